@@ -1,6 +1,7 @@
 #ifndef _AUDIO_H
 #define _AUDIO_H
 
+#include <stdint.h>
 #include "audio/music.h"
 #include "audio/sound.h"
 #include "audio/sink.h"
@@ -13,10 +14,33 @@ int audio_get_sink_count();
 const char* audio_get_sink_name(int id);
 int audio_is_sink_available(const char* sink_name);
 const char* audio_get_first_sink_name();
-int audio_init(const char* sink_name);
+int audio_init(const char* sink_name, int buffer_count, int buffer_size, int voice_count, int period);
 void audio_render();
+int audio_is_threaded();
 void audio_close();
 
+// Safe to call from the main thread while the audio thread is running.
+// audio_play takes ownership of the source.
+unsigned int audio_play(audio_source *src, float volume, float panning, float pitch);
+unsigned int audio_play_sample(const audio_sample *sample, float volume, float panning, float pitch, float priority);
+void audio_stop(unsigned int sid);
+void audio_set_volume(unsigned int sid, float volume);
+void audio_set_panning(unsigned int sid, float panning);
+void audio_set_pitch(unsigned int sid, float pitch);
+int audio_is_playing(unsigned int sid);
+
+// Buffer depth for streams started from now on
+void audio_set_buffers(int count, int size);
+
 audio_sink* audio_get_sink();
 
+// Output rate of the sink, 0 if there is no sink or it can't tell
+int audio_get_frequency();
+
+// Sinks that mix themselves hand every mixed period to the tap, if one is
+// set. It is called on the audio thread, so it must not block.
+typedef void (*audio_tap_cb)(const int16_t *samples, int frames, int frequency);
+void audio_set_tap(audio_tap_cb tap);
+audio_tap_cb audio_get_tap();
+
 #endif // _AUDIO_H
@@ -0,0 +1,35 @@
+#ifndef _AUDIO_STATS_H
+#define _AUDIO_STATS_H
+
+#include <stdint.h>
+
+/*
+* Health of the audio buffers, for tuning the buffer count and size. The
+* sinks record from the audio worker and the mixing callback, and the
+* overlay and console read from the main thread.
+*/
+typedef struct audio_stats_t {
+    int depth; // Buffers queued ahead of playback on the last stream updated
+    int depth_min; // Lowest depth seen, -1 if no stream has been updated
+    unsigned int underruns; // Times a stream ran dry while playing
+    unsigned int decodes;
+    float decode_ms; // Average time to decode a buffer
+    float decode_max_ms;
+    unsigned int sounds;
+    float latency_ms; // Average time from sound_play to playback
+    float latency_max_ms;
+    int voices; // Sounds and streams playing, as of the last mix or update
+} audio_stats;
+
+void audio_stats_depth(int buffers);
+void audio_stats_underrun();
+void audio_stats_voices(int playing);
+
+// Times are in performance counter units
+void audio_stats_decode(uint64_t counts);
+void audio_stats_latency(uint64_t requested);
+
+void audio_stats_get(audio_stats *stats);
+void audio_stats_reset();
+
+#endif // _AUDIO_STATS_H
@@ -3,12 +3,23 @@
 
 #include "audio/source.h"
 
+// Static ticks a crossfade between tracks takes; the same as a scene fade
+#define MUSIC_FADE_TICKS 30
+
+/* Loads the track in the background, and crossfades to it once it's ready */
 int music_play(unsigned int id);
+/* Opens a track and decodes ahead, so a later music_play(id) starts at once */
+int music_prefetch(unsigned int id);
 /* Equivalent to music_stop() + music_play() */
 int music_reload();
 void music_stop();
+/* Fades the track out instead of cutting it off */
+void music_fade_out();
+/* Starts tracks that have finished loading, and runs the fades */
+void music_tick();
 int music_playing();
 void music_set_volume(float volume);
 unsigned int music_get_resource();
+void music_close();
 
 #endif // _MUSIC_H
@@ -1,7 +1,7 @@
 #ifndef _SINK_H
 #define _SINK_H
 
-#include "utils/hashmap.h"
+#include <stdint.h>
 #include "audio/stream.h"
 #include "audio/source.h"
 
@@ -17,24 +17,69 @@
 #define PANNING_MIN -1.0f
 #define PITCH_MIN 0.5f
 
+// Streaming buffers per stream, and their size in bytes
+#define SINK_DEFAULT_BUFFER_COUNT 4
+#define SINK_DEFAULT_BUFFER_SIZE 16384
+#define SINK_DEFAULT_VOICE_COUNT 16
+#define SINK_DEFAULT_PERIOD 512
+#define SINK_MAX_STREAMS 32
+
 typedef struct audio_sink_t audio_sink;
 typedef struct audio_stream_t audio_stream;
 typedef struct audio_source_t audio_source;
 
 typedef void (*sink_format_stream_cb)(audio_sink *sink, audio_stream *stream);
 typedef void (*sink_close_cb)(audio_sink *sink);
+typedef void (*sink_stream_done_cb)(unsigned int sid);
+
+// Short sample that sinks may keep in static buffers instead of streaming
+typedef struct audio_sample_t {
+    int id;
+    const char *data;
+    int len;
+    int frequency;
+    int bytes;
+    int channels;
+    uint64_t requested; // Performance counter when it was played, for the latency stats
+} audio_sample;
+
+// Streams live in a fixed array of slots. A stream goes to the slot its id
+// points at, or the next free one after it; the slot keeps the whole id,
+// so ids of streams that are gone never match.
+typedef struct sink_slot_t {
+    unsigned int sid; // 0 if the slot is free
+    audio_stream stream;
+} sink_slot;
+
+typedef int (*sink_play_sample_cb)(audio_sink *sink, unsigned int sid, const audio_sample *sample, float volume, float panning, float pitch, float priority);
+typedef int (*sink_stop_voice_cb)(audio_sink *sink, unsigned int sid);
+typedef void (*sink_update_voices_cb)(audio_sink *sink);
 
 struct audio_sink_t {
-    hashmap streams;
+    sink_slot slots[SINK_MAX_STREAMS];
+    int active[SINK_MAX_STREAMS]; // Slots in use, packed for sink_render
+    int active_count;
     void *userdata;
     sink_close_cb close;
     sink_format_stream_cb format_stream;
+    sink_stream_done_cb stream_done;
+    sink_play_sample_cb play_sample;
+    sink_stop_voice_cb stop_voice;
+    sink_update_voices_cb update_voices;
+    int buffer_count;
+    int buffer_size;
+    int voice_count; // Voices for samples, if the sink has a voice pool
+    int period; // Frames per callback, for sinks that mix themselves
+    int frequency; // Output rate, 0 if the sink can't tell
 };
 
 void sink_init(audio_sink *sink);
 unsigned int sink_play(audio_sink *sink, audio_source *src);
 unsigned int sink_play_set(audio_sink *sink, audio_source *src, float volume, float panning, float pitch);
+void sink_play_set_id(audio_sink *sink, unsigned int sid, audio_source *src, float volume, float panning, float pitch);
+void sink_play_sample(audio_sink *sink, unsigned int sid, const audio_sample *sample, float volume, float panning, float pitch, float priority);
 void sink_stop(audio_sink *sink, unsigned int sid);
+void sink_stream_done(audio_sink *sink, unsigned int sid);
 void sink_free(audio_sink *sink);
 void sink_render(audio_sink *sink);
 void sink_format_stream(audio_sink *sink, audio_stream *stream);
@@ -53,5 +98,10 @@ void sink_set_userdata(audio_sink *sink, void *userdata);
 void* sink_get_userdata(audio_sink *sink);
 void sink_set_close_cb(audio_sink *sink, sink_close_cb cbfunc);
 void sink_set_format_stream_cb(audio_sink *sink, sink_format_stream_cb cbfunc);
+void sink_set_stream_done_cb(audio_sink *sink, sink_stream_done_cb cbfunc);
+void sink_set_buffers(audio_sink *sink, int count, int size);
+void sink_set_voice_count(audio_sink *sink, int count);
+void sink_set_period(audio_sink *sink, int period);
+void sink_set_voice_cbs(audio_sink *sink, sink_play_sample_cb play, sink_stop_voice_cb stop, sink_update_voices_cb update);
 
 #endif // _SINK_H
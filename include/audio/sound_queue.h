@@ -0,0 +1,39 @@
+#ifndef _SOUND_QUEUE_H
+#define _SOUND_QUEUE_H
+
+/*
+ * Sound effects triggered during one tick. When a HAR comes apart, every
+ * piece of scrap and drop of oil plays the same few samples at once, which
+ * only adds up to clipping and voices taken from sounds that matter. Here
+ * triggers of the same sample at the same pitch and about the same panning
+ * are merged into one louder sound, and sound_queue_finish then keeps the
+ * loudest ones within per sample and per tick limits.
+ */
+
+#define SOUND_QUEUE_SIZE 32 // Distinct sounds per tick; past this, the quietest one gives way
+#define SOUND_QUEUE_PAN_STEPS 8 // Panning -1..1 is split into this many buckets for merging
+#define SOUND_QUEUE_PER_SAMPLE 2 // Sounds of one sample kept per tick
+#define SOUND_QUEUE_VOICES 8 // Sounds kept per tick
+
+typedef struct queued_sound_t {
+    int id;
+    float volume;
+    float panning;
+    float pitch;
+    int pan_bucket; // Of the first trigger; the merged panning may drift off it
+    int triggers; // Merged into this one
+} queued_sound;
+
+typedef struct sound_queue_t {
+    queued_sound sounds[SOUND_QUEUE_SIZE];
+    int count;
+} sound_queue;
+
+void sound_queue_clear(sound_queue *q);
+void sound_queue_add(sound_queue *q, int id, float volume, float panning, float pitch);
+
+// Drops the sounds over the limits, quietest first. The rest stay in the
+// order they were first triggered in. Returns the number of sounds left.
+int sound_queue_finish(sound_queue *q);
+
+#endif // _SOUND_QUEUE_H
@@ -7,6 +7,9 @@
 
 int dumb_source_init(audio_source *src, const char* file, int channels);
 
+// Drops the module kept for reuse, unless it is playing
+void dumb_source_clear_cache();
+
 #endif // USE_DUMB
 
 #endif // _DUMB_SOURCE_H
@@ -1,12 +1,15 @@
 #ifndef _MODPLUG_SOURCE
 #define _MODPLUG_SOURCE
 
-#ifdef USE_OGGVORBIS
+#ifdef USE_MODPLUG
 
 #include "audio/source.h"
 
 int modplug_source_init(audio_source *src, const char* file, int channels);
 
+// Drops the module kept for reuse
+void modplug_source_clear_cache();
+
 #endif // USE_MODPLUG
 
 #endif // _MODPLUG_SOURCE
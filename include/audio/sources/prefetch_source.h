@@ -0,0 +1,10 @@
+#ifndef _PREFETCH_SOURCE_H
+#define _PREFETCH_SOURCE_H
+
+#include "audio/source.h"
+
+// Wraps another source and decodes it ahead of playback on its own thread.
+// On success the wrapper owns inner and frees it on close.
+int prefetch_source_init(audio_source *src, audio_source *inner, int ms);
+
+#endif // _PREFETCH_SOURCE_H
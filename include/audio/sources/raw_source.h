@@ -3,6 +3,6 @@
 
 #include "audio/source.h"
 
-int raw_source_init(audio_source *src, char *buffer, int len);
+int raw_source_init(audio_source *src, char *buffer, int len, int frequency, int bytes);
 
 #endif // _RAW_SOURCE_H
@@ -15,8 +15,18 @@ void console_tick();
 void console_add_cmd(const char *name, command_func func, const char *doc);
 void console_remove_cmd(const char *name);
 
+// Queues the commands of a script file, one per line. Blank lines and lines
+// starting with # are skipped. A script run from a script goes before the
+// rest of the outer one.
+int console_exec_file(const char *path);
+
+// Runs queued script lines until one waits, see the wait command
+void console_script_tick(game_state *gs);
+void console_script_wait(game_state *gs, unsigned int ticks);
+
 void console_output_add(const char *text);
 void console_output_addline(const char *text);
+void console_output_clear();
 
 int console_window_is_open();
 void console_window_open();
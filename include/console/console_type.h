@@ -4,14 +4,19 @@
 #include <SDL2/SDL.h>
 #include "game/protos/scene.h"
 
+// Output is kept as a ring of lines. Lines longer than the screen is wide
+// are cut at CONSOLE_LINE_LEN.
+#define CONSOLE_LINES 128
+#define CONSOLE_LINE_LEN 64
+
 typedef struct console_t {
     font font;
     list history;
     int histpos;
     int histpos_changed;
-    char output[4810];
-    unsigned int output_head, output_tail, output_pos;
-    int output_overflowing;
+    char output[CONSOLE_LINES][CONSOLE_LINE_LEN];
+    unsigned int output_last; // Number of the line being written to
+    unsigned int output_pos; // Number of the first visible line
     char input[41];
     surface background;
     int isopen;
@@ -19,6 +24,9 @@ typedef struct console_t {
     int ypos;
     unsigned int ticks, dir;
     hashmap cmds; // string -> command
+    list script; // Lines of exec scripts still to run
+    unsigned int script_wait; // Ticks to go before the next script line
+    unsigned int script_tick; // Tick the wait was last counted down at
 } console;
 
 typedef struct command_t {
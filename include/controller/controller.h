@@ -1,6 +1,7 @@
 #ifndef _CONTROLLER_H
 #define _CONTROLLER_H
 
+#include <SDL2/SDL.h>
 #include "game/protos/object.h"
 #include "game/objects/har.h"
 #include "game/utils/serial.h"
@@ -23,14 +24,17 @@ enum {
     CTRL_TYPE_GAMEPAD,
     CTRL_TYPE_NETWORK,
     CTRL_TYPE_AI,
-    CTRL_TYPE_REC
+    CTRL_TYPE_REC,
+    CTRL_TYPE_SPECTATOR
 };
 
 enum {
     EVENT_TYPE_ACTION,
     EVENT_TYPE_SYNC,
     EVENT_TYPE_HB,
-    EVENT_TYPE_CLOSE
+    EVENT_TYPE_CLOSE,
+    EVENT_TYPE_ACK,
+    EVENT_TYPE_INPUTS
 };
 
 typedef struct ctrl_event_t ctrl_event;
@@ -41,14 +45,27 @@ struct ctrl_event_t {
         int action;
         serial *ser;
     } event_data;
+    int tick; // Game tick the event belongs to, or -1 for the current tick
     ctrl_event *next;
+    ctrl_event *last; // Last event of the chain. Only valid in the first event.
+    uint8_t pooled; // Event lives in the shared event buffer
+    SDL_atomic_t in_use; // Claimed with a compare and swap, buffer slots are shared between threads
 };
 
 typedef struct controller_t controller;
 
+// Hooks are kept inline, there are only ever one or two of them
+#define CONTROLLER_MAX_HOOKS 4
+
+typedef struct hook_function_t {
+    void(*fp)(controller *ctrl, int act_type);
+    controller *source;
+} hook_function;
+
 struct controller_t {
     object *har;
-    list hooks;
+    hook_function hooks[CONTROLLER_MAX_HOOKS];
+    int hook_count;
     ctrl_event *extra_events;
     int (*tick_fun)(controller *ctrl, int ticks, ctrl_event **ev);
     int (*dyntick_fun)(controller *ctrl, int ticks, ctrl_event **ev);
@@ -65,6 +82,7 @@ struct controller_t {
 
 void controller_init(controller* ctrl);
 void controller_cmd(controller* ctrl, int action, ctrl_event **ev);
+void controller_cmd_at(controller* ctrl, int action, int tick, ctrl_event **ev);
 void controller_sync(controller *ctrl, serial *ser, ctrl_event **ev);
 void controller_close(controller* ctrl, ctrl_event **ev);
 int controller_poll(controller *ctrl, ctrl_event **ev);
@@ -78,4 +96,9 @@ void controller_free_chain(ctrl_event *ev);
 void controller_set_repeat(controller *ctrl, int repeat);
 int controller_rumble(controller *ctrl, float magnitude, int duration);
 
+// Time the dynamic tick being polled is due at, 0 if nobody set it. Local
+// input devices only report what happened up to that moment.
+void controller_set_tick_time(Uint32 time);
+Uint32 controller_get_tick_time();
+
 #endif // _CONTROLLER_H
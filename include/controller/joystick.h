@@ -4,8 +4,12 @@
 #include "controller/controller.h"
 #include <SDL2/SDL.h>
 
+#define JOYSTICK_EVENT_QUEUE_SIZE 64
+#define JOYSTICK_MAX_DEVICES 16
+
 typedef struct joystick_keys_t joystick_keys;
 typedef struct joystick_t joystick;
+typedef struct joystick_input_event_t joystick_input_event;
 
 struct joystick_keys_t {
     int x_axis;
@@ -16,6 +20,13 @@ struct joystick_keys_t {
     int escape;
 };
 
+struct joystick_input_event_t {
+    Uint32 timestamp;
+    uint8_t axis; // Axis motion instead of a button
+    uint8_t index;
+    Sint16 value;
+};
+
 struct joystick_t {
     SDL_GameController *joy;
     SDL_Haptic *haptic;
@@ -23,8 +34,39 @@ struct joystick_t {
     int rumble;
     int last;
     int current;
+
+    // The device this controller reads. If it is unplugged, the controller
+    // stays around without input until a device with the same GUID returns.
+    SDL_JoystickID instance;
+    SDL_JoystickGUID guid;
+    int attached;
+
+    // Button and axis events as SDL receives them, applied by the first
+    // tick that is due at or after the time they happened
+    SDL_SpinLock lock;
+    joystick_input_event queue[JOYSTICK_EVENT_QUEUE_SIZE];
+    unsigned int queue_head;
+    unsigned int queue_tail;
+    uint8_t held[SDL_CONTROLLER_BUTTON_MAX];
+    uint8_t pressed[SDL_CONTROLLER_BUTTON_MAX]; // Went down since the last poll
+    Sint16 axes[SDL_CONTROLLER_AXIS_MAX];
+
+    // Last effect handed to the rumble thread, and the one waiting for it
+    float rumble_sent;
+    Uint32 rumble_until;
+    float rumble_magnitude;
+    int rumble_duration;
+    int rumble_pending;
 };
 
+// Keeps a list of the attached devices. Mappings are read from the built-in
+// database and the given file only when a device needs one.
+void joystick_init(const char *mapping_file);
+void joystick_close();
+
+// Device added and removed events from the engine loop
+void joystick_device_event(const SDL_Event *event);
+
 int joystick_create(controller *ctrl, int joystick_id);
 void joystick_free(controller *ctrl);
 
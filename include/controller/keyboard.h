@@ -5,9 +5,22 @@
 #include <SDL2/SDL.h>
 
 #define KEYBOARD_INPUT_BUFFER_SIZE 16
+#define KEYBOARD_EVENT_QUEUE_SIZE 64
+
+enum {
+    KEY_UP = 0,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_PUNCH,
+    KEY_KICK,
+    KEY_ESCAPE,
+    KEY_COUNT
+};
 
 typedef struct keyboard_keys_t keyboard_keys;
 typedef struct keyboard_t keyboard;
+typedef struct keyboard_key_event_t keyboard_key_event;
 
 struct keyboard_keys_t {
     int up;
@@ -19,10 +32,25 @@ struct keyboard_keys_t {
     int escape;
 };
 
+struct keyboard_key_event_t {
+    Uint32 timestamp;
+    uint8_t key;
+    uint8_t down;
+};
+
 struct keyboard_t {
     keyboard_keys *keys;
     int last;
     int current;
+
+    // Key events as SDL receives them. Each one is applied by the first
+    // tick that is due at or after the time it happened.
+    SDL_SpinLock lock;
+    keyboard_key_event queue[KEYBOARD_EVENT_QUEUE_SIZE];
+    unsigned int queue_head;
+    unsigned int queue_tail;
+    uint8_t held[KEY_COUNT];
+    uint8_t pressed[KEY_COUNT]; // Went down since the last poll, so short taps are not lost
 };
 
 void keyboard_create(controller *ctrl, keyboard_keys *keys, int delay);
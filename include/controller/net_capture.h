@@ -0,0 +1,51 @@
+#ifndef _NET_CAPTURE_H
+#define _NET_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <enet/enet.h>
+
+/*
+ * Opt-in capture of the netplay packets, for looking into lag reports. Every
+ * packet the net controller sends or receives is written with the time since
+ * the capture started, the game tick, the channel and the contents. A
+ * "capture" instant is added to a running trace when the capture starts, so
+ * the two can be lined up.
+ *
+ * File layout: "ONCP", a version byte, then one record per packet: a kind
+ * byte (direction, channel and enet flags), the microseconds since the
+ * previous record, the game tick (or -1) and the length as varints,
+ * followed by the packet data.
+ */
+
+enum {
+    NET_CAPTURE_OUT = 0,
+    NET_CAPTURE_IN,
+};
+
+typedef struct net_capture_record_t {
+    uint64_t time_us; // Since the capture started
+    int dir;
+    int channel;
+    uint32_t flags; // ENET_PACKET_FLAG_*
+    int tick;
+    const char *data;
+    size_t len;
+} net_capture_record;
+
+// Return nonzero to stop reading
+typedef int (*net_capture_cb)(const net_capture_record *rec, void *userdata);
+
+int net_capture_start(const char *filename);
+void net_capture_stop();
+int net_capture_is_active();
+void net_capture_packet(int dir, int channel, const ENetPacket *packet, int tick);
+
+// Returns the number of records read, or -1 if the file is not a capture
+int net_capture_read(const char *filename, net_capture_cb cb, void *userdata);
+
+// Connects to a game listening on host:port and sends it the packets that
+// were received in the capture, with their original timing, as the peer did
+int net_capture_replay(const char *filename, const char *host, int port);
+
+#endif // _NET_CAPTURE_H
@@ -2,12 +2,41 @@
 #define _NET_CONTROLLER_H
 
 #include "controller/controller.h"
+#include "controller/net_service.h"
 #include <SDL2/SDL.h>
 #include <enet/enet.h>
 
-void net_controller_create(controller *ctrl, ENetHost *host, ENetPeer *peer, int id);
+enum {
+    NET_CHANNEL_DEFAULT = 0,
+    NET_CHANNEL_GAME,
+    NET_CHANNEL_INPUT,
+    NET_CHANNEL_COUNT
+};
+
+typedef struct net_stats_t {
+    unsigned int bytes_sent;
+    unsigned int bytes_received;
+    unsigned int sync_raw_bytes; // Size of the sent states before delta encoding
+    unsigned int sync_bytes; // Size of the sent sync packets
+    unsigned int keyframes;
+    unsigned int deltas;
+    unsigned int desyncs; // State hash mismatches
+    unsigned int start_ticks;
+
+    // Clock sync, see net_controller_clock_sample
+    float rtt_ms; // Smoothed round trip time
+    float jitter_ms; // Smoothed deviation of the round trip time
+    float loss; // Share of recent heartbeats that got no answer
+    int frame_advantage; // Ticks we are ahead of the peer
+    int input_delay; // Ticks local moves are delayed by
+} net_stats;
+
+void net_controller_create(controller *ctrl, net_service *service, ENetPeer *peer, int id);
 void net_controller_free(controller *ctrl);
 int net_controller_get_rtt(controller *ctrl);
+int net_controller_get_input_delay(controller *ctrl);
 void net_controller_har_hook(int action, void *cb_data);
+const net_stats* net_controller_get_stats(controller *ctrl);
+int net_controller_take_desync(controller *ctrl);
 
 #endif // _NET_CONTROLLER_H
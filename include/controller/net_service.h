@@ -0,0 +1,60 @@
+#ifndef _NET_SERVICE_H
+#define _NET_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <enet/enet.h>
+
+/*
+ * Services an ENetHost on a thread of its own. Once the host is handed over
+ * the game thread must not touch it anymore; it queues packets to send and
+ * polls the received events, neither of which blocks. Queued packets are
+ * held back until net_service_flush, so a tick's worth of them goes out in
+ * one datagram.
+ */
+typedef struct net_service_t net_service;
+
+net_service* net_service_create(ENetHost *host);
+int net_service_poll(net_service *ns, ENetEvent *event);
+int net_service_send(net_service *ns, ENetPeer *peer, int channel, ENetPacket *packet);
+void net_service_flush(net_service *ns);
+
+// Disconnects all peers and destroys the host in the background. The
+// service must not be used after this.
+void net_service_close(net_service *ns);
+
+// Waits for closed services to finish disconnecting, at most timeout ms
+void net_service_wait_all(unsigned int timeout);
+
+/*
+ * Network condition emulation, for testing netplay over bad connections.
+ * The conditions apply to the packets this process sends, per channel, so
+ * both peers need them set for a symmetric link. Only unreliable packets are
+ * lost or duplicated. Reliable ones stay in order, a lost one arrives late
+ * and holds up the ones behind it, as it would when enet resends it.
+ */
+#define NET_EMU_CHANNELS 8
+
+typedef struct net_emu_t {
+    int latency; // ms
+    int jitter; // ms, added to or taken off the latency at random
+    int loss; // percent
+    int dup; // percent
+    int reorder; // percent, these are held back for another latency + jitter
+} net_emu;
+
+// A channel of -1 means all of them
+void net_emu_set(int channel, const net_emu *emu);
+void net_emu_get(int channel, net_emu *emu);
+
+// Services created after this pick their random numbers from the seed
+void net_emu_seed(uint32_t seed);
+
+// Takes "off", or comma or space separated key=value pairs, eg.
+// "latency=80,jitter=10,loss=2". Keys are latency, jitter, loss, dup,
+// reorder, seed and channel; pairs after a channel only apply to that
+// channel. Returns 0 if the whole spec was valid, nothing is changed otherwise.
+int net_emu_parse(const char *spec);
+void net_emu_to_str(int channel, char *buf, size_t len);
+
+#endif // _NET_SERVICE_H
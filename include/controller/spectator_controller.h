@@ -0,0 +1,11 @@
+#ifndef _SPECTATOR_CONTROLLER_H
+#define _SPECTATOR_CONTROLLER_H
+
+#include "controller/controller.h"
+#include "game/game_state_type.h"
+
+void spectator_controller_create(controller *ctrl, game_state *gs, int player);
+void spectator_controller_free(controller *ctrl);
+int spectator_controller_get_delay(controller *ctrl);
+
+#endif // _SPECTATOR_CONTROLLER_H
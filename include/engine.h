@@ -5,9 +5,28 @@ typedef struct engine_init_flags_t {
     unsigned int net_mode;
     unsigned int record;
     char rec_file[255];
+    unsigned int fast_sim; // Server only: tick as fast as possible instead of at wall-clock rate
+    unsigned int benchmark; // Play rec_file with one tick and one rendered frame per loop, then report frame times
+    char encode_cmd[255]; // Benchmark only: stream the frames into this encoder command
+    unsigned int null_video; // No window; frames are built but never drawn, see VIDEO_RENDERER_NULL
+    unsigned int alloc_check; // Report allocations in ticks and frames once a fight has settled
+    // Replay only: write or check per tick state hashes, see game/utils/hash_log.h
+    char hash_file[255];
+    int hash_mode;
+    unsigned int dump_tick;
+    unsigned int check_failed; // Set when the hash check found a desync, or the load benchmark failed
+    // Server only: play one AI against AI match, write the result to match_result and quit
+    unsigned int ai_match;
+    int match_har[2];
+    int match_pilot[2];
+    int match_difficulty[2];
+    unsigned int match_seed;
+    char match_result[255];
+    char exec_file[255]; // Console script to run once the game is up, see console_exec_file
+    char load_bench[255]; // Time loading every arena and HAR, write the times here as JSON and quit
 } engine_init_flags;
 
-int engine_init(); // Init window, audiodevice, etc.
+int engine_init(const engine_init_flags *init_flags); // Init window, audiodevice, etc.
 void engine_run(engine_init_flags *init_flags); // Run game
 void engine_close(); // Kill window, audiodev
 
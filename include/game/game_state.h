@@ -7,6 +7,12 @@
 #include "game/utils/serial.h"
 #include "game/game_state_type.h"
 
+// Roughly the size of a serialized game state, used to preallocate buffers
+#define GAME_STATE_SERIAL_SIZE_HINT 1024
+
+// Bump whenever the layout of serialized states changes
+#define GAME_STATE_SERIAL_VERSION 3
+
 typedef struct scene_t scene;
 typedef struct game_player_t game_player;
 typedef struct object_t object;
@@ -23,15 +29,48 @@ unsigned int game_state_get_tick(game_state *gs);
 scene* game_state_get_scene(game_state *gs);
 unsigned int game_state_is_running(game_state *gs);
 unsigned int game_state_is_paused(game_state *gs);
+int game_state_is_idle(game_state *gs);
 void game_state_set_paused(game_state *gs, unsigned int paused);
+int game_state_is_simulated(game_state *gs);
+int game_state_is_speculative(game_state *gs);
+void game_state_play_sound(game_state *gs, int id, float volume, float panning, float pitch);
+uint32_t game_state_rand_int(game_state *gs, uint32_t upperbound);
+float game_state_rand_float(game_state *gs);
 void game_state_set_next(game_state *gs, unsigned int next_scene_id);
+int game_load_new(game_state *gs, int scene_id); // Switches scenes right away, see game_state_set_next
 game_player* game_state_get_player(game_state *gs, int player_id);
 int game_state_num_players(game_state *gs);
 void game_state_init_demo(game_state *gs);
 int game_state_ms_per_dyntick(game_state *gs);
+void game_state_set_render_alpha(game_state *gs, float alpha);
+int game_state_limit_backlog(game_state *gs, int *dynamic_wait, int max_ticks);
 ticktimer* game_state_get_ticktimer(game_state *gs);
 int game_state_serialize(game_state *gs, serial *ser);
 int game_state_unserialize(game_state *gs, serial *ser, int rtt);
+int game_state_hash(game_state *gs, uint32_t *hash);
+uint32_t game_state_tick_hash(game_state *gs);
+int game_state_get_tick_hash(game_state *gs, unsigned int tick, uint32_t *hash);
+int game_state_rec_seek(game_state *gs, unsigned int tick);
+int game_state_history_start(game_state *gs, unsigned int seconds);
+void game_state_history_stop(game_state *gs);
+void game_state_history_save(game_state *gs);
+int game_state_history_seek(game_state *gs, unsigned int tick);
+int game_state_history_reset(game_state *gs);
+void game_state_save_snapshot(game_state *gs);
+void game_state_clear_snapshots(game_state *gs);
+void game_state_set_spectate(game_state *gs, spectate *sp);
+void game_state_record_action(game_state *gs, int player_id, int action);
+int game_state_rollback_action(game_state *gs, int player_id, int action, int tick);
+
+// Scratch states for simulating ahead of the real one
+int game_state_fork_create(game_state *fork, game_state *gs);
+void game_state_fork_sync(game_state *fork, game_state *gs, serial *buf);
+void game_state_fork_reset(game_state *fork, serial *buf);
+void game_state_fork_tick(game_state *fork);
+void game_state_fork_clear(game_state *fork);
+void game_state_fork_free(game_state *fork);
+
+void game_state_run_ahead(game_state *gs, int ticks);
 
 void _setup_keyboard(game_state *gs, int player_id);
 void _setup_ai(game_state *gs, int player_id);
@@ -44,12 +83,19 @@ void game_state_replay(game_state *gs, int rtt);
 void game_state_slowdown(game_state *gs, int ticks, int rate);
 
 void game_state_set_speed(game_state *gs, int speed);
+void game_state_set_fixed_physics(game_state *gs, int enabled);
 unsigned int game_state_get_speed(game_state *gs);
 
 int game_state_add_object(game_state *gs, object *obj, int layer, int singleton, int persistent);
 void game_state_del_object(game_state *gs, object *obj);
 void game_state_del_animation(game_state *gs, int anim_id);
-void game_state_get_projectiles(game_state *gs, vector *obj_proj);
+const vector* game_state_get_projectiles(game_state *gs);
 void game_state_clear_hazards_projectiles(game_state *gs);
+unsigned int game_state_count_objects(game_state *gs, int layers);
+
+object* game_state_alloc_object(game_state *gs);
+void game_state_free_object(game_state *gs, object *obj);
+void* game_state_alloc_userdata(game_state *gs, unsigned int size);
+void game_state_free_userdata(game_state *gs, void *ptr);
 
 #endif // _GAME_STATE_H
@@ -1,9 +1,20 @@
 #ifndef _GAME_STATE_TYPE_H
 #define _GAME_STATE_TYPE_H
 
+#include <stdint.h>
 #include "utils/vector.h"
+#include "utils/mempool.h"
+#include "utils/random.h"
+#include "audio/sound_queue.h"
+#include "game/utils/serial.h"
+#include "game/utils/hash_log.h"
+#include "game/particles.h"
 #include "engine.h"
 
+// Animation IDs that singleton objects are tracked for. Larger ones are
+// looked for among the objects.
+#define GAME_STATE_SINGLETON_IDS 256
+
 enum {
     RENDER_LAYER_BOTTOM = 0,
     RENDER_LAYER_MIDDLE,
@@ -21,9 +32,53 @@ enum {
     NET_MODE_SERVER
 };
 
+// Netplay keeps this many past ticks around for rolling back
+#define ROLLBACK_TICKS 32
+#define ROLLBACK_MAX_ACTIONS 8
+// Per-tick state hashes kept for comparing against the peer's
+#define TICK_HASH_HISTORY 64
+// Most ticks the frame can be drawn ahead of the simulation, see game_state_run_ahead
+#define RUN_AHEAD_MAX_TICKS 4
+
+typedef struct game_snapshot_t {
+    unsigned int tick;
+    int valid;
+    serial state; // State at the start of the tick
+    uint8_t action_count[2];
+    int actions[2][ROLLBACK_MAX_ACTIONS]; // Actions applied during the tick
+    uint8_t delays[2]; // HAR move delays the actions were applied with
+} game_snapshot;
+
+// Sounds from resimulated ticks that had not been played yet, see
+// game_state_play_sound
+#define DEFERRED_SOUNDS 16
+
+typedef struct deferred_sound_t {
+    int id;
+    float volume;
+    float panning;
+    float pitch;
+} deferred_sound;
+
 typedef struct scene_t scene;
+typedef struct object_t object;
 typedef struct game_player_t game_player;
 typedef struct ticktimer_t ticktimer;
+typedef struct rec_index_t rec_index;
+typedef struct state_history_t state_history;
+typedef struct spectate_t spectate;
+
+// Flat copies of the fields that the collision pair scan filters on,
+// gathered once per tick so that the scan only touches the objects of
+// pairs that can actually collide.
+typedef struct collide_table_t {
+    unsigned int size;
+    unsigned int capacity;
+    object **objs;
+    uint8_t *layers;
+    int8_t *groups;
+    uint8_t *starts; // Whether the object can be the first one of a pair
+} collide_table;
 
 typedef struct game_state_t {
     unsigned int run;
@@ -35,6 +90,15 @@ typedef struct game_state_t {
     unsigned int int_tick; // never adjusted, used in ping calculation
     unsigned int role;
     unsigned int speed;
+    unsigned int fixed_physics; // Keep positions on the fixed point grid, see object_move
+    unsigned int simulated; // Scratch state for looking ahead, see game_state_fork_create
+    unsigned int resimulating; // Running ticks over again after a rollback or sync
+    unsigned int heard_tick; // Ticks before this one have had their sounds played
+    deferred_sound deferred_sounds[DEFERRED_SOUNDS];
+    int deferred_count;
+    sound_queue sounds; // Triggered during this tick, played at its end
+    int catchup_ms; // Left to make up after a sync, see game_state_unserialize
+    struct random_t rand; // Random numbers for the simulation, part of the serialized state
     engine_init_flags *init_flags;
 
     // For screen shaking
@@ -49,11 +113,60 @@ typedef struct game_state_t {
     int next_wait_ticks;
     int this_wait_ticks;
 
-    int next_requires_refresh; // If next frame requires a texture refresh, this should be set to 1
+    // Fighting ticks in a row, allocations are checked for once past warm up
+    unsigned int steady_ticks;
+
     int net_mode; // NET_MODE_NONE, NET_MODE_CLIENT, NET_MODE_SERVER
+    float render_alpha; // How far along the next dynamic tick is, see game_state_set_render_alpha
     scene *sc;
     vector objects;
+    uint8_t singletons[GAME_STATE_SINGLETON_IDS]; // 1 if a singleton object of the animation ID is alive
     game_player *players[2];
+
+    // Objects to render per layer, and objects that cast shadows. Rebuilt
+    // from objects when render_lists_dirty is set.
+    vector render_lists[3];
+    vector shadow_list;
+    int render_lists_dirty;
+    vector projectiles; // See game_state_get_projectiles
+    int projectiles_dirty;
+    vector tick_order; // Objects grouped by kind for ticking, see game_state_get_tick_order
+    int tick_order_dirty;
+    collide_table collide;
+
+    // Storage for spawned objects and their specialization data
+    mempool obj_pool;
+    mempool userdata_pool;
+
+    // Ring of ROLLBACK_TICKS snapshots, allocated on first use
+    game_snapshot *snapshots;
+
+    // Hash of the state at the start of each recent tick, see game_state_tick_hash
+    uint32_t tick_hashes[TICK_HASH_HISTORY];
+    unsigned int tick_hash_ticks[TICK_HASH_HISTORY];
+
+    // Keyframes of the recording being played back, if it has any
+    rec_index *rec_idx;
+
+    // States of the last seconds of the fight for rewinding, see game_state_history_start
+    state_history *history;
+
+    // Spectator broadcast being sent or followed, see game_state_set_spectate
+    spectate *spectate;
+
+    // Scrap and oil that need no object of their own
+    particle_system particles;
+
+    // Per tick hashes being written or checked, if any
+    hash_log *hashes;
+
+    // Fork the HARs and projectiles are drawn from with run-ahead, allocated
+    // on first use. See game_state_run_ahead.
+    struct game_state_t *ahead;
+    serial ahead_state;
+    unsigned int ahead_tick; // Tick of this state the fork was run from
+    int ahead_valid;
+    int last_action[2]; // Last action applied for each player, for running ahead with
 } game_state;
 
 #endif // _GAME_STATE_TYPE_H
@@ -11,6 +11,7 @@
 
 #include <SDL2/SDL.h>
 #include "controller/controller.h"
+#include "video/video.h"
 
 enum {
     COM_ENABLED = 0,   ///< Component enabled. Component is colored and can be interacted with.
@@ -61,6 +62,9 @@ struct component_t {
     char supports_focus;        ///< Whether the component can be focused by component_focus() call.
     char is_focused;            ///< Whether the component is focused
 
+    char is_dirty;              ///< Whether the component looks different than when it was last drawn
+    video_draw_list *draw_list; ///< Draws of the last render, replayed while the component is not dirty. NULL if not cached.
+
     component_render_cb render; ///< Render function callback. This tells the component to draw itself.
     component_event_cb event;   ///< Event function callback. Direct SDL2 event handler.
     component_action_cb action; ///< Action function callback. Handles OpenOMF abstract key events.
@@ -90,6 +94,9 @@ int component_is_disabled(const component *c);
 int component_is_selected(const component *c);
 int component_is_focused(const component *c);
 
+void component_set_cached(component *c);
+void component_set_dirty(component *c);
+
 void component_set_size_hints(component *c, int w, int h);
 void component_set_pos_hints(component *c, int x, int y);
 
@@ -8,6 +8,8 @@ typedef void (*menu_tick_cb)(component *c);
 typedef void (*menu_free_cb)(component *c);
 typedef void (*menu_submenu_done_cb)(component *menu, component *submenu);
 
+#define MENU_SUBMENU_SLOTS 4
+
 typedef struct  {
     surface *bg;
     int selected;
@@ -18,6 +20,8 @@ typedef struct  {
     char prev_submenu_state;
     component *submenu;
     menu_submenu_done_cb submenu_done;
+    component *kept[MENU_SUBMENU_SLOTS]; // Submenus kept around for reopening
+
 
     void *userdata;
     menu_free_cb free;
@@ -32,6 +36,13 @@ int menu_is_finished(const component *menu);
 
 void menu_set_submenu(component *menu, component *submenu);
 component* menu_get_submenu(const component *menu);
+
+// Like menu_set_submenu, but the submenu is kept in the given slot once
+// closed, and menu_get_kept_submenu hands it back ready to be opened again.
+// Only for submenus that show no state of their own, eg. ones with widgets
+// bound to settings.
+void menu_set_kept_submenu(component *menu, int slot, component *submenu);
+component* menu_get_kept_submenu(const component *menu, int slot);
 void menu_set_submenu_done_cb(component *menu, menu_submenu_done_cb done_cb);
 
 void menu_set_userdata(component *menu, void *userdata);
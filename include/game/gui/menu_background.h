@@ -7,4 +7,8 @@ void menu_background_create(surface *sur, int w, int h);
 void menu_background2_create(surface *sur, int w, int h);
 void menu_background_border_create(surface *sur, int w, int h);
 
+// Backgrounds of the same style and size share their pixels. The surfaces
+// are freed as usual; this lets go of the ones kept for sharing.
+void menu_background_cache_clear();
+
 #endif // _MENU_BACKGROUND_H
@@ -63,6 +63,10 @@ void text_render_char(const text_settings *settings, int x, int y, char ch);
 void text_render(const text_settings *settings, int x, int y, int w, int h, const char *text);
 int text_char_width(const text_settings *settings);
 
+// Cached layouts and composited text surfaces
+void text_cache_clear();
+void text_cache_close();
+
 // Old functions
 void font_get_wrapped_size(const font *font, const char *text, int max_w, int *out_w, int *out_h);
 void font_get_wrapped_size_shadowed(const font *font, const char *text, int max_w, int shadow_flag, int *out_w, int *out_h);
@@ -23,20 +23,6 @@
 
 #define GROUP_PROJECTILE 2
 
-enum {
-    CAT_MISC = 0,
-    CAT_CLOSE = 2,
-    CAT_LOW = 4,
-    CAT_MEDIUM = 5,
-    CAT_HIGH,
-    CAT_JUMPING,
-    CAT_PROJECTILE,
-    CAT_BASIC,
-    CAT_VICTORY = 10, // or defeat
-    CAT_SCRAP = 12,
-    CAT_DESTRUCTION
-};
-
 enum {
     STATE_STANDING = 1,
     STATE_WALKTO,
@@ -87,6 +73,17 @@ typedef struct har_event_t {
     };
 } har_event;
 
+// HAR conditions that decide which moves can be executed. Every
+// combination of these has a precomputed mask of allowed moves.
+enum {
+    MOVE_FILTER_JUMPING = 0x01,
+    MOVE_FILTER_VICTORY = 0x02,
+    MOVE_FILTER_SCRAP = 0x04,
+    MOVE_FILTER_CLOSE = 0x08,
+    MOVE_FILTER_WALL = 0x10,
+    MOVE_FILTER_COUNT = 0x20
+};
+
 enum {
     DAMAGETYPE_LOW, // Damage to low area of har
     DAMAGETYPE_HIGH // Damage to high area of har
@@ -100,6 +97,9 @@ typedef struct har_hook_t {
     void *data;
 } har_hook;
 
+// Hooks are kept inline, the arena is the only one installing any
+#define HAR_MAX_HOOKS 4
+
 typedef struct action_buffer_t {
     char actions[10];
     uint8_t count;
@@ -128,9 +128,14 @@ typedef struct har_t {
 
     int16_t health_max, health;
     int16_t endurance_max, endurance;
-    char inputs[11];
+    // The latest inputs as a ring, newest at input_head. See har_add_input.
+    char inputs[MOVE_TRIE_MAX_INPUTS];
+    uint8_t input_head;
+    int move_node; // Where the inputs since the last move lead to in the AF's move trie
     uint8_t hard_close;
 
+    move_mask move_filters[MOVE_FILTER_COUNT]; // Allowed moves per MOVE_FILTER_* combination
+
     uint8_t stun_timer;
     uint8_t delay; // used for 'stretching' frames in netplay
 
@@ -142,7 +147,8 @@ typedef struct har_t {
     unsigned int p_ticks_length;
     uint8_t p_color_fn;
 
-    list har_hooks;
+    har_hook har_hooks[HAR_MAX_HOOKS];
+    int har_hook_count;
 
     har_action_hook_cb action_hook_cb;
     void *action_hook_cb_data;
@@ -164,5 +170,6 @@ int har_is_crouching(har *h);
 int har_is_walking(har *h);
 int har_is_blocking(har *h, af_move *move);
 void har_copy_actions(object *new, object *old);
+int har_move_filter(har *h);
 
 #endif // _HAR_H
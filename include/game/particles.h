@@ -0,0 +1,68 @@
+#ifndef _PARTICLES_H
+#define _PARTICLES_H
+
+#include <stdint.h>
+#include "resources/animation.h"
+#include "utils/vec.h"
+
+#define PARTICLE_MAX 512
+#define PARTICLE_MAX_ANIMATIONS 16
+
+/*
+ * Scrap, oil drops and other debris that nothing collides with. These are
+ * simulated and drawn by the game state in one pass each, instead of being
+ * full objects. Only animations whose strings do nothing but show sprites,
+ * rewind and blend can be used; the rest still need objects.
+ */
+typedef struct particle_frame_t {
+    int start; // First tick of the frame
+    int len;
+    int sprite; // Sprite index, -1 for none
+    int rewind; // Tick to jump to when the frame is entered, -1 if none
+    uint8_t additive;
+} particle_frame;
+
+typedef struct particle_anim_t {
+    animation *ani;
+    int frame_count;
+    int total_ticks;
+    particle_frame *frames; // NULL if the animation can't be used for particles
+} particle_anim;
+
+typedef struct particle_t {
+    vec2i pos;
+    vec2f vel;
+    float gravity;
+    const particle_anim *anim;
+    sprite *cur_sprite;
+    int tick;
+    uint8_t additive;
+    uint8_t pal_offset;
+    uint8_t layer;
+    uint8_t shadow;
+    uint8_t resting; // Lying on the floor, so the rewind tag no longer loops
+    uint8_t fresh; // Spawned during this tick, has not moved yet
+} particle;
+
+typedef struct particle_system_t {
+    particle *pool; // PARTICLE_MAX entries, allocated on first spawn
+    int count;
+    particle_anim anims[PARTICLE_MAX_ANIMATIONS];
+    int anim_count;
+} particle_system;
+
+void particles_create(particle_system *ps);
+void particles_free(particle_system *ps);
+
+// Drops the particles, and the animations they were made of
+void particles_clear(particle_system *ps);
+
+// Returns 1 if the animation can't be shown as a particle. Without room the
+// particle is dropped, since it only shows; nothing in the game depends on it.
+int particles_spawn(particle_system *ps, animation *ani, vec2i pos, vec2f vel,
+                    float gravity, int pal_offset, int layer, int shadow);
+void particles_tick(particle_system *ps);
+void particles_render(const particle_system *ps, int layer);
+void particles_render_shadows(const particle_system *ps);
+
+#endif // _PARTICLES_H
@@ -41,6 +41,22 @@ enum {
 typedef struct object_t object;
 typedef struct game_state_t game_state;
 
+// The current frame placed in the world, for hit point checks. Worked out
+// once and used for every object it is checked against, see intersect.c.
+typedef struct object_hit_frame_t {
+    const sprite *sprite; // Frame it was worked out for, NULL if none yet
+    const animation *animation;
+    vec2i obj_pos;
+    int direction;
+    vec2i pos; // Top left corner of the sprite, mirrored when facing left
+    vec2i size;
+    collision_coord *coords; // Hit points of the frame
+    int coord_count;
+    vec2i base; // World position of hit point 0,0
+    int sign; // Hit point x goes this way, -1 when facing left
+    vec2i hit_min, hit_max; // Box around the hit points, in the world
+} object_hit_frame;
+
 typedef void (*object_free_cb)(object *obj);
 typedef int  (*object_act_cb)(object *obj, int action);
 typedef void (*object_tick_cb)(object *obj);
@@ -57,6 +73,7 @@ struct object_t {
 
     vec2f start;
     vec2f pos;
+    vec2f prev_pos; // Position before the last dynamic tick, for render interpolation
     vec2f vel;
     int8_t direction;
     int8_t group;
@@ -66,13 +83,13 @@ struct object_t {
     int8_t can_hit;
 
     int8_t orbit;
-    float orbit_tick;
+    int orbit_tick; // Angle, FIXED_TURN per turn
     vec2f orbit_dest;
     vec2f orbit_dest_dir;
     vec2f orbit_pos;
     vec2f orbit_pos_vary;
 
-    struct random_t rand_state;
+    uint32_t rand_key; // Random stream of the object, see object_random_int
 
     float y_percent;
     float gravity;
@@ -98,6 +115,7 @@ struct object_t {
     uint8_t stride;
     uint8_t cast_shadow;
     surface *cur_surface;
+    object_hit_frame hit_frame;
 
     player_sprite_state sprite_state;
     player_animation_state animation_state;
@@ -224,6 +242,11 @@ void object_set_vx(object *obj, float val);
 void object_set_vy(object *obj, float val);
 
 uint32_t object_get_age(object *obj);
+
+// Returns a random integer in 0 <= r < upperbound. The result only depends on the
+// object's stream, its age and the draw, so a resimulated tick gets the same values.
+// Use a different draw for each value needed in one tick.
+uint32_t object_random_int(object *obj, uint32_t draw, uint32_t upperbound);
 serial* object_get_last_serialization_point(const object *obj);
 serial* object_get_serialization_point(const object *obj, unsigned int ticks_ago);
 
@@ -3,6 +3,8 @@
 
 #include "utils/vec.h"
 #include <shadowdive/script.h>
+#include "resources/frame_tags.h"
+#include "resources/frame_timeline.h"
 
 typedef struct object_t object;
 
@@ -48,7 +50,12 @@ typedef struct player_animation_state_t {
     uint32_t end_frame;
     int previous;
     int entered_frame;
-    sd_script parser;
+    const sd_script *parser; // Decoded animation string; either own_parser or the animation's
+    sd_script own_parser;
+    const tag_table *tags; // Compiled tags of parser; either own_tags or the animation's
+    tag_table own_tags;
+    const frame_timeline *timeline; // Frame start ticks of parser; either own_timeline or the animation's
+    frame_timeline own_timeline;
     uint8_t repeat;
     uint8_t reverse;
     uint8_t finished;
@@ -68,6 +75,9 @@ void player_reload_with_str(object *obj, const char *str);
 void player_reset(object *obj);
 int player_frame_isset(const object *obj, const char *tag);
 int player_frame_get(const object *obj, const char *tag);
+int player_frame_tag_isset(const object *obj, int tag);
+int player_frame_tag_get(const object *obj, int tag);
+const frame_tags* player_get_frame_tags(const object *obj, int frame_index);
 void player_run(object *obj);
 void player_set_repeat(object *obj, int repeat);
 int player_get_repeat(const object *obj);
@@ -24,11 +24,12 @@ typedef void (*scene_tick_cb)(scene *scene, int paused);
 typedef void (*scene_input_poll_cb)(scene *scene);
 typedef void (*scene_startup_cb)(scene *scene, int anim_id, int *m_load, int *m_repeat);
 typedef int (*scene_anim_prio_override_cb)(scene *scene, int anim_id);
+typedef int (*scene_is_idle_cb)(scene *scene);
 
 struct scene_t {
     game_state *gs;
     int id;
-    bk bk_data;
+    bk *bk_data;
     af *af_data[2];
     void *userdata;
 
@@ -41,7 +42,10 @@ struct scene_t {
     scene_input_poll_cb input_poll;
     scene_startup_cb startup;
     scene_anim_prio_override_cb prio_override;
+    scene_is_idle_cb is_idle;
     ticktimer tick_timer;
+    int predecoded; // All deferred sprites of bk_data and af_data are decoded
+    int prewarm_pos; // Next common HAR move to warm up, see scene_prewarm
 };
 
 int scene_create(scene *scene, game_state *gs, int scene_id);
@@ -53,9 +57,12 @@ void scene_render_overlay(scene *scene);
 void scene_render(scene *scene);
 void scene_dynamic_tick(scene *scene, int paused);
 void scene_static_tick(scene *scene, int paused);
+void scene_predecode(scene *scene, int budget);
+void scene_prewarm(scene *scene);
 void scene_input_poll(scene *scene);
 void scene_startup(scene *scene, int id, int *m_load, int *m_startup);
 int scene_anim_prio_override(scene *scene, int anim_id);
+int scene_is_idle(scene *scene);
 
 int scene_serialize(scene *scene, serial *ser);
 int scene_unserialize(scene *scene, serial *ser);
@@ -72,6 +79,7 @@ void scene_set_static_tick_cb(scene *scene, scene_tick_cb cbfunc);
 void scene_set_input_poll_cb(scene *scene, scene_input_poll_cb cbfunc);
 void scene_set_startup_cb(scene *scene, scene_startup_cb cbfunc);
 void scene_set_anim_prio_override_cb(scene *scene, scene_anim_prio_override_cb cbfunc);
+void scene_set_is_idle_cb(scene *scene, scene_is_idle_cb cbfunc);
 void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata);
 void cb_scene_destroy_object(object *parent, int id, void *userdata);
 
@@ -0,0 +1,9 @@
+#ifndef _MENU_SPECTATE_H
+#define _MENU_SPECTATE_H
+
+#include "game/gui/component.h"
+#include "game/protos/scene.h"
+
+component* menu_spectate_create(scene *s);
+
+#endif // _MENU_SPECTATE_H
@@ -0,0 +1,80 @@
+#ifndef _SPECTATE_H
+#define _SPECTATE_H
+
+#include <enet/enet.h>
+#include "game/game_state_type.h"
+#include "game/utils/serial.h"
+#include "utils/vector.h"
+
+// Ticks of input kept on the spectator side
+#define SPECTATE_TICK_BUFFER 1024
+
+enum {
+    SPECTATE_HOST,
+    SPECTATE_CLIENT
+};
+
+// What a spectator needs to set up the arena of a match
+typedef struct spectate_match_t {
+    int seq; // Counts the matches seen on this connection
+    int scene_id;
+    int speed;
+    int har_id[2];
+    int pilot_id[2];
+    char colors[2][3];
+} spectate_match;
+
+// Final inputs of one tick, once no rollback can change them anymore
+typedef struct spectate_tick_t {
+    int tick;
+    uint8_t delay[2];
+    uint8_t count[2];
+    int actions[2][ROLLBACK_MAX_ACTIONS];
+} spectate_tick;
+
+/*
+ * A netplay host broadcasts its match to any number of spectators. A
+ * spectator can forward the broadcast to spectators of its own, so a
+ * relay is a spectator that nobody watches. Both keep the packets a late
+ * joiner needs: the match, the newest keyframes and the inputs since.
+ */
+typedef struct spectate_t {
+    int mode;
+    ENetHost *host; // Downstream spectators connect here, NULL if not relaying
+    vector backlog; // serial copies of packets for late joiners
+
+    // Host: keyframes and the batch of settled ticks waiting to go out
+    serial batch;
+    int batch_count;
+    int full_tick;
+    int delta_tick;
+    serial full; // Newest full keyframe, which deltas are against
+
+    // Spectator
+    ENetHost *upstream;
+    ENetPeer *upstream_peer;
+    int connected;
+    int ended; // Host said the match is over
+    int followed_seq; // Newest match the game has been set up for
+    spectate_match match;
+    spectate_tick ticks[SPECTATE_TICK_BUFFER];
+    serial keyframe;
+    int keyframe_tick;
+    int keyframe_pending;
+} spectate;
+
+int spectate_host_create(spectate *sp, int port);
+int spectate_client_create(spectate *sp, const char *addr, int port, int relay_port);
+void spectate_free(spectate *sp);
+int spectate_service(spectate *sp);
+
+void spectate_host_match(spectate *sp, const spectate_match *match);
+void spectate_host_settle(spectate *sp, const game_snapshot *snap);
+void spectate_host_end(spectate *sp);
+
+int spectate_is_connected(const spectate *sp);
+const spectate_match* spectate_get_match(const spectate *sp);
+const spectate_tick* spectate_get_tick(const spectate *sp, unsigned int tick);
+serial* spectate_take_keyframe(spectate *sp, unsigned int tick);
+
+#endif // _SPECTATE_H
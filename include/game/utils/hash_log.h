@@ -0,0 +1,33 @@
+#ifndef _HASH_LOG_H
+#define _HASH_LOG_H
+
+#include <stdint.h>
+
+/*
+ * Per tick state hashes of a replay, for catching desyncs between builds.
+ * A golden log is written with one "tick hash" line per simulated tick, and
+ * later replays of the same recording are checked against it. At the first
+ * tick that differs, the state is serialized next to the log so it can be
+ * diffed against the same tick from the golden build (see --state-dump).
+ */
+typedef struct hash_log_t hash_log;
+
+enum {
+    HASH_LOG_WRITE,
+    HASH_LOG_CHECK,
+    HASH_LOG_DUMP, // Only write the state of dump_tick to path
+};
+
+struct game_state_t;
+
+// Returns NULL if the file can't be opened
+hash_log* hash_log_open(const char *path, int mode, unsigned int dump_tick);
+
+// Call after every dynamic tick. Returns 1 once there is nothing left to do,
+// ie. the first difference was found or the state was dumped.
+int hash_log_tick(hash_log *log, struct game_state_t *gs);
+
+// Returns 0 if the check passed, or there was nothing to check
+int hash_log_close(hash_log *log);
+
+#endif // _HASH_LOG_H
@@ -0,0 +1,13 @@
+#ifndef _PERF_OVERLAY_H
+#define _PERF_OVERLAY_H
+
+#include "game/game_state_type.h"
+
+// Frame timing overlay, drawn on top of everything when toggled on
+void perf_overlay_init();
+void perf_overlay_close();
+void perf_overlay_toggle();
+int perf_overlay_is_visible();
+void perf_overlay_render(game_state *gs);
+
+#endif // _PERF_OVERLAY_H
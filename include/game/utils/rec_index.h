@@ -0,0 +1,31 @@
+#ifndef _REC_INDEX_H
+#define _REC_INDEX_H
+
+#include <stddef.h>
+#include "utils/vector.h"
+#include "game/utils/serial.h"
+
+// Ticks between keyframes when recording
+#define REC_INDEX_INTERVAL 500
+
+// Serialized game states taken every few ticks while recording, stored
+// next to the REC file. Playback can restore the nearest one and simulate
+// forward from there instead of from tick 0.
+typedef struct rec_keyframe_t {
+    unsigned int tick;
+    size_t len;
+    char *data;
+} rec_keyframe;
+
+typedef struct rec_index_t {
+    vector frames; // rec_keyframe, ascending tick
+} rec_index;
+
+void rec_index_create(rec_index *idx);
+void rec_index_free(rec_index *idx);
+void rec_index_add(rec_index *idx, unsigned int tick, const serial *state);
+const rec_keyframe* rec_index_find(const rec_index *idx, unsigned int tick);
+int rec_index_save(const rec_index *idx, const char *rec_file);
+int rec_index_load(rec_index *idx, const char *rec_file);
+
+#endif // _REC_INDEX_H
@@ -0,0 +1,76 @@
+#ifndef _REC_LIBRARY_H
+#define _REC_LIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "utils/vector.h"
+
+// Index file kept in the scanned directory
+#define REC_LIBRARY_FILE "RECS.IDX"
+
+// Longer file names are left out
+#define REC_LIBRARY_NAME_MAX 256
+
+typedef struct rec_library_pilot_t {
+    char name[19];
+    uint8_t har_id; // 0 for HAR_JAGUAR, as in the REC file
+    uint8_t pilot_id;
+} rec_library_pilot;
+
+// What is worth knowing about a REC file without playing it
+typedef struct rec_library_entry_t {
+    char name[REC_LIBRARY_NAME_MAX]; // File name in the directory
+    int64_t mtime;
+    uint32_t size;
+    uint32_t move_count;
+    uint32_t ticks; // Tick of the last move
+    uint32_t invalid; // Could not be loaded; kept so that it isn't tried again until it changes
+    rec_library_pilot pilots[2];
+} rec_library_entry;
+
+/*
+ * Index of the REC files in a directory. The index is kept in a file next to
+ * them, and rec_library_update only reads the recordings that are new or have
+ * a different time or size since then, so listing a large archive again
+ * doesn't load every recording.
+ */
+typedef struct rec_library_t {
+    char dir[512];
+    vector entries; // rec_library_entry, by name
+} rec_library;
+
+// Loads the index of dir, if there is one
+void rec_library_open(rec_library *lib, const char *dir);
+void rec_library_free(rec_library *lib);
+
+// Brings the index up to date with the directory. Returns -1 if the
+// directory can't be read, else the number of recordings that were read.
+int rec_library_update(rec_library *lib);
+int rec_library_save(const rec_library *lib);
+
+// Open, update and save if anything changed, in one go. Returns what
+// rec_library_update does; the library must be freed either way.
+int rec_library_refresh(rec_library *lib, const char *dir);
+
+// Filters for rec_library_match; -1 and NULL match anything
+typedef struct rec_library_query_t {
+    int har_id;
+    int pilot_id;
+    const char *pilot_name; // Either pilot, ignoring case
+} rec_library_query;
+
+void rec_library_query_init(rec_library_query *q);
+
+// Parses one "har=", "pilot=" filter argument. HARs and pilots can be given
+// by number or by name. Returns 1 if the argument is not a known filter.
+int rec_library_query_parse(rec_library_query *q, const char *arg);
+int rec_library_match(const rec_library_entry *e, const rec_library_query *q);
+
+// One line about the recording, for listings
+void rec_library_describe(const rec_library_entry *e, char *buf, size_t len);
+
+// Updates the index of dir and prints the recordings that match all filters
+// to stdout. Returns 1 if the directory can't be read or a filter is wrong.
+int rec_library_list(const char *dir, int filter_count, char **filters);
+
+#endif // _REC_LIBRARY_H
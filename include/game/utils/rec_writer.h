@@ -0,0 +1,29 @@
+#ifndef _REC_WRITER_H
+#define _REC_WRITER_H
+
+#include <shadowdive/shadowdive.h>
+
+// Moves handed to the writer before they are flushed to disk
+#define REC_WRITER_BUFFER_SIZE 256
+
+// Milliseconds between background flushes
+#define REC_WRITER_FLUSH_INTERVAL 500
+
+/*
+ * Streams the moves of a match to disk while it is being recorded. The REC
+ * file is written without moves when recording starts, and the moves go to
+ * a journal next to it. Closing the writer folds the journal into the REC
+ * file. If the game never gets that far, rec_writer_recover does the same
+ * the next time the recording is opened.
+ */
+typedef struct rec_writer_t rec_writer;
+
+// Returns NULL if the files can't be written
+rec_writer* rec_writer_open(sd_rec_file *header, const char *rec_file);
+void rec_writer_add(rec_writer *w, const sd_rec_move *move);
+int rec_writer_close(rec_writer *w, sd_rec_file *header);
+
+// Returns 0 if there was no journal, or it was folded into the REC file
+int rec_writer_recover(const char *rec_file);
+
+#endif // _REC_WRITER_H
@@ -0,0 +1,41 @@
+#ifndef _SCENE_STATS_H
+#define _SCENE_STATS_H
+
+#include "game/game_state_type.h"
+
+/*
+ * Load of the running scene, for sizing object pools, caches and voice
+ * counts from real games. Sampled about once a second; every value keeps
+ * its latest sample, average and maximum over the scene. The totals are
+ * logged when the scene ends (see game_load_new) and start over.
+ */
+enum {
+    SCENE_STAT_OBJECTS = 0,
+    SCENE_STAT_PROJECTILES,
+    SCENE_STAT_SCRAP,
+    SCENE_STAT_HAZARDS,
+    SCENE_STAT_SPAWNS, // Objects added per second
+    SCENE_STAT_FREES, // Objects removed per second
+    SCENE_STAT_TCACHE_ENTRIES,
+    SCENE_STAT_TCACHE_KB,
+    SCENE_STAT_PALETTE_BUMPS, // Palette version changes per second
+    SCENE_STAT_VOICES, // Sounds and streams playing
+    SCENE_STAT_COUNT
+};
+
+typedef struct scene_stat_t {
+    unsigned int last;
+    unsigned int max;
+    float avg;
+} scene_stat;
+
+// Call every static tick, with the game state locked
+void scene_stats_tick(game_state *gs);
+
+// Logs the totals of the scene that is ending and starts over
+void scene_stats_end(int scene_id);
+
+void scene_stats_get(int stat, scene_stat *out);
+const char* scene_stats_name(int stat);
+
+#endif // _SCENE_STATS_H
@@ -3,14 +3,22 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 typedef struct serial_t {
     size_t len;
     size_t rpos;
+    size_t cap;
+    int view; // Data is borrowed and read-only
+    int error; // Set once a read ran past the end; such reads give zeros
     char *data;
 } serial;
 
 void serial_create(serial *s);
+void serial_create_size(serial *s, size_t size_hint);
+void serial_create_view(serial *s, const char *data, size_t len);
+void serial_reserve(serial *s, size_t len);
+void serial_clear(serial *s);
 void serial_write(serial *s, const char *buf, int len);
 void serial_write_int8(serial *s, int8_t v);
 void serial_write_int16(serial *s, int16_t v);
@@ -28,4 +36,102 @@ int32_t serial_read_int32(serial *s);
 long serial_read_long(serial *s);
 float serial_read_float(serial *s);
 
+// Variable length integers, 7 bits per byte. The signed ones are zigzag
+// encoded, so small negative numbers stay small too.
+void serial_write_varint(serial *s, uint32_t v);
+void serial_write_svarint(serial *s, int32_t v);
+uint32_t serial_read_varint(serial *s);
+int32_t serial_read_svarint(serial *s);
+
+// Nonzero if a read ran past the end since the serial was created or reset
+int serial_error(const serial *s);
+
+/*
+ * Fixed size records, eg. network messages. serial_read_block checks once
+ * that len bytes are left and returns them (or NULL, marking the serial
+ * failed), and serial_write_block makes room for len bytes; the
+ * serial_get_* and serial_put_* calls then go through the record without
+ * further checks. Byte order is the same as serial_read_int* and friends.
+ */
+const char* serial_read_block(serial *s, size_t len);
+char* serial_write_block(serial *s, size_t len);
+
+static inline int8_t serial_get_int8(const char **p) {
+    return (int8_t)*(*p)++;
+}
+
+static inline int16_t serial_get_int16(const char **p) {
+    const uint8_t *b = (const uint8_t*)*p;
+    *p += 2;
+    return (int16_t)((b[0] << 8) | b[1]);
+}
+
+static inline int32_t serial_get_int32(const char **p) {
+    const uint8_t *b = (const uint8_t*)*p;
+    *p += 4;
+    return (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+}
+
+static inline float serial_get_float(const char **p) {
+    int32_t v = serial_get_int32(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline void serial_put_int8(char **p, int8_t v) {
+    *(*p)++ = (char)v;
+}
+
+static inline void serial_put_int16(char **p, int16_t v) {
+    uint16_t u = (uint16_t)v;
+    (*p)[0] = (char)(u >> 8);
+    (*p)[1] = (char)u;
+    *p += 2;
+}
+
+static inline void serial_put_int32(char **p, int32_t v) {
+    uint32_t u = (uint32_t)v;
+    (*p)[0] = (char)(u >> 24);
+    (*p)[1] = (char)(u >> 16);
+    (*p)[2] = (char)(u >> 8);
+    (*p)[3] = (char)u;
+    *p += 4;
+}
+
+static inline void serial_put_float(char **p, float v) {
+    int32_t u;
+    memcpy(&u, &v, sizeof(u));
+    serial_put_int32(p, u);
+}
+
+/*
+ * A field table describes a plain struct once, and serial_write_fields and
+ * serial_read_fields walk the same table, so writing and reading cannot drift
+ * apart. Flags are packed into a bitmap ahead of the values. Floats are kept
+ * exact, restored states have to simulate exactly like the originals; floats
+ * that hold a whole number go out as a varint.
+ */
+enum {
+    SERIAL_FIELD_FLAG, // int, 0 or 1
+    SERIAL_FIELD_UINT, // int, varint
+    SERIAL_FIELD_INT, // int, zigzag varint
+    SERIAL_FIELD_RAW32, // int, 4 bytes, for seeds and such that use all the bits
+    SERIAL_FIELD_FLOAT // float, a bitmap bit and a zigzag varint or 4 bytes
+};
+
+// Flags and floats per table
+#define SERIAL_FIELD_MAX_BITS 64
+
+typedef struct serial_field_t {
+    uint8_t type;
+    uint16_t offset;
+} serial_field;
+
+#define SERIAL_FIELD(type, st, member) { type, offsetof(st, member) }
+#define SERIAL_FIELD_COUNT(table) ((int)(sizeof(table) / sizeof(serial_field)))
+
+void serial_write_fields(serial *s, const serial_field *fields, int count, const void *src);
+void serial_read_fields(serial *s, const serial_field *fields, int count, void *dst);
+
 #endif // _SERIAL_H
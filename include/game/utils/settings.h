@@ -1,6 +1,8 @@
 #ifndef _SETTINGS_H
 #define _SETTINGS_H
 
+#include <stddef.h>
+
 typedef enum fight_mode_t {
     FIGHT_MODE_NORMAL,
     FIGHT_MODE_HYPER
@@ -35,6 +37,10 @@ typedef struct settings_sound_t {
     char *music_arena4;
     char *music_end;
     char *music_menu;
+    int audio_buffers;
+    int audio_buffer_size;
+    int sound_voices;
+    int audio_period;
 } settings_sound;
 
 typedef struct settings_video_t {
@@ -47,6 +53,17 @@ typedef struct settings_video_t {
     int crossfade_on;
     char *scaler;
     int scale_factor;
+    int texture_cache_mb;
+    int texture_copy_mb; // Converted pixels kept for renderer resets, 0 to keep none
+    int scale_cache_mb; // Scaled sprites kept on disk for the next run, 0 for none
+    int fps_cap;
+    int idle_wait;
+    int vrr;
+    int interpolate;
+    int frame_skip;
+    int frame_delay;
+    int flight_recorder; // Keep the last few seconds of trace events, written out for slow frames
+    int flight_recorder_ms; // Frames slower than this are written out, 0 for twice the frame time
 } settings_video;
 
 typedef struct settings_gameplay_t {
@@ -57,6 +74,23 @@ typedef struct settings_gameplay_t {
     int hazards_on;
     int difficulty;
     int rounds;
+    int object_pool_size;
+    int resource_cache_mb;
+    int lazy_sprites;
+    int sprite_predecode;
+    int sprite_cache_mb;
+    int low_memory;
+    int sim_thread;
+    int max_catchup_ticks;
+    int fixed_physics;
+    int run_ahead;
+    char *cores_main; // Core lists to pin threads to, see thread_sched_init
+    char *cores_sim;
+    char *cores_audio;
+    char *cores_net;
+    char *cores_jobs;
+    int thread_priority;
+    int job_threads; // Job workers allowed to run, 0 for all of them
 } settings_gameplay;
 
 typedef struct settings_tournament_t {
@@ -104,6 +138,11 @@ typedef struct settings_network_t {
     char *net_connect_ip;
     int net_connect_port;
     int net_listen_port;
+    int net_input_redundancy;
+    int net_frame_advantage;
+    int net_spectate_port;
+    int net_spectate_relay_port;
+    int net_relay_session; // Nonzero to meet the other player at a relay at the connect address
 } settings_network;
 
 
@@ -124,6 +163,28 @@ void settings_free();
 void settings_load();
 void settings_save();
 
+// The live settings, edited in place by the menus. Only for the main thread.
 settings *settings_get();
 
+/*
+ * Read-only copy of the settings as of the last settings_apply(). Code that
+ * runs every tick, or on another thread, should read this one. A snapshot
+ * stays valid until settings_apply() has been called twice more.
+ */
+const settings *settings_snapshot();
+
+// Publishes the live settings as the new snapshot and tells the listeners.
+// Loading and saving the settings apply them too.
+void settings_apply();
+
+// Live settings by their name in the config file, eg. "vsync", with the value
+// as text. Setting returns 1 if there is no such field or the value doesn't
+// parse; nothing changes until settings_apply().
+int settings_set(const char *name, const char *value);
+int settings_format(const char *name, char *buf, size_t len);
+
+typedef void (*settings_listener)(const settings *s, void *userdata);
+int settings_add_listener(settings_listener fn, void *userdata);
+void settings_remove_listener(settings_listener fn, void *userdata);
+
 #endif // _SETTINGS_H
@@ -0,0 +1,47 @@
+#ifndef _STATE_HISTORY_H
+#define _STATE_HISTORY_H
+
+#include <stddef.h>
+#include "game/utils/serial.h"
+
+// Every this many states, one is stored whole
+#define STATE_HISTORY_KEYFRAME_INTERVAL 32
+
+// Serialized game states of the recent ticks, for rewinding eg. while
+// practicing. Each state is stored as a delta against the one before it,
+// with a whole state every STATE_HISTORY_KEYFRAME_INTERVAL, so that tens of
+// seconds of ticks stay small. Once full, the oldest states are dropped one
+// keyframe at a time. The first state added is kept aside for resets.
+typedef struct state_history_entry_t {
+    unsigned int tick;
+    unsigned int chain; // States since the last keyframe, 0 for a keyframe
+    size_t len;
+    char *data;
+} state_history_entry;
+
+typedef struct state_history_t {
+    state_history_entry *entries; // Ring of max_states, ascending tick
+    unsigned int max_states;
+    unsigned int first;
+    unsigned int count;
+    size_t bytes; // Held by the entries
+    serial start; // The first state, whole
+    serial last; // The newest state, whole, for taking the next delta against
+    serial scratch;
+} state_history;
+
+void state_history_create(state_history *h, unsigned int max_states);
+void state_history_free(state_history *h);
+
+// Adding a tick that is not newer than the newest one drops the newer
+// states first, eg. after rewinding.
+void state_history_add(state_history *h, unsigned int tick, const serial *state);
+
+// Writes the newest state at or before tick to out, or the oldest state if
+// the history doesn't reach back that far. Returns 1 if the history is empty.
+int state_history_get(state_history *h, unsigned int tick, serial *out);
+
+unsigned int state_history_size(const state_history *h);
+const serial* state_history_start(const state_history *h);
+
+#endif // _STATE_HISTORY_H
@@ -1,17 +1,57 @@
 #ifndef _TICKTIMER_H
 #define _TICKTIMER_H
 
+#include <stdint.h>
 #include "utils/vector.h"
+#include "game/utils/serial.h"
 
+#define TICKTIMER_WHEEL0_BITS 8
+#define TICKTIMER_WHEEL1_BITS 6
+#define TICKTIMER_WHEEL0_SIZE (1 << TICKTIMER_WHEEL0_BITS)
+#define TICKTIMER_WHEEL1_SIZE (1 << TICKTIMER_WHEEL1_BITS)
+
+// Identifies a pending timer, 0 is never used
+typedef uint32_t ticktimer_handle;
+
+typedef void (*ticktimer_cb)(void *userdata);
+
+// A list of units, linked through their indexes
+typedef struct ticktimer_slot_t {
+    int head;
+    int tail;
+} ticktimer_slot;
+
+/*
+ * Timers are kept by the tick they fire on, in a two level timer wheel.
+ * The first level has a slot for every tick of the current block of
+ * TICKTIMER_WHEEL0_SIZE ticks, the second one a slot for every block of the
+ * current superblock, and whatever lies beyond that waits in a list. Each
+ * time a block begins, its timers are moved down a level. Timers that fire
+ * on the same tick fire in the order they were added.
+ */
 typedef struct ticktimer_t {
     vector units;
+    int free_head;
+    uint32_t now; // The tick that the next ticktimer_run runs
+    ticktimer_slot wheel0[TICKTIMER_WHEEL0_SIZE];
+    ticktimer_slot wheel1[TICKTIMER_WHEEL1_SIZE];
+    ticktimer_slot far;
+    void *context; // Userdata of the timers that can be serialized
 } ticktimer;
 
-typedef void (*ticktimer_cb)(void *userdata);
-
 void ticktimer_init(ticktimer *tt);
-void ticktimer_add(ticktimer *tt, int ticks, ticktimer_cb cb, void *userdata);
+void ticktimer_init_with_allocator(ticktimer *tt, allocator alloc);
+ticktimer_handle ticktimer_add(ticktimer *tt, int ticks, ticktimer_cb cb, void *userdata);
+void ticktimer_cancel(ticktimer *tt, ticktimer_handle handle);
 void ticktimer_run(ticktimer *tt);
 void ticktimer_close(ticktimer *tt);
 
+// Timers are serialized by callback, so the callbacks have to be registered
+// in the same order everywhere. Only timers whose userdata is the context
+// are written; for those that are read back, the context is the userdata.
+void ticktimer_register_cb(ticktimer_cb cb);
+void ticktimer_set_context(ticktimer *tt, void *context);
+void ticktimer_serialize(ticktimer *tt, serial *ser);
+void ticktimer_unserialize(ticktimer *tt, serial *ser);
+
 #endif // _TICKTIMER_H
@@ -1,13 +1,19 @@
 #ifndef _BASE_PLUGIN
 #define _BASE_PLUGIN
 
+#define PLUGIN_INFO_LEN 64
+#define PLUGIN_PATH_LEN 256
+
+// Plugin information comes from the plugin manifest cache when the file
+// hasn't changed, so the plugin itself is only opened once it is used.
 typedef struct {
-    void *handle;
-    const char* (*get_name)();
-    const char* (*get_author)();
-    const char* (*get_license)();
-    const char* (*get_type)();
-    const char* (*get_version)();
+    void *handle; // NULL until the plugin is loaded
+    char path[PLUGIN_PATH_LEN];
+    char name[PLUGIN_INFO_LEN];
+    char author[PLUGIN_INFO_LEN];
+    char license[PLUGIN_INFO_LEN];
+    char type[PLUGIN_INFO_LEN];
+    char version[PLUGIN_INFO_LEN]; // Empty for old plugins
 } base_plugin;
 
 #endif // _BASE_PLUGIN
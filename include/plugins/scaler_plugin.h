@@ -9,6 +9,8 @@ typedef struct {
     int (*get_factors_list)(int** factors);
     int (*get_color_format)();
     int (*scale)(const char* in, char* out, int w, int h, int factor);
+    int (*scale_rows)(const char* in, char* out, int w, int h, int factor, int y0, int y1); // Optional
+    int (*scale_index)(const char* in, char* out, int w, int h, int factor, int y0, int y1); // Optional, 8-bit
 } scaler_plugin;
 
 void scaler_init(scaler_plugin *scaler);
@@ -20,5 +22,21 @@ int scaler_scale(scaler_plugin *scaler,
                  char* out,
                  int w, int h,
                  int factor);
+int scaler_has_scale_rows(scaler_plugin *scaler);
+int scaler_scale_rows(scaler_plugin *scaler,
+                      const char* in,
+                      char* out,
+                      int w, int h,
+                      int factor,
+                      int y0, int y1);
+int scaler_has_scale_index(scaler_plugin *scaler);
+int scaler_scale_index(scaler_plugin *scaler,
+                       const char* in,
+                       const char* in_stencil,
+                       char* out,
+                       char* out_stencil,
+                       int w, int h,
+                       int factor,
+                       int y0, int y1);
 
 # endif // _SCALER_PLUGIN
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef _RELAY_H
+#define _RELAY_H
+
+#include <stdint.h>
+
+// Two player sessions a relay serves by default
+#define RELAY_DEFAULT_SESSIONS 512
+
+// The relay tells both players that their session is complete with this
+// packet on channel 0: the type byte and the role the player takes.
+#define RELAY_PACKET_PAIRED 0xF0
+
+/*
+ * Forwards netplay between players that can't reach each other directly,
+ * eg. both behind NAT. Players connect to the relay with the same nonzero
+ * session code as their connect data. Once the second one is in, the first
+ * one becomes the server, and from then on every packet is handed to the
+ * other player as is, on the channel it came in on. One enet host serves
+ * all sessions. Runs until interrupted, returns nonzero if it can't start.
+ */
+int relay_run(int port, int max_sessions);
+
+#endif // _RELAY_H
@@ -0,0 +1,19 @@
+#ifndef _REPLAY_BATCH_H
+#define _REPLAY_BATCH_H
+
+// Replays every REC file in dir with "exe play <file> --fast", running up to
+// jobs processes at once. Returns the number of replays that failed.
+int replay_batch_run(const char *exe, const char *dir, int jobs);
+
+enum {
+    REPLAY_BATCH_PLAY,
+    REPLAY_BATCH_RECORD, // Write <file>.hashes next to every REC file
+    REPLAY_BATCH_CHECK, // Check every REC file against its <file>.hashes
+};
+
+// Same as above, with per tick state hashes. When a check fails and a
+// reference build is given, it is run to the tick of the desync to write its
+// state next to the one from exe.
+int replay_batch_hashes(const char *exe, const char *dir, int jobs, int mode, const char *reference);
+
+#endif // _REPLAY_BATCH_H
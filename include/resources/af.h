@@ -2,6 +2,17 @@
 #define _AF_H
 
 #include "resources/af_move.h"
+#include "resources/move_trie.h"
+
+// Moves grouped by what the AI needs to know about them, see af_create
+typedef struct af_ai_moves_t {
+    move_mask attacks; // Plain input strings, and do damage or spawn something
+    move_mask specials; // Anything but the basic punches and kicks
+    move_mask close_range; // Only worth trying when close or jumping
+} af_ai_moves;
+
+// Move ids of an AF file are 0..AF_MOVE_COUNT-1
+#define AF_MOVE_COUNT 70
 
 typedef struct af_t {
     unsigned int id;
@@ -11,7 +22,9 @@ typedef struct af_t {
     int reverse_speed;
     int jump_speed;
     int fall_speed;
-    af_move moves[70];
+    af_move moves[AF_MOVE_COUNT]; // Indexed by move id, id -1 if missing
+    move_trie move_trie; // Move strings of all moves
+    af_ai_moves ai_moves;
     char sound_translation_table[30];
 } af;
 
@@ -19,4 +32,8 @@ void af_create(af *a, void *src);
 af_move* af_get_move(af *a, int id);
 void af_free(af *a);
 
+// Frees one move at a time, and the rest with the last one. Returns 1 while
+// there is more to free.
+int af_free_step(af *a);
+
 #endif // _AF_H
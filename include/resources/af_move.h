@@ -4,6 +4,20 @@
 #include "resources/animation.h"
 #include "utils/str.h"
 
+enum {
+    CAT_MISC = 0,
+    CAT_CLOSE = 2,
+    CAT_LOW = 4,
+    CAT_MEDIUM = 5,
+    CAT_HIGH,
+    CAT_JUMPING,
+    CAT_PROJECTILE,
+    CAT_BASIC,
+    CAT_VICTORY = 10, // or defeat
+    CAT_SCRAP = 12,
+    CAT_DESTRUCTION
+};
+
 typedef struct af_move_t {
     int id;
     animation ani;
@@ -16,6 +30,7 @@ typedef struct af_move_t {
     float damage;
     str move_string;
     str footer_string;
+    int reach; // Furthest collision coord in front of the HAR, -1 if none
 #ifdef DEBUGMODE
     char unknown[21];
 #endif
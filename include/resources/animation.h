@@ -2,6 +2,8 @@
 #define _ANIMATION_H
 
 #include "resources/sprite.h"
+#include "resources/frame_tags.h"
+#include "resources/frame_timeline.h"
 #include "utils/vec.h"
 #include "utils/vector.h"
 #include "utils/str.h"
@@ -37,18 +39,29 @@ typedef struct collision_coord_t {
 typedef struct animation_t {
     int id;
     vec2i start_pos;
-    vector collision_coords;
+    vector collision_coords; // Sorted by frame_index
+    int *frame_coords; // Index of the first coord of every frame, frame_coord_count + 1 entries
+    int frame_coord_count;
+    int hit_tick; // Ticks until the first frame with collision coords, -1 if none
     str animation_string;
+    sd_script script; // animation_string, decoded. Shared by every object playing the animation
+    uint8_t script_ok; // Set if script could be decoded
+    tag_table tags; // animation_string, compiled
+    frame_timeline timeline; // Frame start ticks of script
     uint8_t extra_string_count;
     vector extra_strings;
     vector sprites;
 } animation;
 
+// The sprites are left undecoded, they must be added to a batch with animation_decode_sprites
 void animation_create(animation *ani, void *src, int id);
+void animation_decode_sprites(animation *ani, sprite_batch *batch);
 sprite* animation_get_sprite(animation *ani, int sprite_id);
 void animation_free(animation *ani);
 
 int animation_get_sprite_count(animation *ani);
+collision_coord* animation_get_frame_coords(animation *ani, int frame_index, int *count);
+int animation_predecode(animation *ani, int budget);
 
 animation* create_animation_from_single(sprite *sp, vec2i pos);
 
@@ -5,10 +5,14 @@
 #include "utils/hashmap.h"
 #include "utils/vector.h"
 
+// Animation ids of a BK file are 0..BK_INFO_COUNT-1
+#define BK_INFO_COUNT 50
+
 typedef struct bk_t {
     int file_id;
     surface background;
-    hashmap infos;
+    hashmap infos; // Owns the infos; iterated in this order where it matters
+    bk_info *info_index[BK_INFO_COUNT]; // Same infos by id, NULL if missing
     vector palettes;
     char sound_translation_table[30];
 } bk;
@@ -19,4 +23,8 @@ palette* bk_get_palette(bk *b, int id);
 char* bk_get_stl(bk *b);
 void bk_free(bk *b);
 
+// Frees one animation at a time, and the rest with the last one. Returns 1
+// while there is more to free.
+int bk_free_step(bk *b);
+
 #endif // _BK_H
@@ -0,0 +1,32 @@
+#ifndef _BUNDLE_H
+#define _BUNDLE_H
+
+#include <shadowdive/sprite.h>
+#include "video/surface.h"
+
+// File name of the bundle in the resource directory
+#define BUNDLE_FILE "SPRITES.BDL"
+
+/*
+ * A bundle holds the sprites of all BK and AF files already decoded, so
+ * loading a scene doesn't have to VGA decode them again. Sprites are found
+ * by a hash of their encoded data; sprites of a changed file simply miss
+ * and get decoded the usual way.
+ *
+ * The bundle is mapped read-only and the sprites found in it point into the
+ * mapping, so processes running from the same files share their pixels.
+ */
+int bundle_open(const char *path);
+void bundle_close();
+
+// Makes sur a borrowed surface of the packed sprite, see surface_create_borrowed.
+// Returns 1 if the sprite isn't in the bundle.
+int bundle_find_sprite(const sd_sprite *sdsprite, surface *sur);
+
+// Called for every freshly decoded and packed sprite, remembers it while packing
+void bundle_collect_sprite(const sd_sprite *sdsprite, const surface *sur);
+
+// Decodes every BK and AF file and writes the bundle
+int bundle_pack(const char *path);
+
+#endif // _BUNDLE_H
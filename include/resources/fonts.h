@@ -2,6 +2,12 @@
 #define _FONTS_H
 
 #include "utils/vector.h"
+#include "video/surface.h"
+
+// Font atlas layout. Glyphs are kept apart so that scalers
+// don't bleed neighbouring glyphs into each other.
+#define FONT_ATLAS_COLS 16
+#define FONT_ATLAS_PADDING 1
 
 typedef enum {
     FONT_BIG,
@@ -12,6 +18,7 @@ typedef struct {
     font_size size;
     int w,h;
     vector surfaces;
+    surface *atlas; // All glyphs in one surface, or NULL
 } font;
 
 extern font font_small;
@@ -19,5 +26,6 @@ extern font font_large;
 
 int fonts_init();
 void fonts_close();
+void font_get_atlas_pos(const font *font, int code, int *x, int *y);
 
 #endif // _FONTS_H
\ No newline at end of file
@@ -0,0 +1,117 @@
+#ifndef _FRAME_TAGS_H
+#define _FRAME_TAGS_H
+
+#include <stdint.h>
+#include <shadowdive/script.h>
+
+// Animation string tags that the engine acts on. Scripts are compiled
+// into per-frame tables of these at load time, so lookups during
+// playback are bit tests instead of string compares.
+enum {
+    TAG_AR = 0, // ar
+    TAG_AS,     // as
+    TAG_AT,     // at
+    TAG_AW,     // aw
+    TAG_B1,     // b1
+    TAG_B2,     // b2
+    TAG_BB,     // bb
+    TAG_BC,     // bc
+    TAG_BD,     // bd
+    TAG_BE,     // be
+    TAG_BF,     // bf
+    TAG_BH,     // bh
+    TAG_BJ,     // bj
+    TAG_BL,     // bl
+    TAG_BM,     // bm
+    TAG_BPB,    // bpb
+    TAG_BPD,    // bpd
+    TAG_BPF,    // bpf
+    TAG_BPN,    // bpn
+    TAG_BPP,    // bpp
+    TAG_BPS,    // bps
+    TAG_BR,     // br
+    TAG_BS,     // bs
+    TAG_BT,     // bt
+    TAG_BU,     // bu
+    TAG_BW,     // bw
+    TAG_BX,     // bx
+    TAG_BZ,     // bz
+    TAG_D,      // d
+    TAG_E,      // e
+    TAG_F,      // f
+    TAG_H,      // h
+    TAG_I,      // i
+    TAG_JF,     // jf
+    TAG_JF2,    // jf2
+    TAG_JH,     // jh
+    TAG_JL,     // jl
+    TAG_JM,     // jm
+    TAG_JN,     // jn
+    TAG_K,      // k
+    TAG_L,      // l
+    TAG_M,      // m
+    TAG_MD,     // md
+    TAG_MG,     // mg
+    TAG_MM,     // mm
+    TAG_MRX,    // mrx
+    TAG_MRY,    // mry
+    TAG_MX,     // mx
+    TAG_MY,     // my
+    TAG_OX,     // ox
+    TAG_OY,     // oy
+    TAG_PA,     // pa
+    TAG_PD,     // pd
+    TAG_PE,     // pe
+    TAG_PP,     // pp
+    TAG_PTR,    // ptr
+    TAG_Q,      // q
+    TAG_R,      // r
+    TAG_S,      // s
+    TAG_SB,     // sb
+    TAG_SF,     // sf
+    TAG_SMF,    // smf
+    TAG_SMO,    // smo
+    TAG_UA,     // ua
+    TAG_UB,     // ub
+    TAG_UE,     // ue
+    TAG_V,      // v
+    TAG_X_EQ,   // x=
+    TAG_X_PLUS, // x+
+    TAG_X_MINUS,// x-
+    TAG_Y,      // y
+    TAG_Y_EQ,   // y=
+    TAG_Y_PLUS, // y+
+    TAG_Y_MINUS,// y-
+    TAG_ZH,     // zh
+    TAG_ZJ,     // zj
+    TAG_ZL,     // zl
+    TAG_ZM,     // zm
+    TAG_ZP,     // zp
+    TAG_ZZ,     // zz
+    TAG_COUNT
+};
+
+#define TAG_MASK_WORDS ((TAG_COUNT + 31) / 32)
+
+typedef struct frame_tags_t {
+    uint32_t mask[TAG_MASK_WORDS];
+    int params[TAG_COUNT];
+} frame_tags;
+
+typedef struct tag_table_t {
+    int frame_count;
+    frame_tags *frames;
+} tag_table;
+
+void tag_table_create(tag_table *table);
+void tag_table_compile(tag_table *table, const sd_script *script);
+void tag_table_free(tag_table *table);
+const frame_tags* tag_table_get(const tag_table *table, int frame_index);
+int tag_table_next_frame_with_tag(const tag_table *table, int tag, int frame_index);
+
+int frame_tags_isset(const frame_tags *tags, int tag);
+int frame_tags_get(const frame_tags *tags, int tag);
+
+int tag_lookup(const char *name);
+
+#endif // _FRAME_TAGS_H
@@ -0,0 +1,31 @@
+#ifndef _FRAME_TIMELINE_H
+#define _FRAME_TIMELINE_H
+
+#include <stdint.h>
+#include <shadowdive/script.h>
+
+// Animations no longer than this get a direct tick -> frame table
+#define FRAME_TIMELINE_DIRECT_TICKS 512
+
+// Frame start ticks of a decoded animation string, so that finding the frame
+// at a tick doesn't need to add up the lengths of all frames before it.
+// Compiled once per animation and shared, like the tag tables.
+typedef struct frame_timeline_t {
+    int frame_count;
+    int *starts; // Start tick of each frame; starts[frame_count] is the length
+    int16_t *direct; // Frame at each tick, for short animations; else NULL
+} frame_timeline;
+
+void frame_timeline_create(frame_timeline *timeline);
+void frame_timeline_compile(frame_timeline *timeline, const sd_script *script);
+void frame_timeline_free(frame_timeline *timeline);
+
+// Index of the frame playing at tick, or -1 if tick is outside the animation
+int frame_timeline_frame_at(const frame_timeline *timeline, int tick);
+
+// Start tick of a frame, or -1 if there is no such frame
+int frame_timeline_frame_start(const frame_timeline *timeline, int frame_index);
+
+int frame_timeline_total_ticks(const frame_timeline *timeline);
+
+#endif // _FRAME_TIMELINE_H
@@ -0,0 +1,64 @@
+#ifndef _MOVE_TRIE_H
+#define _MOVE_TRIE_H
+
+#include <stdint.h>
+#include "utils/vector.h"
+
+// Bitmask over move ids (0..MOVE_MASK_BITS-1)
+#define MOVE_MASK_WORDS 3
+#define MOVE_MASK_BITS (MOVE_MASK_WORDS * 32)
+
+typedef struct move_mask_t {
+    uint32_t bits[MOVE_MASK_WORDS];
+} move_mask;
+
+void move_mask_clear(move_mask *mask);
+void move_mask_set(move_mask *mask, int id);
+int move_mask_isset(const move_mask *mask, int id);
+void move_mask_and(move_mask *dst, const move_mask *src);
+void move_mask_andnot(move_mask *dst, const move_mask *src);
+int move_mask_next(const move_mask *mask, int from);
+
+// Inputs that move strings are made of: directions 1-9 as on a numpad, K and P
+#define MOVE_TRIE_KEYS 11
+
+// Inputs a HAR remembers; longer move strings can never be matched
+#define MOVE_TRIE_MAX_INPUTS 10
+
+// The node before any input
+#define MOVE_TRIE_START 0
+
+// Matcher over move strings. Move strings are stored newest input first,
+// same as the HAR input buffer; the trie holds them the other way around and
+// is walked one input at a time as they come in (Aho-Corasick). A node stands
+// for the longest tail of the inputs so far that some move string starts
+// with, and knows every move whose string the inputs end in, so each new
+// input is one table lookup. All moves are added before move_trie_build.
+typedef struct move_trie_node_t {
+    int next[MOVE_TRIE_KEYS]; // Node after each input; -1 for none until built
+    int fail; // Node of the longest shorter tail
+    move_mask own; // Moves whose string ends exactly here
+    move_mask moves; // Moves whose string ends here or at a shorter tail, once built
+} move_trie_node;
+
+typedef struct move_trie_t {
+    vector nodes;
+} move_trie;
+
+void move_trie_create(move_trie *trie);
+void move_trie_add(move_trie *trie, const char *str, int move_id);
+void move_trie_build(move_trie *trie);
+void move_trie_free(move_trie *trie);
+
+// Node after one more input
+int move_trie_step(const move_trie *trie, int node, char input);
+const move_mask* move_trie_moves(const move_trie *trie, int node);
+
+// Node after the inputs of a buffer, newest first and up to a '\0', as if
+// they had been stepped through from the start one by one
+int move_trie_walk(const move_trie *trie, const char *inputs);
+
+// Collects all moves whose string is a prefix of inputs
+void move_trie_match(const move_trie *trie, const char *inputs, move_mask *out);
+
+#endif // _MOVE_TRIE_H
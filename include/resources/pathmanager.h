@@ -10,6 +10,8 @@ enum {
     CONFIG_PATH,
     SCORE_PATH,
     SAVE_PATH,
+    PLUGIN_CACHE_PATH,
+    SCALE_CACHE_PATH,
     NUMBER_OF_LOCAL_PATHS
 };
 
@@ -0,0 +1,19 @@
+#ifndef _PIC_H
+#define _PIC_H
+
+#include "resources/sprite.h"
+
+// The photos of a PIC file, decoded. Palettes aren't kept, the game only
+// shows the sprites.
+typedef struct pic_t {
+    int photo_count;
+    sprite *photos;
+} pic;
+
+int load_pic_file(pic *p, int resource_id);
+void pic_free(pic *p);
+
+// NULL if there is no such photo
+sprite* pic_get_photo(pic *p, int photo_id);
+
+#endif // _PIC_H
@@ -0,0 +1,27 @@
+#ifndef _PRELOADER_H
+#define _PRELOADER_H
+
+#include "resources/bk.h"
+#include "resources/af.h"
+#include "resources/pic.h"
+
+// Loads BK, AF and PIC files on a background thread, so that the next scene's
+// resources can be decoded while the current scene is still fading out.
+int preloader_init();
+void preloader_close();
+
+void preloader_request_bk(int resource_id);
+void preloader_request_af(int resource_id);
+void preloader_request_pic(int resource_id);
+
+// Hands a preloaded file over to the caller, waiting for it if it is still
+// loading. Returns 1 if the file wasn't requested or failed to load; the
+// caller should then load it synchronously.
+int preloader_take_bk(bk *b, int resource_id);
+int preloader_take_af(af *a, int resource_id);
+int preloader_take_pic(pic *p, int resource_id);
+
+// Drops everything that was requested but not taken
+void preloader_flush();
+
+#endif // _PRELOADER_H
@@ -0,0 +1,28 @@
+#ifndef _RESCACHE_H
+#define _RESCACHE_H
+
+#include "resources/bk.h"
+#include "resources/af.h"
+#include "resources/pic.h"
+
+// Keeps decoded BK, AF and PIC files around between scenes. Files are
+// refcounted; once nothing holds a file it stays in the cache until the
+// memory budget runs out, and then the least recently used go first.
+void rescache_init();
+void rescache_close();
+void rescache_set_budget(unsigned int bytes);
+
+// Returns the file, loading it if it isn't cached. NULL on failure.
+bk* rescache_get_bk(int resource_id);
+af* rescache_get_af(int resource_id);
+pic* rescache_get_pic(int resource_id);
+
+// Loads the file on the preloader thread if it isn't cached
+void rescache_preload_bk(int resource_id);
+void rescache_preload_af(int resource_id);
+void rescache_preload_pic(int resource_id);
+
+// Drops a reference taken with rescache_get_*
+void rescache_release(const void *res);
+
+#endif // _RESCACHE_H
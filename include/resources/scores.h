@@ -12,6 +12,7 @@ typedef struct scoreboard_t {
     score_entry entries[4][20];
 } scoreboard;
 
+void scores_prefetch();
 int scores_read(scoreboard *sb);
 int scores_write(scoreboard *sb);
 void scores_clear(scoreboard *sb);
@@ -0,0 +1,29 @@
+#ifndef _SCRIPT_CACHE_H
+#define _SCRIPT_CACHE_H
+
+#include <shadowdive/script.h>
+#include "resources/frame_tags.h"
+#include "resources/frame_timeline.h"
+
+// Strings past this many are not kept, but decoded for each user
+#define SCRIPT_CACHE_MAX_ENTRIES 4096
+
+// Custom animation strings (hit strings, move footers and the like) decoded
+// and compiled once, and shared like an animation's own script. There are
+// only so many of these in the game data, but the same ones are set over
+// and over, and again on every rollback and state load. Only used from
+// the thread running the game.
+typedef struct script_cache_entry_t {
+    sd_script script;
+    tag_table tags;
+    frame_timeline timeline;
+} script_cache_entry;
+
+// Returns the compiled string, or NULL if it didn't decode or the cache is
+// full; the caller then decodes it on its own. Entries live until
+// script_cache_clear.
+const script_cache_entry* script_cache_get(const char *str);
+unsigned int script_cache_size();
+void script_cache_clear();
+
+#endif // _SCRIPT_CACHE_H
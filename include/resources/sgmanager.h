@@ -4,6 +4,7 @@
 #include <shadowdive/pilot.h>
 
 int sg_init();
+void sg_prefetch(const char *pilotname);
 int sg_load(sd_pilot *pilot, const char* pilotname);
 int sd_save(const sd_pilot *pilot, const char* pilotname);
 
@@ -1,8 +1,32 @@
 #ifndef _SOUNDS_LOADER_H
 #define _SOUNDS_LOADER_H
 
+#include <stdint.h>
+
+// Rate of the samples in SOUNDS.DAT, and the rate they are converted to
+// until the audio device tells us what it runs at
+#define SOUNDS_SOURCE_RATE 8000
+#define SOUNDS_DEFAULT_RATE 44100
+
+// A sample converted for playback
+typedef struct sound_buffer_t {
+    int key; // Different for every sample and pitch variant
+    const char *data;
+    int len; // In bytes
+    int frequency;
+    int bytes;
+    float pitch; // Pitch that is left for the sink to apply
+} sound_buffer;
+
 int sounds_loader_init();
 int sounds_loader_get(int id, char **buffer, int *len);
+
+// Converted 16 bit copy of the sample. Common pitches have buffers of their
+// own, so they need no resampling while playing.
+int sounds_loader_get_buffer(int id, float pitch, sound_buffer *buf);
+
+// Converts the samples for another output rate. Done once the sink is up.
+void sounds_loader_set_rate(int rate);
 void sounds_loader_close();
 
 #endif // _SOUNDS_LOADER_H
@@ -1,20 +1,66 @@
 #ifndef _SPRITE_H
 #define _SPRITE_H
 
+#include <stddef.h>
 #include "resources/palette.h"
 #include "video/surface.h"
+#include "utils/jobs.h"
 #include "utils/vec.h"
 
+typedef struct sprite_lru_t sprite_lru;
+
 typedef struct sprite_t {
     int id;
     vec2i pos;
-    surface *data;
+    surface *data; // NULL until decoded, if decoding is deferred
+    void *raw;     // Compressed sd_sprite kept for deferred decoding
+    sprite_lru *lru; // Set while the decoded pixels may be dropped again
 } sprite;
 
+// Decodes sprites made with sprite_create_deferred on the job system
+typedef struct sprite_batch_t {
+    job_counter done;
+} sprite_batch;
+
+typedef struct sprite_stats_t {
+    size_t bytes_used; // Decoded pixels that can be dropped
+    size_t budget;
+    unsigned int decodes;
+    unsigned int evictions;
+} sprite_stats;
+
+// When lazy, sprite_create() keeps the compressed data and decodes it
+// the first time the surface is asked for.
+void sprite_set_lazy(int lazy);
+
+// With a budget, lazily created sprites keep their compressed data after
+// decoding. Pixels of the least recently used ones are dropped when the
+// budget runs out, and decoded again on their next use. 0 means no limit.
+void sprite_set_budget(size_t bytes);
+void sprite_tick();
+void sprite_get_stats(sprite_stats *stats);
+
 void sprite_create(sprite *sp, void *src, int id);
 void sprite_create_custom(sprite *sp, vec2i pos, surface *sur);
+
+// Keeps the compressed data for now, whether lazy or not. Unless lazy, the
+// sprite must then be added to a batch, so that a whole file worth of sprites
+// can be decoded in parallel. The sprite must not move until the batch is done.
+void sprite_create_deferred(sprite *sp, void *src, int id);
+void sprite_batch_begin(sprite_batch *batch);
+void sprite_batch_add(sprite_batch *batch, sprite *sp);
+void sprite_batch_finish(sprite_batch *batch);
 void sprite_free(sprite *sp);
 
+// The surface stays decoded for as long as the sprite lives. For holders
+// that keep the surface pointer around, eg. GUI components.
+surface* sprite_get_surface(sprite *sp);
+
+// The surface may be dropped once it has gone unused for a while, so it
+// must not be kept past the current tick or frame.
+surface* sprite_use_surface(sprite *sp);
+
+int sprite_is_decoded(const sprite *sp);
 vec2i sprite_get_size(sprite *s);
 sprite* sprite_copy(sprite *src);
 
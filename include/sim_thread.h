@@ -0,0 +1,21 @@
+#ifndef _SIM_THREAD_H
+#define _SIM_THREAD_H
+
+#include "game/game_state.h"
+
+// Runs arena simulation on its own thread, so that slow frames and vsync
+// waits on the main thread don't delay game ticks. The main thread keeps
+// handling events and rendering, and takes the lock whenever it touches
+// the game state.
+
+int sim_thread_can_run(game_state *gs);
+int sim_thread_start(game_state *gs);
+void sim_thread_stop();
+int sim_thread_is_started();
+int sim_thread_is_ticking();
+
+// No-ops while the thread isn't started
+void sim_thread_lock();
+void sim_thread_unlock();
+
+#endif // _SIM_THREAD_H
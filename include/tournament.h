@@ -0,0 +1,16 @@
+#ifndef _TOURNAMENT_H
+#define _TOURNAMENT_H
+
+// AI matches that have not ended by now are called a draw
+#define TOURNAMENT_MATCH_MAX_TICKS 60000
+
+// Plays every pairing of the first hars HARs, pilots pilots and difficulties
+// AI difficulties against each other once with "exe match ... --fast",
+// running up to jobs processes at once. Win rates and the average match
+// length are printed to stdout. Returns the number of matches that failed.
+int tournament_run(const char *exe, int jobs, int hars, int pilots, int difficulties);
+
+// Used by the match process. Winner is the player id, or -1 for a draw.
+int tournament_write_result(const char *path, int winner, unsigned int ticks);
+
+#endif // _TOURNAMENT_H
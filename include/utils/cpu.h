@@ -0,0 +1,34 @@
+#ifndef _CPU_H
+#define _CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instruction set extensions that vector kernels can be picked by
+enum {
+    CPU_SSE2 = 0x1,
+    CPU_SSSE3 = 0x2,
+    CPU_AVX2 = 0x4,
+    CPU_NEON = 0x8,
+};
+
+// Detects what the CPU supports. The override is a comma separated list of
+// feature names, or "none", and can only turn features off.
+void cpu_init(const char *override);
+int cpu_has(int features);
+int cpu_get_features();
+void cpu_set_features(int features);
+
+// Returns -1 if the string has an unknown feature name in it
+int cpu_parse_features(const char *str);
+void cpu_features_to_str(int features, char *buf, size_t len);
+
+// Sets of cores as bitmasks, written as lists like "0,2-3". Only the first
+// CPU_MAX_CORES cores can be named.
+#define CPU_MAX_CORES 64
+
+// Returns 0 and the mask, or -1 if the string is not a core list
+int cpu_parse_cores(const char *str, uint64_t *cores);
+void cpu_cores_to_str(uint64_t cores, char *buf, size_t len);
+
+#endif // _CPU_H
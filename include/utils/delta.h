@@ -0,0 +1,15 @@
+#ifndef _DELTA_H
+#define _DELTA_H
+
+#include <stddef.h>
+
+// Delta encoding of a buffer against an earlier version of it. The buffers
+// are compared as 32-bit big-endian words; the delta holds the new length,
+// a bitmask of changed words and a varint of the XOR for each changed word.
+
+size_t delta_max_size(size_t len);
+size_t delta_encode(const char *base, size_t base_len, const char *data, size_t len, char *out);
+long delta_decoded_len(const char *delta, size_t delta_len);
+long delta_decode(const char *base, size_t base_len, const char *delta, size_t delta_len, char *out, size_t out_size);
+
+#endif // _DELTA_H
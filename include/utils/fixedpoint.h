@@ -0,0 +1,39 @@
+#ifndef _FIXEDPOINT_H
+#define _FIXEDPOINT_H
+
+#include <stdint.h>
+
+// 16.16 fixed point. All of it is integer arithmetic, so the results are
+// the same on every platform and compiler.
+typedef int32_t fixed;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_PI 205887 // 3.14159265 * FIXED_ONE
+
+// Floats are put on a grid of this many steps per unit by fixed_snap. Sums
+// of two values on the grid are exact in a float as long as they stay below
+// 2^(23 - FIXED_SNAP_BITS), which covers anything in the arena.
+#define FIXED_SNAP_BITS 8
+
+fixed fixed_from_int(int v);
+fixed fixed_from_float(float v);
+int fixed_to_int(fixed v);
+float fixed_to_float(fixed v);
+fixed fixed_mul(fixed a, fixed b);
+fixed fixed_div(fixed a, fixed b);
+fixed fixed_sin(fixed a);
+fixed fixed_cos(fixed a);
+
+// Angles for the lookup table versions are integers, FIXED_TURN per full
+// turn. They wrap around, so they can be counted up forever.
+#define FIXED_TURN 1024
+
+int fixed_to_angle(fixed radians);
+fixed fixed_sin_lut(int angle);
+fixed fixed_cos_lut(int angle);
+
+// Rounds to the nearest step of the FIXED_SNAP_BITS grid
+float fixed_snap(float v);
+
+#endif // _FIXEDPOINT_H
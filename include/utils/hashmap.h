@@ -13,14 +13,18 @@ struct hashmap_pair_t {
     void *key, *val;
 };
 
+// Open addressing slot. Key and value live in one allocation that
+// pair.key and pair.val point into, so values never move on resize.
 struct hashmap_node_t {
     hashmap_pair pair;
-    hashmap_node *next;
+    unsigned int hash;
+    unsigned int dist; // Distance from home slot + 1, or 0 if the slot is empty
 };
 
 struct hashmap_t {
-    hashmap_node **buckets;
-    unsigned int buckets_x;
+    hashmap_node *buckets;
+    unsigned int buckets_x; // Capacity is 2^buckets_x
+    unsigned int slots;     // Capacity plus overflow slots past the end
     unsigned int reserved;
     allocator alloc;
 };
@@ -43,4 +47,28 @@ void hashmap_iter_begin(const hashmap *hashmap, iterator *iter);
 int hashmap_delete(hashmap *hashmap, iterator *iter);
 void hashmap_clear(hashmap *hashmap);
 
+/*
+ * Typed access to a hashmap with keys and values of one type each.
+ * HASHMAP_DEFINE(name, key_type, val_type) declares inline functions:
+ *   name_put(hm, &key, val)  copies *val in, returns the stored value
+ *   name_get(hm, &key)       stored value, or NULL
+ *   name_del(hm, &key)
+ * Keys are hashed and compared as sizeof(key_type) bytes, so struct keys
+ * must have their padding zeroed. They are passed by pointer, since the
+ * padding of a copy made by value is not kept.
+ */
+#define HASHMAP_DEFINE(name, key_type, val_type) \
+    static inline val_type* name##_put(hashmap *hm, const key_type *key, val_type const *val) { \
+        return hashmap_put(hm, key, sizeof(key_type), val, sizeof(val_type)); \
+    } \
+    static inline val_type* name##_get(hashmap *hm, const key_type *key) { \
+        void *val; \
+        unsigned int len; \
+        hashmap_get(hm, key, sizeof(key_type), &val, &len); \
+        return val; \
+    } \
+    static inline int name##_del(hashmap *hm, const key_type *key) { \
+        return hashmap_del(hm, key, sizeof(key_type)); \
+    }
+
 #endif // _HASHMAP_H
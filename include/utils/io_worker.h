@@ -0,0 +1,29 @@
+#ifndef _IO_WORKER_H
+#define _IO_WORKER_H
+
+// Saves and loads small files on a thread of its own, so that a slow disk
+// never holds up a frame. Without the thread (io_worker_init not called, or
+// it failed), everything runs right away on the calling thread.
+
+// Writes the whole file to the given path, returns nonzero on failure
+typedef int (*io_write_fn)(const char *path, void *userdata);
+typedef void (*io_task_fn)(void *userdata);
+
+int io_worker_init();
+
+// Finishes everything that was queued first
+void io_worker_close();
+
+// Queues a write of the file at path. The file is written next to path first,
+// and renamed over it once complete, so a crash never leaves half a file
+// behind. A newer write of the same path replaces one that hasn't started
+// yet. Userdata is handed to free_fn (if any) once the write is done.
+void io_worker_write(const char *path, io_write_fn fn, void *userdata, io_task_fn free_fn);
+
+// Queues any other work, eg. reading a file ahead of use
+void io_worker_run(io_task_fn fn, void *userdata);
+
+// Waits until everything queued so far is done
+void io_worker_flush();
+
+#endif // _IO_WORKER_H
@@ -0,0 +1,59 @@
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+// Work-stealing job scheduler, shared by everything that has work to do off
+// the main thread. Without a pool (jobs_init not called, or a single core),
+// jobs run right away on the thread that submits them.
+
+typedef struct job_t job;
+typedef void (*job_fn)(void *userdata);
+
+// Number of unfinished jobs that were submitted with the counter. Other jobs
+// can be held back until it reaches zero. Must not be freed or reused while
+// jobs_wait is still needed on it.
+typedef struct job_counter_t {
+    SDL_atomic_t count;
+    SDL_SpinLock lock;
+    job *waiting; // Jobs held back until count reaches zero
+} job_counter;
+
+enum {
+    JOB_MAIN_THREAD = 0x1, // Only run from jobs_run_main, eg. for anything that calls SDL render functions
+};
+
+// Called after every job with its run time in performance counter units
+typedef void (*job_profile_hook)(const char *name, uint64_t counts, void *userdata);
+
+int jobs_init(int threads);
+void jobs_close();
+int jobs_thread_count();
+
+// Lets only the first threads workers run, the others wait until the count
+// goes up again. 0 or more than jobs_thread_count() lets all of them run.
+void jobs_set_active(int threads);
+int jobs_active_count();
+void jobs_set_profile_hook(job_profile_hook hook, void *userdata);
+
+void job_counter_init(job_counter *counter);
+int job_counter_done(job_counter *counter);
+
+// The name is shown in traces and passed to the profile hook, so it must be a
+// string literal or otherwise outlive the job. The counter may be NULL.
+void jobs_run(const char *name, job_fn fn, void *userdata, job_counter *counter, int flags);
+void jobs_run_after(job_counter *after,
+                    const char *name,
+                    job_fn fn,
+                    void *userdata,
+                    job_counter *counter,
+                    int flags);
+
+// Runs other jobs while waiting, so it is fine to call from inside a job
+void jobs_wait(job_counter *counter);
+
+// Runs the jobs queued for the main thread. Returns how many there were.
+int jobs_run_main();
+
+#endif // _JOBS_H
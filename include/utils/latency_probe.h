@@ -0,0 +1,57 @@
+#ifndef _LATENCY_PROBE_H
+#define _LATENCY_PROBE_H
+
+#include <stdint.h>
+
+/*
+ * Follows key and button presses through the game to the screen, for tuning
+ * input latency. One press is followed at a time, through these stages: the
+ * SDL event, the controller command made of it, the HAR move or state change
+ * it leads to, the first frame drawn after that and the present of that
+ * frame. Presses that don't get that far within LATENCY_TIMEOUT_MS, such as
+ * those in menus, are dropped.
+ *
+ * Controllers and HARs may run on the simulation thread, frames are drawn on
+ * the main thread. Without latency_probe_enable, all of this does nothing.
+ */
+
+// Histogram buckets are a millisecond each, the last one takes anything longer
+#define LATENCY_BUCKETS 100
+#define LATENCY_TIMEOUT_MS 500
+
+enum {
+    LATENCY_SPAN_CMD = 0, // Event to controller command
+    LATENCY_SPAN_ACT, // Command to the HAR acting on it
+    LATENCY_SPAN_RENDER, // To the frame that draws it
+    LATENCY_SPAN_PRESENT, // To that frame being presented
+    LATENCY_SPAN_TOTAL,
+    LATENCY_SPANS
+};
+
+typedef struct latency_stats_t {
+    unsigned int samples; // Presses followed all the way
+    unsigned int dropped;
+    unsigned int hist[LATENCY_SPANS][LATENCY_BUCKETS];
+} latency_stats;
+
+// With marker set, a white square is drawn in the top right corner of the
+// frame each followed press shows up in, to check the numbers with a photodiode
+void latency_probe_enable(int enable, int marker);
+int latency_probe_is_enabled();
+int latency_probe_marker_due();
+
+// Stages in order. timestamp is that of the SDL event of a key or button going down.
+void latency_probe_input(uint32_t timestamp);
+void latency_probe_cmd();
+void latency_probe_act();
+void latency_probe_rendered();
+void latency_probe_presented();
+
+void latency_probe_get(latency_stats *stats);
+void latency_probe_reset();
+const char* latency_probe_span_name(int span);
+
+// p is in the range 0..100. Milliseconds, rounded down.
+int latency_probe_percentile(const latency_stats *stats, int span, float p);
+
+#endif // _LATENCY_PROBE_H
@@ -0,0 +1,45 @@
+#ifndef _LOAD_TIMER_H
+#define _LOAD_TIMER_H
+
+#include <stdint.h>
+
+/*
+ * Times the parts of starting up and loading scenes, for the load benchmark.
+ * Loading may happen on worker threads, so the times are summed atomically.
+ * Until load_timer_enable, load_timer_start returns 0 and nothing is added.
+ */
+enum {
+    LOAD_TIME_PLUGINS = 0,
+    LOAD_TIME_VIDEO_INIT,
+    LOAD_TIME_AUDIO_INIT,
+    LOAD_TIME_GAME_FILES, // Waiting for the init jobs, see engine_init
+    LOAD_TIME_ENGINE_INIT, // All of engine_init
+    LOAD_TIME_SCENE, // game_load_new
+    LOAD_TIME_BK, // load_bk_file, sprites included
+    LOAD_TIME_AF, // load_af_file, sprites included
+    LOAD_TIME_SPRITES, // Decoding single sprites, summed over threads
+    LOAD_TIME_TCACHE_WARM,
+    LOAD_TIME_FRAME, // Drawing and presenting a frame
+    LOAD_TIME_COUNT
+};
+
+typedef struct load_time_t {
+    unsigned int count;
+    float total_ms;
+    float max_ms;
+} load_time;
+
+// Also starts the clock that load_timer_elapsed_ms reads
+void load_timer_enable();
+int load_timer_is_enabled();
+float load_timer_elapsed_ms();
+
+// Performance counter, or 0 when disabled
+uint64_t load_timer_start();
+void load_timer_add(int phase, uint64_t start);
+
+void load_timer_get(int phase, load_time *t);
+void load_timer_reset();
+const char* load_timer_name(int phase);
+
+#endif // _LOAD_TIMER_H
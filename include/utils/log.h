@@ -3,20 +3,48 @@
 
 #include <stdlib.h>
 
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_ERROR 2
+
+// Messages below this level are compiled out, arguments and all
+#ifndef LOG_COMPILE_LEVEL
+#ifdef DEBUGMODE
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#else
+#define LOG_COMPILE_LEVEL LOG_INFO
+#endif
+#endif
+
 #ifdef DEBUGMODE
-#define DEBUG(...) log_print('D', __FUNCTION__, __VA_ARGS__ )
-#define PERROR(...) log_print('E', __FUNCTION__, __VA_ARGS__ )
-#define INFO(...) log_print('I', __FUNCTION__, __VA_ARGS__ )
+#define LOG_FN __FUNCTION__
+#else
+#define LOG_FN NULL
+#endif
+
+// Messages below the runtime level are skipped before anything is formatted
+#define LOG_AT(level, mode, ...) \
+    do { if((level) >= _log_level) log_print(mode, LOG_FN, __VA_ARGS__); } while(0)
+
+#if LOG_COMPILE_LEVEL <= LOG_DEBUG
+#define DEBUG(...) LOG_AT(LOG_DEBUG, 'D', __VA_ARGS__)
 #else
 #define DEBUG(...)
-#define PERROR(...) log_print('E', NULL, __VA_ARGS__ )
-#define INFO(...) log_print('I', NULL, __VA_ARGS__ )
 #endif
+#if LOG_COMPILE_LEVEL <= LOG_INFO
+#define INFO(...) LOG_AT(LOG_INFO, 'I', __VA_ARGS__)
+#else
+#define INFO(...)
+#endif
+#define PERROR(...) LOG_AT(LOG_ERROR, 'E', __VA_ARGS__)
 
 #define LOGTICK(x) _log_tick = x;
 extern unsigned int _log_tick;
+extern int _log_level;
 
 void log_print(char mode, const char* fn, const char *fmt, ...);
+void log_set_level(int level);
+int log_get_level();
 int log_init(const char *filename);
 void log_close();
 
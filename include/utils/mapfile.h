@@ -0,0 +1,17 @@
+#ifndef _MAPFILE_H
+#define _MAPFILE_H
+
+#include <stddef.h>
+
+// Read-only view of a whole file. Memory mapped where the platform
+// supports it, otherwise read into a heap buffer.
+typedef struct mapfile_t {
+    const char *data;
+    size_t size;
+    int mapped;
+} mapfile;
+
+int mapfile_open(mapfile *mf, const char *filename);
+void mapfile_close(mapfile *mf);
+
+#endif // _MAPFILE_H
@@ -0,0 +1,34 @@
+#ifndef _MEMARENA_H
+#define _MEMARENA_H
+
+#include <stddef.h>
+#include "utils/allocator.h"
+
+// Bump allocator. Allocations are carved out of large blocks and are
+// only released all at once, by memarena_reset() or memarena_free().
+typedef struct memarena_block_t memarena_block;
+
+typedef struct memarena_t {
+    memarena_block *head;
+    size_t block_size;
+    size_t used;
+} memarena;
+
+void memarena_create(memarena *arena, size_t block_size);
+void* memarena_alloc(memarena *arena, size_t size);
+void* memarena_realloc(memarena *arena, void *ptr, size_t size);
+void memarena_reset(memarena *arena);
+void memarena_free(memarena *arena);
+size_t memarena_used(const memarena *arena);
+
+// Shared arenas for containers, through the allocator interface. Anything
+// made with the scene allocator must be gone before the scene is torn
+// down, and anything made with the frame allocator before the frame ends.
+// Freeing through these allocators does nothing.
+allocator memarena_scene_allocator();
+allocator memarena_frame_allocator();
+void memarena_scene_reset();
+void memarena_frame_reset();
+void memarena_close();
+
+#endif // _MEMARENA_H
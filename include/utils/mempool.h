@@ -0,0 +1,28 @@
+#ifndef _MEMPOOL_H
+#define _MEMPOOL_H
+
+#include "utils/allocator.h"
+
+// Fixed capacity pool of equally sized memory blocks. When the pool runs out,
+// allocations fall back to the allocator, so callers never need to handle a full pool.
+typedef struct mempool_t {
+    char *data;
+    void *free_list;
+    unsigned int block_size;
+    unsigned int capacity;
+    unsigned int used;
+    unsigned int peak;
+    unsigned int overflows; // Allocations that had to fall back to the allocator
+    allocator alloc;
+} mempool;
+
+void mempool_create(mempool *pool, unsigned int block_size, unsigned int capacity);
+void mempool_create_with_allocator(mempool *pool, unsigned int block_size, unsigned int capacity, allocator alloc);
+void mempool_free(mempool *pool);
+void* mempool_alloc(mempool *pool);
+void mempool_release(mempool *pool, void *ptr);
+int mempool_owns(const mempool *pool, const void *ptr);
+unsigned int mempool_used(const mempool *pool);
+unsigned int mempool_capacity(const mempool *pool);
+
+#endif // _MEMPOOL_H
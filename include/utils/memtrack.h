@@ -0,0 +1,55 @@
+#ifndef _MEMTRACK_H
+#define _MEMTRACK_H
+
+#include <stddef.h>
+#include "utils/allocator.h"
+
+// Tracking allocator. Every block carries a small header with its size and tag,
+// so live bytes, allocation counts and high water marks can be kept per
+// subsystem. Blocks from mem_malloc must only be freed with mem_free.
+
+typedef enum {
+    MEM_TAG_MISC = 0,
+    MEM_TAG_VIDEO,
+    MEM_TAG_TCACHE,
+    MEM_TAG_RESOURCES,
+    MEM_TAG_AUDIO,
+    MEM_TAG_OBJECTS,
+    MEM_TAG_GUI,
+    MEM_TAG_NET,
+    MEM_TAG_COUNT
+} mem_tag;
+
+typedef struct mem_stats_t {
+    size_t live; // Bytes currently allocated
+    size_t peak; // Highest live bytes seen
+    unsigned int allocs; // Allocations made, reallocs not included
+    unsigned int count; // Blocks currently allocated
+} mem_stats;
+
+void* mem_malloc(mem_tag tag, size_t size);
+void* mem_calloc(mem_tag tag, size_t num, size_t size);
+void* mem_realloc(mem_tag tag, void *ptr, size_t size);
+void mem_free(void *ptr);
+
+// For containers, through vector_create_with_allocator etc.
+allocator mem_allocator(mem_tag tag);
+
+const char* mem_tag_name(mem_tag tag);
+void mem_get_stats(mem_tag tag, mem_stats *stats);
+void mem_get_total(mem_stats *stats);
+void mem_reset_peaks();
+
+// Allocation guard. Allocations made by a thread between mem_guard_begin and
+// mem_guard_end are counted and reported to the hook, which logs them with a
+// backtrace by default. Without the ALLOC_GUARD build option only mem_malloc
+// and friends are seen, with it every malloc in the game code is.
+typedef void (*mem_guard_hook)(const char *where, size_t size, void *userdata);
+
+void mem_guard_begin(const char *where);
+void mem_guard_end();
+unsigned int mem_guard_count();
+void mem_guard_reset();
+void mem_guard_set_hook(mem_guard_hook hook, void *userdata);
+
+#endif // _MEMTRACK_H
@@ -0,0 +1,31 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+/*
+ * Pushes numbers about a running server to a statsd compatible collector
+ * over UDP, eg. for dashboards and autoscaling of headless servers and
+ * relays. Names are prefixed with "openomf." and sent as gauges ("|g") or
+ * timings ("|ms"). Lines are gathered into datagrams of at most
+ * METRICS_PACKET_SIZE bytes; a lost datagram only loses one report.
+ *
+ * Without metrics_open (or if it failed), all of this does nothing.
+ */
+
+// Stays under the usual internet MTU, so datagrams aren't fragmented
+#define METRICS_PACKET_SIZE 1400
+
+// How often servers report
+#define METRICS_INTERVAL_MS 10000
+
+// Target is "host:port", the port defaults to statsd's 8125
+int metrics_open(const char *target);
+void metrics_close();
+int metrics_is_active();
+
+void metrics_gauge(const char *name, double value);
+void metrics_timing(const char *name, double ms);
+
+// Sends what is gathered so far
+void metrics_flush();
+
+#endif // _METRICS_H
@@ -0,0 +1,64 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Frames of timing history kept for the graph and percentiles
+#define PROFILER_HISTORY 256
+
+enum {
+    PROF_FRAME = 0, // Whole main loop iteration
+    PROF_EVENTS,
+    PROF_STATIC_TICK,
+    PROF_DYNAMIC_TICK,
+    PROF_AUDIO,
+    PROF_RENDER,
+    PROF_CONSOLE,
+    PROF_PRESENT,
+    PROF_PRESENT_GAP, // From one present to the next
+    PROF_RUN_AHEAD, // Ticking ahead for the frame, see game_state_run_ahead
+    PROF_FRAME_DELAY, // Waiting for a later vblank to start the frame at
+    PROF_COUNT
+};
+
+// Running totals of events rather than times
+enum {
+    PROF_CNT_DYNAMIC_TICKS = 0,
+    PROF_CNT_DROPPED_TICKS, // Given up on after falling too far behind
+    PROF_CNT_SKIPPED_FRAMES, // Not rendered to catch up
+    PROF_CNT_TCACHE_HITS,
+    PROF_CNT_TCACHE_MISSES, // Textures built at draw time
+    PROF_CNT_TCACHE_WARMED, // Textures built ahead of use
+    PROF_CNT_ROLLBACKS, // Late netplay actions replayed
+    PROF_CNT_ROLLBACK_TICKS, // Ticks simulated again for them
+    PROF_CNT_OBJ_SPAWNS, // Objects added to the game state
+    PROF_CNT_OBJ_FREES, // Objects removed from it
+    PROF_CNT_RUN_AHEAD_TICKS, // Ticks simulated only to be drawn
+    PROF_CNT_COUNT
+};
+
+void profiler_begin(int phase);
+void profiler_end(int phase);
+void profiler_frame_end();
+
+// Adds a span measured elsewhere, in performance counter units
+void profiler_record(int phase, uint64_t counts);
+
+// Counters may be bumped from the simulation thread
+void profiler_count(int counter, int n);
+unsigned int profiler_get_count(int counter);
+const char* profiler_counter_name(int counter);
+
+const char* profiler_phase_name(int phase);
+float profiler_get_ms(int phase, int frames_ago);
+float profiler_percentile(int phase, float p);
+int profiler_frame_count();
+void profiler_reset_history();
+
+// Keeps every frame from now on, instead of only the last PROFILER_HISTORY.
+// The report prints average, p99 and max per phase and ends the capture.
+void profiler_capture_start();
+void profiler_capture_report(FILE *out);
+
+#endif // _PROFILER_H
@@ -21,6 +21,14 @@ uint32_t random_intmax(struct random_t *r);
 /* Return a random float in 0 <= r <= 1.0f */
 float random_float(struct random_t *r);
 
+/* Counter-based generator: the result only depends on the key and the counter,
+ * so a stream needs no state of its own. Any counter value can be drawn in any
+ * order, eg. the tick, and gives the same result every time.
+ */
+uint32_t random_hash(uint32_t key, uint32_t counter);
+
+/* Return a random integer in 0 <= r < upperbound, see random_hash */
+uint32_t random_hash_int(uint32_t key, uint32_t counter, uint32_t upperbound);
 
 /* Same as the above but keeps an internal state
  * Use as a replacement for rand()
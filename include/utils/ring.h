@@ -0,0 +1,24 @@
+#ifndef _RING_H
+#define _RING_H
+
+#include <SDL2/SDL.h>
+
+// Fixed capacity queue of equally sized items for one producer thread and
+// one consumer thread. Neither side takes a lock. Capacity is rounded up to
+// a power of two.
+typedef struct ring_t {
+    char *data;
+    unsigned int item_size;
+    unsigned int mask;
+    SDL_atomic_t head; // Only written by the producer
+    SDL_atomic_t tail; // Only written by the consumer
+} ring;
+
+void ring_create(ring *r, unsigned int item_size, unsigned int capacity);
+void ring_free(ring *r);
+int ring_push(ring *r, const void *item);
+int ring_pop(ring *r, void *item);
+unsigned int ring_size(ring *r);
+unsigned int ring_capacity(const ring *r);
+
+#endif // _RING_H
@@ -5,13 +5,21 @@
 
 typedef struct str_t {
     size_t len;
+    size_t capacity; // Allocated bytes, including the terminator
     char* data;
 } str;
 
+// Non-owning, read-only view into a string. Not necessarily zero terminated.
+typedef struct str_view_t {
+    size_t len;
+    const char *data;
+} str_view;
+
 void str_create(str *string);
 void str_create_from_cstr(str *string, const char *cstr);
 void str_create_from_data(str *string, const char *data, size_t len);
 void str_free(str *string);
+void str_reserve(str *string, size_t len);
 
 size_t str_size(const str *string);
 
@@ -39,4 +47,10 @@ int str_to_long(const str *string, long *result);
 int str_to_float(const str *string, float *result);
 const char* str_c(const str *string);
 
+str_view str_view_of(const str *string);
+str_view str_view_from_cstr(const char *cstr);
+str_view str_view_sub(str_view view, size_t start, size_t end);
+int str_view_equal(str_view a, str_view b);
+int str_view_starts_with(str_view view, str_view prefix);
+
 #endif // _UTIL_STRING_H
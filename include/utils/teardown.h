@@ -0,0 +1,34 @@
+#ifndef _TEARDOWN_H
+#define _TEARDOWN_H
+
+/*
+ * Frees that are too slow to do all at once, such as the resources of the
+ * scene that was just left. They are queued here and done a step at a time
+ * from the main loop, within a time budget per frame, so that a scene change
+ * doesn't show up as one long frame.
+ *
+ * Anything may be queued from any thread; the steps run on the main thread.
+ * Before teardown_init and after teardown_close, queued frees happen right away.
+ */
+
+// Time given to queued frees per frame
+#define TEARDOWN_FRAME_US 1000
+
+// Does a step of the free and returns 1 while there is more to do. The
+// last step frees data as well, if it needs that.
+typedef int (*teardown_fn)(void *data);
+
+void teardown_init();
+void teardown_close();
+
+void teardown_push(teardown_fn fn, void *data);
+
+// Runs steps for about budget_us microseconds, at least one if anything is
+// queued. Returns the number of frees still queued.
+int teardown_run(unsigned int budget_us);
+
+// Finishes everything queued, eg. before what it frees into goes away
+void teardown_flush();
+int teardown_pending();
+
+#endif // _TEARDOWN_H
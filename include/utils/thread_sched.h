@@ -0,0 +1,27 @@
+#ifndef _THREAD_SCHED_H
+#define _THREAD_SCHED_H
+
+/*
+ * Core pinning and priorities of the engine's threads, to keep OS
+ * scheduling from adding jitter. Every thread applies the settings of its
+ * role itself when it starts, and logs what it actually got.
+ */
+enum {
+    THREAD_ROLE_MAIN = 0, // Events and rendering, and ticks without the simulation thread
+    THREAD_ROLE_SIM,
+    THREAD_ROLE_AUDIO,
+    THREAD_ROLE_NET,
+    THREAD_ROLE_JOBS, // Job workers and other background work
+    THREAD_ROLE_COUNT
+};
+
+// Core lists per role, see cpu_parse_cores; NULL or empty for any core.
+// Job workers default to the cores the simulation is not pinned to. With
+// raise_priority, audio and network threads ask for real-time or high
+// priority, as far as the OS allows.
+void thread_sched_init(const char *cores[THREAD_ROLE_COUNT], int raise_priority);
+
+// Applies the settings of a role to the calling thread
+void thread_sched_apply(int role);
+
+#endif // _THREAD_SCHED_H
@@ -0,0 +1,32 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+// Opt-in event tracing in Chrome trace event format. The output can be
+// opened in chrome://tracing or ui.perfetto.dev.
+//
+// Every thread that emits events gets its own single producer ring buffer,
+// and a writer thread drains the buffers into the file. Emitting an event
+// is a couple of atomic loads and stores, and nothing when tracing is off.
+// Event names and categories are stored as pointers, so they must be string
+// literals or otherwise outlive the trace.
+
+int trace_start(const char *filename);
+void trace_stop();
+int trace_is_active();
+void trace_close();
+
+void trace_begin(const char *cat, const char *name);
+void trace_end(const char *cat, const char *name);
+void trace_instant(const char *cat, const char *name, int value);
+
+// Events that didn't fit in a thread buffer since the trace was started
+unsigned int trace_dropped();
+
+// Flight recorder. While on, the thread buffers keep the latest events even
+// without a trace running, and trace_flight_dump writes those of all threads
+// out as a trace file. The file is written on the io worker.
+void trace_flight_set(int on);
+int trace_flight_is_on();
+int trace_flight_dump(const char *filename);
+
+#endif // _TRACE_H
@@ -14,6 +14,7 @@ typedef struct vector_t {
 } vector;
 
 typedef int (*vector_compare_func)(const void*, const void*);
+typedef int (*vector_remove_func)(void *item, void *userdata);
 
 void vector_create_with_allocator(vector *vector, unsigned int block_size, allocator alloc);
 void vector_create(vector *vector, unsigned int block_size);
@@ -25,7 +26,37 @@ int vector_prepend(vector *vector, const void *value);
 void vector_sort(vector *vector, vector_compare_func cf);
 unsigned int vector_size(const vector *vector);
 int vector_delete(vector *vector, iterator *iterator);
+unsigned int vector_remove_if(vector *vector, vector_remove_func rf, void *userdata);
 void vector_iter_begin(const vector *vector, iterator *iter);
 void vector_iter_end(const vector *vector, iterator *iter);
 
+/*
+ * Typed access to a vector of one element type, with the element size known
+ * at compile time. VECTOR_DEFINE(name, type) declares inline functions that
+ * work on a vector made with name_create (or vector_create with sizeof(type)):
+ *   name_at(vec, i)      element i, unchecked
+ *   name_get(vec, i)     element i, or NULL if out of range
+ *   name_append(vec, v)  same as vector_append
+ * Loops over a typed vector go by index, eg.
+ *   for(unsigned int i = 0; i < vector_size(vec); i++) { name_at(vec, i)... }
+ * Element pointers are only good until the vector grows.
+ */
+#define VECTOR_DEFINE(name, type) \
+    static inline void name##_create(vector *vec) { \
+        vector_create(vec, sizeof(type)); \
+    } \
+    static inline type* name##_at(const vector *vec, unsigned int i) { \
+        return (type*)vec->data + i; \
+    } \
+    static inline type* name##_get(const vector *vec, unsigned int i) { \
+        return (i < vec->blocks) ? (type*)vec->data + i : NULL; \
+    } \
+    static inline int name##_append(vector *vec, type const *v) { \
+        if(vec->blocks < vec->reserved) { \
+            ((type*)vec->data)[vec->blocks++] = *v; \
+            return 0; \
+        } \
+        return vector_append(vec, v); \
+    }
+
 #endif // _VECTOR_H
@@ -0,0 +1,30 @@
+#ifndef _ENCODER_H
+#define _ENCODER_H
+
+#define ENCODER_DEFAULT_FPS 60
+
+typedef struct encoder_options_t {
+    const char *command; // Shell command that reads the frames from its standard input
+    const char *audio_path; // WAV file for the mixed audio, or NULL for none
+    int fps; // Frame rate of the output; frames are repeated or left out to keep it
+    int rgba; // Raw RGBA frames instead of YUV4MPEG2
+    int wait; // Wait for the encoder instead of dropping frames it can't keep up with
+} encoder_options;
+
+/*
+* Streams the finished frames into an external encoder, such as
+* "ffmpeg -i - vod.mkv". Frames are read back on the render thread and
+* converted and written out by a worker thread.
+*/
+int encoder_start(const encoder_options *opts);
+void encoder_stop();
+int encoder_active();
+
+// Called between submitting and presenting a frame. The clock says where
+// the frame is on the output's timeline, in milliseconds.
+void encoder_capture(unsigned int clock_ms);
+
+unsigned int encoder_frame_count();
+unsigned int encoder_dropped_count();
+
+#endif // _ENCODER_H
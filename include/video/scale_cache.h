@@ -0,0 +1,32 @@
+#ifndef _SCALE_CACHE_H
+#define _SCALE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Keeps what the scaler made of a sprite on disk, so the next run doesn't
+ * have to scale it again. Scalers always give the same output for the same
+ * input, so entries are found by a hash of the scaler, the factor and the
+ * input pixels; the palette is part of the key through the input only when
+ * the scaler works on converted colors. The file is mapped when opened and
+ * rewritten with the new entries on close.
+ *
+ * Without scale_cache_open (or if it failed), nothing is found or kept.
+ * Finding and adding entries may happen on any thread, opening and closing
+ * only while nothing else uses the cache.
+ */
+
+uint64_t scale_cache_key(const char *scaler_name, int factor, int w, int h);
+uint64_t scale_cache_key_add(uint64_t key, const char *data, size_t len);
+
+// max_bytes limits the file, entries past it are not kept
+int scale_cache_open(const char *path, unsigned int max_bytes);
+void scale_cache_close();
+int scale_cache_is_open();
+
+// Returns the stored output if it has the expected size, NULL otherwise
+const char* scale_cache_find(uint64_t key, uint32_t size);
+void scale_cache_add(uint64_t key, const char *data, uint32_t size);
+
+#endif // _SCALE_CACHE_H
@@ -0,0 +1,12 @@
+#ifndef _SCALER_POOL_H
+#define _SCALER_POOL_H
+
+#include "plugins/scaler_plugin.h"
+
+int scaler_pool_scale(scaler_plugin *scaler,
+                      const char* in,
+                      char* out,
+                      int w, int h,
+                      int factor);
+
+#endif // _SCALER_POOL_H
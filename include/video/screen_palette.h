@@ -3,9 +3,68 @@
 
 #include <stdint.h>
 
+#define PALETTE_MASK_WORDS 8
+
+// One bit per palette index
+typedef struct {
+    uint32_t bits[PALETTE_MASK_WORDS];
+} palette_mask;
+
+// Palette index to RGBA lookup table. Remap tables and palette offsets
+// are folded into the table when it is built.
+typedef struct {
+    union {
+        uint8_t data[256][4];
+        uint32_t packed[256]; // Same as above, one pixel per word
+    };
+} palette_lut;
+
+// Colors 0-47 are the HAR colors. Each player has a bank of its own: the
+// first player's is at 0-47, the second player's copy of them at 48-95. A
+// surface drawn with the pal_offset of a bank takes its indexes below
+// PLAYER_PALETTE_SIZE from that bank; all other indexes are shared. The banks
+// have to fit in the 256 colors next to the scene's own, which is what limits
+// their number.
+#define PLAYER_PALETTE_COUNT 2
+#define PLAYER_PALETTE_SIZE 48
+
+static inline uint8_t palette_bank_offset(int player) {
+    return player * PLAYER_PALETTE_SIZE;
+}
+
+// Where a surface's palette index ends up when drawn with pal_offset
+static inline uint8_t palette_bank_index(uint8_t idx, uint8_t pal_offset) {
+    return (idx < PLAYER_PALETTE_SIZE) ? idx + pal_offset : idx;
+}
+
 typedef struct {
     uint8_t data[256][3];
-    unsigned int version;
+    unsigned int version; // Bumped on any change
+    unsigned int changed[256]; // Version at which each index last changed
+    unsigned int word_changed[PALETTE_MASK_WORDS]; // Latest change within each 32 index block
+
+    // Final colors of each player, kept up to date by screen_palette_get_lut()
+    palette_lut player_luts[PLAYER_PALETTE_COUNT];
+    unsigned int player_lut_version[PLAYER_PALETTE_COUNT];
+    uint8_t player_lut_built[PLAYER_PALETTE_COUNT];
 } screen_palette;
 
+void palette_mask_clear(palette_mask *mask);
+void palette_mask_fill(palette_mask *mask);
+void palette_mask_set(palette_mask *mask, uint8_t index);
+int palette_mask_get(const palette_mask *mask, uint8_t index);
+int palette_mask_any(const palette_mask *mask, int start, int count);
+
+void screen_palette_mark(screen_palette *pal, const uint8_t old_data[256][3], int force);
+int screen_palette_changed_since(const screen_palette *pal, const palette_mask *mask, unsigned int version);
+
+// Move count entries from start towards the color at ref. The weight is in
+// 8.8 fixed point out of 255, so 255 << 8 replaces the entries with the color.
+// Tinting also scales the weight by the brightness of each entry.
+void screen_palette_blend(screen_palette *pal, int start, int count, int ref, int weight);
+void screen_palette_tint(screen_palette *pal, int start, int count, int ref, int weight);
+
+// Lookup table without remapping for the given palette offset, or NULL if the offset isn't a player's
+const palette_lut* screen_palette_get_lut(screen_palette *pal, uint8_t pal_offset);
+
 #endif // _SCREEN_PALETTE
@@ -0,0 +1,16 @@
+#ifndef _SCREENSHOT_H
+#define _SCREENSHOT_H
+
+// Frames are read back on the render thread, and encoded and written on a
+// worker thread so that the game does not stall on the compression.
+void screenshot_request();
+void screenshot_sequence_start(int every);
+void screenshot_sequence_stop();
+int screenshot_sequence_active();
+unsigned int screenshot_sequence_count();
+
+// Called between submitting and presenting a frame
+void screenshot_capture();
+void screenshot_close();
+
+#endif // _SCREENSHOT_H
@@ -6,18 +6,33 @@
 #include "video/screen_palette.h"
 #include "resources/palette.h"
 
+// Opaque pixel runs of a paletted surface stencil
+typedef struct {
+    uint16_t *runs;     // Start and length pairs, row by row
+    unsigned int *rows; // Index of the first run pair of each row, h+1 entries
+    unsigned int *offsets; // Start of each row in the pixels, h+1 entries, if they are packed
+} surface_rle;
+
 typedef struct {
     int w;
     int h;
     int type;
     char *data;
-    char *stencil;
+    char *stencil; // NULL for RGBA, and for paletted surfaces with a packed stencil
+    surface_rle *rle;
+    uint32_t *hitmask; // Stencil packed into bits, or NULL if not built
+    palette_mask *pal_used; // Palette indexes used by visible pixels, or NULL if unknown
+    SDL_atomic_t *refs; // Owner count of the buffers above if shared, otherwise NULL
+    uint8_t borrowed; // The buffers above belong to someone else and are never written or freed
+    uint8_t opaque; // Stencil has no holes; only known while rle is built
+    uint8_t rle_pixels; // data holds only the pixels of the runs, see surface_pack_pixels
     uint8_t force_refresh;
 } surface;
 
 enum {
     SURFACE_TYPE_RGBA,
-    SURFACE_TYPE_PALETTE
+    SURFACE_TYPE_PALETTE,
+    SURFACE_TYPE_ALPHA // Coverage only, one byte per pixel; white until tinted when drawn
 };
 
 enum {
@@ -25,6 +40,7 @@ enum {
     SUB_METHOD_MIRROR
 };
 
+int surface_pixel_bytes(int type);
 void surface_create(surface *sur, int type, int w, int h);
 void surface_force_refresh(surface *sur);
 void surface_create_from_image(surface *sur, image *img);
@@ -32,7 +48,30 @@ void surface_create_from_data(surface *sur, int type, int w, int h, const char *
 int surface_to_image(surface *sur, image *img);
 void surface_copy(surface *dst, surface *src);
 void surface_copy_ex(surface *dst, surface *src);
+void surface_share(surface *dst, surface *src);
+
+// Makes a surface of buffers that belong to something else, such as a file
+// mapped read-only. src describes them and must not have refs. The buffers
+// must outlive the surface; writing to it copies them first.
+void surface_create_borrowed(surface *sur, const surface *src);
+void surface_make_writable(surface *sur);
 void surface_free(surface *sur);
+unsigned int surface_get_free_count();
+int surface_build_rle(surface *sur);
+void surface_build_hitmask(surface *sur);
+void surface_build_pal_mask(surface *sur);
+
+// Frees the byte stencil of a surface that has its runs and hit mask built,
+// which then stand in for it. The bytes come back if the surface is written to.
+void surface_pack_stencil(surface *sur);
+int surface_stencil_at(const surface *sur, int i);
+void surface_read_stencil(const surface *sur, char *dst, int start, int count);
+
+// Drops the transparent pixels of a surface with a packed stencil, keeping
+// only the runs. Blitters and conversions work on them as they are; anything
+// else reads pixels with surface_read_pixels. Writing brings the rest back.
+void surface_pack_pixels(surface *sur);
+void surface_read_pixels(const surface *sur, char *dst, int start, int count);
 void surface_clear(surface *sur);
 void surface_fill(surface *sur, color c);
 void surface_sub(surface *dst,
@@ -48,12 +87,29 @@ void surface_to_rgba(surface *sur,
                      screen_palette *pal,
                      char *remap_table,
                      uint8_t pal_offset);
+void surface_build_lut(palette_lut *lut,
+                       const screen_palette *pal,
+                       const char *remap_table,
+                       uint8_t pal_offset);
+void surface_to_rgba_lut(surface *sur, char *dst, const palette_lut *lut);
+void surface_to_rgba_lut_rows(surface *sur, char *dst, const palette_lut *lut, int y0, int y1);
+void surface_select_kernels();
 void surface_additive_blit(surface *dst,
                            surface *src,
                            int dst_x, int dst_y,
                            palette *remap_pal,
                            SDL_RendererFlip flip);
 void surface_rgba_blit(surface *dst, const surface *src, int dst_x, int dst_y);
+
+// Blends the w*h area at src_x,src_y of an alpha surface over an RGBA surface
+// in color c, as SDL would blend a white RGBA surface with that color and
+// alpha modulation. Returns 0 if nothing was visible, else the drawn rows in
+// *y0 (first) and *y1 (past the last) in dst coordinates.
+int surface_alpha_tint_blit(surface *dst, const surface *src,
+                            int dst_x, int dst_y,
+                            int src_x, int src_y, int w, int h,
+                            uint8_t opacity, color c, int additive,
+                            int *y0, int *y1);
 void surface_alpha_blit(surface *dst,
                         surface *src,
                         int dst_x, int dst_y,
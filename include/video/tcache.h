@@ -6,14 +6,47 @@
 #include "video/screen_palette.h"
 #include "plugins/scaler_plugin.h"
 
+typedef void (*tcache_flush_hook)(void *userdata);
+
+typedef struct tcache_stats_t {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int warmed;
+    unsigned int evictions;
+    unsigned int bytes_used;
+    unsigned int budget;
+    unsigned int copy_bytes;
+    unsigned int reuploads;
+    unsigned int streaming; // Entries moved to streaming textures for changing often
+    unsigned int entries;
+} tcache_stats;
+
 void tcache_init(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler);
+void tcache_release();
 void tcache_reinit(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler);
 void tcache_close();
 void tcache_clear();
+void tcache_retire();
 SDL_Texture* tcache_get(surface *sur,
                         screen_palette *pal,
                         char *remap_table,
-                        uint8_t pal_offset);
+                        uint8_t pal_offset,
+                        SDL_Rect *src_rect);
+SDL_Texture* tcache_get_static(surface *sur, screen_palette *pal, SDL_Rect *src_rect);
+int tcache_warm(surface *sur, screen_palette *pal, char *remap_table, uint8_t pal_offset);
+void tcache_set_budget(unsigned int bytes);
+void tcache_set_copy_budget(unsigned int bytes);
+void tcache_set_flush_hook(tcache_flush_hook hook, void *userdata);
 void tcache_tick();
 
+// Between these, misses only reserve their texture; the conversion and scaling
+// of all of them runs in parallel in tcache_resolve, which must be called
+// before anything drawn with the textures is submitted. tcache_end_frame
+// resolves whatever is left.
+void tcache_begin_frame();
+void tcache_resolve();
+void tcache_end_frame();
+void tcache_forget(surface *sur);
+void tcache_get_stats(tcache_stats *stats);
+
 #endif // _TCACHE_H
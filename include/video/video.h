@@ -6,6 +6,7 @@
 #include "video/image.h"
 #include "video/screen_palette.h"
 #include "resources/palette.h"
+#include "utils/vector.h"
 
 #define NATIVE_W 320
 #define NATIVE_H 200
@@ -21,9 +22,36 @@ enum VIDEO_FLIP_MODE {
     FLIP_VERTICAL = 0x2,
 };
 
+// Recorded sprite draws that can be drawn again without redoing the work
+// that produced them.
+typedef struct video_draw_list_t {
+    vector cmds;
+    unsigned int surface_frees; // surface_get_free_count() when recorded
+    int valid;
+} video_draw_list;
+
+// What video_render_submit does to the frame on its way to the window
+typedef struct video_frame_info_t {
+    int w;
+    int h;
+    float fade;
+    int move_x; // Screen shake offset, in frame pixels
+    int move_y;
+} video_frame_info;
+
 enum VIDEO_RENDERER {
     VIDEO_RENDERER_QUIRKS = 0,
     VIDEO_RENDERER_HW,
+    VIDEO_RENDERER_NULL, // Draws nothing, for measuring everything but the drawing
+};
+
+// Scalers that stretch the finished native resolution frame on the GPU.
+// Unlike scaler plugins, these keep all sprite textures at native size.
+enum VIDEO_FRAME_SCALER {
+    VIDEO_FRAME_SCALER_NEAREST = 0,
+    VIDEO_FRAME_SCALER_LINEAR,
+    VIDEO_FRAME_SCALER_CRT,
+    VIDEO_FRAME_SCALER_COUNT
 };
 
 int video_init(int window_w,
@@ -32,6 +60,7 @@ int video_init(int window_w,
                int vsync,
                const char* scaler_name,
                int scale_factor);
+int video_init_headless();
 int video_reinit(int window_w,
                  int window_h,
                  int fullscreen,
@@ -40,6 +69,9 @@ int video_reinit(int window_w,
                  int scale_factor);
 void video_reinit_renderer();
 void video_get_state(int *w, int *h, int *fs, int *vsync);
+int video_get_refresh_rate();
+const char* video_frame_scaler_name(int frame_scaler);
+int video_find_frame_scaler(const char *name);
 void video_move_target(int x, int y);
 
 void video_render_sprite(
@@ -91,19 +123,55 @@ void video_render_sprite_flip_scale_opacity_tint(
     uint8_t opacity,
     color tint);
 
+// Draws the w*h area at src_x,src_y of the surface, unscaled
+void video_render_sprite_part_opacity_tint(
+    surface *sur,
+    int x,
+    int y,
+    int src_x,
+    int src_y,
+    int w,
+    int h,
+    unsigned int render_mode,
+    uint8_t opacity,
+    color tint);
+
+// Shadows added between begin and end are drawn as one black layer at end
+void video_shadow_begin();
+void video_render_shadow(surface *sur, int x, int y, unsigned int flip_mode, float y_percent);
+void video_shadow_end();
+
+void video_draw_list_create(video_draw_list *list);
+void video_draw_list_free(video_draw_list *list);
+void video_record_begin(video_draw_list *list);
+void video_record_end(video_draw_list *list);
+int video_draw_list_replay(const video_draw_list *list);
+
 void video_select_renderer(int renderer);
 void video_tick();
 void video_render_background(surface *sur);
+void video_prewarm_sprite(surface *sur, int pal_offset);
 void video_render_prepare();
 void video_render_finish();
+void video_render_submit();
+void video_render_present();
 void video_close();
 void video_screenshot(image *img);
-int video_area_capture(surface *sur, int x, int y, int w, int h);
+
+// The finished frame at native size times the scale factor, unstretched.
+// Pixels are RGBA bytes, w * h * 4 of them. Call after submitting.
+void video_get_frame_info(video_frame_info *info);
+int video_read_frame(char *dst);
+// Queues a capture of a native resolution area. The area is read from the
+// next presented frame, after which sur is created and *ok is set to 1.
+int video_area_capture(surface *sur, int *ok, int x, int y, int w, int h);
+void video_area_capture_cancel(surface *sur);
 void video_set_fade(float fade);
 
 void video_set_base_palette(const palette *src);
 palette *video_get_base_palette();
 void video_force_pal_refresh();
+void video_sync_pal_version();
 void video_copy_pal_range(const palette *src, int src_start, int dst_start, int amount);
 screen_palette* video_get_pal_ref();
 
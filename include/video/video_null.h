@@ -0,0 +1,8 @@
+#ifndef _VIDEO_NULL_H
+#define _VIDEO_NULL_H
+
+#include "video/video_state.h"
+
+void video_null_init(video_state *state);
+
+#endif // _VIDEO_NULL_H
@@ -16,9 +16,11 @@ typedef void (*render_background_cb)(
                     video_state *state,
                     surface *sur);
 
+// src is the part of the surface to draw, or NULL for all of it
 typedef void (*render_sprite_fsot_cb)(
                     video_state *state,
                     surface *sur,
+                    const SDL_Rect *src,
                     SDL_Rect *dst,
                     SDL_BlendMode blend_mode,
                     int pal_offset,
@@ -26,6 +28,12 @@ typedef void (*render_sprite_fsot_cb)(
                     uint8_t opacity,
                     color tint);
 
+// Asks the renderer to get a sprite ready for drawing before it is needed
+typedef void (*render_prewarm_cb)(
+                    video_state *state,
+                    surface *sur,
+                    int pal_offset);
+
 typedef struct video_render_cbs_t {
     render_close_cb render_close;
     render_reinit_cb render_reinit;
@@ -33,6 +41,7 @@ typedef struct video_render_cbs_t {
     render_finish_cb render_finish;
     render_sprite_fsot_cb render_fsot;
     render_background_cb render_background;
+    render_prewarm_cb render_prewarm; // Optional
 } video_render_cbs;
 
 #endif // _VIDEO_OPS_H
@@ -25,10 +25,13 @@ typedef struct video_state_t {
 
     int cur_renderer;
     SDL_Texture *target;
+    int frame_scaler; // VIDEO_FRAME_SCALER_*, or -1 if a scaler plugin is used
+    SDL_Texture *scanlines; // Darkens every other half row for FRAME_SCALER_CRT
 
     // Palettes
     palette *base_palette;
     screen_palette *cur_palette;
+    screen_palette *ver_palette; // Palette contents at the last version bump
 
     // Renderer
     video_render_cbs cb;
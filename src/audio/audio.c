@@ -1,12 +1,243 @@
 #include <stdlib.h>
 #include <string.h>
+#include <SDL2/SDL.h>
 #include "audio/audio.h"
 #include "audio/sink.h"
 #include "audio/sinks/openal_sink.h"
+#include "audio/sinks/sdl_sink.h"
 #include "utils/log.h"
+#include "utils/thread_sched.h"
+#include "utils/trace.h"
 
 audio_sink *_global_sink = NULL;
 
+/*
+* Stream updates run on a worker thread, so that buffers get refilled even
+* when the main loop stalls. The worker owns the sink; the rest of the game
+* talks to it through a single producer, single consumer command queue that
+* is only ever written from the main thread.
+*/
+
+// How often the worker refills stream buffers
+#define AUDIO_THREAD_PERIOD_MS 5
+#define AUDIO_QUEUE_SIZE 256
+// Stream ids are tracked in this many slots for audio_is_playing
+#define AUDIO_PLAYING_SLOTS 256
+
+enum {
+    AUDIO_CMD_PLAY,
+    AUDIO_CMD_PLAY_SAMPLE,
+    AUDIO_CMD_STOP,
+    AUDIO_CMD_VOLUME,
+    AUDIO_CMD_PANNING,
+    AUDIO_CMD_PITCH,
+    AUDIO_CMD_BUFFERS
+};
+
+typedef struct audio_cmd_t {
+    int type;
+    unsigned int sid;
+    audio_source *src;
+    audio_sample sample;
+    float volume;
+    float panning;
+    float pitch;
+    float priority;
+    int buffer_count;
+    int buffer_size;
+} audio_cmd;
+
+static audio_cmd _queue[AUDIO_QUEUE_SIZE];
+static SDL_atomic_t _queue_head; // Next slot to write, owned by the main thread
+static SDL_atomic_t _queue_tail; // Next slot to read, owned by the audio thread
+static SDL_atomic_t _playing[AUDIO_PLAYING_SLOTS];
+static SDL_atomic_t _running;
+static void *_tap = NULL; // audio_tap_cb, read from the mixing thread
+static SDL_Thread *_audio_thread = NULL;
+static unsigned int _next_sid = 1;
+
+static void audio_run_cmd(audio_cmd *cmd) {
+    switch(cmd->type) {
+        case AUDIO_CMD_PLAY:
+            sink_play_set_id(_global_sink, cmd->sid, cmd->src, cmd->volume, cmd->panning, cmd->pitch);
+            break;
+        case AUDIO_CMD_PLAY_SAMPLE:
+            sink_play_sample(_global_sink, cmd->sid, &cmd->sample, cmd->volume, cmd->panning, cmd->pitch, cmd->priority);
+            break;
+        case AUDIO_CMD_STOP:
+            sink_stop(_global_sink, cmd->sid);
+            break;
+        case AUDIO_CMD_VOLUME:
+            if(sink_is_playing(_global_sink, cmd->sid)) {
+                sink_set_stream_volume(_global_sink, cmd->sid, cmd->volume);
+            }
+            break;
+        case AUDIO_CMD_PANNING:
+            if(sink_is_playing(_global_sink, cmd->sid)) {
+                sink_set_stream_panning(_global_sink, cmd->sid, cmd->panning);
+            }
+            break;
+        case AUDIO_CMD_PITCH:
+            if(sink_is_playing(_global_sink, cmd->sid)) {
+                sink_set_stream_pitch(_global_sink, cmd->sid, cmd->pitch);
+            }
+            break;
+        case AUDIO_CMD_BUFFERS:
+            sink_set_buffers(_global_sink, cmd->buffer_count, cmd->buffer_size);
+            break;
+    }
+}
+
+static void audio_drain_queue() {
+    int tail = SDL_AtomicGet(&_queue_tail);
+    while(tail != SDL_AtomicGet(&_queue_head)) {
+        audio_run_cmd(&_queue[tail % AUDIO_QUEUE_SIZE]);
+        tail++;
+        SDL_AtomicSet(&_queue_tail, tail);
+    }
+}
+
+// Drops queued commands without running them. Sample data may already be gone.
+static void audio_discard_queue() {
+    int tail = SDL_AtomicGet(&_queue_tail);
+    while(tail != SDL_AtomicGet(&_queue_head)) {
+        audio_cmd *cmd = &_queue[tail % AUDIO_QUEUE_SIZE];
+        if(cmd->type == AUDIO_CMD_PLAY) {
+            source_free(cmd->src);
+            free(cmd->src);
+        }
+        tail++;
+    }
+    SDL_AtomicSet(&_queue_tail, tail);
+}
+
+static unsigned int audio_new_sid() {
+    unsigned int sid = _next_sid++;
+    if(_next_sid == 0) {
+        _next_sid = 1;
+    }
+    SDL_AtomicSet(&_playing[sid % AUDIO_PLAYING_SLOTS], sid);
+    return sid;
+}
+
+static void audio_push_cmd(audio_cmd *cmd) {
+    if(_audio_thread == NULL) {
+        audio_run_cmd(cmd);
+        return;
+    }
+    int head = SDL_AtomicGet(&_queue_head);
+    while(head - SDL_AtomicGet(&_queue_tail) >= AUDIO_QUEUE_SIZE) {
+        // Full; the worker empties the queue every few milliseconds
+        SDL_Delay(1);
+    }
+    _queue[head % AUDIO_QUEUE_SIZE] = *cmd;
+    SDL_AtomicSet(&_queue_head, head + 1);
+}
+
+// Called by the sink when a stream is removed
+static void audio_stream_done(unsigned int sid) {
+    SDL_AtomicCAS(&_playing[sid % AUDIO_PLAYING_SLOTS], sid, 0);
+}
+
+static int audio_thread_run(void *data) {
+    thread_sched_apply(THREAD_ROLE_AUDIO);
+    while(SDL_AtomicGet(&_running)) {
+        audio_drain_queue();
+        trace_begin("audio", "refill");
+        sink_render(_global_sink);
+        trace_end("audio", "refill");
+        SDL_Delay(AUDIO_THREAD_PERIOD_MS);
+    }
+    return 0;
+}
+
+unsigned int audio_play(audio_source *src, float volume, float panning, float pitch) {
+    if(_global_sink == NULL) {
+        source_free(src);
+        free(src);
+        return 0;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_PLAY;
+    cmd.sid = audio_new_sid();
+    cmd.src = src;
+    cmd.volume = volume;
+    cmd.panning = panning;
+    cmd.pitch = pitch;
+    audio_push_cmd(&cmd);
+    return cmd.sid;
+}
+
+// Plays a short sample. When voices run out, samples with a lower priority
+// are cut off first. The sample data must stay around while audio is running.
+unsigned int audio_play_sample(const audio_sample *sample, float volume, float panning, float pitch, float priority) {
+    if(_global_sink == NULL) {
+        return 0;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_PLAY_SAMPLE;
+    cmd.sid = audio_new_sid();
+    cmd.sample = *sample;
+    cmd.volume = volume;
+    cmd.panning = panning;
+    cmd.pitch = pitch;
+    cmd.priority = priority;
+    cmd.src = NULL;
+    audio_push_cmd(&cmd);
+    return cmd.sid;
+}
+
+void audio_stop(unsigned int sid) {
+    if(_global_sink == NULL || sid == 0) {
+        return;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_STOP;
+    cmd.sid = sid;
+    audio_push_cmd(&cmd);
+}
+
+void audio_set_volume(unsigned int sid, float volume) {
+    if(_global_sink == NULL || sid == 0) {
+        return;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_VOLUME;
+    cmd.sid = sid;
+    cmd.volume = volume;
+    audio_push_cmd(&cmd);
+}
+
+void audio_set_panning(unsigned int sid, float panning) {
+    if(_global_sink == NULL || sid == 0) {
+        return;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_PANNING;
+    cmd.sid = sid;
+    cmd.panning = panning;
+    audio_push_cmd(&cmd);
+}
+
+void audio_set_pitch(unsigned int sid, float pitch) {
+    if(_global_sink == NULL || sid == 0) {
+        return;
+    }
+    audio_cmd cmd;
+    cmd.type = AUDIO_CMD_PITCH;
+    cmd.sid = sid;
+    cmd.pitch = pitch;
+    audio_push_cmd(&cmd);
+}
+
+// Streams are tracked by slot, so very old ids may be reported as stopped early
+int audio_is_playing(unsigned int sid) {
+    if(sid == 0) {
+        return 0;
+    }
+    return (unsigned int)SDL_AtomicGet(&_playing[sid % AUDIO_PLAYING_SLOTS]) == sid;
+}
+
 struct sink_info_t {
     int (*sink_init_fn)(audio_sink *sink);
     const char* name;
@@ -53,13 +284,21 @@ int audio_is_sink_available(const char* sink_name) {
     return 0;
 }
 
+// Only does something if the audio thread is not running
 void audio_render() {
-    if(_global_sink != NULL) {
+    if(_global_sink != NULL && _audio_thread == NULL) {
+        trace_begin("audio", "refill");
         sink_render(_global_sink);
+        trace_end("audio", "refill");
     }
 }
 
-int audio_init(const char* sink_name) {
+// Whether buffers are refilled by the audio thread instead of audio_render()
+int audio_is_threaded() {
+    return _audio_thread != NULL;
+}
+
+int audio_init(const char* sink_name, int buffer_count, int buffer_size, int voice_count, int period) {
     struct sink_info_t si;
     int found = 0;
 
@@ -87,18 +326,38 @@ int audio_init(const char* sink_name) {
     // Init sink
     _global_sink = malloc(sizeof(audio_sink));
     sink_init(_global_sink);
+    sink_set_buffers(_global_sink, buffer_count, buffer_size);
+    sink_set_voice_count(_global_sink, voice_count);
+    sink_set_period(_global_sink, period);
+    sink_set_stream_done_cb(_global_sink, audio_stream_done);
     if(si.sink_init_fn(_global_sink) != 0) {
         free(_global_sink);
         _global_sink = NULL;
         return 1;
     }
 
+    // Start the worker. If that fails, streams are updated from audio_render.
+    SDL_AtomicSet(&_queue_head, 0);
+    SDL_AtomicSet(&_queue_tail, 0);
+    SDL_AtomicSet(&_running, 1);
+    _audio_thread = SDL_CreateThread(audio_thread_run, "audio", NULL);
+    if(_audio_thread == NULL) {
+        PERROR("Unable to create audio thread: %s", SDL_GetError());
+    }
+
     // Success
     INFO("Audio system initialized.");
     return 0;
 }
 
 void audio_close() {
+    if(_audio_thread != NULL) {
+        SDL_AtomicSet(&_running, 0);
+        SDL_WaitThread(_audio_thread, NULL);
+        _audio_thread = NULL;
+
+        audio_discard_queue();
+    }
     if(_global_sink != NULL) {
         sink_free(_global_sink);
         free(_global_sink);
@@ -107,6 +366,32 @@ void audio_close() {
     }
 }
 
+void audio_set_tap(audio_tap_cb tap) {
+    SDL_AtomicSetPtr(&_tap, (void*)tap);
+}
+
+audio_tap_cb audio_get_tap() {
+    return (audio_tap_cb)SDL_AtomicGetPtr(&_tap);
+}
+
+// Streams are given their buffers when they start, so the ones playing now
+// keep what they have
+void audio_set_buffers(int count, int size) {
+    if(_global_sink == NULL) {
+        return;
+    }
+    audio_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = AUDIO_CMD_BUFFERS;
+    cmd.buffer_count = count;
+    cmd.buffer_size = size;
+    audio_push_cmd(&cmd);
+}
+
 audio_sink* audio_get_sink() {
     return _global_sink;
 }
+
+int audio_get_frequency() {
+    return (_global_sink != NULL) ? _global_sink->frequency : 0;
+}
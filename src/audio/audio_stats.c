@@ -0,0 +1,89 @@
+#include <limits.h>
+#include <SDL2/SDL.h>
+#include "audio/audio_stats.h"
+
+// Times are kept in microseconds, so they fit the atomics
+static SDL_atomic_t depth;
+static SDL_atomic_t depth_min = {INT_MAX};
+static SDL_atomic_t underruns;
+static SDL_atomic_t decodes;
+static SDL_atomic_t decode_us;
+static SDL_atomic_t decode_max_us;
+static SDL_atomic_t sounds;
+static SDL_atomic_t latency_us;
+static SDL_atomic_t latency_max_us;
+static SDL_atomic_t voices;
+
+static int counts_to_us(uint64_t counts) {
+    uint64_t us = counts * 1000000 / SDL_GetPerformanceFrequency();
+    return (us > INT_MAX) ? INT_MAX : (int)us;
+}
+
+static void atomic_max(SDL_atomic_t *a, int v) {
+    int old;
+    do {
+        old = SDL_AtomicGet(a);
+    } while(v > old && !SDL_AtomicCAS(a, old, v));
+}
+
+static void atomic_min(SDL_atomic_t *a, int v) {
+    int old;
+    do {
+        old = SDL_AtomicGet(a);
+    } while(v < old && !SDL_AtomicCAS(a, old, v));
+}
+
+void audio_stats_depth(int buffers) {
+    SDL_AtomicSet(&depth, buffers);
+    atomic_min(&depth_min, buffers);
+}
+
+void audio_stats_underrun() {
+    SDL_AtomicAdd(&underruns, 1);
+}
+
+void audio_stats_voices(int playing) {
+    SDL_AtomicSet(&voices, playing);
+}
+
+void audio_stats_decode(uint64_t counts) {
+    int us = counts_to_us(counts);
+    SDL_AtomicAdd(&decodes, 1);
+    SDL_AtomicAdd(&decode_us, us);
+    atomic_max(&decode_max_us, us);
+}
+
+void audio_stats_latency(uint64_t requested) {
+    if(requested == 0) {
+        return;
+    }
+    int us = counts_to_us(SDL_GetPerformanceCounter() - requested);
+    SDL_AtomicAdd(&sounds, 1);
+    SDL_AtomicAdd(&latency_us, us);
+    atomic_max(&latency_max_us, us);
+}
+
+void audio_stats_get(audio_stats *stats) {
+    int min = SDL_AtomicGet(&depth_min);
+    stats->depth = SDL_AtomicGet(&depth);
+    stats->depth_min = (min == INT_MAX) ? -1 : min;
+    stats->underruns = SDL_AtomicGet(&underruns);
+    stats->decodes = SDL_AtomicGet(&decodes);
+    stats->decode_ms = stats->decodes ? SDL_AtomicGet(&decode_us) / 1000.0f / stats->decodes : 0.0f;
+    stats->decode_max_ms = SDL_AtomicGet(&decode_max_us) / 1000.0f;
+    stats->sounds = SDL_AtomicGet(&sounds);
+    stats->latency_ms = stats->sounds ? SDL_AtomicGet(&latency_us) / 1000.0f / stats->sounds : 0.0f;
+    stats->latency_max_ms = SDL_AtomicGet(&latency_max_us) / 1000.0f;
+    stats->voices = SDL_AtomicGet(&voices);
+}
+
+void audio_stats_reset() {
+    SDL_AtomicSet(&depth_min, INT_MAX);
+    SDL_AtomicSet(&underruns, 0);
+    SDL_AtomicSet(&decodes, 0);
+    SDL_AtomicSet(&decode_us, 0);
+    SDL_AtomicSet(&decode_max_us, 0);
+    SDL_AtomicSet(&sounds, 0);
+    SDL_AtomicSet(&latency_us, 0);
+    SDL_AtomicSet(&latency_max_us, 0);
+}
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
 #ifdef __linux__
 #include <strings.h> // strcasecmp
 #endif // __linux__
@@ -8,6 +10,7 @@
 #include "audio/audio.h"
 #include "utils/log.h"
 #include "game/utils/settings.h"
+#include "audio/sources/prefetch_source.h"
 
 #ifdef USE_DUMB
 #include "audio/sources/dumb_source.h"
@@ -20,10 +23,16 @@
 #endif // USE_OGGVORBIS
 
 #ifdef STANDALONE_SERVER
-int music_play(const char *filename) { return 0; }
+int music_play(unsigned int id) { return 0; }
+int music_prefetch(unsigned int id) { return 0; }
+int music_reload() { return 0; }
+void music_tick() {}
+void music_close() {}
 void music_set_volume(float volume) {}
 void music_stop() {}
+void music_fade_out() {}
 int music_playing() { return 1; }
+unsigned int music_get_resource() { return 0; }
 #else // STANDALONE_SERVER
 
 struct music_override_t {
@@ -31,9 +40,35 @@ struct music_override_t {
     const char *name;
 };
 
+/*
+* Two decode slots: the track that is playing, and the next one. The next
+* track is opened and parsed on a loader thread, and once it is ready it
+* takes over, with the old track fading out over MUSIC_FADE_TICKS while
+* the new one fades in. Until then the old track keeps playing.
+*/
+typedef struct music_slot_t {
+    unsigned int resource_id; // 0 if the slot is empty
+    char file[256];
+    int channels;
+    audio_source *src; // Opened by the loader, NULL if that failed
+    SDL_Thread *thread;
+    SDL_atomic_t ready;
+} music_slot;
+
 static unsigned int _music_stream_id = 0;
 static unsigned int _music_resource_id = 0;
 static float _music_volume = VOLUME_DEFAULT;
+static int _fade_in_ticks = 0;
+
+// The track that is fading out
+static unsigned int _fade_stream_id = 0;
+static int _fade_out_ticks = 0;
+
+static music_slot _next;
+static int _play_pending = 0; // Start the next track as soon as it's ready
+
+// How far ahead of playback the music decode thread runs
+#define MUSIC_PREFETCH_MS 500
 
 const char* get_file_or_override(unsigned int id) {
     // Declare music overrides
@@ -58,32 +93,23 @@ const char* get_file_or_override(unsigned int id) {
     return pm_get_resource_path(id);
 }
 
-int music_play(unsigned int id) {
-    audio_sink *sink = audio_get_sink();
-
-    // If there is no sink, do nothing
-    if(sink == NULL) {
-        return 0;
-    }
-
-    int channels = settings_get()->sound.music_mono ? 1 : 2;
+// Runs on the loader thread
+static audio_source* music_open(const char *filename, int channels) {
     (void)(channels);
-    // Check if the wanted music is already playing
-    if(id == _music_resource_id && _music_stream_id != 0) {
-        return 0;
-    }
 
-    // ... Okay, it's not. Create a new resource and start loading.
     audio_source *music_src = malloc(sizeof(audio_source));
     source_init(music_src);
 
+    // Module sources read the loop flag while opening, so set it first
+    source_set_loop(music_src, 1);
+
     // Find path & ext
-    const char* filename = get_file_or_override(id);
-    const char* ext = strrchr(filename, '.') + 1;
+    const char* ext = strrchr(filename, '.');
     if(ext == NULL || ext == filename) {
         PERROR("Couldn't find extension for music file!");
         goto error_0;
     }
+    ext++;
 
     // Try to open as module file
     int failed = 1;
@@ -114,28 +140,161 @@ int music_play(unsigned int id) {
         goto error_0;
     }
 
-    // Source settings
-    source_set_loop(music_src, 1);
+    // Decode ahead on a separate thread. If that can't be done, the plain
+    // source still works, it just decodes inside the stream update.
+    audio_source *prefetch_src = malloc(sizeof(audio_source));
+    source_init(prefetch_src);
+    if(prefetch_source_init(prefetch_src, music_src, MUSIC_PREFETCH_MS)) {
+        free(prefetch_src);
+        return music_src;
+    }
+    return prefetch_src;
 
-    // Stop previous
-    music_stop();
+error_0:
+    free(music_src);
+    return NULL;
+}
+
+static int music_load_run(void *arg) {
+    music_slot *slot = arg;
+    slot->src = music_open(slot->file, slot->channels);
+    SDL_AtomicSet(&slot->ready, 1);
+    return 0;
+}
+
+static void music_drop_next() {
+    if(_next.thread != NULL) {
+        SDL_WaitThread(_next.thread, NULL);
+        _next.thread = NULL;
+    }
+    if(_next.src != NULL) {
+        source_free(_next.src);
+        free(_next.src);
+        _next.src = NULL;
+    }
+    _next.resource_id = 0;
+    SDL_AtomicSet(&_next.ready, 0);
+    _play_pending = 0;
+}
+
+static void music_stop_fading() {
+    if(_fade_stream_id != 0) {
+        audio_stop(_fade_stream_id);
+        _fade_stream_id = 0;
+        _fade_out_ticks = 0;
+    }
+}
+
+// Swaps the next track in, once the loader is done with it
+static int music_start_next() {
+    if(_next.thread != NULL) {
+        SDL_WaitThread(_next.thread, NULL);
+        _next.thread = NULL;
+    }
+    audio_source *src = _next.src;
+    unsigned int id = _next.resource_id;
+    _next.src = NULL;
+    _next.resource_id = 0;
+    SDL_AtomicSet(&_next.ready, 0);
+    _play_pending = 0;
+    if(src == NULL) {
+        return 1;
+    }
+
+    // Whatever plays now fades out; a track that was already fading is cut
+    music_stop_fading();
+    int crossfade = (_music_stream_id != 0);
+    if(crossfade) {
+        _fade_stream_id = _music_stream_id;
+        _fade_out_ticks = MUSIC_FADE_TICKS;
+    }
 
-    // Start playback
     _music_resource_id = id;
-    _music_stream_id = sink_play(sink, music_src);
-    sink_set_stream_volume(sink, _music_stream_id, _music_volume);
+    _fade_in_ticks = crossfade ? MUSIC_FADE_TICKS : 0;
+    _music_stream_id = audio_play(src, crossfade ? 0.0f : _music_volume, PANNING_DEFAULT, PITCH_DEFAULT);
+    return 0;
+}
+
+// Opens a track and starts decoding it, so that a following music_play()
+// with the same id can start right away.
+int music_prefetch(unsigned int id) {
+    if(audio_get_sink() == NULL) {
+        return 0;
+    }
+
+    // Already playing or already waiting
+    if(id == _music_resource_id && _music_stream_id != 0) {
+        return 0;
+    }
+    if(id == _next.resource_id) {
+        return 0;
+    }
 
-    // All done
+    music_drop_next();
+    _next.resource_id = id;
+    snprintf(_next.file, sizeof(_next.file), "%s", get_file_or_override(id));
+    _next.channels = settings_get()->sound.music_mono ? 1 : 2;
+    _next.thread = SDL_CreateThread(music_load_run, "music load", &_next);
+    if(_next.thread == NULL) {
+        music_load_run(&_next);
+    }
     return 0;
+}
 
-error_0:
-    free(music_src);
-    return 1;
+int music_play(unsigned int id) {
+    audio_sink *sink = audio_get_sink();
+
+    // If there is no sink, do nothing
+    if(sink == NULL) {
+        return 0;
+    }
+
+    // Check if the wanted music is already playing
+    if(id == _music_resource_id && _music_stream_id != 0) {
+        _play_pending = 0;
+        return 0;
+    }
+
+    // ... Okay, it's not. Start loading it if that hasn't happened yet;
+    // it is started by music_tick() once it's ready.
+    music_prefetch(id);
+    _play_pending = 1;
+    if(SDL_AtomicGet(&_next.ready)) {
+        return music_start_next();
+    }
+    return 0;
+}
+
+// Called every static tick, the same ticks the scene fades run on
+void music_tick() {
+    if(_play_pending && SDL_AtomicGet(&_next.ready)) {
+        music_start_next();
+    }
+    if(_fade_stream_id != 0) {
+        if(--_fade_out_ticks <= 0) {
+            music_stop_fading();
+        } else {
+            audio_set_volume(_fade_stream_id, _music_volume * _fade_out_ticks / MUSIC_FADE_TICKS);
+        }
+    }
+    if(_fade_in_ticks > 0 && _music_stream_id != 0) {
+        _fade_in_ticks--;
+        audio_set_volume(_music_stream_id, _music_volume * (MUSIC_FADE_TICKS - _fade_in_ticks) / MUSIC_FADE_TICKS);
+    }
 }
 
 int music_reload() {
     unsigned int old_res_id = _music_resource_id;
     music_stop();
+    music_drop_next();
+
+    // Settings such as mono playback are read when the module is loaded
+#ifdef USE_DUMB
+    dumb_source_clear_cache();
+#endif
+#ifdef USE_MODPLUG
+    modplug_source_clear_cache();
+#endif
     return music_play(old_res_id);
 }
 
@@ -146,8 +305,8 @@ void music_set_volume(float volume) {
     }
 
     _music_volume = volume;
-    if(_music_stream_id != 0) {
-        sink_set_stream_volume(sink, _music_stream_id, _music_volume);
+    if(_music_stream_id != 0 && _fade_in_ticks == 0) {
+        audio_set_volume(_music_stream_id, _music_volume);
     }
 }
 
@@ -156,15 +315,33 @@ void music_stop() {
     if(sink == NULL) {
         return;
     }
+    _play_pending = 0;
+    music_stop_fading();
     if(_music_stream_id == 0) {
         return;
     }
-    sink_stop(sink, _music_stream_id);
+    audio_stop(_music_stream_id);
     _music_stream_id = 0;
+    _fade_in_ticks = 0;
 }
 
-int music_playing() {
+void music_fade_out() {
+    if(audio_get_sink() == NULL) {
+        return;
+    }
+    _play_pending = 0;
     if(_music_stream_id == 0) {
+        return;
+    }
+    music_stop_fading();
+    _fade_stream_id = _music_stream_id;
+    _fade_out_ticks = MUSIC_FADE_TICKS;
+    _music_stream_id = 0;
+    _fade_in_ticks = 0;
+}
+
+int music_playing() {
+    if(_music_stream_id == 0 && !_play_pending) {
         return 0;
     }
     return 1;
@@ -174,4 +351,14 @@ unsigned int music_get_resource() {
     return _music_resource_id;
 }
 
+void music_close() {
+    music_drop_next();
+#ifdef USE_DUMB
+    dumb_source_clear_cache();
+#endif
+#ifdef USE_MODPLUG
+    modplug_source_clear_cache();
+#endif
+}
+
 #endif // STANDALONE_SERVER
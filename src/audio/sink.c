@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "audio/sink.h"
+#include "audio/sources/raw_source.h"
 #include "utils/log.h"
 
 unsigned int _sink_global_id = 1;
@@ -8,22 +9,60 @@ unsigned int gid_gen() {
     return _sink_global_id++;
 }
 
+static int sink_find_slot(audio_sink *sink, unsigned int sid) {
+    for(int i = 0; i < SINK_MAX_STREAMS; i++) {
+        int slot = (sid + i) % SINK_MAX_STREAMS;
+        if(sink->slots[slot].sid == sid) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static int sink_free_slot(audio_sink *sink, unsigned int sid) {
+    for(int i = 0; i < SINK_MAX_STREAMS; i++) {
+        int slot = (sid + i) % SINK_MAX_STREAMS;
+        if(sink->slots[slot].sid == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Stops the stream and gives its slot back. Doesn't tell anyone.
+static void sink_release(audio_sink *sink, int active_idx) {
+    sink_slot *slot = &sink->slots[sink->active[active_idx]];
+    stream_stop(&slot->stream);
+    stream_free(&slot->stream);
+    slot->sid = 0;
+    sink->active[active_idx] = sink->active[--sink->active_count];
+}
+
 audio_stream* sink_get_stream(audio_sink *sink, unsigned int sid) {
     if(sid == 0) return NULL;
     if(sink == NULL) return NULL;
-    audio_stream **s;
-    unsigned int len;
-    if(hashmap_iget(&sink->streams, sid, (void**)&s, &len) != 0) {
-    	return NULL;
-    }
-    return *s;
+    // Ids are handed out in order, so the first slot is nearly always it
+    int slot = sink_find_slot(sink, sid);
+    return (slot < 0) ? NULL : &sink->slots[slot].stream;
 }
 
 void sink_init(audio_sink *sink) {
     sink->userdata = NULL;
     sink->close = NULL;
     sink->format_stream = NULL;
-    hashmap_create(&sink->streams, 6);
+    sink->stream_done = NULL;
+    sink->play_sample = NULL;
+    sink->stop_voice = NULL;
+    sink->update_voices = NULL;
+    sink->buffer_count = SINK_DEFAULT_BUFFER_COUNT;
+    sink->buffer_size = SINK_DEFAULT_BUFFER_SIZE;
+    sink->voice_count = SINK_DEFAULT_VOICE_COUNT;
+    sink->period = SINK_DEFAULT_PERIOD;
+    sink->frequency = 0;
+    for(int i = 0; i < SINK_MAX_STREAMS; i++) {
+        sink->slots[i].sid = 0;
+    }
+    sink->active_count = 0;
 }
 
 void sink_format_stream(audio_sink *sink, audio_stream *stream) {
@@ -47,57 +86,111 @@ unsigned int sink_play_set(audio_sink *sink,
 						   float volume,
 						   float panning,
 						   float pitch) {
-    audio_stream *stream = malloc(sizeof(audio_stream));
+    unsigned int new_key = gid_gen();
+    sink_play_set_id(sink, new_key, src, volume, panning, pitch);
+    return new_key;
+}
+
+void sink_play_set_id(audio_sink *sink,
+                      unsigned int sid,
+                      audio_source *src,
+                      float volume,
+                      float panning,
+                      float pitch) {
+    int slot = sink_free_slot(sink, sid);
+    if(slot < 0) {
+        PERROR("Too many audio streams!");
+        source_free(src);
+        free(src);
+        sink_stream_done(sink, sid);
+        return;
+    }
+    audio_stream *stream = &sink->slots[slot].stream;
+    sink->slots[slot].sid = sid;
+    sink->active[sink->active_count++] = slot;
     stream_init(stream, sink, src);
     sink_format_stream(sink, stream);
     stream->volume = volume;
     stream->panning = panning;
     stream->pitch = pitch;
     stream_play(stream);
-    unsigned int new_key = gid_gen();
-    hashmap_iput(&sink->streams, new_key, &stream, sizeof(audio_stream*));
-    return new_key;
+}
+
+void sink_stream_done(audio_sink *sink, unsigned int sid) {
+    if(sink->stream_done != NULL) {
+        sink->stream_done(sid);
+    }
+}
+
+/*
+* Plays a short sample. Sinks with a voice pool play it from a static buffer;
+* the sink may also decide to drop it if all voices are busy with more
+* important sounds. Other sinks stream it like any other source.
+*/
+void sink_play_sample(audio_sink *sink,
+                      unsigned int sid,
+                      const audio_sample *sample,
+                      float volume,
+                      float panning,
+                      float pitch,
+                      float priority) {
+    if(sink->play_sample != NULL) {
+        if(sink->play_sample(sink, sid, sample, volume, panning, pitch, priority) != 0) {
+            sink_stream_done(sink, sid);
+        }
+        return;
+    }
+    audio_source *src = malloc(sizeof(audio_source));
+    source_init(src);
+    raw_source_init(src, (char*)sample->data, sample->len, sample->frequency, sample->bytes);
+    sink_play_set_id(sink, sid, src, volume, panning, pitch);
 }
 
 void sink_stop(audio_sink *sink, unsigned int sid) {
+    if(sink->stop_voice != NULL && sink->stop_voice(sink, sid) == 0) {
+        sink_stream_done(sink, sid);
+        return;
+    }
+    int slot = sink_find_slot(sink, sid);
+    if(slot < 0) {
+        return;
+    }
+
     // Stop playback && remove stream
-    audio_stream *s = sink_get_stream(sink, sid);
-    stream_stop(s);
-    stream_free(s);
-    free(s);
-    hashmap_idel(&sink->streams, sid);
+    for(int i = 0; i < sink->active_count; i++) {
+        if(sink->active[i] == slot) {
+            sink_release(sink, i);
+            break;
+        }
+    }
+    sink_stream_done(sink, sid);
 }
 
 void sink_render(audio_sink *sink) {
-    iterator it;
-    hashmap_iter_begin(&sink->streams, &it);
-    hashmap_pair *pair;
-    while((pair = iter_next(&it)) != NULL) {
-        audio_stream *stream = *((audio_stream**)pair->val);
-        stream_render(stream);
-
-        // If stream is done, free it here.
-        if(stream_get_status(stream) == STREAM_STATUS_FINISHED) {
-            stream_stop(stream);
-            stream_free(stream);
-            free(stream);
-            hashmap_delete(&sink->streams, &it);
+    int i = 0;
+    while(i < sink->active_count) {
+        sink_slot *slot = &sink->slots[sink->active[i]];
+        stream_render(&slot->stream);
+
+        // If stream is done, free it here. The last one takes its place.
+        if(stream_get_status(&slot->stream) == STREAM_STATUS_FINISHED) {
+            unsigned int sid = slot->sid;
+            sink_release(sink, i);
+            sink_stream_done(sink, sid);
+        } else {
+            i++;
         }
     }
+    if(sink->update_voices != NULL) {
+        sink->update_voices(sink);
+    }
 }
 
 void sink_free(audio_sink *sink) {
     // Free streams
-    iterator it;
-    hashmap_iter_begin(&sink->streams, &it);
-    hashmap_pair *pair;
-    while((pair = iter_next(&it)) != NULL) {
-        audio_stream *stream = *((audio_stream**)pair->val);
-        stream_stop(stream);
-        stream_free(stream);
-        free(stream);
+    while(sink->active_count > 0) {
+        sink_release(sink, sink->active_count - 1);
     }
-    hashmap_free(&sink->streams);
 
     // Close sink
     if(sink->close != NULL) {
@@ -153,3 +246,37 @@ void sink_set_close_cb(audio_sink *sink, sink_close_cb cbfunc) {
 void sink_set_format_stream_cb(audio_sink *sink, sink_format_stream_cb cbfunc) {
     sink->format_stream = cbfunc;
 }
+
+void sink_set_stream_done_cb(audio_sink *sink, sink_stream_done_cb cbfunc) {
+    sink->stream_done = cbfunc;
+}
+
+void sink_set_voice_cbs(audio_sink *sink,
+                        sink_play_sample_cb play,
+                        sink_stop_voice_cb stop,
+                        sink_update_voices_cb update) {
+    sink->play_sample = play;
+    sink->stop_voice = stop;
+    sink->update_voices = update;
+}
+
+void sink_set_buffers(audio_sink *sink, int count, int size) {
+    if(count >= 2) {
+        sink->buffer_count = count;
+    }
+    if(size >= 1024) {
+        sink->buffer_size = size;
+    }
+}
+
+void sink_set_voice_count(audio_sink *sink, int count) {
+    if(count > 0) {
+        sink->voice_count = count;
+    }
+}
+
+void sink_set_period(audio_sink *sink, int period) {
+    if(period > 0) {
+        sink->period = period;
+    }
+}
@@ -12,15 +12,177 @@
 #include <stdlib.h>
 #include "audio/sinks/openal_sink.h"
 #include "audio/sinks/openal_stream.h"
+#include "audio/audio_stats.h"
 #include "utils/log.h"
 
+typedef struct {
+    ALuint source;
+    unsigned int sid; // 0 if the voice is free
+    float priority;
+    unsigned int started;
+} openal_voice;
+
 typedef struct {
     ALCdevice *device;
     ALCcontext *context;
+
+    // Sources for playing samples, and a static buffer per sample id.
+    // Buffers are uploaded on first use; 0 means not uploaded yet.
+    openal_voice *voices;
+    int voice_count;
+    ALuint *samples;
+    int sample_count;
+    unsigned int play_counter;
 } openal_sink;
 
+static void openal_sink_free_voices(openal_sink *local) {
+    for(int i = 0; i < local->voice_count; i++) {
+        alSourceStop(local->voices[i].source);
+        alDeleteSources(1, &local->voices[i].source);
+    }
+    for(int i = 0; i < local->sample_count; i++) {
+        if(local->samples[i] != 0) {
+            alDeleteBuffers(1, &local->samples[i]);
+        }
+    }
+    free(local->voices);
+    free(local->samples);
+}
+
+static ALuint openal_sink_get_sample(openal_sink *local, const audio_sample *sample) {
+    if(sample->id < 0) {
+        return 0;
+    }
+    if(sample->id >= local->sample_count) {
+        int count = sample->id + 1;
+        local->samples = realloc(local->samples, sizeof(ALuint) * count);
+        for(int i = local->sample_count; i < count; i++) {
+            local->samples[i] = 0;
+        }
+        local->sample_count = count;
+    }
+    if(local->samples[sample->id] != 0) {
+        return local->samples[sample->id];
+    }
+
+    int format = 0;
+    if(sample->bytes == 1) {
+        format = (sample->channels == 2) ? AL_FORMAT_STEREO8 : AL_FORMAT_MONO8;
+    } else if(sample->bytes == 2) {
+        format = (sample->channels == 2) ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+    }
+    if(!format) {
+        PERROR("OpenAL Sink: Unsupported sample format!");
+        return 0;
+    }
+
+    ALuint buffer;
+    while(alGetError() != AL_NO_ERROR);
+    alGenBuffers(1, &buffer);
+    alBufferData(buffer, format, sample->data, sample->len, sample->frequency);
+    if(alGetError() != AL_NO_ERROR) {
+        PERROR("OpenAL Sink: Could not upload sample %d!", sample->id);
+        alDeleteBuffers(1, &buffer);
+        return 0;
+    }
+    local->samples[sample->id] = buffer;
+    return buffer;
+}
+
+// Frees voices whose sample has played to the end
+static void openal_sink_update_voices(audio_sink *sink) {
+    openal_sink *local = sink_get_userdata(sink);
+    int playing = sink->active_count;
+    for(int i = 0; i < local->voice_count; i++) {
+        openal_voice *voice = &local->voices[i];
+        if(voice->sid == 0) {
+            continue;
+        }
+        ALint state;
+        alGetSourcei(voice->source, AL_SOURCE_STATE, &state);
+        if(state != AL_PLAYING) {
+            sink_stream_done(sink, voice->sid);
+            voice->sid = 0;
+        } else {
+            playing++;
+        }
+    }
+    audio_stats_voices(playing);
+}
+
+// Takes a free voice, or the least important one. Returns NULL if every
+// voice is busy with something more important.
+static openal_voice* openal_sink_pick_voice(audio_sink *sink, float priority) {
+    openal_sink *local = sink_get_userdata(sink);
+    openal_voice *victim = NULL;
+    for(int i = 0; i < local->voice_count; i++) {
+        openal_voice *voice = &local->voices[i];
+        if(voice->sid == 0) {
+            return voice;
+        }
+        if(victim == NULL
+                || voice->priority < victim->priority
+                || (voice->priority == victim->priority && voice->started < victim->started)) {
+            victim = voice;
+        }
+    }
+    if(victim == NULL || victim->priority > priority) {
+        return NULL;
+    }
+    alSourceStop(victim->source);
+    sink_stream_done(sink, victim->sid);
+    victim->sid = 0;
+    return victim;
+}
+
+static int openal_sink_play_sample(audio_sink *sink,
+                                   unsigned int sid,
+                                   const audio_sample *sample,
+                                   float volume,
+                                   float panning,
+                                   float pitch,
+                                   float priority) {
+    openal_sink *local = sink_get_userdata(sink);
+    ALuint buffer = openal_sink_get_sample(local, sample);
+    if(buffer == 0) {
+        return 1;
+    }
+    openal_voice *voice = openal_sink_pick_voice(sink, priority);
+    if(voice == NULL) {
+        return 1;
+    }
+
+    alSourcei(voice->source, AL_BUFFER, buffer);
+    if(sample->channels == 1) {
+        float pos[] = {panning, 0.0f, -1.0f};
+        alSourcefv(voice->source, AL_POSITION, pos);
+    }
+    alSourcef(voice->source, AL_GAIN, volume);
+    alSourcef(voice->source, AL_PITCH, pitch);
+    alSourcePlay(voice->source);
+    audio_stats_latency(sample->requested);
+
+    voice->sid = sid;
+    voice->priority = priority;
+    voice->started = local->play_counter++;
+    return 0;
+}
+
+static int openal_sink_stop_voice(audio_sink *sink, unsigned int sid) {
+    openal_sink *local = sink_get_userdata(sink);
+    for(int i = 0; i < local->voice_count; i++) {
+        if(local->voices[i].sid == sid) {
+            alSourceStop(local->voices[i].source);
+            local->voices[i].sid = 0;
+            return 0;
+        }
+    }
+    return 1;
+}
+
 void openal_sink_close(audio_sink *sink) {
     openal_sink *local = sink_get_userdata(sink);
+    openal_sink_free_voices(local);
     alcMakeContextCurrent(0);
     alcDestroyContext(local->context);
     alcCloseDevice(local->device);
@@ -49,16 +211,45 @@ int openal_sink_init(audio_sink *sink) {
     // Good for panning
     alDistanceModel(AL_NONE);
 
+    ALCint frequency = 0;
+    alcGetIntegerv(local->device, ALC_FREQUENCY, 1, &frequency);
+    sink->frequency = frequency;
+
+    // Voices for samples. Stop at the first failure; OpenAL may have a
+    // lower limit on sources than what was asked for.
+    local->voices = malloc(sizeof(openal_voice) * sink->voice_count);
+    local->voice_count = 0;
+    local->samples = NULL;
+    local->sample_count = 0;
+    local->play_counter = 0;
+    while(alGetError() != AL_NO_ERROR);
+    for(int i = 0; i < sink->voice_count; i++) {
+        openal_voice *voice = &local->voices[i];
+        alGenSources(1, &voice->source);
+        if(alGetError() != AL_NO_ERROR) {
+            PERROR("OpenAL Sink: Could only create %d of %d voices.", i, sink->voice_count);
+            break;
+        }
+        voice->sid = 0;
+        voice->priority = 0;
+        voice->started = 0;
+        local->voice_count++;
+    }
+
     // Set callbacks
     sink_set_userdata(sink, local);
     sink_set_close_cb(sink, openal_sink_close);
     sink_set_format_stream_cb(sink, openal_sink_format_stream);
+    if(local->voice_count > 0) {
+        sink_set_voice_cbs(sink, openal_sink_play_sample, openal_sink_stop_voice, openal_sink_update_voices);
+    }
 
     // Some log stuff
     INFO("OpenAL Audio Sink:");
     INFO(" * Vendor:      %s", alGetString(AL_VENDOR));
     INFO(" * Renderer:    %s", alGetString(AL_RENDERER));
     INFO(" * Version:     %s", alGetString(AL_VERSION));
+    INFO(" * Frequency:   %d", frequency);
 
     // All done
     return 0;
@@ -10,15 +10,17 @@
 #endif
 
 #include <stdlib.h>
+#include <SDL2/SDL.h>
 #include "audio/sinks/openal_stream.h"
+#include "audio/audio_stats.h"
 #include "utils/log.h"
 
-#define AUDIO_BUFFER_COUNT 2
-#define AUDIO_BUFFER_SIZE 32768
-
 typedef struct {
     unsigned int source;
-    unsigned int buffers[AUDIO_BUFFER_COUNT];
+    unsigned int *buffers;
+    int buffer_count;
+    int buffer_size;
+    char *scratch; // Decode buffer, buffer_size bytes
     int format;
 } openal_stream;
 
@@ -36,18 +38,24 @@ void openal_stream_apply(audio_stream *stream) {
     alSourcef(local->source, AL_PITCH, stream->pitch);
 }
 
+static int openal_stream_decode(audio_stream *stream, openal_stream *local) {
+    uint64_t start = SDL_GetPerformanceCounter();
+    int ret = source_update(stream->src, local->scratch, local->buffer_size);
+    audio_stats_decode(SDL_GetPerformanceCounter() - start);
+    return ret;
+}
+
 void openal_stream_play(audio_stream *stream) {
     openal_stream *local = stream_get_userdata(stream);
 
     // Fill initial buffers
-    char buf[AUDIO_BUFFER_SIZE];
-    for(int i = 0; i < AUDIO_BUFFER_COUNT; i++) {
-        int ret = source_update(stream->src, buf, AUDIO_BUFFER_SIZE);
+    for(int i = 0; i < local->buffer_count; i++) {
+        int ret = openal_stream_decode(stream, local);
         if(ret > 0) {
             alBufferData(
                 local->buffers[i],
                 local->format,
-                buf, ret,
+                local->scratch, ret,
                 source_get_frequency(stream->src));
             alSourceQueueBuffers(local->source, 1, &local->buffers[i]);
         }
@@ -73,21 +81,22 @@ void openal_stream_update(audio_stream *stream) {
     openal_stream *local = stream_get_userdata(stream);
 
     // See if we have any empty buffers to fill
-    int val;
+    int val, queued;
     alGetSourcei(local->source, AL_BUFFERS_PROCESSED, &val);
+    alGetSourcei(local->source, AL_BUFFERS_QUEUED, &queued);
+    audio_stats_depth(queued - val);
     if(val <= 0) {
         return;
     }
 
     // Handle buffer filling and loading
-    char buf[AUDIO_BUFFER_SIZE];
     ALuint n;
     while(val--) {
         // Fill buffer & re-queue
-        int ret = source_update(stream->src, buf, AUDIO_BUFFER_SIZE);
+        int ret = openal_stream_decode(stream, local);
         if(ret > 0) {
             alSourceUnqueueBuffers(local->source, 1, &n);
-            alBufferData(n, local->format, buf, ret, source_get_frequency(stream->src));
+            alBufferData(n, local->format, local->scratch, ret, source_get_frequency(stream->src));
             alSourceQueueBuffers(local->source, 1, &n);
 
             // Check for any errors
@@ -106,6 +115,8 @@ void openal_stream_update(audio_stream *stream) {
         ALenum state;
         alGetSourcei(local->source, AL_SOURCE_STATE, &state);
         if(state != AL_PLAYING) {
+            // Every buffer was played before the next one was queued
+            audio_stats_underrun();
             alSourcePlay(local->source);
         }
     }
@@ -115,12 +126,18 @@ void openal_stream_close(audio_stream *stream) {
     openal_stream *local = stream_get_userdata(stream);
     alSourceStop(local->source);
     alDeleteSources(1, &local->source);
-    alDeleteBuffers(AUDIO_BUFFER_COUNT, local->buffers);
+    alDeleteBuffers(local->buffer_count, local->buffers);
+    free(local->buffers);
+    free(local->scratch);
     free(local);
 }
 
 int openal_stream_init(audio_stream *stream, audio_sink *sink) {
     openal_stream *local = malloc(sizeof(openal_stream));
+    local->buffer_count = sink->buffer_count;
+    local->buffer_size = sink->buffer_size;
+    local->buffers = malloc(sizeof(unsigned int) * local->buffer_count);
+    local->scratch = malloc(local->buffer_size);
 
     // Dump old errors
     int error;
@@ -151,7 +168,7 @@ int openal_stream_init(audio_stream *stream, audio_sink *sink) {
     }
 
     // Generate buffers
-    alGenBuffers(AUDIO_BUFFER_COUNT, local->buffers);
+    alGenBuffers(local->buffer_count, local->buffers);
     if(alGetError() != AL_NO_ERROR) {
         PERROR("OpenAL Stream: Could not create audio buffers!");
         goto exit_1;
@@ -172,6 +189,8 @@ int openal_stream_init(audio_stream *stream, audio_sink *sink) {
 exit_1:
     alDeleteSources(1, &local->source);
 exit_0:
+    free(local->buffers);
+    free(local->scratch);
     free(local);
     return 1;
 }
@@ -0,0 +1,540 @@
+#ifdef USE_SDLAUDIO
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "audio/sinks/sdl_sink.h"
+#include "audio/audio.h"
+#include "audio/stream.h"
+#include "audio/source.h"
+#include "audio/audio_stats.h"
+#include "utils/log.h"
+
+/*
+* SDL2 audio sink. Streams and samples are mixed in the SDL audio callback
+* with a fixed-point mixer, which resamples every voice to the output rate
+* with linear interpolation. Streams are decoded on the audio worker into a
+* ring buffer per stream; samples are copied once and played from memory.
+*
+* Everything the callback reads is only changed with the device locked.
+*/
+
+#define SDL_SINK_FREQUENCY 44100
+#define SDL_SINK_MAX_STREAMS 16
+#define SDL_SINK_MIN_PERIOD 256
+
+typedef struct sdl_voice_t {
+    int active;
+    int done; // Set by the callback when a sample has played to the end
+    unsigned int sid;
+    float priority;
+    unsigned int started;
+
+    // Source data. Samples use data/len, streams use the ring buffer.
+    const char *data;
+    int len;
+    char *ring;
+    int ring_size;
+    int ring_read;
+    int ring_fill;
+    int ended; // Stream source has no more data
+    int starved; // Stream ran dry, counted as an underrun once
+    uint64_t requested; // When the sample was played, until it is first mixed
+    int pos; // Read position in frames, samples only
+
+    int bytes;
+    int channels;
+    uint32_t step; // Source frames per output frame, 16.16
+    uint32_t frac;
+    int gain_l; // Q15
+    int gain_r;
+} sdl_voice;
+
+typedef struct sdl_sample_t {
+    char *data;
+    int len;
+} sdl_sample;
+
+typedef struct sdl_sink_t {
+    SDL_AudioDeviceID device;
+    int frequency;
+    int32_t *mix;
+    int mix_frames;
+
+    sdl_voice *voices;
+    int voice_count;
+    sdl_voice *streams[SDL_SINK_MAX_STREAMS];
+    sdl_sample *samples;
+    int sample_count;
+    unsigned int play_counter;
+} sdl_sink;
+
+typedef struct sdl_stream_t {
+    sdl_voice voice;
+    char *scratch;
+    int scratch_size;
+} sdl_stream;
+
+static int sdl_voice_frame_size(const sdl_voice *voice) {
+    return voice->bytes * voice->channels;
+}
+
+static int sdl_voice_frames_left(const sdl_voice *voice) {
+    int fs = sdl_voice_frame_size(voice);
+    if(voice->ring != NULL) {
+        return voice->ring_fill / fs;
+    }
+    return voice->len / fs - voice->pos;
+}
+
+// Reads a frame relative to the read position as signed 16 bit
+static void sdl_voice_get(const sdl_voice *voice, int idx, int *l, int *r) {
+    if(idx >= sdl_voice_frames_left(voice)) {
+        *l = *r = 0;
+        return;
+    }
+    int fs = sdl_voice_frame_size(voice);
+    const char *p;
+    if(voice->ring != NULL) {
+        p = voice->ring + (voice->ring_read + idx * fs) % voice->ring_size;
+    } else {
+        p = voice->data + (voice->pos + idx) * fs;
+    }
+    if(voice->bytes == 1) {
+        *l = ((int)(uint8_t)p[0] - 128) << 8;
+        *r = (voice->channels == 2) ? ((int)(uint8_t)p[1] - 128) << 8 : *l;
+    } else {
+        int16_t v[2];
+        memcpy(v, p, sizeof(int16_t) * voice->channels);
+        *l = v[0];
+        *r = (voice->channels == 2) ? v[1] : *l;
+    }
+}
+
+static void sdl_voice_advance(sdl_voice *voice, int frames) {
+    if(voice->ring != NULL) {
+        int bytes = frames * sdl_voice_frame_size(voice);
+        if(bytes > voice->ring_fill) {
+            bytes = voice->ring_fill;
+        }
+        voice->ring_read = (voice->ring_read + bytes) % voice->ring_size;
+        voice->ring_fill -= bytes;
+    } else {
+        voice->pos += frames;
+    }
+}
+
+static void sdl_voice_mix(sdl_voice *voice, int32_t *mix, int frames) {
+    if(voice->requested != 0) {
+        audio_stats_latency(voice->requested);
+        voice->requested = 0;
+    }
+    for(int i = 0; i < frames; i++) {
+        if(sdl_voice_frames_left(voice) <= 0) {
+            // Samples are done; streams just ran dry and resume when refilled
+            if(voice->ring == NULL) {
+                voice->active = 0;
+                voice->done = 1;
+            } else if(!voice->ended && !voice->starved) {
+                voice->starved = 1;
+                audio_stats_underrun();
+            }
+            return;
+        }
+        voice->starved = 0;
+        int l0, r0, l1, r1;
+        sdl_voice_get(voice, 0, &l0, &r0);
+        sdl_voice_get(voice, 1, &l1, &r1);
+        int l = l0 + (int)(((int64_t)(l1 - l0) * voice->frac) >> 16);
+        int r = r0 + (int)(((int64_t)(r1 - r0) * voice->frac) >> 16);
+        mix[i * 2] += (l * voice->gain_l) >> 15;
+        mix[i * 2 + 1] += (r * voice->gain_r) >> 15;
+
+        voice->frac += voice->step;
+        sdl_voice_advance(voice, voice->frac >> 16);
+        voice->frac &= 0xFFFF;
+    }
+}
+
+static void sdl_sink_callback(void *userdata, Uint8 *out, int len) {
+    sdl_sink *local = userdata;
+    int16_t *samples = (int16_t*)out;
+    int frames = len / (2 * sizeof(int16_t));
+    if(frames > local->mix_frames) {
+        frames = local->mix_frames;
+        memset(out, 0, len);
+    }
+
+    memset(local->mix, 0, sizeof(int32_t) * 2 * frames);
+    int playing = 0;
+    for(int i = 0; i < local->voice_count; i++) {
+        if(local->voices[i].active) {
+            sdl_voice_mix(&local->voices[i], local->mix, frames);
+            playing++;
+        }
+    }
+    for(int i = 0; i < SDL_SINK_MAX_STREAMS; i++) {
+        if(local->streams[i] != NULL && local->streams[i]->active) {
+            sdl_voice_mix(local->streams[i], local->mix, frames);
+            playing++;
+        }
+    }
+    audio_stats_voices(playing);
+
+    for(int i = 0; i < frames * 2; i++) {
+        int32_t v = local->mix[i];
+        samples[i] = (v > 32767) ? 32767 : (v < -32768) ? -32768 : v;
+    }
+
+    audio_tap_cb tap = audio_get_tap();
+    if(tap != NULL) {
+        tap(samples, frames, local->frequency);
+    }
+}
+
+static void sdl_voice_set(sdl_sink *local, sdl_voice *voice, int frequency, float volume, float panning, float pitch) {
+    float left = 1.0f, right = 1.0f;
+    if(voice->channels == 1) {
+        if(panning > 0) {
+            left = 1.0f - panning;
+        } else {
+            right = 1.0f + panning;
+        }
+    }
+    voice->gain_l = volume * left * 32767;
+    voice->gain_r = volume * right * 32767;
+    voice->step = frequency * pitch * 65536.0f / local->frequency;
+}
+
+// -------- Streams --------
+
+static void sdl_stream_fill(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    sdl_voice *voice = &ls->voice;
+    int fs = sdl_voice_frame_size(voice);
+
+    while(1) {
+        SDL_LockAudioDevice(local->device);
+        int room = voice->ring_size - voice->ring_fill;
+        int ended = voice->ended;
+        SDL_UnlockAudioDevice(local->device);
+
+        int want = (room < ls->scratch_size) ? room : ls->scratch_size;
+        want -= want % fs;
+        if(ended || want <= 0) {
+            break;
+        }
+
+        // Decode outside the lock, so the callback never waits on it
+        uint64_t start = SDL_GetPerformanceCounter();
+        int got = source_update(stream->src, ls->scratch, want);
+        audio_stats_decode(SDL_GetPerformanceCounter() - start);
+
+        SDL_LockAudioDevice(local->device);
+        if(got <= 0) {
+            voice->ended = 1;
+        } else {
+            int write = (voice->ring_read + voice->ring_fill) % voice->ring_size;
+            int first = voice->ring_size - write;
+            if(first > got) {
+                first = got;
+            }
+            memcpy(voice->ring + write, ls->scratch, first);
+            memcpy(voice->ring, ls->scratch + first, got - first);
+            voice->ring_fill += got;
+        }
+        SDL_UnlockAudioDevice(local->device);
+    }
+}
+
+void sdl_stream_update(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    sdl_stream_fill(stream);
+
+    SDL_LockAudioDevice(local->device);
+    int finished = ls->voice.ended && ls->voice.ring_fill == 0;
+    int fill = ls->voice.ring_fill;
+    SDL_UnlockAudioDevice(local->device);
+    if(!ls->voice.ended) {
+        audio_stats_depth(fill / ls->scratch_size);
+    }
+    if(finished) {
+        stream_set_finished(stream);
+    }
+}
+
+void sdl_stream_apply(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    SDL_LockAudioDevice(local->device);
+    sdl_voice_set(local, &ls->voice, source_get_frequency(stream->src), stream->volume, stream->panning, stream->pitch);
+    SDL_UnlockAudioDevice(local->device);
+}
+
+void sdl_stream_play(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    sdl_stream_fill(stream);
+    sdl_stream_apply(stream);
+    SDL_LockAudioDevice(local->device);
+    ls->voice.active = 1;
+    SDL_UnlockAudioDevice(local->device);
+}
+
+void sdl_stream_stop(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    SDL_LockAudioDevice(local->device);
+    ls->voice.active = 0;
+    SDL_UnlockAudioDevice(local->device);
+}
+
+void sdl_stream_close(audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(stream->sink);
+    sdl_stream *ls = stream_get_userdata(stream);
+    SDL_LockAudioDevice(local->device);
+    for(int i = 0; i < SDL_SINK_MAX_STREAMS; i++) {
+        if(local->streams[i] == &ls->voice) {
+            local->streams[i] = NULL;
+        }
+    }
+    SDL_UnlockAudioDevice(local->device);
+    free(ls->voice.ring);
+    free(ls->scratch);
+    free(ls);
+}
+
+static void sdl_sink_format_stream(audio_sink *sink, audio_stream *stream) {
+    sdl_sink *local = sink_get_userdata(sink);
+    int bytes = source_get_bytes(stream->src);
+    int channels = source_get_channels(stream->src);
+    if((bytes != 1 && bytes != 2) || (channels != 1 && channels != 2)) {
+        PERROR("SDL Sink: Could not find suitable audio format!");
+        return;
+    }
+
+    sdl_stream *ls = malloc(sizeof(sdl_stream));
+    memset(ls, 0, sizeof(sdl_stream));
+    ls->voice.bytes = bytes;
+    ls->voice.channels = channels;
+    ls->voice.ring_size = sink->buffer_count * sink->buffer_size;
+    ls->voice.ring_size -= ls->voice.ring_size % (bytes * channels);
+    ls->voice.ring = malloc(ls->voice.ring_size);
+    ls->scratch_size = sink->buffer_size;
+    ls->scratch = malloc(ls->scratch_size);
+
+    SDL_LockAudioDevice(local->device);
+    int slot = -1;
+    for(int i = 0; i < SDL_SINK_MAX_STREAMS; i++) {
+        if(local->streams[i] == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot >= 0) {
+        local->streams[slot] = &ls->voice;
+    }
+    SDL_UnlockAudioDevice(local->device);
+    if(slot < 0) {
+        PERROR("SDL Sink: Too many streams!");
+        free(ls->voice.ring);
+        free(ls->scratch);
+        free(ls);
+        return;
+    }
+
+    stream_set_userdata(stream, ls);
+    stream_set_update_cb(stream, sdl_stream_update);
+    stream_set_close_cb(stream, sdl_stream_close);
+    stream_set_play_cb(stream, sdl_stream_play);
+    stream_set_stop_cb(stream, sdl_stream_stop);
+    stream_set_apply_cb(stream, sdl_stream_apply);
+}
+
+// -------- Samples --------
+
+static sdl_sample* sdl_sink_get_sample(sdl_sink *local, const audio_sample *sample) {
+    if(sample->id < 0) {
+        return NULL;
+    }
+    if(sample->id >= local->sample_count) {
+        int count = sample->id + 1;
+        local->samples = realloc(local->samples, sizeof(sdl_sample) * count);
+        memset(local->samples + local->sample_count, 0, sizeof(sdl_sample) * (count - local->sample_count));
+        local->sample_count = count;
+    }
+    sdl_sample *s = &local->samples[sample->id];
+    if(s->data == NULL) {
+        // Keep our own copy; the callback may still run after the sounds are unloaded
+        s->data = malloc(sample->len);
+        memcpy(s->data, sample->data, sample->len);
+        s->len = sample->len;
+    }
+    return s;
+}
+
+static void sdl_sink_update_voices(audio_sink *sink) {
+    sdl_sink *local = sink_get_userdata(sink);
+    SDL_LockAudioDevice(local->device);
+    for(int i = 0; i < local->voice_count; i++) {
+        sdl_voice *voice = &local->voices[i];
+        if(voice->done && voice->sid != 0) {
+            sink_stream_done(sink, voice->sid);
+            voice->sid = 0;
+            voice->done = 0;
+        }
+    }
+    SDL_UnlockAudioDevice(local->device);
+}
+
+// Same policy as the OpenAL sink: free voice first, then the least important, oldest one
+static sdl_voice* sdl_sink_pick_voice(audio_sink *sink, float priority) {
+    sdl_sink *local = sink_get_userdata(sink);
+    sdl_voice *victim = NULL;
+    for(int i = 0; i < local->voice_count; i++) {
+        sdl_voice *voice = &local->voices[i];
+        if(!voice->active) {
+            if(voice->sid != 0) {
+                sink_stream_done(sink, voice->sid);
+                voice->sid = 0;
+                voice->done = 0;
+            }
+            return voice;
+        }
+        if(victim == NULL
+                || voice->priority < victim->priority
+                || (voice->priority == victim->priority && voice->started < victim->started)) {
+            victim = voice;
+        }
+    }
+    if(victim == NULL || victim->priority > priority) {
+        return NULL;
+    }
+    sink_stream_done(sink, victim->sid);
+    victim->active = 0;
+    victim->sid = 0;
+    return victim;
+}
+
+static int sdl_sink_play_sample(audio_sink *sink,
+                                unsigned int sid,
+                                const audio_sample *sample,
+                                float volume,
+                                float panning,
+                                float pitch,
+                                float priority) {
+    sdl_sink *local = sink_get_userdata(sink);
+    if((sample->bytes != 1 && sample->bytes != 2) || (sample->channels != 1 && sample->channels != 2)) {
+        return 1;
+    }
+    sdl_sample *s = sdl_sink_get_sample(local, sample);
+    if(s == NULL) {
+        return 1;
+    }
+
+    SDL_LockAudioDevice(local->device);
+    sdl_voice *voice = sdl_sink_pick_voice(sink, priority);
+    if(voice != NULL) {
+        memset(voice, 0, sizeof(sdl_voice));
+        voice->data = s->data;
+        voice->len = s->len;
+        voice->bytes = sample->bytes;
+        voice->channels = sample->channels;
+        sdl_voice_set(local, voice, sample->frequency, volume, panning, pitch);
+        voice->sid = sid;
+        voice->priority = priority;
+        voice->started = local->play_counter++;
+        voice->requested = sample->requested;
+        voice->active = 1;
+    }
+    SDL_UnlockAudioDevice(local->device);
+    return (voice == NULL) ? 1 : 0;
+}
+
+static int sdl_sink_stop_voice(audio_sink *sink, unsigned int sid) {
+    sdl_sink *local = sink_get_userdata(sink);
+    int ret = 1;
+    SDL_LockAudioDevice(local->device);
+    for(int i = 0; i < local->voice_count; i++) {
+        if(local->voices[i].sid == sid) {
+            local->voices[i].active = 0;
+            local->voices[i].sid = 0;
+            local->voices[i].done = 0;
+            ret = 0;
+            break;
+        }
+    }
+    SDL_UnlockAudioDevice(local->device);
+    return ret;
+}
+
+// -------- Sink --------
+
+static void sdl_sink_close(audio_sink *sink) {
+    sdl_sink *local = sink_get_userdata(sink);
+    SDL_CloseAudioDevice(local->device);
+    for(int i = 0; i < local->sample_count; i++) {
+        free(local->samples[i].data);
+    }
+    free(local->samples);
+    free(local->voices);
+    free(local->mix);
+    free(local);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    INFO("SDL Sink closed.");
+}
+
+int sdl_sink_init(audio_sink *sink) {
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        PERROR("Could not initialize SDL audio: %s", SDL_GetError());
+        return 1;
+    }
+
+    sdl_sink *local = malloc(sizeof(sdl_sink));
+    memset(local, 0, sizeof(sdl_sink));
+
+    int period = sink->period;
+    if(period < SDL_SINK_MIN_PERIOD) {
+        period = SDL_SINK_MIN_PERIOD;
+    }
+
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = SDL_SINK_FREQUENCY;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = period;
+    want.callback = sdl_sink_callback;
+    want.userdata = local;
+    local->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if(local->device == 0) {
+        PERROR("Could not open audio playback device: %s", SDL_GetError());
+        free(local);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return 1;
+    }
+    local->frequency = have.freq;
+    sink->frequency = have.freq;
+    local->mix_frames = have.samples;
+    local->mix = malloc(sizeof(int32_t) * 2 * local->mix_frames);
+    local->voice_count = sink->voice_count;
+    local->voices = calloc(local->voice_count, sizeof(sdl_voice));
+
+    sink_set_userdata(sink, local);
+    sink_set_close_cb(sink, sdl_sink_close);
+    sink_set_format_stream_cb(sink, sdl_sink_format_stream);
+    sink_set_voice_cbs(sink, sdl_sink_play_sample, sdl_sink_stop_voice, sdl_sink_update_voices);
+
+    INFO("SDL Audio Sink:");
+    INFO(" * Driver:      %s", SDL_GetCurrentAudioDriver());
+    INFO(" * Frequency:   %d", have.freq);
+    INFO(" * Period:      %d frames", have.samples);
+
+    SDL_PauseAudioDevice(local->device, 0);
+    return 0;
+}
+
+#endif // USE_SDLAUDIO
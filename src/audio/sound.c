@@ -1,7 +1,7 @@
 #include <stdlib.h>
+#include <SDL2/SDL.h>
 #include "audio/audio.h"
 #include "audio/source.h"
-#include "audio/sources/raw_source.h"
 #include "audio/sink.h"
 #include "audio/sound.h"
 #include "resources/sounds_loader.h"
@@ -9,7 +9,7 @@
 static float _sound_volume = VOLUME_DEFAULT;
 
 #ifdef STANDALONE_SERVER
-unsigned int sound_play(int id, float volume, float panning, float pitch) {}
+unsigned int sound_play(int id, float volume, float panning, float pitch) { return 0; }
 #else
 unsigned int sound_play(int id, float volume, float panning, float pitch) {
     audio_sink *sink = audio_get_sink();
@@ -19,29 +19,27 @@ unsigned int sound_play(int id, float volume, float panning, float pitch) {
         return -1;
     }
 
-    // Get sample data
-    char *buf;
-    int len;
-    if(sounds_loader_get(id, &buf, &len) != 0) {
+    // Sound effects are converted to 16 bit mono at the output rate when
+    // loaded, and are played from static buffers. The requested volume
+    // doubles as priority when voices run out.
+    sound_buffer buf;
+    if(sounds_loader_get_buffer(id, pitch, &buf) != 0) {
         return -1;
     }
-
-    // Play
-    audio_source *src = malloc(sizeof(audio_source));
-    source_init(src);
-    raw_source_init(src, buf, len);
-    unsigned int sound_id = sink_play_set(sink, src, volume, panning, pitch);
-    sink_set_stream_volume(sink, sound_id, _sound_volume);
-    return sound_id;
+    audio_sample sample;
+    sample.id = buf.key;
+    sample.data = buf.data;
+    sample.len = buf.len;
+    sample.frequency = buf.frequency;
+    sample.bytes = buf.bytes;
+    sample.channels = 1;
+    sample.requested = SDL_GetPerformanceCounter();
+    return audio_play_sample(&sample, _sound_volume, panning, buf.pitch, volume);
 }
 #endif
 
 int sound_playing(unsigned int sound_id) {
-    audio_sink *sink = audio_get_sink();
-    if(sink == NULL) {
-        return 0;
-    }
-    return sink_is_playing(sink, sound_id);
+    return audio_is_playing(sound_id);
 }
 
 void sound_set_volume(float volume) {
@@ -0,0 +1,91 @@
+#include <math.h>
+#include "audio/sound_queue.h"
+#include "audio/sink.h"
+
+static int sound_queue_pan_bucket(float panning) {
+    int b = (int)floorf((panning + 1.0f) * SOUND_QUEUE_PAN_STEPS / 2.0f);
+    if(b < 0) {
+        return 0;
+    }
+    return (b >= SOUND_QUEUE_PAN_STEPS) ? SOUND_QUEUE_PAN_STEPS - 1 : b;
+}
+
+static void sound_queue_remove(sound_queue *q, int index) {
+    for(int i = index; i < q->count - 1; i++) {
+        q->sounds[i] = q->sounds[i + 1];
+    }
+    q->count--;
+}
+
+// Index of the quietest sound, of the given sample or any if id is -1
+static int sound_queue_quietest(const sound_queue *q, int id) {
+    int found = -1;
+    for(int i = 0; i < q->count; i++) {
+        if(id >= 0 && q->sounds[i].id != id) {
+            continue;
+        }
+        if(found < 0 || q->sounds[i].volume < q->sounds[found].volume) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+void sound_queue_clear(sound_queue *q) {
+    q->count = 0;
+}
+
+void sound_queue_add(sound_queue *q, int id, float volume, float panning, float pitch) {
+    int bucket = sound_queue_pan_bucket(panning);
+    for(int i = 0; i < q->count; i++) {
+        queued_sound *s = &q->sounds[i];
+        if(s->id != id || s->pitch != pitch || s->pan_bucket != bucket) {
+            continue;
+        }
+        // Louder triggers pull the panning their way
+        float total = s->volume + volume;
+        if(total > 0.0f) {
+            s->panning = (s->panning * s->volume + panning * volume) / total;
+        }
+        s->volume = (total > VOLUME_MAX) ? VOLUME_MAX : total;
+        s->triggers++;
+        return;
+    }
+
+    int index = q->count;
+    if(q->count == SOUND_QUEUE_SIZE) {
+        index = sound_queue_quietest(q, -1);
+        if(q->sounds[index].volume >= volume) {
+            return;
+        }
+        sound_queue_remove(q, index);
+        index = q->count;
+    }
+    queued_sound *s = &q->sounds[index];
+    s->id = id;
+    s->volume = (volume > VOLUME_MAX) ? VOLUME_MAX : volume;
+    s->panning = panning;
+    s->pitch = pitch;
+    s->pan_bucket = bucket;
+    s->triggers = 1;
+    q->count++;
+}
+
+int sound_queue_finish(sound_queue *q) {
+    // Removing may skip the sound after the removed one, but a sample only
+    // needs checking once, at any one of its sounds
+    for(int i = 0; i < q->count; i++) {
+        int id = q->sounds[i].id;
+        int same = 0;
+        for(int k = 0; k < q->count; k++) {
+            same += (q->sounds[k].id == id);
+        }
+        for(; same > SOUND_QUEUE_PER_SAMPLE; same--) {
+            sound_queue_remove(q, sound_queue_quietest(q, id));
+        }
+    }
+    while(q->count > SOUND_QUEUE_VOICES) {
+        sound_queue_remove(q, sound_queue_quietest(q, -1));
+    }
+    return q->count;
+}
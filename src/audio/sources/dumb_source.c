@@ -2,10 +2,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #ifdef __linux__
 #include <strings.h> // strcasecmp
 #endif // __linux__
 #include <dumb.h>
+#include <SDL2/SDL.h>
 #include "audio/sources/dumb_source.h"
 #include "utils/log.h"
 
@@ -16,6 +18,71 @@ typedef struct dumb_source_t {
     long vpos;
 } dumb_source;
 
+// The module loaded last is kept, so that a track that starts over, as in
+// a rematch, isn't loaded and parsed again. Every source renders the
+// module with a renderer of its own, so they can share it.
+static SDL_SpinLock _cache_lock;
+static DUH *_cache_data = NULL;
+static char _cache_file[256];
+static int _cache_refs = 0;
+
+static DUH* dumb_cache_take(const char *file) {
+    DUH *data = NULL;
+    SDL_AtomicLock(&_cache_lock);
+    if(_cache_data != NULL && strcmp(_cache_file, file) == 0) {
+        data = _cache_data;
+        _cache_refs++;
+    }
+    SDL_AtomicUnlock(&_cache_lock);
+    return data;
+}
+
+// Makes the module the cached one, unless the cached one is still playing.
+// Returns 1 if the module went to the cache.
+static int dumb_cache_put(const char *file, DUH *data) {
+    DUH *old = NULL;
+    int cached = 0;
+    SDL_AtomicLock(&_cache_lock);
+    if(_cache_refs == 0) {
+        old = _cache_data;
+        _cache_data = data;
+        snprintf(_cache_file, sizeof(_cache_file), "%s", file);
+        _cache_refs = 1;
+        cached = 1;
+    }
+    SDL_AtomicUnlock(&_cache_lock);
+    if(old != NULL) {
+        unload_duh(old);
+    }
+    return cached;
+}
+
+static void dumb_cache_release(DUH *data) {
+    int cached = 0;
+    SDL_AtomicLock(&_cache_lock);
+    if(data == _cache_data) {
+        _cache_refs--;
+        cached = 1;
+    }
+    SDL_AtomicUnlock(&_cache_lock);
+    if(!cached) {
+        unload_duh(data);
+    }
+}
+
+void dumb_source_clear_cache() {
+    DUH *old = NULL;
+    SDL_AtomicLock(&_cache_lock);
+    if(_cache_refs == 0) {
+        old = _cache_data;
+        _cache_data = NULL;
+    }
+    SDL_AtomicUnlock(&_cache_lock);
+    if(old != NULL) {
+        unload_duh(old);
+    }
+}
+
 int dumb_source_update(audio_source *src, char *buffer, int len) {
     dumb_source *local = source_get_userdata(src);
 
@@ -46,7 +113,7 @@ int dumb_source_update(audio_source *src, char *buffer, int len) {
 void dumb_source_close(audio_source *src) {
     dumb_source *local = source_get_userdata(src);
     duh_end_sigrenderer(local->renderer);
-    unload_duh(local->data);
+    dumb_cache_release(local->data);
     free(local);
     DEBUG("Libdumb Source: Closed.");
 }
@@ -56,7 +123,11 @@ int dumb_source_init(audio_source *src, const char* file, int channels) {
 
     // Load file and initialize renderer
     char *ext = strrchr(file, '.') + 1;
-    if(strcasecmp(ext, "psm") == 0) {
+    local->data = dumb_cache_take(file);
+    int reused = (local->data != NULL);
+    if(reused) {
+        DEBUG("Libdumb Source: Reusing the module loaded from '%s'.", file);
+    } else if(strcasecmp(ext, "psm") == 0) {
         local->data = dumb_load_psm(file, 0);
     } else if(strcasecmp(ext, "s3m") == 0) {
         local->data = dumb_load_s3m(file);
@@ -74,6 +145,9 @@ int dumb_source_init(audio_source *src, const char* file, int channels) {
         PERROR("Libdumb Source: Error while loading module file!");
         goto error_0;
     }
+    if(!reused) {
+        dumb_cache_put(file, local->data);
+    }
     local->renderer = duh_start_sigrenderer(local->data, 0, channels, 0);
     local->vlen = duh_get_length(local->data);
     local->vpos = 0;
@@ -5,17 +5,67 @@
 #include <stdio.h>
 #define MODPLUG_STATIC
 #include <libmodplug/modplug.h>
+#include <SDL2/SDL.h>
 #include "audio/sources/modplug_source.h"
+#include "utils/mapfile.h"
 #include "utils/log.h"
 
 typedef struct {
     ModPlugFile *renderer;
-    char *data;
-    size_t dsize;
+    char file[256];
+    int channels;
+    int loop;
     long vlen;
     long vpos;
 } modplug_source;
 
+// The module of the source that was closed last is kept and rewound, so
+// that a track that starts over, as in a rematch, isn't loaded again.
+// Modplug renders from the loaded module itself, so it can't be shared.
+static SDL_SpinLock _cache_lock;
+static ModPlugFile *_cache_renderer = NULL;
+static char _cache_file[256];
+static int _cache_channels = 0;
+static int _cache_loop = 0;
+
+static ModPlugFile* modplug_cache_take(const char *file, int channels, int loop) {
+    ModPlugFile *renderer = NULL;
+    SDL_AtomicLock(&_cache_lock);
+    if(_cache_renderer != NULL && strcmp(_cache_file, file) == 0
+            && _cache_channels == channels && _cache_loop == loop) {
+        renderer = _cache_renderer;
+        _cache_renderer = NULL;
+    }
+    SDL_AtomicUnlock(&_cache_lock);
+    if(renderer != NULL) {
+        ModPlug_Seek(renderer, 0);
+    }
+    return renderer;
+}
+
+static void modplug_cache_put(const char *file, int channels, int loop, ModPlugFile *renderer) {
+    SDL_AtomicLock(&_cache_lock);
+    ModPlugFile *old = _cache_renderer;
+    _cache_renderer = renderer;
+    snprintf(_cache_file, sizeof(_cache_file), "%s", file);
+    _cache_channels = channels;
+    _cache_loop = loop;
+    SDL_AtomicUnlock(&_cache_lock);
+    if(old != NULL) {
+        ModPlug_Unload(old);
+    }
+}
+
+void modplug_source_clear_cache() {
+    SDL_AtomicLock(&_cache_lock);
+    ModPlugFile *old = _cache_renderer;
+    _cache_renderer = NULL;
+    SDL_AtomicUnlock(&_cache_lock);
+    if(old != NULL) {
+        ModPlug_Unload(old);
+    }
+}
+
 int modplug_source_update(audio_source *src, char *buffer, int len) {
     modplug_source *local = source_get_userdata(src);
     return ModPlug_Read(local->renderer, buffer, len);
@@ -23,27 +73,30 @@ int modplug_source_update(audio_source *src, char *buffer, int len) {
 
 void modplug_source_close(audio_source *src) {
     modplug_source *local = source_get_userdata(src);
-    ModPlug_Unload(local->renderer);
-    free(local->data);
+    modplug_cache_put(local->file, local->channels, local->loop, local->renderer);
     free(local);
     DEBUG("Modplug Source: Closed.");
 }
 
 int modplug_source_init(audio_source *src, const char* file, int channels) {
     modplug_source *local = malloc(sizeof(modplug_source));
+    snprintf(local->file, sizeof(local->file), "%s", file);
+    local->channels = channels;
+    local->loop = src->loop;
+
+    local->renderer = modplug_cache_take(file, channels, src->loop);
+    if(local->renderer != NULL) {
+        DEBUG("Modplug Source: Reusing the module loaded from '%s'.", file);
+        goto loaded;
+    }
 
-    // Read all data from file
-    FILE *handle = fopen(file, "rb");
-    if(handle == NULL) {
+    // Map the module file. Modplug copies what it needs while loading,
+    // so the mapping is only held for the duration of ModPlug_Load().
+    mapfile mf;
+    if(mapfile_open(&mf, file)) {
         PERROR("Modplug Source: Unable to open module file.");
         goto error_0;
     }
-    fseek(handle, 0L, SEEK_END);
-    local->dsize = ftell(handle);
-    rewind(handle);
-    local->data = malloc(local->dsize);
-    fread(local->data, local->dsize, 1, handle);
-    fclose(handle);
 
     // Settings
     ModPlug_Settings settings;
@@ -56,11 +109,14 @@ int modplug_source_init(audio_source *src, const char* file, int channels) {
     ModPlug_SetSettings(&settings);
     
     // Init rnederer
-    local->renderer = ModPlug_Load(local->data, local->dsize);
+    local->renderer = ModPlug_Load(mf.data, mf.size);
+    mapfile_close(&mf);
     if(!local->renderer) {
         PERROR("Modplug Source: Error while loading module file!");
-        goto error_1;
+        goto error_0;
     }
+
+loaded:
     local->vlen = 0;
     local->vpos = 0;
 
@@ -80,9 +136,6 @@ int modplug_source_init(audio_source *src, const char* file, int channels) {
     // All done
     return 0;
 
-error_1:
-    free(local->data);
-
 error_0:
     free(local);
     return 1;
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "audio/sources/prefetch_source.h"
+#include "utils/log.h"
+
+#define PREFETCH_CHUNK 4096
+
+// Single producer (decode thread), single consumer (whoever calls update).
+// One byte of the ring is always left empty so that read == write means empty.
+typedef struct prefetch_source_t {
+    audio_source *inner;
+    char *ring;
+    int size;
+    SDL_atomic_t read;
+    SDL_atomic_t write;
+    SDL_atomic_t done;
+    SDL_atomic_t quit;
+    SDL_sem *wake;
+    SDL_Thread *thread;
+    char scratch[PREFETCH_CHUNK];
+} prefetch_source;
+
+static int prefetch_fill(prefetch_source *local) {
+    return (SDL_AtomicGet(&local->write) - SDL_AtomicGet(&local->read) + local->size) % local->size;
+}
+
+static int prefetch_thread_run(void *data) {
+    prefetch_source *local = data;
+    int frame = local->inner->channels * local->inner->bytes;
+    while(!SDL_AtomicGet(&local->quit)) {
+        int room = local->size - 1 - prefetch_fill(local);
+        int want = (room < PREFETCH_CHUNK) ? room : PREFETCH_CHUNK;
+        want -= want % frame;
+        if(SDL_AtomicGet(&local->done) || want <= 0) {
+            SDL_SemWaitTimeout(local->wake, 10);
+            continue;
+        }
+
+        int got = source_update(local->inner, local->scratch, want);
+        if(got <= 0) {
+            SDL_AtomicSet(&local->done, 1);
+            continue;
+        }
+
+        int write = SDL_AtomicGet(&local->write);
+        int first = local->size - write;
+        if(first > got) {
+            first = got;
+        }
+        memcpy(local->ring + write, local->scratch, first);
+        memcpy(local->ring, local->scratch + first, got - first);
+        SDL_AtomicSet(&local->write, (write + got) % local->size);
+    }
+    return 0;
+}
+
+int prefetch_source_update(audio_source *src, char *buffer, int len) {
+    prefetch_source *local = source_get_userdata(src);
+
+    // On underrun, wait for the decoder rather than ending the stream
+    int avail;
+    while((avail = prefetch_fill(local)) == 0) {
+        if(SDL_AtomicGet(&local->done)) {
+            // Check again, the last chunk may have landed after the fill check
+            if((avail = prefetch_fill(local)) == 0) {
+                return 0;
+            }
+            break;
+        }
+        SDL_Delay(1);
+    }
+
+    int read = SDL_AtomicGet(&local->read);
+    int got = (avail < len) ? avail : len;
+    int first = local->size - read;
+    if(first > got) {
+        first = got;
+    }
+    memcpy(buffer, local->ring + read, first);
+    memcpy(buffer + first, local->ring, got - first);
+    SDL_AtomicSet(&local->read, (read + got) % local->size);
+    SDL_SemPost(local->wake);
+    return got;
+}
+
+void prefetch_source_close(audio_source *src) {
+    prefetch_source *local = source_get_userdata(src);
+    SDL_AtomicSet(&local->quit, 1);
+    SDL_SemPost(local->wake);
+    SDL_WaitThread(local->thread, NULL);
+    SDL_DestroySemaphore(local->wake);
+    source_free(local->inner);
+    free(local->inner);
+    free(local->ring);
+    free(local);
+    DEBUG("Prefetch Source: Closed.");
+}
+
+int prefetch_source_init(audio_source *src, audio_source *inner, int ms) {
+    prefetch_source *local = malloc(sizeof(prefetch_source));
+    int frame = inner->channels * inner->bytes;
+    local->inner = inner;
+    local->size = inner->frequency * frame / 1000 * ms;
+    if(local->size < PREFETCH_CHUNK * 2) {
+        local->size = PREFETCH_CHUNK * 2;
+    }
+    local->size -= local->size % frame;
+    local->ring = malloc(local->size);
+    SDL_AtomicSet(&local->read, 0);
+    SDL_AtomicSet(&local->write, 0);
+    SDL_AtomicSet(&local->done, 0);
+    SDL_AtomicSet(&local->quit, 0);
+    local->wake = SDL_CreateSemaphore(0);
+
+    // Audio information comes straight from the wrapped source
+    source_set_frequency(src, inner->frequency);
+    source_set_bytes(src, inner->bytes);
+    source_set_channels(src, inner->channels);
+    source_set_loop(src, inner->loop);
+
+    // Set callbacks
+    source_set_userdata(src, local);
+    source_set_update_cb(src, prefetch_source_update);
+    source_set_close_cb(src, prefetch_source_close);
+
+    local->thread = SDL_CreateThread(prefetch_thread_run, "music decode", local);
+    if(local->thread == NULL) {
+        PERROR("Prefetch Source: Unable to start decode thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(local->wake);
+        free(local->ring);
+        free(local);
+        source_init(src);
+        return 1;
+    }
+
+    DEBUG("Prefetch Source: Decoding %d bytes ahead.", local->size);
+    return 0;
+}
@@ -29,7 +29,7 @@ void raw_source_close(audio_source *src) {
     free(local);
 }
 
-int raw_source_init(audio_source *src, char* buffer, int len) {
+int raw_source_init(audio_source *src, char* buffer, int len, int frequency, int bytes) {
     raw_source *local = malloc(sizeof(raw_source));
 
     // Set data
@@ -38,8 +38,8 @@ int raw_source_init(audio_source *src, char* buffer, int len) {
     local->buf = buffer;
 
     // Audio information
-    source_set_frequency(src, 8000);
-    source_set_bytes(src, 1);
+    source_set_frequency(src, frequency);
+    source_set_bytes(src, bytes);
     source_set_channels(src, 1);
 
     // Set callbacks
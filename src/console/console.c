@@ -4,10 +4,12 @@
 #include "game/gui/menu_background.h"
 #include "game/utils/settings.h"
 #include "video/video.h"
+#include "utils/log.h"
 
 #define HISTORY_MAX 100
-#define BUFFER_INC(b) (((b) + 1) % sizeof(con->output))
-#define BUFFER_DEC(b) (((b) + sizeof(con->output) - 1) % sizeof(con->output))
+#define CONSOLE_SCRIPT_LINE_LEN 256
+#define VISIBLE_LINES 15
+#define OUTPUT_LINE(n) (con->output[(n) % CONSOLE_LINES])
 
 #define CURSOR_STR "\x7f"
 
@@ -16,6 +18,7 @@ console *con = NULL;
 
 // defined in console_cmd.c
 void console_init_cmd();
+void console_cmd_tick();
 
 int make_argv(char *p, char **argv) {
     // split line into argv, warning: does not handle quoted strings
@@ -50,146 +53,178 @@ void console_add_history(const char *input, unsigned int len) {
     con->histpos = -1;
 }
 
+// Splits the line in place and runs it. Returns 1 if a command was found.
+static int console_run_line(game_state *gs, char *line) {
+    int argc = make_argv(line, NULL);
+    if(argc == 0) {
+        console_output_addline(">");
+        return 0;
+    }
+    char *argv[argc];
+    void *val = 0;
+    unsigned int len;
+    make_argv(line, argv);
+    if(hashmap_sget(&con->cmds, argv[0], &val, &len)) {
+        console_output_add("> ");
+        console_output_add(argv[0]);
+        console_output_addline(" NOT RECOGNIZED");
+        return 0;
+    }
+    command *cmd = val;
+    int err = cmd->func(gs, argc, argv);
+    if(err == 0)
+    {
+        console_output_add("> ");
+        console_output_add(argv[0]);
+        console_output_addline(" SUCCESS");
+    } else {
+        char buf[12];
+        sprintf(buf, "%d", err);
+        console_output_add("> ");
+        console_output_add(argv[0]);
+        console_output_add(" ERROR:");
+        console_output_addline(buf);
+    }
+    return 1;
+}
+
 void console_handle_line(game_state *gs) {
     if(con->input[0] == '\0') {
         console_output_addline(">");
     } else {
         char input_copy[sizeof(con->input)];
         memcpy(input_copy, con->input, sizeof(con->input));
-        int argc = make_argv(con->input, NULL);
-        if(argc > 0) {
-            char *argv[argc];
-            void *val = 0;
-            unsigned int len;
-            make_argv(con->input, argv);
-            if(!hashmap_sget(&con->cmds, argv[0], &val, &len)) {
-                command *cmd = val;
-                int err = cmd->func(gs, argc, argv);
-                if(err == 0)
-                {
-                    console_output_add("> ");
-                    console_output_add(argv[0]);
-                    console_output_addline(" SUCCESS");
-                } else {
-                    char buf[12];
-                    sprintf(buf, "%d", err);
-                    console_output_add("> ");
-                    console_output_add(argv[0]);
-                    console_output_add(" ERROR:");
-                    console_output_addline(buf);
-                }
-                console_add_history(input_copy, sizeof(input_copy));
-            } else {
-                console_output_add("> ");
-                console_output_add(argv[0]);
-                console_output_addline(" NOT RECOGNIZED");
-            }
-        } else {
-            console_output_addline(">");
+        if(console_run_line(gs, con->input)) {
+            console_add_history(input_copy, sizeof(input_copy));
         }
     }
 }
 
-void console_output_scroll_to_end() {
-    // iterate the output buffer backward to count up to 16 lines or 480 chars, whichever comes first
-    unsigned int lines = 0;
-    unsigned int si;
-    if(con->output_overflowing) {
-        si = BUFFER_DEC(con->output_head);
-        si = BUFFER_DEC(si);
-    } else if(con->output_tail == con->output_head) {
-        si = con->output_tail;
-    } else {
-        si = BUFFER_DEC(con->output_tail);
+int console_exec_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if(f == NULL) {
+        PERROR("Could not open console script '%s'", path);
+        return 1;
     }
+    list lines;
+    list_create(&lines);
+    char buf[CONSOLE_SCRIPT_LINE_LEN];
+    while(fgets(buf, sizeof(buf), f) != NULL) {
+        buf[strcspn(buf, "\r\n")] = '\0';
+        char *p = buf;
+        while(isspace(*p)) { ++p; }
+        if(*p == '\0' || *p == '#') {
+            continue;
+        }
+        list_append(&lines, p, strlen(p) + 1);
+    }
+    fclose(f);
 
-    for(;
-        si != con->output_head;
-        si = BUFFER_DEC(si)) {
+    // Whatever was still queued runs after this script
+    iterator it;
+    char *line;
+    list_iter_begin(&con->script, &it);
+    while((line = iter_next(&it)) != NULL) {
+        list_append(&lines, line, strlen(line) + 1);
+    }
+    list_free(&con->script);
+    con->script = lines;
+    INFO("Running console script '%s'", path);
+    return 0;
+}
 
-        if(con->output[si] == '\n') {
-            lines++;
+void console_script_wait(game_state *gs, unsigned int ticks) {
+    con->script_wait = ticks;
+    con->script_tick = gs->int_tick;
+}
 
-            if(lines >= 16) {
-                si = BUFFER_INC(si);
-                break;
-            }
-        }
+void console_script_tick(game_state *gs) {
+    if(con->script_wait > 0) {
+        unsigned int passed = gs->int_tick - con->script_tick;
+        con->script_tick = gs->int_tick;
+        con->script_wait = (passed < con->script_wait) ? con->script_wait - passed : 0;
     }
+    char line[CONSOLE_SCRIPT_LINE_LEN];
+    while(con->script_wait == 0 && list_size(&con->script) > 0) {
+        iterator it;
+        list_iter_begin(&con->script, &it);
+        strncpy(line, iter_next(&it), sizeof(line) - 1);
+        line[sizeof(line) - 1] = '\0';
+        list_delete(&con->script, &it);
+        DEBUG("exec: %s", line);
+        console_run_line(gs, line);
+    }
+}
 
-    con->output_pos = si;
+// Oldest line that is still in the ring
+static unsigned int console_output_first() {
+    return con->output_last >= CONSOLE_LINES ? con->output_last - CONSOLE_LINES + 1 : 0;
 }
 
-void console_output_scroll_up(unsigned int lines) {
-    unsigned int l = 0;
-    if(con->output_pos != con->output_head) {
-        con->output_pos = BUFFER_DEC(con->output_pos);
-    }
-    while(con->output_pos != con->output_head) {
-        con->output_pos = BUFFER_DEC(con->output_pos);
-        if(con->output[con->output_pos] == '\n') {
-            l++;
-            if(l == lines){
-                con->output_pos = BUFFER_INC(con->output_pos);
-                break;
-            }
-        }
+// First visible line when the output is scrolled all the way down. The line
+// being written to is only shown once there is something on it.
+static unsigned int console_output_end() {
+    unsigned int last = con->output_last;
+    if(OUTPUT_LINE(last)[0] == '\0' && last > 0) {
+        last--;
     }
+    unsigned int first = console_output_first();
+    return (last >= first + VISIBLE_LINES - 1) ? last - VISIBLE_LINES + 1 : first;
+}
+
+void console_output_scroll_to_end() {
+    con->output_pos = console_output_end();
+}
+
+void console_output_scroll_up(unsigned int lines) {
+    unsigned int first = console_output_first();
+    con->output_pos = (con->output_pos >= first + lines) ? con->output_pos - lines : first;
 }
 
 void console_output_scroll_down(unsigned int lines) {
-    unsigned int l = 0;
-    while(con->output_pos != con->output_tail) {
-        con->output_pos = BUFFER_INC(con->output_pos);
-        if(con->output[con->output_pos] == '\n') {
-            l++;
-            if(l == lines){
-                con->output_pos = BUFFER_INC(con->output_pos);
-                break;
-            }
-        }
-    }
+    unsigned int end = console_output_end();
+    con->output_pos = (con->output_pos + lines <= end) ? con->output_pos + lines : end;
+}
+
+void console_output_clear() {
+    con->output_last = 0;
+    con->output_pos = 0;
+    OUTPUT_LINE(0)[0] = '\0';
 }
 
 void console_output_add(const char *text) {
-    size_t len = strlen(text);
-    for(size_t i = 0;i < len;++i) {
-        char c = text[i];
-        con->output[con->output_tail] = c;
-        con->output_tail = BUFFER_INC(con->output_tail);
-        if(con->output_tail == con->output_head) {
-            // buffer is overflowing
-            con->output_head = BUFFER_INC(con->output_head);
-            con->output_overflowing = 1;
+    char *line = OUTPUT_LINE(con->output_last);
+    size_t len = strlen(line);
+    for(; *text != '\0'; text++) {
+        if(*text == '\n') {
+            con->output_last++;
+            line = OUTPUT_LINE(con->output_last);
+            line[0] = '\0';
+            len = 0;
+        } else if(len < CONSOLE_LINE_LEN - 1) {
+            line[len++] = *text;
+            line[len] = '\0';
         }
     }
 
     console_output_scroll_to_end();
 }
+
 void console_output_addline(const char *text) {
     console_output_add(text);
     console_output_add("\n");
 }
 
+// Each line is drawn as a whole, so that the text cache can keep it as one surface
 void console_output_render() {
-    int x = 0;
-    int y = 0;
-    unsigned int lines = 0;
     const color textcolor = color_create(121, 121, 121, 255);
-    for(unsigned int i = con->output_pos;
-        i != con->output_tail && lines < 15;
-        i = BUFFER_INC(i)) {
-
-        char c = con->output[i];
-        if(c == '\n') {
-            x = 0;
-            y += font_small.h;
-            lines++;
-        } else {
-            // TODO add word wrapping?
-            font_render_char(&font_small, c, x, y+con->ypos-100, textcolor);
-            x += font_small.w;
+    int y = con->ypos - 100;
+    for(unsigned int i = 0; i < VISIBLE_LINES && con->output_pos + i <= con->output_last; i++) {
+        const char *line = OUTPUT_LINE(con->output_pos + i);
+        if(line[0] != '\0') {
+            font_render(&font_small, line, 0, y, textcolor);
         }
+        y += font_small.h;
     }
 }
 
@@ -202,14 +237,13 @@ int console_init() {
     con->ticks = 0;
     con->dir = 0;
     con->input[0] = '\0';
-    con->output[0] = '\0';
-    con->output_head = 0;
-    con->output_tail = 0;
-    con->output_pos = 0;
-    con->output_overflowing = 0;
+    console_output_clear();
     con->histpos = -1;
     con->histpos_changed = 0;
     list_create(&con->history);
+    list_create(&con->script);
+    con->script_wait = 0;
+    con->script_tick = 0;
     hashmap_create(&con->cmds, 8);
     menu_background_create(&con->background, 322, 101);
 
@@ -243,6 +277,7 @@ int console_init() {
 void console_close() {
     surface_free(&con->background);
     list_free(&con->history);
+    list_free(&con->script);
     hashmap_free(&con->cmds);
     free(con);
 }
@@ -336,6 +371,7 @@ void console_tick() {
     if(con->ticks == 0) {
         con->dir = 0;
     }
+    console_cmd_tick();
 }
 
 void console_add_cmd(const char *name, command_func func, const char *doc) {
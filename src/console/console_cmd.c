@@ -3,7 +3,24 @@
 #include "console/console.h"
 #include "console/console_type.h"
 #include "resources/ids.h"
+#include "controller/net_controller.h"
+#include "controller/net_service.h"
+#include "controller/net_capture.h"
 #include "video/video.h"
+#include "utils/log.h"
+#include "utils/memarena.h"
+#include "utils/memtrack.h"
+#include "utils/latency_probe.h"
+#include "utils/profiler.h"
+#include "audio/audio_stats.h"
+#include "game/utils/settings.h"
+#include "utils/trace.h"
+#include "video/tcache.h"
+#include "resources/sprite.h"
+#include "video/screenshot.h"
+#include "video/encoder.h"
+#include "game/utils/rec_library.h"
+#include "utils/jobs.h"
 
 // utils
 int strtoint(char *input, int *output) {
@@ -38,11 +55,7 @@ int console_cmd_history(game_state *gs, int argc, char **argv) {
 }
 
 int console_cmd_clear(game_state *gs, int argc, char **argv) {
-    con->output[0] = '\0';
-    con->output_head = 0;
-    con->output_tail = 0;
-    con->output_pos = 0;
-    con->output_overflowing = 0;
+    console_output_clear();
     return 0;
 }
 
@@ -57,7 +70,7 @@ int console_cmd_help(game_state *gs, int argc, char **argv) {
     iterator it;
     hashmap_pair *pair, **ppair;
 
-    vector_create(&sorted, sizeof(hashmap_pair*));
+    vector_create_with_allocator(&sorted, sizeof(hashmap_pair*), memarena_frame_allocator());
     hashmap_iter_begin(&con->cmds, &it);
     while((pair = iter_next(&it)) != NULL) {
         vector_append(&sorted, &pair);
@@ -177,11 +190,103 @@ int console_cmd_rein(game_state *gs, int argc, char **argv) {
     return 1;
 }
 
+// Frame times from before the last live change, compared with those after it
+// once the profiler history has filled up again
+static struct {
+    int pending;
+    char what[32];
+    float p50;
+    float p99;
+    unsigned int underruns;
+} switch_report;
+
+static void console_switch_begin(const char *what) {
+    char buf[128];
+    audio_stats stats;
+    audio_stats_get(&stats);
+    snprintf(switch_report.what, sizeof(switch_report.what), "%s", what);
+    switch_report.p50 = profiler_percentile(PROF_FRAME, 50.0f);
+    switch_report.p99 = profiler_percentile(PROF_FRAME, 99.0f);
+    switch_report.underruns = stats.underruns;
+    switch_report.pending = 1;
+    snprintf(buf, sizeof(buf), "before: p50 %.2f p99 %.2f ms, %u underruns",
+             switch_report.p50, switch_report.p99, switch_report.underruns);
+    console_output_addline(buf);
+    profiler_reset_history();
+    audio_stats_reset();
+}
+
+// Called every tick from console_tick
+void console_cmd_tick() {
+    if(!switch_report.pending || profiler_frame_count() < PROFILER_HISTORY) {
+        return;
+    }
+    char buf[128];
+    audio_stats stats;
+    audio_stats_get(&stats);
+    snprintf(buf, sizeof(buf), "after %s:", switch_report.what);
+    console_output_addline(buf);
+    snprintf(buf, sizeof(buf), " p50 %.2f p99 %.2f ms, %u underruns",
+             profiler_percentile(PROF_FRAME, 50.0f),
+             profiler_percentile(PROF_FRAME, 99.0f),
+             stats.underruns);
+    console_output_addline(buf);
+    INFO("Switched %s: frame p50 %.2f -> %.2f ms, p99 %.2f -> %.2f ms, underruns %u -> %u",
+         switch_report.what,
+         switch_report.p50, profiler_percentile(PROF_FRAME, 50.0f),
+         switch_report.p99, profiler_percentile(PROF_FRAME, 99.0f),
+         switch_report.underruns, stats.underruns);
+    switch_report.pending = 0;
+}
+
+// Settings that video_reinit takes
+static int is_display_setting(const char *name) {
+    static const char *names[] = {"screen_w", "screen_h", "fullscreen", "vsync", "scaler", "scale_factor"};
+    for(int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if(strcmp(name, names[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// set NAME [VALUE]
+int console_cmd_set(game_state *gs, int argc, char **argv) {
+    char old[64];
+    char buf[128];
+    if(argc < 2 || argc > 3 || settings_format(argv[1], old, sizeof(old))) {
+        return 1;
+    }
+    if(argc == 2) {
+        snprintf(buf, sizeof(buf), "%s = %s", argv[1], old);
+        console_output_addline(buf);
+        return 0;
+    }
+    // Nothing changes until the settings are applied
+    if(settings_set(argv[1], argv[2])) {
+        return 1;
+    }
+    console_switch_begin(argv[1]);
+    settings_apply();
+    if(is_display_setting(argv[1])) {
+        settings_video *v = &settings_get()->video;
+        video_reinit(v->screen_w, v->screen_h, v->fullscreen, v->vsync, v->scaler, v->scale_factor);
+    }
+    snprintf(buf, sizeof(buf), "%s: %s -> %s", argv[1], old, argv[2]);
+    console_output_addline(buf);
+    if(strcmp(argv[1], "job_threads") == 0) {
+        snprintf(buf, sizeof(buf), "%d of %d job threads", jobs_active_count(), jobs_thread_count());
+        console_output_addline(buf);
+    }
+    return 0;
+}
+
 int console_cmd_renderer(game_state *gs, int argc, char **argv) {
     if(argc == 2) {
         int i;
         if(strtoint(argv[1], &i)) {
-            if(i == 0 || i == 1) {
+            if(i >= VIDEO_RENDERER_QUIRKS && i <= VIDEO_RENDERER_NULL) {
+                console_switch_begin("renderer");
                 video_select_renderer(i);
                 return 0;
             }
@@ -225,6 +330,512 @@ int console_cmd_ez_destruct(game_state *gs, int argc, char **argv) {
     return 0;
 }
 
+static void console_pool_stats(const char *name, const mempool *pool) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s: %u/%u used, peak %u, %u overflows",
+             name,
+             mempool_used(pool),
+             mempool_capacity(pool),
+             pool->peak,
+             pool->overflows);
+    console_output_addline(buf);
+}
+
+int console_cmd_pool(game_state *gs, int argc, char **argv) {
+    console_pool_stats("objects", &gs->obj_pool);
+    console_pool_stats("userdata", &gs->userdata_pool);
+    return 0;
+}
+
+int console_cmd_mem(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    mem_stats stats;
+    if(argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        mem_reset_peaks();
+        console_output_addline("memory peaks reset");
+        return 0;
+    }
+    for(int i = 0; i < MEM_TAG_COUNT; i++) {
+        mem_get_stats(i, &stats);
+        snprintf(buf, sizeof(buf), "%-10s %7u kB, peak %7u kB, %u blocks, %u allocs",
+                 mem_tag_name(i), (unsigned int)(stats.live / 1024), (unsigned int)(stats.peak / 1024),
+                 stats.count, stats.allocs);
+        console_output_addline(buf);
+    }
+    mem_get_total(&stats);
+    snprintf(buf, sizeof(buf), "%-10s %7u kB, peak %7u kB, %u blocks, %u allocs",
+             "total", (unsigned int)(stats.live / 1024), (unsigned int)(stats.peak / 1024),
+             stats.count, stats.allocs);
+    console_output_addline(buf);
+
+    // Budgeted caches, a budget of 0 kB is no limit
+    sprite_stats sprites;
+    sprite_get_stats(&sprites);
+    snprintf(buf, sizeof(buf), "%-10s %7u kB of %u kB, %u decodes, %u evictions%s",
+             "sprites", (unsigned int)(sprites.bytes_used / 1024), (unsigned int)(sprites.budget / 1024),
+             sprites.decodes, sprites.evictions, settings_get()->gameplay.low_memory ? ", low memory" : "");
+    console_output_addline(buf);
+    tcache_stats textures;
+    tcache_get_stats(&textures);
+    snprintf(buf, sizeof(buf), "%-10s %7u kB of %u kB, %u evictions, %u streaming",
+             "textures", textures.bytes_used / 1024, textures.budget / 1024, textures.evictions,
+             textures.streaming);
+    console_output_addline(buf);
+    snprintf(buf, sizeof(buf), "%-10s %7u kB, %u reuploads",
+             "tex copies", textures.copy_bytes / 1024, textures.reuploads);
+    console_output_addline(buf);
+    return 0;
+}
+
+int console_cmd_net(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    int found = 0;
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+        if(ctrl == NULL || ctrl->type != CTRL_TYPE_NETWORK) {
+            continue;
+        }
+        const net_stats *stats = net_controller_get_stats(ctrl);
+        float secs = (SDL_GetTicks() - stats->start_ticks) / 1000.0f;
+        if(secs < 1.0f) {
+            secs = 1.0f;
+        }
+        snprintf(buf, sizeof(buf), "up %u kB (%.1f kB/s), down %u kB (%.1f kB/s)",
+                 stats->bytes_sent / 1024,
+                 stats->bytes_sent / 1024.0f / secs,
+                 stats->bytes_received / 1024,
+                 stats->bytes_received / 1024.0f / secs);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "sync: %u keyframes, %u deltas, %u%% of full size, %u desyncs",
+                 stats->keyframes,
+                 stats->deltas,
+                 stats->sync_raw_bytes ? (unsigned int)(100ULL * stats->sync_bytes / stats->sync_raw_bytes) : 100,
+                 stats->desyncs);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "rtt %.1f ms, jitter %.1f ms, loss %.0f%%, advantage %d, input delay %d",
+                 stats->rtt_ms,
+                 stats->jitter_ms,
+                 stats->loss * 100.0f,
+                 stats->frame_advantage,
+                 stats->input_delay);
+        console_output_addline(buf);
+        found = 1;
+    }
+    if(!found) {
+        console_output_addline("not in a network game");
+    }
+    return 0;
+}
+
+int console_cmd_netem(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2) {
+        char spec[256] = "";
+        for(int i = 1; i < argc; i++) {
+            strncat(spec, argv[i], sizeof(spec) - strlen(spec) - 2);
+            strcat(spec, ",");
+        }
+        if(net_emu_parse(spec)) {
+            console_output_addline("usage: netem off | [channel=N] latency=MS jitter=MS loss=% dup=% reorder=%");
+            return 1;
+        }
+    }
+    for(int i = 0; i < NET_CHANNEL_COUNT; i++) {
+        char conditions[96];
+        net_emu_to_str(i, conditions, sizeof(conditions));
+        snprintf(buf, sizeof(buf), "channel %d: %s", i, conditions);
+        console_output_addline(buf);
+    }
+    return 0;
+}
+
+// netcap start [file] | netcap stop
+int console_cmd_netcap(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2 && strcmp(argv[1], "start") == 0) {
+        const char *filename = (argc >= 3) ? argv[2] : "netcap.bin";
+        if(net_capture_start(filename)) {
+            console_output_addline("unable to start network capture");
+            return 0;
+        }
+        snprintf(buf, sizeof(buf), "capturing network packets to %s", filename);
+        console_output_addline(buf);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "stop") == 0) {
+        if(!net_capture_is_active()) {
+            console_output_addline("no network capture running");
+            return 0;
+        }
+        net_capture_stop();
+        console_output_addline("network capture stopped");
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_perf(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%d frames, ms p50/p90/p99/max", profiler_frame_count());
+    console_output_addline(buf);
+    for(int i = 0; i < PROF_COUNT; i++) {
+        snprintf(buf, sizeof(buf), "%s: %.2f %.2f %.2f %.2f",
+                 profiler_phase_name(i),
+                 profiler_percentile(i, 50.0f),
+                 profiler_percentile(i, 90.0f),
+                 profiler_percentile(i, 99.0f),
+                 profiler_percentile(i, 100.0f));
+        console_output_addline(buf);
+    }
+    for(int i = 0; i < PROF_CNT_COUNT; i++) {
+        snprintf(buf, sizeof(buf), "%s: %u", profiler_counter_name(i), profiler_get_count(i));
+        console_output_addline(buf);
+    }
+    tcache_stats stats;
+    tcache_get_stats(&stats);
+    snprintf(buf, sizeof(buf), "tcache: %u hits, %u misses, %u evictions",
+             stats.hits, stats.misses, stats.evictions);
+    console_output_addline(buf);
+    return 0;
+}
+
+// audio [reset]
+int console_cmd_audio(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        audio_stats_reset();
+        console_output_addline("audio stats reset");
+        return 0;
+    }
+    const settings *s = settings_snapshot();
+    audio_stats stats;
+    audio_stats_get(&stats);
+    snprintf(buf, sizeof(buf), "buffers: %d x %d bytes, %d queued, lowest %d",
+             s->sound.audio_buffers, s->sound.audio_buffer_size, stats.depth, stats.depth_min);
+    console_output_addline(buf);
+    snprintf(buf, sizeof(buf), "underruns: %u", stats.underruns);
+    console_output_addline(buf);
+    snprintf(buf, sizeof(buf), "decode: %u buffers, %.2f ms avg, %.2f ms max",
+             stats.decodes, stats.decode_ms, stats.decode_max_ms);
+    console_output_addline(buf);
+    snprintf(buf, sizeof(buf), "sound latency: %u sounds, %.1f ms avg, %.1f ms max",
+             stats.sounds, stats.latency_ms, stats.latency_max_ms);
+    console_output_addline(buf);
+    return 0;
+}
+
+// Buckets shown per histogram line
+#define LATENCY_LINE_MS 5
+
+// latency on [marker] / latency off / latency reset / latency
+int console_cmd_latency(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2 && strcmp(argv[1], "on") == 0) {
+        latency_probe_enable(1, argc >= 3 && strcmp(argv[2], "marker") == 0);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "off") == 0) {
+        latency_probe_enable(0, 0);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "reset") == 0) {
+        latency_probe_reset();
+        console_output_addline("latency stats reset");
+        return 0;
+    }
+    if(argc != 1) {
+        return 1;
+    }
+    latency_stats stats;
+    latency_probe_get(&stats);
+    snprintf(buf, sizeof(buf), "%u presses, %u dropped, ms p50/p90/p99/max",
+             stats.samples, stats.dropped);
+    console_output_addline(buf);
+    for(int i = 0; i < LATENCY_SPANS; i++) {
+        snprintf(buf, sizeof(buf), "%s: %d %d %d %d",
+                 latency_probe_span_name(i),
+                 latency_probe_percentile(&stats, i, 50.0f),
+                 latency_probe_percentile(&stats, i, 90.0f),
+                 latency_probe_percentile(&stats, i, 99.0f),
+                 latency_probe_percentile(&stats, i, 100.0f));
+        console_output_addline(buf);
+    }
+    // Total in a few ms wide bars, leaving out the empty ones
+    for(int b = 0; b < LATENCY_BUCKETS; b += LATENCY_LINE_MS) {
+        unsigned int n = 0;
+        for(int i = b; i < b + LATENCY_LINE_MS && i < LATENCY_BUCKETS; i++) {
+            n += stats.hist[LATENCY_SPAN_TOTAL][i];
+        }
+        if(n == 0) {
+            continue;
+        }
+        int len = snprintf(buf, sizeof(buf), "%3d ms %4u ", b, n);
+        for(unsigned int i = 0; i < n * 40 / stats.samples && len < (int)sizeof(buf) - 1; i++) {
+            buf[len++] = '#';
+        }
+        buf[len] = 0;
+        console_output_addline(buf);
+    }
+    return 0;
+}
+
+int console_cmd_seek(game_state *gs, int argc, char **argv) {
+    int tick;
+    if(argc != 2 || !strtoint(argv[1], &tick) || tick < 0) {
+        return 1;
+    }
+    // Input is not polled while the console is open, and playback needs it
+    console_window_close();
+    if(game_state_rec_seek(gs, tick)) {
+        console_output_addline("cannot seek to that tick");
+    }
+    return 0;
+}
+
+// Matches shown at most by recs; the command line lists all of them
+#define RECS_MAX_LINES 40
+
+// recs DIR [har=HAR] [pilot=PILOT]
+int console_cmd_recs(game_state *gs, int argc, char **argv) {
+    if(argc < 2) {
+        return 1;
+    }
+    rec_library_query q;
+    rec_library_query_init(&q);
+    for(int i = 2; i < argc; i++) {
+        if(rec_library_query_parse(&q, argv[i])) {
+            return 1;
+        }
+    }
+    rec_library lib;
+    int loaded = rec_library_refresh(&lib, argv[1]);
+    if(loaded < 0) {
+        console_output_addline("cannot open that directory");
+        rec_library_free(&lib);
+        return 0;
+    }
+
+    char buf[512];
+    unsigned int shown = 0;
+    unsigned int valid = 0;
+    iterator it;
+    rec_library_entry *e;
+    vector_iter_begin(&lib.entries, &it);
+    while((e = iter_next(&it)) != NULL) {
+        valid += !e->invalid;
+        if(!rec_library_match(e, &q)) {
+            continue;
+        }
+        if(shown < RECS_MAX_LINES) {
+            rec_library_describe(e, buf, sizeof(buf));
+            console_output_addline(buf);
+        }
+        shown++;
+    }
+    snprintf(buf, sizeof(buf), "%u of %u recordings match, %d read", shown, valid, loaded);
+    console_output_addline(buf);
+    rec_library_free(&lib);
+    return 0;
+}
+
+// Seconds of fighting kept for rewinding, unless told otherwise
+#define REWIND_DEFAULT_SECONDS 30
+
+// rewind on [seconds] | rewind off | rewind reset | rewind <seconds back>
+int console_cmd_rewind(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    int seconds;
+    if(argc >= 2 && strcmp(argv[1], "on") == 0) {
+        seconds = REWIND_DEFAULT_SECONDS;
+        if(argc >= 3 && (!strtoint(argv[2], &seconds) || seconds <= 0)) {
+            return 1;
+        }
+        if(game_state_history_start(gs, seconds)) {
+            console_output_addline("rewinding only works in a local fight");
+            return 0;
+        }
+        snprintf(buf, sizeof(buf), "keeping the last %d seconds", seconds);
+        console_output_addline(buf);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "off") == 0) {
+        game_state_history_stop(gs);
+        return 0;
+    }
+    if(gs->history == NULL) {
+        console_output_addline("not keeping any history, see rewind on");
+        return 0;
+    }
+    int failed;
+    if(argc == 2 && strcmp(argv[1], "reset") == 0) {
+        failed = game_state_history_reset(gs);
+    } else if(argc == 2 && strtoint(argv[1], &seconds) && seconds >= 0) {
+        unsigned int ticks = seconds * 1000 / game_state_ms_per_dyntick(gs);
+        failed = game_state_history_seek(gs, (ticks < gs->tick) ? gs->tick - ticks : 0);
+    } else {
+        return 1;
+    }
+    if(failed) {
+        console_output_addline("cannot rewind");
+        return 0;
+    }
+    console_window_close();
+    return 0;
+}
+
+// trace start [file] | trace stop
+int console_cmd_trace(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2 && strcmp(argv[1], "start") == 0) {
+        const char *filename = (argc >= 3) ? argv[2] : "trace.json";
+        if(trace_start(filename)) {
+            console_output_addline("unable to start trace");
+            return 0;
+        }
+        snprintf(buf, sizeof(buf), "tracing to %s", filename);
+        console_output_addline(buf);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "stop") == 0) {
+        if(!trace_is_active()) {
+            console_output_addline("no trace running");
+            return 0;
+        }
+        trace_stop();
+        snprintf(buf, sizeof(buf), "trace stopped, %u events dropped", trace_dropped());
+        console_output_addline(buf);
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_loglevel(game_state *gs, int argc, char **argv) {
+    static const char *names[] = {"debug", "info", "error"};
+    char buf[64];
+    if(argc == 2) {
+        int level = -1;
+        for(int i = 0; i < 3; i++) {
+            if(strcmp(argv[1], names[i]) == 0) {
+                level = i;
+            }
+        }
+        if(level < 0) {
+            return 1;
+        }
+        log_set_level(level);
+    } else if(argc != 1) {
+        return 1;
+    }
+    snprintf(buf, sizeof(buf), "log level is %s", names[log_get_level()]);
+    console_output_addline(buf);
+    return 0;
+}
+
+int console_cmd_capture(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 2 && strcmp(argv[1], "start") == 0) {
+        int every = 1;
+        if(argc >= 3 && (!strtoint(argv[2], &every) || every <= 0)) {
+            return 1;
+        }
+        screenshot_sequence_start(every);
+        snprintf(buf, sizeof(buf), "capturing every %d frame(s)", every);
+        console_output_addline(buf);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "stop") == 0) {
+        if(!screenshot_sequence_active()) {
+            console_output_addline("no capture running");
+            return 0;
+        }
+        screenshot_sequence_stop();
+        snprintf(buf, sizeof(buf), "capture stopped, %u frames saved", screenshot_sequence_count());
+        console_output_addline(buf);
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_vod(game_state *gs, int argc, char **argv) {
+    char buf[128];
+    if(argc >= 3 && strcmp(argv[1], "start") == 0) {
+        // The rest of the line is the encoder command
+        char cmd[256] = "";
+        for(int i = 2; i < argc; i++) {
+            if(i > 2) {
+                strncat(cmd, " ", sizeof(cmd) - strlen(cmd) - 1);
+            }
+            strncat(cmd, argv[i], sizeof(cmd) - strlen(cmd) - 1);
+        }
+        char audio_path[64];
+        snprintf(audio_path, sizeof(audio_path), "vod_%u.wav", SDL_GetTicks());
+        encoder_options opts;
+        memset(&opts, 0, sizeof(opts));
+        opts.command = cmd;
+        opts.audio_path = audio_path;
+        opts.fps = ENCODER_DEFAULT_FPS;
+        if(encoder_start(&opts)) {
+            console_output_addline("could not start the encoder");
+            return 0;
+        }
+        snprintf(buf, sizeof(buf), "encoding, audio goes to %s", audio_path);
+        console_output_addline(buf);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "stop") == 0) {
+        if(!encoder_active()) {
+            console_output_addline("no encoder running");
+            return 0;
+        }
+        snprintf(buf, sizeof(buf), "encoder stopped, %u frames, %u dropped",
+                 encoder_frame_count(), encoder_dropped_count());
+        encoder_stop();
+        console_output_addline(buf);
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_exec(game_state *gs, int argc, char **argv) {
+    if(argc != 2) {
+        return 1;
+    }
+    return console_exec_file(argv[1]) ? 2 : 0;
+}
+
+// Only means something in exec scripts
+int console_cmd_wait(game_state *gs, int argc, char **argv) {
+    int ticks;
+    if(argc != 2 || !strtoint(argv[1], &ticks) || ticks < 0) {
+        return 1;
+    }
+    console_script_wait(gs, ticks);
+    return 0;
+}
+
+int console_cmd_bench(game_state *gs, int argc, char **argv) {
+    if(argc == 2 && strcmp(argv[1], "start") == 0) {
+        profiler_capture_start();
+        return 0;
+    }
+    if((argc == 2 || argc == 3) && strcmp(argv[1], "stop") == 0) {
+        FILE *out = stdout;
+        if(argc == 3) {
+            // Appended, so runs of several scripts go in one file
+            out = fopen(argv[2], "a");
+            if(out == NULL) {
+                return 2;
+            }
+        }
+        profiler_capture_report(out);
+        if(out != stdout) {
+            fclose(out);
+        }
+        return 0;
+    }
+    return 1;
+}
+
 void console_init_cmd() {
     // Add console commands
     console_add_cmd("h",     &console_cmd_history,  "show command history");
@@ -239,8 +850,27 @@ void console_init_cmd() {
     console_add_cmd("lose",  &console_cmd_lose,   "Set your health to 0");
     console_add_cmd("stun",  &console_cmd_stun,   "Stun the other player");
     console_add_cmd("rein",  &console_cmd_rein,   "R-E-I-N!");
-    console_add_cmd("rdr",   &console_cmd_renderer, "Renderer (0=sw,1=hw)");
+    console_add_cmd("rdr",   &console_cmd_renderer, "Renderer (0=sw,1=hw,2=none)");
     console_add_cmd("god",   &console_cmd_god,  "Enable god mode");
     console_add_cmd("kreissack",   &console_kreissack,  "Fight Kreissack");
     console_add_cmd("ez-destruct",  &console_cmd_ez_destruct,  "Punch = destruction, kick = scrap");
+    console_add_cmd("pool",  &console_cmd_pool,  "show object pool usage");
+    console_add_cmd("net",   &console_cmd_net,  "show network bandwidth usage");
+    console_add_cmd("netem", &console_cmd_netem, "emulate a bad network. usage: netem off | [channel=N] latency=MS jitter=MS loss=% dup=% reorder=%");
+    console_add_cmd("netcap", &console_cmd_netcap, "netcap start [file] / netcap stop");
+    console_add_cmd("mem",   &console_cmd_mem,  "show tracked memory use. usage: mem [reset]");
+    console_add_cmd("perf",  &console_cmd_perf,  "show frame time percentiles");
+    console_add_cmd("set",   &console_cmd_set,   "change a setting now and compare frame times. usage: set NAME [VALUE]");
+    console_add_cmd("audio", &console_cmd_audio, "show audio buffer stats. usage: audio [reset]");
+    console_add_cmd("latency", &console_cmd_latency, "follow presses to the screen. usage: latency on [marker] / latency off / latency reset / latency");
+    console_add_cmd("trace", &console_cmd_trace, "trace start [file] / trace stop");
+    console_add_cmd("loglevel", &console_cmd_loglevel, "loglevel [debug|info|error]");
+    console_add_cmd("capture", &console_cmd_capture, "capture start [every nth frame] / capture stop");
+    console_add_cmd("vod",   &console_cmd_vod,   "vod start [encoder command] / vod stop");
+    console_add_cmd("seek",  &console_cmd_seek,  "seek recording playback to a tick. usage: seek 1200");
+    console_add_cmd("recs",  &console_cmd_recs,  "list recordings. usage: recs DIR [har=HAR] [pilot=PILOT]");
+    console_add_cmd("exec",  &console_cmd_exec,  "run the commands in a script file. usage: exec FILE");
+    console_add_cmd("wait",  &console_cmd_wait,  "in exec scripts, wait some ticks before the next line. usage: wait 100");
+    console_add_cmd("bench", &console_cmd_bench, "bench start / bench stop [file]; times every frame in between");
+    console_add_cmd("rewind", &console_cmd_rewind, "rewind on [seconds] / rewind off / rewind reset / rewind <seconds back>");
 }
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <limits.h>
 #include "controller/ai_controller.h"
 #include "game/objects/har.h"
 #include "game/objects/scrap.h"
@@ -7,7 +8,9 @@
 #include "game/protos/object_specializer.h"
 #include "game/scenes/arena.h"
 #include "game/game_state.h"
+#include "game/game_player.h"
 #include "game/utils/serial.h"
+#include "game/utils/settings.h"
 #include "resources/af_loader.h"
 #include "resources/ids.h"
 #include "resources/animation.h"
@@ -16,6 +19,14 @@
 #include "utils/vec.h"
 #include "utils/random.h"
 
+// On the highest difficulty, the best few moves are tried out on a
+// forked game state before picking one
+#define LOOKAHEAD_MOVES 6
+#define LOOKAHEAD_TICKS 30
+#define LOOKAHEAD_BUDGET_US 1500 // Per poll
+#define LOOKAHEAD_STALE_TICKS 6
+#define LOOKAHEAD_ABORTED INT_MIN
+
 typedef struct move_stat_t {
     int max_hit_dist;
     int min_hit_dist;
@@ -39,8 +50,17 @@ typedef struct ai_t {
     move_stat move_stats[70];
     int blocked;
 
-    // all projectiles currently on screen (vector of projectile object*)
-    vector active_projectiles;
+    // lookahead, see ai_lookahead_step
+    game_state *fork;
+    serial fork_state;
+    int search_active;
+    unsigned int search_tick;
+    int search_count;
+    int search_next;
+    af_move *search_moves[LOOKAHEAD_MOVES];
+    int search_values[LOOKAHEAD_MOVES];
+    af_move *search_best;
+    int search_best_value;
 } ai;
 
 
@@ -136,82 +156,30 @@ int ai_har_event(controller *ctrl, har_event event) {
 
 void ai_controller_free(controller *ctrl) {
     ai *a = ctrl->data;
-    vector_free(&a->active_projectiles);
+    if(a->fork != NULL) {
+        game_state_fork_free(a->fork);
+        free(a->fork);
+        serial_free(&a->fork_state);
+    }
     free(a);
 }
 
-int is_special_move(af_move *move) {
-    const char *move_string = str_c(&move->move_string);
-    if (
-            !strcmp("K", move_string) ||
-            !strcmp("K1", move_string) ||
-            !strcmp("K2", move_string) ||
-            !strcmp("K3", move_string) ||
-            !strcmp("K4", move_string) ||
-            !strcmp("K6", move_string) ||
-            !strcmp("P", move_string) ||
-            !strcmp("P1", move_string) ||
-            !strcmp("P2", move_string) ||
-            !strcmp("P3", move_string) ||
-            !strcmp("P4", move_string) ||
-            !strcmp("P6", move_string)) {
-        return 0;
+// Moves that are worth trying in the current HAR state. Closeness and wall
+// hugging are not part of the filter, since the AI may still close in.
+static void ai_candidate_moves(har *h, move_mask *out) {
+    *out = h->move_filters[har_move_filter(h) | MOVE_FILTER_CLOSE | MOVE_FILTER_WALL];
+    move_mask_and(out, &h->af_data->ai_moves.attacks);
+    if(!h->close && h->state != STATE_JUMPING) {
+        // Only allow handwaving if close or jumping. This attempts
+        // to make the HARs close up instead of standing in place
+        // wawing their hands towards each other. Not a perfect solution.
+        move_mask_andnot(out, &h->af_data->ai_moves.close_range);
     }
-    return 1;
 }
 
-int is_valid_move(af_move *move, har *h) {
-    // If category is any of these, and bot is not close, then
-    // do not try to execute any of them. This attempts
-    // to make the HARs close up instead of standing in place
-    // wawing their hands towards each other. Not a perfect solution.
-    switch(move->category) {
-        case CAT_CLOSE:
-        case CAT_LOW:
-        case CAT_MEDIUM:
-        case CAT_HIGH:
-            // Only allow handwaving if close or jumping
-            if(!h->close && h->state != STATE_JUMPING) {
-                return 0;
-            }
-    }
-    if(move->category == CAT_JUMPING && h->state != STATE_JUMPING) {
-        // not jumping but trying to execute a jumping move
-        return 0;
-    }
-    if(move->category != CAT_JUMPING && h->state == STATE_JUMPING) {
-        // jumping but this move is not a jumping move
-        return 0;
-    }
-    if(move->category == CAT_SCRAP && h->state != STATE_VICTORY) {
-        return 0;
-    }
-
-    if(move->category == CAT_DESTRUCTION && h->state != STATE_SCRAP) {
-        return 0;
-    }
-    // XXX check for chaining?
-
-    const char *move_str = str_c(&move->move_string);
-    for(int i = 0;i < str_size(&move->move_string);i++) {
-        if((move_str[i] >= '1' && move_str[i] <= '9') || move_str[i] == 'K' || move_str[i] == 'P') {
-            continue;
-        } else {
-            return 0;
-        }
-    }
-
-    if((move->damage > 0 || move->category == CAT_PROJECTILE || move->category == CAT_SCRAP || move->category == CAT_DESTRUCTION) &&
-        str_size(&move->move_string) > 0) {
-        return 1;
-    }
-
-    return 0;
-}
-
-int maybe(int difficulty) {
+int maybe(game_state *gs, int difficulty) {
     // make chance of blocking exponentially better as the difficulty inreases
-    int a = rand_int(49);
+    int a = game_state_rand_int(gs, 49);
     int b = difficulty*difficulty;
     /*DEBUG("maybe %d, %d < %d : %s", difficulty, a, b, a < b ? "true" : "false");*/
     if(a < b) {
@@ -230,7 +198,7 @@ int ai_block_har(controller *ctrl, ctrl_event **ev) {
 
     // XXX TODO get maximum move distance from the animation object
     if(fabsf(o_enemy->pos.x - o->pos.x) < 100) {
-        if(h_enemy->executing_move && maybe(a->difficulty)) {
+        if(h_enemy->executing_move && maybe(o->gs, a->difficulty)) {
             if(har_is_crouching(h_enemy)) {
                 a->cur_act = (o->direction == OBJECT_FACE_RIGHT ? ACT_DOWN|ACT_LEFT : ACT_DOWN|ACT_RIGHT);
                 controller_cmd(ctrl, a->cur_act, ev);
@@ -250,13 +218,13 @@ int ai_block_projectile(controller *ctrl, ctrl_event **ev) {
 
     iterator it;
     object **o_tmp;
-    vector_iter_begin(&a->active_projectiles, &it);
+    vector_iter_begin(game_state_get_projectiles(o->gs), &it);
     while((o_tmp = iter_next(&it)) != NULL) {
         object *o_prj = *o_tmp;
         if(projectile_get_owner(o_prj) == o)  {
             continue;
         }
-        if(o_prj->cur_sprite && maybe(a->difficulty)) {
+        if(o_prj->cur_sprite && maybe(o->gs, a->difficulty)) {
             vec2i pos_prj = vec2i_add(object_get_pos(o_prj), o_prj->cur_sprite->pos);
             vec2i size_prj = object_get_size(o_prj);
             if (object_get_direction(o_prj) == OBJECT_FACE_LEFT) {
@@ -274,6 +242,137 @@ int ai_block_projectile(controller *ctrl, ctrl_event **ev) {
     return 0;
 }
 
+static void ai_select_move(ai *a, object *o, object *o_enemy, af_move *selected_move) {
+    a->move_stats[selected_move->id].attempts++;
+    a->move_stats[selected_move->id].consecutive++;
+
+    // do the move
+    a->selected_move = selected_move;
+    a->move_str_pos = str_size(&selected_move->move_string)-1;
+    a->move_stats[a->selected_move->id].last_dist = abs(o->pos.x - o_enemy->pos.x);
+    a->blocked = 0;
+    DEBUG("AI selected move %s", str_c(&selected_move->move_string));
+}
+
+static int ai_use_lookahead(ai *a) {
+    return a->difficulty > ULTIMATE;
+}
+
+// Keeps the LOOKAHEAD_MOVES best moves by heuristic value, best first
+static void ai_lookahead_add(ai *a, af_move *move, int value) {
+    int i = a->search_count;
+    if(i == LOOKAHEAD_MOVES) {
+        if(value <= a->search_values[i - 1]) {
+            return;
+        }
+        i--;
+    } else {
+        a->search_count++;
+    }
+    for(; i > 0 && a->search_values[i - 1] < value; i--) {
+        a->search_moves[i] = a->search_moves[i - 1];
+        a->search_values[i] = a->search_values[i - 1];
+    }
+    a->search_moves[i] = move;
+    a->search_values[i] = value;
+}
+
+static void ai_lookahead_begin(ai *a, game_state *gs) {
+    if(a->fork == NULL) {
+        a->fork = malloc(sizeof(game_state));
+        game_state_fork_create(a->fork, gs);
+        serial_create_size(&a->fork_state, GAME_STATE_SERIAL_SIZE_HINT);
+    }
+    game_state_fork_sync(a->fork, gs, &a->fork_state);
+    a->search_active = 1;
+    a->search_tick = game_state_get_tick(gs);
+    a->search_next = 0;
+    a->search_best = NULL;
+    a->search_best_value = 0;
+}
+
+static void ai_lookahead_cancel(ai *a) {
+    if(a->search_active) {
+        a->search_active = 0;
+        a->search_count = 0;
+        game_state_fork_clear(a->fork);
+    }
+}
+
+// Plays the move out on the fork and returns how well it went, judged by the
+// damage done and taken. Inputs are fed the same way ai_controller_poll does.
+static int ai_lookahead_score(ai *a, int player_id, af_move *move, Uint64 deadline) {
+    game_state_fork_reset(a->fork, &a->fork_state);
+    object *o = game_state_get_player(a->fork, player_id)->har;
+    object *o_enemy = game_state_get_player(a->fork, !player_id)->har;
+    har *h = object_get_userdata(o);
+    har *h_enemy = object_get_userdata(o_enemy);
+    int health = h->health;
+    int enemy_health = h_enemy->health;
+    int enemy_endurance = h_enemy->endurance;
+
+    int pos = str_size(&move->move_string) - 1;
+    int lag_timer = a->input_lag_timer;
+    for(int t = 0; t < LOOKAHEAD_TICKS; t++) {
+        if(SDL_GetPerformanceCounter() > deadline) {
+            return LOOKAHEAD_ABORTED;
+        }
+        if(pos >= 0) {
+            if(lag_timer > 0) {
+                lag_timer--;
+            } else {
+                pos--;
+                lag_timer = a->input_lag;
+            }
+            int ch = str_at(&move->move_string, pos < 0 ? 0 : pos);
+            object_act(o, char_to_act(ch, o->direction));
+        }
+        game_state_fork_tick(a->fork);
+    }
+    return (enemy_health - h_enemy->health) * 4
+         + (enemy_endurance - h_enemy->endurance)
+         - (health - h->health) * 6;
+}
+
+/*
+ * Tries out candidate moves until the per poll budget runs out. The search
+ * carries over to the next polls, and the best move found so far is picked
+ * once all moves are tried or the forked state gets too old.
+ * Returns 1 when a move was picked.
+ */
+static int ai_lookahead_step(controller *ctrl) {
+    ai *a = ctrl->data;
+    object *o = ctrl->har;
+    har *h = object_get_userdata(o);
+    object *o_enemy = game_state_get_player(o->gs, !h->player_id)->har;
+
+    Uint64 deadline = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() * LOOKAHEAD_BUDGET_US / 1000000;
+    while(a->search_next < a->search_count) {
+        int score = ai_lookahead_score(a, h->player_id, a->search_moves[a->search_next], deadline);
+        if(score == LOOKAHEAD_ABORTED) {
+            break;
+        }
+        int value = score + a->search_values[a->search_next];
+        if(a->search_best == NULL || value > a->search_best_value) {
+            a->search_best = a->search_moves[a->search_next];
+            a->search_best_value = value;
+        }
+        a->search_next++;
+    }
+    if(a->search_next < a->search_count && game_state_get_tick(o->gs) - a->search_tick <= LOOKAHEAD_STALE_TICKS) {
+        return 0;
+    }
+
+    af_move *best = a->search_best;
+    if(best == NULL) {
+        // Ran out of time before trying anything
+        best = a->search_moves[0];
+    }
+    ai_lookahead_cancel(a);
+    ai_select_move(a, o, o_enemy, best);
+    return 1;
+}
+
 int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
     ai *a = ctrl->data;
     object *o = ctrl->har;
@@ -294,13 +393,10 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
 
         // null out selected move to fix the "AI not moving problem"
         a->selected_move = NULL;
+        ai_lookahead_cancel(a);
         return 0;
     }
 
-    // Grab all projectiles on screen
-    vector_clear(&a->active_projectiles);
-    game_state_get_projectiles(o->gs, &a->active_projectiles);
-
     // Try to block har
     if(ai_block_har(ctrl, ev)) {
         return 0;
@@ -325,61 +421,70 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
         int ch = str_at(&a->selected_move->move_string, a->move_str_pos);
         controller_cmd(ctrl, char_to_act(ch, o->direction), ev);
 
-    } else if(rand_int(100) < a->difficulty) {
+    } else if(a->search_active) {
+        ai_lookahead_step(ctrl);
+    } else if(game_state_rand_int(o->gs, 100) < a->difficulty) {
         af_move *selected_move = NULL;
+        int lookahead = ai_use_lookahead(a);
+        a->search_count = 0;
         int top_value = 0;
 
         // Attack
-        for(int i = 0; i < 70; i++) {
-            af_move *move = NULL;
-            if((move = af_get_move(h->af_data, i))) {
-                move_stat *ms = &a->move_stats[i];
-                if(is_valid_move(move, h)) {
-                    int value = ms->value + rand_int(10);
-                    if (ms->min_hit_dist != -1){
-                        if (ms->last_dist < ms->max_hit_dist+5 && ms->last_dist > ms->min_hit_dist+5){
-                            value += 2;
-                        } else if (ms->last_dist > ms->max_hit_dist+10){
-                            value -= 3;
-                        }
-                    }
-
-                    value -= ms->attempts/2;
-                    value -= ms->consecutive*2;
-
-                    if (is_special_move(move) && !maybe(a->difficulty)) {
-                        DEBUG("skipping special move %s because of difficulty", str_c(&move->move_string));
-                        continue;
-                    }
-
-                    if (selected_move == NULL){
-                        selected_move = move;
-                        top_value = value;
-                    } else if (value > top_value) {
-                        selected_move = move;
-                        top_value = value;
-                    }
+        har *h_enemy = object_get_userdata(o_enemy);
+        int dist = abs(o->pos.x - o_enemy->pos.x);
+        move_mask candidates;
+        ai_candidate_moves(h, &candidates);
+        for(int i = move_mask_next(&candidates, 0); i >= 0; i = move_mask_next(&candidates, i + 1)) {
+            af_move *move = af_get_move(h->af_data, i);
+            move_stat *ms = &a->move_stats[i];
+            int value = ms->value + game_state_rand_int(o->gs, 10);
+            if (ms->min_hit_dist != -1){
+                if (ms->last_dist < ms->max_hit_dist+5 && ms->last_dist > ms->min_hit_dist+5){
+                    value += 2;
+                } else if (ms->last_dist > ms->max_hit_dist+10){
+                    value -= 3;
                 }
+            } else if(move->reach >= 0 && move->category != CAT_PROJECTILE && dist > move->reach + 40) {
+                // Not tried yet, but the enemy looks to be out of reach
+                value -= 2;
+            }
+            if(h_enemy->executing_move && move->ani.hit_tick > 0) {
+                // Quick moves are better for interrupting
+                value -= move->ani.hit_tick / 10;
+            }
+
+            value -= ms->attempts/2;
+            value -= ms->consecutive*2;
+
+            if (move_mask_isset(&h->af_data->ai_moves.specials, i) && !maybe(o->gs, a->difficulty)) {
+                DEBUG("skipping special move %s because of difficulty", str_c(&move->move_string));
+                continue;
+            }
+
+            if(lookahead) {
+                ai_lookahead_add(a, move, value);
+            }
+            if (selected_move == NULL){
+                selected_move = move;
+                top_value = value;
+            } else if (value > top_value) {
+                selected_move = move;
+                top_value = value;
             }
         }
         for(int i = 0; i < 70; i++) {
             a->move_stats[i].consecutive /= 2;
         }
-        if(selected_move) {
-            a->move_stats[selected_move->id].attempts++;
-            a->move_stats[selected_move->id].consecutive++;
-
-            // do the move
-            a->selected_move = selected_move;
-            a->move_str_pos = str_size(&selected_move->move_string)-1;
-            a->move_stats[a->selected_move->id].last_dist = abs(o->pos.x - o_enemy->pos.x);
-            a->blocked = 0;
-            DEBUG("AI selected move %s", str_c(&selected_move->move_string));
+        if(lookahead && a->search_count > 1) {
+            ai_lookahead_begin(a, o->gs);
+            ai_lookahead_step(ctrl);
+        } else if(selected_move) {
+            ai_select_move(a, o, o_enemy, selected_move);
         }
     } else {
         // Change action after 30 ticks
-        if(a->act_timer <= 0 && rand_int(100) > 88){
-            int p = rand_int(100);
+        if(a->act_timer <= 0 && game_state_rand_int(o->gs, 100) > 88){
+            int p = game_state_rand_int(o->gs, 100);
             if(p > 40){
                 // walk forward
                 a->cur_act = (o->direction == OBJECT_FACE_RIGHT ? ACT_RIGHT : ACT_LEFT);
@@ -401,7 +506,7 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
         }
 
         // Jump once in a while
-        if(rand_int(100) == 88){
+        if(game_state_rand_int(o->gs, 100) == 88){
             if(o->vel.x < 0) {
                 controller_cmd(ctrl, ACT_UP|ACT_LEFT, ev);
             } else if(o->vel.x > 0) {
@@ -431,7 +536,9 @@ void ai_controller_create(controller *ctrl, int difficulty) {
         a->move_stats[i].last_dist = -1;
     }
     a->blocked = 0;
-    vector_create(&a->active_projectiles, sizeof(object*));
+    a->fork = NULL;
+    a->search_active = 0;
+    a->search_count = 0;
 
     ctrl->data = a;
     ctrl->type = CTRL_TYPE_AI;
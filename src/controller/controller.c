@@ -2,13 +2,28 @@
 #include "utils/log.h"
 #include "controller/controller.h"
 
-typedef struct hook_function_t {
-    void(*fp)(controller *ctrl, int act_type);
-    controller *source;
-} hook_function;
+// Events are taken from a ring buffer shared by all controllers. The buffer
+// is not owned by any controller, so event chains stay valid even if the
+// controller that produced them is replaced while they are being handled.
+// Controllers of different game states may run on different threads, so
+// slots are claimed atomically.
+#define CTRL_EVENT_BUF_SIZE 128
+
+static ctrl_event event_buf[CTRL_EVENT_BUF_SIZE];
+static SDL_atomic_t event_pos;
+
+static SDL_atomic_t tick_time;
+
+void controller_set_tick_time(Uint32 time) {
+    SDL_AtomicSet(&tick_time, (int)time);
+}
+
+Uint32 controller_get_tick_time() {
+    return (Uint32)SDL_AtomicGet(&tick_time);
+}
 
 void controller_init(controller *ctrl) {
-    list_create(&ctrl->hooks);
+    ctrl->hook_count = 0;
     ctrl->extra_events = NULL;
     ctrl->har = NULL;
     ctrl->poll_fun = NULL;
@@ -21,59 +36,79 @@ void controller_init(controller *ctrl) {
     ctrl->repeat = 0;
 }
 
+// Takes the next event from the ring buffer. If that slot is still held
+// by a chain that has not been freed yet, falls back to malloc.
+static ctrl_event* controller_alloc_event(int type) {
+    unsigned int pos = (unsigned int)SDL_AtomicGet(&event_pos) % CTRL_EVENT_BUF_SIZE;
+    ctrl_event *e = &event_buf[pos];
+    if(!SDL_AtomicCAS(&e->in_use, 0, 1)) {
+        e = malloc(sizeof(ctrl_event));
+        e->pooled = 0;
+        SDL_AtomicSet(&e->in_use, 1);
+    } else {
+        e->pooled = 1;
+        SDL_AtomicCAS(&event_pos, pos, (pos + 1) % CTRL_EVENT_BUF_SIZE);
+    }
+    e->type = type;
+    e->tick = -1;
+    e->next = NULL;
+    e->last = e;
+    return e;
+}
+
+// Appends an event to the end of the chain
+static void controller_append_event(ctrl_event **ev, ctrl_event *e) {
+    if(*ev == NULL) {
+        *ev = e;
+    } else {
+        (*ev)->last->next = e;
+        (*ev)->last = e;
+    }
+}
+
 void controller_add_hook(controller *ctrl, controller *source, void(*fp)(controller *ctrl, int act_type)) {
-    hook_function *h = malloc(sizeof(hook_function));
+    if(ctrl->hook_count >= CONTROLLER_MAX_HOOKS) {
+        PERROR("Too many controller hooks, ignoring the new one");
+        return;
+    }
+    hook_function *h = &ctrl->hooks[ctrl->hook_count++];
     h->fp = fp;
     h->source = source;
-    list_append(&ctrl->hooks, &h, sizeof(hook_function*));
 }
 
 void controller_clear_hooks(controller *ctrl) {
-    iterator it;
-    hook_function **tmp = 0;
-    list_iter_begin(&ctrl->hooks, &it);
-    while((tmp = iter_next(&it)) != NULL) {
-        free(*tmp);
-        list_delete(&ctrl->hooks, &it);
-    }
+    ctrl->hook_count = 0;
 }
 
 void controller_free_chain(ctrl_event *ev) {
-    if(ev != NULL) {
-        if(ev->next != NULL) {
-            controller_free_chain(ev->next);
-        }
+    while(ev != NULL) {
+        ctrl_event *next = ev->next;
         if (ev->type == EVENT_TYPE_SYNC) {
             serial_free(ev->event_data.ser);
             free(ev->event_data.ser);
         }
-        free(ev);
+        if(ev->pooled) {
+            SDL_AtomicSet(&ev->in_use, 0);
+        } else {
+            free(ev);
+        }
+        ev = next;
     }
 }
 
 void controller_cmd(controller* ctrl, int action, ctrl_event **ev) {
-    // fire any installed hooks
-    iterator it;
-    hook_function **p = 0;
-    ctrl_event *i;
+    controller_cmd_at(ctrl, action, -1, ev);
+}
 
-    list_iter_begin(&ctrl->hooks, &it);
-    while((p = iter_next(&it)) != NULL) {
-        ((*p)->fp)((*p)->source, action);
-    }
-    if (*ev == NULL) {
-        *ev = malloc(sizeof(ctrl_event));
-        (*ev)->type = EVENT_TYPE_ACTION;
-        (*ev)->event_data.action = action;
-        (*ev)->next = NULL;
-    } else {
-        i = *ev;
-        while (i->next) { i = i->next; }
-        i->next = malloc(sizeof(ctrl_event));
-        i->next->type = EVENT_TYPE_ACTION;
-        i->next->event_data.action = action;
-        i->next->next = NULL;
+void controller_cmd_at(controller* ctrl, int action, int tick, ctrl_event **ev) {
+    // fire any installed hooks
+    for(int i = 0; i < ctrl->hook_count; i++) {
+        ctrl->hooks[i].fp(ctrl->hooks[i].source, action);
     }
+    ctrl_event *e = controller_alloc_event(EVENT_TYPE_ACTION);
+    e->event_data.action = action;
+    e->tick = tick;
+    controller_append_event(ev, e);
 }
 
 void controller_sync(controller *ctrl, serial *ser, ctrl_event **ev) {
@@ -81,10 +116,8 @@ void controller_sync(controller *ctrl, serial *ser, ctrl_event **ev) {
         // a sync event obsoletes all previous events
         controller_free_chain(*ev);
     }
-    *ev = malloc(sizeof(ctrl_event));
-    (*ev)->type = EVENT_TYPE_SYNC;
+    *ev = controller_alloc_event(EVENT_TYPE_SYNC);
     (*ev)->event_data.ser = ser;
-    (*ev)->next = NULL;
 }
 
 void controller_close(controller *ctrl, ctrl_event **ev) {
@@ -92,9 +125,7 @@ void controller_close(controller *ctrl, ctrl_event **ev) {
         // a close event obsoletes all previous events
         controller_free_chain(*ev);
     }
-    *ev = malloc(sizeof(ctrl_event));
-    (*ev)->type = EVENT_TYPE_CLOSE;
-    (*ev)->next = NULL;
+    *ev = controller_alloc_event(EVENT_TYPE_CLOSE);
 }
 
 int controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
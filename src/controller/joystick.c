@@ -1,6 +1,12 @@
 #include "controller/joystick.h"
+#include "controller/gamecontrollerdb.h"
+#include "utils/hashmap.h"
+#include "utils/latency_probe.h"
 #include "utils/log.h"
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define UP -32768
 #define DOWN 32767
@@ -8,12 +14,435 @@
 #define RIGHT 32767
 #define CENTER 0
 
-void joystick_free(controller *ctrl) {
-    joystick *k = ctrl->data;
+#define JOYSTICK_GUID_LEN 33
+
+// Rumble updates closer than this to the effect already playing are dropped
+#define JOYSTICK_RUMBLE_MAGNITUDE_STEP 0.1f
+#define JOYSTICK_RUMBLE_SLACK_MS 50
+
+/*
+ * Attached devices are kept in a list that follows SDL's device indexes, so
+ * that looking one up by name or counting them does not have to open every
+ * device. The list is changed one device at a time as SDL reports devices
+ * being added and removed.
+ *
+ * Mappings are indexed by GUID the first time a device needs one, and only
+ * the mapping of that device is handed over to SDL.
+ */
+typedef struct joystick_device_t {
+    SDL_JoystickID instance;
+    SDL_JoystickGUID guid;
+    char name[64];
+} joystick_device;
+
+static joystick_device devices[JOYSTICK_MAX_DEVICES];
+static int device_count = 0;
+static SDL_SpinLock devices_lock;
+
+// Joystick controllers that exist, so unplugged ones can be given their device back
+static joystick *opened[JOYSTICK_MAX_DEVICES];
+static int opened_count = 0;
+
+/*
+ * Haptic calls can block for milliseconds on some wireless pads, so rumble
+ * is played by a worker thread. Each joystick has room for one pending
+ * effect and a newer one replaces it, so the worker never falls behind.
+ * The opened list and the pending effects are guarded by the rumble lock,
+ * and the haptic lock keeps a device from being closed while it plays.
+ */
+typedef struct joystick_rumbler_t {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_mutex *haptic_lock;
+    SDL_cond *wake;
+    int quit;
+} joystick_rumbler;
+
+static joystick_rumbler rumbler;
+
+static hashmap mappings;
+static int mappings_indexed = 0;
+static char *mapping_file = NULL;
+
+static void joystick_index_mappings(const char *text) {
+    const char *platform = SDL_GetPlatform();
+    size_t platform_len = strlen(platform);
+    const char *line = text;
+    while(*line) {
+        const char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        if(len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        const char *comma = memchr(line, ',', len);
+        if(line[0] != '#' && comma != NULL && comma - line == JOYSTICK_GUID_LEN - 1) {
+            char *mapping = malloc(len + 1);
+            memcpy(mapping, line, len);
+            mapping[len] = 0;
+
+            // Same rule SDL uses for mapping files: skip other platforms
+            const char *p = strstr(mapping, "platform:");
+            if(p == NULL || (strncmp(p + 9, platform, platform_len) == 0
+                             && (p[9 + platform_len] == ',' || p[9 + platform_len] == 0))) {
+                char guid[JOYSTICK_GUID_LEN];
+                memcpy(guid, mapping, JOYSTICK_GUID_LEN - 1);
+                guid[JOYSTICK_GUID_LEN - 1] = 0;
+                hashmap_sput(&mappings, guid, mapping, len + 1);
+            }
+            free(mapping);
+        }
+        if(end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+}
+
+static char* joystick_read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = NULL;
+    if(size > 0) {
+        data = malloc(size + 1);
+        size = fread(data, 1, size, fp);
+        data[size] = 0;
+    }
+    fclose(fp);
+    return data;
+}
+
+// Gives SDL the mapping of the device, if it has none yet
+static void joystick_map_device(int index) {
+    if(SDL_IsGameController(index)) {
+        return;
+    }
+    if(!mappings_indexed) {
+        // The local file comes last so that it overrides the built-in one
+        hashmap_create(&mappings, 8);
+        joystick_index_mappings(gamecontrollerdb);
+        if(mapping_file != NULL) {
+            char *data = joystick_read_file(mapping_file);
+            if(data != NULL) {
+                joystick_index_mappings(data);
+                DEBUG("Indexed mappings from %s", mapping_file);
+                free(data);
+            }
+        }
+        mappings_indexed = 1;
+        DEBUG("%u controller mappings indexed", hashmap_reserved(&mappings));
+    }
+    char guid[JOYSTICK_GUID_LEN];
+    SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(index), guid, sizeof(guid));
+    char *mapping;
+    unsigned int len;
+    if(hashmap_sget(&mappings, guid, (void**)&mapping, &len) == 0) {
+        if(SDL_GameControllerAddMapping(mapping) < 0) {
+            PERROR("Unable to add mapping for %s: %s", guid, SDL_GetError());
+        }
+    }
+}
+
+static void joystick_device_add(int index) {
+    SDL_JoystickID instance = SDL_JoystickGetDeviceInstanceID(index);
+    SDL_AtomicLock(&devices_lock);
+    for(int i = 0; i < device_count; i++) {
+        if(devices[i].instance == instance) {
+            SDL_AtomicUnlock(&devices_lock);
+            return;
+        }
+    }
+    SDL_AtomicUnlock(&devices_lock);
+    if(device_count >= JOYSTICK_MAX_DEVICES) {
+        PERROR("Too many joysticks, ignoring device %d", index);
+        return;
+    }
+
+    joystick_map_device(index);
+    joystick_device d;
+    const char *name = SDL_JoystickNameForIndex(index);
+    d.instance = instance;
+    d.guid = SDL_JoystickGetDeviceGUID(index);
+    snprintf(d.name, sizeof(d.name), "%s", name ? name : "");
+
+    char guidstr[JOYSTICK_GUID_LEN];
+    SDL_JoystickGetGUIDString(d.guid, guidstr, sizeof(guidstr));
+    INFO("Joystick %d attached", index);
+    INFO(" * Name:              %s", d.name);
+    INFO(" * GUID          :    %s", guidstr);
+    INFO(" * Game controller:   %s", SDL_IsGameController(index) ? "yes" : "no");
+
+    SDL_AtomicLock(&devices_lock);
+    devices[device_count++] = d;
+    SDL_AtomicUnlock(&devices_lock);
+}
+
+static void joystick_device_remove(SDL_JoystickID instance) {
+    SDL_AtomicLock(&devices_lock);
+    for(int i = 0; i < device_count; i++) {
+        if(devices[i].instance == instance) {
+            // Later devices move down an index, same as in SDL
+            memmove(&devices[i], &devices[i + 1], sizeof(joystick_device) * (device_count - i - 1));
+            device_count--;
+            break;
+        }
+    }
+    SDL_AtomicUnlock(&devices_lock);
+}
+
+static joystick* joystick_rumble_next() {
+    for(int i = 0; i < opened_count; i++) {
+        if(opened[i]->rumble_pending) {
+            return opened[i];
+        }
+    }
+    return NULL;
+}
+
+static int joystick_rumble_worker(void *data) {
+    SDL_LockMutex(rumbler.lock);
+    while(!rumbler.quit) {
+        joystick *k = joystick_rumble_next();
+        if(k == NULL) {
+            SDL_CondWait(rumbler.wake, rumbler.lock);
+            continue;
+        }
+        float magnitude = k->rumble_magnitude;
+        int duration = k->rumble_duration;
+        k->rumble_pending = 0;
+        SDL_UnlockMutex(rumbler.lock);
+
+        // The joystick may have been freed in the meantime
+        SDL_LockMutex(rumbler.haptic_lock);
+        SDL_LockMutex(rumbler.lock);
+        int alive = 0;
+        for(int i = 0; i < opened_count; i++) {
+            alive |= (opened[i] == k);
+        }
+        SDL_UnlockMutex(rumbler.lock);
+        if(alive && k->haptic != NULL) {
+            SDL_HapticRumblePlay(k->haptic, magnitude, duration);
+        }
+        SDL_UnlockMutex(rumbler.haptic_lock);
+        SDL_LockMutex(rumbler.lock);
+    }
+    SDL_UnlockMutex(rumbler.lock);
+    return 0;
+}
+
+void joystick_init(const char *path) {
+    if(path != NULL) {
+        mapping_file = malloc(strlen(path) + 1);
+        strcpy(mapping_file, path);
+    }
+    device_count = 0;
+    for(int i = 0; i < SDL_NumJoysticks(); i++) {
+        joystick_device_add(i);
+    }
+    INFO("Found %d joysticks attached", device_count);
+
+    rumbler.lock = SDL_CreateMutex();
+    rumbler.haptic_lock = SDL_CreateMutex();
+    rumbler.wake = SDL_CreateCond();
+    rumbler.quit = 0;
+    rumbler.thread = NULL;
+}
+
+void joystick_close() {
+    if(rumbler.thread != NULL) {
+        SDL_LockMutex(rumbler.lock);
+        rumbler.quit = 1;
+        SDL_CondSignal(rumbler.wake);
+        SDL_UnlockMutex(rumbler.lock);
+        SDL_WaitThread(rumbler.thread, NULL);
+        rumbler.thread = NULL;
+    }
+    SDL_DestroyCond(rumbler.wake);
+    SDL_DestroyMutex(rumbler.haptic_lock);
+    SDL_DestroyMutex(rumbler.lock);
+    rumbler.wake = NULL;
+    rumbler.haptic_lock = NULL;
+    rumbler.lock = NULL;
+    if(mappings_indexed) {
+        hashmap_free(&mappings);
+        mappings_indexed = 0;
+    }
+    free(mapping_file);
+    mapping_file = NULL;
+    device_count = 0;
+}
+
+static void joystick_reset_state(joystick *k) {
+    k->queue_tail = k->queue_head;
+    memset(k->held, 0, sizeof(k->held));
+    memset(k->pressed, 0, sizeof(k->pressed));
+    memset(k->axes, 0, sizeof(k->axes));
+}
+
+static int joystick_open_device(joystick *k, int index) {
+    SDL_GameController *joy = SDL_GameControllerOpen(index);
+    if(joy == NULL) {
+        return 1;
+    }
+    SDL_Joystick *sjoy = SDL_GameControllerGetJoystick(joy);
+    SDL_Haptic *haptic = SDL_HapticOpenFromJoystick(sjoy);
+    int rumble = 0;
+    if (haptic) {
+        if (SDL_HapticRumbleSupported(haptic)) {
+            if (SDL_HapticRumbleInit(haptic) == 0) {
+                rumble = 1;
+            } else {
+                DEBUG("Failed to initialize rumble: %s", SDL_GetError());
+            }
+        } else {
+            DEBUG("Rumble not supported");
+        }
+    } else {
+        DEBUG("Haptic not supported");
+    }
+
+    SDL_LockMutex(rumbler.haptic_lock);
+    k->haptic = haptic;
+    k->rumble = rumble;
+    k->rumble_sent = 0;
+    k->rumble_until = 0;
+    SDL_UnlockMutex(rumbler.haptic_lock);
+
+    SDL_AtomicLock(&k->lock);
+    k->joy = joy;
+    k->instance = SDL_JoystickInstanceID(sjoy);
+    k->guid = SDL_JoystickGetGUID(sjoy);
+    k->attached = 1;
+    joystick_reset_state(k);
+
+    // Whatever is already held down when the device is opened
+    for(int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++) {
+        k->held[i] = SDL_GameControllerGetButton(joy, i);
+    }
+    for(int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) {
+        k->axes[i] = SDL_GameControllerGetAxis(joy, i);
+    }
+    SDL_AtomicUnlock(&k->lock);
+    return 0;
+}
+
+static void joystick_close_device(joystick *k) {
+    SDL_LockMutex(rumbler.haptic_lock);
     if (k->haptic) {
         SDL_HapticClose(k->haptic);
     }
-    SDL_GameControllerClose(k->joy);
+    k->haptic = NULL;
+    k->rumble = 0;
+    SDL_UnlockMutex(rumbler.haptic_lock);
+
+    SDL_AtomicLock(&k->lock);
+    SDL_GameController *joy = k->joy;
+    k->joy = NULL;
+    k->attached = 0;
+    joystick_reset_state(k);
+    SDL_AtomicUnlock(&k->lock);
+    if (joy) {
+        SDL_GameControllerClose(joy);
+    }
+}
+
+void joystick_device_event(const SDL_Event *event) {
+    if(event->type == SDL_JOYDEVICEADDED) {
+        int index = event->jdevice.which;
+        joystick_device_add(index);
+
+        // Give a controller that lost its device a new one of the same kind
+        SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(index);
+        for(int i = 0; i < opened_count; i++) {
+            joystick *k = opened[i];
+            if(!k->attached && memcmp(&k->guid, &guid, sizeof(guid)) == 0
+                    && joystick_open_device(k, index) == 0) {
+                DEBUG("Joystick reattached as device %d", index);
+                break;
+            }
+        }
+    } else if(event->type == SDL_JOYDEVICEREMOVED) {
+        SDL_JoystickID instance = event->jdevice.which;
+        joystick_device_remove(instance);
+        for(int i = 0; i < opened_count; i++) {
+            joystick *k = opened[i];
+            if(k->attached && k->instance == instance) {
+                DEBUG("Joystick detached");
+                joystick_close_device(k);
+            }
+        }
+    }
+}
+
+// Runs when SDL pumps the event, which is before the engine loop gets
+// around to it, and possibly on another thread than the one polling.
+static int joystick_event_watch(void *userdata, SDL_Event *event) {
+    joystick *k = userdata;
+    joystick_input_event ev;
+    SDL_JoystickID which;
+    switch(event->type) {
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            which = event->cbutton.which;
+            ev.timestamp = event->cbutton.timestamp;
+            ev.axis = 0;
+            ev.index = event->cbutton.button;
+            ev.value = event->cbutton.state == SDL_PRESSED;
+            if(ev.index >= SDL_CONTROLLER_BUTTON_MAX) {
+                return 0;
+            }
+            break;
+        case SDL_CONTROLLERAXISMOTION:
+            which = event->caxis.which;
+            ev.timestamp = event->caxis.timestamp;
+            ev.axis = 1;
+            ev.index = event->caxis.axis;
+            ev.value = event->caxis.value;
+            if(ev.index >= SDL_CONTROLLER_AXIS_MAX) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    SDL_AtomicLock(&k->lock);
+    if(!k->attached || which != k->instance) {
+        SDL_AtomicUnlock(&k->lock);
+        return 0;
+    }
+    if(k->queue_head - k->queue_tail >= JOYSTICK_EVENT_QUEUE_SIZE) {
+        // Nobody is polling; keep the button states right at least
+        const joystick_input_event *old = &k->queue[k->queue_tail % JOYSTICK_EVENT_QUEUE_SIZE];
+        if(old->axis) {
+            k->axes[old->index] = old->value;
+        } else {
+            k->held[old->index] = old->value;
+        }
+        k->queue_tail++;
+    }
+    k->queue[k->queue_head % JOYSTICK_EVENT_QUEUE_SIZE] = ev;
+    k->queue_head++;
+    SDL_AtomicUnlock(&k->lock);
+    return 0;
+}
+
+void joystick_free(controller *ctrl) {
+    joystick *k = ctrl->data;
+    SDL_DelEventWatch(joystick_event_watch, k);
+    SDL_LockMutex(rumbler.lock);
+    for(int i = 0; i < opened_count; i++) {
+        if(opened[i] == k) {
+            opened[i] = opened[--opened_count];
+            break;
+        }
+    }
+    SDL_UnlockMutex(rumbler.lock);
+    joystick_close_device(k);
     free(k->keys);
     free(k);
 }
@@ -22,65 +451,48 @@ void joystick_cmd(controller *ctrl, int action, ctrl_event **ev) {
     joystick *k = ctrl->data;
     if (ctrl->repeat && action != ACT_KICK && action != ACT_PUNCH && action != ACT_ESC) {
         controller_cmd(ctrl, action, ev);
+        latency_probe_cmd();
     } else if (!(k->last & action)) {
         controller_cmd(ctrl, action, ev);
+        latency_probe_cmd();
     }
     k->current |= action;
 }
 
 int joystick_count() {
-    int valid_joysticks = 0;
-    SDL_Joystick *joy;
-    for (int i = 0; i < SDL_NumJoysticks(); i++) {
-        joy = SDL_JoystickOpen(i);
-        if (joy) {
-            valid_joysticks++;
-        }
-        if (SDL_JoystickGetAttached(joy)) {
-            SDL_JoystickClose(joy);
-        }
-    }
-    return valid_joysticks;
+    return device_count;
 }
 
 int joystick_nth_id(int n) {
-    SDL_Joystick *joy;
-    int c = 0;
-    for (int i = 0; i < SDL_NumJoysticks(); i++) {
-        joy = SDL_JoystickOpen(i);
-        if (joy) {
-            c++;
-            if (SDL_JoystickGetAttached(joy)) {
-                SDL_JoystickClose(joy);
-            }
-            if (c == n) {
-                return i;
-            }
-        }
-    }
-    return -1;
+    return (n >= 1 && n <= device_count) ? n - 1 : -1;
 }
 
 int joystick_offset(int id, const char *name) {
     int offset = 0;
-    for (int i = 0; i < id; i++) {
-        if (i != id && !strcmp(name, SDL_JoystickNameForIndex(i)))
+    SDL_AtomicLock(&devices_lock);
+    for (int i = 0; i < id && i < device_count; i++) {
+        if (!strcmp(name, devices[i].name))
             offset++;
     }
+    SDL_AtomicUnlock(&devices_lock);
     return offset;
 }
 
 int joystick_name_to_id(const char *name, int offset) {
-    for (int i = 0; i < SDL_NumJoysticks(); i++) {
-        if (!strcmp(name, SDL_JoystickNameForIndex(i))) {
+    int id = -1;
+    SDL_AtomicLock(&devices_lock);
+    for (int i = 0; i < device_count; i++) {
+        if (!strcmp(name, devices[i].name)) {
             if (offset) {
                 offset--;
             } else {
-                return i;
+                id = i;
+                break;
             }
         }
     }
-    return -1;
+    SDL_AtomicUnlock(&devices_lock);
+    return id;
 }
 
 int joystick_poll(controller *ctrl, ctrl_event **ev) {
@@ -88,12 +500,38 @@ int joystick_poll(controller *ctrl, ctrl_event **ev) {
 
     k->current = 0;
 
-    Sint16 x_axis = SDL_GameControllerGetAxis(k->joy, k->keys->x_axis);
-    Sint16 y_axis = SDL_GameControllerGetAxis(k->joy, k->keys->y_axis);
-    int dpadup = SDL_GameControllerGetButton(k->joy, k->keys->dpad[0]);
-    int dpaddown = SDL_GameControllerGetButton(k->joy, k->keys->dpad[1]);
-    int dpadleft = SDL_GameControllerGetButton(k->joy, k->keys->dpad[2]);
-    int dpadright = SDL_GameControllerGetButton(k->joy, k->keys->dpad[3]);
+    // Only take the events that happened before this tick was due
+    Uint32 due = controller_get_tick_time();
+    uint8_t buttons[SDL_CONTROLLER_BUTTON_MAX];
+    SDL_AtomicLock(&k->lock);
+    while(k->queue_tail != k->queue_head) {
+        const joystick_input_event *e = &k->queue[k->queue_tail % JOYSTICK_EVENT_QUEUE_SIZE];
+        if(due != 0 && !SDL_TICKS_PASSED(due, e->timestamp)) {
+            break;
+        }
+        if(e->axis) {
+            k->axes[e->index] = e->value;
+        } else {
+            k->held[e->index] = e->value;
+            if(e->value) {
+                k->pressed[e->index] = 1;
+                latency_probe_input(e->timestamp);
+            }
+        }
+        k->queue_tail++;
+    }
+    for(int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++) {
+        buttons[i] = k->held[i] || k->pressed[i];
+        k->pressed[i] = 0;
+    }
+    Sint16 x_axis = k->axes[k->keys->x_axis];
+    Sint16 y_axis = k->axes[k->keys->y_axis];
+    SDL_AtomicUnlock(&k->lock);
+
+    int dpadup = buttons[k->keys->dpad[0]];
+    int dpaddown = buttons[k->keys->dpad[1]];
+    int dpadleft = buttons[k->keys->dpad[2]];
+    int dpadright = buttons[k->keys->dpad[3]];
 
     // joystick input
     // TODO the devide by 2 should be a 'dead zone' variable that can be set in the option menu but this devide works well 99% of the time.
@@ -135,13 +573,13 @@ int joystick_poll(controller *ctrl, ctrl_event **ev) {
     }
 
     // button input
-    if (SDL_GameControllerGetButton(k->joy, k->keys->punch)) {
+    if (buttons[k->keys->punch]) {
         joystick_cmd(ctrl, ACT_PUNCH, ev);
-    } else if (SDL_GameControllerGetButton(k->joy, k->keys->kick)) {
+    } else if (buttons[k->keys->kick]) {
         joystick_cmd(ctrl, ACT_KICK, ev);
     }
 
-    if (SDL_GameControllerGetButton(k->joy, k->keys->escape)) {
+    if (buttons[k->keys->escape]) {
         joystick_cmd(ctrl, ACT_ESC, ev);
     }
 
@@ -155,12 +593,45 @@ int joystick_poll(controller *ctrl, ctrl_event **ev) {
 
 int joystick_rumble(controller *ctrl, float magnitude, int duration) {
     joystick *k = ctrl->data;
-    SDL_HapticRumblePlay(k->haptic, magnitude, duration);
+    if (!k->rumble) {
+        return 0;
+    }
+
+    // Screen shake asks again every tick. Nothing needs to be sent while the
+    // effect that is playing is about as strong and lasts long enough.
+    Uint32 now = SDL_GetTicks();
+    Uint32 until = now + duration;
+    if (fabsf(magnitude - k->rumble_sent) < JOYSTICK_RUMBLE_MAGNITUDE_STEP
+            && SDL_TICKS_PASSED(k->rumble_until + JOYSTICK_RUMBLE_SLACK_MS, until)) {
+        return 0;
+    }
+    k->rumble_sent = magnitude;
+    k->rumble_until = until;
+
+    SDL_LockMutex(rumbler.lock);
+    if (rumbler.thread == NULL && !rumbler.quit) {
+        rumbler.thread = SDL_CreateThread(joystick_rumble_worker, "rumble", NULL);
+        if (rumbler.thread == NULL) {
+            PERROR("Unable to create rumble thread: %s", SDL_GetError());
+            rumbler.quit = 1;
+        }
+    }
+    if (rumbler.thread == NULL) {
+        SDL_UnlockMutex(rumbler.lock);
+        SDL_HapticRumblePlay(k->haptic, magnitude, duration);
+        return 0;
+    }
+    k->rumble_magnitude = magnitude;
+    k->rumble_duration = duration;
+    k->rumble_pending = 1;
+    SDL_CondSignal(rumbler.wake);
+    SDL_UnlockMutex(rumbler.lock);
     return 0;
 }
 
 int joystick_create(controller *ctrl, int joystick_id) {
     joystick *k = malloc(sizeof(joystick));
+    memset(k, 0, sizeof(joystick));
     k->keys = malloc(sizeof(joystick_keys));
     k->keys->x_axis = SDL_CONTROLLER_AXIS_LEFTX;
     k->keys->y_axis = SDL_CONTROLLER_AXIS_LEFTY;
@@ -176,24 +647,15 @@ int joystick_create(controller *ctrl, int joystick_id) {
     ctrl->data = k;
     ctrl->type = CTRL_TYPE_GAMEPAD;
     ctrl->poll_fun = &joystick_poll;
+    ctrl->rumble_fun = &joystick_rumble;
+    SDL_AddEventWatch(joystick_event_watch, k);
 
-    k->joy = SDL_GameControllerOpen(joystick_id);
-    if (k->joy) {
-        k->haptic = SDL_HapticOpenFromJoystick(SDL_GameControllerGetJoystick(k->joy));
-        if (k->haptic) {
-            if (SDL_HapticRumbleSupported(k->haptic)) {
-                if (SDL_HapticRumbleInit(k->haptic) == 0) {
-                    k->rumble = 1;
-                    ctrl->rumble_fun = joystick_rumble;
-                } else {
-                    DEBUG("Failed to initialize rumble: %s", SDL_GetError());
-                }
-            } else {
-                DEBUG("Rumble not supported");
-            }
-        } else {
-            DEBUG("Haptic not supported");
+    if (joystick_id >= 0 && joystick_open_device(k, joystick_id) == 0) {
+        SDL_LockMutex(rumbler.lock);
+        if (opened_count < JOYSTICK_MAX_DEVICES) {
+            opened[opened_count++] = k;
         }
+        SDL_UnlockMutex(rumbler.lock);
         return 1;
     }
 
@@ -1,9 +1,68 @@
 #include "controller/keyboard.h"
+#include "utils/latency_probe.h"
 #include "utils/log.h"
 #include <stdlib.h>
+#include <string.h>
+
+static void keyboard_get_binds(const keyboard_keys *keys, int binds[KEY_COUNT]) {
+    binds[KEY_UP] = keys->up;
+    binds[KEY_DOWN] = keys->down;
+    binds[KEY_LEFT] = keys->left;
+    binds[KEY_RIGHT] = keys->right;
+    binds[KEY_PUNCH] = keys->punch;
+    binds[KEY_KICK] = keys->kick;
+    binds[KEY_ESCAPE] = keys->escape;
+}
+
+static int keyboard_key_index(keyboard *k, SDL_Scancode sc) {
+    int binds[KEY_COUNT];
+    keyboard_get_binds(k->keys, binds);
+    for(int i = 0; i < KEY_COUNT; i++) {
+        if(binds[i] == (int)sc) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void keyboard_apply(keyboard *k, const keyboard_key_event *ev) {
+    k->held[ev->key] = ev->down;
+    if(ev->down) {
+        k->pressed[ev->key] = 1;
+    }
+}
+
+// Runs when SDL pumps the event, which is before the engine loop gets
+// around to it, and possibly on another thread than the one polling.
+static int keyboard_event_watch(void *userdata, SDL_Event *event) {
+    keyboard *k = userdata;
+    if((event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) || event->key.repeat) {
+        return 0;
+    }
+    int key = keyboard_key_index(k, event->key.keysym.scancode);
+    if(key < 0) {
+        return 0;
+    }
+    keyboard_key_event ev;
+    ev.timestamp = event->key.timestamp;
+    ev.key = key;
+    ev.down = (event->type == SDL_KEYDOWN);
+
+    SDL_AtomicLock(&k->lock);
+    if(k->queue_head - k->queue_tail >= KEYBOARD_EVENT_QUEUE_SIZE) {
+        // Nobody is polling; keep the key states right at least
+        keyboard_apply(k, &k->queue[k->queue_tail % KEYBOARD_EVENT_QUEUE_SIZE]);
+        k->queue_tail++;
+    }
+    k->queue[k->queue_head % KEYBOARD_EVENT_QUEUE_SIZE] = ev;
+    k->queue_head++;
+    SDL_AtomicUnlock(&k->lock);
+    return 0;
+}
 
 void keyboard_free(controller *ctrl) {
     keyboard *k = ctrl->data;
+    SDL_DelEventWatch(keyboard_event_watch, k);
     free(k->keys);
     free(k);
 }
@@ -12,8 +71,10 @@ void keyboard_cmd(controller *ctrl, int action, ctrl_event **ev) {
     keyboard *k = ctrl->data;
     if (ctrl->repeat && action != ACT_KICK && action != ACT_PUNCH && action != ACT_ESC) {
         controller_cmd(ctrl, action, ev);
+        latency_probe_cmd();
     } else if (!(k->last & action)) {
         controller_cmd(ctrl, action, ev);
+        latency_probe_cmd();
     }
     k->current |= action;
 }
@@ -21,32 +82,53 @@ void keyboard_cmd(controller *ctrl, int action, ctrl_event **ev) {
 int keyboard_poll(controller *ctrl, ctrl_event **ev) {
     keyboard *k = ctrl->data;
     k->current = 0;
-    const unsigned char *state = SDL_GetKeyboardState(NULL);
-    if ( state[k->keys->left] && state[k->keys->up]) {
+
+    // Only take the key events that happened before this tick was due
+    Uint32 due = controller_get_tick_time();
+    uint8_t keys[KEY_COUNT];
+    SDL_AtomicLock(&k->lock);
+    while(k->queue_tail != k->queue_head) {
+        const keyboard_key_event *ev = &k->queue[k->queue_tail % KEYBOARD_EVENT_QUEUE_SIZE];
+        if(due != 0 && !SDL_TICKS_PASSED(due, ev->timestamp)) {
+            break;
+        }
+        keyboard_apply(k, ev);
+        if(ev->down) {
+            latency_probe_input(ev->timestamp);
+        }
+        k->queue_tail++;
+    }
+    for(int i = 0; i < KEY_COUNT; i++) {
+        keys[i] = k->held[i] || k->pressed[i];
+        k->pressed[i] = 0;
+    }
+    SDL_AtomicUnlock(&k->lock);
+
+    if ( keys[KEY_LEFT] && keys[KEY_UP]) {
         keyboard_cmd(ctrl, ACT_UP|ACT_LEFT, ev);
-    } else if ( state[k->keys->left] && state[k->keys->down]) {
+    } else if ( keys[KEY_LEFT] && keys[KEY_DOWN]) {
         keyboard_cmd(ctrl, ACT_DOWN|ACT_LEFT, ev);
-    } else  if ( state[k->keys->right] && state[k->keys->up]) {
+    } else  if ( keys[KEY_RIGHT] && keys[KEY_UP]) {
         keyboard_cmd(ctrl, ACT_UP|ACT_RIGHT, ev);
-    } else  if ( state[k->keys->right] && state[k->keys->down]) {
+    } else  if ( keys[KEY_RIGHT] && keys[KEY_DOWN]) {
         keyboard_cmd(ctrl, ACT_DOWN|ACT_RIGHT, ev);
-    } else if ( state[k->keys->right]) {
+    } else if ( keys[KEY_RIGHT]) {
         keyboard_cmd(ctrl, ACT_RIGHT, ev);
-    } else if ( state[k->keys->left]) {
+    } else if ( keys[KEY_LEFT]) {
         keyboard_cmd(ctrl, ACT_LEFT, ev);
-    } else if ( state[k->keys->up]) {
+    } else if ( keys[KEY_UP]) {
         keyboard_cmd(ctrl, ACT_UP, ev);
-    } else if ( state[k->keys->down]) {
+    } else if ( keys[KEY_DOWN]) {
         keyboard_cmd(ctrl, ACT_DOWN, ev);
     }
 
-    if (state[k->keys->punch]) {
+    if (keys[KEY_PUNCH]) {
         keyboard_cmd(ctrl, ACT_PUNCH, ev);
-    }  else if (state[k->keys->kick]) {
+    }  else if (keys[KEY_KICK]) {
         keyboard_cmd(ctrl, ACT_KICK, ev);
     }
 
-    if (state[k->keys->escape]) {
+    if (keys[KEY_ESCAPE]) {
         keyboard_cmd(ctrl, ACT_ESC, ev);
     }
 
@@ -76,9 +158,20 @@ int keyboard_binds_key(controller *ctrl, SDL_Event *event) {
 
 void keyboard_create(controller *ctrl, keyboard_keys *keys, int delay) {
     keyboard *k = malloc(sizeof(keyboard));
+    memset(k, 0, sizeof(keyboard));
     k->keys = keys;
     k->last = 0;
+
+    // Keys that are already down when the controller is made
+    const unsigned char *state = SDL_GetKeyboardState(NULL);
+    int binds[KEY_COUNT];
+    keyboard_get_binds(keys, binds);
+    for(int i = 0; i < KEY_COUNT; i++) {
+        k->held[i] = state[binds[i]];
+    }
+
     ctrl->data = k;
     ctrl->type = CTRL_TYPE_KEYBOARD;
     ctrl->poll_fun = &keyboard_poll;
+    SDL_AddEventWatch(keyboard_event_watch, k);
 }
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "controller/net_capture.h"
+#include "game/utils/serial.h"
+#include "utils/trace.h"
+#include "utils/log.h"
+
+#define NET_CAPTURE_MAGIC "ONCP"
+#define NET_CAPTURE_VERSION 1
+
+// Records are gathered in memory and written out in chunks of about this size
+#define NET_CAPTURE_FLUSH_SIZE 65536
+
+// How long the replay waits for the game to accept the connection
+#define NET_CAPTURE_CONNECT_MS 5000
+
+// Kind byte: direction in bit 0, channel in bits 1-4, enet flags above
+#define KIND_DIR 0x01
+#define KIND_CHANNEL_SHIFT 1
+#define KIND_CHANNEL_MASK 0x0F
+#define KIND_RELIABLE 0x20
+#define KIND_UNSEQUENCED 0x40
+
+typedef struct net_capture_t {
+    FILE *fp;
+    serial buf;
+    uint64_t start;
+    uint64_t last_us;
+    unsigned int packets;
+} net_capture;
+
+// Packets are captured on the game thread, the console may stop it elsewhere
+static net_capture *cap = NULL;
+static SDL_SpinLock cap_lock;
+
+static void net_capture_write_out(net_capture *c) {
+    if(c->buf.len > 0 && fwrite(c->buf.data, 1, c->buf.len, c->fp) != c->buf.len) {
+        PERROR("Could not write to the network capture");
+    }
+    serial_clear(&c->buf);
+}
+
+int net_capture_start(const char *filename) {
+    if(net_capture_is_active()) {
+        return 1;
+    }
+    FILE *fp = fopen(filename, "wb");
+    if(fp == NULL) {
+        PERROR("Could not open network capture %s.", filename);
+        return 1;
+    }
+    net_capture *c = malloc(sizeof(net_capture));
+    c->fp = fp;
+    serial_create_size(&c->buf, NET_CAPTURE_FLUSH_SIZE);
+    serial_write(&c->buf, NET_CAPTURE_MAGIC, 4);
+    serial_write_int8(&c->buf, NET_CAPTURE_VERSION);
+    c->start = SDL_GetPerformanceCounter();
+    c->last_us = 0;
+    c->packets = 0;
+    trace_instant("net", "capture", 0);
+
+    SDL_AtomicLock(&cap_lock);
+    cap = c;
+    SDL_AtomicUnlock(&cap_lock);
+    INFO("Capturing network packets to %s.", filename);
+    return 0;
+}
+
+void net_capture_stop() {
+    SDL_AtomicLock(&cap_lock);
+    net_capture *c = cap;
+    cap = NULL;
+    SDL_AtomicUnlock(&cap_lock);
+    if(c == NULL) {
+        return;
+    }
+    net_capture_write_out(c);
+    fclose(c->fp);
+    serial_free(&c->buf);
+    INFO("Network capture stopped, %u packets.", c->packets);
+    free(c);
+}
+
+int net_capture_is_active() {
+    return cap != NULL;
+}
+
+void net_capture_packet(int dir, int channel, const ENetPacket *packet, int tick) {
+    if(cap == NULL) {
+        return;
+    }
+    SDL_AtomicLock(&cap_lock);
+    net_capture *c = cap;
+    if(c != NULL) {
+        uint64_t now_us = (SDL_GetPerformanceCounter() - c->start) * 1000000 / SDL_GetPerformanceFrequency();
+        int kind = (dir & KIND_DIR) | ((channel & KIND_CHANNEL_MASK) << KIND_CHANNEL_SHIFT);
+        if(packet->flags & ENET_PACKET_FLAG_RELIABLE) {
+            kind |= KIND_RELIABLE;
+        }
+        if(packet->flags & ENET_PACKET_FLAG_UNSEQUENCED) {
+            kind |= KIND_UNSEQUENCED;
+        }
+        serial_write_int8(&c->buf, kind);
+        serial_write_varint(&c->buf, (uint32_t)(now_us - c->last_us));
+        serial_write_svarint(&c->buf, tick);
+        serial_write_varint(&c->buf, packet->dataLength);
+        serial_write(&c->buf, (const char*)packet->data, packet->dataLength);
+        c->last_us = now_us;
+        c->packets++;
+        if(c->buf.len >= NET_CAPTURE_FLUSH_SIZE) {
+            net_capture_write_out(c);
+        }
+    }
+    SDL_AtomicUnlock(&cap_lock);
+}
+
+int net_capture_read(const char *filename, net_capture_cb cb, void *userdata) {
+    FILE *fp = fopen(filename, "rb");
+    if(fp == NULL) {
+        PERROR("Could not open network capture %s.", filename);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size > 0 ? size : 1);
+    if(size < 5 || fread(data, 1, size, fp) != (size_t)size
+            || memcmp(data, NET_CAPTURE_MAGIC, 4) != 0 || data[4] != NET_CAPTURE_VERSION) {
+        PERROR("%s is not a network capture.", filename);
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    serial ser;
+    serial_create_view(&ser, data, size);
+    ser.rpos = 5;
+    net_capture_record rec;
+    rec.time_us = 0;
+    int count = 0;
+    while(ser.rpos < ser.len) {
+        int kind = (uint8_t)serial_read_int8(&ser);
+        rec.time_us += serial_read_varint(&ser);
+        rec.tick = serial_read_svarint(&ser);
+        rec.len = serial_read_varint(&ser);
+        if(rec.len > ser.len - ser.rpos) {
+            DEBUG("Network capture %s is cut short.", filename);
+            break;
+        }
+        rec.dir = kind & KIND_DIR;
+        rec.channel = (kind >> KIND_CHANNEL_SHIFT) & KIND_CHANNEL_MASK;
+        rec.flags = ((kind & KIND_RELIABLE) ? ENET_PACKET_FLAG_RELIABLE : 0)
+                  | ((kind & KIND_UNSEQUENCED) ? ENET_PACKET_FLAG_UNSEQUENCED : 0);
+        rec.data = ser.data + ser.rpos;
+        ser.rpos += rec.len;
+        count++;
+        if(cb(&rec, userdata)) {
+            break;
+        }
+    }
+    free(data);
+    return count;
+}
+
+typedef struct net_replay_t {
+    ENetHost *host;
+    ENetPeer *peer;
+    uint64_t start;
+    uint64_t first_us;
+    int started;
+    int disconnected;
+    unsigned int sent;
+    uint64_t max_late_us;
+} net_replay;
+
+// Services the host until the given time, throwing away what the game sends
+static void net_replay_wait(net_replay *r, uint64_t until_us) {
+    ENetEvent event;
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    while(!r->disconnected) {
+        uint64_t now_us = (SDL_GetPerformanceCounter() - r->start) * 1000000 / freq;
+        if(now_us >= until_us) {
+            return;
+        }
+        uint64_t left_ms = (until_us - now_us) / 1000;
+        if(enet_host_service(r->host, &event, left_ms > 1 ? 1 : 0) > 0) {
+            if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+                enet_packet_destroy(event.packet);
+            } else if(event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                r->disconnected = 1;
+            }
+        }
+    }
+}
+
+static int net_replay_record(const net_capture_record *rec, void *userdata) {
+    net_replay *r = userdata;
+    if(rec->dir != NET_CAPTURE_IN) {
+        return 0;
+    }
+    if(!r->started) {
+        r->started = 1;
+        r->first_us = rec->time_us;
+        r->start = SDL_GetPerformanceCounter();
+    }
+    uint64_t due_us = rec->time_us - r->first_us;
+    net_replay_wait(r, due_us);
+    if(r->disconnected) {
+        INFO("The game closed the connection.");
+        return 1;
+    }
+    uint64_t now_us = (SDL_GetPerformanceCounter() - r->start) * 1000000 / SDL_GetPerformanceFrequency();
+    if(now_us - due_us > r->max_late_us) {
+        r->max_late_us = now_us - due_us;
+    }
+    ENetPacket *packet = enet_packet_create(rec->data, rec->len, rec->flags);
+    if(enet_peer_send(r->peer, rec->channel, packet) < 0) {
+        enet_packet_destroy(packet);
+    }
+    enet_host_flush(r->host);
+    r->sent++;
+    return 0;
+}
+
+int net_capture_replay(const char *filename, const char *host, int port) {
+    net_replay r;
+    ENetAddress address;
+    ENetEvent event;
+    memset(&r, 0, sizeof(net_replay));
+
+    // Enough channels for anything the capture may hold
+    r.host = enet_host_create(NULL, 1, KIND_CHANNEL_MASK + 1, 0, 0);
+    if(r.host == NULL) {
+        PERROR("Could not create a network host for the replay");
+        return 1;
+    }
+    enet_address_set_host(&address, host);
+    address.port = port;
+    r.peer = enet_host_connect(r.host, &address, KIND_CHANNEL_MASK + 1, 0);
+    if(r.peer == NULL
+            || enet_host_service(r.host, &event, NET_CAPTURE_CONNECT_MS) <= 0
+            || event.type != ENET_EVENT_TYPE_CONNECT) {
+        PERROR("Could not connect to %s:%d", host, port);
+        enet_host_destroy(r.host);
+        return 1;
+    }
+
+    INFO("Replaying %s to %s:%d", filename, host, port);
+    int count = net_capture_read(filename, net_replay_record, &r);
+    if(count >= 0) {
+        INFO("Replayed %u packets, at most %.1f ms late.", r.sent, r.max_late_us / 1000.0);
+    }
+
+    enet_peer_disconnect(r.peer, 0);
+    Uint32 deadline = SDL_GetTicks() + 1000;
+    while(!r.disconnected && !SDL_TICKS_PASSED(SDL_GetTicks(), deadline)) {
+        if(enet_host_service(r.host, &event, 10) > 0) {
+            if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+                enet_packet_destroy(event.packet);
+            } else if(event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                r.disconnected = 1;
+            }
+        }
+    }
+    enet_host_destroy(r.host);
+    return (count < 0);
+}
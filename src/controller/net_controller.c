@@ -1,105 +1,474 @@
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include "controller/net_controller.h"
+#include "controller/net_capture.h"
+#include "game/game_state.h"
+#include "game/game_state_type.h"
+#include "game/protos/object.h"
+#include "game/utils/settings.h"
+#include "utils/delta.h"
 #include "utils/log.h"
+#include "utils/memtrack.h"
+#include "utils/trace.h"
+
+// Number of past sync states kept on each side for delta encoding
+#define SYNC_HISTORY 16
+// Send a full state at least this often, counted in syncs
+#define SYNC_KEYFRAME_INTERVAL 30
+// Number of recent HAR actions kept for resending in input packets
+#define INPUT_HISTORY 64
+// Heartbeats carry the state hash of this many ticks ago, so that late
+// input has been rolled back into it on both sides
+#define HASH_DELAY_TICKS ROLLBACK_TICKS
+// Heartbeats are sent this often, in ticks, whether or not the last one was answered
+#define HB_INTERVAL_TICKS 4
+// Heartbeats in flight that are remembered, older ones count as lost
+#define HB_HISTORY 16
+// Round trip samples the clock offset is picked from
+#define CLOCK_SAMPLES 8
+// Upper bound for the adaptive input delay, in ticks
+#define MAX_INPUT_DELAY 15
+// Tick length to assume while there is no HAR to ask the game state with
+#define DEFAULT_MS_PER_TICK 10
+
+typedef struct net_input_t {
+    int tick;
+    int action;
+} net_input;
+
+typedef struct net_heartbeat_t {
+    int seq;
+    int tick; // Our game tick when it was sent, or -1
+    int answered;
+} net_heartbeat;
+
+typedef struct net_clock_sample_t {
+    Uint32 rtt;
+    int advantage;
+    int has_advantage;
+} net_clock_sample;
 
 typedef struct wtf_t {
-    ENetHost *host;
+    controller *ctrl; // Owner
+    net_service *service;
     ENetPeer *peer;
     int id;
     int last_hb;
     int last_action;
-    int outstanding_hb;
     int disconnected;
+
+    // Heartbeats sent, and the round trips measured from their answers
+    int hb_seq;
+    net_heartbeat hbs[HB_HISTORY];
+    net_clock_sample samples[CLOCK_SAMPLES];
+    int sample_count;
+
+    // Sent states, and the newest one the peer has acknowledged
+    int sync_seq;
+    int acked_seq;
+    int keyframe_seq;
+    serial sent[SYNC_HISTORY];
+    int sent_seq[SYNC_HISTORY];
+
+    // Received states, kept so that deltas against them can be decoded
+    serial received[SYNC_HISTORY];
+    int received_seq[SYNC_HISTORY];
+
+    // Batched HAR input. Every action gets a sequence number, and each
+    // input packet repeats the actions of the last input_redundancy ticks.
+    int input_redundancy;
+    int input_seq; // Sequence number of the next action to send
+    int inputs_dirty;
+    int last_input_send_tick;
+    net_input inputs[INPUT_HISTORY];
+    int recv_input_seq; // Sequence number of the next action to apply
+
+    int desynced; // Peer reported a state hash that differs from ours
+
+    net_stats stats;
 } wtf;
 
+static int net_controller_game_tick(controller *ctrl) {
+    return ctrl->har ? (int)game_state_get_tick(ctrl->har->gs) : -1;
+}
+
+static void net_controller_send(wtf *data, ENetPeer *peer, int channel, ENetPacket *packet) {
+    data->stats.bytes_sent += packet->dataLength;
+    trace_instant("net", "send", packet->dataLength);
+    net_capture_packet(NET_CAPTURE_OUT, channel, packet, net_controller_game_tick(data->ctrl));
+    net_service_send(data->service, peer, channel, packet);
+}
+
+static void net_controller_send_ack(wtf *data, int seq) {
+    serial ser;
+    serial_create(&ser);
+    serial_write_int8(&ser, EVENT_TYPE_ACK);
+    serial_write_int32(&ser, seq);
+    ENetPacket *packet = enet_packet_create(ser.data, ser.len, ENET_PACKET_FLAG_UNSEQUENCED);
+    serial_free(&ser);
+    if (data->peer) {
+        net_controller_send(data, data->peer, NET_CHANNEL_DEFAULT, packet);
+    } else {
+        enet_packet_destroy(packet);
+    }
+}
+
+/*
+ * Turns a received sync packet into a full state. The packet has the
+ * sequence number of the state and the sequence number of the state it is
+ * a delta against, or -1 if it holds the full state. Returns a new serial
+ * holding the state, or NULL if the state the delta is against is not
+ * known anymore.
+ */
+static serial* net_controller_decode_sync(wtf *data, serial *packet) {
+    const char *p = serial_read_block(packet, 8);
+    if (p == NULL) {
+        return NULL;
+    }
+    int seq = serial_get_int32(&p);
+    int base_seq = serial_get_int32(&p);
+    const char *payload = packet->data + packet->rpos;
+    size_t payload_len = packet->len - packet->rpos;
+
+    serial *state = malloc(sizeof(serial));
+    if (base_seq < 0) {
+        serial_create_size(state, payload_len);
+        serial_write(state, payload, payload_len);
+    } else {
+        serial *base = &data->received[base_seq % SYNC_HISTORY];
+        long len = delta_decoded_len(payload, payload_len);
+        if (data->received_seq[base_seq % SYNC_HISTORY] != base_seq || len < 0) {
+            DEBUG("dropping sync %d, delta against unknown state %d", seq, base_seq);
+            free(state);
+            return NULL;
+        }
+        serial_create_size(state, len);
+        if (delta_decode(base->data, base->len, payload, payload_len, state->data, len) < 0) {
+            DEBUG("dropping sync %d, malformed delta", seq);
+            serial_free(state);
+            free(state);
+            return NULL;
+        }
+        state->len = len;
+    }
+
+    serial *slot = &data->received[seq % SYNC_HISTORY];
+    serial_clear(slot);
+    serial_write(slot, state->data, state->len);
+    data->received_seq[seq % SYNC_HISTORY] = seq;
+    net_controller_send_ack(data, seq);
+    return state;
+}
+
+// Sends the actions of the last input_redundancy ticks in one unreliable packet
+static void net_controller_send_inputs(controller *ctrl) {
+    wtf *data = ctrl->data;
+    if (ctrl->har == NULL) {
+        return;
+    }
+    int now = ctrl->har->gs->tick;
+    if (!data->inputs_dirty && now == data->last_input_send_tick) {
+        return;
+    }
+
+    // Find the oldest action that is still inside the window
+    int first = data->input_seq;
+    while (first > 0
+            && data->input_seq - first < INPUT_HISTORY
+            && data->input_seq - first < 255) {
+        net_input *in = &data->inputs[(first - 1) % INPUT_HISTORY];
+        if (in->tick > now || now - in->tick >= data->input_redundancy) {
+            break;
+        }
+        first--;
+    }
+    data->inputs_dirty = 0;
+    data->last_input_send_tick = now;
+    if (first == data->input_seq) {
+        return;
+    }
+
+    serial ser;
+    serial_create(&ser);
+    char *p = serial_write_block(&ser, 6 + (data->input_seq - first) * 6);
+    serial_put_int8(&p, EVENT_TYPE_INPUTS);
+    serial_put_int32(&p, first);
+    serial_put_int8(&p, data->input_seq - first);
+    for (int i = first; i < data->input_seq; i++) {
+        serial_put_int16(&p, data->inputs[i % INPUT_HISTORY].action);
+        serial_put_int32(&p, data->inputs[i % INPUT_HISTORY].tick);
+    }
+    ENetPacket *packet = enet_packet_create(ser.data, ser.len, 0);
+    serial_free(&ser);
+    if (data->peer) {
+        net_controller_send(data, data->peer, NET_CHANNEL_INPUT, packet);
+    } else {
+        enet_packet_destroy(packet);
+    }
+}
+
 void net_controller_free(controller *ctrl) {
     wtf *data = ctrl->data;
-    ENetEvent event;
-    if (!data->disconnected) {
-        DEBUG("closing connection");
-        enet_peer_disconnect(data->peer, 0);
-
-        while (enet_host_service(data->host, &event, 3000) > 0) {
-            switch (event.type) {
-                case ENET_EVENT_TYPE_RECEIVE:
-                    enet_packet_destroy(event.packet);
-                    break;
-                case ENET_EVENT_TYPE_DISCONNECT:
-                    DEBUG("got disconnect notice");
-                    // peer has acknowledged the disconnect
-                    goto done;
-                    break;
-                default:
-                    break;
-            }
+    // The network thread says goodbye to the peer, no need to wait for it here
+    DEBUG("closing connection");
+    net_service_close(data->service);
+    for (int i = 0; i < SYNC_HISTORY; i++) {
+        serial_free(&data->sent[i]);
+        serial_free(&data->received[i]);
+    }
+    mem_free(data);
+}
+
+// Appends the hash of a settled tick to a heartbeat, or a zero flag if there is none
+static void net_controller_write_hash(controller *ctrl, serial *ser) {
+    uint32_t hash;
+    if (ctrl->har != NULL) {
+        game_state *gs = ctrl->har->gs;
+        unsigned int tick = game_state_get_tick(gs);
+        if (tick >= HASH_DELAY_TICKS && !game_state_get_tick_hash(gs, tick - HASH_DELAY_TICKS, &hash)) {
+            serial_write_int8(ser, 1);
+            serial_write_int32(ser, tick - HASH_DELAY_TICKS);
+            serial_write_int32(ser, hash);
+            return;
+        }
+    }
+    serial_write_int8(ser, 0);
+}
+
+static void net_controller_check_hash(controller *ctrl, serial *ser) {
+    wtf *data = ctrl->data;
+    uint32_t hash;
+    if (ctrl->har == NULL || ser->rpos >= ser->len || serial_read_int8(ser) == 0) {
+        return;
+    }
+    const char *p = serial_read_block(ser, 8);
+    if (p == NULL) {
+        return;
+    }
+    unsigned int tick = serial_get_int32(&p);
+    uint32_t peer_hash = serial_get_int32(&p);
+    if (game_state_get_tick_hash(ctrl->har->gs, tick, &hash)) {
+        return; // Too old or not yet simulated here
+    }
+    if (hash != peer_hash) {
+        DEBUG("state hash mismatch at tick %u", tick);
+        data->desynced = 1;
+        data->stats.desyncs++;
+    }
+}
+
+static int net_controller_ms_per_tick(controller *ctrl) {
+    return ctrl->har ? game_state_ms_per_dyntick(ctrl->har->gs) : DEFAULT_MS_PER_TICK;
+}
+
+/*
+ * Takes in the answer to one of our heartbeats. The round trip time and
+ * its jitter are smoothed the way TCP does it. The tick offset to the peer
+ * is measured NTP style, assuming the peer's tick sits halfway between our
+ * send and receive ticks, and is taken from the sample with the shortest
+ * round trip, since that one was least skewed by queueing.
+ */
+static void net_controller_clock_sample(controller *ctrl, int seq, Uint32 sent, int peer_tick) {
+    wtf *data = ctrl->data;
+    net_heartbeat *hb = &data->hbs[seq % HB_HISTORY];
+    if (hb->seq != seq || hb->answered) {
+        return; // Too old, or a duplicate
+    }
+    hb->answered = 1;
+
+    Uint32 rtt = SDL_GetTicks() - sent;
+    if (data->sample_count == 0) {
+        data->stats.rtt_ms = rtt;
+        data->stats.jitter_ms = rtt / 2.0f;
+    } else {
+        data->stats.jitter_ms = 0.75f * data->stats.jitter_ms + 0.25f * fabsf(data->stats.rtt_ms - rtt);
+        data->stats.rtt_ms = 0.875f * data->stats.rtt_ms + 0.125f * rtt;
+    }
+    data->stats.loss *= 0.9f;
+
+    net_clock_sample *sample = &data->samples[data->sample_count % CLOCK_SAMPLES];
+    int now_tick = net_controller_game_tick(ctrl);
+    sample->rtt = rtt;
+    sample->has_advantage = (hb->tick >= 0 && now_tick >= 0 && peer_tick >= 0);
+    sample->advantage = sample->has_advantage ? (hb->tick + now_tick) / 2 - peer_tick : 0;
+    data->sample_count++;
+
+    int best = -1;
+    for (int i = 0; i < CLOCK_SAMPLES && i < data->sample_count; i++) {
+        if (data->samples[i].has_advantage && (best < 0 || data->samples[i].rtt < data->samples[best].rtt)) {
+            best = i;
         }
     }
-done:
-    enet_host_destroy(data->host);
-    free(data);
+    data->stats.frame_advantage = best >= 0 ? data->samples[best].advantage : 0;
+
+    float ms_per_tick = net_controller_ms_per_tick(ctrl);
+    ctrl->rtt = ceilf(data->stats.rtt_ms / ms_per_tick);
+
+    // Delay local moves for as long as they take to reach the peer, less the
+    // ticks we are already ahead, so they arrive net_frame_advantage ticks
+    // before the peer needs them and it rarely has to roll back.
+    int one_way = ceilf((data->stats.rtt_ms / 2.0f + data->stats.jitter_ms) / ms_per_tick);
+    int wanted = one_way - data->stats.frame_advantage + settings_snapshot()->net.net_frame_advantage;
+    wanted = wanted < 0 ? 0 : (wanted > MAX_INPUT_DELAY ? MAX_INPUT_DELAY : wanted);
+
+    // Step towards it a tick at a time, so a single late packet does not stretch moves
+    if (wanted > data->stats.input_delay) {
+        data->stats.input_delay++;
+    } else if (wanted < data->stats.input_delay) {
+        data->stats.input_delay--;
+    }
+}
+
+static void net_controller_send_heartbeat(controller *ctrl, int ticks) {
+    wtf *data = ctrl->data;
+    net_heartbeat *hb = &data->hbs[data->hb_seq % HB_HISTORY];
+    if (hb->seq >= 0 && !hb->answered) {
+        data->stats.loss = 0.9f * data->stats.loss + 0.1f;
+    }
+    hb->seq = data->hb_seq++;
+    hb->tick = net_controller_game_tick(ctrl);
+    hb->answered = 0;
+    data->last_hb = ticks;
+
+    serial ser;
+    serial_create(&ser);
+    serial_write_int8(&ser, EVENT_TYPE_HB);
+    serial_write_int8(&ser, data->id);
+    serial_write_int32(&ser, hb->seq);
+    serial_write_int32(&ser, SDL_GetTicks());
+    serial_write_int32(&ser, hb->tick);
+    net_controller_write_hash(ctrl, &ser);
+    ENetPacket *packet = enet_packet_create(ser.data, ser.len, ENET_PACKET_FLAG_UNSEQUENCED);
+    serial_free(&ser);
+    net_controller_send(data, data->peer, NET_CHANNEL_DEFAULT, packet);
+}
+
+int net_controller_get_rtt(controller *ctrl) {
+    return ctrl->rtt;
+}
+
+int net_controller_get_input_delay(controller *ctrl) {
+    wtf *data = ctrl->data;
+    return data->stats.input_delay;
+}
+
+int net_controller_take_desync(controller *ctrl) {
+    wtf *data = ctrl->data;
+    int ret = data->desynced;
+    data->desynced = 0;
+    return ret;
 }
 
 int net_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
     ENetEvent event;
     wtf *data = ctrl->data;
-    ENetHost *host = data->host;
     ENetPeer *peer = data->peer;
-    serial *ser;
+    serial ser;
     /*int handled = 0;*/
-    while (enet_host_service(host, &event, 0) > 0) {
+    while (net_service_poll(data->service, &event) == 0) {
         switch (event.type) {
             case ENET_EVENT_TYPE_RECEIVE:
-                ser = malloc(sizeof(serial));
-                serial_create(ser);
-                ser->data = malloc(event.packet->dataLength);
-                ser->len = event.packet->dataLength;
-                memcpy(ser->data, event.packet->data, event.packet->dataLength);
-                switch(serial_read_int8(ser)) {
+                data->stats.bytes_received += event.packet->dataLength;
+                trace_instant("net", "receive", event.packet->dataLength);
+                net_capture_packet(NET_CAPTURE_IN, event.channelID, event.packet, net_controller_game_tick(ctrl));
+                // Read straight from the packet, it is only destroyed after parsing
+                serial_create_view(&ser, (const char*)event.packet->data, event.packet->dataLength);
+                switch(serial_read_int8(&ser)) {
                     case EVENT_TYPE_ACTION:
                         {
+                            const char *p = serial_read_block(&ser, 6);
+                            if (p == NULL) {
+                                break;
+                            }
                             // dispatch keypress to scene
-                            int action = serial_read_int16(ser);
-                            controller_cmd(ctrl, action, ev);
+                            int action = serial_get_int16(&p);
+                            int tick = serial_get_int32(&p);
+                            controller_cmd_at(ctrl, action, tick, ev);
                             /*handled = 1;*/
-                            serial_free(ser);
-                            free(ser);
                         }
                         break;
                     case EVENT_TYPE_HB:
                         {
-                            // got a tick
-                            int id = serial_read_int8(ser);
+                            const char *p = serial_read_block(&ser, 13);
+                            if (p == NULL) {
+                                break;
+                            }
+                            int id = serial_get_int8(&p);
+                            int seq = serial_get_int32(&p);
+                            Uint32 sent = serial_get_int32(&p);
+                            int tick = serial_get_int32(&p);
                             if (id == data->id) {
-                                int start = serial_read_int32(ser);
-                                int newrtt = abs(start - ticks);
-                                if (newrtt > ctrl->rtt) {
-                                    ctrl->rtt++;
-                                } else if (newrtt < ctrl->rtt) {
-                                    ctrl->rtt--;
-                                }
-                                data->outstanding_hb = 0;
-                                data->last_hb = ticks;
-                                serial_free(ser);
+                                // the answer to one of ours, tick is the peer's
+                                net_controller_clock_sample(ctrl, seq, sent, tick);
                             } else {
-                                // a heartbeat from the peer, bounce it back
+                                net_controller_check_hash(ctrl, &ser);
+
+                                // a heartbeat from the peer, answer with our tick
+                                serial reply;
+                                serial_create(&reply);
+                                serial_write_int8(&reply, EVENT_TYPE_HB);
+                                serial_write_int8(&reply, id);
+                                serial_write_int32(&reply, seq);
+                                serial_write_int32(&reply, sent);
+                                serial_write_int32(&reply, net_controller_game_tick(ctrl));
                                 ENetPacket *packet;
-                                packet = enet_packet_create(ser->data, ser->len, ENET_PACKET_FLAG_UNSEQUENCED);
+                                packet = enet_packet_create(reply.data, reply.len, ENET_PACKET_FLAG_UNSEQUENCED);
+                                serial_free(&reply);
                                 if (peer) {
-                                    enet_peer_send(peer, 0, packet);
-                                    enet_host_flush (host);
+                                    net_controller_send(data, peer, NET_CHANNEL_DEFAULT, packet);
+                                } else {
+                                    enet_packet_destroy(packet);
                                 }
                             }
-                            free(ser);
                         }
                         break;
                     case EVENT_TYPE_SYNC:
-                        controller_sync(ctrl, ser, ev);
-                        /*handled = 1;*/
+                        {
+                            serial *state = net_controller_decode_sync(data, &ser);
+                            if (state) {
+                                controller_sync(ctrl, state, ev);
+                            }
+                            /*handled = 1;*/
+                        }
+                        break;
+                    case EVENT_TYPE_INPUTS:
+                        {
+                            // Skip the actions that were already seen in earlier packets.
+                            // A short packet is dropped as a whole.
+                            const char *p = serial_read_block(&ser, 5);
+                            if (p == NULL) {
+                                break;
+                            }
+                            int seq = serial_get_int32(&p);
+                            int count = (uint8_t)serial_get_int8(&p);
+                            if ((p = serial_read_block(&ser, count * 6)) == NULL) {
+                                break;
+                            }
+                            if (seq > data->recv_input_seq) {
+                                DEBUG("lost %d actions", seq - data->recv_input_seq);
+                            }
+                            for (int i = 0; i < count; i++, seq++) {
+                                int action = serial_get_int16(&p);
+                                int tick = serial_get_int32(&p);
+                                if (seq >= data->recv_input_seq) {
+                                    controller_cmd_at(ctrl, action, tick, ev);
+                                    data->recv_input_seq = seq + 1;
+                                }
+                            }
+                        }
+                        break;
+                    case EVENT_TYPE_ACK:
+                        {
+                            int seq = serial_read_int32(&ser);
+                            if (!serial_error(&ser) && seq > data->acked_seq && seq <= data->sync_seq) {
+                                data->acked_seq = seq;
+                            }
+                        }
                         break;
                     default:
-                        serial_free(ser);
-                        free(ser);
+                        break;
                 }
                 enet_packet_destroy(event.packet);
                 break;
@@ -114,18 +483,13 @@ int net_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
         }
     }
 
-    if ((data->last_hb == -1 || ticks - data->last_hb > 20) || !data->outstanding_hb) {
-        data->outstanding_hb = 1;
-        serial ser;
-        ENetPacket *packet;
-        serial_create(&ser);
-        serial_write_int8(&ser, EVENT_TYPE_HB);
-        serial_write_int8(&ser, data->id);
-        serial_write_int32(&ser, ticks);
-        packet = enet_packet_create(ser.data, ser.len, ENET_PACKET_FLAG_UNSEQUENCED);
+    if (data->input_redundancy > 0) {
+        net_controller_send_inputs(ctrl);
+    }
+
+    if (data->last_hb == -1 || ticks - data->last_hb >= HB_INTERVAL_TICKS) {
         if (peer) {
-            enet_peer_send(peer, 0, packet);
-            enet_host_flush (host);
+            net_controller_send_heartbeat(ctrl, ticks);
         } else {
             DEBUG("peer is null~");
             data->disconnected = 1;
@@ -136,38 +500,81 @@ int net_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
     /*if(!handled) {*/
         /*controller_cmd(ctrl, ACT_STOP, ev);*/
     /*}*/
+    net_service_flush(data->service);
     return 0;
 }
 
 int net_controller_update(controller *ctrl, serial *serial) {
     wtf *data = ctrl->data;
     ENetPeer *peer = data->peer;
-    ENetHost *host = data->host;
     ENetPacket *packet;
-    uint8_t et = EVENT_TYPE_SYNC;
-    char *buf = malloc(serial->len+sizeof(et));
+    int seq = ++data->sync_seq;
+
+    // Encode against the newest state the peer has, unless it's time for a keyframe
+    int base_seq = data->acked_seq;
+    if (base_seq < 0
+            || seq - base_seq >= SYNC_HISTORY
+            || seq - data->keyframe_seq >= SYNC_KEYFRAME_INTERVAL
+            || data->sent_seq[base_seq % SYNC_HISTORY] != base_seq) {
+        base_seq = -1;
+        data->keyframe_seq = seq;
+    }
+
+    // The packet is sized for the worst case, the state or its delta is
+    // written straight into it, and it is then cut down to what was used
+    struct serial_t header;
+    serial_create_size(&header, 9);
+    serial_write_int8(&header, EVENT_TYPE_SYNC);
+    serial_write_int32(&header, seq);
+    serial_write_int32(&header, base_seq);
+    size_t max_len = header.len + ((base_seq < 0) ? serial->len : delta_max_size(serial->len));
+    packet = enet_packet_create(NULL, max_len, 0);
+    if (packet == NULL) {
+        serial_free(&header);
+        return 1;
+    }
+    memcpy(packet->data, header.data, header.len);
+    size_t len = header.len;
+    serial_free(&header);
+    if (base_seq < 0) {
+        memcpy(packet->data + len, serial->data, serial->len);
+        len += serial->len;
+        data->stats.keyframes++;
+    } else {
+        struct serial_t *base = &data->sent[base_seq % SYNC_HISTORY];
+        len += delta_encode(base->data, base->len, serial->data, serial->len, (char*)packet->data + len);
+        data->stats.deltas++;
+    }
+    enet_packet_resize(packet, len);
+    data->stats.sync_raw_bytes += serial->len;
+    data->stats.sync_bytes += len;
 
-    memcpy(buf, (char*)&et, sizeof(et));
-    // need to copy here because enet will free this packet
-    memcpy(buf+sizeof(et), serial->data, serial->len);
+    // Remember what was sent, so later states can be sent as deltas against it
+    struct serial_t *slot = &data->sent[seq % SYNC_HISTORY];
+    serial_clear(slot);
+    serial_write(slot, serial->data, serial->len);
+    data->sent_seq[seq % SYNC_HISTORY] = seq;
 
-    packet = enet_packet_create(buf, serial->len+4, 0);
-    free(buf);
     if (peer) {
-        enet_peer_send(peer, 1, packet);
-        enet_host_flush(host);
+        net_controller_send(data, peer, NET_CHANNEL_GAME, packet);
+        net_service_flush(data->service);
     } else {
         DEBUG("peer is null~");
+        enet_packet_destroy(packet);
     }
 
     return 0;
 }
 
+const net_stats* net_controller_get_stats(controller *ctrl) {
+    wtf *data = ctrl->data;
+    return &data->stats;
+}
+
 void controller_hook(controller *ctrl, int action) {
     serial ser;
     wtf *data = ctrl->data;
     ENetPeer *peer = data->peer;
-    ENetHost *host = data->host;
     ENetPacket *packet;
     if (action == ACT_STOP && data->last_action == ACT_STOP) {
         data->last_action = -1;
@@ -177,14 +584,15 @@ void controller_hook(controller *ctrl, int action) {
     serial_create(&ser);
     serial_write_int8(&ser, EVENT_TYPE_ACTION);
     serial_write_int16(&ser, action);
+    serial_write_int32(&ser, -1); // Menu input is not tied to a game tick
     /*DEBUG("controller hook fired with %d", action);*/
     /*sprintf(buf, "k%d", action);*/
     packet = enet_packet_create(ser.data, ser.len, ENET_PACKET_FLAG_RELIABLE);
     if (peer) {
-        enet_peer_send(peer, 1, packet);
-        enet_host_flush (host);
+        net_controller_send(data, peer, NET_CHANNEL_GAME, packet);
     } else {
         DEBUG("peer is null~");
+        enet_packet_destroy(packet);
     }
 }
 
@@ -193,40 +601,78 @@ void net_controller_har_hook(int action, void *cb_data) {
     wtf *data = ctrl->data;
     serial ser;
     ENetPeer *peer = data->peer;
-    ENetHost *host = data->host;
     ENetPacket *packet;
     if (action == ACT_STOP && data->last_action == ACT_STOP) {
         data->last_action = -1;
         return;
     }
+    if (data->input_redundancy > 0 && ctrl->har) {
+        if (action == ACT_FLUSH) {
+            net_controller_send_inputs(ctrl);
+            net_service_flush(data->service);
+            return;
+        }
+        data->last_action = action;
+        net_input *in = &data->inputs[data->input_seq % INPUT_HISTORY];
+        in->tick = ctrl->har->gs->tick;
+        in->action = action;
+        data->input_seq++;
+        data->inputs_dirty = 1;
+        return;
+    }
     if (action == ACT_FLUSH) {
-        enet_host_flush(host);
+        net_service_flush(data->service);
         return;
     }
     data->last_action = action;
     serial_create(&ser);
     serial_write_int8(&ser, EVENT_TYPE_ACTION);
     serial_write_int16(&ser, action);
+    // Tag the action with the tick it happened on, so the peer can roll back to it
+    serial_write_int32(&ser, ctrl->har ? (int)ctrl->har->gs->tick : -1);
     /*DEBUG("controller hook fired with %d", action);*/
     /*sprintf(buf, "k%d", action);*/
     packet = enet_packet_create(ser.data, ser.len, ENET_PACKET_FLAG_RELIABLE);
     if (peer) {
-        enet_peer_send(peer, 1, packet);
-        /*enet_host_flush (host);*/
+        net_controller_send(data, peer, NET_CHANNEL_GAME, packet);
     } else {
         DEBUG("peer is null~");
+        enet_packet_destroy(packet);
     }
 }
 
-void net_controller_create(controller *ctrl, ENetHost *host, ENetPeer *peer, int id) {
-    wtf *data = malloc(sizeof(wtf));
+void net_controller_create(controller *ctrl, net_service *service, ENetPeer *peer, int id) {
+    wtf *data = mem_malloc(MEM_TAG_NET, sizeof(wtf));
+    data->ctrl = ctrl;
     data->id = id;
-    data->host = host;
+    data->service = service;
     data->peer = peer;
     data->last_hb = -1;
     data->last_action = ACT_STOP;
-    data->outstanding_hb = 0;
+    data->hb_seq = 0;
+    for (int i = 0; i < HB_HISTORY; i++) {
+        data->hbs[i].seq = -1;
+        data->hbs[i].answered = 0;
+    }
+    data->sample_count = 0;
     data->disconnected = 0;
+    data->sync_seq = -1;
+    data->acked_seq = -1;
+    data->keyframe_seq = -1;
+    for (int i = 0; i < SYNC_HISTORY; i++) {
+        serial_create(&data->sent[i]);
+        serial_create(&data->received[i]);
+        data->sent_seq[i] = -1;
+        data->received_seq[i] = -1;
+    }
+    data->input_redundancy = settings_get()->net.net_input_redundancy;
+    data->input_seq = 0;
+    data->inputs_dirty = 0;
+    data->last_input_send_tick = -1;
+    data->recv_input_seq = 0;
+    data->desynced = 0;
+    memset(&data->stats, 0, sizeof(net_stats));
+    data->stats.start_ticks = SDL_GetTicks();
     ctrl->data = data;
     ctrl->type = CTRL_TYPE_NETWORK;
     ctrl->tick_fun = &net_controller_tick;
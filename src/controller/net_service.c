@@ -0,0 +1,446 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "controller/net_service.h"
+#include "utils/ring.h"
+#include "utils/random.h"
+#include "utils/memtrack.h"
+#include "utils/log.h"
+#include "utils/thread_sched.h"
+
+#define NET_SERVICE_QUEUE_SIZE 256
+
+// The host is serviced about every millisecond, whatever the frame rate
+#define NET_SERVICE_INTERVAL_MS 1
+
+// How long a closed service waits for its peers to acknowledge the disconnect
+#define NET_SERVICE_LINGER_MS 3000
+
+// Roughly how long enet waits before resending a reliable packet, on top of the round trip
+#define NET_EMU_RESEND_MS 30
+
+// Reordered packets are held back at least this long, even without latency
+#define NET_EMU_REORDER_MIN_MS 10
+
+#define NET_EMU_DEFAULT_SEED 0x4e45544d
+
+typedef struct net_send_t {
+    ENetPeer *peer;
+    int channel;
+    ENetPacket *packet;
+} net_send;
+
+// A send held back by the emulation
+typedef struct net_delayed_t {
+    Uint32 due;
+    net_send send;
+} net_delayed;
+
+struct net_service_t {
+    ENetHost *host; // Only touched by the service thread
+    ring outgoing; // net_send, game thread to service thread
+    ring incoming; // ENetEvent, service thread to game thread
+    SDL_atomic_t closing;
+
+    // Sends go out in batches, the game thread publishes a batch once per tick
+    unsigned int queued; // Game thread
+    SDL_atomic_t published;
+    unsigned int sent; // Service thread
+
+    // Emulation state, service thread only
+    net_delayed *delayed;
+    unsigned int delayed_count;
+    unsigned int delayed_cap;
+    Uint32 reliable_due[NET_EMU_CHANNELS];
+    struct random_t rand;
+};
+
+// Services that have not destroyed their host yet
+static SDL_atomic_t live_services;
+
+static net_emu emu_config[NET_EMU_CHANNELS];
+static SDL_SpinLock emu_lock;
+static SDL_atomic_t emu_active; // Set if any channel has conditions
+static SDL_atomic_t emu_seed;
+
+static int net_emu_enabled(const net_emu *emu) {
+    return emu->latency > 0 || emu->jitter > 0 || emu->loss > 0 || emu->dup > 0 || emu->reorder > 0;
+}
+
+// Copies the conditions for the service thread. Returns 0 if there are none.
+static int net_emu_snapshot(net_emu *emu) {
+    if(!SDL_AtomicGet(&emu_active)) {
+        return 0;
+    }
+    SDL_AtomicLock(&emu_lock);
+    memcpy(emu, emu_config, sizeof(emu_config));
+    SDL_AtomicUnlock(&emu_lock);
+    return 1;
+}
+
+static int net_emu_roll(net_service *ns, int percent) {
+    return percent > 0 && (int)random_int(&ns->rand, 100) < percent;
+}
+
+static void net_service_enet_send(net_send *send) {
+    if(enet_peer_send(send->peer, send->channel, send->packet) < 0) {
+        // enet only takes ownership of packets it managed to queue
+        enet_packet_destroy(send->packet);
+    }
+}
+
+static void net_service_delay(net_service *ns, const net_send *send, Uint32 due) {
+    if(ns->delayed_count == ns->delayed_cap) {
+        ns->delayed_cap = (ns->delayed_cap == 0) ? 64 : ns->delayed_cap * 2;
+        ns->delayed = mem_realloc(MEM_TAG_NET, ns->delayed, sizeof(net_delayed) * ns->delayed_cap);
+    }
+    ns->delayed[ns->delayed_count].due = due;
+    ns->delayed[ns->delayed_count].send = *send;
+    ns->delayed_count++;
+}
+
+static void net_service_emulate(net_service *ns, net_send *send, const net_emu *emu, Uint32 now) {
+    int reliable = send->packet->flags & ENET_PACKET_FLAG_RELIABLE;
+    int delay = emu->latency;
+    if(emu->jitter > 0) {
+        delay += (int)random_int(&ns->rand, emu->jitter * 2 + 1) - emu->jitter;
+    }
+    if(net_emu_roll(ns, emu->reorder)) {
+        int extra = emu->latency + emu->jitter;
+        delay += (extra > NET_EMU_REORDER_MIN_MS) ? extra : NET_EMU_REORDER_MIN_MS;
+    }
+    if(delay < 0) {
+        delay = 0;
+    }
+    if(net_emu_roll(ns, emu->loss)) {
+        if(!reliable) {
+            enet_packet_destroy(send->packet);
+            return;
+        }
+        delay += emu->latency * 2 + NET_EMU_RESEND_MS;
+    }
+
+    Uint32 due = now + delay;
+    if(reliable) {
+        // enet hands these over in order, so the ones behind a late one wait for it
+        if(SDL_TICKS_PASSED(ns->reliable_due[send->channel], due)) {
+            due = ns->reliable_due[send->channel];
+        }
+        ns->reliable_due[send->channel] = due;
+    } else if(net_emu_roll(ns, emu->dup)) {
+        enet_uint32 flags = send->packet->flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED);
+        net_send copy = *send;
+        copy.packet = enet_packet_create(send->packet->data, send->packet->dataLength, flags);
+        net_service_delay(ns, &copy, due + random_int(&ns->rand, emu->jitter + 1));
+    }
+    net_service_delay(ns, send, due);
+}
+
+// Sends what is due, in the order it was queued. Returns how many went out.
+static int net_service_release_delayed(net_service *ns, Uint32 now, int all) {
+    unsigned int kept = 0;
+    int released = 0;
+    for(unsigned int i = 0; i < ns->delayed_count; i++) {
+        if(all || SDL_TICKS_PASSED(now, ns->delayed[i].due)) {
+            net_service_enet_send(&ns->delayed[i].send);
+            released++;
+        } else {
+            ns->delayed[kept++] = ns->delayed[i];
+        }
+    }
+    ns->delayed_count = kept;
+    return released;
+}
+
+static void net_service_flush_sends(net_service *ns) {
+    net_send send;
+    net_emu emu[NET_EMU_CHANNELS];
+    Uint32 now = SDL_GetTicks();
+    int emulate = net_emu_snapshot(emu);
+    int released = net_service_release_delayed(ns, now, 0);
+    unsigned int published = SDL_AtomicGet(&ns->published);
+    if(ns->sent == published) {
+        if(released > 0) {
+            enet_host_flush(ns->host);
+        }
+        return;
+    }
+    while(ns->sent != published && ring_pop(&ns->outgoing, &send) == 0) {
+        ns->sent++;
+        if(emulate && send.channel < NET_EMU_CHANNELS && net_emu_enabled(&emu[send.channel])) {
+            net_service_emulate(ns, &send, &emu[send.channel], now);
+        } else {
+            net_service_enet_send(&send);
+        }
+    }
+    // Whatever was not held back goes out right away
+    net_service_release_delayed(ns, now, 0);
+
+    // One datagram per peer for the whole batch
+    enet_host_flush(ns->host);
+}
+
+static void net_service_destroy_event(ENetEvent *event) {
+    if(event->type == ENET_EVENT_TYPE_RECEIVE) {
+        enet_packet_destroy(event->packet);
+    }
+}
+
+static void net_service_linger(net_service *ns) {
+    ENetEvent event;
+    int connected = 0;
+    for(size_t i = 0; i < ns->host->peerCount; i++) {
+        ENetPeer *peer = &ns->host->peers[i];
+        if(peer->state == ENET_PEER_STATE_CONNECTED) {
+            connected++;
+        }
+        if(peer->state != ENET_PEER_STATE_DISCONNECTED) {
+            enet_peer_disconnect(peer, 0);
+        }
+    }
+    Uint32 deadline = SDL_GetTicks() + NET_SERVICE_LINGER_MS;
+    while(connected > 0 && !SDL_TICKS_PASSED(SDL_GetTicks(), deadline)) {
+        if(enet_host_service(ns->host, &event, 10) > 0) {
+            if(event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                DEBUG("got disconnect notice");
+                connected--;
+            }
+            net_service_destroy_event(&event);
+        }
+    }
+}
+
+static int net_service_thread(void *arg) {
+    thread_sched_apply(THREAD_ROLE_NET);
+    net_service *ns = arg;
+    ENetEvent event;
+    int has_event = 0;
+
+    while(!SDL_AtomicGet(&ns->closing)) {
+        net_service_flush_sends(ns);
+
+        // Hold on to an event the game thread has no room for yet
+        if(has_event) {
+            if(ring_push(&ns->incoming, &event)) {
+                SDL_Delay(1);
+                continue;
+            }
+            has_event = 0;
+        }
+
+        // Wait a little for the first event, then take whatever else arrived
+        int timeout = NET_SERVICE_INTERVAL_MS;
+        int ret;
+        while((ret = enet_host_service(ns->host, &event, timeout)) > 0) {
+            timeout = 0;
+            if(ring_push(&ns->incoming, &event)) {
+                has_event = 1;
+                break;
+            }
+        }
+        if(ret < 0) {
+            PERROR("Servicing the network host failed");
+            SDL_Delay(1);
+        }
+    }
+
+    // The game thread is done with the queues, whatever it queued still goes out
+    net_service_flush_sends(ns);
+    net_service_release_delayed(ns, 0, 1);
+    enet_host_flush(ns->host);
+    if(has_event) {
+        net_service_destroy_event(&event);
+    }
+    while(ring_pop(&ns->incoming, &event) == 0) {
+        net_service_destroy_event(&event);
+    }
+    net_service_linger(ns);
+
+    enet_host_destroy(ns->host);
+    ring_free(&ns->outgoing);
+    ring_free(&ns->incoming);
+    mem_free(ns->delayed);
+    free(ns);
+    SDL_AtomicAdd(&live_services, -1);
+    return 0;
+}
+
+net_service* net_service_create(ENetHost *host) {
+    net_service *ns = malloc(sizeof(net_service));
+    ns->host = host;
+    ring_create(&ns->outgoing, sizeof(net_send), NET_SERVICE_QUEUE_SIZE);
+    ring_create(&ns->incoming, sizeof(ENetEvent), NET_SERVICE_QUEUE_SIZE);
+    SDL_AtomicSet(&ns->closing, 0);
+    ns->queued = 0;
+    SDL_AtomicSet(&ns->published, 0);
+    ns->sent = 0;
+    ns->delayed = NULL;
+    ns->delayed_count = 0;
+    ns->delayed_cap = 0;
+    memset(ns->reliable_due, 0, sizeof(ns->reliable_due));
+    random_seed(&ns->rand, NET_EMU_DEFAULT_SEED ^ (uint32_t)SDL_AtomicAdd(&emu_seed, 1));
+
+    SDL_AtomicAdd(&live_services, 1);
+    SDL_Thread *thread = SDL_CreateThread(net_service_thread, "net_service", ns);
+    if(thread == NULL) {
+        PERROR("Could not start the network thread: %s", SDL_GetError());
+        SDL_AtomicAdd(&live_services, -1);
+        ring_free(&ns->outgoing);
+        ring_free(&ns->incoming);
+        free(ns);
+        return NULL;
+    }
+    SDL_DetachThread(thread);
+    return ns;
+}
+
+// Returns 1 if there are no events waiting
+int net_service_poll(net_service *ns, ENetEvent *event) {
+    return ring_pop(&ns->incoming, event);
+}
+
+// Takes ownership of the packet, even if it could not be queued
+int net_service_send(net_service *ns, ENetPeer *peer, int channel, ENetPacket *packet) {
+    if(ring_push(&ns->outgoing, &(net_send){peer, channel, packet})) {
+        DEBUG("network send queue is full, dropping packet");
+        enet_packet_destroy(packet);
+        return 1;
+    }
+    ns->queued++;
+    return 0;
+}
+
+// Lets the network thread send everything queued so far
+void net_service_flush(net_service *ns) {
+    SDL_AtomicSet(&ns->published, ns->queued);
+}
+
+void net_service_close(net_service *ns) {
+    net_service_flush(ns);
+    SDL_AtomicSet(&ns->closing, 1);
+}
+
+void net_service_wait_all(unsigned int timeout) {
+    Uint32 deadline = SDL_GetTicks() + timeout;
+    while(SDL_AtomicGet(&live_services) > 0 && !SDL_TICKS_PASSED(SDL_GetTicks(), deadline)) {
+        SDL_Delay(10);
+    }
+}
+
+void net_emu_set(int channel, const net_emu *emu) {
+    int active = 0;
+    SDL_AtomicLock(&emu_lock);
+    for(int i = 0; i < NET_EMU_CHANNELS; i++) {
+        if(channel < 0 || channel == i) {
+            emu_config[i] = *emu;
+        }
+        active |= net_emu_enabled(&emu_config[i]);
+    }
+    SDL_AtomicUnlock(&emu_lock);
+    SDL_AtomicSet(&emu_active, active);
+}
+
+void net_emu_get(int channel, net_emu *emu) {
+    SDL_AtomicLock(&emu_lock);
+    *emu = emu_config[(channel >= 0 && channel < NET_EMU_CHANNELS) ? channel : 0];
+    SDL_AtomicUnlock(&emu_lock);
+}
+
+void net_emu_seed(uint32_t seed) {
+    SDL_AtomicSet(&emu_seed, (int)seed);
+}
+
+int net_emu_parse(const char *spec) {
+    net_emu config[NET_EMU_CHANNELS];
+    char buf[256];
+    int channel = -1;
+    int seed = -1;
+
+    for(int i = 0; i < NET_EMU_CHANNELS; i++) {
+        net_emu_get(i, &config[i]);
+    }
+    snprintf(buf, sizeof(buf), "%s", spec);
+    size_t len = strlen(buf);
+    for(size_t i = 0; i < len; i++) {
+        if(buf[i] == ',' || buf[i] == ' ') {
+            buf[i] = '\0';
+        }
+    }
+    for(char *tok = buf; tok < buf + len; tok += strlen(tok) + 1) {
+        if(*tok == '\0') {
+            continue;
+        }
+        if(strcmp(tok, "off") == 0) {
+            memset(config, 0, sizeof(config));
+            continue;
+        }
+        char *eq = strchr(tok, '=');
+        if(eq == NULL) {
+            return 1;
+        }
+        *eq = '\0';
+        char *end;
+        long value = strtol(eq + 1, &end, 10);
+        if(*end != '\0' || value < 0) {
+            return 1;
+        }
+        if(strcmp(tok, "channel") == 0 || strcmp(tok, "ch") == 0) {
+            if(value >= NET_EMU_CHANNELS) {
+                return 1;
+            }
+            channel = value;
+            continue;
+        }
+        if(strcmp(tok, "seed") == 0) {
+            seed = value;
+            continue;
+        }
+        int is_percent = 0;
+        size_t offset;
+        if(strcmp(tok, "latency") == 0) {
+            offset = offsetof(net_emu, latency);
+        } else if(strcmp(tok, "jitter") == 0) {
+            offset = offsetof(net_emu, jitter);
+        } else if(strcmp(tok, "loss") == 0) {
+            offset = offsetof(net_emu, loss);
+            is_percent = 1;
+        } else if(strcmp(tok, "dup") == 0) {
+            offset = offsetof(net_emu, dup);
+            is_percent = 1;
+        } else if(strcmp(tok, "reorder") == 0) {
+            offset = offsetof(net_emu, reorder);
+            is_percent = 1;
+        } else {
+            return 1;
+        }
+        if(value > (is_percent ? 100 : 10000)) {
+            return 1;
+        }
+        for(int i = 0; i < NET_EMU_CHANNELS; i++) {
+            if(channel < 0 || channel == i) {
+                *(int*)((char*)&config[i] + offset) = value;
+            }
+        }
+    }
+
+    for(int i = 0; i < NET_EMU_CHANNELS; i++) {
+        net_emu_set(i, &config[i]);
+    }
+    if(seed >= 0) {
+        net_emu_seed(seed);
+    }
+    return 0;
+}
+
+void net_emu_to_str(int channel, char *buf, size_t len) {
+    net_emu emu;
+    net_emu_get(channel, &emu);
+    if(!net_emu_enabled(&emu)) {
+        snprintf(buf, len, "off");
+        return;
+    }
+    snprintf(buf, len, "latency=%d jitter=%d loss=%d dup=%d reorder=%d",
+             emu.latency, emu.jitter, emu.loss, emu.dup, emu.reorder);
+}
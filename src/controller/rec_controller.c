@@ -1,18 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
 #include "controller/rec_controller.h"
 #include "utils/log.h"
 
+// Moves of one player, sorted by tick. Playback walks through them with a
+// cursor, and only seeking needs to search.
+typedef struct rec_move_t {
+    int tick;
+    int action;
+} rec_move;
+
 typedef struct wtf_t {
     int id;
     int last_tick;
     int last_action;
     int max_tick;
-    hashmap tick_lookup;
+    rec_move *moves;
+    unsigned int move_count;
+    unsigned int cursor; // First move that has not been played yet
 } wtf;
 
+static int rec_controller_move_action(int move_action) {
+    if (move_action == SD_ACT_NONE) {
+        return ACT_STOP;
+    }
+    int action = 0;
+    if (move_action & SD_ACT_UP) {
+        action |= ACT_UP;
+    }
+    if (move_action & SD_ACT_DOWN) {
+        action |= ACT_DOWN;
+    }
+    if (move_action & SD_ACT_LEFT) {
+        action |= ACT_LEFT;
+    }
+    if (move_action & SD_ACT_RIGHT) {
+        action |= ACT_RIGHT;
+    }
+    return (action != 0) ? action : ACT_STOP;
+}
+
+// Index of the first move at or after the tick
+static unsigned int rec_controller_find(const wtf *data, int tick) {
+    unsigned int lo = 0;
+    unsigned int hi = data->move_count;
+    while(lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if(data->moves[mid].tick < tick) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 int rec_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
     wtf *data = ctrl->data;
-    sd_rec_move *move;
-    unsigned int len;
     if (ticks > data->max_tick) {
         DEBUG("closing controller");
         controller_close(ctrl, ev);
@@ -20,39 +64,30 @@ int rec_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
     }
 
     if (data->last_tick != ticks) {
-        if (hashmap_iget(&data->tick_lookup, ticks, (void**)(&move), &len) == 0) {
-            if (move->action == SD_ACT_NONE) {
+        // Ticks only go forward, unless someone went back without seeking
+        if (data->cursor > 0 && data->moves[data->cursor - 1].tick >= ticks) {
+            data->cursor = rec_controller_find(data, ticks);
+        }
+        while (data->cursor < data->move_count && data->moves[data->cursor].tick < ticks) {
+            data->cursor++;
+        }
+        if (data->cursor < data->move_count && data->moves[data->cursor].tick == ticks) {
+            int move_action = data->moves[data->cursor++].action;
+            if (move_action == SD_ACT_NONE) {
                 controller_cmd(ctrl, ACT_STOP, ev);
                 data->last_action = ACT_STOP;
             } else {
-                if (move->action & SD_ACT_PUNCH) {
+                if (move_action & SD_ACT_PUNCH) {
                     controller_cmd(ctrl, ACT_PUNCH, ev);
-                } else if (move->action & SD_ACT_KICK) {
+                } else if (move_action & SD_ACT_KICK) {
                     controller_cmd(ctrl, ACT_KICK, ev);
                 }
 
-                int action = 0;
-                if (move->action & SD_ACT_UP) {
-                    action |= ACT_UP;
-                }
-
-                if (move->action & SD_ACT_DOWN) {
-                    action |= ACT_DOWN;
-                }
-
-                if (move->action & SD_ACT_LEFT) {
-                    action |= ACT_LEFT;
-                }
-
-                if (move->action & SD_ACT_RIGHT) {
-                    action |= ACT_RIGHT;
-                }
-                if (action != 0) {
+                int action = rec_controller_move_action(move_action);
+                if (action != ACT_STOP) {
                     controller_cmd(ctrl, action, ev);
-                    data->last_action = action;
-                } else {
-                    data->last_action = ACT_STOP;
                 }
+                data->last_action = action;
             }
         } else {
             controller_cmd(ctrl, data->last_action, ev);
@@ -62,15 +97,42 @@ int rec_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
     return 0;
 }
 
+// Prepares the controller to continue playback at the start of the given tick
+void rec_controller_seek(controller *ctrl, int tick) {
+    wtf *data = ctrl->data;
+    data->last_tick = tick - 1;
+    data->cursor = rec_controller_find(data, tick);
+    data->last_action = ACT_STOP;
+    if (data->cursor > 0) {
+        data->last_action = rec_controller_move_action(data->moves[data->cursor - 1].action);
+    }
+}
+
 void rec_controller_create(controller *ctrl, int player, sd_rec_file *rec) {
     wtf *data = malloc(sizeof(wtf));
     data->last_action = ACT_STOP;
     data->last_tick = 0;
-    hashmap_create(&data->tick_lookup, 9);
+    data->cursor = 0;
+    data->move_count = 0;
+    data->moves = malloc(sizeof(rec_move) * (rec->move_count > 0 ? rec->move_count : 1));
     for(unsigned int i = 0; i < rec->move_count; i++) {
-        if (rec->moves[i].player_id == player && rec->moves[i].lookup_id == 2) {
-            hashmap_iput(&data->tick_lookup, rec->moves[i].tick, &rec->moves[i], sizeof(sd_rec_move));
+        if (rec->moves[i].player_id != player || rec->moves[i].lookup_id != 2) {
+            continue;
+        }
+        // Recordings are in tick order already, so this rarely moves anything.
+        // A later move for the same tick replaces the earlier one.
+        rec_move m = {rec->moves[i].tick, rec->moves[i].action};
+        unsigned int k = data->move_count;
+        while (k > 0 && data->moves[k - 1].tick > m.tick) {
+            k--;
         }
+        if (k > 0 && data->moves[k - 1].tick == m.tick) {
+            data->moves[k - 1] = m;
+            continue;
+        }
+        memmove(&data->moves[k + 1], &data->moves[k], sizeof(rec_move) * (data->move_count - k));
+        data->moves[k] = m;
+        data->move_count++;
     }
     data->max_tick = rec->moves[rec->move_count-1].tick;
     DEBUG("max tick is %d", data->last_tick);
@@ -78,3 +140,9 @@ void rec_controller_create(controller *ctrl, int player, sd_rec_file *rec) {
     ctrl->type = CTRL_TYPE_REC;
     ctrl->dyntick_fun = &rec_controller_tick;
 }
+
+void rec_controller_free(controller *ctrl) {
+    wtf *data = ctrl->data;
+    free(data->moves);
+    free(data);
+}
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "controller/spectator_controller.h"
+#include "game/spectate.h"
+#include "game/game_state.h"
+#include "game/common_defines.h"
+#include "game/utils/settings.h"
+
+typedef struct wtf_t {
+    game_state *gs;
+    int player;
+    int delay;
+} wtf;
+
+// Replays the broadcast inputs of the tick
+int spectator_controller_dyntick(controller *ctrl, int ticks, ctrl_event **ev) {
+    wtf *data = ctrl->data;
+    if(data->gs->spectate == NULL) {
+        return 0;
+    }
+    const spectate_tick *t = spectate_get_tick(data->gs->spectate, ticks);
+    if(t == NULL) {
+        return 0;
+    }
+    data->delay = t->delay[data->player];
+    for(int i = 0; i < t->count[data->player]; i++) {
+        controller_cmd(ctrl, t->actions[data->player][i], ev);
+    }
+    return 0;
+}
+
+// Spectators can't play, but they can leave
+int spectator_controller_tick(controller *ctrl, int ticks, ctrl_event **ev) {
+    wtf *data = ctrl->data;
+    const unsigned char *state = SDL_GetKeyboardState(NULL);
+    if(data->player == 0 && state[SDL_GetScancodeFromName(settings_snapshot()->keys.key1_escape)]) {
+        game_state_set_next(data->gs, SCENE_MENU);
+    }
+    return 0;
+}
+
+int spectator_controller_get_delay(controller *ctrl) {
+    wtf *data = ctrl->data;
+    return data->delay;
+}
+
+void spectator_controller_free(controller *ctrl) {
+    free(ctrl->data);
+}
+
+void spectator_controller_create(controller *ctrl, game_state *gs, int player) {
+    wtf *data = malloc(sizeof(wtf));
+    data->gs = gs;
+    data->player = player;
+    data->delay = 0;
+    ctrl->data = data;
+    ctrl->type = CTRL_TYPE_SPECTATOR;
+    ctrl->dyntick_fun = &spectator_controller_dyntick;
+    ctrl->tick_fun = &spectator_controller_tick;
+}
@@ -1,34 +1,163 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <signal.h> // signal()
+#include <time.h>
 #include <SDL2/SDL.h>
 #include "engine.h"
+#include "sim_thread.h"
 #include "utils/log.h"
 #include "utils/config.h"
+#include "utils/jobs.h"
+#include "utils/latency_probe.h"
+#include "utils/load_timer.h"
+#include "utils/memarena.h"
+#include "utils/memtrack.h"
+#include "utils/metrics.h"
+#include "utils/miscmath.h"
+#include "game/utils/hash_log.h"
+#include "utils/profiler.h"
+#include "utils/teardown.h"
+#include "utils/trace.h"
 #include "audio/audio.h"
 #include "audio/music.h"
 #include "resources/sounds_loader.h"
+#include "resources/preloader.h"
+#include "resources/rescache.h"
+#include "resources/bundle.h"
+#include "resources/script_cache.h"
+#include "resources/pathmanager.h"
+#include "resources/sprite.h"
 #include "video/surface.h"
 #include "video/video.h"
+#include "video/tcache.h"
+#include "video/scale_cache.h"
+#include "video/screenshot.h"
+#include "video/encoder.h"
 #include "resources/languages.h"
+#include "game/common_defines.h"
 #include "game/game_state.h"
+#include "game/game_player.h"
+#include "controller/keyboard.h"
+#include "controller/joystick.h"
+#include "controller/net_capture.h"
+#include "controller/net_controller.h"
+#include "game/objects/har.h"
 #include "game/utils/settings.h"
 #include "game/utils/ticktimer.h"
+#include "game/utils/perf_overlay.h"
+#include "game/utils/scene_stats.h"
 #include "game/gui/text_render.h"
+#include "game/gui/menu_background.h"
 #include "console/console.h"
 
 static int run = 0;
 static int start_timeout = 30;
 #ifndef STANDALONE_SERVER
-static int take_screenshot = 0;
 static int enable_screen_updates = 1;
-static char screenshot_filename[128];
 #endif
 
 void exit_handler(int s) {
     run = 0;
 }
 
-int engine_init() {
+// A loader that only parses game files, and can run while video and audio come up
+typedef struct init_job_t {
+    const char *name;
+    int (*init)();
+    void (*close)();
+    SDL_Thread *thread;
+    int failed;
+    Uint32 ms;
+} init_job;
+
+static init_job init_jobs[] = {
+    {"sounds", sounds_loader_init, sounds_loader_close, NULL, 0, 0},
+    {"language", lang_init, lang_close, NULL, 0, 0},
+    {"fonts", fonts_init, fonts_close, NULL, 0, 0},
+    {"altpals", altpals_init, altpals_close, NULL, 0, 0},
+};
+#define INIT_JOB_COUNT (int)(sizeof(init_jobs) / sizeof(init_job))
+
+static int init_job_run(void *arg) {
+    init_job *job = arg;
+    Uint32 start = SDL_GetTicks();
+    job->failed = job->init();
+    job->ms = SDL_GetTicks() - start;
+    return 0;
+}
+
+static void init_jobs_start() {
+    for(int i = 0; i < INIT_JOB_COUNT; i++) {
+        init_jobs[i].thread = SDL_CreateThread(init_job_run, init_jobs[i].name, &init_jobs[i]);
+        if(init_jobs[i].thread == NULL) {
+            init_job_run(&init_jobs[i]);
+        }
+    }
+}
+
+// Waits for the loaders. If any of them failed, closes the rest and returns 1.
+static int init_jobs_finish() {
+    int failed = 0;
+    for(int i = 0; i < INIT_JOB_COUNT; i++) {
+        if(init_jobs[i].thread != NULL) {
+            SDL_WaitThread(init_jobs[i].thread, NULL);
+            init_jobs[i].thread = NULL;
+        }
+        failed |= init_jobs[i].failed;
+    }
+    if(failed) {
+        for(int i = INIT_JOB_COUNT - 1; i >= 0; i--) {
+            if(!init_jobs[i].failed) {
+                init_jobs[i].close();
+            }
+        }
+    }
+    return failed;
+}
+
+static void init_jobs_close() {
+    for(int i = INIT_JOB_COUNT - 1; i >= 0; i--) {
+        init_jobs[i].close();
+    }
+}
+
+// Caps used in low memory mode, unless the settings ask for even less
+#define LOW_MEMORY_SPRITE_MB 8
+#define LOW_MEMORY_TEXTURE_MB 16
+#define LOW_MEMORY_TEXTURE_COPY_MB 0
+#define LOW_MEMORY_RESOURCE_MB 16
+
+static int engine_budget_mb(const settings *s, int mb, int low_memory_mb) {
+    if(s->gameplay.low_memory && (mb <= 0 || mb > low_memory_mb)) {
+        return low_memory_mb;
+    }
+    return mb;
+}
+
+// Keeps the resource cache and sprite budgets in step with the settings
+static void engine_settings_changed(const settings *s, void *userdata) {
+    int resource_mb = engine_budget_mb(s, s->gameplay.resource_cache_mb, LOW_MEMORY_RESOURCE_MB);
+    if(resource_mb > 0) {
+        rescache_set_budget(resource_mb * 1024 * 1024);
+    }
+    int sprite_mb = engine_budget_mb(s, s->gameplay.sprite_cache_mb, LOW_MEMORY_SPRITE_MB);
+    sprite_set_budget(sprite_mb > 0 ? (size_t)sprite_mb * 1024 * 1024 : 0);
+    jobs_set_active(s->gameplay.job_threads);
+#ifndef STANDALONE_SERVER
+    trace_flight_set(s->video.flight_recorder);
+    audio_set_buffers(s->sound.audio_buffers, s->sound.audio_buffer_size);
+#endif
+}
+
+int engine_init(const engine_init_flags *init_flags) {
+    Uint32 init_start = SDL_GetTicks();
+    Uint32 video_ms = 0, audio_ms = 0;
+    uint64_t init_timer = load_timer_start();
+
+    // Game files are parsed on worker threads meanwhile
+    init_jobs_start();
+
 #ifndef STANDALONE_SERVER
     settings *setting = settings_get();
 
@@ -41,9 +170,30 @@ int engine_init() {
     const char *audiosink = setting->sound.sink;
 
     // Initialize everything.
-    if(video_init(w, h, fs, vsync, scaler, scale_factor)) {
-        goto exit_0;
+    Uint32 phase_start = SDL_GetTicks();
+    uint64_t phase_timer = load_timer_start();
+    if(init_flags->null_video) {
+        if(video_init_headless()) {
+            goto exit_0;
+        }
+    } else {
+        if(video_init(w, h, fs, vsync, scaler, scale_factor)) {
+            goto exit_0;
+        }
+        int texture_mb = engine_budget_mb(setting, setting->video.texture_cache_mb, LOW_MEMORY_TEXTURE_MB);
+        if(texture_mb > 0) {
+            tcache_set_budget(texture_mb * 1024 * 1024);
+        }
+        int copy_mb = engine_budget_mb(setting, setting->video.texture_copy_mb, LOW_MEMORY_TEXTURE_COPY_MB);
+        tcache_set_copy_budget(copy_mb > 0 ? copy_mb * 1024 * 1024 : 0);
+        if(setting->video.scale_cache_mb > 0) {
+            scale_cache_open(pm_get_local_path(SCALE_CACHE_PATH), setting->video.scale_cache_mb * 1024 * 1024);
+        }
     }
+    video_ms = SDL_GetTicks() - phase_start;
+    load_timer_add(LOAD_TIME_VIDEO_INIT, phase_timer);
+    phase_start = SDL_GetTicks();
+    phase_timer = load_timer_start();
     if(!audio_is_sink_available(audiosink)) {
         const char *prev_sink = audiosink;
         audiosink = audio_get_first_sink_name();
@@ -53,66 +203,428 @@ int engine_init() {
             INFO("Could not find requested sink '%s'. Falling back to '%s'.", prev_sink, audiosink);
         }
     }
-    if(audio_init(audiosink)) {
+    if(audio_init(audiosink,
+                  setting->sound.audio_buffers,
+                  setting->sound.audio_buffer_size,
+                  setting->sound.sound_voices,
+                  setting->sound.audio_period)) {
         goto exit_1;
     }
     sound_set_volume(setting->sound.sound_vol/10.0f);
     music_set_volume(setting->sound.music_vol/10.0f);
+    audio_ms = SDL_GetTicks() - phase_start;
+    load_timer_add(LOAD_TIME_AUDIO_INIT, phase_timer);
+#else
+    // No window or audio, but scenes still need the palette state
+    if(video_init_headless()) {
+        goto exit_0;
+    }
 #endif
 
-    if(sounds_loader_init()) {
+    Uint32 wait_start = SDL_GetTicks();
+    uint64_t wait_timer = load_timer_start();
+    if(init_jobs_finish()) {
         goto exit_2;
     }
-    if(lang_init()) {
+#ifndef STANDALONE_SERVER
+    sounds_loader_set_rate(audio_get_frequency());
+#endif
+    Uint32 wait_ms = SDL_GetTicks() - wait_start;
+    load_timer_add(LOAD_TIME_GAME_FILES, wait_timer);
+    if(console_init()) {
         goto exit_3;
     }
-    if(fonts_init()) {
-        goto exit_4;
-    }
-    if(altpals_init()) {
-        goto exit_5;
-    }
-    if(console_init()) {
-        goto exit_6;
+    if(preloader_init()) {
+        goto exit_7;
     }
+    // Decoded sprites, if openomf pack has been run. Optional.
+    char bundle_path[512];
+    snprintf(bundle_path, sizeof(bundle_path), "%s%s", pm_get_local_path(RESOURCE_PATH), BUNDLE_FILE);
+    bundle_open(bundle_path);
+    perf_overlay_init();
+    // Pixels can only be dropped from sprites that still have their compressed data
+    sprite_set_lazy(settings_get()->gameplay.lazy_sprites || settings_get()->gameplay.low_memory);
+    rescache_init();
+    teardown_init();
+    engine_settings_changed(settings_snapshot(), NULL);
+    settings_add_listener(engine_settings_changed, NULL);
 
     // Return successfully
     run = 1;
     INFO("Engine initialization successful.");
+    INFO("Startup: video %u ms, audio %u ms, waited %u ms for game files",
+         video_ms, audio_ms, wait_ms);
+    for(int i = 0; i < INIT_JOB_COUNT; i++) {
+        INFO(" * %-8s %u ms", init_jobs[i].name, init_jobs[i].ms);
+    }
+    INFO("Startup: engine ready in %u ms.", SDL_GetTicks() - init_start);
+    load_timer_add(LOAD_TIME_ENGINE_INIT, init_timer);
     return 0;
 
     // If something failed, close in correct order
-exit_6:
-    altpals_close();
-exit_5:
-    fonts_close();
-exit_4:
-    lang_close();
+exit_7:
+    console_close();
 exit_3:
-    sounds_loader_close();
-
+    init_jobs_close();
 exit_2:
 #ifndef STANDALONE_SERVER
+    music_close();
     audio_close();
 #endif
+    video_close();
+    return 1;
 
-exit_1:
 #ifndef STANDALONE_SERVER
+exit_1:
     video_close();
 #endif
-
 exit_0:
+    // The loaders may still be running
+    if(!init_jobs_finish()) {
+        init_jobs_close();
+    }
     return 1;
 }
 
+static void engine_report_replay(game_state *gs, const char *rec_file) {
+    chr_score *s1 = game_player_get_score(game_state_get_player(gs, 0));
+    chr_score *s2 = game_player_get_score(game_state_get_player(gs, 1));
+    int winner = -1;
+    if(s1->rounds != s2->rounds) {
+        winner = (s1->rounds > s2->rounds) ? 0 : 1;
+    }
+    uint32_t hash = 0;
+    if(game_state_hash(gs, &hash)) {
+        PERROR("Replay of %s did not end in an arena; no state hash.", rec_file);
+    }
+    printf("REPLAY %s: winner=%d rounds=%d-%d score=%d-%d ticks=%u hash=%08x\n",
+        rec_file, winner, s1->rounds, s2->rounds, s1->score, s2->score,
+        game_state_get_tick(gs), hash);
+    fflush(stdout);
+}
+
+// Called every METRICS_INTERVAL_MS while metrics are on, see --metrics
+static void engine_report_metrics(game_state *gs, unsigned int elapsed_ms) {
+    static unsigned int last_counts[PROF_CNT_COUNT];
+    unsigned int counts[PROF_CNT_COUNT];
+    for(int i = 0; i < PROF_CNT_COUNT; i++) {
+        counts[i] = profiler_get_count(i) - last_counts[i];
+        last_counts[i] += counts[i];
+    }
+    float secs = (elapsed_ms > 0) ? elapsed_ms / 1000.0f : 1.0f;
+
+    metrics_gauge("server.ticks_per_s", counts[PROF_CNT_DYNAMIC_TICKS] / secs);
+    metrics_gauge("server.dropped_ticks", counts[PROF_CNT_DROPPED_TICKS]);
+    metrics_timing("server.tick.p50", profiler_percentile(PROF_DYNAMIC_TICK, 50.0f));
+    metrics_timing("server.tick.p99", profiler_percentile(PROF_DYNAMIC_TICK, 99.0f));
+    metrics_timing("server.frame.p99", profiler_percentile(PROF_FRAME, 99.0f));
+    metrics_gauge("server.rollbacks", counts[PROF_CNT_ROLLBACKS]);
+    metrics_gauge("server.rollback_depth",
+                  counts[PROF_CNT_ROLLBACKS] ? (float)counts[PROF_CNT_ROLLBACK_TICKS] / counts[PROF_CNT_ROLLBACKS] : 0.0f);
+
+    mem_stats mem;
+    mem_get_total(&mem);
+    metrics_gauge("server.heap.live", mem.live);
+    metrics_gauge("server.heap.peak", mem.peak);
+    metrics_gauge("server.heap.blocks", mem.count);
+
+    metrics_gauge("server.objects.hars", game_state_count_objects(gs, LAYER_HAR));
+    metrics_gauge("server.objects.projectiles", game_state_count_objects(gs, LAYER_PROJECTILE));
+    metrics_gauge("server.objects.hazards", game_state_count_objects(gs, LAYER_HAZARD));
+    metrics_gauge("server.objects.scrap", game_state_count_objects(gs, LAYER_SCRAP));
+
+    // A game has at most one remote player
+    int sessions = 0;
+    for(int i = 0; i < game_state_num_players(gs); i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+        if(ctrl == NULL || ctrl->type != CTRL_TYPE_NETWORK) {
+            continue;
+        }
+        const net_stats *net = net_controller_get_stats(ctrl);
+        metrics_timing("server.net.rtt", net->rtt_ms);
+        metrics_timing("server.net.jitter", net->jitter_ms);
+        metrics_gauge("server.net.loss", net->loss);
+        metrics_gauge("server.net.bytes_sent", net->bytes_sent);
+        metrics_gauge("server.net.bytes_received", net->bytes_received);
+        metrics_gauge("server.net.syncs", net->keyframes + net->deltas);
+        metrics_gauge("server.net.desyncs", net->desyncs);
+        sessions++;
+    }
+    metrics_gauge("server.sessions", sessions);
+    metrics_flush();
+}
+
+#ifndef STANDALONE_SERVER
+// While nothing animates, redraw at this interval at the latest
+#define IDLE_FRAME_MS 100
+
+// Keeps presents on a fixed cadence. Each frame is due one interval after the
+// previous one was due, not after it began, so a frame that took or slept too
+// long is made up for by the next one instead of the rate drifting.
+typedef struct frame_pacer_t {
+    int fps;
+    Uint64 interval; // Performance counter units per frame
+    Uint64 next; // When the next frame is due, 0 to start over
+} frame_pacer;
+
+static void frame_pacer_set_fps(frame_pacer *fp, int fps) {
+    if(fps != fp->fps) {
+        fp->fps = fps;
+        fp->interval = fps > 0 ? SDL_GetPerformanceFrequency() / fps : 0;
+        fp->next = 0;
+    }
+}
+
+// SDL_Delay is only accurate to a millisecond or so; the rest is yielded away.
+static void engine_wait_until(Uint64 until) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 now = SDL_GetPerformanceCounter();
+    while(now < until) {
+        Uint64 left_ms = (until - now) * 1000 / freq;
+        SDL_Delay(left_ms > 1 ? left_ms - 1 : 0);
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
+static void frame_pacer_wait(frame_pacer *fp) {
+    if(fp->interval == 0) {
+        return;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    if(fp->next == 0 || now > fp->next + fp->interval) {
+        // Too far behind to catch up without a burst of frames
+        fp->next = now;
+    }
+    engine_wait_until(fp->next);
+    fp->next += fp->interval;
+}
+
+// Frames whose cost the frame delay is planned from
+#define FRAME_DELAY_HISTORY 32
+// Least time kept free before the vblank
+#define FRAME_DELAY_MIN_MARGIN_MS 2
+// Frames without a miss before the margin is narrowed again
+#define FRAME_DELAY_CALM_FRAMES 300
+
+// With vsync, the present blocks until the vblank, so input read right after
+// it is most of a refresh old by the time the frame is shown. The frame delay
+// waits after the present for as long as recent frames say can be spared,
+// and only then reads input, ticks and draws. The margin left before the
+// vblank grows by a millisecond whenever a frame misses it, and slowly
+// shrinks back while none do.
+typedef struct frame_delay_t {
+    Uint64 present; // When the last present returned, 0 if unknown
+    Uint64 work_start; // When the ongoing frame was done waiting
+    float cost[FRAME_DELAY_HISTORY]; // Ms from the end of the wait to the present
+    int head;
+    int margin_ms;
+    int calm_frames;
+    int delayed; // Whether the ongoing frame was delayed
+} frame_delay;
+
+static void frame_delay_reset(frame_delay *fd) {
+    memset(fd, 0, sizeof(frame_delay));
+    fd->margin_ms = FRAME_DELAY_MIN_MARGIN_MS;
+}
+
+static void frame_delay_wait(frame_delay *fd, int refresh_rate) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    fd->delayed = 0;
+    if(fd->present != 0 && refresh_rate > 0) {
+        float worst = 0.0f;
+        for(int i = 0; i < FRAME_DELAY_HISTORY; i++) {
+            if(fd->cost[i] > worst) {
+                worst = fd->cost[i];
+            }
+        }
+        float delay_ms = 1000.0f / refresh_rate - worst - fd->margin_ms;
+        if(delay_ms >= 1.0f) {
+            Uint64 until = fd->present + (Uint64)(delay_ms * freq / 1000.0f);
+            // Already late if the last frame was not presented
+            fd->delayed = (SDL_GetPerformanceCounter() < until);
+            engine_wait_until(until);
+        }
+    }
+    fd->work_start = SDL_GetPerformanceCounter();
+}
+
+// Called with the time the frame went to be presented, and after the present
+static void frame_delay_presented(frame_delay *fd, Uint64 submit, int refresh_rate) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 now = SDL_GetPerformanceCounter();
+    fd->cost[fd->head] = (float)(submit - fd->work_start) * 1000.0f / freq;
+    fd->head = (fd->head + 1) % FRAME_DELAY_HISTORY;
+    if(fd->delayed && refresh_rate > 0 && (now - fd->present) * refresh_rate * 2 > freq * 3) {
+        // Went past the vblank it was aiming for
+        fd->margin_ms = min2(fd->margin_ms + 1, 500 / refresh_rate);
+        fd->calm_frames = 0;
+    } else if(++fd->calm_frames >= FRAME_DELAY_CALM_FRAMES) {
+        fd->margin_ms = max2(fd->margin_ms - 1, FRAME_DELAY_MIN_MARGIN_MS);
+        fd->calm_frames = 0;
+    }
+    fd->present = now;
+}
+
+// The frame rate to pace to, 0 for none. A variable refresh rate display
+// without vsync shows frames as they come, so presenting at its top rate
+// keeps them evenly spaced without waiting on vsync.
+static int engine_pace_fps() {
+    const settings_video *v = &settings_get()->video;
+    if(v->fps_cap > 0) {
+        return v->fps_cap;
+    }
+    if(v->vrr && !v->vsync) {
+        return video_get_refresh_rate();
+    }
+    return 0;
+}
+
+// Slow frame traces from the flight recorder: at most one every
+// HITCH_DUMP_INTERVAL_MS, and only so many per run
+#define HITCH_DUMP_INTERVAL_MS 30000
+#define HITCH_MAX_DUMPS 10
+
+typedef struct hitch_dumps_t {
+    Uint32 last;
+    int count;
+} hitch_dumps;
+
+// Writes the flight recorder out if the frame just presented came much later
+// than it should have
+static void engine_check_hitch(hitch_dumps *hd) {
+    const settings_video *v = &settings_get()->video;
+    float limit_ms = v->flight_recorder_ms;
+    if(limit_ms <= 0) {
+        int fps = engine_pace_fps();
+        if(fps <= 0) {
+            fps = v->vsync ? video_get_refresh_rate() : 0;
+        }
+        limit_ms = 2000.0f / (fps > 0 ? fps : 60);
+    }
+    float gap_ms = profiler_get_ms(PROF_PRESENT_GAP, 0);
+    Uint32 now = SDL_GetTicks();
+    if(gap_ms <= limit_ms || hd->count >= HITCH_MAX_DUMPS
+       || (hd->count > 0 && !SDL_TICKS_PASSED(now, hd->last + HITCH_DUMP_INTERVAL_MS))) {
+        return;
+    }
+    char stamp[32];
+    time_t t = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&t));
+    char *dir = pm_get_local_base_dir();
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%shitch_%s.json", dir != NULL ? dir : "", stamp);
+    free(dir);
+    if(trace_flight_dump(filename) == 0) {
+        INFO("Frame took %.1f ms (limit %.1f ms), tracing it to %s.", gap_ms, limit_ms, filename);
+        hd->last = now;
+        hd->count++;
+    }
+}
+#endif
+
+#define LOAD_BENCH_ARENAS (SCENE_ARENA4 - SCENE_ARENA0 + 1)
+
+static float engine_ms_since(Uint64 start) {
+    return (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+// Draws and presents one frame of whatever scene is up
+static void engine_load_bench_frame(game_state *gs) {
+#ifndef STANDALONE_SERVER
+    uint64_t start = load_timer_start();
+    video_render_prepare();
+    game_state_render(gs);
+    video_render_submit();
+    video_render_present();
+    load_timer_add(LOAD_TIME_FRAME, start);
+#endif
+}
+
+static void engine_load_bench_phases(FILE *fp, int first, int last) {
+    fprintf(fp, "{");
+    for(int i = first; i <= last; i++) {
+        load_time t;
+        load_timer_get(i, &t);
+        fprintf(fp, "%s\"%s\":{\"count\":%u,\"total_ms\":%.3f,\"max_ms\":%.3f}",
+                i > first ? "," : "", load_timer_name(i), t.count, t.total_ms, t.max_ms);
+    }
+    fprintf(fp, "}");
+}
+
+// Loads every arena and every HAR, once into empty caches and once more into
+// warm ones, and writes where the time went. See --load-benchmark.
+static int engine_load_bench(game_state *gs, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) {
+        PERROR("Could not open %s for writing.", path);
+        return 1;
+    }
+
+    // Startup is only timed once, so it is written before the passes reset the timers
+    Uint64 start = SDL_GetPerformanceCounter();
+    if(game_load_new(gs, SCENE_MENU)) {
+        fclose(fp);
+        return 1;
+    }
+    engine_load_bench_frame(gs);
+    float menu_ms = engine_ms_since(start);
+    fprintf(fp, "{\"startup\":{\"first_frame_ms\":%.3f,\"menu_ms\":%.3f,\"phases\":",
+            load_timer_elapsed_ms(), menu_ms);
+    engine_load_bench_phases(fp, LOAD_TIME_PLUGINS, LOAD_TIME_ENGINE_INIT);
+    fprintf(fp, ",\"init_jobs\":{");
+    for(int i = 0; i < INIT_JOB_COUNT; i++) {
+        fprintf(fp, "%s\"%s\":%u", i > 0 ? "," : "", init_jobs[i].name, init_jobs[i].ms);
+    }
+    fprintf(fp, "}},\n\"passes\":[");
+
+    game_state_init_demo(gs);
+    const char *pass_names[] = {"cold", "warm"};
+    int failed = 0;
+    for(int pass = 0; pass < 2 && !failed; pass++) {
+        load_timer_reset();
+        Uint64 pass_start = SDL_GetPerformanceCounter();
+        fprintf(fp, "%s\n{\"pass\":\"%s\",\"loads\":[", pass > 0 ? "," : "", pass_names[pass]);
+        for(int i = 0; i < NUMBER_OF_HAR_TYPES; i++) {
+            int scene_id = SCENE_ARENA0 + i % LOAD_BENCH_ARENAS;
+            game_state_get_player(gs, 0)->har_id = HAR_JAGUAR + i;
+            game_state_get_player(gs, 1)->har_id = HAR_JAGUAR + (i + 1) % NUMBER_OF_HAR_TYPES;
+            start = SDL_GetPerformanceCounter();
+            if(game_load_new(gs, scene_id)) {
+                failed = 1;
+                break;
+            }
+            engine_load_bench_frame(gs);
+            fprintf(fp, "%s{\"scene\":%d,\"hars\":[\"%s\",\"%s\"],\"ms\":%.3f}",
+                    i > 0 ? "," : "", scene_id,
+                    har_get_name(game_state_get_player(gs, 0)->har_id),
+                    har_get_name(game_state_get_player(gs, 1)->har_id),
+                    engine_ms_since(start));
+        }
+        fprintf(fp, "],\"total_ms\":%.3f,\"phases\":", engine_ms_since(pass_start));
+        engine_load_bench_phases(fp, LOAD_TIME_SCENE, LOAD_TIME_FRAME);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "]}\n");
+    if(fclose(fp) != 0) {
+        PERROR("Could not write %s.", path);
+        failed = 1;
+    }
+    if(!failed) {
+        INFO("Load benchmark written to %s.", path);
+    }
+    return failed;
+}
+
 void engine_run(engine_init_flags *init_flags) {
-    SDL_Event e;
     int visual_debugger = 0;
     int debugger_proceed = 0;
+#ifndef STANDALONE_SERVER
+    SDL_Event e;
     int debugger_render = 0;
 
     //if mouse_visible_ticks <= 0, hide mouse
     int mouse_visible_ticks = 1000;
+#endif
 
     INFO(" --- BEGIN GAME LOG ---");
 
@@ -149,17 +661,115 @@ void engine_run(engine_init_flags *init_flags) {
     if(game_state_create(gs, init_flags)) {
         return;
     }
+    if(strlen(init_flags->hash_file) > 0) {
+        gs->hashes = hash_log_open(init_flags->hash_file, init_flags->hash_mode, init_flags->dump_tick);
+        if(gs->hashes == NULL) {
+            init_flags->check_failed = 1;
+            gs->run = 0;
+        }
+    }
+    if(strlen(init_flags->exec_file) > 0) {
+        console_exec_file(init_flags->exec_file);
+    }
+    if(strlen(init_flags->load_bench) > 0) {
+        init_flags->check_failed |= engine_load_bench(gs, init_flags->load_bench);
+        gs->run = 0;
+    }
+    if(init_flags->benchmark) {
+        if(settings_get()->video.vsync) {
+            PERROR("Vsync is on, frame times will be capped by the display refresh rate.");
+        }
+        profiler_capture_start();
+    }
+#ifndef STANDALONE_SERVER
+    // Encoding a recording waits on the encoder instead of dropping frames,
+    // and follows the game's clock rather than the wall clock
+    unsigned int encode_clock = 0;
+    if(init_flags->benchmark && strlen(init_flags->encode_cmd) > 0) {
+        encoder_options opts;
+        memset(&opts, 0, sizeof(opts));
+        opts.command = init_flags->encode_cmd;
+        opts.fps = ENCODER_DEFAULT_FPS;
+        opts.wait = 1;
+        if(encoder_start(&opts)) {
+            game_state_free(gs);
+            free(gs);
+            return;
+        }
+    }
+#endif
 
-    // Game loop
+    // Game loop. Time is measured with the performance counter; whatever is
+    // short of a whole millisecond is carried over to the next frame.
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 dt_start = SDL_GetPerformanceCounter();
+    Uint64 dt_carry = 0;
     int frame_start = SDL_GetTicks();
     int dynamic_wait = 0;
     int static_wait = 0;
+#ifndef STANDALONE_SERVER
+    int sim_thread_failed = 0;
+    int pacing = !init_flags->fast_sim && !init_flags->benchmark;
+    Uint64 last_render = 0;
+    int skipped_frames = 0;
+    frame_pacer pacer;
+    memset(&pacer, 0, sizeof(pacer));
+    frame_delay delay;
+    frame_delay_reset(&delay);
+    int delaying = 0;
+    hitch_dumps hitches;
+    memset(&hitches, 0, sizeof(hitches));
+    int was_idle = 1;
+#endif
+    Uint32 last_metrics = SDL_GetTicks();
     while(run && game_state_is_running(gs)) {
+        memarena_frame_reset();
+        profiler_begin(PROF_FRAME);
+        jobs_run_main();
+#ifndef STANDALONE_SERVER
+        int had_events = 0;
+#endif
 
+        // While the simulation thread runs, the game state is only ticked there
+        int threaded = 0;
 #ifndef STANDALONE_SERVER
+        // Followed every frame, so it can be switched from the console mid-fight
+        int use_sim_thread = settings_snapshot()->gameplay.sim_thread && !init_flags->benchmark && !sim_thread_failed;
+        if(sim_thread_is_started() && (!sim_thread_is_ticking() || visual_debugger || !use_sim_thread)) {
+            // It stops on its own for scene changes; carry on ticking here
+            sim_thread_stop();
+            dt_start = SDL_GetPerformanceCounter();
+            dt_carry = 0;
+            frame_start = SDL_GetTicks();
+            dynamic_wait = 0;
+            static_wait = 0;
+        } else if(use_sim_thread && !sim_thread_is_started() && !visual_debugger && sim_thread_can_run(gs)) {
+            if(sim_thread_start(gs)) {
+                sim_thread_failed = 1;
+            }
+        }
+        threaded = sim_thread_is_started();
+
+        // Only worth it when the present waits on vsync and the input is read here
+        int refresh_rate = 0;
+        if(pacing && settings_get()->video.frame_delay && settings_get()->video.vsync && !threaded && !visual_debugger) {
+            refresh_rate = video_get_refresh_rate();
+        }
+        if(refresh_rate > 0) {
+            profiler_begin(PROF_FRAME_DELAY);
+            frame_delay_wait(&delay, refresh_rate);
+            profiler_end(PROF_FRAME_DELAY);
+            delaying = 1;
+        } else if(delaying) {
+            frame_delay_reset(&delay);
+            delaying = 0;
+        }
+
         // Handle events
+        profiler_begin(PROF_EVENTS);
         int check_fs;
         while(SDL_PollEvent(&e)) {
+            had_events = 1;
             // Handle other events
             switch(e.type) {
                 case SDL_QUIT:
@@ -167,7 +777,7 @@ void engine_run(engine_init_flags *init_flags) {
                     break;
                 case SDL_KEYDOWN:
                     if(e.key.keysym.sym == SDLK_F1) {
-                        take_screenshot = 1;
+                        screenshot_request();
                     }
                     if(e.key.keysym.sym == SDLK_F5) {
                         visual_debugger = !visual_debugger;
@@ -178,6 +788,9 @@ void engine_run(engine_init_flags *init_flags) {
                     if(e.key.keysym.sym == SDLK_F6) {
                         debugger_render = !debugger_render;
                     }
+                    if(e.key.keysym.sym == SDLK_F7) {
+                        perf_overlay_toggle();
+                    }
                     break;
                 case SDL_MOUSEMOTION:
                     mouse_visible_ticks = 1000;
@@ -231,12 +844,18 @@ void engine_run(engine_init_flags *init_flags) {
 
             // If console windows is open, pass events to console.
             // Otherwise to the objects.
+            sim_thread_lock();
+            if(e.type == SDL_JOYDEVICEADDED || e.type == SDL_JOYDEVICEREMOVED) {
+                joystick_device_event(&e);
+            }
             if(console_window_is_open()) {
                 console_event(gs, &e);
             } else {
                 game_state_handle_event(gs, &e);
             }
+            sim_thread_unlock();
         }
+        profiler_end(PROF_EVENTS);
 
         // hide mouse after n ticks
         if(mouse_visible_ticks > 0) {
@@ -247,11 +866,26 @@ void engine_run(engine_init_flags *init_flags) {
         }
 #endif
         // Tick controllers
-        game_state_tick_controllers(gs);
+        if(!threaded) {
+            game_state_tick_controllers(gs);
+        }
+
+        // Scripted console commands go between ticks
+        sim_thread_lock();
+        console_script_tick(gs);
+        sim_thread_unlock();
 
         // Render scene
-        int dt = (SDL_GetTicks() - frame_start);
+        Uint64 dt_now = SDL_GetPerformanceCounter();
+        Uint64 elapsed = dt_now - dt_start + dt_carry;
+        int dt = elapsed * 1000 / freq;
+        dt_carry = elapsed - (Uint64)dt * freq / 1000;
+        dt_start = dt_now;
         frame_start = SDL_GetTicks(); // Reset timer
+        // Run exactly one dynamic tick per loop, no matter how long it took
+        if(init_flags->fast_sim || init_flags->benchmark) {
+            dt = game_state_ms_per_dyntick(gs) + 1 - dynamic_wait;
+        }
         if(!visual_debugger) {
             dynamic_wait += dt;
             static_wait += dt;
@@ -260,9 +894,20 @@ void engine_run(engine_init_flags *init_flags) {
             static_wait += 20;
             debugger_proceed = 0;
         }
+        // Don't try to make up for more than a few ticks worth of time
+        int max_ticks = settings_get()->gameplay.max_catchup_ticks;
+        if(max_ticks > 0 && static_wait > 10 * max_ticks) {
+            static_wait = 10 * max_ticks;
+        }
+        if(!threaded) {
+            profiler_count(PROF_CNT_DROPPED_TICKS, game_state_limit_backlog(gs, &dynamic_wait, max_ticks));
+        }
         while(static_wait > 10) {
             // Static tick for gamestate
-            game_state_static_tick(gs);
+            profiler_begin(PROF_STATIC_TICK);
+            if(!threaded) {
+                game_state_static_tick(gs);
+            }
 
             // Tick console
             console_tick();
@@ -270,62 +915,185 @@ void engine_run(engine_init_flags *init_flags) {
             // Tick video (tcache)
             video_tick();
 
+            // Drop decoded sprites that haven't been used in a while
+            sim_thread_lock();
+            sprite_tick();
+            scene_stats_tick(gs);
+            sim_thread_unlock();
+            profiler_end(PROF_STATIC_TICK);
+
             static_wait -= 10;
         }
-        while(dynamic_wait > game_state_ms_per_dyntick(gs)) {
-            // Tick scene
+        int ticks = 0;
+        while(!threaded && dynamic_wait > game_state_ms_per_dyntick(gs) && (max_ticks <= 0 || ticks < max_ticks)) {
+            // Tick scene. Inputs are matched to the tick by when it was due,
+            // not by when the loop got around to running it.
+            profiler_begin(PROF_DYNAMIC_TICK);
+            controller_set_tick_time(frame_start - (dynamic_wait - game_state_ms_per_dyntick(gs)));
             game_state_dynamic_tick(gs);
+            profiler_end(PROF_DYNAMIC_TICK);
 
             // Handle waiting period leftover time
             dynamic_wait -= game_state_ms_per_dyntick(gs);
+            ticks++;
         }
+        profiler_count(PROF_CNT_DYNAMIC_TICKS, ticks);
+#ifndef STANDALONE_SERVER
+        encode_clock += ticks * game_state_ms_per_dyntick(gs);
+#endif
 
 #ifndef STANDALONE_SERVER
         // Handle audio
         if(!visual_debugger) {
+            profiler_begin(PROF_AUDIO);
             audio_render();
+            profiler_end(PROF_AUDIO);
+        }
+
+        // Scenes where nothing moves only need a redraw when something happens
+        int idle = 0;
+        if(pacing && settings_get()->video.idle_wait && !visual_debugger && !console_window_is_open() &&
+           !perf_overlay_is_visible()) {
+            sim_thread_lock();
+            idle = game_state_is_idle(gs);
+            sim_thread_unlock();
+        }
+        Uint64 now = SDL_GetPerformanceCounter();
+        int skip_render =
+            idle && !had_events && now - last_render < SDL_GetPerformanceFrequency() * IDLE_FRAME_MS / 1000;
+
+        // Still a tick or more behind; drawing can wait, the simulation can't.
+        // Every few frames one is drawn anyway so the screen doesn't freeze.
+        if(!skip_render && pacing && !threaded && dynamic_wait > game_state_ms_per_dyntick(gs)
+           && skipped_frames < settings_get()->video.frame_skip) {
+            skip_render = 1;
+            skipped_frames++;
+            profiler_count(PROF_CNT_SKIPPED_FRAMES, 1);
+        } else if(!skip_render) {
+            skipped_frames = 0;
         }
 
         // Do the actual video rendering jobs
-        if(enable_screen_updates) {
+        if(enable_screen_updates && !skip_render) {
+            last_render = now;
 
+            sim_thread_lock();
+            profiler_begin(PROF_RENDER);
+            // Objects can be drawn part way into the tick that is underway,
+            // which smooths motion when frames outnumber ticks
+            float alpha = 1.0f;
+            if(pacing && !threaded && !visual_debugger && settings_get()->video.interpolate) {
+                alpha = (float)dynamic_wait / game_state_ms_per_dyntick(gs);
+            }
+            game_state_set_render_alpha(gs, alpha);
+            game_state_run_ahead(gs, settings_get()->gameplay.run_ahead);
             video_render_prepare();
             game_state_render(gs);
+            latency_probe_rendered();
             if(debugger_render) {
                 game_state_debug(gs);
             }
+            profiler_end(PROF_RENDER);
+            profiler_begin(PROF_CONSOLE);
             console_render();
-            video_render_finish();
-
-            // If screenshot requested, do it here.
-            if(take_screenshot) {
-                image img;
-                video_screenshot(&img);
-                int scr_ret = 0;
-                if(image_supports_png()) {
-                    sprintf(screenshot_filename, "screenshot_%u.png", SDL_GetTicks());
-                    scr_ret = image_write_png(&img, screenshot_filename);
-                } else {
-                    sprintf(screenshot_filename, "screenshot_%u.tga", SDL_GetTicks());
-                    scr_ret= image_write_tga(&img, screenshot_filename);
-                }
-                if(scr_ret) {
-                    PERROR("Screenshot write operation failed (%s)", screenshot_filename);
-                }
+            perf_overlay_render(gs);
+            profiler_end(PROF_CONSOLE);
+            // Presenting may block on vsync, so the game state is let go before that
+            profiler_begin(PROF_PRESENT);
+            video_render_submit();
+            sim_thread_unlock();
+            // The back buffer is only defined until it is presented
+            screenshot_capture();
+            encoder_capture(init_flags->benchmark ? encode_clock : SDL_GetTicks());
+            Uint64 submit = SDL_GetPerformanceCounter();
+            video_render_present();
+            latency_probe_presented();
+            if(delaying) {
+                frame_delay_presented(&delay, submit, refresh_rate);
+            }
+            profiler_end(PROF_PRESENT);
 
-                image_free(&img);
-                take_screenshot = 0;
+            // Presenting may have waited for a while. The simulation thread ticks
+            // on its own, so hand it whatever input came in meanwhile.
+            if(threaded) {
+                SDL_PumpEvents();
             }
-        } else {
+
+        } else if(!enable_screen_updates) {
             // If screen updates are disabled, then wait
             SDL_Delay(1);
         }
+
+        // Whatever the last scene change left to free. Freeing sprites
+        // touches the sprite LRU, which the sim thread uses too.
+        sim_thread_lock();
+        teardown_run(TEARDOWN_FRAME_US);
+        sim_thread_unlock();
+
+        if(idle) {
+            // Without the audio thread, audio_render has to keep the buffers filled
+            SDL_WaitEventTimeout(NULL, audio_is_threaded() ? 50 : 10);
+        } else if(pacing) {
+            frame_pacer_set_fps(&pacer, engine_pace_fps());
+            frame_pacer_wait(&pacer);
+        }
 #else
-        // In standalone, just wait.
-        SDL_Delay(1);
+        teardown_run(TEARDOWN_FRAME_US);
+
+        // In standalone, sleep until the next tick is due
+        if(!init_flags->fast_sim) {
+            int wait = game_state_ms_per_dyntick(gs) - dynamic_wait;
+            if(10 - static_wait < wait) {
+                wait = 10 - static_wait;
+            }
+            SDL_Delay(wait > 0 ? wait + 1 : 1);
+        }
 #endif // STANDALONE_SERVER
+        profiler_end(PROF_FRAME);
+        profiler_frame_end();
+#ifndef STANDALONE_SERVER
+        // Frames that follow waiting for input are late on purpose
+        if(pacing && !idle && !was_idle && trace_flight_is_on()) {
+            engine_check_hitch(&hitches);
+        }
+        was_idle = idle;
+#endif
+
+        if(metrics_is_active() && SDL_TICKS_PASSED(SDL_GetTicks(), last_metrics + METRICS_INTERVAL_MS)) {
+            Uint32 now_ms = SDL_GetTicks();
+            sim_thread_lock();
+            engine_report_metrics(gs, now_ms - last_metrics);
+            sim_thread_unlock();
+            last_metrics = now_ms;
+        }
     }
 
+#ifndef STANDALONE_SERVER
+    sim_thread_stop();
+    encoder_stop();
+#endif
+
+    // Recordings are used for regression runs, so report how the match ended
+    if(strlen(init_flags->rec_file) > 0 && !init_flags->record) {
+        engine_report_replay(gs, init_flags->rec_file);
+    }
+    if(init_flags->benchmark) {
+        printf("BENCHMARK %s: ", init_flags->rec_file);
+        profiler_capture_report(stdout);
+    }
+    if(init_flags->alloc_check) {
+        // Regression runs look for this line, see --alloc-check
+        printf("ALLOCS %s: %u\n", strlen(init_flags->rec_file) > 0 ? init_flags->rec_file : "-", mem_guard_count());
+        if(mem_guard_count() > 0) {
+            PERROR("%u heap allocations in steady state ticks and frames.", mem_guard_count());
+        }
+    }
+
+    if(gs->hashes != NULL && hash_log_close(gs->hashes)) {
+        init_flags->check_failed = 1;
+    }
+    gs->hashes = NULL;
+
     // Free scene object
     game_state_free(gs);
     free(gs);
@@ -334,14 +1102,26 @@ void engine_run(engine_init_flags *init_flags) {
 }
 
 void engine_close() {
+    settings_remove_listener(engine_settings_changed, NULL);
+    rescache_close();
+    teardown_close();
+    preloader_close();
+    scale_cache_close();
+    memarena_close();
+    perf_overlay_close();
     console_close();
-    altpals_close();
-    fonts_close();
-    lang_close();
-    sounds_loader_close();
+    menu_background_cache_clear();
+    script_cache_clear();
+    text_cache_close();
+    // Sprites from the bundle point into it, so it goes after everything that has them
+    bundle_close();
+    init_jobs_close();
 #ifndef STANDALONE_SERVER
+    music_close();
     audio_close();
-    video_close();
 #endif
+    video_close();
+    net_capture_stop();
+    trace_close();
     INFO("Engine deinit successful.");
 }
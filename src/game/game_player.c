@@ -42,6 +42,10 @@ void game_player_set_ctrl(game_player *gp, controller *ctrl) {
             net_controller_free(gp->ctrl);
         } else if(gp->ctrl->type == CTRL_TYPE_AI) {
             ai_controller_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_REC) {
+            rec_controller_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_SPECTATOR) {
+            spectator_controller_free(gp->ctrl);
         }
         free(gp->ctrl);
     }
@@ -1,25 +1,46 @@
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <shadowdive/shadowdive.h>
 #include "controller/keyboard.h"
 #include "controller/joystick.h"
 #include "controller/rec_controller.h"
+#include "controller/spectator_controller.h"
+#include "game/utils/rec_index.h"
+#include "game/utils/rec_writer.h"
+#include "game/utils/state_history.h"
+#include "game/utils/scene_stats.h"
+#include "utils/load_timer.h"
 #include "utils/log.h"
 #include "utils/miscmath.h"
+#include "utils/fixedpoint.h"
+#include "utils/memarena.h"
+#include "utils/memtrack.h"
+#include "utils/profiler.h"
+#include "utils/random.h"
+#include "utils/trace.h"
 #include "game/utils/serial.h"
 #include "resources/ids.h"
 #include "resources/pilots.h"
+#include "resources/preloader.h"
+#include "resources/rescache.h"
+#include "audio/music.h"
+#include "audio/sound.h"
 #include "console/console.h"
 #include "video/video.h"
 #include "video/tcache.h"
 #include "game/game_state.h"
+#include "game/spectate.h"
 #include "game/common_defines.h"
 #include "game/utils/settings.h"
 #include "game/utils/ticktimer.h"
 #include "game/protos/scene.h"
+#include "game/gui/text_render.h"
 #include "game/protos/object.h"
 #include "game/protos/intersect.h"
+#include "game/objects/har.h"
 #include "game/scenes/intro.h"
 #include "game/scenes/mainmenu.h"
 #include "game/scenes/credits.h"
@@ -35,35 +56,143 @@
 #define MS_PER_OMF_TICK 10
 #define MS_PER_OMF_TICK_SLOWEST 60
 
+// Ticks a sync may simulate in one go. The rest is made up by running
+// ticks 1/CATCHUP_DILATION faster until the game is back on time.
+#define RESIM_MAX_TICKS 8
+#define CATCHUP_DILATION 8
+
 enum {
     TICK_DYNAMIC = 0,
     TICK_STATIC,
 };
 
 void _setup_rec_controller(game_state *gs, int player_id, sd_rec_file *rec);
+void _setup_ai_match(game_state *gs, int player_id);
 
 // How long the scene waits after order to move to another scene
 // Used for crossfades
 #define FRAME_WAIT_TICKS 30
 
+// Block size for pooled object userdata. Larger requests go to malloc.
+#define USERDATA_BLOCK_SIZE 64
+
+// Fighting ticks before --alloc-check starts reporting, leaves time for
+// first hits, first sounds and the like to settle their buffers
+#define ALLOC_CHECK_WARMUP_TICKS 200
+
 typedef struct {
     int layer; ///< Object rendering layer
     int persistent; ///< 1 if the object should keep alive across scene boundaries
     int singleton; ///< 1 if object should be the only representative of its animation ID
+    int singleton_id; ///< Animation ID the singleton was added with, -1 if it isn't one
     object *obj;
 } render_obj;
 
+VECTOR_DEFINE(render_obj_vec, render_obj)
+VECTOR_DEFINE(object_vec, object*)
+
+static int game_state_restore(game_state *gs, serial *ser);
+static int game_state_nominal_ms_per_dyntick(game_state *gs);
+static void game_state_run_ahead_stop(game_state *gs);
+
+static void game_state_free_snapshots(game_state *gs) {
+    if(gs->snapshots == NULL) {
+        return;
+    }
+    for(int i = 0; i < ROLLBACK_TICKS; i++) {
+        serial_free(&gs->snapshots[i].state);
+    }
+    free(gs->snapshots);
+    gs->snapshots = NULL;
+}
+
+static void game_state_free_rec_index(game_state *gs) {
+    if(gs->rec_idx != NULL) {
+        rec_index_free(gs->rec_idx);
+        free(gs->rec_idx);
+        gs->rec_idx = NULL;
+    }
+}
+
+static void game_state_free_render_lists(game_state *gs) {
+    for(int i = 0; i < 3; i++) {
+        vector_free(&gs->render_lists[i]);
+    }
+    vector_free(&gs->shadow_list);
+    vector_free(&gs->projectiles);
+    vector_free(&gs->tick_order);
+}
+
+// Marks the lists derived from objects for rebuilding
+static void game_state_objects_changed(game_state *gs) {
+    gs->render_lists_dirty = 1;
+    gs->projectiles_dirty = 1;
+    gs->tick_order_dirty = 1;
+}
+
+static void game_state_free_collide_table(game_state *gs) {
+    collide_table *t = &gs->collide;
+    free(t->objs);
+    free(t->layers);
+    free(t->groups);
+    free(t->starts);
+    memset(t, 0, sizeof(collide_table));
+}
+
 int game_state_create(game_state *gs, engine_init_flags *init_flags) {
     gs->run = 1;
     gs->paused = 0;
     gs->tick = 0;
     gs->int_tick = 0;
+    gs->steady_ticks = 0;
+    gs->hashes = NULL;
+    gs->render_alpha = 1.0f;
     gs->role = ROLE_CLIENT;
-    gs->next_requires_refresh = 0;
     gs->net_mode = init_flags->net_mode;
     gs->speed = settings_get()->gameplay.speed + 5;
+    gs->fixed_physics = settings_get()->gameplay.fixed_physics;
+    gs->simulated = 0;
+    gs->resimulating = 0;
+    gs->heard_tick = 0;
+    gs->deferred_count = 0;
+    sound_queue_clear(&gs->sounds);
+    gs->catchup_ms = 0;
+    gs->ahead = NULL;
+    gs->ahead_valid = 0;
+    gs->last_action[0] = ACT_STOP;
+    gs->last_action[1] = ACT_STOP;
+    random_seed(&gs->rand, rand_intmax());
     gs->init_flags = init_flags;
     vector_create(&gs->objects, sizeof(render_obj));
+    memset(gs->singletons, 0, sizeof(gs->singletons));
+    for(int i = 0; i < 3; i++) {
+        vector_create(&gs->render_lists[i], sizeof(object*));
+    }
+    vector_create(&gs->shadow_list, sizeof(object*));
+    gs->render_lists_dirty = 1;
+    vector_create(&gs->projectiles, sizeof(object*));
+    gs->projectiles_dirty = 1;
+    vector_create(&gs->tick_order, sizeof(object*));
+    gs->tick_order_dirty = 1;
+    memset(&gs->collide, 0, sizeof(collide_table));
+    gs->snapshots = NULL;
+    gs->rec_idx = NULL;
+    gs->history = NULL;
+    gs->spectate = NULL;
+    particles_create(&gs->particles);
+    for(int i = 0; i < TICK_HASH_HISTORY; i++) {
+        gs->tick_hash_ticks[i] = UINT_MAX;
+    }
+
+    // Pools for spawned objects
+    int pool_size = settings_get()->gameplay.object_pool_size;
+    if(pool_size < 0) {
+        pool_size = 0;
+    }
+    // Plain malloc, since blocks the pools don't own are freed with plain free;
+    // plenty of objects are still made with malloc and freed through the pool.
+    mempool_create(&gs->obj_pool, sizeof(object), pool_size);
+    mempool_create(&gs->userdata_pool, USERDATA_BLOCK_SIZE, pool_size);
 
     // For screen shake
     gs->screen_shake_horizontal = 0;
@@ -89,6 +218,7 @@ int game_state_create(game_state *gs, engine_init_flags *init_flags) {
     if (strlen(init_flags->rec_file) > 0 && init_flags->record == 0) {
         sd_rec_file rec;
         sd_rec_create(&rec);
+        rec_writer_recover(init_flags->rec_file);
         int ret = sd_rec_load(&rec, init_flags->rec_file);
         if(ret != SD_SUCCESS) {
             PERROR("Unable to load recording %s.", init_flags->rec_file);
@@ -115,6 +245,26 @@ int game_state_create(game_state *gs, engine_init_flags *init_flags) {
         // XXX use playback controller once it exista
         _setup_rec_controller(gs, 0, &rec);
         _setup_rec_controller(gs, 1, &rec);
+
+        // Keyframes are optional, they only make seeking faster
+        gs->rec_idx = malloc(sizeof(rec_index));
+        rec_index_create(gs->rec_idx);
+        if(rec_index_load(gs->rec_idx, init_flags->rec_file)) {
+            game_state_free_rec_index(gs);
+        }
+        if(arena_create(gs->sc)) {
+            PERROR("Error while creating arena scene.");
+            goto error_1;
+        }
+    } else if(init_flags->ai_match) {
+        for(int i = 0; i < 2; i++) {
+            _setup_ai_match(gs, i);
+        }
+        nscene = SCENE_ARENA0;
+        if(scene_create(gs->sc, gs, nscene)) {
+            PERROR("Error while loading scene %d.", nscene);
+            goto error_0;
+        }
         if(arena_create(gs->sc)) {
             PERROR("Error while creating arena scene.");
             goto error_1;
@@ -151,11 +301,25 @@ int game_state_create(game_state *gs, engine_init_flags *init_flags) {
 error_1:
     scene_free(gs->sc);
 error_0:
+    game_state_free_rec_index(gs);
     free(gs->sc);
     vector_free(&gs->objects);
+    game_state_free_render_lists(gs);
+    game_state_free_collide_table(gs);
+    mempool_free(&gs->obj_pool);
+    mempool_free(&gs->userdata_pool);
     return 1;
 }
 
+// Call for every object that is taken out of gs->objects
+static void game_state_forget_object(game_state *gs, render_obj *robj) {
+    if(robj->singleton_id >= 0) {
+        gs->singletons[robj->singleton_id] = 0;
+    }
+    game_state_free_object(gs, robj->obj);
+    profiler_count(PROF_CNT_OBJ_FREES, 1);
+}
+
 /*
  * \param game_state gs Game state object
  * \param obj Object to add
@@ -168,20 +332,32 @@ int game_state_add_object(game_state *gs, object *obj, int layer, int singleton,
     o.obj = obj;
     o.layer = layer;
     o.singleton = singleton;
+    o.singleton_id = -1;
     o.persistent = persistent;
     animation *new_ani = object_get_animation(obj);
     if(singleton) {
-        iterator it;
-        render_obj *robj;
-        vector_iter_begin(&gs->objects, &it);
-        while((robj = iter_next(&it)) != NULL) {
-            animation *ani = object_get_animation(robj->obj);
-            if(ani != NULL && ani->id == new_ani->id && robj->singleton) {
+        int id = new_ani->id;
+        if(id >= 0 && id < GAME_STATE_SINGLETON_IDS) {
+            if(gs->singletons[id]) {
                 return 1;
             }
+            gs->singletons[id] = 1;
+            o.singleton_id = id;
+        } else {
+            iterator it;
+            render_obj *robj;
+            vector_iter_begin(&gs->objects, &it);
+            while((robj = iter_next(&it)) != NULL) {
+                animation *ani = object_get_animation(robj->obj);
+                if(ani != NULL && ani->id == new_ani->id && robj->singleton) {
+                    return 1;
+                }
+            }
         }
     }
-    vector_append(&gs->objects, &o);
+    render_obj_vec_append(&gs->objects, &o);
+    game_state_objects_changed(gs);
+    profiler_count(PROF_CNT_OBJ_SPAWNS, 1);
 
 #ifdef DEBUGMODE_STFU
     animation *ani = object_get_animation(obj);
@@ -206,6 +382,10 @@ void game_state_set_speed(game_state *gs, int speed) {
     gs->speed = (speed + 5);
 }
 
+void game_state_set_fixed_physics(game_state *gs, int enabled) {
+    gs->fixed_physics = enabled ? 1 : 0;
+}
+
 unsigned int game_state_get_speed(game_state *gs) {
     return gs->speed - 5;
 }
@@ -217,9 +397,9 @@ void game_state_del_animation(game_state *gs, int anim_id) {
     while((robj = iter_next(&it)) != NULL) {
         animation *ani = object_get_animation(robj->obj);
         if(ani != NULL && ani->id == anim_id) {
-            object_free(robj->obj);
-            free(robj->obj);
+            game_state_forget_object(gs, robj);
             vector_delete(&gs->objects, &it);
+            game_state_objects_changed(gs);
             DEBUG("Deleted animation %i from game_state.", anim_id);
             return;
         }
@@ -233,36 +413,92 @@ void game_state_del_object(game_state *gs, object *target) {
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         if(target == robj->obj) {
-            object_free(robj->obj);
-            free(robj->obj);
+            game_state_forget_object(gs, robj);
             vector_delete(&gs->objects, &it);
+            game_state_objects_changed(gs);
             return;
         }
     }
 }
 
-void game_state_get_projectiles(game_state *gs, vector *obj_proj) {
-    iterator it;
-    render_obj *robj;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(object_get_layers(robj->obj) & LAYER_PROJECTILE) {
-            vector_append(obj_proj, &robj->obj);
+// Returns the projectiles in the game as a vector of object*. The vector is
+// kept up to date between calls, and only rebuilt when objects were added or removed.
+const vector* game_state_get_projectiles(game_state *gs) {
+    if(gs->projectiles_dirty) {
+        vector_clear(&gs->projectiles);
+        for(unsigned int i = 0; i < vector_size(&gs->objects); i++) {
+            render_obj *robj = render_obj_vec_at(&gs->objects, i);
+            if(object_get_layers(robj->obj) & LAYER_PROJECTILE) {
+                object_vec_append(&gs->projectiles, &robj->obj);
+            }
         }
+        gs->projectiles_dirty = 0;
     }
+    return &gs->projectiles;
 }
 
-void game_state_clear_hazards_projectiles(game_state *gs) {
-    iterator it;
-    render_obj *robj;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(object_get_group(robj->obj) == GROUP_PROJECTILE) {
-            object_free(robj->obj);
-            free(robj->obj);
-            vector_delete(&gs->objects, &it);
+// Objects on any of the given layers (LAYER_*)
+unsigned int game_state_count_objects(game_state *gs, int layers) {
+    unsigned int count = 0;
+    for(unsigned int i = 0; i < vector_size(&gs->objects); i++) {
+        if(object_get_layers(render_obj_vec_at(&gs->objects, i)->obj) & layers) {
+            count++;
         }
     }
+    return count;
+}
+
+static int game_state_remove_projectile(void *item, void *userdata) {
+    render_obj *robj = item;
+    game_state *gs = userdata;
+    if(object_get_group(robj->obj) == GROUP_PROJECTILE) {
+        game_state_forget_object(gs, robj);
+        return 1;
+    }
+    return 0;
+}
+
+void game_state_clear_hazards_projectiles(game_state *gs) {
+    if(vector_remove_if(&gs->objects, game_state_remove_projectile, gs) > 0) {
+        game_state_objects_changed(gs);
+    }
+}
+
+object* game_state_alloc_object(game_state *gs) {
+    return mempool_alloc(&gs->obj_pool);
+}
+
+// Frees the object and its storage. Works for objects not from the pool, too.
+void game_state_free_object(game_state *gs, object *obj) {
+    object_free(obj);
+    mempool_release(&gs->obj_pool, obj);
+}
+
+void* game_state_alloc_userdata(game_state *gs, unsigned int size) {
+    if(size > gs->userdata_pool.block_size) {
+        return malloc(size);
+    }
+    return mempool_alloc(&gs->userdata_pool);
+}
+
+void game_state_free_userdata(game_state *gs, void *ptr) {
+    mempool_release(&gs->userdata_pool, ptr);
+}
+
+// Returns the music track a scene starts, or 0 if it doesn't change the music
+static unsigned int game_state_scene_music(int scene_id) {
+    switch(scene_id) {
+        case SCENE_MENU:
+        case SCENE_MELEE:
+        case SCENE_NEWSROOM:
+            return PSM_MENU;
+        case SCENE_ARENA0: return PSM_ARENA0;
+        case SCENE_ARENA1: return PSM_ARENA1;
+        case SCENE_ARENA2: return PSM_ARENA2;
+        case SCENE_ARENA3: return PSM_ARENA3;
+        case SCENE_ARENA4: return PSM_ARENA4;
+    }
+    return 0;
 }
 
 void game_state_set_next(game_state *gs, unsigned int next_scene_id) {
@@ -270,6 +506,24 @@ void game_state_set_next(game_state *gs, unsigned int next_scene_id) {
         gs->next_wait_ticks = FRAME_WAIT_TICKS;
         gs->next_next_id = SCENE_MENU;
         gs->next_id = next_scene_id;
+
+        // Start loading the next scene's files while this one fades out
+        if(next_scene_id != SCENE_NONE) {
+            int resource_id = scene_to_resource(next_scene_id);
+            rescache_preload_bk(resource_id);
+            unsigned int track = game_state_scene_music(next_scene_id);
+            if(track != 0) {
+                music_prefetch(track);
+            }
+            if(is_arena(resource_id)) {
+                for(int i = 0; i < 2; i++) {
+                    rescache_preload_af(har_to_resource(gs->players[i]->har_id));
+                }
+            }
+            if(next_scene_id == SCENE_MECHLAB) {
+                rescache_preload_pic(PIC_PLAYERS);
+            }
+        }
     }
 }
 
@@ -285,6 +539,101 @@ unsigned int game_state_is_paused(game_state *gs) {
     return gs->paused;
 }
 
+// Tells whether the screen only changes in response to input. That is the
+// case when the scene says so, no scene change or crossfade is under way,
+// the screen isn't shaking and every object has stopped animating.
+int game_state_is_idle(game_state *gs) {
+    if(gs->sc == NULL || !scene_is_idle(gs->sc)) {
+        return 0;
+    }
+    if(gs->this_id != gs->next_id || gs->next_wait_ticks > 0 || gs->this_wait_ticks > 0) {
+        return 0;
+    }
+    if(gs->screen_shake_horizontal > 0 || gs->screen_shake_vertical > 0) {
+        return 0;
+    }
+    iterator it;
+    render_obj *robj;
+    vector_iter_begin(&gs->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        if(!object_get_halt(robj->obj) && !robj->obj->animation_state.finished) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int game_state_is_simulated(game_state *gs) {
+    return gs->simulated;
+}
+
+/*
+ * Speculative ticks are those of lookahead forks and those run over again
+ * after a rollback or sync. They change the game state like any other, but
+ * have no presentation side effects: no music, rumble or screen grabs.
+ * Sounds go through game_state_play_sound.
+ */
+int game_state_is_speculative(game_state *gs) {
+    return gs->simulated || gs->resimulating;
+}
+
+/*
+ * Plays a sound effect triggered by the simulation. Sounds from resimulated
+ * ticks were already played the first time around, unless the ticks are new,
+ * as when a sync moves the game forward; those are held back until the
+ * resimulation is done and then played. Either way, sounds are gathered and
+ * merged until the end of the tick, see sound_queue.
+ */
+void game_state_play_sound(game_state *gs, int id, float volume, float panning, float pitch) {
+    if(gs->simulated) {
+        return;
+    }
+    if(!gs->resimulating) {
+        sound_queue_add(&gs->sounds, id, volume, panning, pitch);
+        return;
+    }
+    if(gs->tick >= gs->heard_tick && gs->deferred_count < DEFERRED_SOUNDS) {
+        deferred_sound *d = &gs->deferred_sounds[gs->deferred_count++];
+        d->id = id;
+        d->volume = volume;
+        d->panning = panning;
+        d->pitch = pitch;
+    }
+}
+
+static void game_state_play_queued_sounds(game_state *gs) {
+    int count = sound_queue_finish(&gs->sounds);
+    for(int i = 0; i < count; i++) {
+        queued_sound *s = &gs->sounds.sounds[i];
+        sound_play(s->id, s->volume, s->panning, s->pitch);
+    }
+    sound_queue_clear(&gs->sounds);
+}
+
+// Ends a resimulation, playing the sounds of the new ticks it went through
+static void game_state_end_resimulation(game_state *gs) {
+    gs->resimulating = 0;
+    for(int i = 0; i < gs->deferred_count; i++) {
+        deferred_sound *d = &gs->deferred_sounds[i];
+        sound_queue_add(&gs->sounds, d->id, d->volume, d->panning, d->pitch);
+    }
+    gs->deferred_count = 0;
+    game_state_play_queued_sounds(gs);
+    if(gs->tick > gs->heard_tick) {
+        gs->heard_tick = gs->tick;
+    }
+}
+
+// Anything that affects the outcome of a match should take its random
+// numbers from here, so that game states are independent of each other.
+uint32_t game_state_rand_int(game_state *gs, uint32_t upperbound) {
+    return random_int(&gs->rand, upperbound);
+}
+
+float game_state_rand_float(game_state *gs) {
+    return random_float(&gs->rand);
+}
+
 void game_state_set_paused(game_state *gs, unsigned int paused) {
     gs->paused = paused;
 }
@@ -297,56 +646,120 @@ int game_state_handle_event(game_state *gs, SDL_Event *event) {
     return 1;
 }
 
-void game_state_render(game_state *gs) {
-    iterator it;
-    render_obj *robj;
+// Sorts objects into the per layer render lists, keeping their order
+static void game_state_update_render_lists(game_state *gs) {
+    if(!gs->render_lists_dirty) {
+        return;
+    }
+    for(int i = 0; i < 3; i++) {
+        vector_clear(&gs->render_lists[i]);
+    }
+    vector_clear(&gs->shadow_list);
 
-    // Do palette transformations
-    screen_palette *scr_pal = video_get_pal_ref();
-    int pal_changed = 0;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(object_palette_transform(robj->obj, scr_pal) == 1) {
-            pal_changed = 1;
-            gs->next_requires_refresh = 1;
+    for(unsigned int i = 0; i < vector_size(&gs->objects); i++) {
+        render_obj *robj = render_obj_vec_at(&gs->objects, i);
+        if(robj->layer >= RENDER_LAYER_BOTTOM && robj->layer <= RENDER_LAYER_TOP) {
+            object_vec_append(&gs->render_lists[robj->layer], &robj->obj);
+        }
+        if(object_get_shadow(robj->obj)) {
+            object_vec_append(&gs->shadow_list, &robj->obj);
+        }
+    }
+    gs->render_lists_dirty = 0;
+}
+
+static int game_state_is_har(game_state *gs, object *obj) {
+    return obj == gs->players[0]->har || obj == gs->players[1]->har;
+}
+
+// With run-ahead, the HARs and projectiles are drawn from the fork that ran
+// ahead, and everything else from the real state. NULL without run-ahead.
+static game_state* game_state_get_ahead(game_state *gs) {
+    return gs->ahead_valid ? gs->ahead : NULL;
+}
+
+// HARs are rendered separately, between layers
+static void game_state_render_layer(game_state *gs, int layer) {
+    game_state *ahead = game_state_get_ahead(gs);
+    const vector *list = &gs->render_lists[layer];
+    for(unsigned int i = 0; i < vector_size(list); i++) {
+        object *obj = *object_vec_at(list, i);
+        if(game_state_is_har(gs, obj) || (ahead != NULL && obj->group == GROUP_PROJECTILE))
+            continue;
+        object_render(obj);
+    }
+    if(ahead != NULL) {
+        list = &ahead->render_lists[layer];
+        for(unsigned int i = 0; i < vector_size(list); i++) {
+            object *obj = *object_vec_at(list, i);
+            if(obj->group == GROUP_PROJECTILE) {
+                object_render(obj);
+            }
+        }
+    }
+    particles_render(&gs->particles, layer);
+}
+
+static void game_state_render_shadows(game_state *gs) {
+    game_state *ahead = game_state_get_ahead(gs);
+    for(unsigned int i = 0; i < vector_size(&gs->shadow_list); i++) {
+        object *obj = *object_vec_at(&gs->shadow_list, i);
+        if(ahead == NULL || (obj->group != GROUP_PROJECTILE && !game_state_is_har(gs, obj))) {
+            object_render_shadow(obj);
+        }
+    }
+    if(ahead != NULL) {
+        for(unsigned int i = 0; i < vector_size(&ahead->shadow_list); i++) {
+            object *obj = *object_vec_at(&ahead->shadow_list, i);
+            if(obj->group == GROUP_PROJECTILE || game_state_is_har(ahead, obj)) {
+                object_render_shadow(obj);
+            }
         }
     }
+}
+
+static void game_state_render_all(game_state *gs) {
 
-    // If changes were made to palette, then
-    // all resources that depend on it must be redrawn.
-    // This will take care of it.
-    if(pal_changed) {
-        scr_pal->version++;
-    } else if(gs->next_requires_refresh) {
-        // Because of caching, we might sometimes get stuck to
-        // a bad/old frame. This will fix it.
-        scr_pal->version++;
-        gs->next_requires_refresh = 0;
+    // Do palette transformations. Any object may do scene wide transformations
+    // through its animation tags, so all of them are visited.
+    screen_palette *scr_pal = video_get_pal_ref();
+    for(unsigned int i = 0; i < vector_size(&gs->objects); i++) {
+        object_palette_transform(render_obj_vec_at(&gs->objects, i)->obj, scr_pal);
     }
 
+    // If the palette contents differ from the last frame, all resources
+    // that depend on it must be redrawn. Bumping the version takes care of it.
+    video_sync_pal_version();
+
     // Render scene background
     scene_render(gs->sc);
 
+    // Fading in leaves time to get the common HAR textures ready
+    if(gs->this_wait_ticks > 0) {
+        scene_prewarm(gs->sc);
+    }
+
     // Get har objects
+    game_state *ahead = game_state_get_ahead(gs);
+    game_state *front = (ahead != NULL) ? ahead : gs;
     object *har[2];
-    har[0] = game_state_get_player(gs, 0)->har;
-    har[1] = game_state_get_player(gs, 1)->har;
+    har[0] = game_state_get_player(front, 0)->har;
+    har[1] = game_state_get_player(front, 1)->har;
 
-    // Render BOTTOM layer
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(robj->layer == RENDER_LAYER_BOTTOM) {
-            if(robj->obj == har[0] || robj->obj == har[1])
-                continue;
-            object_render(robj->obj);
-        }
+    game_state_update_render_lists(gs);
+    if(ahead != NULL) {
+        game_state_update_render_lists(ahead);
+        ahead->render_alpha = gs->render_alpha;
     }
 
-    // cast object shadows (scrap, projectiles, etc)
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        object_render_shadow(robj->obj);
-    }
+    // Render BOTTOM layer
+    game_state_render_layer(gs, RENDER_LAYER_BOTTOM);
+
+    // cast object shadows (scrap, projectiles, etc), drawn all at once
+    video_shadow_begin();
+    game_state_render_shadows(gs);
+    particles_render_shadows(&gs->particles);
+    video_shadow_end();
 
     // Render passive HARs here
     for(int i = 0; i < 2; i++) {
@@ -356,14 +769,7 @@ void game_state_render(game_state *gs) {
     }
 
     // Render MIDDLE layer
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(robj->layer == RENDER_LAYER_MIDDLE) {
-            if(robj->obj == har[0] || robj->obj == har[1])
-                continue;
-            object_render(robj->obj);
-        }
-    }
+    game_state_render_layer(gs, RENDER_LAYER_MIDDLE);
 
     // Render active HARs here
     for(int i = 0; i < 2; i++) {
@@ -373,19 +779,31 @@ void game_state_render(game_state *gs) {
     }
 
     // Render TOP layer
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(robj->layer == RENDER_LAYER_TOP) {
-            if(robj->obj == har[0] || robj->obj == har[1])
-                continue;
-            object_render(robj->obj);
-        }
-    }
+    game_state_render_layer(gs, RENDER_LAYER_TOP);
 
     // Render scene overlay (menus, etc.)
     scene_render_overlay(gs->sc);
 }
 
+// Whether the match has settled enough that ticks and frames should not allocate
+static int game_state_alloc_checked(game_state *gs) {
+    return gs->init_flags != NULL
+           && gs->init_flags->alloc_check
+           && !gs->simulated
+           && gs->steady_ticks > ALLOC_CHECK_WARMUP_TICKS;
+}
+
+void game_state_render(game_state *gs) {
+    int checked = game_state_alloc_checked(gs);
+    if(checked) {
+        mem_guard_begin("game_state_render");
+    }
+    game_state_render_all(gs);
+    if(checked) {
+        mem_guard_end();
+    }
+}
+
 void game_state_debug(game_state *gs) {
     // If we are in debug mode, handle HAR debug layers
 #ifdef DEBUGMODE
@@ -398,25 +816,136 @@ void game_state_debug(game_state *gs) {
 #endif
 }
 
+static int game_state_remove_transient(void *item, void *userdata) {
+    render_obj *robj = item;
+    if(!robj->persistent) {
+        game_state_forget_object(userdata, robj);
+        return 1;
+    }
+    return 0;
+}
+
+void game_state_set_spectate(game_state *gs, spectate *sp) {
+    if(gs->spectate != NULL) {
+        spectate_free(gs->spectate);
+        free(gs->spectate);
+    }
+    gs->spectate = sp;
+}
+
+static void game_state_announce_match(game_state *gs, int scene_id) {
+    spectate_match match;
+    memset(&match, 0, sizeof(spectate_match));
+    match.scene_id = scene_id;
+    match.speed = gs->speed;
+    for(int i = 0; i < 2; i++) {
+        match.har_id[i] = gs->players[i]->har_id;
+        match.pilot_id[i] = gs->players[i]->pilot_id;
+        memcpy(match.colors[i], gs->players[i]->colors, 3);
+    }
+    spectate_host_match(gs->spectate, &match);
+}
+
+// Sends out the ticks still inside the rollback window, oldest first
+static void game_state_end_broadcast(game_state *gs) {
+    for(unsigned int t = (gs->tick >= ROLLBACK_TICKS) ? gs->tick - ROLLBACK_TICKS + 1 : 0; gs->snapshots != NULL && t < gs->tick; t++) {
+        game_snapshot *snap = &gs->snapshots[t % ROLLBACK_TICKS];
+        if(snap->valid && snap->tick == t) {
+            spectate_host_settle(gs->spectate, snap);
+        }
+    }
+    spectate_host_end(gs->spectate);
+}
+
+static void game_state_setup_spectator(game_state *gs, const spectate_match *match) {
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(gs, i);
+        player->har_id = match->har_id[i];
+        player->pilot_id = match->pilot_id[i];
+        memcpy(player->colors, match->colors[i], 3);
+
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        spectator_controller_create(ctrl, gs, i);
+        game_player_set_ctrl(player, ctrl);
+        game_player_set_selectable(player, 1);
+    }
+    game_state_set_speed(gs, match->speed);
+    game_state_set_next(gs, match->scene_id);
+}
+
+/*
+ * Spectators simulate the broadcast match on their own, from its inputs.
+ * Keyframes put the state back in line with the host. Returns 1 if the
+ * broadcast hasn't reached the current tick yet.
+ */
+static int game_state_follow_broadcast(game_state *gs) {
+    spectate *sp = gs->spectate;
+    const spectate_match *match = spectate_get_match(sp);
+    if(match == NULL) {
+        return 0;
+    }
+    if(match->seq != sp->followed_seq) {
+        sp->followed_seq = match->seq;
+        game_state_setup_spectator(gs, match);
+        return 0;
+    }
+    if(!is_arena(scene_to_resource(gs->this_id))) {
+        return 0;
+    }
+    if(gs->next_id != gs->this_id && gs->next_id != SCENE_MENU) {
+        // The arena is over here too; stay in it until the next match is announced
+        gs->next_id = gs->this_id;
+        gs->next_wait_ticks = 0;
+    }
+
+    serial *keyframe = spectate_take_keyframe(sp, gs->tick);
+    if(keyframe != NULL) {
+        game_state_restore(gs, keyframe);
+        game_state_clear_snapshots(gs);
+        maybe_install_har_hooks(gs->sc);
+    }
+    return spectate_get_tick(sp, gs->tick) == NULL;
+}
+
 int game_load_new(game_state *gs, int scene_id) {
-    // Free old scene
+    trace_begin("scene", "load");
+    uint64_t load_start = load_timer_start();
+    scene_stats_end(gs->this_id);
+    gs->catchup_ms = 0;
+    game_state_run_ahead_stop(gs);
+
+    if(gs->spectate != NULL) {
+        if(scene_id == SCENE_MENU) {
+            game_state_set_spectate(gs, NULL);
+        } else if(gs->spectate->mode == SPECTATE_HOST && is_arena(scene_to_resource(gs->this_id))) {
+            game_state_end_broadcast(gs);
+        }
+    }
+
+    // Start decoding the next track while the scene loads
+    unsigned int track = game_state_scene_music(scene_id);
+    if(track != 0) {
+        music_prefetch(track);
+    }
+
+    // Free old scene. Its files stay cached, or are freed bit by bit from the
+    // main loop if the cache is full.
     scene_free(gs->sc);
     free(gs->sc);
 
-    // Clear up old video cache objects
-    tcache_clear();
+    // Clear up old video cache objects. The textures go a few per tick.
+    tcache_retire();
+    text_cache_clear();
 
     // Remove old objects
-    render_obj *robj;
-    iterator it;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(!robj->persistent) {
-            object_free(robj->obj);
-            free(robj->obj);
-            vector_delete(&gs->objects, &it);
-        }
+    if(vector_remove_if(&gs->objects, game_state_remove_transient, gs) > 0) {
+        game_state_objects_changed(gs);
     }
+    particles_clear(&gs->particles);
+
+    // Everything the old scene put in the scene arena is gone by now
+    memarena_scene_reset();
 
     // Initialize new scene with BK data etc.
     gs->sc = malloc(sizeof(scene));
@@ -490,6 +1019,9 @@ int game_load_new(game_state *gs, int scene_id) {
                 PERROR("Error while creating arena scene.");
                 goto error_1;
             }
+            if(gs->spectate != NULL && gs->spectate->mode == SPECTATE_HOST) {
+                game_state_announce_match(gs, scene_id);
+            }
             break;
         default:
             if(cutscene_create(gs->sc)) {
@@ -502,55 +1034,151 @@ int game_load_new(game_state *gs, int scene_id) {
     // Zap scene to produce objects & background
     scene_init(gs->sc);
 
+    // Anything preloaded that the scene didn't use is stale now
+    preloader_flush();
+
     // All done.
     gs->this_id = scene_id;
     gs->next_id = scene_id;
     gs->tick = 0;
+    gs->heard_tick = 0;
+    load_timer_add(LOAD_TIME_SCENE, load_start);
+    trace_end("scene", "load");
     return 0;
 
 error_1:
     scene_free(gs->sc);
 error_0:
     free(gs->sc);
+    preloader_flush();
+    trace_end("scene", "load");
     return 1;
 }
 
-void game_state_call_collide(game_state *gs) {
-    object *a, *b;
+static void game_state_gather_collide(game_state *gs) {
+    collide_table *t = &gs->collide;
     unsigned int size = vector_size(&gs->objects);
-    for(int i = 0; i < size; i++) {
-        a = ((render_obj*)vector_get(&gs->objects, i))->obj;
-        for(int k = i+1; k < size; k++) {
-            b = ((render_obj*)vector_get(&gs->objects, k))->obj;
-            if(a->group != b->group || a->group == OBJECT_NO_GROUP || b->group == OBJECT_NO_GROUP) {
-                if(a->layers & b->layers) {
-                    object_collide(a, b);
-                }
+    if(size > t->capacity) {
+        t->capacity = size + 32;
+        t->objs = realloc(t->objs, t->capacity * sizeof(object*));
+        t->layers = realloc(t->layers, t->capacity);
+        t->groups = realloc(t->groups, t->capacity);
+        t->starts = realloc(t->starts, t->capacity);
+    }
+    for(unsigned int i = 0; i < size; i++) {
+        object *obj = render_obj_vec_at(&gs->objects, i)->obj;
+        t->objs[i] = obj;
+        t->layers[i] = obj->layers;
+        t->groups[i] = obj->group;
+        t->starts[i] = (obj->collide != NULL && obj->layers != 0);
+    }
+    t->size = size;
+}
+
+void game_state_call_collide(game_state *gs) {
+    // Layers and groups are only set up when objects are created, so the copies
+    // stay valid while the collision callbacks run. Objects spawned by the
+    // callbacks are left for the next tick, same as before.
+    game_state_gather_collide(gs);
+    const collide_table *t = &gs->collide;
+    for(unsigned int i = 0; i < t->size; i++) {
+        // Only the first object of a pair gets its collision callback called,
+        // so objects without one (scrap, oil, most effects) can't start a pair.
+        // Pairs are still visited in the same order as before.
+        if(!t->starts[i]) {
+            continue;
+        }
+        uint8_t layers = t->layers[i];
+        int8_t group = t->groups[i];
+        for(unsigned int k = i+1; k < t->size; k++) {
+            if(!(layers & t->layers[k])) {
+                continue;
+            }
+            if(group != t->groups[k] || group == OBJECT_NO_GROUP || t->groups[k] == OBJECT_NO_GROUP) {
+                object_collide(t->objs[i], t->objs[k]);
             }
         }
     }
 }
 
+static int game_state_remove_finished(void *item, void *userdata) {
+    render_obj *robj = item;
+    if(object_finished(robj->obj)) {
+        /*DEBUG("Animation object %d is finished, removing.", robj->obj->cur_animation->id);*/
+        game_state_forget_object(userdata, robj);
+        return 1;
+    }
+    return 0;
+}
+
 void game_state_cleanup(game_state *gs) {
-    render_obj *robj;
-    iterator it;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(object_finished(robj->obj)) {
-            /*DEBUG("Animation object %d is finished, removing.", robj->obj->cur_animation->id);*/
-            object_free(robj->obj);
-            free(robj->obj);
-            vector_delete(&gs->objects, &it);
+    if(vector_remove_if(&gs->objects, game_state_remove_finished, gs) > 0) {
+        game_state_objects_changed(gs);
+    }
+}
+
+// Kinds of objects, in the order they are ticked
+enum {
+    TICK_KIND_HAR,
+    TICK_KIND_PROJECTILE,
+    TICK_KIND_HAZARD,
+    TICK_KIND_SCRAP,
+    TICK_KIND_OTHER,
+    TICK_KIND_COUNT
+};
+
+static int game_state_tick_kind(object *obj) {
+    int layers = object_get_layers(obj);
+    // Hazards are on the HAR layer too, so they go first
+    if(layers & LAYER_HAZARD) {
+        return TICK_KIND_HAZARD;
+    }
+    if(layers & LAYER_HAR) {
+        return TICK_KIND_HAR;
+    }
+    if(layers & LAYER_PROJECTILE) {
+        return TICK_KIND_PROJECTILE;
+    }
+    if(layers & LAYER_SCRAP) {
+        return TICK_KIND_SCRAP;
+    }
+    return TICK_KIND_OTHER;
+}
+
+// Returns the objects as a vector of object*, grouped by kind so that the
+// same tick callbacks run back to back. Within a kind the objects keep the
+// order of gs->objects, so the order only depends on the game state. Rebuilt
+// when objects were added or removed.
+static const vector* game_state_get_tick_order(game_state *gs) {
+    if(gs->tick_order_dirty) {
+        vector_clear(&gs->tick_order);
+        for(int kind = 0; kind < TICK_KIND_COUNT; kind++) {
+            for(unsigned int i = 0; i < vector_size(&gs->objects); i++) {
+                render_obj *robj = render_obj_vec_at(&gs->objects, i);
+                if(game_state_tick_kind(robj->obj) == kind) {
+                    object_vec_append(&gs->tick_order, &robj->obj);
+                }
+            }
         }
+        gs->tick_order_dirty = 0;
     }
+    return &gs->tick_order;
+}
+
+static void game_state_move_object(object *obj) {
+    obj->prev_pos = obj->pos;
+    object_move(obj);
 }
 
 void game_state_call_move(game_state *gs) {
-    render_obj *robj;
-    iterator it;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        object_move(robj->obj);
+    unsigned int count = vector_size(&gs->objects);
+    const vector *order = game_state_get_tick_order(gs);
+    for(unsigned int i = 0; i < count; i++) {
+        game_state_move_object(*object_vec_at(order, i));
+    }
+    // Objects spawned on the way are moved in the same pass, as they come
+    for(unsigned int i = count; i < vector_size(&gs->objects); i++) {
+        game_state_move_object(render_obj_vec_at(&gs->objects, i)->obj);
     }
 }
 
@@ -562,6 +1190,9 @@ void game_state_tick_controllers(game_state *gs) {
             controller_tick(c, gs->int_tick, &c->extra_events);
         }
     }
+    if(gs->spectate != NULL && spectate_service(gs->spectate)) {
+        game_state_set_next(gs, SCENE_MENU);
+    }
 }
 
 void game_state_dyntick_controllers(game_state *gs) {
@@ -588,15 +1219,17 @@ void game_state_ctrl_events_free(game_state *gs) {
 
 // This function is called with changing interval, depending on the value of game speed
 void game_state_call_tick(game_state *gs, int mode) {
-    render_obj *robj;
-    iterator it;
-    vector_iter_begin(&gs->objects, &it);
-    while((robj = iter_next(&it)) != NULL) {
-        if(mode == TICK_DYNAMIC) {
-            object_dynamic_tick(robj->obj);
-        } else {
-            object_static_tick(robj->obj);
-        }
+    void (*tick)(object*) = (mode == TICK_DYNAMIC) ? object_dynamic_tick : object_static_tick;
+    unsigned int count = vector_size(&gs->objects);
+    const vector *order = game_state_get_tick_order(gs);
+    for(unsigned int i = 0; i < count; i++) {
+        tick(*object_vec_at(order, i));
+    }
+    for(unsigned int i = count; i < vector_size(&gs->objects); i++) {
+        tick(render_obj_vec_at(&gs->objects, i)->obj);
+    }
+    if(mode == TICK_DYNAMIC) {
+        particles_tick(&gs->particles);
     }
 
     // Speed back up
@@ -621,17 +1254,84 @@ void game_state_static_tick(game_state *gs) {
         video_set_fade(1.0f - (float)gs->this_wait_ticks / (float)FRAME_WAIT_TICKS);
     }
 
+    // Music crossfades run alongside the scene fades
+    music_tick();
+
     // Call static ticks for scene
     scene_static_tick(gs->sc, game_state_is_paused(gs));
 
+    // Decode some of the scene's sprites ahead of use. With little memory
+    // they are decoded when needed instead, and dropped when not.
+    if(!settings_get()->gameplay.low_memory) {
+        scene_predecode(gs->sc, settings_get()->gameplay.sprite_predecode);
+    }
+
     // Call static tick functions
     game_state_call_tick(gs, TICK_STATIC);
+    game_state_play_queued_sounds(gs);
+}
+
+static uint32_t hash_word(uint32_t h, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        h = (h ^ ((v >> (i * 8)) & 0xFF)) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_float(uint32_t h, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return hash_word(h, bits);
+}
+
+// Cheap hash over the parts of the state that diverge first when peers
+// desync. Much smaller than a full serialization, so it fits in heartbeats.
+uint32_t game_state_tick_hash(game_state *gs) {
+    uint32_t h = hash_word(2166136261u, random_get_seed(&gs->rand));
+    for(int i = 0; i < 2; i++) {
+        object *obj = game_player_get_har(game_state_get_player(gs, i));
+        if(obj == NULL) {
+            continue;
+        }
+        har *h_har = object_get_userdata(obj);
+        h = hash_float(h, obj->pos.x);
+        h = hash_float(h, obj->pos.y);
+        h = hash_float(h, obj->vel.x);
+        h = hash_float(h, obj->vel.y);
+        h = hash_word(h, obj->animation_state.current_tick);
+        h = hash_word(h, obj->cur_animation != NULL ? obj->cur_animation->id : -1);
+        h = hash_word(h, (uint16_t)h_har->health);
+        h = hash_word(h, (uint16_t)h_har->endurance);
+    }
+    return h;
+}
+
+static void game_state_store_tick_hash(game_state *gs) {
+    if(gs->net_mode == NET_MODE_NONE) {
+        return;
+    }
+    gs->tick_hashes[gs->tick % TICK_HASH_HISTORY] = game_state_tick_hash(gs);
+    gs->tick_hash_ticks[gs->tick % TICK_HASH_HISTORY] = gs->tick;
+}
+
+// Returns 1 if the hash for the tick is no longer or not yet known
+int game_state_get_tick_hash(game_state *gs, unsigned int tick, uint32_t *hash) {
+    if(gs->tick_hash_ticks[tick % TICK_HASH_HISTORY] != tick) {
+        return 1;
+    }
+    *hash = gs->tick_hashes[tick % TICK_HASH_HISTORY];
+    return 0;
 }
 
 // This function is called when the game speed requires it
-void game_state_dynamic_tick(game_state *gs) {
+static void game_state_run_dynamic_tick(game_state *gs) {
+    // Spectators wait here whenever the broadcast hasn't reached this tick yet
+    if(gs->spectate != NULL && gs->spectate->mode == SPECTATE_CLIENT && game_state_follow_broadcast(gs)) {
+        return;
+    }
+
     // We want to load another scene
-    if(gs->this_id != gs->next_id && (gs->next_wait_ticks <= 1 || !settings_get()->video.crossfade_on)) {
+    if(gs->this_id != gs->next_id && (gs->next_wait_ticks <= 1 || !settings_snapshot()->video.crossfade_on)) {
         // If this is the end, set run to 0 so that engine knows to close here
         if(gs->next_id == SCENE_NONE) {
             DEBUG("Next ID is SCENE_NONE! bailing.");
@@ -645,7 +1345,7 @@ void game_state_dynamic_tick(game_state *gs) {
             gs->run = 0;
             return;
         }
-        if(settings_get()->video.crossfade_on) {
+        if(settings_snapshot()->video.crossfade_on) {
             gs->this_wait_ticks = FRAME_WAIT_TICKS;
         } else {
             gs->this_wait_ticks = 0;
@@ -663,9 +1363,12 @@ void game_state_dynamic_tick(game_state *gs) {
     }
 
     if (gs->screen_shake_horizontal > 0 || gs->screen_shake_vertical > 0) {
-        float shake_x = sin(gs->screen_shake_horizontal) * 5 * ((float)gs->screen_shake_horizontal / 15);
-        float shake_y = sin(gs->screen_shake_vertical) * 5 * ((float)gs->screen_shake_vertical / 15);
-        video_move_target((int)shake_x, (int)shake_y);
+        // sin(n) * 5 * n / 15, with n in radians
+        int h = gs->screen_shake_horizontal;
+        int v = gs->screen_shake_vertical;
+        int shake_x = fixed_sin_lut(fixed_to_angle(fixed_from_int(h))) * 5 * h / 15 / FIXED_ONE;
+        int shake_y = fixed_sin_lut(fixed_to_angle(fixed_from_int(v))) * 5 * v / 15 / FIXED_ONE;
+        video_move_target(shake_x, shake_y);
         for(int i = 0; i < game_state_num_players(gs); i++) {
             game_player *gp = game_state_get_player(gs, i);
             controller *c = game_player_get_ctrl(gp);
@@ -703,6 +1406,7 @@ void game_state_dynamic_tick(game_state *gs) {
 
         // Increment tick
         gs->tick++;
+        game_state_store_tick_hash(gs);
         LOGTICK(gs->tick);
     }
 
@@ -713,6 +1417,35 @@ void game_state_dynamic_tick(game_state *gs) {
     gs->int_tick++;
 }
 
+void game_state_dynamic_tick(game_state *gs) {
+    if(gs->catchup_ms > 0) {
+        gs->catchup_ms -= game_state_nominal_ms_per_dyntick(gs) - game_state_ms_per_dyntick(gs);
+    }
+    int checked = game_state_alloc_checked(gs);
+    if(checked) {
+        mem_guard_begin("game_state_dynamic_tick");
+    }
+    game_state_run_dynamic_tick(gs);
+    if(checked) {
+        mem_guard_end();
+    }
+    game_state_play_queued_sounds(gs);
+
+    gs->heard_tick = gs->tick;
+
+    // Stop the replay at the first desync, there is nothing more to learn
+    if(gs->hashes != NULL && !gs->simulated && hash_log_tick(gs->hashes, gs)) {
+        gs->run = 0;
+    }
+
+    // Only fights that keep going count as steady, scene changes start over
+    if(gs->sc != NULL && is_arena(gs->this_id) && gs->this_id == gs->next_id && arena_get_state(gs->sc) == ARENA_STATE_FIGHTING) {
+        gs->steady_ticks++;
+    } else {
+        gs->steady_ticks = 0;
+    }
+}
+
 unsigned int game_state_get_tick(game_state *gs) {
     return gs->tick;
 }
@@ -803,6 +1536,26 @@ void reconfigure_controller(game_state *gs) {
     }
 }
 
+// Sets up a player for a tournament match, see engine_init_flags
+void _setup_ai_match(game_state *gs, int player_id) {
+    game_player *player = game_state_get_player(gs, player_id);
+    controller *ctrl = malloc(sizeof(controller));
+    controller_init(ctrl);
+    ai_controller_create(ctrl, gs->init_flags->match_difficulty[player_id]);
+    game_player_set_ctrl(player, ctrl);
+    game_player_set_selectable(player, 1);
+
+    player->har_id = HAR_JAGUAR + gs->init_flags->match_har[player_id];
+    player->pilot_id = gs->init_flags->match_pilot[player_id];
+    chr_score_reset(&player->score, 1);
+
+    pilot pilot_info;
+    pilot_get_info(&pilot_info, player->pilot_id);
+    player->colors[0] = pilot_info.colors[0];
+    player->colors[1] = pilot_info.colors[1];
+    player->colors[2] = pilot_info.colors[2];
+}
+
 void game_state_init_demo(game_state *gs) {
     // Set up player controller
     for(int i = 0;i < game_state_num_players(gs);i++) {
@@ -833,11 +1586,17 @@ void game_state_free(game_state *gs) {
     iterator it;
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
-        object_free(robj->obj);
-        free(robj->obj);
-        vector_delete(&gs->objects, &it);
+        game_state_free_object(gs, robj->obj);
     }
     vector_free(&gs->objects);
+    game_state_free_render_lists(gs);
+    game_state_free_collide_table(gs);
+    game_state_free_snapshots(gs);
+    game_state_free_rec_index(gs);
+    game_state_history_stop(gs);
+    game_state_set_spectate(gs, NULL);
+    game_state_run_ahead_stop(gs);
+    particles_free(&gs->particles);
 
     // Free scene
     scene_free(gs->sc);
@@ -849,9 +1608,35 @@ void game_state_free(game_state *gs) {
         game_player_free(gs->players[i]);
         free(gs->players[i]);
     }
+
+    // Free pools last, since freeing objects may still release userdata
+    mempool_free(&gs->obj_pool);
+    mempool_free(&gs->userdata_pool);
 }
 
-int game_state_ms_per_dyntick(game_state *gs) {
+// Objects are drawn this far from where the last dynamic tick started
+// towards where it left them. 1.0 draws them where they are.
+void game_state_set_render_alpha(game_state *gs, float alpha) {
+    gs->render_alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
+
+// Keeps a loop that has fallen behind, say after a scene load, from
+// running a long burst of ticks that only makes it fall further behind.
+// Whatever is more than max_ticks behind is given up on, and the number of
+// ticks dropped is returned. Network peers expect every tick, so there the
+// backlog is kept; the caller then runs max_ticks per frame and the game
+// runs slow until it has caught up.
+int game_state_limit_backlog(game_state *gs, int *dynamic_wait, int max_ticks) {
+    int ms = game_state_ms_per_dyntick(gs);
+    if(max_ticks <= 0 || gs->net_mode != NET_MODE_NONE || *dynamic_wait <= ms * max_ticks) {
+        return 0;
+    }
+    int dropped = *dynamic_wait / ms - max_ticks;
+    *dynamic_wait -= dropped * ms;
+    return dropped;
+}
+
+static int game_state_nominal_ms_per_dyntick(game_state *gs) {
     float tmp;
     switch(gs->this_id) {
         case SCENE_ARENA0:
@@ -865,11 +1650,36 @@ int game_state_ms_per_dyntick(game_state *gs) {
     return MS_PER_OMF_TICK;
 }
 
+// Ms of wall clock time per tick. A bit less while catching up after a sync.
+int game_state_ms_per_dyntick(game_state *gs) {
+    int ms = game_state_nominal_ms_per_dyntick(gs);
+    if(gs->catchup_ms > 0) {
+        ms -= max2(1, ms / CATCHUP_DILATION);
+    }
+    return ms;
+}
+
+// The game wide part of a serialized state
+typedef struct game_state_wire_t {
+    int tick;
+    int seed;
+    int paused;
+} game_state_wire;
+
+static const serial_field game_state_fields[] = {
+    SERIAL_FIELD(SERIAL_FIELD_UINT, game_state_wire, tick),
+    SERIAL_FIELD(SERIAL_FIELD_RAW32, game_state_wire, seed),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, game_state_wire, paused),
+};
+
 int game_state_serialize(game_state *gs, serial *ser) {
     // serialize tick time and random seed, so client can reply state from this point
-    serial_write_int32(ser, game_state_get_tick(gs));
-    serial_write_int32(ser, rand_get_seed());
-    serial_write_int32(ser, game_state_is_paused(gs));
+    game_state_wire w;
+    w.tick = game_state_get_tick(gs);
+    w.seed = random_get_seed(&gs->rand);
+    w.paused = game_state_is_paused(gs);
+    serial_write_int8(ser, GAME_STATE_SERIAL_VERSION);
+    serial_write_fields(ser, game_state_fields, SERIAL_FIELD_COUNT(game_state_fields), &w);
 
     object *har[2];
     har[0] = game_state_get_player(gs, 0)->har;
@@ -901,23 +1711,55 @@ int game_state_serialize(game_state *gs, serial *ser) {
     chr_score_serialize(game_player_get_score(game_state_get_player(gs, 0)), ser);
     chr_score_serialize(game_player_get_score(game_state_get_player(gs, 1)), ser);
 
+    // Pending timers, such as the one that starts the fight
+    if(gs->sc != NULL) {
+        ticktimer_serialize(&gs->sc->tick_timer, ser);
+    } else {
+        serial_write_varint(ser, 0);
+    }
+
     return 0;
 }
 
-int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
-#ifdef DEBUGMODE
-    int oldtick = gs->tick;
-#endif
-    gs->tick = serial_read_int32(ser);
-    int endtick = gs->tick + ceil(rtt / 2.0f);
-    rand_seed(serial_read_int32(ser));
-    game_state_set_paused(gs, serial_read_int32(ser));
+// FNV-1a over the serialized state. Only meaningful while both HARs exist.
+int game_state_hash(game_state *gs, uint32_t *hash) {
+    if(game_state_get_player(gs, 0)->har == NULL || game_state_get_player(gs, 1)->har == NULL) {
+        return 1;
+    }
+    serial ser;
+    serial_create_size(&ser, GAME_STATE_SERIAL_SIZE_HINT);
+    game_state_serialize(gs, &ser);
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < ser.len; i++) {
+        h = (h ^ (uint8_t)ser.data[i]) * 16777619u;
+    }
+    serial_free(&ser);
+    *hash = h;
+    return 0;
+}
+
+// Replaces the current state with a serialized one, without ticking forward
+static int game_state_restore(game_state *gs, serial *ser) {
+    int version = (uint8_t)serial_read_int8(ser);
+    if(version != GAME_STATE_SERIAL_VERSION) {
+        PERROR("Serialized state has version %d, expected %d.", version, GAME_STATE_SERIAL_VERSION);
+        return 1;
+    }
+    game_state_wire w;
+    serial_read_fields(ser, game_state_fields, SERIAL_FIELD_COUNT(game_state_fields), &w);
+    if(serial_error(ser)) {
+        PERROR("Serialized state is truncated.");
+        return 1;
+    }
+    gs->tick = w.tick;
+    random_seed(&gs->rand, w.seed);
+    game_state_set_paused(gs, w.paused);
 
     for(int i = 0; i < 2; i++) {
         // Declare some vars
         game_player *player = game_state_get_player(gs, i);
         game_state_del_object(gs, player->har);
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(gs);
 
         // Create object and specialize it as HAR.
         // Errors are unlikely here, but check anyway.
@@ -942,21 +1784,12 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
     obj_har2->animation_state.enemy = obj_har1;
 
     // clean out any current projectiles/hazards
-    iterator it;
-    vector_iter_begin(&gs->objects, &it);
-    render_obj *robj;
-    while((robj = iter_next(&it)) != NULL) {
-        if (robj->obj->group == GROUP_PROJECTILE) {
-            object_free(robj->obj);
-            free(robj->obj);
-            vector_delete(&gs->objects, &it);
-        }
-    }
+    game_state_clear_hazards_projectiles(gs);
 
     uint8_t count = serial_read_int8(ser);
 
-    for (int i = 0; i < count; i++) {
-        object *obj = malloc(sizeof(object));
+    for (int i = 0; i < count && !serial_error(ser); i++) {
+        object *obj = game_state_alloc_object(gs);
         int layer = serial_read_int8(ser);
         object_create(obj, gs, vec2i_create(0, 0), vec2f_create(0,0));
         object_unserialize(obj, ser, gs);
@@ -968,17 +1801,445 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
     chr_score_unserialize(game_player_get_score(game_state_get_player(gs, 0)), ser);
     chr_score_unserialize(game_player_get_score(game_state_get_player(gs, 1)), ser);
 
-    // tick things back to the current time
-    DEBUG("replaying %d ticks", endtick - gs->tick);
+    if(gs->sc != NULL) {
+        ticktimer_unserialize(&gs->sc->tick_timer, ser);
+    } else {
+        ticktimer skipped;
+        ticktimer_init(&skipped);
+        ticktimer_unserialize(&skipped, ser);
+        ticktimer_close(&skipped);
+    }
+    // Too late to keep the old state, but at least don't simulate on from this one
+    if(serial_error(ser)) {
+        PERROR("Serialized state is truncated.");
+        return 1;
+    }
+    return 0;
+}
+
+// Moves recording playback to the start of the given tick. Going backwards or
+// far forwards restores the nearest keyframe first; the rest is simulated.
+int game_state_rec_seek(game_state *gs, unsigned int tick) {
+    if(!is_arena(scene_to_resource(gs->this_id))) {
+        return 1;
+    }
+    const rec_keyframe *kf = NULL;
+    if(gs->rec_idx != NULL) {
+        kf = rec_index_find(gs->rec_idx, tick);
+    }
+    if(kf != NULL && (tick < gs->tick || kf->tick > gs->tick)) {
+        serial ser;
+        serial_create_view(&ser, kf->data, kf->len);
+        game_state_restore(gs, &ser);
+        game_state_clear_snapshots(gs);
+        for(int i = 0; i < 2; i++) {
+            controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+            if(ctrl != NULL && ctrl->type == CTRL_TYPE_REC) {
+                rec_controller_seek(ctrl, gs->tick);
+            }
+        }
+    } else if(tick < gs->tick) {
+        PERROR("Cannot seek back to tick %u without a keyframe.", tick);
+        return 1;
+    }
+    while(gs->run && gs->tick < tick) {
+        game_state_dynamic_tick(gs);
+    }
+    return 0;
+}
+
+// Keeps the states of the last seconds of the fight, so that it can be
+// rewound and reset without reloading anything. Not for netplay, where both
+// sides have to agree on the state.
+int game_state_history_start(game_state *gs, unsigned int seconds) {
+    if(gs->net_mode != NET_MODE_NONE || !is_arena(scene_to_resource(gs->this_id)) || seconds == 0) {
+        return 1;
+    }
+    game_state_history_stop(gs);
+    gs->history = malloc(sizeof(state_history));
+    state_history_create(gs->history, seconds * 1000 / game_state_ms_per_dyntick(gs));
+    return 0;
+}
+
+void game_state_history_stop(game_state *gs) {
+    if(gs->history != NULL) {
+        state_history_free(gs->history);
+        free(gs->history);
+        gs->history = NULL;
+    }
+}
+
+// Called at the start of every tick while the history is kept
+void game_state_history_save(game_state *gs) {
+    serial ser;
+    serial_create_size(&ser, GAME_STATE_SERIAL_SIZE_HINT);
+    game_state_serialize(gs, &ser);
+    state_history_add(gs->history, gs->tick, &ser);
+    serial_free(&ser);
+}
+
+static int game_state_history_restore(game_state *gs, serial *ser) {
+    if(game_state_restore(gs, ser)) {
+        return 1;
+    }
+    game_state_clear_snapshots(gs);
+    // Restored HARs come without hooks
+    maybe_install_har_hooks(gs->sc);
+    return 0;
+}
+
+// Goes back to the start of the given tick, or as far back as the history reaches
+int game_state_history_seek(game_state *gs, unsigned int tick) {
+    if(gs->history == NULL) {
+        return 1;
+    }
+    serial ser;
+    serial_create_size(&ser, GAME_STATE_SERIAL_SIZE_HINT);
+    int ret = state_history_get(gs->history, tick, &ser) || game_state_history_restore(gs, &ser);
+    serial_free(&ser);
+    return ret;
+}
+
+// Goes back to where the history was started
+int game_state_history_reset(game_state *gs) {
+    if(gs->history == NULL || state_history_start(gs->history) == NULL) {
+        return 1;
+    }
+    const serial *start = state_history_start(gs->history);
+    serial ser;
+    serial_create_view(&ser, start->data, start->len);
+    return game_state_history_restore(gs, &ser);
+}
+
+int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
+#ifdef DEBUGMODE
+    int oldtick = gs->tick;
+#endif
+    trace_begin("net", "apply sync");
+    if(game_state_restore(gs, ser)) {
+        trace_end("net", "apply sync");
+        return 1;
+    }
+    int endtick = gs->tick + ceil(rtt / 2.0f);
+
+    // Local snapshots are older than the state we just got
+    game_state_clear_snapshots(gs);
+
+    // tick things back to the current time. A long way back would stall this
+    // frame, so only part of it is done now and the rest is caught up on.
+    int ticks = endtick - (int)gs->tick + 1;
+    int now = min2(ticks, RESIM_MAX_TICKS);
+    gs->catchup_ms = (ticks - now) * game_state_nominal_ms_per_dyntick(gs);
+    DEBUG("replaying %d ticks, catching up on %d", now, ticks - now);
     DEBUG("adjusting clock from %d to %d (%d)", oldtick, endtick, ceil(rtt / 2.0f));
-    while (gs->tick <= endtick) {
+    gs->resimulating = 1;
+    for(int i = 0; i < now; i++) {
         game_state_cleanup(gs);
         game_state_call_move(gs);
         game_state_call_collide(gs);
         game_state_call_tick(gs, TICK_DYNAMIC);
         gs->tick++;
+        game_state_store_tick_hash(gs);
     }
+    game_state_end_resimulation(gs);
     DEBUG("replay done");
+    trace_end("net", "apply sync");
 
     return 0;
 }
+
+// Drops all rollback snapshots
+void game_state_clear_snapshots(game_state *gs) {
+    if(gs->snapshots == NULL) {
+        return;
+    }
+    for(int i = 0; i < ROLLBACK_TICKS; i++) {
+        gs->snapshots[i].valid = 0;
+    }
+}
+
+/*
+ * Stores the state at the start of the current tick, so that the game can
+ * later be rolled back here. Actions recorded for this tick are kept.
+ */
+void game_state_save_snapshot(game_state *gs) {
+    if(gs->snapshots == NULL) {
+        gs->snapshots = malloc(sizeof(game_snapshot) * ROLLBACK_TICKS);
+        for(int i = 0; i < ROLLBACK_TICKS; i++) {
+            gs->snapshots[i].valid = 0;
+            serial_create_size(&gs->snapshots[i].state, GAME_STATE_SERIAL_SIZE_HINT);
+        }
+    }
+    game_snapshot *snap = &gs->snapshots[gs->tick % ROLLBACK_TICKS];
+    if(!snap->valid || snap->tick != gs->tick) {
+        // The tick in this slot can't be rolled back anymore, so it is final
+        if(snap->valid && gs->spectate != NULL && gs->spectate->mode == SPECTATE_HOST) {
+            spectate_host_settle(gs->spectate, snap);
+        }
+        snap->action_count[0] = 0;
+        snap->action_count[1] = 0;
+        snap->delays[0] = 0;
+        snap->delays[1] = 0;
+    }
+    serial_clear(&snap->state);
+    game_state_serialize(gs, &snap->state);
+    snap->tick = gs->tick;
+    snap->valid = 1;
+}
+
+// Remembers an action that was applied on the current tick, for resimulation
+// and for running ahead
+void game_state_record_action(game_state *gs, int player_id, int action) {
+    gs->last_action[player_id] = action;
+    if(gs->snapshots == NULL) {
+        return;
+    }
+    game_snapshot *snap = &gs->snapshots[gs->tick % ROLLBACK_TICKS];
+    if(snap->valid && snap->tick == gs->tick && snap->action_count[player_id] < ROLLBACK_MAX_ACTIONS) {
+        snap->actions[player_id][snap->action_count[player_id]++] = action;
+        object *obj = game_player_get_har(game_state_get_player(gs, player_id));
+        if(obj != NULL) {
+            snap->delays[player_id] = ((har*)obj->userdata)->delay;
+        }
+    }
+}
+
+/*
+ * Applies an action that should have happened on an earlier tick. The game
+ * is rolled back to the snapshot of that tick and simulated forward again
+ * with all recorded actions. Until a late action arrives, the remote player
+ * is predicted to keep doing what it did last.
+ *
+ * Returns 0 if the action was handled by rolling back, 1 if the caller
+ * should apply it on the current tick instead.
+ */
+int game_state_rollback_action(game_state *gs, int player_id, int action, int tick) {
+    if(gs->snapshots == NULL || tick < 0 || (unsigned int)tick >= gs->tick) {
+        return 1;
+    }
+    game_snapshot *snap = &gs->snapshots[tick % ROLLBACK_TICKS];
+    if(!snap->valid || snap->tick != (unsigned int)tick) {
+        DEBUG("action for tick %d is too old to roll back, now at %d", tick, gs->tick);
+        return 1;
+    }
+    if(snap->action_count[player_id] < ROLLBACK_MAX_ACTIONS) {
+        snap->actions[player_id][snap->action_count[player_id]++] = action;
+    }
+
+    unsigned int endtick = gs->tick;
+    DEBUG("rolling back from tick %d to %d", endtick, tick);
+    profiler_count(PROF_CNT_ROLLBACKS, 1);
+    profiler_count(PROF_CNT_ROLLBACK_TICKS, endtick - tick);
+    serial_read_reset(&snap->state);
+    game_state_restore(gs, &snap->state);
+    gs->resimulating = 1;
+    while(gs->tick < endtick) {
+        snap = &gs->snapshots[gs->tick % ROLLBACK_TICKS];
+        if(gs->tick != (unsigned int)tick) {
+            // State differs from what it was the first time around
+            game_state_save_snapshot(gs);
+        }
+        for(int i = 0; i < 2; i++) {
+            object *har = game_player_get_har(game_state_get_player(gs, i));
+            for(int k = 0; har != NULL && k < snap->action_count[i]; k++) {
+                object_act(har, snap->actions[i][k]);
+            }
+        }
+        game_state_cleanup(gs);
+        game_state_call_move(gs);
+        game_state_call_collide(gs);
+        game_state_call_tick(gs, TICK_DYNAMIC);
+        gs->tick++;
+        game_state_store_tick_hash(gs);
+    }
+    game_state_end_resimulation(gs);
+    return 0;
+}
+
+/*
+ * A fork is a scratch game state for trying things out ahead of the real
+ * one. It shares the scene (and so the AF and BK data) of its parent, has
+ * players of its own and never plays sounds or music. Only the HARs,
+ * projectiles and scores are carried over, same as for rollback.
+ */
+int game_state_fork_create(game_state *fork, game_state *gs) {
+    memset(fork, 0, sizeof(game_state));
+    fork->run = 1;
+    fork->simulated = 1;
+    fork->this_id = gs->this_id;
+    fork->next_id = gs->this_id;
+    fork->role = gs->role;
+    fork->speed = gs->speed;
+    fork->fixed_physics = gs->fixed_physics;
+    fork->init_flags = gs->init_flags;
+    fork->net_mode = NET_MODE_NONE;
+    fork->sc = gs->sc;
+    vector_create(&fork->objects, sizeof(render_obj));
+    for(int i = 0; i < 3; i++) {
+        vector_create(&fork->render_lists[i], sizeof(object*));
+    }
+    vector_create(&fork->shadow_list, sizeof(object*));
+    fork->render_lists_dirty = 1;
+    vector_create(&fork->projectiles, sizeof(object*));
+    fork->projectiles_dirty = 1;
+    vector_create(&fork->tick_order, sizeof(object*));
+    fork->tick_order_dirty = 1;
+    particles_create(&fork->particles);
+    fork->speed_slowdown_time = -1;
+    for(int i = 0; i < TICK_HASH_HISTORY; i++) {
+        fork->tick_hash_ticks[i] = UINT_MAX;
+    }
+
+    // Forks are reset over and over, so keep the objects in a pool
+    mempool_create(&fork->obj_pool, sizeof(object), 32);
+    mempool_create(&fork->userdata_pool, USERDATA_BLOCK_SIZE, 32);
+
+    for(int i = 0; i < 2; i++) {
+        fork->players[i] = malloc(sizeof(game_player));
+        game_player_create(fork->players[i]);
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        fork->players[i]->ctrl = ctrl;
+    }
+    return 0;
+}
+
+// Stores the state of gs in buf, for game_state_fork_reset to start the fork from
+void game_state_fork_sync(game_state *fork, game_state *gs, serial *buf) {
+    serial_clear(buf);
+    game_state_serialize(gs, buf);
+    fork->this_id = gs->this_id;
+    for(int i = 0; i < 2; i++) {
+        fork->players[i]->god = gs->players[i]->god;
+        fork->players[i]->ez_destruct = gs->players[i]->ez_destruct;
+    }
+    fork->speed = gs->speed;
+    fork->fixed_physics = gs->fixed_physics;
+    fork->speed_slowdown_previous = gs->speed_slowdown_previous;
+    fork->speed_slowdown_time = gs->speed_slowdown_time;
+}
+
+void game_state_fork_reset(game_state *fork, serial *buf) {
+    // Leftovers like scrap and dust are not part of the serialized state
+    game_state_fork_clear(fork);
+    serial_read_reset(buf);
+    game_state_restore(fork, buf);
+}
+
+// Same steps as a dynamic tick of the real state, minus the scene and controllers
+void game_state_fork_tick(game_state *fork) {
+    game_state_cleanup(fork);
+    game_state_call_move(fork);
+    game_state_call_collide(fork);
+    game_state_call_tick(fork, TICK_DYNAMIC);
+    fork->tick++;
+}
+
+// Drops all objects of the fork. Nothing in it points into the scene after this.
+void game_state_fork_clear(game_state *fork) {
+    render_obj *robj;
+    iterator it;
+    vector_iter_begin(&fork->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        game_state_forget_object(fork, robj);
+    }
+    vector_clear(&fork->objects);
+    game_state_objects_changed(fork);
+    particles_clear(&fork->particles);
+    for(int i = 0; i < 2; i++) {
+        fork->players[i]->har = NULL;
+        fork->players[i]->ctrl->har = NULL;
+    }
+}
+
+void game_state_fork_free(game_state *fork) {
+    game_state_fork_clear(fork);
+    vector_free(&fork->objects);
+    game_state_free_render_lists(fork);
+    game_state_free_collide_table(fork);
+    particles_free(&fork->particles);
+    for(int i = 0; i < 2; i++) {
+        free(fork->players[i]->ctrl);
+        fork->players[i]->ctrl = NULL;
+        game_player_free(fork->players[i]);
+        free(fork->players[i]);
+    }
+    mempool_free(&fork->obj_pool);
+    mempool_free(&fork->userdata_pool);
+}
+
+/*
+ * Run-ahead hides the frames of startup that moves have before they show,
+ * which a local player otherwise feels as input latency. Before a frame is
+ * drawn, a fork of the game is run the given number of ticks ahead with the
+ * inputs held now, and the HARs and projectiles are drawn from there. The
+ * real state is never touched, so the simulation stays the same with or
+ * without it. Only for local fights; netplay has rollback instead.
+ */
+static int game_state_can_run_ahead(game_state *gs) {
+    if(gs->simulated || gs->net_mode != NET_MODE_NONE || gs->spectate != NULL || gs->rec_idx != NULL) {
+        return 0;
+    }
+    if(!is_arena(scene_to_resource(gs->this_id)) || game_state_is_paused(gs)) {
+        return 0;
+    }
+    int local = 0;
+    for(int i = 0; i < 2; i++) {
+        game_player *gp = game_state_get_player(gs, i);
+        controller *ctrl = game_player_get_ctrl(gp);
+        if(gp->har == NULL || ctrl == NULL || ctrl->type == CTRL_TYPE_REC) {
+            return 0;
+        }
+        if(ctrl->type == CTRL_TYPE_KEYBOARD || ctrl->type == CTRL_TYPE_GAMEPAD) {
+            local = 1;
+        }
+    }
+    return local;
+}
+
+void game_state_run_ahead(game_state *gs, int ticks) {
+    if(ticks > RUN_AHEAD_MAX_TICKS) {
+        ticks = RUN_AHEAD_MAX_TICKS;
+    }
+    if(ticks <= 0 || !game_state_can_run_ahead(gs)) {
+        gs->ahead_valid = 0;
+        return;
+    }
+    // Nothing happened since the last frame, so it would come out the same
+    if(gs->ahead_valid && gs->ahead_tick == gs->tick) {
+        return;
+    }
+
+    profiler_begin(PROF_RUN_AHEAD);
+    if(gs->ahead == NULL) {
+        gs->ahead = malloc(sizeof(game_state));
+        game_state_fork_create(gs->ahead, gs);
+        serial_create_size(&gs->ahead_state, GAME_STATE_SERIAL_SIZE_HINT);
+    }
+    game_state_fork_sync(gs->ahead, gs, &gs->ahead_state);
+    game_state_fork_reset(gs->ahead, &gs->ahead_state);
+    for(int t = 0; t < ticks; t++) {
+        for(int i = 0; i < 2; i++) {
+            object *har = game_state_get_player(gs->ahead, i)->har;
+            if(har != NULL) {
+                object_act(har, gs->last_action[i]);
+            }
+        }
+        game_state_fork_tick(gs->ahead);
+    }
+    profiler_count(PROF_CNT_RUN_AHEAD_TICKS, ticks);
+    gs->ahead_tick = gs->tick;
+    gs->ahead_valid = 1;
+    profiler_end(PROF_RUN_AHEAD);
+}
+
+// The fork shares the scene, so it has to go before the scene does
+static void game_state_run_ahead_stop(game_state *gs) {
+    gs->ahead_valid = 0;
+    if(gs->ahead != NULL) {
+        game_state_fork_free(gs->ahead);
+        free(gs->ahead);
+        serial_free(&gs->ahead_state);
+        gs->ahead = NULL;
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "game/gui/component.h"
 #include "utils/log.h"
+#include "utils/memtrack.h"
 
 void component_tick(component *c) {
     if(c->tick) {
@@ -10,9 +11,30 @@ void component_tick(component *c) {
 }
 
 void component_render(component *c) {
-    if(c->render) {
+    if(!c->render) {
+        return;
+    }
+
+    // Components that can't tell when they change must be redrawn every
+    // frame, and so must everything that contains them.
+    if(c->draw_list == NULL) {
+        if(c->parent != NULL) {
+            component_set_dirty(c->parent);
+        }
         c->render(c);
+        return;
+    }
+
+    // Nothing has changed, draw the last frame again
+    if(!c->is_dirty && video_draw_list_replay(c->draw_list) == 0) {
+        return;
     }
+
+    // Children may dirty us again while rendering, so clear the flag first
+    c->is_dirty = 0;
+    video_record_begin(c->draw_list);
+    c->render(c);
+    video_record_end(c->draw_list);
 }
 
 int component_event(component *c, SDL_Event *event) {
@@ -30,6 +52,7 @@ int component_action(component *c, int action) {
 }
 
 void component_layout(component *c, int x, int y, int w, int h) {
+    component_set_dirty(c);
     c->x = x;
     c->y = y;
     c->w = w;
@@ -42,18 +65,27 @@ void component_layout(component *c, int x, int y, int w, int h) {
 void component_disable(component *c, int disabled) {
     if(!c->supports_disable)
         return;
+    if(c->is_disabled != (disabled != 0)) {
+        component_set_dirty(c);
+    }
     c->is_disabled = (disabled != 0) ? 1 : 0;
 }
 
 void component_select(component *c, int selected) {
     if(!c->supports_select)
         return;
+    if(c->is_selected != (selected != 0)) {
+        component_set_dirty(c);
+    }
     c->is_selected = (selected != 0) ? 1 : 0;
 }
 
 void component_focus(component *c, int focused) {
     if(!c->supports_focus)
         return;
+    if(c->is_focused != (focused != 0)) {
+        component_set_dirty(c);
+    }
     c->is_focused = (focused != 0) ? 1 : 0;
 }
 
@@ -69,6 +101,25 @@ int component_is_focused(const component *c) {
     return c->is_focused;
 }
 
+// Makes the component keep its draws and replay them until it is marked dirty.
+// Only for components that mark themselves dirty on every visible change.
+void component_set_cached(component *c) {
+    if(c->draw_list != NULL) {
+        return;
+    }
+    c->draw_list = mem_malloc(MEM_TAG_GUI, sizeof(video_draw_list));
+    video_draw_list_create(c->draw_list);
+    c->is_dirty = 1;
+}
+
+// Marks the component and everything containing it for redraw
+void component_set_dirty(component *c) {
+    while(c != NULL) {
+        c->is_dirty = 1;
+        c = c->parent;
+    }
+}
+
 void component_set_size_hints(component *c, int w, int h) {
     c->w_hint = w;
     c->h_hint = h;
@@ -120,12 +171,13 @@ void component_set_find_cb(component *c, component_find_cb cb) {
 }
 
 component* component_create() {
-    component *c = malloc(sizeof(component));
+    component *c = mem_malloc(MEM_TAG_GUI, sizeof(component));
     memset(c, 0, sizeof(component));
     c->x_hint = -1;
     c->y_hint = -1;
     c->w_hint = -1;
     c->h_hint = -1;
+    c->is_dirty = 1;
     return c;
 }
 
@@ -136,5 +188,9 @@ void component_free(component *c) {
     if(c->free != NULL) {
         c->free(c);
     }
-    free(c);
+    if(c->draw_list != NULL) {
+        video_draw_list_free(c->draw_list);
+        mem_free(c->draw_list);
+    }
+    mem_free(c);
 }
@@ -7,5 +7,6 @@ component* filler_create() {
     c->supports_disable = 0;
     c->supports_select = 0;
     c->supports_focus = 0;
+    component_set_cached(c);
     return c;
 }
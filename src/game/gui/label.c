@@ -20,6 +20,7 @@ static void label_free(component *c) {
 
 void label_set_text(component *c, const char* text) {
     label *local = widget_get_obj(c);
+    component_set_dirty(c);
     if(local->text) {
         free(local->text);
     }
@@ -41,6 +42,7 @@ component* label_create(const text_settings *tconf, const char *text) {
     widget_set_obj(c, local);
     widget_set_render_cb(c, label_render);
     widget_set_free_cb(c, label_free);
+    component_set_cached(c);
 
     return c;
 }
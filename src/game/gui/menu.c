@@ -66,6 +66,8 @@ static void menu_tick(component *c) {
     // Check if we need to run submenu done -callback
     if(m->submenu != NULL && menu_is_finished(m->submenu)) {
         if(!m->prev_submenu_state) {
+            // Back to drawing this menu
+            component_set_dirty(c);
             if(m->submenu_done) {
                 m->submenu_done(c, m->submenu);
             }
@@ -175,14 +177,24 @@ static int menu_action(component *mc, int action) {
     return 1;
 }
 
+static int menu_is_kept(const menu *m, const component *submenu) {
+    for(int i = 0; i < MENU_SUBMENU_SLOTS; i++) {
+        if(m->kept[i] == submenu) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void menu_set_submenu(component *mc, component *submenu) {
     menu *m = sizer_get_obj(mc);
-    if(m->submenu) {
+    if(m->submenu && m->submenu != submenu && !menu_is_kept(m, m->submenu)) {
         component_free(m->submenu);
     }
     m->submenu = submenu;
     m->prev_submenu_state = 0;
     submenu->parent = mc; // Set correct parent
+    component_set_dirty(mc);
     component_layout(m->submenu, mc->x, mc->y, mc->w, mc->h);
 }
 
@@ -191,6 +203,37 @@ component* menu_get_submenu(const component *c) {
     return m->submenu;
 }
 
+void menu_set_kept_submenu(component *mc, int slot, component *submenu) {
+    menu *m = sizer_get_obj(mc);
+    if(m->kept[slot] != NULL && m->kept[slot] != submenu) {
+        component *old = m->kept[slot];
+        m->kept[slot] = NULL;
+        if(m->submenu != old) {
+            component_free(old);
+        }
+    }
+    menu_set_submenu(mc, submenu);
+    m->kept[slot] = submenu;
+}
+
+component* menu_get_kept_submenu(const component *mc, int slot) {
+    menu *m = sizer_get_obj(mc);
+    component *c = m->kept[slot];
+    if(c == NULL) {
+        return NULL;
+    }
+
+    // Back to how it was when created; layout selects the first item again
+    menu *sm = sizer_get_obj(c);
+    component *selected = sizer_get(c, sm->selected);
+    if(selected != NULL) {
+        component_select(selected, 0);
+        component_focus(selected, 0);
+    }
+    sm->finished = 0;
+    return c;
+}
+
 int menu_is_finished(const component *c) {
     menu *m = sizer_get_obj(c);
     return m->finished;
@@ -252,9 +295,14 @@ static void menu_free(component *c) {
         surface_free(m->bg);
         free(m->bg);
     }
-    if(m->submenu) {
+    if(m->submenu && !menu_is_kept(m, m->submenu)) {
         component_free(m->submenu); // Free submenu component
     }
+    for(int i = 0; i < MENU_SUBMENU_SLOTS; i++) {
+        if(m->kept[i]) {
+            component_free(m->kept[i]);
+        }
+    }
     if(m->free) {
         m->free(c); // Free menu userdata
     }
@@ -285,6 +333,7 @@ component* menu_create(int obj_h) {
     sizer_set_layout_cb(c, menu_layout);
     sizer_set_free_cb(c, menu_free);
     sizer_set_find_cb(c, menu_find);
+    component_set_cached(c);
 
     return c;
 }
@@ -11,7 +11,97 @@
 #define COLOR_MENU_BORDER2 color_create(0,93,0,255)
 #define COLOR_MENU_BG     color_create(4,4,16,210)
 
+// Backgrounds are drawn once per style and size, and shared after that.
+// Sharing the pixels also shares the texture made of them.
+#define MENU_BG_CACHE_SIZE 16
+
+enum {
+    MENU_BG_STYLE_GRID,
+    MENU_BG_STYLE_GRID2,
+    MENU_BG_STYLE_BORDER,
+};
+
+typedef struct menu_bg_cached_t {
+    int style;
+    int w;
+    int h;
+    unsigned int last_use;
+    surface sur;
+} menu_bg_cached;
+
+static menu_bg_cached cached[MENU_BG_CACHE_SIZE];
+static int cached_count = 0;
+static unsigned int use_clock = 0;
+
+// Finds a slot for a new background: a free one, or the one unused the
+// longest that nobody else holds anymore. NULL if all are in use.
+static menu_bg_cached* menu_background_slot() {
+    if(cached_count < MENU_BG_CACHE_SIZE) {
+        return &cached[cached_count++];
+    }
+    menu_bg_cached *oldest = NULL;
+    for(int i = 0; i < cached_count; i++) {
+        menu_bg_cached *c = &cached[i];
+        if(c->sur.refs != NULL && SDL_AtomicGet(c->sur.refs) > 1) {
+            continue;
+        }
+        if(oldest == NULL || c->last_use < oldest->last_use) {
+            oldest = c;
+        }
+    }
+    if(oldest != NULL) {
+        surface_free(&oldest->sur);
+    }
+    return oldest;
+}
+
+static void menu_background_draw(surface *s, int style, int w, int h);
+
+static void menu_background_get(surface *s, int style, int w, int h) {
+    use_clock++;
+    for(int i = 0; i < cached_count; i++) {
+        menu_bg_cached *c = &cached[i];
+        if(c->style == style && c->w == w && c->h == h) {
+            c->last_use = use_clock;
+            surface_share(s, &c->sur);
+            return;
+        }
+    }
+    menu_bg_cached *c = menu_background_slot();
+    if(c == NULL) {
+        menu_background_draw(s, style, w, h);
+        return;
+    }
+    c->style = style;
+    c->w = w;
+    c->h = h;
+    c->last_use = use_clock;
+    menu_background_draw(&c->sur, style, w, h);
+    surface_share(s, &c->sur);
+}
+
+void menu_background_cache_clear() {
+    for(int i = 0; i < cached_count; i++) {
+        surface_free(&cached[i].sur);
+    }
+    cached_count = 0;
+}
+
 void menu_background_create(surface *s, int w, int h) {
+    menu_background_get(s, MENU_BG_STYLE_GRID, w, h);
+}
+
+// the *other* style menu background
+void menu_background2_create(surface *s, int w, int h) {
+    menu_background_get(s, MENU_BG_STYLE_GRID2, w, h);
+}
+
+// create a transparent background with only the borders
+void menu_background_border_create(surface *s, int w, int h) {
+    menu_background_get(s, MENU_BG_STYLE_BORDER, w, h);
+}
+
+static void menu_background_grid(surface *s, int w, int h) {
     image img;
     image_create(&img, w, h);
     image_clear(&img, COLOR_MENU_BG);
@@ -26,8 +116,7 @@ void menu_background_create(surface *s, int w, int h) {
     image_free(&img);
 }
 
-// the *other* style menu background
-void menu_background2_create(surface *s, int w, int h) {
+static void menu_background_grid2(surface *s, int w, int h) {
     image img;
     image_create(&img, w, h);
     image_clear(&img, COLOR_MENU_BG);
@@ -43,8 +132,7 @@ void menu_background2_create(surface *s, int w, int h) {
     image_free(&img);
 }
 
-// create a transparent background with only the borders
-void menu_background_border_create(surface *s, int w, int h) {
+static void menu_background_border(surface *s, int w, int h) {
     image img;
     image_create(&img, w, h);
     image_clear(&img, color_create(0,0,0,0));
@@ -52,3 +140,11 @@ void menu_background_border_create(surface *s, int w, int h) {
     surface_create_from_image(s, &img);
     image_free(&img);
 }
+
+static void menu_background_draw(surface *s, int style, int w, int h) {
+    switch(style) {
+        case MENU_BG_STYLE_GRID: menu_background_grid(s, w, h); break;
+        case MENU_BG_STYLE_GRID2: menu_background_grid2(s, w, h); break;
+        case MENU_BG_STYLE_BORDER: menu_background_border(s, w, h); break;
+    }
+}
@@ -1,5 +1,7 @@
-#include <shadowdive/shadowdive.h>
-#include "resources/pathmanager.h"
+#include <stdlib.h>
+#include <string.h>
+#include "resources/ids.h"
+#include "resources/rescache.h"
 #include "resources/sprite.h"
 #include "game/gui/pilotpic.h"
 #include "game/gui/widget.h"
@@ -9,64 +11,46 @@
 
 // Local small gauge type
 typedef struct {
-    sprite *img;
+    pic *pics; // Reference to the cached PIC file
+    sprite *img; // Owned by pics
 } pilotpic;
 
 static void pilotpic_render(component *c) {
     pilotpic *g = widget_get_obj(c);
     if(g->img != NULL) {
-        video_render_sprite(g->img->data, c->x, c->y, BLEND_ALPHA, 0);
+        video_render_sprite(sprite_get_surface(g->img), c->x, c->y, BLEND_ALPHA, 0);
     }
 }
 
 static void pilotpic_free(component *c) {
     pilotpic *g = widget_get_obj(c);
-    sprite_free(g->img);
-    free(g->img);
+    rescache_release(g->pics);
     free(g);
 }
 
 void pilotpic_select(component *c, int pic_id, int pilot_id) {
     pilotpic *local = widget_get_obj(c);
 
-    // Free old image
-    if(local->img != NULL) {
-        sprite_free(local->img);
-        free(local->img);
-    }
-
-    // Find pic file handle
-    const char *filename = pm_get_resource_path(pic_id);
-    if(filename == NULL) {
-        PERROR("Could not find requested PIC file handle.");
+    // The photos are decoded once and kept in the resource cache. The new
+    // reference is taken first, so that the file stays cached when only
+    // the photo changes.
+    pic *pics = rescache_get_pic(pic_id);
+    rescache_release(local->pics);
+    local->pics = pics;
+    local->img = NULL;
+    if(pics == NULL) {
         return;
     }
-
-    // Load PIC file and make a surface
-    sd_pic_file pics;
-    sd_pic_create(&pics);
-    int ret = sd_pic_load(&pics, filename);
-    if(ret != SD_SUCCESS) {
-        PERROR("Could not load PIC file %s: %s", filename, sd_get_error(ret));
+    local->img = pic_get_photo(pics, pilot_id);
+    if(local->img == NULL) {
+        PERROR("PIC file %s has no picture %d.", get_resource_name(pic_id), pilot_id);
         return;
-    } else {
-        DEBUG("PIC file %s loaded, selecting picture %d.", get_resource_name(pic_id), pilot_id);
     }
 
-    // Create new
-    const sd_pic_photo *photo = sd_pic_get(&pics, pilot_id);
-    local->img = malloc(sizeof(sprite));
-    sprite_create(local->img, photo->sprite, -1);
-
     // Position and size hints for the gui component
     // These are set on layout function call
-    component_set_size_hints(
-        c,
-        local->img->data->w,
-        local->img->data->h);
-
-    // Free pics
-    sd_pic_free(&pics);
+    vec2i size = sprite_get_size(local->img);
+    component_set_size_hints(c, size.x, size.y);
 }
 
 component* pilotpic_create(int pic_id, int pilot_id) {
@@ -88,5 +72,3 @@ component* pilotpic_create(int pic_id, int pilot_id) {
     pilotpic_select(c, pic_id, pilot_id);
     return c;
 }
-
-
@@ -40,7 +40,7 @@ const progressbar_theme _progressbar_theme_melee = {
 typedef struct {
     surface *background;
     surface *background_alt;
-    surface *block;
+    surface *block; // Full width; only as much of it as the progress covers is drawn
     int orientation;
     int percentage;
     progressbar_theme theme;
@@ -48,15 +48,11 @@ typedef struct {
     int rate;
     int state;
     int tick;
-    int refresh;
 } progressbar;
 
 void progressbar_set_progress(component *c, int percentage) {
     progressbar *bar = widget_get_obj(c);
-    int tmp = clamp(percentage, 0, 100);
-    if(!bar->refresh)
-        bar->refresh = (tmp != bar->percentage);
-    bar->percentage = tmp;
+    bar->percentage = clamp(percentage, 0, 100);
 }
 
 void progressbar_set_flashing(component *c, int flashing, int rate) {
@@ -72,42 +68,6 @@ void progressbar_set_flashing(component *c, int flashing, int rate) {
 static void progressbar_render(component *c) {
     progressbar *bar = widget_get_obj(c);
 
-    // If necessary, refresh the progress block
-    if(bar->refresh) {
-        bar->refresh = 0;
-
-        // Free old block first ...
-        if(bar->block) {
-            surface_free(bar->block);
-        }
-
-        // ... Then draw the new one
-        float prog = bar->percentage / 100.0f;
-        int w = c->w * prog;
-        int h = c->h;
-        if(w > 1 && h > 1) {
-            image tmp;
-            image_create(&tmp, w, h);
-            image_clear(&tmp, bar->theme.int_bg_color);
-            image_rect_bevel(&tmp,
-                             0, 0,
-                             w - 1, h - 1,
-                             bar->theme.int_topleft_color,
-                             bar->theme.int_bottomright_color,
-                             bar->theme.int_bottomright_color,
-                             bar->theme.int_topleft_color);
-            if(bar->block == NULL) {
-                bar->block = malloc(sizeof(surface));
-            }
-            surface_create_from_image(bar->block, &tmp);
-            surface_force_refresh(bar->block);
-            image_free(&tmp);
-        } else {
-            free(bar->block);
-            bar->block = NULL;
-        }
-    }
-
     // Render backgrond (flashing or not)
     if(bar->state) {
         video_render_sprite(bar->background_alt, c->x, c->y, BLEND_ALPHA, 0);
@@ -115,14 +75,17 @@ static void progressbar_render(component *c) {
         video_render_sprite(bar->background, c->x, c->y, BLEND_ALPHA, 0);
     }
 
-    // Render block
-    if(bar->block != NULL) {
-        video_render_sprite(
-            bar->block,
-            c->x + (bar->orientation == PROGRESSBAR_LEFT ? 0 : c->w - bar->block->w + 1),
-            c->y,
-            BLEND_ALPHA,
-            0);
+    // Render block. A narrower bevel looks the same as the full one with the
+    // columns before its right edge left out, so the block is drawn in two
+    // parts and its texture stays the same whatever the progress is.
+    int w = c->w * (bar->percentage / 100.0f);
+    if(bar->block != NULL && w > 1) {
+        color tint = color_create(0xFF, 0xFF, 0xFF, 0xFF);
+        int x = c->x + (bar->orientation == PROGRESSBAR_LEFT ? 0 : c->w - w + 1);
+        int h = bar->block->h;
+        video_render_sprite_part_opacity_tint(bar->block, x, c->y, 0, 0, w - 1, h, BLEND_ALPHA, 0xFF, tint);
+        video_render_sprite_part_opacity_tint(bar->block, x + w - 1, c->y, bar->block->w - 1, 0, 1, h,
+                                              BLEND_ALPHA, 0xFF, tint);
     }
 }
 
@@ -181,6 +144,21 @@ static void progressbar_layout(component *c, int x, int y, int w, int h) {
                      bar->theme.border_topleft_color);
     surface_create_from_image(bar->background_alt, &tmp);
     image_free(&tmp);
+
+    // Progress block
+    if(w > 1 && h > 1) {
+        bar->block = malloc(sizeof(surface));
+        image_create(&tmp, w, h);
+        image_clear(&tmp, bar->theme.int_bg_color);
+        image_rect_bevel(&tmp,
+                         0, 0, w-1, h-1,
+                         bar->theme.int_topleft_color,
+                         bar->theme.int_bottomright_color,
+                         bar->theme.int_bottomright_color,
+                         bar->theme.int_topleft_color);
+        surface_create_from_image(bar->block, &tmp);
+        image_free(&tmp);
+    }
 }
 
 component* progressbar_create(progressbar_theme theme, int orientation, int percentage) {
@@ -194,7 +172,6 @@ component* progressbar_create(progressbar_theme theme, int orientation, int perc
     local->theme = theme;
     local->orientation = clamp(orientation, 0, 1);
     local->percentage = clamp(percentage, 0, 100);
-    local->refresh = 1;
 
     widget_set_obj(c, local);
     widget_set_render_cb(c, progressbar_render);
@@ -1,4 +1,5 @@
 #include "game/gui/sizer.h"
+#include "utils/memarena.h"
 
 component* sizer_get(const component *nc, int item) {
     sizer *local = component_get_obj(nc);
@@ -64,6 +65,7 @@ void sizer_attach(component *c, component *nc) {
     sizer *local = component_get_obj(c);
     nc->parent = c;
     vector_append(&local->objs, &nc);
+    component_set_dirty(c);
 }
 
 static void sizer_tick(component *c) {
@@ -168,7 +170,7 @@ component* sizer_create() {
 
     sizer *local = malloc(sizeof(sizer));
     memset(local, 0, sizeof(sizer));
-    vector_create(&local->objs, sizeof(component*));
+    vector_create_with_allocator(&local->objs, sizeof(component*), memarena_scene_allocator());
     component_set_obj(c, local);
 
     component_set_tick_cb(c, sizer_tick);
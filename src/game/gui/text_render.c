@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
@@ -5,55 +6,333 @@
 #include "game/gui/text_render.h"
 #include "video/video.h"
 #include "utils/vector.h"
+#include "utils/hashmap.h"
+#include "utils/iterator.h"
 #include "utils/log.h"
 
-void text_defaults(text_settings *settings) {
-    memset(settings, 0, sizeof(text_settings));
-    settings->cforeground = color_create(0xFF,0xFF,0xFF,0xFF);
-    settings->opacity = 0xFF;
+/*
+ * Text layout cache
+ *
+ * Layouts are keyed by the font, the layout settings, the box size and the
+ * string itself. Colors and opacity are not part of the key, so highlight
+ * changes and fades reuse the same entry. Once a layout has been drawn a
+ * couple of times all of its glyphs and shadows are composited into a single
+ * white RGBA surface that gets tinted at draw time, so static text costs one
+ * texture draw per frame instead of up to five per glyph.
+ */
+
+#define TEXT_CACHE_SIZE 256
+#define TEXT_CACHE_MAX_STRLEN 1024
+#define TEXT_CACHE_HITS_TO_COMPOSITE 2
+
+enum {
+    LAYOUT_TEXT = 0,
+    LAYOUT_LINE,
+    LAYOUT_WRAPPED
+};
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    char ch;
+} text_glyph;
+
+typedef struct {
+    vector glyphs; // Glyph positions relative to the box origin
+    surface *sur;  // Composited glyphs, or NULL if not built yet
+    int sur_x;
+    int sur_y;
+    int w; // Measured size, only for the old wrapped renderer
+    int h;
+    unsigned int hits;
+    unsigned int last_used;
+    int cached;
+} text_layout;
+
+typedef struct {
+    const font *font;
+    int kind;
+    int w;
+    int h;
+    int valign;
+    int halign;
+    int direction;
+    uint8_t padding[4];
+    uint8_t shadow;
+    uint8_t cspacing;
+    uint8_t lspacing;
+    uint8_t wrap;
+} text_layout_key;
+
+static hashmap text_cache;
+static int text_cache_ready = 0;
+static unsigned int text_cache_clock = 0;
+
+static const font* text_font(const text_settings *settings) {
+    return (settings->font == FONT_BIG) ? &font_large : &font_small;
 }
 
-void text_render_char(const text_settings *settings, int x, int y, char ch) {
-    // Make sure code is valid
+// Returns the glyph index of ch, or -1 if the font has nothing for it
+static int text_glyph_code(const font *font, char ch) {
     int code = ch - 32;
-    surface **sur = NULL;
+    if(code < 0 || code >= (int)vector_size(&font->surfaces)) {
+        return -1;
+    }
+    return code;
+}
+
+static surface* text_glyph_surface(const font *font, char ch) {
+    int code = text_glyph_code(font, ch);
     if(code < 0) {
+        return NULL;
+    }
+    surface **sur = vector_get(&font->surfaces, code);
+    return *sur;
+}
+
+// Draws from the font atlas when there is one, so that consecutive glyphs
+// share a texture and end up in the same render batch.
+static void text_blit_glyph(const font *font, int code, int x, int y, uint8_t opacity, color c) {
+    if(font->atlas != NULL) {
+        int ax, ay;
+        font_get_atlas_pos(font, code, &ax, &ay);
+        video_render_sprite_part_opacity_tint(
+            font->atlas, x, y, ax, ay, font->w, font->h, BLEND_ALPHA, opacity, c);
+    } else {
+        surface **sur = vector_get(&font->surfaces, code);
+        video_render_sprite_flip_scale_opacity_tint(
+            *sur, x, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, opacity, c);
+    }
+}
+
+static void text_render_glyph(const font *font, int code, int x, int y, int shadow, uint8_t opacity, color c) {
+    // Handle shadows if necessary
+    uint8_t shadow_opacity = (opacity / 255.0f) * 80;
+    if(shadow & TEXT_SHADOW_RIGHT)
+        text_blit_glyph(font, code, x+1, y, shadow_opacity, c);
+    if(shadow & TEXT_SHADOW_LEFT)
+        text_blit_glyph(font, code, x-1, y, shadow_opacity, c);
+    if(shadow & TEXT_SHADOW_BOTTOM)
+        text_blit_glyph(font, code, x, y+1, shadow_opacity, c);
+    if(shadow & TEXT_SHADOW_TOP)
+        text_blit_glyph(font, code, x, y-1, shadow_opacity, c);
+
+    // Handle the font face itself
+    text_blit_glyph(font, code, x, y, opacity, c);
+}
+
+static void text_layout_emit(vector *glyphs, int x, int y, char ch) {
+    // Spaces and control characters have nothing to draw
+    if(ch - 32 <= 0) {
         return;
     }
+    text_glyph g;
+    g.x = x;
+    g.y = y;
+    g.ch = ch;
+    vector_append(glyphs, &g);
+}
 
-    // Select font face surface
-    if(settings->font == FONT_BIG) {
-        sur = vector_get(&font_large.surfaces, code);
+static void text_layout_free(text_layout *layout) {
+    vector_free(&layout->glyphs);
+    if(layout->sur != NULL) {
+        surface_free(layout->sur);
+        free(layout->sur);
+        layout->sur = NULL;
     }
-    if(settings->font == FONT_SMALL) {
-        sur = vector_get(&font_small.surfaces, code);
+}
+
+static void text_cache_evict_oldest() {
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_pair *oldest = NULL;
+    hashmap_iter_begin(&text_cache, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        text_layout *layout = pair->val;
+        if(oldest == NULL || layout->last_used < ((text_layout*)oldest->val)->last_used) {
+            oldest = pair;
+        }
     }
-    if(sur == NULL || *sur == NULL) {
+    if(oldest != NULL) {
+        text_layout_free(oldest->val);
+        hashmap_del(&text_cache, oldest->key, oldest->keylen);
+    }
+}
+
+// Finds the layout for key + text. On a miss a new empty layout is returned
+// and *found is set to 0; the caller is expected to fill in the glyphs. Text
+// that is too long to key on gets the caller's scratch layout, which must be
+// freed after drawing.
+static text_layout* text_cache_get(const text_layout_key *key, const char *text, int len,
+                                   text_layout *scratch, int *found) {
+    char keybuf[sizeof(text_layout_key) + TEXT_CACHE_MAX_STRLEN];
+    text_layout *layout;
+    unsigned int vlen;
+
+    if(!text_cache_ready) {
+        hashmap_create(&text_cache, 9);
+        text_cache_ready = 1;
+    }
+    text_cache_clock++;
+
+    if(len <= TEXT_CACHE_MAX_STRLEN) {
+        unsigned int klen = sizeof(text_layout_key) + len;
+        memcpy(keybuf, key, sizeof(text_layout_key));
+        memcpy(keybuf + sizeof(text_layout_key), text, len);
+        if(hashmap_get(&text_cache, keybuf, klen, (void**)&layout, &vlen) == 0) {
+            layout->hits++;
+            layout->last_used = text_cache_clock;
+            *found = 1;
+            return layout;
+        }
+        if(hashmap_reserved(&text_cache) >= TEXT_CACHE_SIZE) {
+            text_cache_evict_oldest();
+        }
+        text_layout tmp;
+        memset(&tmp, 0, sizeof(text_layout));
+        layout = hashmap_put(&text_cache, keybuf, klen, &tmp, sizeof(text_layout));
+        layout->cached = 1;
+    } else {
+        layout = scratch;
+        memset(layout, 0, sizeof(text_layout));
+    }
+    vector_create(&layout->glyphs, sizeof(text_glyph));
+    layout->hits = 1;
+    layout->last_used = text_cache_clock;
+    *found = 0;
+    return layout;
+}
+
+// Blends an alpha glyph over dst with extra alpha. dst must contain the glyph.
+// Everything is white, so only the coverage adds up.
+static void text_composite_glyph(surface *dst, const surface *src, int dx, int dy, int alpha) {
+    for(int y = 0; y < src->h; y++) {
+        const uint8_t *s = (const uint8_t*)src->data + y * src->w;
+        uint8_t *d = (uint8_t*)dst->data + (dy + y) * dst->w + dx;
+        for(int x = 0; x < src->w; x++, s++, d++) {
+            int a = *s * alpha / 255;
+            if(a == 0) {
+                continue;
+            }
+            *d = a + *d * (255 - a) / 255;
+        }
+    }
+}
+
+static void text_layout_composite(text_layout *layout, const font *font, int shadow) {
+    int count = vector_size(&layout->glyphs);
+    if(count == 0) {
         return;
     }
 
-    // Handle shadows if necessary
-    float of = settings->opacity / 255.0f;
-    if(settings->shadow & TEXT_SHADOW_RIGHT)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x+1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, of * 80, settings->cforeground
-        );
-    if(settings->shadow & TEXT_SHADOW_LEFT)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x-1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, of * 80, settings->cforeground
-        );
-    if(settings->shadow & TEXT_SHADOW_BOTTOM)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y+1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, of * 80, settings->cforeground
-        );
-    if(settings->shadow & TEXT_SHADOW_TOP)
+    // Find the bounding box of all glyphs and their shadows
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for(int i = 0; i < count; i++) {
+        text_glyph *g = vector_get(&layout->glyphs, i);
+        if(i == 0 || g->x < x0) x0 = g->x;
+        if(i == 0 || g->y < y0) y0 = g->y;
+        if(i == 0 || g->x + font->w > x1) x1 = g->x + font->w;
+        if(i == 0 || g->y + font->h > y1) y1 = g->y + font->h;
+    }
+    if(shadow & TEXT_SHADOW_LEFT) x0--;
+    if(shadow & TEXT_SHADOW_RIGHT) x1++;
+    if(shadow & TEXT_SHADOW_TOP) y0--;
+    if(shadow & TEXT_SHADOW_BOTTOM) y1++;
+
+    layout->sur = malloc(sizeof(surface));
+    surface_create(layout->sur, SURFACE_TYPE_ALPHA, x1 - x0, y1 - y0);
+    surface_clear(layout->sur);
+    layout->sur_x = x0;
+    layout->sur_y = y0;
+
+    // Same passes as text_render_glyph; the tint is applied when drawing
+    for(int i = 0; i < count; i++) {
+        text_glyph *g = vector_get(&layout->glyphs, i);
+        surface *src = text_glyph_surface(font, g->ch);
+        if(src == NULL || src->w > font->w || src->h > font->h) {
+            continue;
+        }
+        int gx = g->x - x0;
+        int gy = g->y - y0;
+        if(shadow & TEXT_SHADOW_RIGHT)
+            text_composite_glyph(layout->sur, src, gx+1, gy, 80);
+        if(shadow & TEXT_SHADOW_LEFT)
+            text_composite_glyph(layout->sur, src, gx-1, gy, 80);
+        if(shadow & TEXT_SHADOW_BOTTOM)
+            text_composite_glyph(layout->sur, src, gx, gy+1, 80);
+        if(shadow & TEXT_SHADOW_TOP)
+            text_composite_glyph(layout->sur, src, gx, gy-1, 80);
+        text_composite_glyph(layout->sur, src, gx, gy, 255);
+    }
+}
+
+static void text_layout_draw(text_layout *layout, const font *font, int shadow,
+                             int x, int y, uint8_t opacity, color c) {
+    // Faded text stacks its passes differently than a composited surface
+    // would, so only fully opaque text uses the composite.
+    if(opacity == 255 && layout->cached && layout->sur == NULL
+       && layout->hits >= TEXT_CACHE_HITS_TO_COMPOSITE) {
+        text_layout_composite(layout, font, shadow);
+    }
+    if(opacity == 255 && layout->sur != NULL) {
         video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y-1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, of * 80, settings->cforeground
-        );
+            layout->sur, x + layout->sur_x, y + layout->sur_y,
+            BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 255, c);
+        return;
+    }
 
-    // Handle the font face itself
-    video_render_sprite_flip_scale_opacity_tint(
-        *sur, x, y, BLEND_ALPHA, 0, FLIP_NONE, 1, settings->opacity, settings->cforeground);
+    iterator it;
+    text_glyph *g;
+    vector_iter_begin(&layout->glyphs, &it);
+    while((g = iter_next(&it)) != NULL) {
+        int code = text_glyph_code(font, g->ch);
+        if(code >= 0) {
+            text_render_glyph(font, code, x + g->x, y + g->y, shadow, opacity, c);
+        }
+    }
+}
+
+static void text_layout_done(text_layout *layout) {
+    if(!layout->cached) {
+        text_layout_free(layout);
+    }
+}
+
+void text_cache_clear() {
+    if(!text_cache_ready) {
+        return;
+    }
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&text_cache, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        text_layout_free(pair->val);
+    }
+    hashmap_clear(&text_cache);
+}
+
+void text_cache_close() {
+    if(!text_cache_ready) {
+        return;
+    }
+    text_cache_clear();
+    hashmap_free(&text_cache);
+    text_cache_ready = 0;
+}
+
+void text_defaults(text_settings *settings) {
+    memset(settings, 0, sizeof(text_settings));
+    settings->cforeground = color_create(0xFF,0xFF,0xFF,0xFF);
+    settings->opacity = 0xFF;
+}
+
+void text_render_char(const text_settings *settings, int x, int y, char ch) {
+    const font *font = text_font(settings);
+    int code = text_glyph_code(font, ch);
+    if(code < 0) {
+        return;
+    }
+    text_render_glyph(font, code, x, y, settings->shadow, settings->opacity, settings->cforeground);
 }
 
 int text_find_max_strlen(int maxchars, const char *ptr) {
@@ -114,8 +393,7 @@ int text_find_line_count(text_direction dir, int cols, int rows, int len, const
     return lines;
 }
 
-void text_render(const text_settings *settings, int x, int y, int w, int h, const char *text) {
-    int len = strlen(text);
+static void text_layout_build(const text_settings *settings, int w, int h, const char *text, int len, vector *glyphs) {
 
     int size = text_char_width(settings);
     int xspace = w - settings->padding.left - settings->padding.right;
@@ -126,8 +404,8 @@ void text_render(const text_settings *settings, int x, int y, int w, int h, cons
     int cols = (xspace + settings->cspacing) / charw;
     int fit_lines = text_find_line_count(settings->direction, cols, rows, len, text);
 
-    int start_x = x + settings->padding.left;
-    int start_y = y + settings->padding.top;
+    int start_x = settings->padding.left;
+    int start_y = settings->padding.top;
     int tmp_s = 0;
 
     // Initial alignment for whole text block
@@ -225,8 +503,8 @@ void text_render(const text_settings *settings, int x, int y, int w, int h, cons
             if(text[ptr+k] == '\n')
                 continue;
 
-            // Render character
-            text_render_char(settings, mx + start_x, my + start_y, text[ptr+k]);
+            // Place character
+            text_layout_emit(glyphs, mx + start_x, my + start_y, text[ptr+k]);
 
             // Render to the right direction
             if(settings->direction == TEXT_HORIZONTAL) {
@@ -241,43 +519,65 @@ void text_render(const text_settings *settings, int x, int y, int w, int h, cons
     }
 }
 
+void text_render(const text_settings *settings, int x, int y, int w, int h, const char *text) {
+    int len = strlen(text);
+    text_layout_key key;
+    memset(&key, 0, sizeof(text_layout_key));
+    key.font = text_font(settings);
+    key.kind = LAYOUT_TEXT;
+    key.w = w;
+    key.h = h;
+    key.valign = settings->valign;
+    key.halign = settings->halign;
+    key.direction = settings->direction;
+    key.padding[0] = settings->padding.left;
+    key.padding[1] = settings->padding.right;
+    key.padding[2] = settings->padding.top;
+    key.padding[3] = settings->padding.bottom;
+    key.shadow = settings->shadow;
+    key.cspacing = settings->cspacing;
+    key.lspacing = settings->lspacing;
+    key.wrap = settings->wrap;
+
+    text_layout scratch;
+    int found;
+    text_layout *layout = text_cache_get(&key, text, len, &scratch, &found);
+    if(!found) {
+        text_layout_build(settings, w, h, text, len, &layout->glyphs);
+    }
+    text_layout_draw(layout, key.font, settings->shadow, x, y,
+                     settings->opacity, settings->cforeground);
+    text_layout_done(layout);
+}
+
 /// ---------------- OLD RENDERER FUNCTIONS ---------------------
 
+static void font_layout_key(text_layout_key *key, const font *font, int kind, int max_w, int shadow_flags) {
+    memset(key, 0, sizeof(text_layout_key));
+    key->font = font;
+    key->kind = kind;
+    key->w = max_w;
+    key->shadow = shadow_flags;
+}
+
+static void font_layout_len(const font *font, const char *text, int len, int x, int y, vector *glyphs) {
+    int pos_x = x;
+    for(int i = 0; i < len; i++) {
+        text_layout_emit(glyphs, pos_x, y, text[i]);
+        pos_x += font->w;
+    }
+}
+
 void font_render_char(const font *font, char ch, int x, int y, color c) {
     font_render_char_shadowed(font, ch, x, y, c, 0);
 }
 
 void font_render_char_shadowed(const font *font, char ch, int x, int y, color c, int shadow_flags) {
-    // Make sure code is valid
-    int code = ch - 32;
-    surface **sur = NULL;
-    if (code < 0) {
+    int code = text_glyph_code(font, ch);
+    if(code < 0) {
         return;
     }
-
-    // Get font face
-    sur = vector_get(&font->surfaces, code);
-
-    // Handle shadows if necessary
-    if(shadow_flags & TEXT_SHADOW_RIGHT)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x+1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
-        );
-    if(shadow_flags & TEXT_SHADOW_LEFT)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x-1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
-        );
-    if(shadow_flags & TEXT_SHADOW_BOTTOM)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y+1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
-        );
-    if(shadow_flags & TEXT_SHADOW_TOP)
-        video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y-1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
-        );
-
-    // Handle the font face itself
-    video_render_sprite_tint(*sur, x, y, c, 0);
+    text_render_glyph(font, code, x, y, shadow_flags, 255, c);
 }
 
 void font_render_len(const font *font, const char *text, int len, int x, int y, color c) {
@@ -285,11 +585,17 @@ void font_render_len(const font *font, const char *text, int len, int x, int y,
 }
 
 void font_render_len_shadowed(const font *font, const char *text, int len, int x, int y, color c, int shadow_flags) {
-    int pos_x = x;
-    for(int i = 0; i < len; i++) {
-        font_render_char_shadowed(font, text[i], pos_x, y, c, shadow_flags);
-        pos_x += font->w;
+    text_layout_key key;
+    font_layout_key(&key, font, LAYOUT_LINE, 0, shadow_flags);
+
+    text_layout scratch;
+    int found;
+    text_layout *layout = text_cache_get(&key, text, len, &scratch, &found);
+    if(!found) {
+        font_layout_len(font, text, len, 0, 0, &layout->glyphs);
     }
+    text_layout_draw(layout, font, shadow_flags, x, y, 255, c);
+    text_layout_done(layout);
 }
 
 void font_render(const font *font, const char *text, int x, int y, color c) {
@@ -306,8 +612,7 @@ void font_render_wrapped(const font *font, const char *text, int x, int y, int w
     font_render_wrapped_shadowed(font, text, x, y, w, c, 0);
 }
 
-void font_render_wrapped_internal(const font *font, const char *text, int x, int y, int max_w, color c, int shadow_flags, int only_size, int *out_w, int *out_h) {
-    int len = strlen(text);
+static void font_layout_wrapped(const font *font, const char *text, int len, int max_w, int shadow_flags, vector *glyphs, int *out_w, int *out_h) {
     int has_newline = 0;
     for(int i = 0;i < len;i++) {
         if(text[i] == '\n' || text[i] == '\r') {
@@ -318,10 +623,8 @@ void font_render_wrapped_internal(const font *font, const char *text, int x, int
     if(!has_newline && font->w*len < max_w) {
         // short enough text that we don't need to wrap
         // render it centered, at least for now
-        if(!only_size) {
-            int xoff = (max_w - font->w*len)/2;
-            font_render_len_shadowed(font, text, len, x + xoff, y, c, shadow_flags);
-        }
+        int xoff = (max_w - font->w*len)/2;
+        font_layout_len(font, text, len, xoff, 0, glyphs);
         *out_w = font->w*len;
         *out_h = font->h;
     } else {
@@ -382,10 +685,8 @@ void font_render_wrapped_internal(const font *font, const char *text, int x, int
             if(shadow_flags & TEXT_SHADOW_TOP) {
                 yoff++;
             }
-            if(!only_size) {
-                int xoff = (max_w - font->w*linelen)/2;
-                font_render_len_shadowed(font, start, linelen + (is_last_line?1:0), x + xoff, y + yoff, c, shadow_flags);
-            }
+            int xoff = (max_w - font->w*linelen)/2;
+            font_layout_len(font, start, linelen + (is_last_line?1:0), xoff, yoff, glyphs);
             if(*out_w < linelen*font->w) {
                 *out_w = linelen*font->w;
             }
@@ -399,17 +700,34 @@ void font_render_wrapped_internal(const font *font, const char *text, int x, int
     }
 }
 
+static text_layout* font_wrapped_layout(const font *font, const char *text, int max_w, int shadow_flags, text_layout *scratch) {
+    int len = strlen(text);
+    text_layout_key key;
+    font_layout_key(&key, font, LAYOUT_WRAPPED, max_w, shadow_flags);
+
+    int found;
+    text_layout *layout = text_cache_get(&key, text, len, scratch, &found);
+    if(!found) {
+        font_layout_wrapped(font, text, len, max_w, shadow_flags, &layout->glyphs, &layout->w, &layout->h);
+    }
+    return layout;
+}
+
 void font_render_wrapped_shadowed(const font *font, const char *text, int x, int y, int w, color c, int shadow_flags) {
-    int tmp;
-    font_render_wrapped_internal(font, text, x, y, w, c, shadow_flags, 0, &tmp, &tmp);
+    text_layout scratch;
+    text_layout *layout = font_wrapped_layout(font, text, w, shadow_flags, &scratch);
+    text_layout_draw(layout, font, shadow_flags, x, y, 255, c);
+    text_layout_done(layout);
 }
 
 void font_get_wrapped_size(const font *font, const char *text, int max_w, int *out_w, int *out_h) {
-    static color c = {0};
-    font_render_wrapped_internal(font, text, 0, 0, max_w, c, 0, 1, out_w, out_h);
+    font_get_wrapped_size_shadowed(font, text, max_w, 0, out_w, out_h);
 }
 
 void font_get_wrapped_size_shadowed(const font *font, const char *text, int max_w, int shadow_flag, int *out_w, int *out_h) {
-    static color c = {0};
-    font_render_wrapped_internal(font, text, 0, 0, max_w, c, shadow_flag, 1, out_w, out_h);
+    text_layout scratch;
+    text_layout *layout = font_wrapped_layout(font, text, max_w, shadow_flag, &scratch);
+    *out_w = layout->w;
+    *out_h = layout->h;
+    text_layout_done(layout);
 }
@@ -27,6 +27,7 @@ typedef struct {
 
 void textbutton_set_border(component *c, color col) {
     textbutton *tb = widget_get_obj(c);
+    component_set_dirty(c);
     tb->border_enabled = 1;
     tb->border_color = col;
     if(tb->border_created) {
@@ -44,11 +45,13 @@ void textbutton_set_border(component *c, color col) {
 
 void textbutton_remove_border(component *c) {
     textbutton *tb = widget_get_obj(c);
+    component_set_dirty(c);
     tb->border_enabled = 0;
 }
 
 void textbutton_set_text(component *c, const char* text) {
     textbutton *tb = widget_get_obj(c);
+    component_set_dirty(c);
     if(tb->text) {
         free(tb->text);
     }
@@ -91,6 +94,7 @@ static int textbutton_action(component *c, int action) {
 
 static void textbutton_tick(component *c) {
     textbutton *tb = widget_get_obj(c);
+    int t = tb->ticks / 2;
     if(!tb->dir) {
         tb->ticks++;
     } else {
@@ -102,6 +106,11 @@ static void textbutton_tick(component *c) {
     if(tb->ticks == 0) {
         tb->dir = 0;
     }
+
+    // Selected text pulses
+    if(component_is_selected(c) && tb->ticks / 2 != t) {
+        component_set_dirty(c);
+    }
 }
 
 static void textbutton_free(component *c) {
@@ -130,6 +139,7 @@ component* textbutton_create(const text_settings *tconf, const char *text, int d
     widget_set_action_cb(c, textbutton_action);
     widget_set_tick_cb(c, textbutton_tick);
     widget_set_free_cb(c, textbutton_free);
+    component_set_cached(c);
 
     return c;
 }
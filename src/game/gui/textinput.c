@@ -59,6 +59,8 @@ static void textinput_render(component *c) {
 }
 
 static int textinput_event(component *c, SDL_Event *e) {
+    component_set_dirty(c);
+
     // Handle selection
     if (e->type == SDL_TEXTINPUT) {
         textinput *tb = widget_get_obj(c);
@@ -164,5 +166,6 @@ component* textinput_create(const text_settings *tconf, const char *text, const
     widget_set_event_cb(c, textinput_event);
     widget_set_tick_cb(c, textinput_tick);
     widget_set_free_cb(c, textinput_free);
+    component_set_cached(c);
     return c;
 }
@@ -8,6 +8,7 @@
 #include "audio/sound.h"
 #include "utils/log.h"
 #include "utils/compat.h"
+#include "utils/memarena.h"
 
 typedef struct {
     char *text;
@@ -16,6 +17,7 @@ typedef struct {
     int dir;
     int pos_;
     int *pos;
+    int last_pos; // Bound positions may change behind our back
     vector options;
 
     void *userdata;
@@ -35,12 +37,14 @@ void textselector_clear_options(component *c) {
 
     // Clear vector
     vector_clear(&tb->options);
+    component_set_dirty(c);
 }
 
 void textselector_add_option(component *c, const char *value) {
     textselector *tb = widget_get_obj(c);
     char *new = strdup(value);
     vector_append(&tb->options, &new);
+    component_set_dirty(c);
 }
 
 const char* textselector_get_current_text(const component *c) {
@@ -78,6 +82,7 @@ static void textselector_render(component *c) {
 
 static int textselector_action(component *c, int action) {
     textselector *tb = widget_get_obj(c);
+    component_set_dirty(c);
     if(action == ACT_KICK || action == ACT_PUNCH || action == ACT_RIGHT) {
         if(vector_size(&tb->options) == 0) { return 0; }
         (*tb->pos)++;
@@ -106,6 +111,7 @@ static int textselector_action(component *c, int action) {
 
 static void textselector_tick(component *c) {
     textselector *tb = widget_get_obj(c);
+    int t = tb->ticks / 2;
     if(!tb->dir) {
         tb->ticks++;
     } else {
@@ -117,6 +123,16 @@ static void textselector_tick(component *c) {
     if(tb->ticks == 0) {
         tb->dir = 0;
     }
+
+    if(*tb->pos != tb->last_pos) {
+        tb->last_pos = *tb->pos;
+        component_set_dirty(c);
+    }
+
+    // Selected text pulses
+    if(component_is_selected(c) && tb->ticks / 2 != t) {
+        component_set_dirty(c);
+    }
 }
 
 int textselector_get_pos(const component *c) {
@@ -127,6 +143,7 @@ int textselector_get_pos(const component *c) {
 void textselector_set_pos(component *c, int pos) {
     textselector *tb = widget_get_obj(c);
     *tb->pos = pos;
+    component_set_dirty(c);
 }
 
 static void textselector_free(component *c) {
@@ -147,13 +164,14 @@ component* textselector_create(const text_settings *tconf, const char *text, tex
     tb->pos = &tb->pos_;
     tb->userdata = userdata;
     tb->toggle = cb;
-    vector_create(&tb->options, sizeof(char*));
+    vector_create_with_allocator(&tb->options, sizeof(char*), memarena_scene_allocator());
     widget_set_obj(c, tb);
 
     widget_set_render_cb(c, textselector_render);
     widget_set_action_cb(c, textselector_action);
     widget_set_tick_cb(c, textselector_tick);
     widget_set_free_cb(c, textselector_free);
+    component_set_cached(c);
 
     return c;
 }
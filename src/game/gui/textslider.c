@@ -16,6 +16,7 @@ typedef struct {
     int dir;
     int pos_;
     int *pos;
+    int last_pos; // Bound positions may change behind our back
     int has_off;
     int positions;
 
@@ -59,6 +60,7 @@ static void textslider_render(component *c) {
 
 static int textslider_action(component *c, int action) {
     textslider *tb = widget_get_obj(c);
+    component_set_dirty(c);
     if (action == ACT_KICK || action == ACT_PUNCH || action == ACT_RIGHT) {
         (*tb->pos)++;
         if (*tb->pos > tb->positions) {
@@ -91,6 +93,7 @@ static int textslider_action(component *c, int action) {
 
 static void textslider_tick(component *c) {
     textslider *tb = widget_get_obj(c);
+    int t = tb->ticks / 2;
     if(!tb->dir) {
         tb->ticks++;
     } else {
@@ -102,6 +105,16 @@ static void textslider_tick(component *c) {
     if(tb->ticks == 0) {
         tb->dir = 0;
     }
+
+    if(*tb->pos != tb->last_pos) {
+        tb->last_pos = *tb->pos;
+        component_set_dirty(c);
+    }
+
+    // Selected text pulses
+    if(component_is_selected(c) && tb->ticks / 2 != t) {
+        component_set_dirty(c);
+    }
 }
 
 static void textslider_free(component *c) {
@@ -131,6 +144,7 @@ component* textslider_create(const text_settings *tconf, const char *text, unsig
     widget_set_action_cb(c, textslider_action);
     widget_set_tick_cb(c, textslider_tick);
     widget_set_free_cb(c, textslider_free);
+    component_set_cached(c);
     return c;
 }
 
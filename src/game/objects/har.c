@@ -16,6 +16,7 @@
 #include "resources/af_loader.h"
 #include "resources/animation.h"
 #include "controller/controller.h"
+#include "utils/latency_probe.h"
 #include "utils/log.h"
 #include "utils/random.h"
 #include "utils/miscmath.h"
@@ -32,7 +33,6 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount);
 
 void har_free(object *obj) {
     har *h = object_get_userdata(obj);
-    list_free(&h->har_hooks);
 #ifdef DEBUGMODE
     surface_free(&h->cd_debug);
 #endif
@@ -42,12 +42,8 @@ void har_free(object *obj) {
 /* hooks */
 
 void fire_hooks(har *h, har_event event) {
-    iterator it;
-    har_hook *hook;
-
-    list_iter_begin(&h->har_hooks, &it);
-    while((hook = iter_next(&it)) != NULL) {
-        hook->cb(event, hook->data);
+    for(int i = 0; i < h->har_hook_count; i++) {
+        h->har_hooks[i].cb(event, h->har_hooks[i].data);
     }
     controller *ctrl = game_player_get_ctrl(h->gp);
     if(object_get_userdata(ctrl->har) == h) {
@@ -292,34 +288,34 @@ int har_is_blocking(har *h, af_move *move) {
 }
 
 int har_is_invincible(object *obj, af_move *move) {
-    if (player_frame_isset(obj, "zz")) {
+    if (player_frame_tag_isset(obj, TAG_ZZ)) {
         // blocks everything
         return 1;
     }
     switch (move->category) {
         // XX 'zg' is not handled here, but the game doesn't use it...
         case CAT_LOW:
-            if (player_frame_isset(obj, "zl")) {
+            if (player_frame_tag_isset(obj, TAG_ZL)) {
                 return 1;
             }
             break;
         case CAT_MEDIUM:
-            if (player_frame_isset(obj, "zm")) {
+            if (player_frame_tag_isset(obj, TAG_ZM)) {
                 return 1;
             }
             break;
         case CAT_HIGH:
-            if (player_frame_isset(obj, "zh")) {
+            if (player_frame_tag_isset(obj, TAG_ZH)) {
                 return 1;
             }
             break;
         case CAT_JUMPING:
-            if (player_frame_isset(obj, "zj")) {
+            if (player_frame_tag_isset(obj, TAG_ZJ)) {
                 return 1;
             }
             break;
         case CAT_PROJECTILE:
-            if (player_frame_isset(obj, "zp")) {
+            if (player_frame_tag_isset(obj, TAG_ZP)) {
                 return 1;
             }
             break;
@@ -350,7 +346,7 @@ void cb_har_spawn_object(object *parent, int id, vec2i pos, int g, void *userdat
     // ... otherwise expect it is a projectile
     af_move *move = af_get_move(h->af_data, id);
     if(move != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, pos, vec2f_create(0,0));
         object_set_userdata(obj, h);
         object_set_stl(obj, object_get_stl(parent));
@@ -383,21 +379,24 @@ void cb_har_spawn_object(object *parent, int id, vec2i pos, int g, void *userdat
 }
 
 void har_floor_landing_effects(object *obj) {
-    int amount = rand_int(2) + 1;
+    if(game_state_is_simulated(obj->gs)) {
+        return;
+    }
+    int amount = game_state_rand_int(obj->gs, 2) + 1;
     for(int i = 0; i < amount; i++) {
-        int variance = rand_int(20) - 10;
+        int variance = game_state_rand_int(obj->gs, 20) - 10;
         vec2i coord = vec2i_create(obj->pos.x + variance + i*10, obj->pos.y);
-        object *dust = malloc(sizeof(object));
+        object *dust = game_state_alloc_object(obj->gs);
         object_create(dust, obj->gs, coord, vec2f_create(0,0));
         object_set_stl(dust, object_get_stl(obj));
-        object_set_animation(dust, &bk_get_info(&game_state_get_scene(obj->gs)->bk_data, 26)->ani);
+        object_set_animation(dust, &bk_get_info(game_state_get_scene(obj->gs)->bk_data, 26)->ani);
         game_state_add_object(obj->gs, dust, RENDER_LAYER_MIDDLE, 0, 0);
     }
 
     // Landing sound
     float d = ((float)obj->pos.x) / 640.0f;
     float pos_pan = d - 0.25f;
-    sound_play(56, 0.5f, pos_pan, 1.8f);
+    game_state_play_sound(obj->gs, 56, 0.5f, pos_pan, 1.8f);
 }
 
 void har_move(object *obj) {
@@ -520,7 +519,7 @@ void har_take_damage(object *obj, str* string, float damage) {
     }
 
     // Take a screencap of enemy har
-    if(h->health == 0 && h->endurance == 0) {
+    if(h->health == 0 && h->endurance == 0 && !game_state_is_speculative(obj->gs)) {
         game_player *other_player = game_state_get_player(obj->gs, !h->player_id);
         har_screencaps_capture(&other_player->screencaps, other_player->har, SCREENCAP_BLOW);
     }
@@ -580,9 +579,9 @@ void har_take_damage(object *obj, str* string, float damage) {
 
         // XXX hack - if the first frame has the 'k' tag, treat it as some vertical knockback
         // we can't do this in player.c because it breaks the jaguar leap, which also uses the 'k' tag.
-        const sd_script_frame *frame = sd_script_get_frame(&obj->animation_state.parser, 0);
-        if(frame != NULL) {
-            if(sd_script_isset(frame, "k")) {
+        const frame_tags *tags = player_get_frame_tags(obj, 0);
+        if(tags != NULL) {
+            if(frame_tags_isset(tags, TAG_K)) {
                 obj->vel.y -= 7;
             }
         }
@@ -595,7 +594,7 @@ void har_spawn_oil(object *obj, vec2i pos, int amount, float gravity, int layer)
     // burning oil
     for(int i = 0; i < amount; i++) {
         // Calculate velocity etc.
-        float rv = rand_int(100) / 100.0f - 0.5;
+        float rv = game_state_rand_int(obj->gs, 100) / 100.0f - 0.5;
         float velx = (5 * cos(90 + i-(amount) / 2 + rv)) * object_get_direction(obj);
         float vely = -12 * sin(i / amount + rv);
 
@@ -603,11 +602,17 @@ void har_spawn_oil(object *obj, vec2i pos, int amount, float gravity, int layer)
         // (to prevent floating scrap objects)
         if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
-        // Create the object
-        object *scrap = malloc(sizeof(object));
+        // Drops are particles when the animation allows, objects otherwise
         int anim_no = ANIM_BURNING_OIL;
+        animation *ani = &af_get_move(h->af_data, anim_no)->ani;
+        if(!particles_spawn(&obj->gs->particles, ani, pos, vec2f_create(velx, vely), gravity, 0, layer, 0)) {
+            // Take the draw object_create would have, to keep the RNG in step
+            random_intmax(&obj->gs->rand);
+            continue;
+        }
+        object *scrap = game_state_alloc_object(obj->gs);
         object_create(scrap, obj->gs, pos, vec2f_create(velx, vely));
-        object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
+        object_set_animation(scrap, ani);
         object_set_stl(scrap, object_get_stl(obj));
         object_set_gravity(scrap, gravity);
         object_set_layers(scrap, LAYER_SCRAP);
@@ -647,7 +652,7 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount) {
     }
     for(int i = 0; i < scrap_amount; i++) {
         // Calculate velocity etc.
-        float rv = rand_int(100) / 100.0f - 0.5;
+        float rv = game_state_rand_int(obj->gs, 100) / 100.0f - 0.5;
         float velx = (5 * cos(90 + i-(scrap_amount) / 2 + rv)) * object_get_direction(obj);
         float vely = -12 * sin(i / scrap_amount + rv);
 
@@ -661,11 +666,17 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount) {
         // (to prevent floating scrap objects)
         if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
-        // Create the object
-        object *scrap = malloc(sizeof(object));
-        int anim_no = rand_int(3) + ANIM_SCRAP_METAL;
+        // Create the particle, or the object if the animation needs one
+        int anim_no = game_state_rand_int(obj->gs, 3) + ANIM_SCRAP_METAL;
+        animation *ani = &af_get_move(h->af_data, anim_no)->ani;
+        if(!particles_spawn(&obj->gs->particles, ani, pos, vec2f_create(velx, vely), 1,
+                            object_get_pal_offset(obj), RENDER_LAYER_TOP, 1)) {
+            random_intmax(&obj->gs->rand);
+            continue;
+        }
+        object *scrap = game_state_alloc_object(obj->gs);
         object_create(scrap, obj->gs, pos, vec2f_create(velx, vely));
-        object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
+        object_set_animation(scrap, ani);
         object_set_stl(scrap, object_get_stl(obj));
         object_set_gravity(scrap, 1);
         object_set_pal_offset(scrap, object_get_pal_offset(obj));
@@ -693,7 +704,7 @@ void har_block(object *obj, vec2i hit_coord) {
         // don't make another scrape
         return;
     }
-    object *scrape = malloc(sizeof(object));
+    object *scrape = game_state_alloc_object(obj->gs);
     object_create(scrape, obj->gs, hit_coord, vec2f_create(0, 0));
     object_set_animation(scrape, &af_get_move(h->af_data, ANIM_BLOCKING_SCRAPE)->ani);
     object_set_stl(scrape, object_get_stl(obj));
@@ -856,9 +867,8 @@ void har_debug(object *obj) {
         return;
     }
     // Make sure there are hitpoints to check.
-    if(vector_size(&obj->cur_animation->collision_coords) == 0) {
-        return;
-    }
+    int coord_count;
+    collision_coord *coords = animation_get_frame_coords(obj->cur_animation, obj->cur_sprite->id, &coord_count);
 
 
     // Some useful variables
@@ -873,25 +883,14 @@ void har_debug(object *obj) {
     }
 
     // Iterate through hitpoints
-    iterator it;
-    collision_coord *cc;
-    vector_iter_begin(&obj->cur_animation->collision_coords, &it);
-
-    int found = 0;
-    while((cc = iter_next(&it)) != NULL) {
-        if(cc->frame_index != obj->cur_sprite->id) continue;
-        found = 1;
-    }
-
     image_clear(&img, blank);
 
-    if (!found) {
+    if (coord_count == 0) {
         return;
     }
 
-    vector_iter_begin(&obj->cur_animation->collision_coords, &it);
-    while((cc = iter_next(&it)) != NULL) {
-        if(cc->frame_index != obj->cur_sprite->id) continue;
+    for(int i = 0; i < coord_count; i++) {
+        collision_coord *cc = &coords[i];
         image_set_pixel(&img, pos_a.x + (cc->pos.x * flip), pos_a.y + cc->pos.y, c);
         //DEBUG("%d drawing hit point at %d %d ->%d %d", obj->cur_sprite->id, pos_a.x, pos_a.y, pos_a.x + (cc->pos.x * flip), pos_a.y + cc->pos.y);
     }
@@ -926,11 +925,11 @@ void har_collide_with_har(object *obj_a, object *obj_b, int loop) {
     if(a->damage_done == 0 &&
             (intersect_sprite_hitpoint(obj_a, obj_b, level, &hit_coord)
             || move->category == CAT_CLOSE ||
-            (player_frame_isset(obj_a, "ue") && b->state != STATE_JUMPING))) {
+            (player_frame_tag_isset(obj_a, TAG_UE) && b->state != STATE_JUMPING))) {
 
         if (har_is_blocking(b, move) &&
                 // earthquake smash is unblockable
-                !player_frame_isset(obj_a, "ue")) {
+                !player_frame_tag_isset(obj_a, TAG_UE)) {
             har_event_enemy_block(a, move);
             har_block(obj_b, hit_coord);
             if (b->is_wallhugging) {
@@ -1165,33 +1164,28 @@ int har_palette_transform(object *obj, screen_palette *pal) {
         return 0;
     }
 
-    // Select palette start and length.
-    // For player 0, we should use palette indexes 0-47. For player 1, 48-96.
-    // If pe flag is on, we need to switch to handling the other HAR.
-    int pal_start = 48 * (h->player_id ^ h->p_har_switch);
-    int pal_length = 47 + h->player_id;
+    // Select the palette bank of the player, or with the pe flag on, that of
+    // the other HAR. The first player's bank has always been a color short.
+    int pal_start = palette_bank_offset(h->player_id ^ h->p_har_switch);
+    int pal_length = PLAYER_PALETTE_SIZE - 1 + h->player_id;
 
     // Handle palette transformation
-    int r,g,b,m,c;
-    int _r = pal->data[h->p_pal_ref][0];
-    int _g = pal->data[h->p_pal_ref][1];
-    int _b = pal->data[h->p_pal_ref][2];
-    c = (h->p_color_ref * 4) * ((float)h->p_ticks_left / (float)h->p_ticks_length);
-    for(int i = pal_start; i < pal_start + pal_length; i++) {
-        if(h->p_color_fn) {
-            m = max3(pal->data[i][0], pal->data[i][1], pal->data[i][2]);
-            r = (m * (c * (_r * pal->data[i][0]) / 255.0f) / 255.0f) * pal->data[i][0];
-            g = (m * (c * (_g * pal->data[i][1]) / 255.0f) / 255.0f) * pal->data[i][1];
-            b = (m * (c * (_b * pal->data[i][2]) / 255.0f) / 255.0f) * pal->data[i][2];
-        } else {
-            r = (c * _r) / 255.0f + (255 - c) * (pal->data[i][0] / 255.0f);
-            g = (c * _g) / 255.0f + (255 - c) * (pal->data[i][1] / 255.0f);
-            b = (c * _b) / 255.0f + (255 - c) * (pal->data[i][2] / 255.0f);
+    int c = h->p_color_ref * 4 * h->p_ticks_left / h->p_ticks_length;
+    if(h->p_color_fn) {
+        const int64_t ref[3] = {
+            pal->data[h->p_pal_ref][0],
+            pal->data[h->p_pal_ref][1],
+            pal->data[h->p_pal_ref][2]};
+        for(int i = pal_start; i < pal_start + pal_length; i++) {
+            int64_t m = max3(pal->data[i][0], pal->data[i][1], pal->data[i][2]);
+            for(int j = 0; j < 3; j++) {
+                int64_t x = pal->data[i][j];
+                int64_t v = m * c * ref[j] * x * x / (255 * 255);
+                pal->data[i][j] = v > 255 ? 255 : v;
+            }
         }
-
-        pal->data[i][0] = min2(max2(r, 0), 255);
-        pal->data[i][1] = min2(max2(g, 0), 255);
-        pal->data[i][2] = min2(max2(b, 0), 255);
+    } else {
+        screen_palette_blend(pal, pal_start, pal_length, h->p_pal_ref, c * 256);
     }
 
     h->p_ticks_left--;
@@ -1205,7 +1199,7 @@ void har_tick(object *obj) {
     // TODO: Roof!
     vec2i pos = object_get_pos(obj);
     if (h->state != STATE_DEFEAT) {
-        int wall_flag = player_frame_isset(obj, "aw");
+        int wall_flag = player_frame_tag_isset(obj, TAG_AW);
         int wall = 0;
         int hit = 0;
         if(pos.x <  ARENA_LEFT_WALL) {
@@ -1236,19 +1230,19 @@ void har_tick(object *obj) {
     h->is_grabbed = (obj->enemy_slide_state.timer > 0);
 
     // Check for HAR specific palette tricks
-    if(player_frame_isset(obj, "ptr")) {
+    if(player_frame_tag_isset(obj, TAG_PTR)) {
         h->p_pal_ref = 0;
-        if(player_frame_isset(obj, "pd")) {
-            h->p_pal_ref = player_frame_get(obj, "pd");
+        if(player_frame_tag_isset(obj, TAG_PD)) {
+            h->p_pal_ref = player_frame_tag_get(obj, TAG_PD);
         }
-        h->p_har_switch = player_frame_isset(obj, "pe");
-        h->p_color_ref = player_frame_get(obj, "ptr");
+        h->p_har_switch = player_frame_tag_isset(obj, TAG_PE);
+        h->p_color_ref = player_frame_tag_get(obj, TAG_PTR);
         h->p_ticks_length = 0;
-        if(player_frame_isset(obj, "pp")) {
-            h->p_ticks_length = player_frame_get(obj, "pp");
+        if(player_frame_tag_isset(obj, TAG_PP)) {
+            h->p_ticks_length = player_frame_tag_get(obj, TAG_PP);
         }
         h->p_ticks_left = h->p_ticks_length;
-        h->p_color_fn = player_frame_isset(obj, "pa");
+        h->p_color_fn = player_frame_tag_isset(obj, TAG_PA);
     }
 
     // Object took walldamage, but has now landed
@@ -1336,7 +1330,7 @@ void har_tick(object *obj) {
 
     // Flip tint effect flag
     int cur_effects = object_get_effects(obj);
-    if(player_frame_isset(obj, "bt")) {
+    if(player_frame_tag_isset(obj, TAG_BT)) {
         object_set_effects(obj, cur_effects | EFFECT_DARK_TINT);
     } else {
         object_set_effects(obj, cur_effects & ~EFFECT_DARK_TINT);
@@ -1347,10 +1341,10 @@ void har_tick(object *obj) {
     // to show the sprite with animation string that interpolates opacity down
     // Mark new object as the owner of the animation, so that the animation gets
     // removed when the object is finished.
-    if(player_frame_isset(obj, "ub")) {
+    if(player_frame_tag_isset(obj, TAG_UB)) {
         if(obj->age % 2 == 0) {
             sprite *nsp = sprite_copy(obj->cur_sprite);
-            object *nobj = malloc(sizeof(object));
+            object *nobj = game_state_alloc_object(obj->gs);
             object_create(nobj, obj->gs, object_get_pos(obj), vec2f_create(0,0));
             object_set_stl(nobj, object_get_stl(obj));
             object_set_animation(nobj, create_animation_from_single(nsp, obj->cur_animation->start_pos));
@@ -1376,182 +1370,237 @@ void har_tick(object *obj) {
     }
 }
 
-void add_input_to_buffer(char *buf, char c) {
-    // only add it if it is not the current head of the array
-    if(buf[0] == c) {
-        return;
+// The i-th newest input, or '\0' where the inputs were last cleared
+static char har_get_input(const har *h, int i) {
+    return h->inputs[(h->input_head + MOVE_TRIE_MAX_INPUTS - i) % MOVE_TRIE_MAX_INPUTS];
+}
+
+// Newest first, the way they are saved
+static void har_get_inputs(const har *h, char *out) {
+    for(int i = 0; i < MOVE_TRIE_MAX_INPUTS; i++) {
+        out[i] = har_get_input(h, i);
+    }
+}
+
+static void har_set_inputs(har *h, const char *in) {
+    char buf[MOVE_TRIE_MAX_INPUTS + 1];
+    h->input_head = 0;
+    for(int i = 0; i < MOVE_TRIE_MAX_INPUTS; i++) {
+        h->inputs[(MOVE_TRIE_MAX_INPUTS - i) % MOVE_TRIE_MAX_INPUTS] = in[i];
+        buf[i] = in[i];
     }
+    buf[MOVE_TRIE_MAX_INPUTS] = '\0';
+    h->move_node = move_trie_walk(&h->af_data->move_trie, buf);
+}
 
-    // use memmove to move everything over one spot in the array, leaving the first slot free
-    memmove((buf)+1, buf, 9);
-    // write the new first element
-    buf[0] = c;
+// Once a move is done, the inputs that led to it don't count for the next one
+static void har_clear_inputs(har *h) {
+    h->inputs[h->input_head] = '\0';
+    h->move_node = MOVE_TRIE_START;
+}
+
+// Inputs repeating the newest one are dropped. The move trie is stepped
+// along, so the moves the inputs end in are known without a search.
+void add_input_to_buffer(har *h, char c) {
+    if(har_get_input(h, 0) == c) {
+        return;
+    }
+    h->input_head = (h->input_head + 1) % MOVE_TRIE_MAX_INPUTS;
+    h->inputs[h->input_head] = c;
+    h->move_node = move_trie_step(&h->af_data->move_trie, h->move_node, c);
 }
 
-void add_input(char *buf, int act_type, int direction) {
+void add_input(har *h, int act_type, int direction) {
    // for the reason behind the numbers, look at a numpad sometime
     switch(act_type) {
         case ACT_UP:
-            add_input_to_buffer(buf, '8');
+            add_input_to_buffer(h, '8');
             break;
         case ACT_DOWN:
-            add_input_to_buffer(buf, '2');
+            add_input_to_buffer(h, '2');
             break;
         case ACT_LEFT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '6');
+                add_input_to_buffer(h, '6');
             } else {
-                add_input_to_buffer(buf, '4');
+                add_input_to_buffer(h, '4');
             }
             break;
         case ACT_RIGHT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '4');
+                add_input_to_buffer(h, '4');
             } else {
-                add_input_to_buffer(buf, '6');
+                add_input_to_buffer(h, '6');
             }
             break;
         case ACT_UP|ACT_RIGHT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '7');
+                add_input_to_buffer(h, '7');
             } else {
-                add_input_to_buffer(buf, '9');
+                add_input_to_buffer(h, '9');
             }
             break;
         case ACT_UP|ACT_LEFT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '9');
+                add_input_to_buffer(h, '9');
             } else {
-                add_input_to_buffer(buf, '7');
+                add_input_to_buffer(h, '7');
             }
             break;
         case ACT_DOWN|ACT_RIGHT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '1');
+                add_input_to_buffer(h, '1');
             } else {
-                add_input_to_buffer(buf, '3');
+                add_input_to_buffer(h, '3');
             }
             break;
         case ACT_DOWN|ACT_LEFT:
             if(direction == OBJECT_FACE_LEFT) {
-                add_input_to_buffer(buf, '3');
+                add_input_to_buffer(h, '3');
             } else {
-                add_input_to_buffer(buf, '1');
+                add_input_to_buffer(h, '1');
             }
             break;
         case ACT_KICK:
-            add_input_to_buffer(buf, 'K');
+            add_input_to_buffer(h, 'K');
             break;
         case ACT_PUNCH:
-            add_input_to_buffer(buf, 'P');
+            add_input_to_buffer(h, 'P');
             break;
         case ACT_STOP:
-            add_input_to_buffer(buf, '5');
+            add_input_to_buffer(h, '5');
             break;
     }
 }
 
-af_move* match_move(object *obj, char *inputs) {
-    har *h = object_get_userdata(obj);
-    af_move *move = NULL;
-    size_t len;
-    for(int i = 0; i < 70; i++) {
-        if((move = af_get_move(h->af_data, i))) {
-            len = move->move_string.len;
-            if(!strncmp(str_c(&move->move_string), inputs, len)) {
-                if (move->category == CAT_CLOSE && h->close != 1) {
-                    // not standing close enough
-                    continue;
-                }
-                if (move->category == CAT_JUMPING && h->state != STATE_JUMPING) {
-                    // not jumping
-                    continue;
-                }
-                if (move->category != CAT_JUMPING && h->state == STATE_JUMPING) {
-                    // jumping but this move is not a jumping move
-                    continue;
-                }
-                if (move->category == CAT_SCRAP && h->state != STATE_VICTORY) {
-                    continue;
-                }
-
-                if (move->category == CAT_DESTRUCTION && h->state != STATE_SCRAP) {
-                    continue;
-                }
+// Builds the masks of moves that are allowed for each combination of MOVE_FILTER_* flags
+static void har_build_move_filters(har *h) {
+    for(int f = 0; f < MOVE_FILTER_COUNT; f++) {
+        move_mask *mask = &h->move_filters[f];
+        move_mask_clear(mask);
+        for(int i = 0; i < 70; i++) {
+            af_move *move = af_get_move(h->af_data, i);
+            if(move == NULL) {
+                continue;
+            }
+            if(move->category == CAT_CLOSE && !(f & MOVE_FILTER_CLOSE)) {
+                // not standing close enough
+                continue;
+            }
+            if((move->category == CAT_JUMPING) != ((f & MOVE_FILTER_JUMPING) != 0)) {
+                // jumping moves only while jumping, and nothing else
+                continue;
+            }
+            if(move->category == CAT_SCRAP && !(f & MOVE_FILTER_VICTORY)) {
+                continue;
+            }
+            if(move->category == CAT_DESTRUCTION && !(f & MOVE_FILTER_SCRAP)) {
+                continue;
+            }
+            if(move->pos_constraints & 0x1 && !(f & MOVE_FILTER_WALL)) {
+                // required to be wall hugging
+                continue;
+            }
+            move_mask_set(mask, i);
+        }
+    }
+}
 
+// Returns the MOVE_FILTER_* flags for the current HAR state
+int har_move_filter(har *h) {
+    int filter = 0;
+    if(h->state == STATE_JUMPING) {
+        filter |= MOVE_FILTER_JUMPING;
+    }
+    if(h->state == STATE_VICTORY) {
+        filter |= MOVE_FILTER_VICTORY;
+    }
+    if(h->state == STATE_SCRAP) {
+        filter |= MOVE_FILTER_SCRAP;
+    }
+    if(h->close == 1) {
+        filter |= MOVE_FILTER_CLOSE;
+    }
+    if(h->is_wallhugging == 1) {
+        filter |= MOVE_FILTER_WALL;
+    }
+    return filter;
+}
 
-                if (h->is_wallhugging != 1 && move->pos_constraints & 0x1) {
-                    DEBUG("not wallhugging!");
-                    // required to be wall hugging
-                    continue;
-                }
+af_move* match_move(object *obj) {
+    har *h = object_get_userdata(obj);
+    af_move *move = NULL;
 
-                if (h->executing_move && ! h->enqueued) {
-                    // check if the current frame allows chaining
-                   int allowed = 0;
-                   if (player_frame_isset(obj, "jn") && i == player_frame_get(obj, "jn")) {
-                       allowed = 1;
-                   } else {
-                       switch (move->category) {
-                           case CAT_LOW:
-                               if (player_frame_isset(obj, "jl")) {
-                                   allowed = 1;
-                               }
-                               break;
-                           case CAT_MEDIUM:
-                               if (player_frame_isset(obj, "jm")) {
-                                   allowed = 1;
-                               }
-                               break;
-                           case CAT_HIGH:
-                               if (player_frame_isset(obj, "jh")) {
-                                   allowed = 1;
-                               }
-                               break;
-                           case CAT_SCRAP:
-                               if (player_frame_isset(obj, "jf")) {
-                                   allowed = 1;
-                               }
-                               break;
-                           case CAT_DESTRUCTION:
-                               if (player_frame_isset(obj, "jf2")) {
-                                   allowed = 1;
-                               }
-                               break;
+    // Moves whose string matches the input, and which are allowed in the current state.
+    // Lower move ids have priority.
+    move_mask candidates = *move_trie_moves(&h->af_data->move_trie, h->move_node);
+    move_mask_and(&candidates, &h->move_filters[har_move_filter(h)]);
+    for(int i = move_mask_next(&candidates, 0); i >= 0; i = move_mask_next(&candidates, i + 1)) {
+        move = af_get_move(h->af_data, i);
+        if (h->executing_move && ! h->enqueued) {
+            // check if the current frame allows chaining
+           int allowed = 0;
+           if (player_frame_tag_isset(obj, TAG_JN) && i == player_frame_tag_get(obj, TAG_JN)) {
+               allowed = 1;
+           } else {
+               switch (move->category) {
+                   case CAT_LOW:
+                       if (player_frame_tag_isset(obj, TAG_JL)) {
+                           allowed = 1;
                        }
-                   }
-                   if(player_get_current_tick(obj) >= player_get_len_ticks(obj)) {
-                       DEBUG("enqueueing %d %s",  i, str_c(&move->move_string));
-                       h->enqueued = i;
-                       return NULL;
-                   }
-
-                   if (!allowed) {
-                       // not allowed
-                       continue;
-                   }
-                   DEBUG("CHAINING");
-                }
-
-                DEBUG("matched move %d with string %s", i, str_c(&move->move_string));
-                /*DEBUG("input was %s", h->inputs);*/
-                return move;
-            }
+                       break;
+                   case CAT_MEDIUM:
+                       if (player_frame_tag_isset(obj, TAG_JM)) {
+                           allowed = 1;
+                       }
+                       break;
+                   case CAT_HIGH:
+                       if (player_frame_tag_isset(obj, TAG_JH)) {
+                           allowed = 1;
+                       }
+                       break;
+                   case CAT_SCRAP:
+                       if (player_frame_tag_isset(obj, TAG_JF)) {
+                           allowed = 1;
+                       }
+                       break;
+                   case CAT_DESTRUCTION:
+                       if (player_frame_tag_isset(obj, TAG_JF2)) {
+                           allowed = 1;
+                       }
+                       break;
+               }
+           }
+           if(player_get_current_tick(obj) >= player_get_len_ticks(obj)) {
+               DEBUG("enqueueing %d %s",  i, str_c(&move->move_string));
+               h->enqueued = i;
+               return NULL;
+           }
+
+           if (!allowed) {
+               // not allowed
+               continue;
+           }
+           DEBUG("CHAINING");
         }
+
+        DEBUG("matched move %d with string %s", i, str_c(&move->move_string));
+        /*DEBUG("input was %s", h->inputs);*/
+        return move;
     }
     return NULL;
 }
 
-af_move* scrap_destruction_cheat(object *obj, char *inputs) {
+af_move* scrap_destruction_cheat(object *obj, char input) {
     har *h = object_get_userdata(obj);
     for(int i = 0; i < 70; i++) {
         af_move *move;
         if((move = af_get_move(h->af_data, i))) {
-            if (move->category == CAT_SCRAP && h->state == STATE_VICTORY && inputs[0] == 'K') {
+            if (move->category == CAT_SCRAP && h->state == STATE_VICTORY && input == 'K') {
                 return move;
             }
 
-            if (move->category == CAT_DESTRUCTION && h->state == STATE_SCRAP && inputs[0] == 'P') {
+            if (move->category == CAT_DESTRUCTION && h->state == STATE_SCRAP && input == 'P') {
                 return move;
             }
         }
@@ -1614,6 +1663,17 @@ int maybe_har_change_state(int oldstate, int direction, int act_type) {
     return 0;
 }
 
+// Only presses on this machine are followed
+static void har_latency_act(har *h) {
+    if(!latency_probe_is_enabled()) {
+        return;
+    }
+    controller *ctrl = game_player_get_ctrl(h->gp);
+    if(ctrl != NULL && (ctrl->type == CTRL_TYPE_KEYBOARD || ctrl->type == CTRL_TYPE_GAMEPAD)) {
+        latency_probe_act();
+    }
+}
+
 int har_act(object *obj, int act_type) {
     har *h = object_get_userdata(obj);
     int direction = object_get_direction(obj);
@@ -1640,12 +1700,12 @@ int har_act(object *obj, int act_type) {
 
     int oldstate = h->state;
 
-    add_input(h->inputs, act_type, direction);
+    add_input(h, act_type, direction);
 
-    af_move *move = match_move(obj, h->inputs);
+    af_move *move = match_move(obj);
 
     if(game_state_get_player(obj->gs, h->player_id)->ez_destruct && move == NULL && (h->state == STATE_VICTORY || h->state == STATE_SCRAP)) {
-        move = scrap_destruction_cheat(obj, h->inputs);
+        move = scrap_destruction_cheat(obj, har_get_input(h, 0));
     }
 
     if (move) {
@@ -1716,7 +1776,7 @@ int har_act(object *obj, int act_type) {
         // Set correct animation etc.
         // executing_move = 1 prevents new moves while old one is running.
         har_set_ani(obj, move->id, 0);
-        h->inputs[0] = '\0';
+        har_clear_inputs(h);
         h->executing_move = 1;
 
         // Stop horizontal movement, when move is done
@@ -1750,6 +1810,8 @@ int har_act(object *obj, int act_type) {
             object_dynamic_tick(opp);
         }
 
+        har_latency_act(h);
+
         // we actually did something interesting
         // return 1 so we can use this as sync point for netplay
         return 1;
@@ -1759,7 +1821,7 @@ int har_act(object *obj, int act_type) {
     if(h->executing_move) {
         if(obj->pos.y < ARENA_FLOOR) {
             // XXX I think 'i' is for 'not interruptable'
-            if (h->state < STATE_JUMPING && !player_frame_isset(obj, "i")) {
+            if (h->state < STATE_JUMPING && !player_frame_tag_isset(obj, TAG_I)) {
                 DEBUG("standing move led to airborne one");
                 h->state = STATE_JUMPING;
             } else if (h->state != STATE_JUMPING) {
@@ -1859,6 +1921,7 @@ int har_act(object *obj, int act_type) {
         }
         har_action_hook(obj, act_type);
         har_action_hook(obj, ACT_FLUSH);
+        har_latency_act(h);
         return 1;
     }
 
@@ -1917,6 +1980,39 @@ void har_finished(object *obj) {
     h->flinching = 0;
 }
 
+// The part of a HAR that goes into a serialized state
+typedef struct har_wire_t {
+    int id;
+    int player_id;
+    int pilot_id;
+    int state;
+    int executing_move;
+    int flinching;
+    int close;
+    int hard_close;
+    int damage_done;
+    int damage_received;
+    int air_attacked;
+    int health;
+    int endurance;
+} har_wire;
+
+static const serial_field har_fields[] = {
+    SERIAL_FIELD(SERIAL_FIELD_UINT, har_wire, id),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, har_wire, player_id),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, har_wire, pilot_id),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, har_wire, state),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, executing_move),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, flinching),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, close),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, hard_close),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, damage_done),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, damage_received),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, har_wire, air_attacked),
+    SERIAL_FIELD(SERIAL_FIELD_INT, har_wire, health),
+    SERIAL_FIELD(SERIAL_FIELD_INT, har_wire, endurance),
+};
+
 int har_serialize(object *obj, serial *ser) {
     har *h = object_get_userdata(obj);
 
@@ -1924,20 +2020,24 @@ int har_serialize(object *obj, serial *ser) {
     serial_write_int8(ser, SPECID_HAR);
 
     // Set serialization data
-    serial_write_int16(ser, h->id);
-    serial_write_int8(ser, h->player_id);
-    serial_write_int8(ser, h->pilot_id);
-    serial_write_int8(ser, h->state);
-    serial_write_int8(ser, h->executing_move);
-    serial_write_int8(ser, h->flinching);
-    serial_write_int8(ser, h->close);
-    serial_write_int8(ser, h->hard_close);
-    serial_write_int8(ser, h->damage_done);
-    serial_write_int8(ser, h->damage_received);
-    serial_write_int8(ser, h->air_attacked);
-    serial_write_int16(ser, h->health);
-    serial_write_int16(ser, h->endurance);
-    serial_write(ser, h->inputs, 10);
+    har_wire w;
+    w.id = h->id;
+    w.player_id = h->player_id;
+    w.pilot_id = h->pilot_id;
+    w.state = h->state;
+    w.executing_move = h->executing_move;
+    w.flinching = h->flinching;
+    w.close = h->close;
+    w.hard_close = h->hard_close;
+    w.damage_done = h->damage_done;
+    w.damage_received = h->damage_received;
+    w.air_attacked = h->air_attacked;
+    w.health = h->health;
+    w.endurance = h->endurance;
+    serial_write_fields(ser, har_fields, SERIAL_FIELD_COUNT(har_fields), &w);
+    char inputs[MOVE_TRIE_MAX_INPUTS];
+    har_get_inputs(h, inputs);
+    serial_write(ser, inputs, MOVE_TRIE_MAX_INPUTS);
 
     // ...
     // TODO: Set the other ser attrs here
@@ -1947,42 +2047,42 @@ int har_serialize(object *obj, serial *ser) {
 }
 
 int har_unserialize(object *obj, serial *ser, int animation_id, game_state *gs) {
-
-    int har_id = serial_read_int16(ser);
-    int player_id = serial_read_int8(ser);
-    int pilot_id = serial_read_int8(ser);
+    har_wire w;
+    serial_read_fields(ser, har_fields, SERIAL_FIELD_COUNT(har_fields), &w);
     af *af_data;
 
-    /*DEBUG("unserializing HAR %d for player %d", har_id, player_id);*/
+    /*DEBUG("unserializing HAR %d for player %d", w.id, w.player_id);*/
 
     // find the AF data in the scene
 
-    if (gs->sc->af_data[player_id]->id == har_id) {
-        af_data = gs->sc->af_data[player_id];
+    if (gs->sc->af_data[w.player_id]->id == w.id) {
+        af_data = gs->sc->af_data[w.player_id];
     } else {
-        DEBUG("expected har %d, got %d", har_id, gs->sc->af_data[player_id]->id);
+        DEBUG("expected har %d, got %d", w.id, gs->sc->af_data[w.player_id]->id);
         // HAR IDs do not match!
         // TODO maybe the other player changed their HAR, who knows
         return 1;
     }
 
-    har_create(obj, af_data, obj->direction, har_id, pilot_id, player_id);
+    har_create(obj, af_data, obj->direction, w.id, w.pilot_id, w.player_id);
 
     har *h = object_get_userdata(obj);
     // we are unserializing a state update for a HAR, we expect it to have the AF data already loaded into RAM, we're just updating the volatile attributes
 
     // TODO sanity check pilot/player/HAR IDs
-    h->state = serial_read_int8(ser);
-    h->executing_move = serial_read_int8(ser);
-    h->flinching = serial_read_int8(ser);
-    h->close = serial_read_int8(ser);
-    h->hard_close = serial_read_int8(ser);
-    h->damage_done = serial_read_int8(ser);
-    h->damage_received = serial_read_int8(ser);
-    h->air_attacked = serial_read_int8(ser);
-    h->health = serial_read_int16(ser);
-    h->endurance = serial_read_int16(ser);
-    serial_read(ser, h->inputs, 10);
+    h->state = w.state;
+    h->executing_move = w.executing_move;
+    h->flinching = w.flinching;
+    h->close = w.close;
+    h->hard_close = w.hard_close;
+    h->damage_done = w.damage_done;
+    h->damage_received = w.damage_received;
+    h->air_attacked = w.air_attacked;
+    h->health = w.health;
+    h->endurance = w.endurance;
+    char inputs[MOVE_TRIE_MAX_INPUTS];
+    serial_read(ser, inputs, MOVE_TRIE_MAX_INPUTS);
+    har_set_inputs(h, inputs);
 
     /*DEBUG("har animation id is %d with state %d with %d", animation_id, h->state, h->executing_move);*/
 
@@ -2004,10 +2104,19 @@ void har_install_action_hook(har *h, har_action_hook_cb hook, void *data) {
 }
 
 void har_install_hook(har *h, har_hook_cb hook, void *data) {
-    har_hook hk;
-    hk.cb = hook;
-    hk.data = data;
-    list_append(&h->har_hooks, &hk, sizeof(har_hook));
+    // Installing the same hook again must not make it fire twice
+    for(int i = 0; i < h->har_hook_count; i++) {
+        if(h->har_hooks[i].cb == hook && h->har_hooks[i].data == data) {
+            return;
+        }
+    }
+    if(h->har_hook_count >= HAR_MAX_HOOKS) {
+        PERROR("Too many HAR hooks, ignoring the new one");
+        return;
+    }
+    h->har_hooks[h->har_hook_count].cb = hook;
+    h->har_hooks[h->har_hook_count].data = data;
+    h->har_hook_count++;
 
     /*h->hook_cb = hook;*/
     /*h->hook_cb_data = data;*/
@@ -2032,6 +2141,7 @@ int har_create(object *obj, af *af_data, int dir, int har_id, int pilot_id, int
 
     local->gp = game_state_get_player(obj->gs, player_id);
     local->af_data = af_data;
+    har_build_move_filters(local);
 
     // Save har id
     local->id = har_id;
@@ -2066,12 +2176,12 @@ int har_create(object *obj, af *af_data, int dir, int har_id, int pilot_id, int
     /*local->hook_cb = NULL;*/
     /*local->hook_cb_data = NULL;*/
 
-    list_create(&local->har_hooks);
+    local->har_hook_count = 0;
 
     local->stun_timer = 0;
 
     // Set palette offset 0 for player1, 48 for player2
-    object_set_pal_offset(obj, player_id * 48);
+    object_set_pal_offset(obj, palette_bank_offset(player_id));
 
     // Object related stuff
     /*object_set_gravity(obj, local->af_data->fall_speed);*/
@@ -2090,8 +2200,9 @@ int har_create(object *obj, af *af_data, int dir, int har_id, int pilot_id, int
     har_set_ani(obj, ANIM_IDLE, 1);
 
     // fill the input buffer with 'pauses'
-    memset(local->inputs, '5', 10);
-    local->inputs[10] = '\0';
+    char pauses[MOVE_TRIE_MAX_INPUTS];
+    memset(pauses, '5', MOVE_TRIE_MAX_INPUTS);
+    har_set_inputs(local, pauses);
 
     // Callbacks and userdata
     object_set_free_cb(obj, har_free);
@@ -4,6 +4,8 @@
 #include "game/protos/object_specializer.h"
 #include "utils/log.h"
 #include "utils/miscmath.h"
+#include "utils/fixedpoint.h"
+#include "game/game_state_type.h"
 #include "game/protos/scene.h"
 
 int orb_almost_there(vec2f a, vec2f  b) {
@@ -23,10 +25,7 @@ void hazard_tick(object *obj) {
         }
     }
     if(obj->orbit) {
-        obj->orbit_tick += MATH_PI/32;
-        if(obj->orbit_tick >= MATH_PI*2) {
-            obj->orbit_tick -= MATH_PI*2;
-        }
+        obj->orbit_tick = (obj->orbit_tick + FIXED_TURN / 64) & (FIXED_TURN - 1);
         if(orb_almost_there(obj->orbit_dest, obj->orbit_pos)) {
             // XXX come up with a better equation to randomize the destination
             obj->orbit_pos = obj->pos;
@@ -34,7 +33,7 @@ void hazard_tick(object *obj) {
             float mag;
             int limit = 10;
             do {
-                obj->orbit_dest = vec2f_create(rand_float()*320.0f, rand_float()*200.0f);
+                obj->orbit_dest = vec2f_create(game_state_rand_float(obj->gs)*320.0f, game_state_rand_float(obj->gs)*200.0f);
                 obj->orbit_dest_dir = vec2f_sub(obj->orbit_dest, obj->orbit_pos);
                 mag = sqrtf(obj->orbit_dest_dir.x*obj->orbit_dest_dir.x + obj->orbit_dest_dir.y*obj->orbit_dest_dir.y);
                 limit--;
@@ -50,9 +49,9 @@ void hazard_spawn_cb(object *parent, int id, vec2i pos, int g, void *userdata) {
     scene *s = (scene*)userdata;
 
     // Get next animation
-    bk_info *info = bk_get_info(&s->bk_data, id);
+    bk_info *info = bk_get_info(s->bk_data, id);
     if(info != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, vec2i_add(pos, info->ani.start_pos), vec2f_create(0,0));
         object_set_stl(obj, object_get_stl(parent));
         object_set_animation(obj, &info->ani);
@@ -63,7 +62,7 @@ void hazard_spawn_cb(object *parent, int id, vec2i pos, int g, void *userdata) {
         object_set_group(obj, GROUP_PROJECTILE);
         object_set_userdata(obj, object_get_userdata(parent));
         hazard_create(obj, s);
-        if (s->bk_data.file_id == 128 && id == 14) {
+        if (s->bk_data->file_id == 128 && id == 14) {
             // XXX hack because we don't understand the ms and md tags
             // without this, the 'bullet damage' sprite in the desert spawns at 0,0
             obj->pos = parent->pos;
@@ -81,8 +80,17 @@ void hazard_move(object *obj) {
         obj->pos.y = obj->orbit_pos.y+obj->orbit_pos_vary.y;
         obj->orbit_pos.x += 2*obj->orbit_dest_dir.x;
         obj->orbit_pos.y += 2*obj->orbit_dest_dir.y;
-        obj->orbit_pos_vary.x += sin(obj->orbit_tick)*0.2f;
-        obj->orbit_pos_vary.y += cos(obj->orbit_tick)*0.6f;
+        fixed s = fixed_sin_lut(obj->orbit_tick);
+        fixed c = fixed_cos_lut(obj->orbit_tick);
+        if(obj->gs->fixed_physics) {
+            obj->orbit_pos_vary.x += fixed_to_float(fixed_mul(s, fixed_from_float(0.2f)));
+            obj->orbit_pos_vary.y += fixed_to_float(fixed_mul(c, fixed_from_float(0.6f)));
+            obj->orbit_pos_vary.x = fixed_snap(obj->orbit_pos_vary.x);
+            obj->orbit_pos_vary.y = fixed_snap(obj->orbit_pos_vary.y);
+        } else {
+            obj->orbit_pos_vary.x += fixed_to_float(s)*0.2f;
+            obj->orbit_pos_vary.y += fixed_to_float(c)*0.6f;
+        }
     }
 }
 
@@ -106,7 +114,7 @@ int hazard_serialize(object *obj, serial *ser) {
 }
 
 int hazard_unserialize(object *obj, serial *ser, int animation_id, game_state *gs) {
-    bk *bk_data = &gs->sc->bk_data;
+    bk *bk_data = gs->sc->bk_data;
     hazard_create(obj, gs->sc);
     object_set_userdata(obj, bk_data);
     object_set_stl(obj, bk_data->sound_translation_table);
@@ -30,7 +30,7 @@ void projectile_tick(object *obj) {
 
     // Set effect flags
     int cur_effects = object_get_effects(obj);
-    if(player_frame_isset(obj, "bt")) {
+    if(player_frame_tag_isset(obj, TAG_BT)) {
         object_set_effects(obj, cur_effects | EFFECT_DARK_TINT);
     } else {
         object_set_effects(obj, cur_effects & ~EFFECT_DARK_TINT);
@@ -38,7 +38,7 @@ void projectile_tick(object *obj) {
 }
 
 void projectile_free(object *obj) {
-    free(object_get_userdata(obj));
+    game_state_free_userdata(obj->gs, object_get_userdata(obj));
 }
 
 void projectile_move(object *obj) {
@@ -125,7 +125,7 @@ void projectile_bootstrap(object *obj) {
 
 int projectile_create(object *obj) {
     // strore the HAR in local userdata instead
-    projectile_local *local = malloc(sizeof(projectile_local));
+    projectile_local *local = game_state_alloc_userdata(obj->gs, sizeof(projectile_local));
     local->owner = obj;
     local->wall_bounce = 0;
     local->ground_freeze = 0;
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <shadowdive/script.h>
+#include "game/particles.h"
+#include "game/objects/arena_constraints.h"
+#include "resources/frame_tags.h"
+#include "video/video.h"
+
+#define IS_ZERO(n) (n < 0.1 && n > -0.1)
+
+void particles_create(particle_system *ps) {
+    memset(ps, 0, sizeof(particle_system));
+}
+
+void particles_clear(particle_system *ps) {
+    for(int i = 0; i < ps->anim_count; i++) {
+        free(ps->anims[i].frames);
+    }
+    ps->anim_count = 0;
+    ps->count = 0;
+}
+
+void particles_free(particle_system *ps) {
+    particles_clear(ps);
+    free(ps->pool);
+    ps->pool = NULL;
+}
+
+// Decodes the frames of the animation string. The result has no frames if
+// the string uses tags a particle can't follow.
+static void particles_decode(particle_anim *pa, animation *ani) {
+    memset(pa, 0, sizeof(particle_anim));
+    pa->ani = ani;
+
+    sd_script script;
+    int err_pos;
+    sd_script_create(&script);
+    if(sd_script_decode(&script, str_c(&ani->animation_string), &err_pos) != SD_SUCCESS
+            || script.frame_count <= 0) {
+        sd_script_free(&script);
+        return;
+    }
+    particle_frame *frames = malloc(sizeof(particle_frame) * script.frame_count);
+    int start = 0;
+    for(int i = 0; i < script.frame_count; i++) {
+        const frame_tags *tags = tag_table_get(&ani->tags, i);
+        if(tags != NULL) {
+            for(int t = 0; t < TAG_COUNT; t++) {
+                if(t != TAG_D && t != TAG_BR && frame_tags_isset(tags, t)) {
+                    free(frames);
+                    sd_script_free(&script);
+                    return;
+                }
+            }
+        }
+        frames[i].start = start;
+        frames[i].len = script.frames[i].tick_len;
+        frames[i].sprite = script.frames[i].sprite;
+        frames[i].rewind = (tags != NULL && frame_tags_isset(tags, TAG_D)) ? frame_tags_get(tags, TAG_D) : -1;
+        frames[i].additive = (tags != NULL && frame_tags_isset(tags, TAG_BR));
+        start += frames[i].len;
+    }
+    pa->frames = frames;
+    pa->frame_count = script.frame_count;
+    pa->total_ticks = start;
+    sd_script_free(&script);
+}
+
+// The decoded animation, once per animation
+static const particle_anim* particles_get_anim(particle_system *ps, animation *ani) {
+    for(int i = 0; i < ps->anim_count; i++) {
+        if(ps->anims[i].ani == ani) {
+            return &ps->anims[i];
+        }
+    }
+    if(ps->anim_count >= PARTICLE_MAX_ANIMATIONS) {
+        return NULL;
+    }
+    particle_anim *pa = &ps->anims[ps->anim_count++];
+    particles_decode(pa, ani);
+    return pa;
+}
+
+static int particle_frame_at(const particle_anim *pa, int tick) {
+    if(tick < 0 || tick >= pa->total_ticks) {
+        return -1;
+    }
+    for(int i = 0; i < pa->frame_count; i++) {
+        if(tick < pa->frames[i].start + pa->frames[i].len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Takes the same steps player_run does for an object. Returns 1 once the
+// animation has run out.
+static int particle_animate(particle *p) {
+    const particle_anim *pa = p->anim;
+    int index = particle_frame_at(pa, p->tick);
+    if(index < 0) {
+        p->cur_sprite = NULL;
+        return 1;
+    }
+    if(index != particle_frame_at(pa, p->tick - 1)) {
+        const particle_frame *f = &pa->frames[index];
+        if(f->rewind >= 0 && !p->resting) {
+            p->tick = f->rewind;
+        }
+        p->cur_sprite = NULL;
+        if(f->sprite >= 0 && f->sprite < 25) {
+            p->cur_sprite = animation_get_sprite(pa->ani, f->sprite);
+        }
+        p->additive = f->additive;
+    }
+    p->tick++;
+    return 0;
+}
+
+// Same as scrap_move
+static void particle_move(particle *p) {
+    if(p->resting) {
+        return;
+    }
+    vec2i pos = p->pos;
+    vec2f vel = p->vel;
+    pos.x += vel.x;
+    vel.y += p->gravity;
+    pos.y += vel.y;
+
+    float dampen = 0.4;
+    if(pos.x < ARENA_LEFT_WALL) {
+        pos.x = ARENA_LEFT_WALL;
+        vel.x = -vel.x * dampen;
+    }
+    if(pos.x > ARENA_RIGHT_WALL) {
+        pos.x = ARENA_RIGHT_WALL;
+        vel.x = -vel.x * dampen;
+    }
+    if(pos.y > ARENA_FLOOR) {
+        pos.y = ARENA_FLOOR;
+        vel.y = -vel.y * dampen;
+        vel.x = vel.x * dampen;
+    }
+    if(IS_ZERO(vel.x)) vel.x = 0;
+    p->pos = pos;
+    p->vel = vel;
+
+    if(pos.y >= (ARENA_FLOOR-5) &&
+        IS_ZERO(vel.x) &&
+        vel.y < p->gravity * 1.1 &&
+        vel.y > p->gravity * -1.1)
+    {
+        p->resting = 1;
+    }
+}
+
+int particles_spawn(particle_system *ps, animation *ani, vec2i pos, vec2f vel,
+                    float gravity, int pal_offset, int layer, int shadow) {
+    // Whether an object is needed must only depend on the animation. The
+    // pool is not part of the game state, so when it is full the particle
+    // is just not shown.
+    const particle_anim *pa = particles_get_anim(ps, ani);
+    if(pa == NULL) {
+        // Out of cache slots, so decode just to find out
+        particle_anim tmp;
+        particles_decode(&tmp, ani);
+        int usable = (tmp.frames != NULL);
+        free(tmp.frames);
+        return !usable;
+    }
+    if(pa->frames == NULL) {
+        return 1;
+    }
+    if(ps->pool == NULL) {
+        ps->pool = malloc(sizeof(particle) * PARTICLE_MAX);
+    }
+    if(ps->count >= PARTICLE_MAX) {
+        return 0;
+    }
+    particle *p = &ps->pool[ps->count];
+    memset(p, 0, sizeof(particle));
+    p->pos = pos;
+    p->vel = vel;
+    p->gravity = gravity;
+    p->anim = pa;
+    p->pal_offset = pal_offset;
+    p->layer = layer;
+    p->shadow = shadow;
+    p->fresh = 1;
+
+    // Objects get a tick of their animation when they are spawned
+    if(!particle_animate(p)) {
+        ps->count++;
+    }
+    return 0;
+}
+
+void particles_tick(particle_system *ps) {
+    // Spawned particles skip moving on their first tick, like objects that
+    // are added in the middle of one. Removal keeps the order, so they are
+    // drawn the same way every time.
+    int n = 0;
+    for(int i = 0; i < ps->count; i++) {
+        particle *p = &ps->pool[i];
+        if(!p->fresh) {
+            particle_move(p);
+        }
+        p->fresh = 0;
+        if(particle_animate(p)) {
+            continue;
+        }
+        if(n != i) {
+            ps->pool[n] = *p;
+        }
+        n++;
+    }
+    ps->count = n;
+}
+
+void particles_render(const particle_system *ps, int layer) {
+    color tint = color_create(0xFF, 0xFF, 0xFF, 0xFF);
+    for(int i = 0; i < ps->count; i++) {
+        const particle *p = &ps->pool[i];
+        if(p->cur_sprite == NULL || p->layer != layer) {
+            continue;
+        }
+        video_render_sprite_flip_scale_opacity_tint(
+            sprite_use_surface(p->cur_sprite),
+            p->pos.x + p->cur_sprite->pos.x,
+            p->pos.y + p->cur_sprite->pos.y,
+            p->additive ? BLEND_ADDITIVE : BLEND_ALPHA,
+            p->pal_offset,
+            FLIP_NONE,
+            1.0f,
+            255,
+            tint);
+    }
+}
+
+void particles_render_shadows(const particle_system *ps) {
+    float scale_y = 0.25f;
+    for(int i = 0; i < ps->count; i++) {
+        const particle *p = &ps->pool[i];
+        if(p->cur_sprite == NULL || !p->shadow) {
+            continue;
+        }
+        int h = sprite_get_size(p->cur_sprite).y;
+        float temp = h * scale_y;
+        int x = p->pos.x + p->cur_sprite->pos.x;
+        int y = 190 - temp - (h - temp) / 2;
+        video_render_shadow(sprite_use_surface(p->cur_sprite), x, y, FLIP_NONE, scale_y);
+    }
+}
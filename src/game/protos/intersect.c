@@ -27,64 +27,92 @@ int intersect_object_point(object *obj, vec2i point) {
 }
 
 
+// Works out where the object's current frame and its hit points are in the
+// world, unless that was done already for the same frame, position and
+// direction. An object is usually checked against several others per tick.
+static const object_hit_frame* intersect_hit_frame(object *obj) {
+    object_hit_frame *f = &obj->hit_frame;
+    vec2i obj_pos = object_get_pos(obj);
+    int dir = object_get_direction(obj);
+    if(f->sprite == obj->cur_sprite && f->animation == obj->cur_animation && f->direction == dir
+       && f->obj_pos.x == obj_pos.x && f->obj_pos.y == obj_pos.y) {
+        return f;
+    }
+    const sprite *sp = obj->cur_sprite;
+    f->sprite = sp;
+    f->animation = obj->cur_animation;
+    f->obj_pos = obj_pos;
+    f->direction = dir;
+    f->size = object_get_size(obj);
+    f->pos = vec2i_add(obj_pos, sp->pos);
+    if(dir == OBJECT_FACE_LEFT) {
+        f->pos.x = obj_pos.x + ((sp->pos.x * -1) - f->size.x);
+    }
+    f->coord_count = 0;
+    f->coords = NULL;
+    if(obj->cur_animation != NULL) {
+        f->coords = animation_get_frame_coords(obj->cur_animation, sp->id, &f->coord_count);
+    }
+
+    // Hit points are mirrored along with the object
+    f->sign = (dir == OBJECT_FACE_RIGHT) ? 1 : -1;
+    f->base.x = (dir == OBJECT_FACE_RIGHT) ? f->pos.x - sp->pos.x : f->pos.x + f->size.x + sp->pos.x;
+    f->base.y = f->pos.y - sp->pos.y;
+    for(int i = 0; i < f->coord_count; i++) {
+        int x = f->base.x + f->sign * f->coords[i].pos.x;
+        int y = f->base.y + f->coords[i].pos.y;
+        if(i == 0) {
+            f->hit_min = f->hit_max = vec2i_create(x, y);
+            continue;
+        }
+        f->hit_min.x = (x < f->hit_min.x) ? x : f->hit_min.x;
+        f->hit_min.y = (y < f->hit_min.y) ? y : f->hit_min.y;
+        f->hit_max.x = (x > f->hit_max.x) ? x : f->hit_max.x;
+        f->hit_max.y = (y > f->hit_max.y) ? y : f->hit_max.y;
+    }
+    return f;
+}
+
 int intersect_sprite_hitpoint(object *obj, object *target, int level, vec2i *point) {
     // Make sure both objects have sprites going
     if(obj->cur_sprite == NULL || target->cur_sprite == NULL) {
         return 0;
     }
     // Make sure there are hitpoints to check.
-    if(vector_size(&obj->cur_animation->collision_coords) == 0) {
+    const object_hit_frame *a = intersect_hit_frame(obj);
+    if(a->coord_count == 0) {
         return 0;
     }
 
-    // Some useful variables
-    vec2i pos_a = vec2i_add(object_get_pos(obj), obj->cur_sprite->pos);
-    vec2i pos_b = vec2i_add(object_get_pos(target), target->cur_sprite->pos);
-    vec2i size_a = object_get_size(obj);
-    vec2i size_b = object_get_size(target);
-
-    if (object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        pos_a.x = object_get_pos(obj).x + ((obj->cur_sprite->pos.x * -1) - size_a.x);
-    }
-
-    if (object_get_direction(target) == OBJECT_FACE_LEFT) {
-        pos_b.x = object_get_pos(target).x + ((target->cur_sprite->pos.x * -1) - size_b.x);
+    // Nothing to look at if no hitpoint is within the area of the target sprite
+    const object_hit_frame *b = intersect_hit_frame(target);
+    vec2i pos_b = b->pos;
+    vec2i size_b = b->size;
+    if(a->hit_max.x < pos_b.x || a->hit_min.x >= pos_b.x + size_b.x
+       || a->hit_max.y < pos_b.y || a->hit_min.y >= pos_b.y + size_b.y) {
+        return 0;
     }
 
-
-    // Iterate through hitpoints
+    // Iterate through the hitpoints of the current frame
+    surface *sfc = sprite_use_surface(target->cur_sprite);
+    int mirror = (b->direction == OBJECT_FACE_LEFT);
     vec2i hcoords[level];
     int found = 0;
-    iterator it;
-    collision_coord *cc;
-    vector_iter_begin(&obj->cur_animation->collision_coords, &it);
-    while((cc = iter_next(&it)) != NULL) {
-        // Skip coords that don't belong to the frame we are checking
-        if(cc->frame_index != obj->cur_sprite->id) continue;
-
-        // Convert coords to target sprite local space
-        int t = (object_get_direction(obj) == OBJECT_FACE_RIGHT)
-            ? (pos_a.x + cc->pos.x - obj->cur_sprite->pos.x)
-            : (pos_a.x + (size_a.x - cc->pos.x) + obj->cur_sprite->pos.x);
+    for(int i = 0; i < a->coord_count; i++) {
+        const collision_coord *cc = &a->coords[i];
 
-        // convert global coordinates to local coordinates by compensating for the other player's position
-        int xcoord = t - pos_b.x;
+        // convert global coordinates to local coordinates by compensating for the other player's position.
         // Also note that the hit pixel position during jumps is innacurate because hacks
-        int ycoord = (pos_a.y + size_a.y + cc->pos.y) - pos_b.y;
-
-        ycoord -= (obj->cur_sprite->pos.y + size_a.y);
+        int xcoord = a->base.x + a->sign * cc->pos.x - pos_b.x;
+        int ycoord = a->base.y + cc->pos.y - pos_b.y;
 
         // Make sure that the hitpixel is within the area of the target sprite
         if(xcoord < 0 || xcoord >= size_b.x) continue;
         if(ycoord < 0 || ycoord >= size_b.y) continue;
 
         // Get hitpixel
-        surface *sfc = target->cur_sprite->data;
-        int hitpoint = (ycoord * sfc->w) + xcoord;
-        if (object_get_direction(target) == OBJECT_FACE_LEFT) {
-            hitpoint = (ycoord * sfc->w) + (sfc->w - xcoord);
-        }
-        if(sfc->stencil[hitpoint] > 0) {
+        int hitpoint = (ycoord * sfc->w) + (mirror ? sfc->w - xcoord : xcoord);
+        if(surface_stencil_at(sfc, hitpoint)) {
             hcoords[found++] = vec2i_create(xcoord, ycoord);
             if(found >= level) {
                 vec2f sum = vec2f_create(0,0);
@@ -8,9 +8,16 @@
 #include "video/video.h"
 #include "utils/log.h"
 #include "utils/miscmath.h"
+#include "utils/fixedpoint.h"
 
 #define UNUSED(x) (void)(x)
 
+// How many upcoming animation frames get their sprites warmed up in the renderer
+#define OBJECT_PREWARM_FRAMES 3
+
+// Room for this many random draws per tick, see object_random_int
+#define OBJECT_RANDOM_DRAWS 4
+
 /** \brief Creates a new, empty object.
   * \param obj Object handle
   * \param gs Game state handle
@@ -23,6 +30,7 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
 
     // Position related
     obj->pos = vec2i_to_f(pos);
+    obj->prev_pos = obj->pos;
     // remember the place we were spawned, the x= and y= tags are relative to that
     obj->start = vec2i_to_f(pos);
     obj->vel = vel;
@@ -42,7 +50,7 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
 
     // Fire orb wandering
     obj->orbit = 0;
-    obj->orbit_tick = MATH_PI/2.0f;
+    obj->orbit_tick = FIXED_TURN / 4;
     obj->orbit_dest = obj->start;
     obj->orbit_pos = obj->start;
     obj->orbit_pos_vary = vec2f_create(0, 0);
@@ -54,6 +62,7 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
     obj->sprite_override = 0;
     obj->sound_translation_table = NULL;
     obj->cur_surface = NULL;
+    obj->hit_frame.sprite = NULL;
     obj->cur_remap = -1;
     obj->pal_offset = 0;
     obj->halt = 0;
@@ -64,7 +73,7 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
 
     obj->custom_str = NULL;
 
-    random_seed(&obj->rand_state, rand_intmax());
+    obj->rand_key = random_intmax(&gs->rand);
 
     // For enabling hit on the current and the next n-1 frames
     obj->hit_frames = 0;
@@ -85,41 +94,90 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
     obj->pal_transform = NULL;
 }
 
+// The part of an object that goes into a serialized state
+typedef struct object_wire_t {
+    float pos_x;
+    float pos_y;
+    float vel_x;
+    float vel_y;
+    float gravity;
+    int direction;
+    int group;
+    int layers;
+    int stride;
+    int repeat;
+    int sprite_override;
+    int age;
+    int seed;
+    int animation_id;
+    int pal_offset;
+    int hit_frames;
+    int can_hit;
+    int current_tick;
+    int previous_tick;
+    int reverse;
+} object_wire;
+
+static const serial_field object_fields[] = {
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, object_wire, pos_x),
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, object_wire, pos_y),
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, object_wire, vel_x),
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, object_wire, vel_y),
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, object_wire, gravity),
+    SERIAL_FIELD(SERIAL_FIELD_INT, object_wire, direction),
+    SERIAL_FIELD(SERIAL_FIELD_INT, object_wire, group),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, layers),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, stride),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, object_wire, repeat),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, object_wire, sprite_override),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, age),
+    SERIAL_FIELD(SERIAL_FIELD_RAW32, object_wire, seed),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, animation_id),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, pal_offset),
+    SERIAL_FIELD(SERIAL_FIELD_INT, object_wire, hit_frames),
+    SERIAL_FIELD(SERIAL_FIELD_INT, object_wire, can_hit),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, current_tick),
+    SERIAL_FIELD(SERIAL_FIELD_UINT, object_wire, previous_tick),
+    SERIAL_FIELD(SERIAL_FIELD_FLAG, object_wire, reverse),
+};
+
 /*
  * Serializes the object to a buffer. Should return 1 on error, 0 on success
  * This will call the specialized objects, eg. har or projectile for their
  * serialization data.
  */
 int object_serialize(object *obj, serial *ser) {
-    serial_write_float(ser, obj->pos.x);
-    serial_write_float(ser, obj->pos.y);
-    serial_write_float(ser, obj->vel.x);
-    serial_write_float(ser, obj->vel.y);
-    serial_write_float(ser, obj->gravity);
-    serial_write_int8(ser, obj->direction);
-    serial_write_int8(ser, obj->group);
-    serial_write_int8(ser, obj->layers);
-    serial_write_int8(ser, obj->stride);
-    serial_write_int8(ser, object_get_repeat(obj));
-    serial_write_int8(ser, obj->sprite_override);
-    serial_write_int32(ser, obj->age);
-    serial_write_int32(ser, random_get_seed(&obj->rand_state));
-    serial_write_int8(ser, obj->cur_animation->id);
-    serial_write_int8(ser, obj->pal_offset);
-    serial_write_int8(ser, obj->hit_frames);
-    serial_write_int8(ser, obj->can_hit);
+    object_wire w;
+    w.pos_x = obj->pos.x;
+    w.pos_y = obj->pos.y;
+    w.vel_x = obj->vel.x;
+    w.vel_y = obj->vel.y;
+    w.gravity = obj->gravity;
+    w.direction = obj->direction;
+    w.group = obj->group;
+    w.layers = obj->layers;
+    w.stride = obj->stride;
+    w.repeat = object_get_repeat(obj);
+    w.sprite_override = obj->sprite_override;
+    w.age = obj->age;
+    w.seed = obj->rand_key;
+    w.animation_id = obj->cur_animation->id;
+    w.pal_offset = obj->pal_offset;
+    w.hit_frames = obj->hit_frames;
+    w.can_hit = obj->can_hit;
+    w.current_tick = obj->animation_state.current_tick;
+    w.previous_tick = obj->animation_state.previous_tick;
+    w.reverse = obj->animation_state.reverse;
+    serial_write_fields(ser, object_fields, SERIAL_FIELD_COUNT(object_fields), &w);
 
     // Write animation state
     if (obj->custom_str) {
-        serial_write_int16(ser, strlen(obj->custom_str)+1);
+        serial_write_varint(ser, strlen(obj->custom_str)+1);
         serial_write(ser, obj->custom_str, strlen(obj->custom_str)+1);
     } else {
         // using regular animation string from animation
-        serial_write_int16(ser, 0);
+        serial_write_varint(ser, 0);
     }
-    serial_write_int16(ser, (int)obj->animation_state.current_tick);
-    serial_write_int16(ser, (int)obj->animation_state.previous_tick);
-    serial_write_int8(ser, (int)obj->animation_state.reverse);
 
     /*DEBUG("Animation state: [%d] %s, ticks = %d stride = %d direction = %d pos = %f,%f vel = %f,%f gravity = %f", strlen(player_get_str(obj))+1, player_get_str(obj), obj->animation_state.ticks, obj->stride, obj->animation_state.reverse, obj->pos.x, obj->pos.y, obj->vel.x, obj->vel.y, obj->gravity);*/
 
@@ -140,23 +198,18 @@ int object_serialize(object *obj, serial *ser) {
  * Serial reder position should be set to correct position before calling this.
  */
 int object_unserialize(object *obj, serial *ser, game_state *gs) {
-    obj->pos.x = serial_read_float(ser);
-    obj->pos.y = serial_read_float(ser);
-    obj->vel.x = serial_read_float(ser);
-    obj->vel.y = serial_read_float(ser);
-    float gravity = serial_read_float(ser);
-    obj->direction = serial_read_int8(ser);
-    obj->group = serial_read_int8(ser);
-    obj->layers = serial_read_int8(ser);
-    uint8_t stride = serial_read_int8(ser);
-    uint8_t repeat = serial_read_int8(ser);
-    obj->sprite_override = serial_read_int8(ser);
-    obj->age = serial_read_int32(ser);
-    random_seed(&obj->rand_state, serial_read_int32(ser));
-    uint8_t animation_id = serial_read_int8(ser);
-    uint8_t pal_offset = serial_read_int8(ser);
-    int8_t hit_frames = serial_read_int8(ser);
-    int8_t can_hit = serial_read_int8(ser);
+    object_wire w;
+    serial_read_fields(ser, object_fields, SERIAL_FIELD_COUNT(object_fields), &w);
+    obj->pos.x = w.pos_x;
+    obj->pos.y = w.pos_y;
+    obj->vel.x = w.vel_x;
+    obj->vel.y = w.vel_y;
+    obj->direction = w.direction;
+    obj->group = w.group;
+    obj->layers = w.layers;
+    obj->sprite_override = w.sprite_override;
+    obj->age = w.age;
+    obj->rand_key = w.seed;
 
     // Other stuff not included in serialization
     obj->y_percent = 1.0;
@@ -171,14 +224,13 @@ int object_unserialize(object *obj, serial *ser, game_state *gs) {
     player_create(obj);
 
     // Read animation state
-    uint16_t anim_str_len = serial_read_int16(ser);
+    uint16_t anim_str_len = serial_read_varint(ser);
     char anim_str[anim_str_len+1];
     if(anim_str_len > 0) {
         serial_read(ser, anim_str, anim_str_len);
     }
-    obj->animation_state.current_tick = (uint16_t)serial_read_int16(ser);
-    obj->animation_state.previous_tick = (uint16_t)serial_read_int16(ser);
-    uint8_t reverse = serial_read_int8(ser);
+    obj->animation_state.current_tick = w.current_tick;
+    obj->animation_state.previous_tick = w.previous_tick;
 
     // Read the specialization ID from ther serial "stream".
     // This should be an int.
@@ -192,7 +244,7 @@ int object_unserialize(object *obj, serial *ser, game_state *gs) {
     // serialization data. serial object should be pointing to the
     // start of that data.
     if(obj->unserialize != NULL) {
-        obj->unserialize(obj, ser, animation_id, gs);
+        obj->unserialize(obj, ser, w.animation_id, gs);
     } else {
         DEBUG("object has no special unserializer");
     }
@@ -203,17 +255,17 @@ int object_unserialize(object *obj, serial *ser, game_state *gs) {
         DEBUG("serialized object has custom animation string %s", anim_str);
         player_reload_with_str(obj, anim_str);
     }
-    if(reverse) {
+    if(w.reverse) {
         object_set_playback_direction(obj, PLAY_BACKWARDS);
     }
 
     // deserializing hars can reset these, so we have to set this late
-    obj->stride = stride;
-    object_set_gravity(obj, gravity);
-    object_set_repeat(obj, repeat);
-    object_set_pal_offset(obj, pal_offset);
-    obj->hit_frames = hit_frames;
-    obj->can_hit = can_hit;
+    obj->stride = w.stride;
+    object_set_gravity(obj, w.gravity);
+    object_set_repeat(obj, w.repeat);
+    object_set_pal_offset(obj, w.pal_offset);
+    obj->hit_frames = w.hit_frames;
+    obj->can_hit = w.can_hit;
 
     /*DEBUG("Animation state: [%d] %s, ticks = %d stride = %d direction = %d pos = %f,%f vel = %f,%f gravity = %f", strlen(player_get_str(obj))+1, player_get_str(obj), obj->animation_state.ticks, obj->stride, obj->animation_state.reverse, obj->pos.x, obj->pos.y, obj->vel.x, obj->vel.y, obj->gravity);*/
 
@@ -312,21 +364,53 @@ int object_get_effects(const object *obj) {
     return obj->video_effects;
 }
 
+// Objects moving further than this in one tick have jumped, not moved
+#define INTERPOLATE_MAX_DIST 32.0f
+
+// Where to draw the object, somewhere between where the last dynamic tick
+// started and ended, when the game state asks for interpolation
+static vec2f object_render_pos(object *obj) {
+    float alpha = obj->gs != NULL ? obj->gs->render_alpha : 1.0f;
+    vec2f d = vec2f_sub(obj->pos, obj->prev_pos);
+    if(alpha >= 1.0f || d.x > INTERPOLATE_MAX_DIST || d.x < -INTERPOLATE_MAX_DIST ||
+       d.y > INTERPOLATE_MAX_DIST || d.y < -INTERPOLATE_MAX_DIST) {
+        return obj->pos;
+    }
+    return vec2f_create(obj->prev_pos.x + d.x * alpha, obj->prev_pos.y + d.y * alpha);
+}
+
+// Hands the sprites of the next few frames to the renderer, so that their
+// textures can be built before they are first drawn. Sprites that are still
+// waiting to be decoded are left for later, decoding isn't that cheap.
+static void object_prewarm(object *obj) {
+    const sd_script *parser = obj->animation_state.parser;
+    if(obj->cur_animation == NULL || obj->sprite_override) return;
+    int frame = player_get_frame(obj);
+    if(frame < 0) return;
+    for(int i = frame + 1; i <= frame + OBJECT_PREWARM_FRAMES && i < parser->frame_count; i++) {
+        sprite *sp = animation_get_sprite(obj->cur_animation, parser->frames[i].sprite);
+        if(sp != NULL && sprite_is_decoded(sp)) {
+            video_prewarm_sprite(sprite_use_surface(sp), obj->pal_offset);
+        }
+    }
+}
+
 void object_render(object *obj) {
     // Stop here if cur_sprite is NULL
     if(obj->cur_sprite == NULL) return;
 
     // Set current surface
-    obj->cur_surface = obj->cur_sprite->data;
+    obj->cur_surface = sprite_use_surface(obj->cur_sprite);
 
     // Something to ease the pain ...
     player_sprite_state *rstate = &obj->sprite_state;
 
     // Position
-    int y = obj->pos.y + obj->cur_sprite->pos.y;
-    int x = obj->pos.x + obj->cur_sprite->pos.x;
+    vec2f pos = object_render_pos(obj);
+    int y = pos.y + obj->cur_sprite->pos.y;
+    int x = pos.x + obj->cur_sprite->pos.x;
     if(object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        x = obj->pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
+        x = pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
     }
 
     // Flip to face the right direction
@@ -374,6 +458,8 @@ void object_render(object *obj) {
         obj->y_percent,
         opacity,
         tint);
+
+    object_prewarm(obj);
 }
 
 void object_render_shadow(object *obj) {
@@ -387,9 +473,10 @@ void object_render_shadow(object *obj) {
 
     // Determine X
     int flipmode = obj->sprite_state.flipmode;
-    int x = obj->pos.x + obj->cur_sprite->pos.x;
+    vec2f pos = object_render_pos(obj);
+    int x = pos.x + obj->cur_sprite->pos.x;
     if(object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        x = obj->pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
+        x = pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
         flipmode ^= FLIP_HORIZONTAL;
     }
 
@@ -397,19 +484,9 @@ void object_render_shadow(object *obj) {
     float temp = object_h(obj) * scale_y;
     int y = 190 - temp - (object_h(obj) - temp) / 2;
 
-    // Render shadow object twice with different offsets, so that
+    // The shadow pass spreads the silhouette a bit, so that
     // the shadows seem a bit blobbier and shadow-y
-    for(int i = 0; i < 2; i++) {
-        video_render_sprite_flip_scale_opacity_tint(
-            obj->cur_sprite->data,
-            x+i, y+i,
-            BLEND_ALPHA,
-            obj->pal_offset,
-            flipmode,
-            scale_y,
-            50,
-            color_create(0,0,0,255));
-    }
+    video_render_shadow(sprite_use_surface(obj->cur_sprite), x, y, flipmode, scale_y);
 }
 
 int object_act(object *obj, int action) {
@@ -427,6 +504,17 @@ void object_move(object *obj) {
     if(obj->move != NULL) {
         obj->move(obj);
     }
+
+    // Movement only adds and scales these, so with every value on the grid
+    // the sums are exact and the odd rounding difference of a product between
+    // two FPUs is rounded away again before it can add up.
+    if(obj->gs != NULL && obj->gs->fixed_physics) {
+        obj->pos.x = fixed_snap(obj->pos.x);
+        obj->pos.y = fixed_snap(obj->pos.y);
+        obj->vel.x = fixed_snap(obj->vel.x);
+        obj->vel.y = fixed_snap(obj->vel.y);
+        obj->gravity = fixed_snap(obj->gravity);
+    }
 }
 
 // This does palette transformations to the WHOLE screen palette
@@ -434,30 +522,12 @@ void object_move(object *obj) {
 int object_scenewide_palette_transform(object *obj, screen_palette *pal) {
     player_sprite_state *rstate = &obj->sprite_state;
     if(rstate->pal_entry_count > 0 && rstate->duration > 0) {
-        float bp = ((float)rstate->pal_begin) +
-            ((float)rstate->pal_end - (float)rstate->pal_begin) *
-            ((float)rstate->timer / (float)rstate->duration);
-
-        color b;
-        b.r = pal->data[rstate->pal_ref_index][0];
-        b.g = pal->data[rstate->pal_ref_index][1];
-        b.b = pal->data[rstate->pal_ref_index][2];
-
-        uint8_t m;
-        float u;
-        float k = bp / 255.0f;
-        for(int i = rstate->pal_start_index; i < rstate->pal_start_index + rstate->pal_entry_count; i++) {
-            if(rstate->pal_tint) {
-                m = max3(pal->data[i][0], pal->data[i][1], pal->data[i][2]);
-                u = m / 255.0f;
-                pal->data[i][0] = max2(0, min2(255, pal->data[i][0] + u * k * (b.r - pal->data[i][0])));
-                pal->data[i][1] = max2(0, min2(255, pal->data[i][1] + u * k * (b.g - pal->data[i][1])));
-                pal->data[i][2] = max2(0, min2(255, pal->data[i][2] + u * k * (b.b - pal->data[i][2])));
-            } else {
-                pal->data[i][0] = max2(0, min2(255, pal->data[i][0] * (1 - k) + (b.r * k)));
-                pal->data[i][1] = max2(0, min2(255, pal->data[i][1] * (1 - k) + (b.g * k)));
-                pal->data[i][2] = max2(0, min2(255, pal->data[i][2] * (1 - k) + (b.b * k)));
-            }
+        int weight = rstate->pal_begin * 256 +
+            (rstate->pal_end - rstate->pal_begin) * 256 * rstate->timer / rstate->duration;
+        if(rstate->pal_tint) {
+            screen_palette_tint(pal, rstate->pal_start_index, rstate->pal_entry_count, rstate->pal_ref_index, weight);
+        } else {
+            screen_palette_blend(pal, rstate->pal_start_index, rstate->pal_entry_count, rstate->pal_ref_index, weight);
         }
         return 1;
     }
@@ -492,6 +562,7 @@ void object_free(object *obj) {
     }
     obj->cur_surface = NULL;
     obj->cur_animation = NULL;
+    obj->hit_frame.sprite = NULL;
 }
 
 /** Sets a pointer to a sound translation table. Note! Does NOT copy!
@@ -533,6 +604,7 @@ void object_set_animation(object *obj, animation *ani) {
     obj->custom_str = NULL;
     obj->cur_animation = ani;
     obj->cur_animation_own = OWNER_EXTERNAL;
+    obj->hit_frame.sprite = NULL;
     player_reload(obj);
 
     // Debug texts
@@ -663,6 +735,10 @@ uint32_t object_get_age(object *obj) {
     return obj->age;
 }
 
+uint32_t object_random_int(object *obj, uint32_t draw, uint32_t upperbound) {
+    return random_hash_int(obj->rand_key, obj->age * OBJECT_RANDOM_DRAWS + draw, upperbound);
+}
+
 void object_set_spawn_cb(object *obj, object_state_add_cb cbf, void *userdata) {
     obj->animation_state.spawn = cbf;
     obj->animation_state.spawn_userdata = userdata;
@@ -10,15 +10,29 @@
 #include "audio/sound.h"
 #include "audio/music.h"
 #include "resources/ids.h"
+#include "resources/script_cache.h"
 #include "game/protos/player.h"
 #include "game/protos/object.h"
 #include "utils/str.h"
 #include "utils/miscmath.h"
 #include "utils/log.h"
-#include "utils/random.h"
 
 // ---------------- Private functions ----------------
 
+static const frame_tags empty_tags;
+
+static const sd_script_frame* player_frame_at(const player_animation_state *state, int tick) {
+    int index = frame_timeline_frame_at(state->timeline, tick);
+    return (index >= 0) ? &state->parser->frames[index] : NULL;
+}
+
+// Start tick of a frame. Frames past the end are left to the script, which
+// has its own idea of where they are.
+static int player_frame_start(const player_animation_state *state, int frame_index) {
+    int tick = frame_timeline_frame_start(state->timeline, frame_index);
+    return (tick >= 0) ? tick : sd_script_get_tick_pos_at_frame(state->parser, frame_index);
+}
+
 void player_clear_frame(object *obj) {
     player_sprite_state *s = &obj->sprite_state;
     s->blendmode = BLEND_ALPHA;
@@ -61,24 +75,58 @@ void player_create(object *obj) {
     obj->animation_state.enemy = NULL;
     obj->slide_state.timer = 0;
     obj->slide_state.vel = vec2f_create(0,0);
-    sd_script_create(&obj->animation_state.parser);
+    sd_script_create(&obj->animation_state.own_parser);
+    obj->animation_state.parser = &obj->animation_state.own_parser;
+    tag_table_create(&obj->animation_state.own_tags);
+    obj->animation_state.tags = &obj->animation_state.own_tags;
+    frame_timeline_create(&obj->animation_state.own_timeline);
+    obj->animation_state.timeline = &obj->animation_state.own_timeline;
     player_clear_frame(obj);
 }
 
 void player_free(object *obj) {
-    sd_script_free(&obj->animation_state.parser);
+    sd_script_free(&obj->animation_state.own_parser);
+    tag_table_free(&obj->animation_state.own_tags);
+    frame_timeline_free(&obj->animation_state.own_timeline);
 }
 
-void player_reload_with_str(object *obj, const char* custom_str) {
-    // Free and reload parser
-    sd_script_free(&obj->animation_state.parser);
-    sd_script_create(&obj->animation_state.parser);
-    int ret;
-    int err_pos;
-    ret = sd_script_decode(&obj->animation_state.parser, custom_str, &err_pos);
-    if(ret != SD_SUCCESS) {
-        PERROR("Decoder error %s at position %d in string \"%s\"",
-            sd_get_error(ret), err_pos, custom_str);
+// Loads a new animation string. An animation's string has been decoded and
+// compiled already, and is shared; so is a custom string once it has been seen.
+// Anything else is decoded and compiled here.
+static void player_load(object *obj, const char *custom_str, const animation *ani) {
+    player_animation_state *state = &obj->animation_state;
+    const script_cache_entry *cached = NULL;
+    sd_script_free(&state->own_parser);
+    sd_script_create(&state->own_parser);
+    if(ani != NULL && ani->script_ok) {
+        tag_table_free(&state->own_tags);
+        frame_timeline_free(&state->own_timeline);
+        state->parser = &ani->script;
+        state->tags = &ani->tags;
+        state->timeline = &ani->timeline;
+    } else if(ani == NULL && (cached = script_cache_get(custom_str)) != NULL) {
+        tag_table_free(&state->own_tags);
+        frame_timeline_free(&state->own_timeline);
+        state->parser = &cached->script;
+        state->tags = &cached->tags;
+        state->timeline = &cached->timeline;
+    } else {
+        int err_pos;
+        int ret = sd_script_decode(&state->own_parser, custom_str, &err_pos);
+        if(ret != SD_SUCCESS) {
+            PERROR("Decoder error %s at position %d in string \"%s\"",
+                sd_get_error(ret), err_pos, custom_str);
+        }
+        state->parser = &state->own_parser;
+        frame_timeline_compile(&state->own_timeline, &state->own_parser);
+        state->timeline = &state->own_timeline;
+        if(ani != NULL) {
+            tag_table_free(&state->own_tags);
+            state->tags = &ani->tags;
+        } else {
+            tag_table_compile(&state->own_tags, &state->own_parser);
+            state->tags = &state->own_tags;
+        }
     }
 
     // Set player state
@@ -93,8 +141,12 @@ void player_reload_with_str(object *obj, const char* custom_str) {
     obj->can_hit = 0;
 }
 
+void player_reload_with_str(object *obj, const char* custom_str) {
+    player_load(obj, custom_str, NULL);
+}
+
 void player_reload(object *obj) {
-    player_reload_with_str(obj, str_c(&obj->cur_animation->animation_string));
+    player_load(obj, str_c(&obj->cur_animation->animation_string), obj->cur_animation);
 }
 
 void player_reset(object *obj) {
@@ -105,15 +157,37 @@ void player_reset(object *obj) {
 }
 
 int player_frame_isset(const object *obj, const char *tag) {
-    const sd_script_frame *frame = sd_script_get_frame_at(&obj->animation_state.parser, obj->animation_state.current_tick);
+    int id = tag_lookup(tag);
+    if(id >= 0) {
+        return player_frame_tag_isset(obj, id);
+    }
+    const sd_script_frame *frame = player_frame_at(&obj->animation_state, obj->animation_state.current_tick);
     return sd_script_isset(frame, tag);
 }
 
 int player_frame_get(const object *obj, const char *tag) {
-    const sd_script_frame *frame = sd_script_get_frame_at(&obj->animation_state.parser, obj->animation_state.current_tick);
+    int id = tag_lookup(tag);
+    if(id >= 0) {
+        return player_frame_tag_get(obj, id);
+    }
+    const sd_script_frame *frame = player_frame_at(&obj->animation_state, obj->animation_state.current_tick);
     return sd_script_get(frame, tag);
 }
 
+const frame_tags* player_get_frame_tags(const object *obj, int frame_index) {
+    return tag_table_get(obj->animation_state.tags, frame_index);
+}
+
+int player_frame_tag_isset(const object *obj, int tag) {
+    const frame_tags *tags = player_get_frame_tags(obj, player_get_frame(obj));
+    return tags != NULL && frame_tags_isset(tags, tag);
+}
+
+int player_frame_tag_get(const object *obj, int tag) {
+    const frame_tags *tags = player_get_frame_tags(obj, player_get_frame(obj));
+    return tags != NULL ? frame_tags_get(tags, tag) : 0;
+}
+
 void player_set_delay(object *obj, int delay) {
 
     /*
@@ -186,13 +260,13 @@ void player_run(object *obj) {
     }
 
     // Not sure what this does
-    const sd_script_frame *frame = sd_script_get_frame_at(&state->parser, state->current_tick);
+    const sd_script_frame *frame = player_frame_at(state, state->current_tick);
 
     // Animation has ended ?
     if(frame == NULL) {
         if(state->repeat) {
             player_reset(obj);
-            frame = sd_script_get_frame_at(&state->parser, state->current_tick);
+            frame = player_frame_at(state, state->current_tick);
         } else if(obj->finish != NULL) {
             obj->cur_sprite = NULL;
             obj->finish(obj);
@@ -211,136 +285,146 @@ void player_run(object *obj) {
         // We shouldn't really get here, unless stringparser messes something up badly
     } else {
         // If frame changed, do something
-        if(sd_script_frame_changed(&state->parser, state->previous_tick, state->current_tick)) {
+        if(player_frame_at(state, state->previous_tick) != frame) {
             state->entered_frame = 1;
+            const frame_tags *tags = tag_table_get(state->tags, frame - state->parser->frames);
+            if(tags == NULL) {
+                // Tags are compiled from the same string, so this should never happen
+                tags = &empty_tags;
+            }
             player_clear_frame(obj);
 
             // Tick management
-            if(sd_script_isset(frame, "d")) {
+            if(frame_tags_isset(tags, TAG_D)) {
                 if(!obj->animation_state.disable_d) {
-                    state->previous_tick = sd_script_get(frame, "d")-1;
-                    state->current_tick = sd_script_get(frame, "d");
+                    state->previous_tick = frame_tags_get(tags, TAG_D)-1;
+                    state->current_tick = frame_tags_get(tags, TAG_D);
                 }
             }
 
             // Hover flag
-            if(sd_script_isset(frame, "h")) {
+            if(frame_tags_isset(tags, TAG_H)) {
                 rstate->disable_gravity = 1;
             } else {
                 rstate->disable_gravity = 0;
             }
 
-            if(sd_script_isset(frame, "ua")) {
+            if(frame_tags_isset(tags, TAG_UA)) {
                 obj->animation_state.enemy->sprite_state.disable_gravity = 1;
             }
 
             // Animation creation command
-            if(sd_script_isset(frame, "m") && state->spawn != NULL) {
+            if(frame_tags_isset(tags, TAG_M) && state->spawn != NULL) {
                 int mx = 0;
-                if (sd_script_isset(frame, "mrx")) {
-                    int mrx = sd_script_get(frame, "mrx");
-                    int mm = sd_script_isset(frame, "mm") ? sd_script_get(frame, "mm") : mrx;
-                    mx = random_int(&obj->rand_state, 320 - 2*mm) + mrx;
+                if (frame_tags_isset(tags, TAG_MRX)) {
+                    int mrx = frame_tags_get(tags, TAG_MRX);
+                    int mm = frame_tags_isset(tags, TAG_MM) ? frame_tags_get(tags, TAG_MM) : mrx;
+                    mx = object_random_int(obj, 0, 320 - 2*mm) + mrx;
                     DEBUG("randomized mx as %d", mx);
-                } else if(sd_script_isset(frame, "mx")) {
-                    mx = obj->start.x + (sd_script_get(frame, "mx") * object_get_direction(obj));
+                } else if(frame_tags_isset(tags, TAG_MX)) {
+                    mx = obj->start.x + (frame_tags_get(tags, TAG_MX) * object_get_direction(obj));
                 }
 
                 int my = 0;
-                if (sd_script_isset(frame, "mry")) {
-                    int mry = sd_script_get(frame, "mry");
-                    int mm = sd_script_isset(frame, "mm") ? sd_script_get(frame, "mm") : mry;
-                    my = random_int(&obj->rand_state, 320 - 2*mm) + mry;
+                if (frame_tags_isset(tags, TAG_MRY)) {
+                    int mry = frame_tags_get(tags, TAG_MRY);
+                    int mm = frame_tags_isset(tags, TAG_MM) ? frame_tags_get(tags, TAG_MM) : mry;
+                    my = object_random_int(obj, 1, 320 - 2*mm) + mry;
                     DEBUG("randomized my as %d", my);
-                } else if(sd_script_isset(frame, "my")) {
-                    my = obj->start.y + sd_script_get(frame, "my");
+                } else if(frame_tags_isset(tags, TAG_MY)) {
+                    my = obj->start.y + frame_tags_get(tags, TAG_MY);
                 }
 
-                int mg = sd_script_isset(frame, "mg") ? sd_script_get(frame, "mg") : 0;
+                int mg = frame_tags_isset(tags, TAG_MG) ? frame_tags_get(tags, TAG_MG) : 0;
                 state->spawn(
                     obj,
-                    sd_script_get(frame, "m"),
+                    frame_tags_get(tags, TAG_M),
                     vec2i_create(mx, my),
                     mg,
                     state->spawn_userdata);
             }
 
             // Animation deletion
-            if(sd_script_isset(frame, "md") && state->destroy != NULL) {
-                state->destroy(obj, sd_script_get(frame, "md"), state->destroy_userdata);
+            if(frame_tags_isset(tags, TAG_MD) && state->destroy != NULL) {
+                state->destroy(obj, frame_tags_get(tags, TAG_MD), state->destroy_userdata);
             }
 
-            // Music playback
-            if(sd_script_isset(frame, "smo")) {
-                if(sd_script_get(frame, "smo") == 0) {
-                    music_stop();
+            // Music playback. Speculative ticks stay quiet.
+            int audible = !game_state_is_speculative(obj->gs);
+            if(frame_tags_isset(tags, TAG_SMO)) {
+                if(frame_tags_get(tags, TAG_SMO) == 0) {
+                    if(audible) {
+                        music_stop();
+                    }
                     return;
                 }
-                music_play(PSM_END + (sd_script_get(frame, "smo") - 1));
+                if(audible) {
+                    music_play(PSM_END + (frame_tags_get(tags, TAG_SMO) - 1));
+                }
             }
-            if(sd_script_isset(frame, "smf")) {
+            if(audible && frame_tags_isset(tags, TAG_SMF)) {
                 music_stop();
             }
 
             // Sound playback
-            if(sd_script_isset(frame, "s")) {
+            if(frame_tags_isset(tags, TAG_S)) {
                 float pitch = PITCH_DEFAULT;
-                float volume = VOLUME_DEFAULT * (settings_get()->sound.sound_vol/10.0f);
+                float volume = VOLUME_DEFAULT * (settings_snapshot()->sound.sound_vol/10.0f);
                 float panning = PANNING_DEFAULT;
-                if(sd_script_isset(frame, "sf")) {
-                    int p = clamp(sd_script_get(frame, "sf"), -16, 239);
+                if(frame_tags_isset(tags, TAG_SF)) {
+                    int p = clamp(frame_tags_get(tags, TAG_SF), -16, 239);
                     pitch = clampf((p/239.0f)*3.0f + 1.0f, PITCH_MIN, PITCH_MAX);
                 }
-                if(sd_script_isset(frame, "l")) {
-                    int v = clamp(sd_script_get(frame, "l"), 0, 100);
-                    volume = (v / 100.0f) * (settings_get()->sound.sound_vol/10.0f);
+                if(frame_tags_isset(tags, TAG_L)) {
+                    int v = clamp(frame_tags_get(tags, TAG_L), 0, 100);
+                    volume = (v / 100.0f) * (settings_snapshot()->sound.sound_vol/10.0f);
                 }
-                if(sd_script_isset(frame, "sb")) {
-                    panning = clamp(sd_script_get(frame, "sb"), -100, 100) / 100.0f;
+                if(frame_tags_isset(tags, TAG_SB)) {
+                    panning = clamp(frame_tags_get(tags, TAG_SB), -100, 100) / 100.0f;
                 }
-                int sound_id = obj->sound_translation_table[sd_script_get(frame, "s")] - 1;
-                sound_play(sound_id, volume, panning, pitch);
+                int sound_id = obj->sound_translation_table[frame_tags_get(tags, TAG_S)] - 1;
+                game_state_play_sound(obj->gs, sound_id, volume, panning, pitch);
             }
 
             // Blend mode stuff
-            if(sd_script_isset(frame, "b1")) { rstate->method_flags &= 0x2000; }
-            if(sd_script_isset(frame, "b2")) { rstate->method_flags &= 0x4000; }
-            if(sd_script_isset(frame, "bb")) {
+            if(frame_tags_isset(tags, TAG_B1)) { rstate->method_flags &= 0x2000; }
+            if(frame_tags_isset(tags, TAG_B2)) { rstate->method_flags &= 0x4000; }
+            if(frame_tags_isset(tags, TAG_BB)) {
                 rstate->method_flags &= 0x0010;
-                rstate->blend_finish = sd_script_get(frame, "bb");
-                rstate->screen_shake_vertical = sd_script_get(frame, "bb");
+                rstate->blend_finish = frame_tags_get(tags, TAG_BB);
+                rstate->screen_shake_vertical = frame_tags_get(tags, TAG_BB);
             }
-            if(sd_script_isset(frame, "be")) { rstate->method_flags &= 0x0800; }
-            if(sd_script_isset(frame, "bf")) {
+            if(frame_tags_isset(tags, TAG_BE)) { rstate->method_flags &= 0x0800; }
+            if(frame_tags_isset(tags, TAG_BF)) {
                 rstate->method_flags &= 0x0001;
-                rstate->blend_finish = sd_script_get(frame, "bf");
+                rstate->blend_finish = frame_tags_get(tags, TAG_BF);
             }
-            if(sd_script_isset(frame, "bh")) { rstate->method_flags &= 0x0040; }
-            if(sd_script_isset(frame, "bl")) {
+            if(frame_tags_isset(tags, TAG_BH)) { rstate->method_flags &= 0x0040; }
+            if(frame_tags_isset(tags, TAG_BL)) {
                 rstate->method_flags &= 0x0008;
-                rstate->blend_finish = sd_script_get(frame, "bl");
-                rstate->screen_shake_horizontal = sd_script_get(frame, "bl");
+                rstate->blend_finish = frame_tags_get(tags, TAG_BL);
+                rstate->screen_shake_horizontal = frame_tags_get(tags, TAG_BL);
             }
-            if(sd_script_isset(frame, "bm")) {
+            if(frame_tags_isset(tags, TAG_BM)) {
                 rstate->method_flags &= 0x0100;
-                rstate->blend_finish = sd_script_get(frame, "bm");
+                rstate->blend_finish = frame_tags_get(tags, TAG_BM);
             }
-            if(sd_script_isset(frame, "bj")) {
+            if(frame_tags_isset(tags, TAG_BJ)) {
                 rstate->method_flags &= 0x0400;
-                rstate->blend_finish = sd_script_get(frame, "bj");
+                rstate->blend_finish = frame_tags_get(tags, TAG_BJ);
             }
-            if(sd_script_isset(frame, "bs")) {
-                rstate->blend_start = sd_script_get(frame, "bs");
+            if(frame_tags_isset(tags, TAG_BS)) {
+                rstate->blend_start = frame_tags_get(tags, TAG_BS);
             }
-            if(sd_script_isset(frame, "bu")) { rstate->method_flags &= 0x8000; }
-            if(sd_script_isset(frame, "bw")) { rstate->method_flags &= 0x0080; }
-            if(sd_script_isset(frame, "bx")) { rstate->method_flags &= 0x0002; }
+            if(frame_tags_isset(tags, TAG_BU)) { rstate->method_flags &= 0x8000; }
+            if(frame_tags_isset(tags, TAG_BW)) { rstate->method_flags &= 0x0080; }
+            if(frame_tags_isset(tags, TAG_BX)) { rstate->method_flags &= 0x0002; }
 
             // Palette tricks
-            if(sd_script_isset(frame, "bpd")) { rstate->pal_ref_index = sd_script_get(frame, "bpd"); }
-            if(sd_script_isset(frame, "bpn")) { rstate->pal_entry_count = sd_script_get(frame, "bpn"); }
-            if(sd_script_isset(frame, "bps")) { rstate->pal_start_index = sd_script_get(frame, "bps"); }
-            if(sd_script_isset(frame, "bpf")) {
+            if(frame_tags_isset(tags, TAG_BPD)) { rstate->pal_ref_index = frame_tags_get(tags, TAG_BPD); }
+            if(frame_tags_isset(tags, TAG_BPN)) { rstate->pal_entry_count = frame_tags_get(tags, TAG_BPN); }
+            if(frame_tags_isset(tags, TAG_BPS)) { rstate->pal_start_index = frame_tags_get(tags, TAG_BPS); }
+            if(frame_tags_isset(tags, TAG_BPF)) {
                 // Exact values come from master.dat
                 if(game_state_get_player(obj->gs, 0)->har == obj) {
                     rstate->pal_start_index =  1;
@@ -350,51 +434,51 @@ void player_run(object *obj) {
                     rstate->pal_entry_count = 48;
                 }
             }
-            if(sd_script_isset(frame, "bpp")) {
-                rstate->pal_end = sd_script_get(frame, "bpp") * 4;
-                rstate->pal_begin = sd_script_get(frame, "bpp") * 4;
+            if(frame_tags_isset(tags, TAG_BPP)) {
+                rstate->pal_end = frame_tags_get(tags, TAG_BPP) * 4;
+                rstate->pal_begin = frame_tags_get(tags, TAG_BPP) * 4;
             }
-            if(sd_script_isset(frame, "bpb")) { rstate->pal_begin = sd_script_get(frame, "bpb") * 4; }
-            if(sd_script_isset(frame, "bz"))  { rstate->pal_tint = 1; }
+            if(frame_tags_isset(tags, TAG_BPB)) { rstate->pal_begin = frame_tags_get(tags, TAG_BPB) * 4; }
+            if(frame_tags_isset(tags, TAG_BZ))  { rstate->pal_tint = 1; }
 
             // The following is a hack. We don't REALLY know what these tags do.
             // However, they are only used in CREDITS.BK, so we can just interpret
             // then as we see fit, as long as stuff works.
-            if(sd_script_isset(frame, "bc") && frame->tick_len >= 50) {
+            if(frame_tags_isset(tags, TAG_BC) && frame->tick_len >= 50) {
                 rstate->blend_start = 0;
-            } else if(sd_script_isset(frame, "bd") && frame->tick_len >= 30) {
+            } else if(frame_tags_isset(tags, TAG_BD) && frame->tick_len >= 30) {
                 rstate->blend_finish = 0;
             }
 
             // Handle movement
-            if(sd_script_isset(frame, "ox")) {
-                DEBUG("changing X from %f to %f", obj->pos.x, obj->pos.x+sd_script_get(frame, "ox"));
-                /*obj->pos.x += sd_script_get(frame, "ox");*/
+            if(frame_tags_isset(tags, TAG_OX)) {
+                DEBUG("changing X from %f to %f", obj->pos.x, obj->pos.x+frame_tags_get(tags, TAG_OX));
+                /*obj->pos.x += frame_tags_get(tags, TAG_OX);*/
             }
 
-            if(sd_script_isset(frame, "oy")) {
-                DEBUG("changing Y from %f to %f", obj->pos.y, obj->pos.y+sd_script_get(frame, "oy"));
-                /*obj->pos.y += sd_script_get(frame, "oy");*/
+            if(frame_tags_isset(tags, TAG_OY)) {
+                DEBUG("changing Y from %f to %f", obj->pos.y, obj->pos.y+frame_tags_get(tags, TAG_OY));
+                /*obj->pos.y += frame_tags_get(tags, TAG_OY);*/
             }
 
-            if (sd_script_isset(frame, "bm")) {
+            if (frame_tags_isset(tags, TAG_BM)) {
                 // hack because we don't have 'walk to other HAR' implemented
                 obj->pos.x = state->enemy->pos.x;
                 obj->pos.y = state->enemy->pos.y;
                 player_next_frame(state->enemy);
             }
 
-            if (sd_script_isset(frame, "v")) {
+            if (frame_tags_isset(tags, TAG_V)) {
                 int x = 0, y = 0;
-                if(sd_script_isset(frame, "y-")) {
-                    y = sd_script_get(frame, "y-") * -1;
-                } else if(sd_script_isset(frame, "y+")) {
-                    y = sd_script_get(frame, "y+");
+                if(frame_tags_isset(tags, TAG_Y_MINUS)) {
+                    y = frame_tags_get(tags, TAG_Y_MINUS) * -1;
+                } else if(frame_tags_isset(tags, TAG_Y_PLUS)) {
+                    y = frame_tags_get(tags, TAG_Y_PLUS);
                 }
-                if(sd_script_isset(frame, "x-")) {
-                    x = sd_script_get(frame, "x-") * -1 * object_get_direction(obj);
-                } else if(sd_script_isset(frame, "x+")) {
-                    x = sd_script_get(frame, "x+") * object_get_direction(obj);
+                if(frame_tags_isset(tags, TAG_X_MINUS)) {
+                    x = frame_tags_get(tags, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(frame_tags_isset(tags, TAG_X_PLUS)) {
+                    x = frame_tags_get(tags, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
                 if (x || y) {
@@ -404,7 +488,7 @@ void player_run(object *obj) {
                 }
             }
 
-            if (sd_script_isset(frame, "bu") && obj->vel.y < 0.0f) {
+            if (frame_tags_isset(tags, TAG_BU) && obj->vel.y < 0.0f) {
                 float x_dist = dist(obj->pos.x, 160);
                 // assume that bu is used in conjunction with 'vy-X' and that we want to land in the center of the arena
                 obj->slide_state.vel.x = x_dist / (obj->vel.y*-2);
@@ -412,21 +496,21 @@ void player_run(object *obj) {
             }
 
             // handle scaling on the Y axis
-            if(sd_script_isset(frame, "y")) {
-                obj->y_percent = sd_script_get(frame, "y") / 100.0f;
+            if(frame_tags_isset(tags, TAG_Y)) {
+                obj->y_percent = frame_tags_get(tags, TAG_Y) / 100.0f;
             }
-            if (sd_script_isset(frame, "e")) {
+            if (frame_tags_isset(tags, TAG_E)) {
                 // x,y relative to *enemy's* position
                 int x = 0, y = 0;
-                if(sd_script_isset(frame, "y-")) {
-                    y = sd_script_get(frame, "y-") * -1;
-                } else if(sd_script_isset(frame, "y+")) {
-                    y = sd_script_get(frame, "y+");
+                if(frame_tags_isset(tags, TAG_Y_MINUS)) {
+                    y = frame_tags_get(tags, TAG_Y_MINUS) * -1;
+                } else if(frame_tags_isset(tags, TAG_Y_PLUS)) {
+                    y = frame_tags_get(tags, TAG_Y_PLUS);
                 }
-                if(sd_script_isset(frame, "x-")) {
-                    x = sd_script_get(frame, "x-") * -1 * object_get_direction(obj);
-                } else if(sd_script_isset(frame, "x+")) {
-                    x = sd_script_get(frame, "x+") * object_get_direction(obj);
+                if(frame_tags_isset(tags, TAG_X_MINUS)) {
+                    x = frame_tags_get(tags, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(frame_tags_isset(tags, TAG_X_PLUS)) {
+                    x = frame_tags_get(tags, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
                 if (x || y) {
@@ -442,20 +526,20 @@ void player_run(object *obj) {
                             x, y);*/
                 }
             }
-            if (sd_script_isset(frame, "v") == 0 &&
-                sd_script_isset(frame, "e") == 0 &&
-                (sd_script_isset(frame, "x+") || sd_script_isset(frame, "y+") || sd_script_isset(frame, "x-") || sd_script_isset(frame, "y-"))) {
+            if (frame_tags_isset(tags, TAG_V) == 0 &&
+                frame_tags_isset(tags, TAG_E) == 0 &&
+                (frame_tags_isset(tags, TAG_X_PLUS) || frame_tags_isset(tags, TAG_Y_PLUS) || frame_tags_isset(tags, TAG_X_MINUS) || frame_tags_isset(tags, TAG_Y_MINUS))) {
                 // check for relative X interleaving
                 int x = 0, y = 0;
-                if(sd_script_isset(frame, "y-")) {
-                    y = sd_script_get(frame, "y-") * -1;
-                } else if(sd_script_isset(frame, "y+")) {
-                    y = sd_script_get(frame, "y+");
+                if(frame_tags_isset(tags, TAG_Y_MINUS)) {
+                    y = frame_tags_get(tags, TAG_Y_MINUS) * -1;
+                } else if(frame_tags_isset(tags, TAG_Y_PLUS)) {
+                    y = frame_tags_get(tags, TAG_Y_PLUS);
                 }
-                if(sd_script_isset(frame, "x-")) {
-                    x = sd_script_get(frame, "x-") * -1 * object_get_direction(obj);
-                } else if(sd_script_isset(frame, "x+")) {
-                    x = sd_script_get(frame, "x+") * object_get_direction(obj);
+                if(frame_tags_isset(tags, TAG_X_MINUS)) {
+                    x = frame_tags_get(tags, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(frame_tags_isset(tags, TAG_X_PLUS)) {
+                    x = frame_tags_get(tags, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
                 obj->slide_state.timer = frame->tick_len;
@@ -468,20 +552,20 @@ void player_run(object *obj) {
                     /*param->duration);*/
             }
 
-            if(sd_script_isset(frame, "x=") || sd_script_isset(frame, "y=")) {
+            if(frame_tags_isset(tags, TAG_X_EQ) || frame_tags_isset(tags, TAG_Y_EQ)) {
                 obj->slide_state.vel = vec2f_create(0,0);
             }
-            if(sd_script_isset(frame, "x=")) {
-                obj->pos.x = obj->start.x + (sd_script_get(frame, "x=") * object_get_direction(obj));
+            if(frame_tags_isset(tags, TAG_X_EQ)) {
+                obj->pos.x = obj->start.x + (frame_tags_get(tags, TAG_X_EQ) * object_get_direction(obj));
 
                 // Find frame ID by tick
-                int frame_id = sd_script_next_frame_with_tag(&state->parser, "x=", state->current_tick);
+                int frame_id = tag_table_next_frame_with_tag(state->tags, TAG_X_EQ, frame - state->parser->frames);
                 
                 // Handle it!
                 if(frame_id >= 0) {
-                    int mr = sd_script_get_tick_pos_at_frame(&state->parser, frame_id);
+                    int mr = player_frame_start(state, frame_id);
                     int r = mr - state->current_tick;
-                    int next_x = sd_script_get(sd_script_get_frame(&state->parser, frame_id), "x=");
+                    int next_x = frame_tags_get(tag_table_get(state->tags, frame_id), TAG_X_EQ);
                     int slide = obj->start.x + (next_x * object_get_direction(obj));
                     if(slide != obj->pos.x) {
                         obj->slide_state.vel.x = dist(obj->pos.x, slide) / (float)(frame->tick_len + r);
@@ -494,17 +578,17 @@ void player_run(object *obj) {
 
                 }
             }
-            if(sd_script_isset(frame, "y=")) {
-                obj->pos.y = obj->start.y + sd_script_get(frame, "y=");
+            if(frame_tags_isset(tags, TAG_Y_EQ)) {
+                obj->pos.y = obj->start.y + frame_tags_get(tags, TAG_Y_EQ);
 
                 // Find frame ID by tick
-                int frame_id = sd_script_next_frame_with_tag(&state->parser, "y=", state->current_tick);
+                int frame_id = tag_table_next_frame_with_tag(state->tags, TAG_Y_EQ, frame - state->parser->frames);
 
                 // handle it!
                 if(frame_id >= 0) {
-                    int mr = sd_script_get_tick_pos_at_frame(&state->parser, frame_id);
+                    int mr = player_frame_start(state, frame_id);
                     int r = mr - state->current_tick;
-                    int next_y = sd_script_get(sd_script_get_frame(&state->parser, frame_id), "y=");
+                    int next_y = frame_tags_get(tag_table_get(state->tags, frame_id), TAG_Y_EQ);
                     int slide = next_y + obj->start.y;
                     if(slide != obj->pos.y) {
                         obj->slide_state.vel.y = dist(obj->pos.y, slide) / (float)(frame->tick_len + r);
@@ -517,27 +601,27 @@ void player_run(object *obj) {
 
                 }
             }
-            if(sd_script_isset(frame, "as")) {
+            if(frame_tags_isset(tags, TAG_AS)) {
                 // make the object move around the screen in a circular motion until end of frame
                 obj->orbit = 1;
             } else {
                 obj->orbit = 0;
             }
-            if(sd_script_isset(frame, "q")) {
+            if(frame_tags_isset(tags, TAG_Q)) {
                 // Enable hit on the current and the next n-1 frames.
-                obj->hit_frames = sd_script_get(frame, "q");
+                obj->hit_frames = frame_tags_get(tags, TAG_Q);
             }
             if(obj->hit_frames > 0) {
                 obj->can_hit = 1;
                 obj->hit_frames--;
             }
 
-            if(sd_script_isset(frame, "at")) {
+            if(frame_tags_isset(tags, TAG_AT)) {
                 // set the object's X position to be behind the opponent
                 obj->pos.x = obj->animation_state.enemy->pos.x + (15 * object_get_direction(obj));
             }
 
-            if(sd_script_isset(frame, "ar")) {
+            if(frame_tags_isset(tags, TAG_AR)) {
                 DEBUG("flipping direction %d -> %d", object_get_direction(obj), object_get_direction(obj) *-1);
                 // reverse direction
                 object_set_direction(obj, object_get_direction(obj) * -1);
@@ -549,11 +633,11 @@ void player_run(object *obj) {
                 object_select_sprite(obj, frame->sprite);
                 if(obj->cur_sprite != NULL) {
                     rstate->duration = frame->tick_len;
-                    rstate->blendmode = sd_script_isset(frame, "br") ? BLEND_ADDITIVE : BLEND_ALPHA;
-                    if(sd_script_isset(frame, "r")) {
+                    rstate->blendmode = frame_tags_isset(tags, TAG_BR) ? BLEND_ADDITIVE : BLEND_ALPHA;
+                    if(frame_tags_isset(tags, TAG_R)) {
                         rstate->flipmode ^= FLIP_HORIZONTAL;
                     }
-                    if(sd_script_isset(frame, "f")) {
+                    if(frame_tags_isset(tags, TAG_F)) {
                         rstate->flipmode ^= FLIP_VERTICAL;
                     }
                 }
@@ -587,7 +671,7 @@ void player_jump_to_tick(object *obj, int tick) {
 
 unsigned int player_get_len_ticks(const object *obj) {
     const player_animation_state *state = &obj->animation_state;
-    return sd_script_get_total_ticks(&state->parser);
+    return frame_timeline_total_ticks(state->timeline);
 }
 
 void player_set_repeat(object *obj, int repeat) {
@@ -604,14 +688,14 @@ void player_set_end_frame(object *obj, int end_frame) {
 
 void player_next_frame(object *obj) {
     player_animation_state *state = &obj->animation_state;
-    int current_index = sd_script_get_frame_index_at(&state->parser, state->current_tick);
-    state->current_tick = sd_script_get_tick_pos_at_frame(&state->parser, current_index+1);
+    int current_index = frame_timeline_frame_at(state->timeline, state->current_tick);
+    state->current_tick = player_frame_start(state, current_index+1);
     state->previous_tick = state->current_tick-1;
 }
 
 void player_goto_frame(object *obj, int frame_id) {
     player_animation_state *state = &obj->animation_state;
-    state->current_tick = sd_script_get_tick_pos_at_frame(&state->parser, frame_id);
+    state->current_tick = player_frame_start(state, frame_id);
     state->previous_tick = state->current_tick-1;
 }
 
@@ -621,7 +705,7 @@ int player_get_current_tick(const object *obj) {
 
 int player_get_frame(const object *obj) {
     const player_animation_state *state = &obj->animation_state;
-    return sd_script_get_frame_index_at(&state->parser, state->current_tick);
+    return frame_timeline_frame_at(state->timeline, state->current_tick);
 }
 
 char player_get_frame_letter(const object *obj) {
@@ -630,5 +714,5 @@ char player_get_frame_letter(const object *obj) {
 
 int player_is_last_frame(const object *obj) {
     const player_animation_state *state = &obj->animation_state;
-    return sd_script_is_last_frame_at(&state->parser, state->current_tick);
+    return frame_timeline_frame_at(state->timeline, state->current_tick) == state->timeline->frame_count - 1;
 }
@@ -2,13 +2,27 @@
 #include "game/protos/scene.h"
 #include "video/video.h"
 #include "resources/ids.h"
-#include "resources/bk_loader.h"
-#include "resources/af_loader.h"
+#include "resources/rescache.h"
 #include "utils/log.h"
 #include "utils/vec.h"
+#include "utils/memarena.h"
 #include "game/game_player.h"
 #include "game/game_state_type.h"
 
+// HAR moves seen in almost every fight, most common first. These get their
+// sprites decoded and their textures built before the rest.
+static const int scene_common_moves[] = {
+    ANIM_IDLE,
+    ANIM_WALKING,
+    ANIM_STANDING_BLOCK,
+    ANIM_DAMAGE,
+    ANIM_CROUCHING,
+    ANIM_CROUCHING_BLOCK,
+    ANIM_JUMPING,
+    ANIM_STANDUP,
+};
+#define SCENE_COMMON_MOVES (int)(sizeof(scene_common_moves) / sizeof(scene_common_moves[0]))
+
 // Some internal functions
 void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata);
 void cb_scene_destroy_object(object *parent, int id, void *userdata);
@@ -21,7 +35,8 @@ int scene_create(scene *scene, game_state *gs, int scene_id) {
 
     // Load BK
     int resource_id = scene_to_resource(scene_id);
-    if(load_bk_file(&scene->bk_data, resource_id)) {
+    scene->bk_data = rescache_get_bk(resource_id);
+    if(scene->bk_data == NULL) {
         PERROR("Unable to load scene %s (%s)!",
             scene_get_name(scene_id),
             get_resource_name(resource_id));
@@ -31,6 +46,8 @@ int scene_create(scene *scene, game_state *gs, int scene_id) {
     scene->gs = gs;
     scene->af_data[0] = NULL;
     scene->af_data[1] = NULL;
+    scene->predecoded = 0;
+    scene->prewarm_pos = 0;
 
     // Init functions
     scene->userdata = NULL;
@@ -43,9 +60,10 @@ int scene_create(scene *scene, game_state *gs, int scene_id) {
     scene->input_poll = NULL;
     scene->startup = NULL;
     scene->prio_override = NULL;
+    scene->is_idle = NULL;
 
     // Set base palette
-    video_set_base_palette(bk_get_palette(&scene->bk_data, 0));
+    video_set_base_palette(bk_get_palette(scene->bk_data, 0));
 
     // All done.
     DEBUG("Loaded scene %s (%s).",
@@ -54,42 +72,20 @@ int scene_create(scene *scene, game_state *gs, int scene_id) {
     return 0;
 }
 
-void har_fix_sprite_coords(animation *ani, int fix_x, int fix_y) {
-    iterator it;
-    sprite *s;
-    // Fix sprite positions
-    vector_iter_begin(&ani->sprites, &it);
-    while((s = iter_next(&it)) != NULL) {
-        s->pos.x += fix_x;
-        s->pos.y += fix_y;
-    }
-    // Fix collisions coordinates
-    collision_coord *c;
-    vector_iter_begin(&ani->collision_coords, &it);
-    while((c = iter_next(&it)) != NULL) {
-        c->pos.x += fix_x;
-        c->pos.y += fix_y;
-    }
-}
-
 int scene_load_har(scene *scene, int player_id, int har_id) {
-    if(scene->af_data[player_id]) {
-        af_free(scene->af_data[player_id]);
-        free(scene->af_data[player_id]);
-    }
-    scene->af_data[player_id] = malloc(sizeof(af));
+    rescache_release(scene->af_data[player_id]);
 
     int resource_id = har_to_resource(har_id);
-    if(load_af_file(scene->af_data[player_id], resource_id)) {
+    scene->af_data[player_id] = rescache_get_af(resource_id);
+    scene->predecoded = 0;
+    scene->prewarm_pos = 0;
+    if(scene->af_data[player_id] == NULL) {
         PERROR("Unable to load HAR %s (%s)!",
             har_get_name(har_id),
             get_resource_name(resource_id));
         return 1;
     }
 
-    // Fix some coordinates on jump sprites
-    har_fix_sprite_coords(&af_get_move(scene->af_data[player_id], ANIM_JUMPING)->ani, 0, -50);
-
     DEBUG("Loaded HAR %s (%s).",
         har_get_name(har_id),
         get_resource_name(resource_id));
@@ -100,12 +96,13 @@ void scene_init(scene *scene) {
     int m_load;
     int m_repeat;
 
-    // Bootstrap animations
-    iterator it;
-    hashmap_iter_begin(&scene->bk_data.infos, &it);
-    hashmap_pair *pair = NULL;
-    while((pair = iter_next(&it)) != NULL) {
-        bk_info *info = (bk_info*)pair->val;
+    // Bootstrap animations. They are created by animation id, since the
+    // order sets their draw order and the random keys they get.
+    for(int i = 0; i < BK_INFO_COUNT; i++) {
+        bk_info *info = bk_get_info(scene->bk_data, i);
+        if(info == NULL) {
+            continue;
+        }
 
         // Ask scene if this animation should be played on start
         scene_startup(scene, info->ani.id, &m_load, &m_repeat);
@@ -114,7 +111,7 @@ void scene_init(scene *scene) {
         if(m_load) {
             object *obj = malloc(sizeof(object));
             object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
-            object_set_stl(obj, scene->bk_data.sound_translation_table);
+            object_set_stl(obj, scene->bk_data->sound_translation_table);
             object_set_animation(obj, &info->ani);
             object_set_repeat(obj, m_repeat);
             object_set_spawn_cb(obj, cb_scene_spawn_object, (void*)scene);
@@ -127,7 +124,8 @@ void scene_init(scene *scene) {
     }
 
     // init tick timer
-    ticktimer_init(&scene->tick_timer);
+    ticktimer_init_with_allocator(&scene->tick_timer, memarena_scene_allocator());
+    ticktimer_set_context(&scene->tick_timer, scene->gs);
 }
 
 /*
@@ -186,7 +184,7 @@ void scene_render_overlay(scene *scene) {
 }
 
 void scene_render(scene *scene) {
-    video_render_background(&scene->bk_data.background);
+    video_render_background(&scene->bk_data->background);
 
     if(scene->render != NULL) {
         scene->render(scene);
@@ -200,12 +198,89 @@ int scene_anim_prio_override(scene *scene, int anim_id) {
     return -1;
 }
 
+// Scenes are idle when they only change in response to input. Scenes
+// that don't say otherwise are never idle.
+int scene_is_idle(scene *scene) {
+    if(scene->is_idle != NULL) {
+        return scene->is_idle(scene);
+    }
+    return 0;
+}
+
 void scene_static_tick(scene *scene, int paused) {
     if(scene->static_tick != NULL) {
         scene->static_tick(scene, paused);
     }
 }
 
+// Decodes a few of the scene's deferred sprites, so that they are ready
+// before the animations that use them start playing
+void scene_predecode(scene *scene, int budget) {
+    if(scene->predecoded || budget <= 0) {
+        return;
+    }
+
+    for(int i = 0; budget > 0 && i < SCENE_COMMON_MOVES * 2; i++) {
+        af *af_data = scene->af_data[i % 2];
+        af_move *move = (af_data != NULL) ? af_get_move(af_data, scene_common_moves[i / 2]) : NULL;
+        if(move != NULL) {
+            budget = animation_predecode(&move->ani, budget);
+        }
+    }
+
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&scene->bk_data->infos, &it);
+    while(budget > 0 && (pair = iter_next(&it)) != NULL) {
+        budget = animation_predecode(&((bk_info*)pair->val)->ani, budget);
+    }
+    for(int p = 0; p < 2; p++) {
+        if(scene->af_data[p] == NULL) {
+            continue;
+        }
+        for(int i = 0; budget > 0 && i < 70; i++) {
+            af_move *move = af_get_move(scene->af_data[p], i);
+            if(move != NULL) {
+                budget = animation_predecode(&move->ani, budget);
+            }
+        }
+    }
+
+    // Nothing was left to decode
+    if(budget > 0) {
+        scene->predecoded = 1;
+    }
+}
+
+// Hands the decoded sprites of one common HAR move to the renderer per call,
+// so that their textures are built before the fight needs them. Called on
+// rendered frames while the scene fades in; the renderer keeps to its own
+// time budget.
+void scene_prewarm(scene *scene) {
+    if(scene->prewarm_pos >= SCENE_COMMON_MOVES * 2) {
+        return;
+    }
+    int player_id = scene->prewarm_pos % 2;
+    int move_id = scene_common_moves[scene->prewarm_pos / 2];
+    scene->prewarm_pos++;
+    if(scene->af_data[player_id] == NULL) {
+        return;
+    }
+    af_move *move = af_get_move(scene->af_data[player_id], move_id);
+    if(move == NULL) {
+        return;
+    }
+    iterator it;
+    sprite *s;
+    vector_iter_begin(&move->ani.sprites, &it);
+    while((s = iter_next(&it)) != NULL) {
+        if(sprite_is_decoded(s)) {
+            // Player 2 HARs are drawn with the second set of HAR colors
+            video_prewarm_sprite(sprite_use_surface(s), player_id * 48);
+        }
+    }
+}
+
 void scene_dynamic_tick(scene *scene, int paused) {
     // Tick timers
     if(!paused) {
@@ -227,15 +302,10 @@ void scene_free(scene *scene) {
     if(scene->free != NULL) {
         scene->free(scene);
     }
-    bk_free(&scene->bk_data);
-    if (scene->af_data[0]) {
-        af_free(scene->af_data[0]);
-        free(scene->af_data[0]);
-    }
-    if (scene->af_data[1]) {
-        af_free(scene->af_data[1]);
-        free(scene->af_data[1]);
-    }
+    // The files themselves stay cached for the next scene
+    rescache_release(scene->bk_data);
+    rescache_release(scene->af_data[0]);
+    rescache_release(scene->af_data[1]);
     ticktimer_close(&scene->tick_timer);
 }
 
@@ -271,6 +341,10 @@ void scene_set_anim_prio_override_cb(scene *scene, scene_anim_prio_override_cb c
     scene->prio_override = cbfunc;
 }
 
+void scene_set_is_idle_cb(scene *scene, scene_is_idle_cb cbfunc) {
+    scene->is_idle = cbfunc;
+}
+
 void scene_set_input_poll_cb(scene *scene, scene_input_poll_cb cbfunc) {
     scene->input_poll = cbfunc;
 }
@@ -279,7 +353,7 @@ void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userd
     scene *s = (scene*)userdata;
 
     // Get next animation
-    bk_info *info = bk_get_info(&s->bk_data, id);
+    bk_info *info = bk_get_info(s->bk_data, id);
     if(info != NULL) {
         object *obj = malloc(sizeof(object));
         object_create(obj, parent->gs, vec2i_add(pos, info->ani.start_pos), vec2f_create(0,0));
@@ -17,6 +17,8 @@
 #include "game/objects/arena_constraints.h"
 #include "game/protos/object.h"
 #include "game/utils/score.h"
+#include "game/utils/rec_index.h"
+#include "game/utils/rec_writer.h"
 #include "game/game_player.h"
 #include "game/game_state.h"
 #include "game/utils/ticktimer.h"
@@ -33,9 +35,12 @@
 #include "game/gui/progressbar.h"
 #include "controller/controller.h"
 #include "controller/net_controller.h"
+#include "controller/spectator_controller.h"
 #include "resources/ids.h"
 #include "utils/log.h"
 #include "utils/random.h"
+#include "utils/trace.h"
+#include "tournament.h"
 
 #define TEXT_COLOR color_create(186,250,250,255)
 
@@ -63,9 +68,13 @@ typedef struct arena_local_t {
     object *player_rounds[2][4];
 
     int rein_enabled;
+    vector hazards; // bk_info pointers of the animations that may spawn as hazards
+    serial sync; // Reused for the states sent to network peers
 
     sd_rec_file *rec;
     int rec_last[2];
+    rec_index rec_idx; // Keyframes for seeking, only used when rec is set
+    rec_writer *rec_writer; // Streams the moves to disk, NULL to keep them in rec
 } arena_local;
 
 void arena_maybe_sync(scene *scene, int need_sync);
@@ -95,6 +104,7 @@ void arena_music_slide(component *c, void *userdata, int pos) {
 
 void arena_sound_slide(component *c, void *userdata, int pos) {
     sound_set_volume(pos/10.0f);
+    settings_apply();
 }
 
 void arena_speed_slide(component *c, void *userdata, int pos) {
@@ -103,30 +113,26 @@ void arena_speed_slide(component *c, void *userdata, int pos) {
 }
 
 void scene_fight_anim_done(void *userdata) {
-    object *parent = userdata;
-    scene *scene = game_state_get_scene(parent->gs);
+    game_state *gs = userdata;
+    scene *scene = game_state_get_scene(gs);
     arena_local *arena = scene_get_userdata(scene);
 
     // This will release HARs for action
     arena->state = ARENA_STATE_FIGHTING;
-
-    // Custom object finisher callback requires that we
-    // mark object as finished manually, if necessary.
-    //parent->animation_state.finished = 1;
 }
 
 void scene_fight_anim_start(void *userdata) {
     // Start FIGHT animation
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
-    animation *fight_ani = &bk_get_info(&scene->bk_data, 10)->ani;
+    animation *fight_ani = &bk_get_info(scene->bk_data, 10)->ani;
     object *fight = malloc(sizeof(object));
     object_create(fight, gs, fight_ani->start_pos, vec2f_create(0,0));
-    object_set_stl(fight, bk_get_stl(&scene->bk_data));
+    object_set_stl(fight, bk_get_stl(scene->bk_data));
     object_set_animation(fight, fight_ani);
     //object_set_finish_cb(fight, scene_fight_anim_done);
     game_state_add_object(gs, fight, RENDER_LAYER_TOP, 0, 0);
-    ticktimer_add(&scene->tick_timer, 24, scene_fight_anim_done, fight);
+    ticktimer_add(&scene->tick_timer, 24, scene_fight_anim_done, gs);
 }
 
 void scene_ready_anim_done(object *parent) {
@@ -148,10 +154,10 @@ void scene_youwin_anim_start(void *userdata) {
     // Start FIGHT animation
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
-    animation *youwin_ani = &bk_get_info(&scene->bk_data, 9)->ani;
+    animation *youwin_ani = &bk_get_info(scene->bk_data, 9)->ani;
     object *youwin = malloc(sizeof(object));
     object_create(youwin, gs, youwin_ani->start_pos, vec2f_create(0,0));
-    object_set_stl(youwin, bk_get_stl(&scene->bk_data));
+    object_set_stl(youwin, bk_get_stl(scene->bk_data));
     object_set_animation(youwin, youwin_ani);
     object_set_finish_cb(youwin, scene_youwin_anim_done);
     game_state_add_object(gs, youwin, RENDER_LAYER_MIDDLE, 0, 0);
@@ -170,10 +176,10 @@ void scene_youlose_anim_start(void *userdata) {
     // Start FIGHT animation
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
-    animation *youlose_ani = &bk_get_info(&scene->bk_data, 8)->ani;
+    animation *youlose_ani = &bk_get_info(scene->bk_data, 8)->ani;
     object *youlose = malloc(sizeof(object));
     object_create(youlose, gs, youlose_ani->start_pos, vec2f_create(0,0));
-    object_set_stl(youlose, bk_get_stl(&scene->bk_data));
+    object_set_stl(youlose, bk_get_stl(scene->bk_data));
     object_set_animation(youlose, youlose_ani);
     object_set_finish_cb(youlose, scene_youlose_anim_done);
     game_state_add_object(gs, youlose, RENDER_LAYER_MIDDLE, 0, 0);
@@ -236,12 +242,27 @@ void arena_screengrab_winner(scene* sc) {
     }
 }
 
+// Tournament matches quit after reporting who won
+static void arena_end_ai_match(scene *sc, int draw) {
+    arena_local *local = scene_get_userdata(sc);
+    int winner = -1;
+    for(int i = 0; !draw && i < 2; i++) {
+        if(game_player_get_score(game_state_get_player(sc->gs, i))->rounds >= ceil(local->rounds / 2.0f)) {
+            winner = i;
+        }
+    }
+    tournament_write_result(sc->gs->init_flags->match_result, winner, game_state_get_tick(sc->gs));
+    game_state_set_next(sc->gs, SCENE_NONE);
+}
+
 void arena_end(scene *sc) {
     game_state *gs = sc->gs;
     int next_id;
 
     // Switch scene
-    if (is_demoplay(sc)) {
+    if(gs->init_flags->ai_match) {
+        arena_end_ai_match(sc, 0);
+    } else if (is_demoplay(sc)) {
         do {
             next_id = rand_arena();
         } while(next_id == sc->id);
@@ -288,21 +309,21 @@ void arena_reset(scene *sc) {
         chr_score_clear_done(&player->score);
     }
 
-    sc->bk_data.sound_translation_table[3] = 23 + local->round; // NUMBER
+    sc->bk_data->sound_translation_table[3] = 23 + local->round; // NUMBER
     // ROUND animation
-    animation *round_ani = &bk_get_info(&sc->bk_data, 6)->ani;
+    animation *round_ani = &bk_get_info(sc->bk_data, 6)->ani;
     object *round = malloc(sizeof(object));
     object_create(round, sc->gs, round_ani->start_pos, vec2f_create(0,0));
-    object_set_stl(round, sc->bk_data.sound_translation_table);
+    object_set_stl(round, sc->bk_data->sound_translation_table);
     object_set_animation(round, round_ani);
     object_set_finish_cb(round, scene_ready_anim_done);
     game_state_add_object(sc->gs, round, RENDER_LAYER_TOP, 0, 0);
 
     // Round number
-    animation *number_ani = &bk_get_info(&sc->bk_data, 7)->ani;
+    animation *number_ani = &bk_get_info(sc->bk_data, 7)->ani;
     object *number = malloc(sizeof(object));
     object_create(number, sc->gs, number_ani->start_pos, vec2f_create(0,0));
-    object_set_stl(number, sc->bk_data.sound_translation_table);
+    object_set_stl(number, sc->bk_data->sound_translation_table);
     object_set_animation(number, number_ani);
     object_select_sprite(number, local->round);
     object_set_sprite_override(number, 1);
@@ -319,16 +340,18 @@ void arena_maybe_sync(scene *scene, int need_sync) {
         && (player1->ctrl->type == CTRL_TYPE_NETWORK || player2->ctrl->type == CTRL_TYPE_NETWORK)) {
 
         // some of the moves did something interesting and we should synchronize the peer
-        serial ser;
-        serial_create(&ser);
-        game_state_serialize(scene->gs, &ser);
+        // Serialized once for all peers, into a buffer that stays around
+        trace_begin("net", "sync");
+        arena_local *local = scene_get_userdata(scene);
+        serial_clear(&local->sync);
+        game_state_serialize(scene->gs, &local->sync);
         if (player1->ctrl->type == CTRL_TYPE_NETWORK) {
-            controller_update(player1->ctrl, &ser);
+            controller_update(player1->ctrl, &local->sync);
         }
         if (player2->ctrl->type == CTRL_TYPE_NETWORK) {
-            controller_update(player2->ctrl, &ser);
+            controller_update(player2->ctrl, &local->sync);
         }
-        serial_free(&ser);
+        trace_end("net", "sync");
     }
 }
 
@@ -419,19 +442,19 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
         h->state = STATE_WALLDAMAGE;;
 
         // Spawn wall animation
-        bk_info *info = bk_get_info(&scene->bk_data, 20+wall);
+        bk_info *info = bk_get_info(scene->bk_data, 20+wall);
         object *obj = malloc(sizeof(object));
         object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
-        object_set_stl(obj, scene->bk_data.sound_translation_table);
+        object_set_stl(obj, scene->bk_data->sound_translation_table);
         object_set_animation(obj, &info->ani);
         if(game_state_add_object(scene->gs, obj, RENDER_LAYER_BOTTOM, 1, 0) == 0) {
 
             // spawn the electricity on top of the HAR
             // TODO this doesn't track the har's position well...
-            info = bk_get_info(&scene->bk_data, 22);
+            info = bk_get_info(scene->bk_data, 22);
             object *obj2 = malloc(sizeof(object));
             object_create(obj2, scene->gs, vec2i_create(o_har->pos.x, o_har->pos.y), vec2f_create(0, 0));
-            object_set_stl(obj2, scene->bk_data.sound_translation_table);
+            object_set_stl(obj2, scene->bk_data->sound_translation_table);
             object_set_animation(obj2, &info->ani);
             object_attach_to(obj2, o_har);
             object_dynamic_tick(obj2);
@@ -457,10 +480,10 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
         h->state = STATE_WALLDAMAGE;
 
         // desert always shows the 'hit' animation when you touch the wall
-        bk_info *info = bk_get_info(&scene->bk_data, 20+wall);
+        bk_info *info = bk_get_info(scene->bk_data, 20+wall);
         object *obj = malloc(sizeof(object));
         object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
-        object_set_stl(obj, scene->bk_data.sound_translation_table);
+        object_set_stl(obj, scene->bk_data->sound_translation_table);
         object_set_animation(obj, &info->ani);
         object_set_custom_string(obj, "brwA1-brwB1-brwD1-brwE0-brwD4-brwC2-brwB2-brwA2");
         if(game_state_add_object(scene->gs, obj, RENDER_LAYER_BOTTOM, 1, 0) != 0) {
@@ -483,24 +506,24 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
         DEBUG("hit dusty wall %d", wall);
         h->state = STATE_WALLDAMAGE;
 
-        int amount = rand_int(2) + 3;
+        int amount = game_state_rand_int(scene->gs, 2) + 3;
         for(int i = 0; i < amount; i++) {
-            int variance = rand_int(20) - 10;
-            int anim_no = rand_int(2) + 24;
+            int variance = game_state_rand_int(scene->gs, 20) - 10;
+            int anim_no = game_state_rand_int(scene->gs, 2) + 24;
             DEBUG("XXX anim = %d, variance = %d", anim_no, variance);
             int pos_y = o_har->pos.y - object_get_size(o_har).y + variance + i*25;
             vec2i coord = vec2i_create(o_har->pos.x, pos_y);
-            object *dust = malloc(sizeof(object));
+            object *dust = game_state_alloc_object(scene->gs);
             object_create(dust, scene->gs, coord, vec2f_create(0,0));
-            object_set_stl(dust, scene->bk_data.sound_translation_table);
-            object_set_animation(dust, &bk_get_info(&scene->bk_data, anim_no)->ani);
+            object_set_stl(dust, scene->bk_data->sound_translation_table);
+            object_set_animation(dust, &bk_get_info(scene->bk_data, anim_no)->ani);
             game_state_add_object(scene->gs, dust, RENDER_LAYER_MIDDLE, 0, 0);
         }
 
         // Wallhit sound
         float d = ((float)o_har->pos.x) / 640.0f;
         float pos_pan = d - 0.25f;
-        sound_play(68, 1.0f, pos_pan, 2.0f);
+        game_state_play_sound(scene->gs, 68, 1.0f, pos_pan, 2.0f);
     }
 
     /**
@@ -718,10 +741,17 @@ void arena_free(scene *scene) {
     arena_local *local = scene_get_userdata(scene);
 
     game_state_set_paused(scene->gs, 0);
+    game_state_history_stop(scene->gs);
 
     if (local->rec) {
         write_rec_move(scene, game_state_get_player(scene->gs, 0), ACT_STOP);
-        sd_rec_save(local->rec, scene->gs->init_flags->rec_file);
+        if(local->rec_writer) {
+            rec_writer_close(local->rec_writer, local->rec);
+        } else {
+            sd_rec_save(local->rec, scene->gs->init_flags->rec_file);
+        }
+        rec_index_save(&local->rec_idx, scene->gs->init_flags->rec_file);
+        rec_index_free(&local->rec_idx);
         sd_rec_free(local->rec);
         free(local->rec);
     }
@@ -742,7 +772,8 @@ void arena_free(scene *scene) {
     guiframe_free(local->game_menu);
     surface_free(&local->sur);
 
-    music_stop();
+    // Fades out with the scene, or into the next scene's track
+    music_fade_out();
 
     // Free bar components
     for(int i = 0; i < 2; i++) {
@@ -750,6 +781,8 @@ void arena_free(scene *scene) {
         component_free(local->endurance_bars[i]);
     }
 
+    vector_free(&local->hazards);
+    serial_free(&local->sync);
     settings_save();
 
     free(local);
@@ -800,6 +833,11 @@ void write_rec_move(scene *scene, game_player *player, int action) {
     }
     local->rec_last[move.player_id] = move.action;
 
+    if (local->rec_writer) {
+        rec_writer_add(local->rec_writer, &move);
+        return;
+    }
+
     int ret;
 
     if ((ret = sd_rec_insert_action(local->rec, local->rec->move_count, &move)) != SD_SUCCESS) {
@@ -824,16 +862,30 @@ int arena_handle_events(scene *scene, game_player *player, ctrl_event *i) {
                 // menu events
                 guiframe_action(local->game_menu, i->event_data.action);
             } else if(i->type == EVENT_TYPE_ACTION) {
+                int player_id = (player == game_state_get_player(scene->gs, 0)) ? 0 : 1;
                 if (player->ctrl->type == CTRL_TYPE_NETWORK) {
+                    int rolled_back = 0;
                     do {
-                        object_act(game_player_get_har(player), i->event_data.action);
+                        // Late actions are applied by resimulating from the tick they happened on
+                        if(game_state_rollback_action(scene->gs, player_id, i->event_data.action, i->tick)) {
+                            // Too late to roll back, so the peer applied this on another tick than we do
+                            object_act(game_player_get_har(player), i->event_data.action);
+                            game_state_record_action(scene->gs, player_id, i->event_data.action);
+                            need_sync = 1;
+                        } else {
+                            rolled_back = 1;
+                        }
                         write_rec_move(scene, player, i->event_data.action);
                     } while ((i = i->next) && i->type == EVENT_TYPE_ACTION);
-                    // always trigger a synchronization, since if the client's move did not actually happen, we want to rewind them ASAP
-                    need_sync = 1;
+                    if(rolled_back) {
+                        // Restored HARs come without hooks
+                        maybe_install_har_hooks(scene);
+                    }
                     // XXX do we need to continue here, since we screwed with 'i'?
                 } else {
-                    need_sync += object_act(game_player_get_har(player), i->event_data.action);
+                    // The peer gets this as input and rolls back; state hashes catch any divergence
+                    object_act(game_player_get_har(player), i->event_data.action);
+                    game_state_record_action(scene->gs, player_id, i->event_data.action);
                     write_rec_move(scene, player, i->event_data.action);
                 }
             } else if (i->type == EVENT_TYPE_SYNC) {
@@ -853,10 +905,22 @@ int arena_handle_events(scene *scene, game_player *player, ctrl_event *i) {
     return need_sync;
 }
 
+// Picks out the animations that may spawn as hazards, by animation id. The
+// random draws follow this order, so it must not depend on the hashmap.
+static void arena_find_hazards(scene *scene, vector *hazards) {
+    vector_create(hazards, sizeof(bk_info*));
+    for(int i = 0; i < BK_INFO_COUNT; i++) {
+        bk_info *info = bk_get_info(scene->bk_data, i);
+        if(info != NULL && info->probability > 1) {
+            vector_append(hazards, &info);
+        }
+    }
+}
+
 void arena_spawn_hazard(scene *scene) {
+    arena_local *local = scene_get_userdata(scene);
     iterator it;
-    hashmap_iter_begin(&scene->bk_data.infos, &it);
-    hashmap_pair *pair = NULL;
+    bk_info **hazard;
 
     if (is_netplay(scene) && scene->gs->role == ROLE_CLIENT) {
         // only the server spawns hazards
@@ -865,48 +929,47 @@ void arena_spawn_hazard(scene *scene) {
 
     int changed = 0;
 
-    while((pair = iter_next(&it)) != NULL) {
-        bk_info *info = (bk_info*)pair->val;
-        if(info->probability > 1) {
-            if (rand_int(info->probability) == 1) {
-                // TODO don't spawn it if we already have this animation running
-                object *obj = malloc(sizeof(object));
-                object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
-                object_set_stl(obj, scene->bk_data.sound_translation_table);
-                object_set_animation(obj, &info->ani);
-                if (scene->id == SCENE_ARENA3 && info->ani.id == 0) {
-                    // XXX fire pit orb has a bug whwre it double spawns. Use a custom animation string to avoid it
-                    // it mioght be to do with the 'mp' tag, which we don't currently understand
-                    object_set_custom_string(obj, "Z3-mx+160my+100m15mp10Z1-Z300");
-                }
-                /*object_set_spawn_cb(obj, cb_scene_spawn_object, (void*)scene);*/
-                /*object_set_destroy_cb(obj, cb_scene_destroy_object, (void*)scene);*/
-                hazard_create(obj, scene);
-                if (game_state_add_object(scene->gs, obj, RENDER_LAYER_BOTTOM, 1, 0) == 0) {
-                    object_set_layers(obj, LAYER_HAZARD|LAYER_HAR);
-                    object_set_group(obj, GROUP_PROJECTILE);
-                    object_set_userdata(obj, &scene->bk_data);
-                    if (info->ani.extra_string_count > 0) {
-                        // For the desert, there's a bunch of extra animation strgins for
-                        // the different plane formations.
-                        // Pick one, rather than always use the first
-
-                        int r = rand_int(info->ani.extra_string_count);
-                        if (r > 0) {
-                            str *s = vector_get(&info->ani.extra_strings, r);
-                            object_set_custom_string(obj, str_c(s));
-                        }
+    vector_iter_begin(&local->hazards, &it);
+    while((hazard = iter_next(&it)) != NULL) {
+        bk_info *info = *hazard;
+        if (game_state_rand_int(scene->gs, info->probability) == 1) {
+            // TODO don't spawn it if we already have this animation running
+            object *obj = malloc(sizeof(object));
+            object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
+            object_set_stl(obj, scene->bk_data->sound_translation_table);
+            object_set_animation(obj, &info->ani);
+            if (scene->id == SCENE_ARENA3 && info->ani.id == 0) {
+                // XXX fire pit orb has a bug whwre it double spawns. Use a custom animation string to avoid it
+                // it mioght be to do with the 'mp' tag, which we don't currently understand
+                object_set_custom_string(obj, "Z3-mx+160my+100m15mp10Z1-Z300");
+            }
+            /*object_set_spawn_cb(obj, cb_scene_spawn_object, (void*)scene);*/
+            /*object_set_destroy_cb(obj, cb_scene_destroy_object, (void*)scene);*/
+            hazard_create(obj, scene);
+            if (game_state_add_object(scene->gs, obj, RENDER_LAYER_BOTTOM, 1, 0) == 0) {
+                object_set_layers(obj, LAYER_HAZARD|LAYER_HAR);
+                object_set_group(obj, GROUP_PROJECTILE);
+                object_set_userdata(obj, scene->bk_data);
+                if (info->ani.extra_string_count > 0) {
+                    // For the desert, there's a bunch of extra animation strgins for
+                    // the different plane formations.
+                    // Pick one, rather than always use the first
+
+                    int r = game_state_rand_int(scene->gs, info->ani.extra_string_count);
+                    if (r > 0) {
+                        str *s = vector_get(&info->ani.extra_strings, r);
+                        object_set_custom_string(obj, str_c(s));
                     }
+                }
 
-                    // XXX without this, the object does not unserialize correctly in netplay
-                    object_dynamic_tick(obj);
+                // XXX without this, the object does not unserialize correctly in netplay
+                object_dynamic_tick(obj);
 
-                    DEBUG("Arena tick: Hazard with probability %d started.", info->probability, info->ani.id);
-                    changed++;
-                } else {
-                    object_free(obj);
-                    free(obj);
-                }
+                DEBUG("Arena tick: Hazard with probability %d started.", info->probability, info->ani.id);
+                changed++;
+            } else {
+                object_free(obj);
+                free(obj);
             }
         }
     }
@@ -920,6 +983,27 @@ void arena_dynamic_tick(scene *scene, int paused) {
     game_player *player1 = game_state_get_player(gs, 0);
     game_player *player2 = game_state_get_player(gs, 1);
 
+    if(!paused && is_netplay(scene)) {
+        // Keep the start of this tick around in case remote input for it arrives late
+        game_state_save_snapshot(gs);
+    }
+
+    if(!paused && gs->history != NULL) {
+        game_state_history_save(gs);
+    }
+
+    if(!paused && local->rec && gs->tick % REC_INDEX_INTERVAL == 0) {
+        serial ser;
+        serial_create_size(&ser, GAME_STATE_SERIAL_SIZE_HINT);
+        game_state_serialize(gs, &ser);
+        rec_index_add(&local->rec_idx, gs->tick, &ser);
+        serial_free(&ser);
+    }
+
+    if(!paused && gs->init_flags->ai_match && gs->tick == TOURNAMENT_MATCH_MAX_TICKS) {
+        arena_end_ai_match(scene, 1);
+    }
+
     if(!paused) {
         object *obj_har[2];
         har *hars[2];
@@ -943,9 +1027,16 @@ void arena_dynamic_tick(scene *scene, int paused) {
             component_tick(local->endurance_bars[i]);
         }
 
-        // RTT stuff
-        hars[0]->delay = ceil(player2->ctrl->rtt / 2.0f);
-        hars[1]->delay = ceil(player1->ctrl->rtt / 2.0f);
+        // Local moves wait for as long as they take to reach the peer
+        hars[0]->delay = player2->ctrl->type == CTRL_TYPE_NETWORK ? net_controller_get_input_delay(player2->ctrl) : 0;
+        hars[1]->delay = player1->ctrl->type == CTRL_TYPE_NETWORK ? net_controller_get_input_delay(player1->ctrl) : 0;
+        // Spectators use the delays the host had
+        for(int i = 0; i < 2; i++) {
+            controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+            if(ctrl->type == CTRL_TYPE_SPECTATOR) {
+                hars[i]->delay = spectator_controller_get_delay(ctrl);
+            }
+        }
 
         // Endings and beginnings
         if(local->state != ARENA_STATE_ENDING && local->state != ARENA_STATE_STARTING) {
@@ -957,8 +1048,8 @@ void arena_dynamic_tick(scene *scene, int paused) {
         if(local->state == ARENA_STATE_ENDING) {
             chr_score *s1 = game_player_get_score(game_state_get_player(scene->gs, 0));
             chr_score *s2 = game_player_get_score(game_state_get_player(scene->gs, 1));
-            if (player_frame_isset(obj_har[0], "be")
-                || player_frame_isset(obj_har[1], "be")
+            if (player_frame_tag_isset(obj_har[0], TAG_BE)
+                || player_frame_tag_isset(obj_har[1], TAG_BE)
                 || chr_score_onscreen(s1)
                 || chr_score_onscreen(s2)) {
             } else {
@@ -978,13 +1069,13 @@ void arena_dynamic_tick(scene *scene, int paused) {
 
         // Pour some rein!
         if(local->rein_enabled) {
-            if(rand_float() > 0.65f) {
-                vec2i pos = vec2i_create(rand_int(NATIVE_W), -10);
+            if(game_state_rand_float(gs) > 0.65f) {
+                vec2i pos = vec2i_create(game_state_rand_int(gs, NATIVE_W), -10);
                 for(int harnum = 0;harnum < game_state_num_players(gs);harnum++) {
                     object *h_obj = game_state_get_player(gs, harnum)->har;
                     har *h = object_get_userdata(h_obj);
                     // Calculate velocity etc.
-                    float rv = rand_float() - 0.5f;
+                    float rv = game_state_rand_float(gs) - 0.5f;
                     float velx = rv;
                     float vely = -12 * sin(0 / 2 + rv);
 
@@ -993,8 +1084,8 @@ void arena_dynamic_tick(scene *scene, int paused) {
                     if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
                     // Create the object
-                    object *scrap = malloc(sizeof(object));
-                    int anim_no = rand_int(3) + ANIM_SCRAP_METAL;
+                    object *scrap = game_state_alloc_object(gs);
+                    int anim_no = game_state_rand_int(gs, 3) + ANIM_SCRAP_METAL;
                     object_create(scrap, gs, pos, vec2f_create(velx, vely));
                     object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
                     object_set_gravity(scrap, 0.4f);
@@ -1013,6 +1104,14 @@ void arena_dynamic_tick(scene *scene, int paused) {
     // allow enemy HARs to move during a network game
     need_sync += arena_handle_events(scene, player1, player1->ctrl->extra_events);
     need_sync += arena_handle_events(scene, player2, player2->ctrl->extra_events);
+
+    // Peers only get a full state when their state hash disagrees with ours
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+        if(ctrl->type == CTRL_TYPE_NETWORK) {
+            need_sync += net_controller_take_desync(ctrl);
+        }
+    }
     arena_maybe_sync(scene, need_sync);
 }
 
@@ -1056,7 +1155,7 @@ void arena_render_overlay(scene *scene) {
 #ifdef DEBUGMODE
     sprintf(buf, "%u", game_state_get_tick(scene->gs));
     font_render(&font_small, buf, 160, 0, TEXT_COLOR);
-    sprintf(buf, "%u", rand_get_seed());
+    sprintf(buf, "%u", random_get_seed(&scene->gs->rand));
     font_render(&font_small, buf, 130, 8, TEXT_COLOR);
 #endif
     for(int i = 0; i < 2; i++) {
@@ -1105,11 +1204,11 @@ void arena_render_overlay(scene *scene) {
 
         // render ping, if player is networked
         if (player[0]->ctrl->type == CTRL_TYPE_NETWORK) {
-            sprintf(buf, "ping %u", player[0]->ctrl->rtt);
+            sprintf(buf, "ping %u", (unsigned int)net_controller_get_stats(player[0]->ctrl)->rtt_ms);
             font_render(&font_small, buf, 5, 40, TEXT_COLOR);
         }
         if (player[1]->ctrl->type == CTRL_TYPE_NETWORK) {
-            sprintf(buf, "ping %u", player[1]->ctrl->rtt);
+            sprintf(buf, "ping %u", (unsigned int)net_controller_get_stats(player[1]->ctrl)->rtt_ms);
             font_render(&font_small, buf, 315-(strlen(buf)*font_small.w), 40, TEXT_COLOR);
         }
 
@@ -1145,7 +1244,7 @@ void arena_toggle_rein(scene *scene) {
 }
 
 void arena_startup(scene *scene, int id, int *m_load, int *m_repeat) {
-    if(scene->bk_data.file_id == 64) {
+    if(scene->bk_data->file_id == 64) {
         // Start up & repeat torches on arena startup
         switch(id) {
             case 1:
@@ -1166,13 +1265,17 @@ int arena_create(scene *scene) {
     // Load up settings
     setting = settings_get();
 
-    // Initialize Demo
-    if(is_demoplay(scene)) {
+    // Timers of the arena that may be in a serialized game state
+    ticktimer_register_cb(scene_fight_anim_start);
+    ticktimer_register_cb(scene_fight_anim_done);
+
+    // Initialize Demo. Tournament matches come with their players set up.
+    if(is_demoplay(scene) && !scene->gs->init_flags->ai_match) {
         game_state_init_demo(scene->gs);
     }
 
     // Handle music playback
-    switch(scene->bk_data.file_id) {
+    switch(scene->bk_data->file_id) {
         case 8:   music_play(PSM_ARENA0); break;
         case 16:  music_play(PSM_ARENA1); break;
         case 32:  music_play(PSM_ARENA2); break;
@@ -1188,6 +1291,8 @@ int arena_create(scene *scene) {
     local->state = ARENA_STATE_STARTING;
     local->ending_ticks = 0;
     local->rein_enabled = 0;
+    arena_find_hazards(scene, &local->hazards);
+    serial_create_size(&local->sync, GAME_STATE_SERIAL_SIZE_HINT);
 
     local->round = 0;
     switch (setting->gameplay.rounds) {
@@ -1256,7 +1361,7 @@ int arena_create(scene *scene) {
                 if (i == 1) {
                     xoff = 210 - 9 * j - 3 - j;
                 }
-                animation *ani = &bk_get_info(&scene->bk_data, 27)->ani;
+                animation *ani = &bk_get_info(scene->bk_data, 27)->ani;
                 object_create(local->player_rounds[i][j], scene->gs, vec2i_create(xoff ,9), vec2f_create(0, 0));
                 object_set_animation(local->player_rounds[i][j], ani);
                 object_select_sprite(local->player_rounds[i][j], 1);
@@ -1353,39 +1458,39 @@ int arena_create(scene *scene) {
     har_screencaps_reset(&_player[1]->screencaps);
 
     // Set correct sounds for ready, round and number STL fields
-    scene->bk_data.sound_translation_table[14] = 10; // READY
-    scene->bk_data.sound_translation_table[15] = 16; // ROUND
-    scene->bk_data.sound_translation_table[3] = 23 + local->round; // NUMBER
+    scene->bk_data->sound_translation_table[14] = 10; // READY
+    scene->bk_data->sound_translation_table[15] = 16; // ROUND
+    scene->bk_data->sound_translation_table[3] = 23 + local->round; // NUMBER
 
     // Disable the floating ball disappearence sound in fire arena
     if(scene->id == SCENE_ARENA3) {
-        scene->bk_data.sound_translation_table[20] = 0;
+        scene->bk_data->sound_translation_table[20] = 0;
     }
 
     if (local->rounds == 1) {
         // Start READY animation
-        animation *ready_ani = &bk_get_info(&scene->bk_data, 11)->ani;
+        animation *ready_ani = &bk_get_info(scene->bk_data, 11)->ani;
         object *ready = malloc(sizeof(object));
         object_create(ready, scene->gs, ready_ani->start_pos, vec2f_create(0,0));
-        object_set_stl(ready, scene->bk_data.sound_translation_table);
+        object_set_stl(ready, scene->bk_data->sound_translation_table);
         object_set_animation(ready, ready_ani);
         object_set_finish_cb(ready, scene_ready_anim_done);
         game_state_add_object(scene->gs, ready, RENDER_LAYER_TOP, 0, 0);
     } else {
         // ROUND
-        animation *round_ani = &bk_get_info(&scene->bk_data, 6)->ani;
+        animation *round_ani = &bk_get_info(scene->bk_data, 6)->ani;
         object *round = malloc(sizeof(object));
         object_create(round, scene->gs, round_ani->start_pos, vec2f_create(0,0));
-        object_set_stl(round, scene->bk_data.sound_translation_table);
+        object_set_stl(round, scene->bk_data->sound_translation_table);
         object_set_animation(round, round_ani);
         object_set_finish_cb(round, scene_ready_anim_done);
         game_state_add_object(scene->gs, round, RENDER_LAYER_TOP, 0, 0);
 
         // Number
-        animation *number_ani = &bk_get_info(&scene->bk_data, 7)->ani;
+        animation *number_ani = &bk_get_info(scene->bk_data, 7)->ani;
         object *number = malloc(sizeof(object));
         object_create(number, scene->gs, number_ani->start_pos, vec2f_create(0,0));
-        object_set_stl(number, scene->bk_data.sound_translation_table);
+        object_set_stl(number, scene->bk_data->sound_translation_table);
         object_set_animation(number, number_ani);
         object_select_sprite(number, local->round);
         game_state_add_object(scene->gs, number, RENDER_LAYER_TOP, 0, 0);
@@ -1407,6 +1512,7 @@ int arena_create(scene *scene) {
     if (scene->gs->init_flags->record == 1) {
         local->rec = malloc(sizeof(sd_rec_file));
         sd_rec_create(local->rec);
+        rec_index_create(&local->rec_idx);
         for(int i = 0; i < 2; i++) {
             // Declare some vars
             game_player *player = game_state_get_player(scene->gs, i);
@@ -1418,8 +1524,10 @@ int arena_create(scene *scene) {
             local->rec->pilots[i].info.color_3 = player->colors[0];
             memcpy(local->rec->pilots[i].info.name, lang_get(player->pilot_id+20), 18);
         }
+        local->rec_writer = rec_writer_open(local->rec, scene->gs->init_flags->rec_file);
     } else{
         local->rec = NULL;
+        local->rec_writer = NULL;
     }
 
     // All done!
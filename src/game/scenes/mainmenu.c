@@ -2,6 +2,8 @@
 #include "audio/music.h"
 #include "video/video.h"
 #include "resources/ids.h"
+#include "resources/scores.h"
+#include "resources/sgmanager.h"
 #include "game/gui/frame.h"
 #include "game/scenes/mainmenu.h"
 #include "game/scenes/mainmenu/menu_main.h"
@@ -89,6 +91,10 @@ int mainmenu_create(scene *scene) {
     // Load settings
     game_state_set_speed(scene->gs, settings_get()->gameplay.speed);
 
+    // The scoreboard and the tournament are a few clicks away
+    scores_prefetch();
+    sg_prefetch(settings_get()->tournament.last_name);
+
     // Create main menu
     local->frame = guiframe_create(165, 5, 151, 119);
     guiframe_set_root(local->frame, menu_main_create(scene));
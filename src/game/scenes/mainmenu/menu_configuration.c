@@ -18,6 +18,7 @@ void menu_config_music_slide(component *c, void *userdata, int pos) {
 
 void menu_config_sound_slide(component *c, void *userdata, int pos) {
     sound_set_volume(pos/10.0f);
+    settings_apply();
 }
 
 void menu_config_mono_toggle(component *c, void *userdata, int pos) {
@@ -5,15 +5,18 @@
 #include "game/scenes/mainmenu/menu_widget_ids.h"
 
 #include "game/gui/gui.h"
+#include "controller/net_controller.h"
 #include "game/utils/settings.h"
 #include "game/protos/scene.h"
 #include "game/game_state.h"
+#include "relay.h"
 #include "utils/compat.h"
 #include "utils/log.h"
 
 typedef struct {
     time_t connect_start;
-    ENetHost *host;
+    net_service *service;
+    int at_relay; // Connected to a relay, waiting for the other player
     component *addr_input;
     component *connect_button;
     component *cancel_button;
@@ -22,8 +25,8 @@ typedef struct {
 
 void menu_connect_free(component *c) {
     connect_menu_data *local = menu_get_userdata(c);
-    if(local->host) {
-        enet_host_destroy(local->host);
+    if(local->service) {
+        net_service_close(local->service);
     }
     free(local);
 }
@@ -40,8 +43,8 @@ void menu_connect_start(component *c, void *userdata) {
     settings_get()->net.net_connect_ip = strdup(addr);
 
     // Set up enet host
-    local->host = enet_host_create(NULL, 1, 2, 0, 0);
-    if(local->host == NULL) {
+    ENetHost *host = enet_host_create(NULL, 1, NET_CHANNEL_COUNT, 0, 0);
+    if(host == NULL) {
         DEBUG("Failed to initialize ENet client");
         return;
     }
@@ -55,11 +58,13 @@ void menu_connect_start(component *c, void *userdata) {
     enet_address_set_host(&address, addr);
     address.port = settings_get()->net.net_connect_port;
 
-    ENetPeer *peer = enet_host_connect(local->host, &address, 2, 0);
+    // The network thread takes over the host once the connect is queued
+    ENetPeer *peer = enet_host_connect(host, &address, NET_CHANNEL_COUNT, settings_get()->net.net_relay_session);
     if(peer == NULL) {
         DEBUG("Unable to connect to %s", addr);
-        enet_host_destroy(local->host);
-        local->host = NULL;
+        enet_host_destroy(host);
+    } else if((local->service = net_service_create(host)) == NULL) {
+        enet_host_destroy(host);
     }
     time(&local->connect_start);
 }
@@ -70,73 +75,106 @@ void menu_connect_cancel(component *c, void *userdata) {
 
     // Clean up host
     connect_menu_data *local = menu_get_userdata(c->parent);
-    if(local->host) {
-        enet_host_destroy(local->host);
-        local->host = NULL;
+    if(local->service) {
+        net_service_close(local->service);
+        local->service = NULL;
     }
 }
 
+// Sets up the players once the other side is there. Through a relay, the
+// relay decides which side is the server.
+static void menu_connect_begin(connect_menu_data *local, ENetPeer *peer, int role) {
+    game_state *gs = local->s->gs;
+    ENetPacket * packet = enet_packet_create("0", 2, ENET_PACKET_FLAG_RELIABLE);
+    net_service_send(local->service, peer, 0, packet);
+    net_service_flush(local->service);
+
+    DEBUG("connected to server!");
+    controller *player1_ctrl, *player2_ctrl;
+    keyboard_keys *keys;
+    game_player *p1 = game_state_get_player(gs, 0);
+    game_player *p2 = game_state_get_player(gs, 1);
+    gs->role = role;
+
+    // force the speed to 3
+    game_state_set_speed(gs, 5);
+
+    // Both ends have to come to the same positions, whatever their FPUs do
+    game_state_set_fixed_physics(gs, 1);
+
+    p1->har_id = HAR_JAGUAR;
+    p1->pilot_id = 0;
+    p2->har_id = HAR_JAGUAR;
+    p2->pilot_id = 0;
+
+    player1_ctrl = malloc(sizeof(controller));
+    controller_init(player1_ctrl);
+    player1_ctrl->har = p1->har;
+    player2_ctrl = malloc(sizeof(controller));
+    controller_init(player2_ctrl);
+    player2_ctrl->har = p2->har;
+
+    // The server plays player 1, like a listening game does
+    controller *net_ctrl = (role == ROLE_SERVER) ? player2_ctrl : player1_ctrl;
+    controller *local_ctrl = (role == ROLE_SERVER) ? player1_ctrl : player2_ctrl;
+
+    // Remote player -- Network
+    net_controller_create(net_ctrl, local->service, peer, role);
+
+    // Local player -- Keyboard
+    settings_keyboard *k = &settings_get()->keys;
+    keys = malloc(sizeof(keyboard_keys));
+    keys->up = SDL_GetScancodeFromName(k->key1_up);
+    keys->down = SDL_GetScancodeFromName(k->key1_down);
+    keys->left = SDL_GetScancodeFromName(k->key1_left);
+    keys->right = SDL_GetScancodeFromName(k->key1_right);
+    keys->punch = SDL_GetScancodeFromName(k->key1_punch);
+    keys->kick = SDL_GetScancodeFromName(k->key1_kick);
+    keys->escape = SDL_GetScancodeFromName(k->key1_escape);
+    keyboard_create(local_ctrl, keys, 0);
+
+    game_player_set_ctrl(p1, player1_ctrl);
+    game_player_set_ctrl(p2, player2_ctrl);
+    local->service = NULL;
+    game_player_set_selectable(p2, 1);
+
+    chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 0)), AI_DIFFICULTY_CHAMPION);
+    chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 1)), AI_DIFFICULTY_CHAMPION);
+
+    game_state_set_next(gs, SCENE_MELEE);
+}
+
 void menu_connect_tick(component *c) {
     connect_menu_data *local = menu_get_userdata(c);
-    game_state *gs = local->s->gs;
-    if(local->host) {
-        ENetEvent event;
-        if(enet_host_service(local->host, &event, 0) > 0 && event.type == ENET_EVENT_TYPE_CONNECT) {
-            ENetPacket * packet = enet_packet_create("0", 2, ENET_PACKET_FLAG_RELIABLE);
-            enet_peer_send(event.peer, 0, packet);
-            enet_host_flush(local->host);
-
-            DEBUG("connected to server!");
-            controller *player1_ctrl, *player2_ctrl;
-            keyboard_keys *keys;
-            game_player *p1 = game_state_get_player(gs, 0);
-            game_player *p2 = game_state_get_player(gs, 1);
-
-            // force the speed to 3
-            game_state_set_speed(gs, 5);
-
-            p1->har_id = HAR_JAGUAR;
-            p1->pilot_id = 0;
-            p2->har_id = HAR_JAGUAR;
-            p2->pilot_id = 0;
-
-            player1_ctrl = malloc(sizeof(controller));
-            controller_init(player1_ctrl);
-            player1_ctrl->har = p1->har;
-            player2_ctrl = malloc(sizeof(controller));
-            controller_init(player2_ctrl);
-            player2_ctrl->har = p2->har;
-
-            // Player 1 controller -- Network
-            net_controller_create(player1_ctrl, local->host, event.peer, ROLE_CLIENT);
-            game_player_set_ctrl(p1, player1_ctrl);
-
-            // Player 2 controller -- Keyboard
-            settings_keyboard *k = &settings_get()->keys;
-            keys = malloc(sizeof(keyboard_keys));
-            keys->up = SDL_GetScancodeFromName(k->key1_up);
-            keys->down = SDL_GetScancodeFromName(k->key1_down);
-            keys->left = SDL_GetScancodeFromName(k->key1_left);
-            keys->right = SDL_GetScancodeFromName(k->key1_right);
-            keys->punch = SDL_GetScancodeFromName(k->key1_punch);
-            keys->kick = SDL_GetScancodeFromName(k->key1_kick);
-            keys->escape = SDL_GetScancodeFromName(k->key1_escape);
-            keyboard_create(player2_ctrl, keys, 0);
-            game_player_set_ctrl(p2, player2_ctrl);
-            local->host = NULL;
-            game_player_set_selectable(p2, 1);
-
-            chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 0)), AI_DIFFICULTY_CHAMPION);
-            chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 1)), AI_DIFFICULTY_CHAMPION);
-
-            game_state_set_next(gs, SCENE_MELEE);
-        } else {
-            if(difftime(time(NULL), local->connect_start) > 5.0) {
-                DEBUG("connection timed out");
-                menu_connect_cancel(local->cancel_button, local->s);
+    ENetEvent event;
+    while(local->service && net_service_poll(local->service, &event) == 0) {
+        if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+            int paired = local->at_relay
+                && event.packet->dataLength == 2
+                && event.packet->data[0] == RELAY_PACKET_PAIRED;
+            int role = paired ? event.packet->data[1] : ROLE_CLIENT;
+            enet_packet_destroy(event.packet);
+            if(paired) {
+                local->at_relay = 0;
+                menu_connect_begin(local, event.peer, role);
+            }
+        } else if(event.type == ENET_EVENT_TYPE_CONNECT) {
+            if(settings_get()->net.net_relay_session != 0) {
+                DEBUG("waiting at the relay for session %d", settings_get()->net.net_relay_session);
+                local->at_relay = 1;
+            } else {
+                menu_connect_begin(local, event.peer, ROLE_CLIENT);
             }
+        } else if(event.type == ENET_EVENT_TYPE_DISCONNECT && local->at_relay) {
+            DEBUG("the relay turned us away");
+            menu_connect_cancel(local->cancel_button, local->s);
         }
     }
+    // The other player may take a while to show up at the relay
+    if(local->service && !local->at_relay && difftime(time(NULL), local->connect_start) > 5.0) {
+        DEBUG("connection timed out");
+        menu_connect_cancel(local->cancel_button, local->s);
+    }
 }
 
 component* menu_connect_create(scene *s) {
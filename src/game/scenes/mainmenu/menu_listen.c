@@ -4,21 +4,23 @@
 #include "game/scenes/mainmenu/menu_listen.h"
 
 #include "game/gui/gui.h"
+#include "controller/net_controller.h"
+#include "game/spectate.h"
 #include "game/utils/settings.h"
 #include "game/protos/scene.h"
 #include "game/game_state.h"
 #include "utils/log.h"
 
 typedef struct {
-    ENetHost *host;
+    net_service *service;
     component *cancel_button;
     scene *s;
 } listen_menu_data;
 
 void menu_listen_free(component *c) {
     listen_menu_data *local = menu_get_userdata(c);
-    if(local->host) {
-        enet_host_destroy(local->host);
+    if(local->service) {
+        net_service_close(local->service);
     }
     free(local);
 }
@@ -26,12 +28,14 @@ void menu_listen_free(component *c) {
 void menu_listen_tick(component *c) {
     listen_menu_data *local = menu_get_userdata(c);
     game_state *gs = local->s->gs;
-    if(local->host) {
-        ENetEvent event;
-        if(enet_host_service(local->host, &event, 0) > 0 && event.type == ENET_EVENT_TYPE_CONNECT) {
+    ENetEvent event;
+    while(local->service && net_service_poll(local->service, &event) == 0) {
+        if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+            enet_packet_destroy(event.packet);
+        } else if(event.type == ENET_EVENT_TYPE_CONNECT) {
             ENetPacket * packet = enet_packet_create("0", 2,  ENET_PACKET_FLAG_RELIABLE);
-            enet_peer_send(event.peer, 0, packet);
-            enet_host_flush(local->host);
+            net_service_send(local->service, event.peer, 0, packet);
+            net_service_flush(local->service);
 
             DEBUG("client connected!");
             controller *player1_ctrl, *player2_ctrl;
@@ -42,6 +46,9 @@ void menu_listen_tick(component *c) {
             // force the speed to 3
             game_state_set_speed(gs, 5);
 
+            // Both ends have to come to the same positions, whatever their FPUs do
+            game_state_set_fixed_physics(gs, 1);
+
             p1->har_id = HAR_JAGUAR;
             p1->pilot_id = 0;
             p2->har_id = HAR_JAGUAR;
@@ -68,11 +75,22 @@ void menu_listen_tick(component *c) {
             game_player_set_ctrl(p1, player1_ctrl);
 
             // Player 2 controller -- Network
-            net_controller_create(player2_ctrl, local->host, event.peer, ROLE_SERVER);
+            net_controller_create(player2_ctrl, local->service, event.peer, ROLE_SERVER);
             game_player_set_ctrl(p2, player2_ctrl);
-            local->host = NULL;
+            local->service = NULL;
             game_player_set_selectable(p2, 1);
 
+            // Let spectators watch, if enabled
+            int spectate_port = settings_get()->net.net_spectate_port;
+            if(spectate_port > 0) {
+                spectate *sp = malloc(sizeof(spectate));
+                if(spectate_host_create(sp, spectate_port)) {
+                    free(sp);
+                } else {
+                    game_state_set_spectate(gs, sp);
+                }
+            }
+
             chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 0)), AI_DIFFICULTY_CHAMPION);
             chr_score_set_difficulty(game_player_get_score(game_state_get_player(gs, 1)), AI_DIFFICULTY_CHAMPION);
 
@@ -87,9 +105,9 @@ void menu_listen_cancel(component *c, void *userdata) {
 
     // Clean up host
     listen_menu_data *local = menu_get_userdata(c->parent);
-    if(local->host) {
-        enet_host_destroy(local->host);
-        local->host = NULL;
+    if(local->service) {
+        net_service_close(local->service);
+        local->service = NULL;
     }
 }
 
@@ -103,14 +121,20 @@ component* menu_listen_create(scene *s) {
     address.host = ENET_HOST_ANY;
     address.port = settings_get()->net.net_listen_port;
 
-    // Set up host
-    local->host = enet_host_create(&address, 1, 2, 0, 0);
-    if(local->host == NULL) {
+    // Set up host, and hand it over to the network thread
+    ENetHost *host = enet_host_create(&address, 1, NET_CHANNEL_COUNT, 0, 0);
+    if(host == NULL) {
         DEBUG("Failed to initialize ENet server");
         free(local);
         return NULL;
     }
-    enet_socket_set_option(local->host->socket, ENET_SOCKOPT_REUSEADDR, 1);
+    enet_socket_set_option(host->socket, ENET_SOCKOPT_REUSEADDR, 1);
+    local->service = net_service_create(host);
+    if(local->service == NULL) {
+        enet_host_destroy(host);
+        free(local);
+        return NULL;
+    }
 
     // Text config
     text_settings tconf;
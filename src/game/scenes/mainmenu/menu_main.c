@@ -73,19 +73,38 @@ void mainmenu_mechlab(component *c, void *userdata) {
     game_state_set_next(s->gs, SCENE_MECHLAB);
 }
 
+// Submenus built on first open, and kept for the next
+enum {
+    MAINMENU_KEPT_CONFIGURATION = 0,
+    MAINMENU_KEPT_GAMEPLAY,
+    MAINMENU_KEPT_NETWORK,
+};
+
 void mainmenu_enter_configuration(component *c, void *userdata) {
     scene *s = userdata;
-    menu_set_submenu(c->parent, menu_configuration_create(s));
+    component *sub = menu_get_kept_submenu(c->parent, MAINMENU_KEPT_CONFIGURATION);
+    if(sub == NULL) {
+        sub = menu_configuration_create(s);
+    }
+    menu_set_kept_submenu(c->parent, MAINMENU_KEPT_CONFIGURATION, sub);
 }
 
 void mainmenu_enter_gameplay(component *c, void *userdata) {
     scene *s = userdata;
-    menu_set_submenu(c->parent, menu_gameplay_create(s));
+    component *sub = menu_get_kept_submenu(c->parent, MAINMENU_KEPT_GAMEPLAY);
+    if(sub == NULL) {
+        sub = menu_gameplay_create(s);
+    }
+    menu_set_kept_submenu(c->parent, MAINMENU_KEPT_GAMEPLAY, sub);
 }
 
 void mainmenu_enter_network(component *c, void *userdata) {
     scene *s = userdata;
-    menu_set_submenu(c->parent, menu_net_create(s));
+    component *sub = menu_get_kept_submenu(c->parent, MAINMENU_KEPT_NETWORK);
+    if(sub == NULL) {
+        sub = menu_net_create(s);
+    }
+    menu_set_kept_submenu(c->parent, MAINMENU_KEPT_NETWORK, sub);
 }
 
 component* menu_main_create(scene *s) {
@@ -1,6 +1,7 @@
 #include "game/scenes/mainmenu/menu_net.h"
 #include "game/scenes/mainmenu/menu_connect.h"
 #include "game/scenes/mainmenu/menu_listen.h"
+#include "game/scenes/mainmenu/menu_spectate.h"
 #include "game/scenes/mainmenu/menu_widget_ids.h"
 
 #include "game/gui/gui.h"
@@ -23,6 +24,11 @@ void menu_net_listen(component *c, void *userdata) {
     }
 }
 
+void menu_net_spectate(component *c, void *userdata) {
+    scene *s = userdata;
+    menu_set_submenu(c->parent, menu_spectate_create(s));
+}
+
 component* menu_net_create(scene *s) {
     text_settings tconf;
     text_defaults(&tconf);
@@ -39,6 +45,7 @@ component* menu_net_create(scene *s) {
     component *listen = textbutton_create(&tconf, "START SERVER", COM_ENABLED, menu_net_listen, s);
     widget_set_id(listen, NETWORK_LISTEN_BUTTON_ID);
     menu_attach(menu, listen);
+    menu_attach(menu, textbutton_create(&tconf, "SPECTATE", COM_ENABLED, menu_net_spectate, s));
     menu_attach(menu, textbutton_create(&tconf, "DONE", COM_ENABLED, menu_net_done, NULL));
     return menu;
 }
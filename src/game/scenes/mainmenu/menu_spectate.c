@@ -0,0 +1,96 @@
+#include <time.h>
+
+#include "game/scenes/mainmenu/menu_spectate.h"
+
+#include "game/gui/gui.h"
+#include "game/spectate.h"
+#include "game/utils/settings.h"
+#include "game/protos/scene.h"
+#include "game/game_state.h"
+#include "utils/compat.h"
+#include "utils/log.h"
+
+typedef struct {
+    time_t connect_start;
+    component *addr_input;
+    component *connect_button;
+    component *cancel_button;
+    scene *s;
+} spectate_menu_data;
+
+void menu_spectate_free(component *c) {
+    spectate_menu_data *local = menu_get_userdata(c);
+    free(local);
+}
+
+void menu_spectate_start(component *c, void *userdata) {
+    scene *s = userdata;
+    spectate_menu_data *local = menu_get_userdata(c->parent);
+    const char *addr = textinput_value(local->addr_input);
+
+    // Free old saved address, and set new
+    free(settings_get()->net.net_connect_ip);
+    settings_get()->net.net_connect_ip = strdup(addr);
+
+    spectate *sp = malloc(sizeof(spectate));
+    if(spectate_client_create(sp, addr, settings_get()->net.net_spectate_port, settings_get()->net.net_spectate_relay_port)) {
+        free(sp);
+        return;
+    }
+    // The game state takes over, and moves to the arena once a match is announced
+    game_state_set_spectate(s->gs, sp);
+
+    // Disable connect button and address input field
+    component_disable(local->connect_button, 1);
+    component_disable(local->addr_input, 1);
+    menu_select(c->parent, local->cancel_button);
+    time(&local->connect_start);
+}
+
+void menu_spectate_cancel(component *c, void *userdata) {
+    scene *s = userdata;
+    menu *m = sizer_get_obj(c->parent);
+    m->finished = 1;
+    game_state_set_spectate(s->gs, NULL);
+}
+
+void menu_spectate_tick(component *c) {
+    spectate_menu_data *local = menu_get_userdata(c);
+    game_state *gs = local->s->gs;
+    if(gs->spectate != NULL && !spectate_is_connected(gs->spectate)) {
+        if(difftime(time(NULL), local->connect_start) > 5.0) {
+            DEBUG("spectator connection timed out");
+            menu_spectate_cancel(local->cancel_button, local->s);
+        }
+    }
+}
+
+component* menu_spectate_create(scene *s) {
+    spectate_menu_data *local = malloc(sizeof(spectate_menu_data));
+    memset(local, 0, sizeof(spectate_menu_data));
+    local->s = s;
+
+    // Text config
+    text_settings tconf;
+    text_defaults(&tconf);
+    tconf.font = FONT_BIG;
+    tconf.halign = TEXT_CENTER;
+    tconf.cforeground = color_create(0, 121, 0, 255);
+
+    component* menu = menu_create(11);
+    menu_attach(menu, label_create(&tconf, "SPECTATE"));
+    menu_attach(menu, filler_create());
+
+    local->addr_input = textinput_create(&tconf, "Host/IP", settings_get()->net.net_connect_ip);
+    local->connect_button = textbutton_create(&tconf, "WATCH", COM_ENABLED, menu_spectate_start, s);
+    local->cancel_button = textbutton_create(&tconf, "CANCEL", COM_ENABLED, menu_spectate_cancel, s);
+    menu_attach(menu, local->addr_input);
+    menu_attach(menu, local->connect_button);
+    menu_attach(menu, local->cancel_button);
+
+    menu_set_userdata(menu, local);
+    menu_set_free_cb(menu, menu_spectate_free);
+    menu_set_tick_cb(menu, menu_spectate_tick);
+
+    return menu;
+}
@@ -7,6 +7,7 @@
 #include "game/utils/settings.h"
 #include "video/video.h"
 #include "plugins/plugins.h"
+#include "utils/memarena.h"
 
 struct resolution_t {
     int w;  int h;  const char *name;
@@ -81,9 +82,10 @@ void scaler_toggled(component *c, void *userdata, int pos) {
     v->scaler = realloc(v->scaler, strlen(textselector_get_current_text(c))+1);
     strcpy(v->scaler, textselector_get_current_text(c));
 
-    // If scaler is NEAREST, set factor to 1 and disable
+    // If scaler is done on the whole frame, set factor to 1 and disable
     char tmp_buf[32];
-    if(textselector_get_pos(c) == 0) {
+    int frame_scaler = (video_find_frame_scaler(v->scaler) >= 0);
+    if(frame_scaler) {
         textselector_clear_options(local->factor);
         textselector_add_option(local->factor, "1");
         component_disable(local->factor, 1);
@@ -109,8 +111,8 @@ void scaler_toggled(component *c, void *userdata, int pos) {
     // Always select first factor option if scaler has changed.
     textselector_set_pos(local->factor, 0);
 
-    // If scaler is "Nearest", disable factor toggle
-    component_disable(local->factor, (textselector_get_pos(c) == 0));
+    // If scaler is "Nearest" or another frame scaler, disable factor toggle
+    component_disable(local->factor, frame_scaler);
 
     // Reinig after algorithm change
     video_reinit(v->screen_w, v->screen_h, v->fullscreen, v->vsync, v->scaler, v->scale_factor);
@@ -214,23 +216,28 @@ component* menu_video_create(scene *s) {
     component *factor = textselector_create(&tconf, "SCALING FACTOR:", scaling_factor_toggled, local);
     menu_attach(menu, scaler);
     menu_attach(menu, factor);
-    textselector_add_option(scaler, "NEAREST");
+    for(int i = 0; i < VIDEO_FRAME_SCALER_COUNT; i++) {
+        textselector_add_option(scaler, video_frame_scaler_name(i));
+        if(video_find_frame_scaler(setting->video.scaler) == i) {
+            textselector_set_pos(scaler, i);
+        }
+    }
     textselector_add_option(factor, "1");
     local->scaler = scaler; // Save references to ease their use
     local->factor = factor;
 
     // Get scalers
     list mlist;
-    list_create(&mlist);
+    list_create_with_allocator(&mlist, memarena_frame_allocator());
     plugins_get_list_by_type(&mlist, "scaler");
     iterator it;
     list_iter_begin(&mlist, &it);
     base_plugin **plugin;
-    int i = 1;
+    int i = VIDEO_FRAME_SCALER_COUNT;
     int plugin_found = 0;
     while((plugin = iter_next(&it)) != NULL) {
-        textselector_add_option(scaler, (*plugin)->get_name());
-        if(strcmp((*plugin)->get_name(), setting->video.scaler) == 0) {
+        textselector_add_option(scaler, (*plugin)->name);
+        if(strcmp((*plugin)->name, setting->video.scaler) == 0) {
             textselector_set_pos(scaler, i);
             plugin_found = 1;
         }
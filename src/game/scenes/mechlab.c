@@ -104,7 +104,7 @@ int mechlab_create(scene *scene) {
 
     // Init the background
     for(int i = 0; i < sizeof(bg_ani)/sizeof(animation*); i++) {
-        sprite *spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 14)->ani, i));
+        sprite *spr = sprite_copy(animation_get_sprite(&bk_get_info(scene->bk_data, 14)->ani, i));
         bg_ani[i] = create_animation_from_single(spr, spr->pos);
         object_create(&local->bg_obj[i], scene->gs, vec2i_create(0,0), vec2f_create(0,0));
         object_set_animation(&local->bg_obj[i], bg_ani[i]);
@@ -152,7 +152,7 @@ int mechlab_create(scene *scene) {
     guiframe_layout(local->dashboard);
 
     // Load HAR
-    animation *initial_har_ani = &bk_get_info(&scene->bk_data, 15 + p1->pilot.har_id)->ani;
+    animation *initial_har_ani = &bk_get_info(scene->bk_data, 15 + p1->pilot.har_id)->ani;
     local->mech = malloc(sizeof(object));
     object_create(local->mech, scene->gs, vec2i_create(0,0), vec2f_create(0,0));
     object_set_animation(local->mech, initial_har_ani);
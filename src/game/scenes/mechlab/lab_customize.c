@@ -27,13 +27,13 @@ static const button_details details_list[] = {
 };
 
 component* lab_customize_create(scene *s) {
-    animation *main_sheets = &bk_get_info(&s->bk_data, 1)->ani;
-    animation *main_buttons = &bk_get_info(&s->bk_data, 3)->ani;
-    animation *hand_of_doom = &bk_get_info(&s->bk_data, 29)->ani;
+    animation *main_sheets = &bk_get_info(s->bk_data, 1)->ani;
+    animation *main_buttons = &bk_get_info(s->bk_data, 3)->ani;
+    animation *hand_of_doom = &bk_get_info(s->bk_data, 29)->ani;
 
     // Initialize menu, and set button sheet
     sprite *msprite = animation_get_sprite(main_sheets, 0);
-    component *menu = trnmenu_create(msprite->data, msprite->pos.x, msprite->pos.y);
+    component *menu = trnmenu_create(sprite_get_surface(msprite), msprite->pos.x, msprite->pos.y);
 
     // Default text configuration
     text_settings tconf;
@@ -52,8 +52,8 @@ component* lab_customize_create(scene *s) {
         tconf.direction = details_list[i].dir;
 
         sprite *bsprite = animation_get_sprite(main_buttons, i);
-        component *button = spritebutton_create(&tconf, details_list[i].text, bsprite->data, COM_ENABLED, details_list[i].cb, s);
-        component_set_size_hints(button, bsprite->data->w, bsprite->data->h);
+        component *button = spritebutton_create(&tconf, details_list[i].text, sprite_get_surface(bsprite), COM_ENABLED, details_list[i].cb, s);
+        component_set_size_hints(button, sprite_get_size(bsprite).x, sprite_get_size(bsprite).y);
         component_set_pos_hints(button, bsprite->pos.x, bsprite->pos.y);
         trnmenu_attach(menu, button);
     }
@@ -5,6 +5,7 @@
 #include <SDL2/SDL.h>
 
 #include "utils/log.h"
+#include "utils/miscmath.h"
 #include "utils/random.h"
 #include "audio/music.h"
 #include "audio/sound.h"
@@ -70,22 +71,37 @@ typedef struct melee_local_t {
 
 void handle_action(scene *scene, int player, int action);
 
-void mask_sprite(surface *vga, int x, int y, int w, int h) {
-    for(int i = 0; i < vga->h; i++) {
-        for(int j = 0; j < vga->w; j++) {
-            int offset = (i * vga->w) + j;
-            if ((i < y || i > y+h) || (j < x || j > x+w)) {
-                vga->stencil[offset] = 0;
-            } else {
-                if (vga->data[offset] == -48) {
-                    // strip out the black pixels
-                    vga->stencil[offset] = 0;
-                } else {
-                    vga->stencil[offset] = 1;
-                }
-            }
+// Cuts the x,y,w,h area (edges included) out of the portrait sheet. Only
+// the area is kept, moved into place with the sprite position, so the
+// surface is a small copy instead of the whole sheet.
+sprite* mask_sprite(sprite *sheet, int x, int y, int w, int h) {
+    surface *vga = sprite_get_surface(sheet);
+    int x0 = max2(x, 0);
+    int y0 = max2(y, 0);
+    int x1 = min2(x + w + 1, vga->w);
+    int y1 = min2(y + h + 1, vga->h);
+    int cw = max2(x1 - x0, 0);
+    int ch = max2(y1 - y0, 0);
+
+    surface *sur = malloc(sizeof(surface));
+    surface_create(sur, SURFACE_TYPE_PALETTE, cw, ch);
+    for(int i = 0; i < ch; i++) {
+        const unsigned char *src = (const unsigned char*)sur->data + i * cw;
+        char *stencil = sur->stencil + i * cw;
+        surface_read_pixels(vga, sur->data + i * cw, (y0 + i) * vga->w + x0, cw);
+        for(int j = 0; j < cw; j++) {
+            // strip out the black pixels
+            stencil[j] = (src[j] != 208);
         }
     }
+    surface_build_rle(sur);
+    surface_build_hitmask(sur);
+    surface_build_pal_mask(sur);
+    surface_pack_stencil(sur);
+
+    sprite *spr = malloc(sizeof(sprite));
+    sprite_create_custom(spr, vec2i_add(sheet->pos, vec2i_create(x0, y0)), sur);
+    return spr;
 }
 
 void melee_free(scene *scene) {
@@ -597,12 +613,12 @@ int melee_create(scene *scene) {
     animation *ani;
     sprite *spr;
     for(int i = 0; i < 10; i++) {
-        ani = &bk_get_info(&scene->bk_data, 3)->ani;
+        ani = &bk_get_info(scene->bk_data, 3)->ani;
         object_create(&local->pilots[i], scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
         object_set_animation(&local->pilots[i], ani);
         object_select_sprite(&local->pilots[i], i);
 
-        ani = &bk_get_info(&scene->bk_data, 18+i)->ani;
+        ani = &bk_get_info(scene->bk_data, 18+i)->ani;
         object_create(&local->har_player1[i], scene->gs, vec2i_create(110,95), vec2f_create(0, 0));
         object_set_animation(&local->har_player1[i], ani);
         object_select_sprite(&local->har_player1[i], 0);
@@ -610,34 +626,34 @@ int melee_create(scene *scene) {
 
         int row = i / 5;
         int col = i % 5;
-        spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 1)->ani, 0));
-        mask_sprite(spr->data, 62*col, 42*row, 51, 36);
-        ani = create_animation_from_single(spr, spr->pos);
+        sprite *masked = mask_sprite(animation_get_sprite(&bk_get_info(scene->bk_data, 1)->ani, 0),
+                                     62*col, 42*row, 51, 36);
+        ani = create_animation_from_single(masked, masked->pos);
         object_create(&local->harportraits_player1[i], scene->gs, vec2i_create(0, 0), vec2f_create(0, 0));
         object_set_animation(&local->harportraits_player1[i], ani);
         object_select_sprite(&local->harportraits_player1[i], 0);
         object_set_animation_owner(&local->harportraits_player1[i], OWNER_OBJECT);
         if (player2->selectable) {
-            spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 1)->ani, 0));
-            mask_sprite(spr->data, 62*col, 42*row, 51, 36);
+            // Same pixels as player 1's, only the palette offset differs
+            spr = sprite_copy(masked);
             ani = create_animation_from_single(spr, spr->pos);
             object_create(&local->harportraits_player2[i], scene->gs, vec2i_create(0, 0), vec2f_create(0, 0));
             object_set_animation(&local->harportraits_player2[i], ani);
             object_select_sprite(&local->harportraits_player2[i], 0);
             object_set_animation_owner(&local->harportraits_player2[i], OWNER_OBJECT);
-            object_set_pal_offset(&local->harportraits_player2[i], 48);
+            object_set_pal_offset(&local->harportraits_player2[i], palette_bank_offset(1));
 
-            ani = &bk_get_info(&scene->bk_data, 18+i)->ani;
+            ani = &bk_get_info(scene->bk_data, 18+i)->ani;
             object_create(&local->har_player2[i], scene->gs, vec2i_create(210,95), vec2f_create(0, 0));
             object_set_animation(&local->har_player2[i], ani);
             object_select_sprite(&local->har_player2[i], 0);
             object_set_repeat(&local->har_player2[i], 1);
             object_set_direction(&local->har_player2[i], OBJECT_FACE_LEFT);
-            object_set_pal_offset(&local->har_player2[i], 48);
+            object_set_pal_offset(&local->har_player2[i], palette_bank_offset(1));
         }
     }
 
-    ani = &bk_get_info(&scene->bk_data, 4)->ani;
+    ani = &bk_get_info(scene->bk_data, 4)->ani;
     object_create(&local->bigportrait1, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
     object_set_animation(&local->bigportrait1, ani);
     object_select_sprite(&local->bigportrait1, 0);
@@ -649,7 +665,7 @@ int melee_create(scene *scene) {
         object_set_direction(&local->bigportrait2, OBJECT_FACE_LEFT);
     }
 
-    ani = &bk_get_info(&scene->bk_data, 5)->ani;
+    ani = &bk_get_info(scene->bk_data, 5)->ani;
     object_create(&local->player2_placeholder, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
     object_set_animation(&local->player2_placeholder, ani);
     if (player2->selectable) {
@@ -658,7 +674,7 @@ int melee_create(scene *scene) {
         object_select_sprite(&local->player2_placeholder, 1);
     }
 
-    spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 1)->ani, 0));
+    spr = sprite_copy(animation_get_sprite(&bk_get_info(scene->bk_data, 1)->ani, 0));
     surface_convert_to_rgba(spr->data, video_get_pal_ref(), 0);
     ani = create_animation_from_single(spr, spr->pos);
     object_create(&local->unselected_har_portraits, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
@@ -174,6 +174,12 @@ void newsroom_static_tick(scene *scene, int paused) {
     dialog_tick(&local->continue_dialog);
 }
 
+// The news screens only change on input, but the continue dialog pulses
+int newsroom_is_idle(scene *scene) {
+    newsroom_local *local = scene_get_userdata(scene);
+    return !dialog_is_visible(&local->continue_dialog);
+}
+
 void newsroom_overlay_render(scene *scene) {
     newsroom_local *local = scene_get_userdata(scene);
 
@@ -367,6 +373,7 @@ int newsroom_create(scene *scene) {
     scene_set_render_overlay_cb(scene, newsroom_overlay_render);
     scene_set_free_cb(scene, newsroom_free);
     scene_set_static_tick_cb(scene, newsroom_static_tick);
+    scene_set_is_idle_cb(scene, newsroom_is_idle);
     scene_set_startup_cb(scene, newsroom_startup);
 
     // Start correct music
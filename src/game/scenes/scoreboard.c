@@ -82,6 +82,11 @@ int scoreboard_event(scene *scene, SDL_Event *event) {
     return 1;
 }
 
+// Scores only change on input
+int scoreboard_is_idle(scene *scene) {
+    return 1;
+}
+
 void scoreboard_input_tick(scene *scene) {
     scoreboard_local *local = scene_get_userdata(scene);
     game_player *player1 = game_state_get_player(scene->gs, 0);
@@ -244,6 +249,7 @@ int scoreboard_create(scene *scene) {
     scene_set_input_poll_cb(scene, scoreboard_input_tick);
     scene_set_render_overlay_cb(scene, scoreboard_render_overlay);
     scene_set_free_cb(scene, scoreboard_free);
+    scene_set_is_idle_cb(scene, scoreboard_is_idle);
     video_select_renderer(VIDEO_RENDERER_HW);
 
     // All done
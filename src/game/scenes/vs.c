@@ -104,7 +104,7 @@ void cb_vs_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata
     scene *s = (scene*)userdata;
 
     // Get next animation
-    bk_info *info = bk_get_info(&s->bk_data, id);
+    bk_info *info = bk_get_info(s->bk_data, id);
     if(info != NULL) {
         object *obj = malloc(sizeof(object));
         object_create(obj, parent->gs, vec2i_add(pos, vec2f_to_i(parent->pos)), vec2f_create(0,0));
@@ -316,7 +316,7 @@ int vs_create(scene *scene) {
     video_force_pal_refresh();
 
     // HAR
-    ani = &bk_get_info(&scene->bk_data, 5)->ani;
+    ani = &bk_get_info(scene->bk_data, 5)->ani;
     object_create(&local->player1_har, scene->gs, vec2i_create(160,0), vec2f_create(0, 0));
     object_set_animation(&local->player1_har, ani);
     object_select_sprite(&local->player1_har, player1->har_id);
@@ -325,10 +325,10 @@ int vs_create(scene *scene) {
     object_set_animation(&local->player2_har, ani);
     object_select_sprite(&local->player2_har, player2->har_id);
     object_set_direction(&local->player2_har, OBJECT_FACE_LEFT);
-    object_set_pal_offset(&local->player2_har, 48);
+    object_set_pal_offset(&local->player2_har, palette_bank_offset(1));
 
     // PLAYER
-    ani = &bk_get_info(&scene->bk_data, 4)->ani;
+    ani = &bk_get_info(scene->bk_data, 4)->ani;
     object_create(&local->player1_portrait, scene->gs, vec2i_create(-10,150), vec2f_create(0, 0));
     object_set_animation(&local->player1_portrait, ani);
     object_select_sprite(&local->player1_portrait, player1->pilot_id);
@@ -340,8 +340,8 @@ int vs_create(scene *scene) {
 
     // clone the left side of the background image
     // Note! We are touching the scene-wide background surface!
-    surface_sub(&scene->bk_data.background, // DST Surface
-                &scene->bk_data.background, // SRC Surface
+    surface_sub(&scene->bk_data->background, // DST Surface
+                &scene->bk_data->background, // SRC Surface
                 160, 0, // DST
                 0, 0, // SRC
                 160, 200, // Size
@@ -357,7 +357,7 @@ int vs_create(scene *scene) {
 
     // Arena
     if(player2->selectable) {
-        ani = &bk_get_info(&scene->bk_data, 3)->ani;
+        ani = &bk_get_info(scene->bk_data, 3)->ani;
         object_create(&local->arena_select, scene->gs, vec2i_create(59,155), vec2f_create(0, 0));
         object_set_animation(&local->arena_select, ani);
         object_select_sprite(&local->arena_select, local->arena);
@@ -373,7 +373,7 @@ int vs_create(scene *scene) {
         scientistcoord.x -= 50;
     }
     object *o_scientist = malloc(sizeof(object));
-    ani = &bk_get_info(&scene->bk_data, 8)->ani;
+    ani = &bk_get_info(scene->bk_data, 8)->ani;
     object_create(o_scientist, scene->gs, scientistcoord, vec2f_create(0, 0));
     object_set_animation(o_scientist, ani);
     object_select_sprite(o_scientist, 0);
@@ -389,7 +389,7 @@ int vs_create(scene *scene) {
         welderpos = rand_int(6);
     }
     object *o_welder = malloc(sizeof(object));
-    ani = &bk_get_info(&scene->bk_data, 7)->ani;
+    ani = &bk_get_info(scene->bk_data, 7)->ani;
     object_create(o_welder, scene->gs, spawn_position(welderpos, 0), vec2f_create(0, 0));
     object_set_animation(o_welder, ani);
     object_select_sprite(o_welder, 0);
@@ -400,7 +400,7 @@ int vs_create(scene *scene) {
 
     // GANTRIES
     object *o_gantry_a = malloc(sizeof(object));
-    ani = &bk_get_info(&scene->bk_data, 11)->ani;
+    ani = &bk_get_info(scene->bk_data, 11)->ani;
     object_create(o_gantry_a, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
     object_set_animation(o_gantry_a, ani);
     object_select_sprite(o_gantry_a, 0);
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <string.h>
+#include "game/spectate.h"
+#include "utils/delta.h"
+#include "utils/log.h"
+
+// Downstream spectators per host or relay
+#define SPECTATE_MAX_PEERS 32
+// Keyframe intervals in ticks. Deltas are against the last full keyframe,
+// so a late joiner never needs more than two of them.
+#define SPECTATE_FULL_INTERVAL 1000
+#define SPECTATE_DELTA_INTERVAL 200
+// Settled ticks sent per input packet
+#define SPECTATE_BATCH_TICKS 5
+// Spectators further behind than this skip ahead to the newest keyframe
+#define SPECTATE_MAX_LAG 500
+
+enum {
+    SPECTATE_PACKET_MATCH = 1,
+    SPECTATE_PACKET_FULL,
+    SPECTATE_PACKET_DELTA,
+    SPECTATE_PACKET_INPUTS,
+    SPECTATE_PACKET_END
+};
+
+static void spectate_init(spectate *sp, int mode) {
+    memset(sp, 0, sizeof(spectate));
+    sp->mode = mode;
+    vector_create(&sp->backlog, sizeof(serial));
+    serial_create(&sp->batch);
+    serial_create(&sp->full);
+    serial_create(&sp->keyframe);
+    sp->full_tick = -1;
+    sp->delta_tick = -1;
+    sp->keyframe_tick = -1;
+    for(int i = 0; i < SPECTATE_TICK_BUFFER; i++) {
+        sp->ticks[i].tick = -1;
+    }
+}
+
+static ENetHost* spectate_listen(int port) {
+    ENetAddress address;
+    address.host = ENET_HOST_ANY;
+    address.port = port;
+    ENetHost *host = enet_host_create(&address, SPECTATE_MAX_PEERS, 1, 0, 0);
+    if(host == NULL) {
+        PERROR("Could not start spectator broadcast on port %d.", port);
+        return NULL;
+    }
+    enet_socket_set_option(host->socket, ENET_SOCKOPT_REUSEADDR, 1);
+    return host;
+}
+
+int spectate_host_create(spectate *sp, int port) {
+    spectate_init(sp, SPECTATE_HOST);
+    sp->host = spectate_listen(port);
+    if(sp->host == NULL) {
+        spectate_free(sp);
+        return 1;
+    }
+    DEBUG("Broadcasting to spectators on port %d", port);
+    return 0;
+}
+
+int spectate_client_create(spectate *sp, const char *addr, int port, int relay_port) {
+    spectate_init(sp, SPECTATE_CLIENT);
+    sp->upstream = enet_host_create(NULL, 1, 1, 0, 0);
+    if(sp->upstream == NULL) {
+        PERROR("Could not create spectator client.");
+        spectate_free(sp);
+        return 1;
+    }
+    ENetAddress address;
+    enet_address_set_host(&address, addr);
+    address.port = port;
+    sp->upstream_peer = enet_host_connect(sp->upstream, &address, 1, 0);
+    if(sp->upstream_peer == NULL) {
+        PERROR("Unable to connect to %s for spectating.", addr);
+        spectate_free(sp);
+        return 1;
+    }
+    // Relaying is optional; spectating works without it
+    if(relay_port > 0) {
+        sp->host = spectate_listen(relay_port);
+    }
+    return 0;
+}
+
+static int spectate_free_entry(void *item, void *userdata) {
+    serial_free(item);
+    return 1;
+}
+
+void spectate_free(spectate *sp) {
+    if(sp->host != NULL) {
+        enet_host_destroy(sp->host);
+        sp->host = NULL;
+    }
+    if(sp->upstream != NULL) {
+        enet_host_destroy(sp->upstream);
+        sp->upstream = NULL;
+    }
+    vector_remove_if(&sp->backlog, spectate_free_entry, NULL);
+    vector_free(&sp->backlog);
+    serial_free(&sp->batch);
+    serial_free(&sp->full);
+    serial_free(&sp->keyframe);
+}
+
+// Drops backlog packets of the types whose bit is set in the mask
+static int spectate_drop_entry(void *item, void *userdata) {
+    serial *entry = item;
+    int mask = *(int*)userdata;
+    if(mask & (1 << entry->data[0])) {
+        serial_free(entry);
+        return 1;
+    }
+    return 0;
+}
+
+// Sends a packet to everyone downstream and keeps it for late joiners
+static void spectate_push(spectate *sp, const char *data, size_t len) {
+    if(sp->host == NULL || len == 0) {
+        return;
+    }
+    int drop = 0;
+    switch(data[0]) {
+        case SPECTATE_PACKET_MATCH:
+            drop = ~0;
+            break;
+        case SPECTATE_PACKET_FULL:
+            drop = ~(1 << SPECTATE_PACKET_MATCH);
+            break;
+        case SPECTATE_PACKET_DELTA:
+            drop = (1 << SPECTATE_PACKET_DELTA) | (1 << SPECTATE_PACKET_INPUTS);
+            break;
+    }
+    if(drop != 0) {
+        vector_remove_if(&sp->backlog, spectate_drop_entry, &drop);
+    }
+    serial entry;
+    serial_create_size(&entry, len);
+    serial_write(&entry, data, len);
+    vector_append(&sp->backlog, &entry);
+
+    ENetPacket *packet = enet_packet_create(data, len, ENET_PACKET_FLAG_RELIABLE);
+    enet_host_broadcast(sp->host, 0, packet);
+}
+
+static void spectate_send_backlog(spectate *sp, ENetPeer *peer) {
+    iterator it;
+    serial *entry;
+    vector_iter_begin(&sp->backlog, &it);
+    while((entry = iter_next(&it)) != NULL) {
+        enet_peer_send(peer, 0, enet_packet_create(entry->data, entry->len, ENET_PACKET_FLAG_RELIABLE));
+    }
+}
+
+static void spectate_read_inputs(spectate *sp, serial *ser) {
+    int tick = serial_read_int32(ser);
+    int count = (uint8_t)serial_read_int8(ser);
+    for(int i = 0; i < count; i++, tick++) {
+        spectate_tick *t = &sp->ticks[tick % SPECTATE_TICK_BUFFER];
+        t->tick = tick;
+        for(int p = 0; p < 2; p++) {
+            t->delay[p] = serial_read_int8(ser);
+            t->count[p] = serial_read_int8(ser);
+            for(int k = 0; k < t->count[p]; k++) {
+                int action = serial_read_int16(ser);
+                if(k < ROLLBACK_MAX_ACTIONS) {
+                    t->actions[p][k] = action;
+                }
+            }
+            if(t->count[p] > ROLLBACK_MAX_ACTIONS) {
+                t->count[p] = ROLLBACK_MAX_ACTIONS;
+            }
+        }
+    }
+}
+
+static void spectate_receive(spectate *sp, const char *data, size_t len) {
+    serial ser;
+    serial_create_view(&ser, data, len);
+    switch(serial_read_int8(&ser)) {
+        case SPECTATE_PACKET_MATCH:
+            sp->match.seq++;
+            sp->match.scene_id = serial_read_int8(&ser);
+            sp->match.speed = serial_read_int8(&ser);
+            for(int i = 0; i < 2; i++) {
+                sp->match.har_id[i] = serial_read_int8(&ser);
+                sp->match.pilot_id[i] = serial_read_int8(&ser);
+                serial_read(&ser, sp->match.colors[i], 3);
+            }
+            for(int i = 0; i < SPECTATE_TICK_BUFFER; i++) {
+                sp->ticks[i].tick = -1;
+            }
+            sp->full_tick = -1;
+            sp->keyframe_pending = 0;
+            sp->ended = 0;
+            DEBUG("Spectating match %d in scene %d", sp->match.seq, sp->match.scene_id);
+            break;
+        case SPECTATE_PACKET_FULL:
+            sp->full_tick = serial_read_int32(&ser);
+            serial_clear(&sp->full);
+            serial_write(&sp->full, data + ser.rpos, len - ser.rpos);
+            serial_clear(&sp->keyframe);
+            serial_write(&sp->keyframe, data + ser.rpos, len - ser.rpos);
+            sp->keyframe_tick = sp->full_tick;
+            sp->keyframe_pending = 1;
+            break;
+        case SPECTATE_PACKET_DELTA:
+            {
+                int tick = serial_read_int32(&ser);
+                int base_tick = serial_read_int32(&ser);
+                const char *payload = data + ser.rpos;
+                size_t payload_len = len - ser.rpos;
+                long decoded_len = delta_decoded_len(payload, payload_len);
+                if(base_tick != sp->full_tick || decoded_len < 0) {
+                    DEBUG("Dropping spectator delta against unknown keyframe %d", base_tick);
+                    break;
+                }
+                serial_clear(&sp->keyframe);
+                serial_reserve(&sp->keyframe, decoded_len);
+                if(delta_decode(sp->full.data, sp->full.len, payload, payload_len, sp->keyframe.data, decoded_len) < 0) {
+                    DEBUG("Dropping malformed spectator delta");
+                    break;
+                }
+                sp->keyframe.len = decoded_len;
+                sp->keyframe_tick = tick;
+                sp->keyframe_pending = 1;
+            }
+            break;
+        case SPECTATE_PACKET_INPUTS:
+            spectate_read_inputs(sp, &ser);
+            break;
+        case SPECTATE_PACKET_END:
+            sp->ended = 1;
+            break;
+    }
+}
+
+/*
+ * Accepts downstream spectators and, on the spectator side, takes in the
+ * broadcast. Returns 1 if the connection to the host was lost.
+ */
+int spectate_service(spectate *sp) {
+    ENetEvent event;
+    while(sp->host != NULL && enet_host_service(sp->host, &event, 0) > 0) {
+        if(event.type == ENET_EVENT_TYPE_CONNECT) {
+            DEBUG("Spectator connected");
+            spectate_send_backlog(sp, event.peer);
+        } else if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+            // Spectators have nothing to say
+            enet_packet_destroy(event.packet);
+        }
+    }
+    while(sp->upstream != NULL && enet_host_service(sp->upstream, &event, 0) > 0) {
+        switch(event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                sp->connected = 1;
+                break;
+            case ENET_EVENT_TYPE_RECEIVE:
+                spectate_receive(sp, (const char*)event.packet->data, event.packet->dataLength);
+                spectate_push(sp, (const char*)event.packet->data, event.packet->dataLength);
+                enet_packet_destroy(event.packet);
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                DEBUG("Spectated host went away");
+                sp->connected = 0;
+                return 1;
+            default:
+                break;
+        }
+    }
+    if(sp->host != NULL) {
+        enet_host_flush(sp->host);
+    }
+    return 0;
+}
+
+void spectate_host_match(spectate *sp, const spectate_match *match) {
+    serial ser;
+    serial_create(&ser);
+    serial_write_int8(&ser, SPECTATE_PACKET_MATCH);
+    serial_write_int8(&ser, match->scene_id);
+    serial_write_int8(&ser, match->speed);
+    for(int i = 0; i < 2; i++) {
+        serial_write_int8(&ser, match->har_id[i]);
+        serial_write_int8(&ser, match->pilot_id[i]);
+        serial_write(&ser, match->colors[i], 3);
+    }
+    spectate_push(sp, ser.data, ser.len);
+    serial_free(&ser);
+
+    serial_clear(&sp->batch);
+    sp->batch_count = 0;
+    sp->full_tick = -1;
+    sp->delta_tick = -1;
+}
+
+static void spectate_flush_batch(spectate *sp) {
+    if(sp->batch_count > 0) {
+        // The tick count goes in right after the first tick
+        sp->batch.data[5] = sp->batch_count;
+        spectate_push(sp, sp->batch.data, sp->batch.len);
+    }
+    serial_clear(&sp->batch);
+    sp->batch_count = 0;
+}
+
+static void spectate_send_keyframe(spectate *sp, const game_snapshot *snap) {
+    const serial *state = &snap->state;
+    serial ser;
+    if(sp->full_tick < 0 || snap->tick - sp->full_tick >= SPECTATE_FULL_INTERVAL) {
+        serial_create_size(&ser, 5 + state->len);
+        serial_write_int8(&ser, SPECTATE_PACKET_FULL);
+        serial_write_int32(&ser, snap->tick);
+        serial_write(&ser, state->data, state->len);
+        serial_clear(&sp->full);
+        serial_write(&sp->full, state->data, state->len);
+        sp->full_tick = snap->tick;
+    } else {
+        serial_create_size(&ser, 9 + delta_max_size(state->len));
+        serial_write_int8(&ser, SPECTATE_PACKET_DELTA);
+        serial_write_int32(&ser, snap->tick);
+        serial_write_int32(&ser, sp->full_tick);
+        ser.len += delta_encode(sp->full.data, sp->full.len, state->data, state->len, ser.data + ser.len);
+    }
+    sp->delta_tick = snap->tick;
+    spectate_push(sp, ser.data, ser.len);
+    serial_free(&ser);
+}
+
+// Takes in a tick that has dropped out of the rollback window
+void spectate_host_settle(spectate *sp, const game_snapshot *snap) {
+    if(sp->delta_tick < 0 || snap->tick - sp->delta_tick >= SPECTATE_DELTA_INTERVAL) {
+        // Spectators restore the keyframe before applying the inputs of its tick
+        spectate_flush_batch(sp);
+        spectate_send_keyframe(sp, snap);
+    }
+    if(sp->batch_count == 0) {
+        serial_write_int8(&sp->batch, SPECTATE_PACKET_INPUTS);
+        serial_write_int32(&sp->batch, snap->tick);
+        serial_write_int8(&sp->batch, 0);
+    }
+    for(int p = 0; p < 2; p++) {
+        serial_write_int8(&sp->batch, snap->delays[p]);
+        serial_write_int8(&sp->batch, snap->action_count[p]);
+        for(int k = 0; k < snap->action_count[p]; k++) {
+            serial_write_int16(&sp->batch, snap->actions[p][k]);
+        }
+    }
+    sp->batch_count++;
+    if(sp->batch_count >= SPECTATE_BATCH_TICKS) {
+        spectate_flush_batch(sp);
+    }
+}
+
+void spectate_host_end(spectate *sp) {
+    spectate_flush_batch(sp);
+    char end = SPECTATE_PACKET_END;
+    spectate_push(sp, &end, 1);
+    enet_host_flush(sp->host);
+}
+
+int spectate_is_connected(const spectate *sp) {
+    return sp->connected;
+}
+
+const spectate_match* spectate_get_match(const spectate *sp) {
+    return sp->match.seq > 0 ? &sp->match : NULL;
+}
+
+const spectate_tick* spectate_get_tick(const spectate *sp, unsigned int tick) {
+    const spectate_tick *t = &sp->ticks[tick % SPECTATE_TICK_BUFFER];
+    return (t->tick == (int)tick) ? t : NULL;
+}
+
+/*
+ * Returns the keyframe to restore before simulating the given tick, or
+ * NULL to carry on. Keyframes are restored at their own tick to undo any
+ * drift, or straight away when the inputs for the current tick are gone.
+ */
+serial* spectate_take_keyframe(spectate *sp, unsigned int tick) {
+    if(!sp->keyframe_pending) {
+        return NULL;
+    }
+    unsigned int kf_tick = sp->keyframe_tick;
+    if(kf_tick == tick
+            || (kf_tick > tick && spectate_get_tick(sp, tick) == NULL)
+            || kf_tick > tick + SPECTATE_MAX_LAG) {
+        sp->keyframe_pending = 0;
+        serial_read_reset(&sp->keyframe);
+        return &sp->keyframe;
+    }
+    if(kf_tick < tick && spectate_get_tick(sp, tick) != NULL) {
+        // Already past it, and the inputs carry on from here
+        sp->keyframe_pending = 0;
+    }
+    return NULL;
+}
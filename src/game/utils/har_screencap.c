@@ -13,6 +13,7 @@ void har_screencaps_create(har_screencaps *caps) {
 
 void har_screencaps_free(har_screencaps *caps) {
     for(int i = 0; i < 2; i++) {
+        video_area_capture_cancel(&caps->cap[i]);
         if(caps->ok[i]) {
             surface_free(&caps->cap[i]);
             caps->ok[i] = 0;
@@ -24,7 +25,9 @@ void har_screencaps_reset(har_screencaps *caps) {
     har_screencaps_free(caps);
 }
 
+// The pixels are read after the next frame has been presented
 void har_screencaps_capture(har_screencaps *caps, object *obj, int id) {
+    video_area_capture_cancel(&caps->cap[id]);
     if(caps->ok[id]) {
         surface_free(&caps->cap[id]);
         caps->ok[id] = 0;
@@ -39,8 +42,5 @@ void har_screencaps_capture(har_screencaps *caps, object *obj, int id) {
     if(y + SCREENCAP_H >= NATIVE_H) y = NATIVE_H - SCREENCAP_H;
 
     // Capture
-    int ret = video_area_capture(&caps->cap[id], x, y, SCREENCAP_W, SCREENCAP_H);
-    if(ret == 0) {
-        caps->ok[id] = 1;
-    }
+    video_area_capture(&caps->cap[id], &caps->ok[id], x, y, SCREENCAP_W, SCREENCAP_H);
 }
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "game/utils/hash_log.h"
+#include "game/utils/serial.h"
+#include "game/game_state.h"
+#include "utils/log.h"
+
+struct hash_log_t {
+    FILE *fp;
+    char path[512];
+    int mode;
+    unsigned int dump_tick;
+    unsigned int last_tick; // Tick of the last recorded hash, to skip paused ticks
+    int started;
+    int diverged;
+    unsigned int checked;
+};
+
+hash_log* hash_log_open(const char *path, int mode, unsigned int dump_tick) {
+    FILE *fp = NULL;
+    if(mode != HASH_LOG_DUMP) {
+        fp = fopen(path, (mode == HASH_LOG_WRITE) ? "w" : "r");
+        if(fp == NULL) {
+            PERROR("Could not open hash log %s.", path);
+            return NULL;
+        }
+    }
+    hash_log *log = malloc(sizeof(hash_log));
+    memset(log, 0, sizeof(hash_log));
+    log->fp = fp;
+    log->mode = mode;
+    log->dump_tick = dump_tick;
+    snprintf(log->path, sizeof(log->path), "%s", path);
+
+    // A desync marker from an earlier check would be misleading
+    if(mode == HASH_LOG_CHECK) {
+        char out[540];
+        snprintf(out, sizeof(out), "%s.diverged", path);
+        remove(out);
+    }
+    return log;
+}
+
+static void hash_log_dump(const char *path, game_state *gs) {
+    serial ser;
+    serial_create_size(&ser, GAME_STATE_SERIAL_SIZE_HINT);
+    game_state_serialize(gs, &ser);
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL || fwrite(ser.data, 1, ser.len, fp) != ser.len) {
+        PERROR("Could not write state to %s.", path);
+    } else {
+        INFO("Wrote state of tick %u to %s.", game_state_get_tick(gs), path);
+    }
+    if(fp != NULL) {
+        fclose(fp);
+    }
+    serial_free(&ser);
+}
+
+int hash_log_tick(hash_log *log, game_state *gs) {
+    unsigned int tick = game_state_get_tick(gs);
+    uint32_t hash;
+    if(log->diverged || (log->started && tick == log->last_tick)) {
+        return log->diverged;
+    }
+    if(game_state_hash(gs, &hash)) {
+        return 0; // Not fighting, nothing to compare
+    }
+    log->started = 1;
+    log->last_tick = tick;
+
+    switch(log->mode) {
+        case HASH_LOG_WRITE:
+            fprintf(log->fp, "%u %08x\n", tick, hash);
+            return 0;
+        case HASH_LOG_DUMP:
+            if(tick == log->dump_tick) {
+                hash_log_dump(log->path, gs);
+                log->diverged = 1;
+            }
+            return log->diverged;
+        default:
+            break;
+    }
+
+    unsigned int want_tick;
+    uint32_t want_hash;
+    if(fscanf(log->fp, "%u %x", &want_tick, &want_hash) != 2) {
+        PERROR("Hash log %s ends before tick %u.", log->path, tick);
+        log->diverged = 1;
+    } else if(want_tick != tick || want_hash != hash) {
+        PERROR("Desync at tick %u: hash %08x, expected %08x at tick %u.", tick, hash, want_hash, want_tick);
+        log->diverged = 1;
+    } else {
+        log->checked++;
+        return 0;
+    }
+
+    // Leave the state and the tick behind for a look with the golden build
+    char out[540];
+    snprintf(out, sizeof(out), "%s.%u.new.state", log->path, tick);
+    hash_log_dump(out, gs);
+    snprintf(out, sizeof(out), "%s.diverged", log->path);
+    FILE *fp = fopen(out, "w");
+    if(fp != NULL) {
+        fprintf(fp, "%u\n", tick);
+        fclose(fp);
+    }
+    return 1;
+}
+
+int hash_log_close(hash_log *log) {
+    int failed = log->diverged && log->mode == HASH_LOG_CHECK;
+    if(log->mode == HASH_LOG_CHECK && !failed) {
+        unsigned int tick;
+        uint32_t hash;
+        if(fscanf(log->fp, "%u %x", &tick, &hash) == 2) {
+            PERROR("Replay ended at tick %u, hash log %s goes on to tick %u.", log->last_tick, log->path, tick);
+            failed = 1;
+        } else {
+            INFO("Checked %u tick hashes against %s.", log->checked, log->path);
+        }
+    }
+    if(log->mode == HASH_LOG_DUMP && !log->diverged) {
+        PERROR("Replay never reached tick %u, no state written.", log->dump_tick);
+        failed = 1;
+    }
+    if(log->fp != NULL) {
+        fclose(log->fp);
+    }
+    free(log);
+    return failed;
+}
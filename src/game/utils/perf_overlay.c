@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include "game/utils/perf_overlay.h"
+#include "game/utils/scene_stats.h"
+#include "game/gui/text_render.h"
+#include "game/game_state.h"
+#include "game/game_player.h"
+#include "controller/net_controller.h"
+#include "resources/fonts.h"
+#include "video/surface.h"
+#include "video/video.h"
+#include "video/tcache.h"
+#include "utils/latency_probe.h"
+#include "utils/profiler.h"
+#include "utils/memtrack.h"
+#include "audio/audio_stats.h"
+
+#define GRAPH_W 128
+#define GRAPH_H 32
+#define GRAPH_MAX_MS 50.0f
+#define GRAPH_BUDGET_MS (1000.0f / 60.0f)
+
+#define MARKER_SIZE 16
+
+static surface graph;
+static surface marker;
+static int visible = 0;
+
+void perf_overlay_init() {
+    surface_create(&graph, SURFACE_TYPE_RGBA, GRAPH_W, GRAPH_H);
+    surface_create(&marker, SURFACE_TYPE_RGBA, MARKER_SIZE, MARKER_SIZE);
+    surface_fill(&marker, COLOR_WHITE);
+    visible = 0;
+}
+
+void perf_overlay_close() {
+    surface_free(&graph);
+    surface_free(&marker);
+}
+
+void perf_overlay_toggle() {
+    visible = !visible;
+}
+
+int perf_overlay_is_visible() {
+    return visible;
+}
+
+static void graph_set(int x, int y, color c) {
+    char *px = graph.data + (y * GRAPH_W + x) * 4;
+    px[0] = c.r;
+    px[1] = c.g;
+    px[2] = c.b;
+    px[3] = c.a;
+}
+
+// Newest frame on the right. Frames over budget are drawn in red.
+static void perf_overlay_update_graph() {
+    surface_fill(&graph, color_create(0, 0, 0, 160));
+    int budget_y = GRAPH_H - 1 - (int)(GRAPH_BUDGET_MS / GRAPH_MAX_MS * GRAPH_H);
+    for(int x = 0; x < GRAPH_W; x++) {
+        graph_set(x, budget_y, color_create(80, 80, 80, 255));
+    }
+    for(int i = 0; i < GRAPH_W && i < profiler_frame_count(); i++) {
+        float ms = profiler_get_ms(PROF_FRAME, i);
+        int h = (int)(ms / GRAPH_MAX_MS * GRAPH_H);
+        if(h > GRAPH_H) {
+            h = GRAPH_H;
+        }
+        color c = (ms > GRAPH_BUDGET_MS) ? color_create(255, 60, 60, 255) : color_create(60, 255, 60, 255);
+        for(int y = GRAPH_H - h; y < GRAPH_H; y++) {
+            graph_set(GRAPH_W - 1 - i, y, c);
+        }
+    }
+    surface_force_refresh(&graph);
+}
+
+void perf_overlay_render(game_state *gs) {
+    // For a photodiode, so it is drawn whether the overlay is shown or not
+    if(latency_probe_marker_due()) {
+        video_render_sprite(&marker, NATIVE_W - MARKER_SIZE, 0, BLEND_ALPHA, 0);
+    }
+    if(!visible) {
+        return;
+    }
+    char buf[64];
+    int y = 2;
+    for(int i = 0; i < PROF_COUNT; i++) {
+        snprintf(buf, sizeof(buf), "%-12s %5.2f p99 %5.2f",
+                 profiler_phase_name(i),
+                 profiler_get_ms(i, 0),
+                 profiler_percentile(i, 99.0f));
+        font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+        y += font_small.h + 1;
+    }
+
+    snprintf(buf, sizeof(buf), "ticks %u dropped %u skipped %u",
+             profiler_get_count(PROF_CNT_DYNAMIC_TICKS),
+             profiler_get_count(PROF_CNT_DROPPED_TICKS),
+             profiler_get_count(PROF_CNT_SKIPPED_FRAMES));
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+
+    audio_stats astats;
+    audio_stats_get(&astats);
+    snprintf(buf, sizeof(buf), "audio q %d min %d under %u dec %.2f lat %.1f",
+             astats.depth, astats.depth_min, astats.underruns, astats.decode_ms, astats.latency_ms);
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+
+    tcache_stats stats;
+    tcache_get_stats(&stats);
+    unsigned int lookups = stats.hits + stats.misses;
+    snprintf(buf, sizeof(buf), "tcache %u hit %u miss %u warm %u%% %u kB %u ent",
+             stats.hits, stats.misses, stats.warmed,
+             lookups ? stats.hits * 100 / lookups : 100, stats.bytes_used / 1024, stats.entries);
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+
+    scene_stat objs, proj, scrap, haz, spawns, frees, pal, voices;
+    scene_stats_get(SCENE_STAT_OBJECTS, &objs);
+    scene_stats_get(SCENE_STAT_PROJECTILES, &proj);
+    scene_stats_get(SCENE_STAT_SCRAP, &scrap);
+    scene_stats_get(SCENE_STAT_HAZARDS, &haz);
+    scene_stats_get(SCENE_STAT_SPAWNS, &spawns);
+    scene_stats_get(SCENE_STAT_FREES, &frees);
+    scene_stats_get(SCENE_STAT_PALETTE_BUMPS, &pal);
+    scene_stats_get(SCENE_STAT_VOICES, &voices);
+    snprintf(buf, sizeof(buf), "obj %u/%u proj %u scrap %u haz %u +%u -%u/s",
+             objs.last, objs.max, proj.last, scrap.last, haz.last, spawns.last, frees.last);
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+    snprintf(buf, sizeof(buf), "pal %u/s voices %u/%u", pal.last, voices.last, voices.max);
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+
+    if(latency_probe_is_enabled()) {
+        latency_stats lat;
+        latency_probe_get(&lat);
+        snprintf(buf, sizeof(buf), "input %u p50 %d p99 %d = %d+%d+%d+%d",
+                 lat.samples,
+                 latency_probe_percentile(&lat, LATENCY_SPAN_TOTAL, 50.0f),
+                 latency_probe_percentile(&lat, LATENCY_SPAN_TOTAL, 99.0f),
+                 latency_probe_percentile(&lat, LATENCY_SPAN_CMD, 50.0f),
+                 latency_probe_percentile(&lat, LATENCY_SPAN_ACT, 50.0f),
+                 latency_probe_percentile(&lat, LATENCY_SPAN_RENDER, 50.0f),
+                 latency_probe_percentile(&lat, LATENCY_SPAN_PRESENT, 50.0f));
+        font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+        y += font_small.h + 1;
+    }
+
+    mem_stats mstats, vstats;
+    mem_get_total(&mstats);
+    mem_get_stats(MEM_TAG_VIDEO, &vstats);
+    snprintf(buf, sizeof(buf), "mem %u kB peak %u kB video %u kB",
+             (unsigned int)(mstats.live / 1024), (unsigned int)(mstats.peak / 1024),
+             (unsigned int)(vstats.live / 1024));
+    font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    y += font_small.h + 1;
+
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(gs, i));
+        if(ctrl == NULL || ctrl->type != CTRL_TYPE_NETWORK) {
+            continue;
+        }
+        const net_stats *net = net_controller_get_stats(ctrl);
+        snprintf(buf, sizeof(buf), "net %.0f+-%.0f ms %2.0f%% adv %d dly %d",
+                 net->rtt_ms, net->jitter_ms, net->loss * 100.0f, net->frame_advantage, net->input_delay);
+        font_render_shadowed(&font_small, buf, 2, y, COLOR_WHITE, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+        y += font_small.h + 1;
+    }
+    y += 1;
+
+    perf_overlay_update_graph();
+    video_render_sprite(&graph, 2, y, BLEND_ALPHA, 0);
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "game/utils/rec_index.h"
+#include "utils/log.h"
+
+#define REC_INDEX_MAGIC 0x4B464D4F // "OMFK"
+#define REC_INDEX_VERSION 2 // Keyframes are serialized states, see GAME_STATE_SERIAL_VERSION
+
+static void rec_index_path(char *out, size_t len, const char *rec_file) {
+    snprintf(out, len, "%s.idx", rec_file);
+}
+
+void rec_index_create(rec_index *idx) {
+    vector_create(&idx->frames, sizeof(rec_keyframe));
+}
+
+void rec_index_free(rec_index *idx) {
+    iterator it;
+    rec_keyframe *kf;
+    vector_iter_begin(&idx->frames, &it);
+    while((kf = iter_next(&it)) != NULL) {
+        free(kf->data);
+    }
+    vector_free(&idx->frames);
+}
+
+void rec_index_add(rec_index *idx, unsigned int tick, const serial *state) {
+    // Ticks only go forwards while recording, except after a rollback
+    rec_keyframe *last = vector_get(&idx->frames, vector_size(&idx->frames) - 1);
+    if(last != NULL && last->tick >= tick) {
+        return;
+    }
+    rec_keyframe kf;
+    kf.tick = tick;
+    kf.len = state->len;
+    kf.data = malloc(state->len);
+    memcpy(kf.data, state->data, state->len);
+    vector_append(&idx->frames, &kf);
+}
+
+// Returns the last keyframe at or before tick, or NULL if there is none
+const rec_keyframe* rec_index_find(const rec_index *idx, unsigned int tick) {
+    int lo = 0;
+    int hi = (int)vector_size(&idx->frames) - 1;
+    const rec_keyframe *found = NULL;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const rec_keyframe *kf = vector_get(&idx->frames, mid);
+        if(kf->tick <= tick) {
+            found = kf;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static int write_u32(FILE *fp, uint32_t v) {
+    return fwrite(&v, sizeof(v), 1, fp) != 1;
+}
+
+static int read_u32(FILE *fp, uint32_t *v) {
+    return fread(v, sizeof(*v), 1, fp) != 1;
+}
+
+int rec_index_save(const rec_index *idx, const char *rec_file) {
+    char path[512];
+    rec_index_path(path, sizeof(path), rec_file);
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        PERROR("Could not open %s for writing.", path);
+        return 1;
+    }
+    int err = write_u32(fp, REC_INDEX_MAGIC);
+    err |= write_u32(fp, REC_INDEX_VERSION);
+    err |= write_u32(fp, vector_size(&idx->frames));
+    iterator it;
+    rec_keyframe *kf;
+    vector_iter_begin(&idx->frames, &it);
+    while(!err && (kf = iter_next(&it)) != NULL) {
+        err |= write_u32(fp, kf->tick);
+        err |= write_u32(fp, kf->len);
+        err |= fwrite(kf->data, 1, kf->len, fp) != kf->len;
+    }
+    fclose(fp);
+    if(err) {
+        PERROR("Could not write recording index %s.", path);
+    }
+    return err;
+}
+
+int rec_index_load(rec_index *idx, const char *rec_file) {
+    char path[512];
+    rec_index_path(path, sizeof(path), rec_file);
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return 1;
+    }
+    uint32_t magic, version, count;
+    if(read_u32(fp, &magic) || read_u32(fp, &version) || read_u32(fp, &count)
+            || magic != REC_INDEX_MAGIC || version != REC_INDEX_VERSION) {
+        PERROR("Recording index %s is not valid.", path);
+        fclose(fp);
+        return 1;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t tick, len;
+        if(read_u32(fp, &tick) || read_u32(fp, &len)) {
+            goto error_0;
+        }
+        rec_keyframe kf;
+        kf.tick = tick;
+        kf.len = len;
+        kf.data = malloc(len > 0 ? len : 1);
+        if(fread(kf.data, 1, len, fp) != len) {
+            free(kf.data);
+            goto error_0;
+        }
+        vector_append(&idx->frames, &kf);
+    }
+    fclose(fp);
+    DEBUG("Loaded %u keyframes from %s", count, path);
+    return 0;
+
+error_0:
+    PERROR("Recording index %s is truncated.", path);
+    fclose(fp);
+    return 1;
+}
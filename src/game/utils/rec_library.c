@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <shadowdive/shadowdive.h>
+#include "game/utils/rec_library.h"
+#include "game/common_defines.h"
+#include "utils/list.h"
+#include "utils/log.h"
+#include "utils/scandir.h"
+
+#define REC_LIBRARY_MAGIC 0x4C464D4F // "OMFL"
+#define REC_LIBRARY_VERSION 1 // Entries are rec_library_entry as is
+
+static int write_u32(FILE *fp, uint32_t v) {
+    return fwrite(&v, sizeof(v), 1, fp) != 1;
+}
+
+static int read_u32(FILE *fp, uint32_t *v) {
+    return fread(v, sizeof(*v), 1, fp) != 1;
+}
+
+static void rec_library_path(const rec_library *lib, char *out, size_t len) {
+    snprintf(out, len, "%s/%s", lib->dir, REC_LIBRARY_FILE);
+}
+
+static int rec_library_cmp(const void *a, const void *b) {
+    return strcmp(((const rec_library_entry*)a)->name, ((const rec_library_entry*)b)->name);
+}
+
+static int is_rec_file(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".rec") == 0;
+}
+
+// Entries are sorted by name
+static rec_library_entry* rec_library_find(const rec_library *lib, const char *name) {
+    int lo = 0;
+    int hi = (int)vector_size(&lib->entries) - 1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        rec_library_entry *e = vector_get(&lib->entries, mid);
+        int c = strcmp(e->name, name);
+        if(c < 0) {
+            lo = mid + 1;
+        } else if(c > 0) {
+            hi = mid - 1;
+        } else {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void rec_library_open(rec_library *lib, const char *dir) {
+    snprintf(lib->dir, sizeof(lib->dir), "%s", dir);
+    vector_create(&lib->entries, sizeof(rec_library_entry));
+
+    char path[600];
+    rec_library_path(lib, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return;
+    }
+    uint32_t magic, version, count;
+    if(read_u32(fp, &magic) || read_u32(fp, &version) || read_u32(fp, &count)
+            || magic != REC_LIBRARY_MAGIC || version != REC_LIBRARY_VERSION) {
+        PERROR("Recording library %s is not valid, reading all recordings again.", path);
+        fclose(fp);
+        return;
+    }
+    rec_library_entry e;
+    for(uint32_t i = 0; i < count; i++) {
+        if(fread(&e, sizeof(e), 1, fp) != 1) {
+            PERROR("Recording library %s is truncated.", path);
+            break;
+        }
+        e.name[sizeof(e.name) - 1] = 0;
+        e.pilots[0].name[sizeof(e.pilots[0].name) - 1] = 0;
+        e.pilots[1].name[sizeof(e.pilots[1].name) - 1] = 0;
+        vector_append(&lib->entries, &e);
+    }
+    fclose(fp);
+    vector_sort(&lib->entries, rec_library_cmp);
+}
+
+void rec_library_free(rec_library *lib) {
+    vector_free(&lib->entries);
+}
+
+// Reads what the index keeps of a recording
+static int rec_library_read(rec_library_entry *e, const char *path) {
+    sd_rec_file rec;
+    sd_rec_create(&rec);
+    if(sd_rec_load(&rec, path) != SD_SUCCESS) {
+        sd_rec_free(&rec);
+        return 1;
+    }
+    for(int i = 0; i < 2; i++) {
+        memset(e->pilots[i].name, 0, sizeof(e->pilots[i].name));
+        memcpy(e->pilots[i].name, rec.pilots[i].info.name, 18);
+        e->pilots[i].har_id = rec.pilots[i].info.har_id;
+        e->pilots[i].pilot_id = rec.pilots[i].info.pilot_id;
+    }
+    e->move_count = rec.move_count;
+    e->ticks = (rec.move_count > 0) ? rec.moves[rec.move_count - 1].tick : 0;
+    sd_rec_free(&rec);
+    return 0;
+}
+
+int rec_library_update(rec_library *lib) {
+    list files;
+    list_create(&files);
+    if(scan_directory(&files, lib->dir)) {
+        list_free(&files);
+        return -1;
+    }
+
+    vector fresh;
+    vector_create(&fresh, sizeof(rec_library_entry));
+    int loaded = 0;
+    char path[800];
+    iterator it;
+    char *name;
+    list_iter_begin(&files, &it);
+    while((name = iter_next(&it)) != NULL) {
+        if(!is_rec_file(name) || strlen(name) >= REC_LIBRARY_NAME_MAX) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", lib->dir, name);
+        struct stat st;
+        if(stat(path, &st) != 0) {
+            continue;
+        }
+
+        // Unchanged recordings keep what was read of them before
+        rec_library_entry *old = rec_library_find(lib, name);
+        if(old != NULL && old->mtime == (int64_t)st.st_mtime && old->size == (uint32_t)st.st_size) {
+            vector_append(&fresh, old);
+            continue;
+        }
+        rec_library_entry e;
+        memset(&e, 0, sizeof(e));
+        strcpy(e.name, name);
+        e.mtime = st.st_mtime;
+        e.size = st.st_size;
+        if(rec_library_read(&e, path)) {
+            DEBUG("Skipping %s, it is not a valid recording.", path);
+            e.invalid = 1;
+        }
+        vector_append(&fresh, &e);
+        loaded++;
+    }
+    list_free(&files);
+
+    vector_sort(&fresh, rec_library_cmp);
+    vector_free(&lib->entries);
+    lib->entries = fresh;
+    return loaded;
+}
+
+int rec_library_save(const rec_library *lib) {
+    char path[600];
+    rec_library_path(lib, path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        PERROR("Could not open %s for writing.", path);
+        return 1;
+    }
+    int err = write_u32(fp, REC_LIBRARY_MAGIC);
+    err |= write_u32(fp, REC_LIBRARY_VERSION);
+    err |= write_u32(fp, vector_size(&lib->entries));
+    iterator it;
+    rec_library_entry *e;
+    vector_iter_begin(&lib->entries, &it);
+    while(!err && (e = iter_next(&it)) != NULL) {
+        err |= fwrite(e, sizeof(rec_library_entry), 1, fp) != 1;
+    }
+    err |= fclose(fp) != 0;
+    if(err) {
+        PERROR("Could not write recording library %s.", path);
+    }
+    return err;
+}
+
+void rec_library_query_init(rec_library_query *q) {
+    q->har_id = -1;
+    q->pilot_id = -1;
+    q->pilot_name = NULL;
+}
+
+// Number, or a name from names, or -1
+static int rec_library_lookup(const char *value, const char* (*get_name)(unsigned int), int count) {
+    char *end;
+    long n = strtol(value, &end, 10);
+    if(*value != 0 && *end == 0) {
+        return (n >= 0 && n < count) ? (int)n : -1;
+    }
+    for(int i = 0; i < count; i++) {
+        if(strcasecmp(get_name(i), value) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int rec_library_query_parse(rec_library_query *q, const char *arg) {
+    if(strncmp(arg, "har=", 4) == 0) {
+        q->har_id = rec_library_lookup(arg + 4, har_get_name, NUMBER_OF_HAR_TYPES);
+        // Nothing matches an unknown HAR
+        if(q->har_id < 0) {
+            q->har_id = NUMBER_OF_HAR_TYPES;
+        }
+        return 0;
+    }
+    if(strncmp(arg, "pilot=", 6) == 0) {
+        q->pilot_id = rec_library_lookup(arg + 6, pilot_get_name, NUMBER_OF_PILOT_TYPES);
+        if(q->pilot_id < 0) {
+            // Could be a name that only the recording has
+            q->pilot_name = arg + 6;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int rec_library_pilot_match(const rec_library_pilot *p, const rec_library_query *q) {
+    if(q->har_id >= 0 && p->har_id != q->har_id) {
+        return 0;
+    }
+    if(q->pilot_id >= 0 && p->pilot_id != q->pilot_id) {
+        return 0;
+    }
+    if(q->pilot_name != NULL && strcasecmp(p->name, q->pilot_name) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
+// The filters must all hold for the same side
+int rec_library_match(const rec_library_entry *e, const rec_library_query *q) {
+    if(e->invalid) {
+        return 0;
+    }
+    return rec_library_pilot_match(&e->pilots[0], q) || rec_library_pilot_match(&e->pilots[1], q);
+}
+
+void rec_library_describe(const rec_library_entry *e, char *buf, size_t len) {
+    const char *har[2];
+    for(int i = 0; i < 2; i++) {
+        har[i] = har_get_name(e->pilots[i].har_id);
+        if(har[i] == NULL) {
+            har[i] = "?";
+        }
+    }
+    snprintf(buf, len, "%s: %s (%s) vs %s (%s), %u ticks",
+             e->name,
+             e->pilots[0].name, har[0],
+             e->pilots[1].name, har[1],
+             e->ticks);
+}
+
+int rec_library_refresh(rec_library *lib, const char *dir) {
+    rec_library_open(lib, dir);
+    unsigned int known = vector_size(&lib->entries);
+    int loaded = rec_library_update(lib);
+    if(loaded > 0 || (loaded == 0 && vector_size(&lib->entries) != known)) {
+        rec_library_save(lib);
+    }
+    return loaded;
+}
+
+int rec_library_list(const char *dir, int filter_count, char **filters) {
+    rec_library_query q;
+    rec_library_query_init(&q);
+    for(int i = 0; i < filter_count; i++) {
+        if(rec_library_query_parse(&q, filters[i])) {
+            fprintf(stderr, "Unknown filter %s, expected har=HAR or pilot=PILOT\n", filters[i]);
+            return 1;
+        }
+    }
+
+    rec_library lib;
+    int loaded = rec_library_refresh(&lib, dir);
+    if(loaded < 0) {
+        fprintf(stderr, "Could not open directory %s\n", dir);
+        rec_library_free(&lib);
+        return 1;
+    }
+
+    char buf[512];
+    unsigned int shown = 0;
+    unsigned int valid = 0;
+    iterator it;
+    rec_library_entry *e;
+    vector_iter_begin(&lib.entries, &it);
+    while((e = iter_next(&it)) != NULL) {
+        valid += !e->invalid;
+        if(rec_library_match(e, &q)) {
+            rec_library_describe(e, buf, sizeof(buf));
+            printf("%s\n", buf);
+            shown++;
+        }
+    }
+    printf("%u of %u recordings, %d read\n", shown, valid, loaded);
+    rec_library_free(&lib);
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "game/utils/rec_writer.h"
+#include "utils/log.h"
+
+#define REC_JOURNAL_MAGIC 0x4A464D4F // "OMFJ"
+#define REC_JOURNAL_VERSION 1
+#define REC_JOURNAL_HEADER_SIZE 12
+#define REC_JOURNAL_MOVE_SIZE 8
+
+// The parts of a move the arena fills in
+typedef struct rec_journal_move_t {
+    uint32_t tick;
+    uint8_t player_id;
+    uint8_t action;
+    uint8_t lookup_id;
+    uint8_t extra;
+} rec_journal_move;
+
+struct rec_writer_t {
+    FILE *fp;
+    char path[512];
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake; // Moves to write, or time to quit
+    SDL_cond *space; // Room in the buffer again
+    rec_journal_move buffer[REC_WRITER_BUFFER_SIZE];
+    unsigned int head;
+    unsigned int tail;
+    uint32_t written; // Moves on disk, as the journal header says
+    int quit;
+    int error;
+};
+
+static void rec_journal_path(char *out, size_t len, const char *rec_file) {
+    snprintf(out, len, "%s.part", rec_file);
+}
+
+static int write_u32(FILE *fp, uint32_t v) {
+    return fwrite(&v, sizeof(v), 1, fp) != 1;
+}
+
+static int read_u32(FILE *fp, uint32_t *v) {
+    return fread(v, sizeof(*v), 1, fp) != 1;
+}
+
+static int rec_writer_write(rec_writer *w, const rec_journal_move *moves, unsigned int count) {
+    int err = 0;
+    for(unsigned int i = 0; i < count && !err; i++) {
+        err |= write_u32(w->fp, moves[i].tick);
+        err |= fwrite(&moves[i].player_id, 1, 4, w->fp) != 4;
+    }
+    err |= fflush(w->fp) != 0;
+    if(err) {
+        return 1;
+    }
+
+    // The count only goes up once the moves are on disk
+    w->written += count;
+    err |= fseek(w->fp, 8, SEEK_SET) != 0;
+    err |= write_u32(w->fp, w->written);
+    err |= fseek(w->fp, 0, SEEK_END) != 0;
+    err |= fflush(w->fp) != 0;
+    return err;
+}
+
+static int rec_writer_run(void *data) {
+    rec_writer *w = data;
+    rec_journal_move moves[REC_WRITER_BUFFER_SIZE];
+    SDL_LockMutex(w->lock);
+    while(1) {
+        if(w->head == w->tail) {
+            if(w->quit) {
+                break;
+            }
+            SDL_CondWaitTimeout(w->wake, w->lock, REC_WRITER_FLUSH_INTERVAL);
+            continue;
+        }
+        unsigned int count = 0;
+        while(w->tail != w->head) {
+            moves[count++] = w->buffer[w->tail % REC_WRITER_BUFFER_SIZE];
+            w->tail++;
+        }
+        SDL_CondSignal(w->space);
+        SDL_UnlockMutex(w->lock);
+
+        int err = rec_writer_write(w, moves, count);
+
+        SDL_LockMutex(w->lock);
+        if(err && !w->error) {
+            PERROR("Writing to recording journal %s failed.", w->path);
+            w->error = 1;
+        }
+    }
+    SDL_UnlockMutex(w->lock);
+    return 0;
+}
+
+rec_writer* rec_writer_open(sd_rec_file *header, const char *rec_file) {
+    // The REC file is valid from the start, it just has no moves yet
+    header->move_count = 0;
+    if(sd_rec_save(header, rec_file) != SD_SUCCESS) {
+        PERROR("Could not write recording %s.", rec_file);
+        return NULL;
+    }
+
+    rec_writer *w = malloc(sizeof(rec_writer));
+    memset(w, 0, sizeof(rec_writer));
+    rec_journal_path(w->path, sizeof(w->path), rec_file);
+    w->fp = fopen(w->path, "wb");
+    if(w->fp == NULL) {
+        PERROR("Could not open %s for writing.", w->path);
+        goto error_0;
+    }
+    if(write_u32(w->fp, REC_JOURNAL_MAGIC) || write_u32(w->fp, REC_JOURNAL_VERSION)
+            || write_u32(w->fp, 0) || fflush(w->fp) != 0) {
+        PERROR("Could not write recording journal %s.", w->path);
+        goto error_1;
+    }
+    w->lock = SDL_CreateMutex();
+    w->wake = SDL_CreateCond();
+    w->space = SDL_CreateCond();
+    w->thread = SDL_CreateThread(rec_writer_run, "rec writer", w);
+    if(w->thread == NULL) {
+        PERROR("Unable to create recording thread: %s", SDL_GetError());
+        goto error_2;
+    }
+    return w;
+
+error_2:
+    SDL_DestroyCond(w->space);
+    SDL_DestroyCond(w->wake);
+    SDL_DestroyMutex(w->lock);
+error_1:
+    fclose(w->fp);
+    remove(w->path);
+error_0:
+    free(w);
+    return NULL;
+}
+
+void rec_writer_add(rec_writer *w, const sd_rec_move *move) {
+    rec_journal_move m;
+    m.tick = move->tick;
+    m.player_id = move->player_id;
+    m.action = move->action;
+    m.lookup_id = move->lookup_id;
+    m.extra = 0;
+
+    SDL_LockMutex(w->lock);
+    while(w->head - w->tail >= REC_WRITER_BUFFER_SIZE) {
+        // Only if the disk can't keep up at all
+        SDL_CondSignal(w->wake);
+        SDL_CondWait(w->space, w->lock);
+    }
+    w->buffer[w->head % REC_WRITER_BUFFER_SIZE] = m;
+    w->head++;
+    if(w->head - w->tail >= REC_WRITER_BUFFER_SIZE / 2) {
+        SDL_CondSignal(w->wake);
+    }
+    SDL_UnlockMutex(w->lock);
+}
+
+// Appends the moves of the journal to the recording and saves it. The
+// journal is removed once the REC file has them.
+static int rec_writer_fold(const char *journal, sd_rec_file *rec, const char *rec_file) {
+    FILE *fp = fopen(journal, "rb");
+    if(fp == NULL) {
+        PERROR("Could not open recording journal %s.", journal);
+        return 1;
+    }
+    uint32_t magic, version, count;
+    if(read_u32(fp, &magic) || read_u32(fp, &version) || read_u32(fp, &count)
+            || magic != REC_JOURNAL_MAGIC || version != REC_JOURNAL_VERSION) {
+        PERROR("Recording journal %s is not valid.", journal);
+        fclose(fp);
+        return 1;
+    }
+
+    // Moves written after the count was last updated are taken too, as long
+    // as they are whole
+    uint32_t found = 0;
+    uint8_t rec_data[REC_JOURNAL_MOVE_SIZE];
+    while(fread(rec_data, 1, REC_JOURNAL_MOVE_SIZE, fp) == REC_JOURNAL_MOVE_SIZE) {
+        sd_rec_move move;
+        memset(&move, 0, sizeof(move));
+        memcpy(&move.tick, rec_data, 4);
+        move.player_id = rec_data[4];
+        move.action = rec_data[5];
+        move.lookup_id = rec_data[6];
+        if(sd_rec_insert_action(rec, rec->move_count, &move) != SD_SUCCESS) {
+            PERROR("Could not add move %u from %s.", found, journal);
+            fclose(fp);
+            return 1;
+        }
+        found++;
+    }
+    fclose(fp);
+    if(found != count) {
+        DEBUG("Recording journal %s has %u moves, header says %u.", journal, found, count);
+    }
+
+    if(sd_rec_save(rec, rec_file) != SD_SUCCESS) {
+        PERROR("Could not write recording %s.", rec_file);
+        return 1;
+    }
+    remove(journal);
+    return 0;
+}
+
+int rec_writer_close(rec_writer *w, sd_rec_file *header) {
+    SDL_LockMutex(w->lock);
+    w->quit = 1;
+    SDL_CondSignal(w->wake);
+    SDL_UnlockMutex(w->lock);
+    SDL_WaitThread(w->thread, NULL);
+    SDL_DestroyCond(w->space);
+    SDL_DestroyCond(w->wake);
+    SDL_DestroyMutex(w->lock);
+    fclose(w->fp);
+
+    // The REC file name is the journal's without the suffix
+    char rec_file[512];
+    snprintf(rec_file, sizeof(rec_file), "%.*s", (int)(strlen(w->path) - 5), w->path);
+    int ret = rec_writer_fold(w->path, header, rec_file);
+    free(w);
+    return ret;
+}
+
+int rec_writer_recover(const char *rec_file) {
+    char journal[512];
+    rec_journal_path(journal, sizeof(journal), rec_file);
+    FILE *fp = fopen(journal, "rb");
+    if(fp == NULL) {
+        return 0;
+    }
+    fclose(fp);
+
+    INFO("Recovering unfinished recording %s.", rec_file);
+    sd_rec_file rec;
+    sd_rec_create(&rec);
+    int ret = 1;
+    if(sd_rec_load(&rec, rec_file) != SD_SUCCESS) {
+        PERROR("Unable to load recording %s.", rec_file);
+    } else {
+        ret = rec_writer_fold(journal, &rec, rec_file);
+    }
+    sd_rec_free(&rec);
+    return ret;
+}
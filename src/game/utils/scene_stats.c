@@ -0,0 +1,115 @@
+#include <string.h>
+#include "game/utils/scene_stats.h"
+#include "game/game_state.h"
+#include "game/common_defines.h"
+#include "game/objects/har.h"
+#include "video/video.h"
+#include "video/tcache.h"
+#include "audio/audio_stats.h"
+#include "utils/profiler.h"
+#include "utils/log.h"
+
+// Static ticks are 10ms apart
+#define SCENE_STATS_SAMPLE_TICKS 100
+
+static const char *stat_names[] = {
+    "objects",
+    "projectiles",
+    "scrap",
+    "hazards",
+    "spawns/s",
+    "frees/s",
+    "tcache entries",
+    "tcache kB",
+    "palette/s",
+    "voices",
+};
+
+static struct {
+    unsigned int last[SCENE_STAT_COUNT];
+    unsigned int max[SCENE_STAT_COUNT];
+    uint64_t sum[SCENE_STAT_COUNT];
+    unsigned int samples;
+    unsigned int ticks;
+    // Running totals at the previous sample, for the rates
+    unsigned int spawns;
+    unsigned int frees;
+    unsigned int pal_version;
+    int primed;
+} stats;
+
+static void scene_stats_sample(game_state *gs) {
+    unsigned int v[SCENE_STAT_COUNT];
+    v[SCENE_STAT_OBJECTS] = vector_size(&gs->objects);
+    v[SCENE_STAT_PROJECTILES] = game_state_count_objects(gs, LAYER_PROJECTILE);
+    v[SCENE_STAT_SCRAP] = game_state_count_objects(gs, LAYER_SCRAP);
+    v[SCENE_STAT_HAZARDS] = game_state_count_objects(gs, LAYER_HAZARD);
+
+    unsigned int spawns = profiler_get_count(PROF_CNT_OBJ_SPAWNS);
+    unsigned int frees = profiler_get_count(PROF_CNT_OBJ_FREES);
+    screen_palette *pal = video_get_pal_ref();
+    unsigned int pal_version = (pal != NULL) ? pal->version : 0;
+    if(!stats.primed) {
+        // Nothing to take a rate from yet
+        stats.spawns = spawns;
+        stats.frees = frees;
+        stats.pal_version = pal_version;
+        stats.primed = 1;
+        return;
+    }
+    v[SCENE_STAT_SPAWNS] = spawns - stats.spawns;
+    v[SCENE_STAT_FREES] = frees - stats.frees;
+    v[SCENE_STAT_PALETTE_BUMPS] = pal_version - stats.pal_version;
+    stats.spawns = spawns;
+    stats.frees = frees;
+    stats.pal_version = pal_version;
+
+    tcache_stats tstats;
+    tcache_get_stats(&tstats);
+    v[SCENE_STAT_TCACHE_ENTRIES] = tstats.entries;
+    v[SCENE_STAT_TCACHE_KB] = tstats.bytes_used / 1024;
+
+    audio_stats astats;
+    audio_stats_get(&astats);
+    v[SCENE_STAT_VOICES] = astats.voices;
+
+    for(int i = 0; i < SCENE_STAT_COUNT; i++) {
+        stats.last[i] = v[i];
+        stats.sum[i] += v[i];
+        if(v[i] > stats.max[i]) {
+            stats.max[i] = v[i];
+        }
+    }
+    stats.samples++;
+}
+
+void scene_stats_tick(game_state *gs) {
+    if(++stats.ticks >= SCENE_STATS_SAMPLE_TICKS) {
+        stats.ticks = 0;
+        scene_stats_sample(gs);
+    }
+}
+
+void scene_stats_end(int scene_id) {
+    if(stats.samples > 0) {
+        INFO("Load of scene %s over %u seconds (avg/max):", scene_get_name(scene_id), stats.samples);
+        for(int i = 0; i < SCENE_STAT_COUNT; i++) {
+            INFO(" * %-15s %8.1f %6u", stat_names[i], (float)stats.sum[i] / stats.samples, stats.max[i]);
+        }
+    }
+    // The rates carry on from the last sample
+    memset(stats.last, 0, sizeof(stats.last));
+    memset(stats.max, 0, sizeof(stats.max));
+    memset(stats.sum, 0, sizeof(stats.sum));
+    stats.samples = 0;
+}
+
+void scene_stats_get(int stat, scene_stat *out) {
+    out->last = stats.last[stat];
+    out->max = stats.max[stat];
+    out->avg = stats.samples ? (float)stats.sum[stat] / stats.samples : 0.0f;
+}
+
+const char* scene_stats_name(int stat) {
+    return stat_names[stat];
+}
@@ -267,11 +267,22 @@ int chr_score_end_combo(chr_score *score, vec2i pos) {
     return ret;
 }
 
+static const serial_field score_fields[] = {
+    SERIAL_FIELD(SERIAL_FIELD_INT, chr_score, score),
+    SERIAL_FIELD(SERIAL_FIELD_INT, chr_score, done),
+    SERIAL_FIELD(SERIAL_FIELD_INT, chr_score, scrap),
+    SERIAL_FIELD(SERIAL_FIELD_INT, chr_score, destruction),
+};
+
+static const serial_field score_text_fields[] = {
+    SERIAL_FIELD(SERIAL_FIELD_FLOAT, score_text, position),
+    SERIAL_FIELD(SERIAL_FIELD_INT, score_text, start.x),
+    SERIAL_FIELD(SERIAL_FIELD_INT, score_text, start.y),
+    SERIAL_FIELD(SERIAL_FIELD_INT, score_text, points),
+};
+
 void chr_score_serialize(chr_score *score, serial *ser) {
-    serial_write_int32(ser, score->score);
-    serial_write_int32(ser, score->done);
-    serial_write_int32(ser, score->scrap);
-    serial_write_int32(ser, score->destruction);
+    serial_write_fields(ser, score_fields, SERIAL_FIELD_COUNT(score_fields), score);
     serial_write_int8(ser, score->texts.size);
     iterator it;
     score_text *t;
@@ -280,24 +291,16 @@ void chr_score_serialize(chr_score *score, serial *ser) {
     while((t = iter_next(&it)) != NULL) {
         serial_write_int8(ser, strlen(t->text)+1);
         serial_write(ser, t->text, strlen(t->text)+1);
-        serial_write_float(ser, t->position);
-        serial_write_int16(ser, t->start.x);
-        serial_write_int16(ser, t->start.y);
-        serial_write_int32(ser, t->points);
+        serial_write_fields(ser, score_text_fields, SERIAL_FIELD_COUNT(score_text_fields), t);
     }
 }
 
 void chr_score_unserialize(chr_score *score, serial *ser) {
-    score->score = serial_read_int32(ser);
-    score->done = serial_read_int32(ser);
-    score->scrap = serial_read_int32(ser);
-    score->destruction = serial_read_int32(ser);
+    serial_read_fields(ser, score_fields, SERIAL_FIELD_COUNT(score_fields), score);
     uint8_t count = serial_read_int8(ser);
     uint16_t text_len;
     char *text;
-    float pos;
-    int x, y;
-    int points;
+    score_text t;
 
     // clean it out
     chr_score_free(score);
@@ -307,11 +310,8 @@ void chr_score_unserialize(chr_score *score, serial *ser) {
         text_len = serial_read_int8(ser);
         text = malloc(text_len);
         serial_read(ser, text, text_len);
-        pos = serial_read_float(ser);
-        x = serial_read_int16(ser);
-        y = serial_read_int16(ser);
-        points = serial_read_int32(ser);
+        serial_read_fields(ser, score_text_fields, SERIAL_FIELD_COUNT(score_text_fields), &t);
 
-        chr_score_add(score, text, points, vec2i_create(x, y), pos);
+        chr_score_add(score, text, t.points, t.start, t.position);
     }
 }
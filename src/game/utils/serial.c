@@ -1,77 +1,116 @@
 #include <stdlib.h>
 #include <string.h>
-#if defined(WIN32) || defined(_WIN32)
-    #include <winsock.h> // for htonl and friends
-#else
-    #include <arpa/inet.h> // for htonl and friends
-#endif
+#include <math.h>
 #include "game/utils/serial.h"
 #include "utils/log.h"
-#include <stdio.h>
 
+// Initial capacity for serials that are created without a size hint
+#define SERIAL_MIN_CAPACITY 64
 
-// taken from http://stackoverflow.com/questions/10620601/portable-serialisation-of-ieee754-floating-point-values
-float htonf(float val) {
-    uint32_t rep;
-    memcpy(&rep, &val, sizeof rep);
-    rep = htonl(rep);
-    memcpy(&val, &rep, sizeof rep);
-    return val;
+void serial_create(serial *s) {
+    s->len = 0;
+    s->rpos = 0;
+    s->cap = 0;
+    s->view = 0;
+    s->error = 0;
+    s->data = NULL;
 }
 
-float ntohf(float val) {
-    uint32_t rep;
-    memcpy(&rep, &val, sizeof rep);
-    rep = ntohl(rep);
-    memcpy(&val, &rep, sizeof rep);
-    return val;
+void serial_create_size(serial *s, size_t size_hint) {
+    serial_create(s);
+    serial_reserve(s, size_hint);
 }
 
-// TODO we should probably have some reasonable initial size, so we don't realloc like crazy
-void serial_create(serial *s) {
-    s->len = 0;
+// Wraps existing data for reading. The data must outlive the serial.
+void serial_create_view(serial *s, const char *data, size_t len) {
+    serial_create(s);
+    s->data = (char*)data;
+    s->len = len;
+    s->cap = len;
+    s->view = 1;
+}
+
+// Makes sure there is room for at least len bytes in total
+void serial_reserve(serial *s, size_t len) {
+    if(s->view || len <= s->cap) {
+        return;
+    }
+    size_t cap = s->cap ? s->cap : SERIAL_MIN_CAPACITY;
+    while(cap < len) {
+        cap *= 2;
+    }
+    s->data = realloc(s->data, cap);
+    s->cap = cap;
+}
+
+// Empties the serial, but keeps its buffer for reuse
+void serial_clear(serial *s) {
+    if(!s->view) {
+        s->len = 0;
+    }
     s->rpos = 0;
-    s->data = NULL;
+    s->error = 0;
 }
 
-// TODO: Optimize writing
-void serial_write(serial *s, const char *buf, int len) {
-    if(s->data == NULL) {
-        s->data = malloc(len);
-        memcpy(s->data, buf, len);
-    } else {
-        s->data = realloc(s->data, s->len + len);
-        memcpy(s->data + s->len, buf, len);
+// Returns NULL for read-only serials
+char* serial_write_block(serial *s, size_t len) {
+    if(s->view) {
+        PERROR("Attempted to write to a read-only serial");
+        return NULL;
     }
+    serial_reserve(s, s->len + len);
+    char *p = s->data + s->len;
     s->len += len;
+    return p;
+}
+
+void serial_write(serial *s, const char *buf, int len) {
+    char *p = serial_write_block(s, len);
+    if(p != NULL) {
+        memcpy(p, buf, len);
+    }
 }
 
 void serial_write_int8(serial *s, int8_t v) {
-    serial_write(s, (char*)&v, sizeof(v));
+    char *p = serial_write_block(s, 1);
+    if(p != NULL) {
+        serial_put_int8(&p, v);
+    }
 }
 
 void serial_write_int16(serial *s, int16_t v) {
-    int16_t t = htons(v);
-    serial_write(s, (char*)&t, sizeof(t));
+    char *p = serial_write_block(s, 2);
+    if(p != NULL) {
+        serial_put_int16(&p, v);
+    }
 }
 
 void serial_write_int32(serial *s, int32_t v) {
-    int32_t t = htonl(v);
-    serial_write(s, (char*)&t, sizeof(t));
+    char *p = serial_write_block(s, 4);
+    if(p != NULL) {
+        serial_put_int32(&p, v);
+    }
 }
 
 void serial_write_float(serial *s, float v) {
-    float t = htonf(v);
-    serial_write(s, (char*)&t, sizeof(t));
+    char *p = serial_write_block(s, 4);
+    if(p != NULL) {
+        serial_put_float(&p, v);
+    }
 }
 
 void serial_free(serial *s) {
     if(s->data != NULL) {
-        free(s->data);
+        if(!s->view) {
+            free(s->data);
+        }
         s->data = NULL;
         s->len = 0;
         s->rpos = 0;
+        s->cap = 0;
+        s->view = 0;
     }
+    s->error = 0;
 }
 
 size_t serial_len(serial *s) {
@@ -80,39 +119,178 @@ size_t serial_len(serial *s) {
 
 void serial_read_reset(serial *s) {
     s->rpos = 0;
+    s->error = 0;
+}
+
+int serial_error(const serial *s) {
+    return s->error;
 }
 
+const char* serial_read_block(serial *s, size_t len) {
+    if(len > s->len - s->rpos) {
+        s->rpos = s->len;
+        s->error = 1;
+        return NULL;
+    }
+    const char *p = s->data + s->rpos;
+    s->rpos += len;
+    return p;
+}
+
+// Whatever is missing at the end is zeroed
 void serial_read(serial *s, char *buf, int len) {
-    if(len + s->rpos  > s->len) {
-        len = s->len - s->rpos;
+    size_t left = s->len - s->rpos;
+    if((size_t)len > left) {
+        memset(buf + left, 0, len - left);
+        len = left;
+        s->error = 1;
     }
     memcpy(buf, s->data+s->rpos, len);
     s->rpos += len;
-    if (s->rpos > s->len) {
-        s->rpos = s->len;
-    }
 }
 
 int8_t serial_read_int8(serial *s) {
-    int8_t v;
-    serial_read(s, (char*)&v, sizeof(v));
-    return v;
+    const char *p = serial_read_block(s, 1);
+    return p ? serial_get_int8(&p) : 0;
 }
 
 int16_t serial_read_int16(serial *s) {
-    int16_t v;
-    serial_read(s, (char*)&v, sizeof(v));
-    return ntohs(v);
+    const char *p = serial_read_block(s, 2);
+    return p ? serial_get_int16(&p) : 0;
 }
 
 int32_t serial_read_int32(serial *s) {
-    int32_t v;
-    serial_read(s, (char*)&v, sizeof(v));
-    return ntohl(v);
+    const char *p = serial_read_block(s, 4);
+    return p ? serial_get_int32(&p) : 0;
 }
 
 float serial_read_float(serial *s) {
-    float v;
-    serial_read(s, (char*)&v, sizeof(v));
-    return ntohf(v);
+    const char *p = serial_read_block(s, 4);
+    return p ? serial_get_float(&p) : 0.0f;
+}
+
+void serial_write_varint(serial *s, uint32_t v) {
+    char buf[5];
+    int len = 0;
+    while(v >= 0x80) {
+        buf[len++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[len++] = (char)v;
+    serial_write(s, buf, len);
+}
+
+void serial_write_svarint(serial *s, int32_t v) {
+    serial_write_varint(s, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+uint32_t serial_read_varint(serial *s) {
+    uint32_t v = 0;
+    for(int shift = 0; shift < 35; shift += 7) {
+        if(s->rpos >= s->len) {
+            s->error = 1;
+            break;
+        }
+        uint8_t b = s->data[s->rpos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            break;
+        }
+    }
+    return v;
+}
+
+int32_t serial_read_svarint(serial *s) {
+    uint32_t v = serial_read_varint(s);
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Whole numbers up to 2^24 survive the trip through an int exactly
+static int serial_float_is_whole(float v) {
+    return v >= -16777216.0f && v <= 16777216.0f
+        && v == (float)(int32_t)v
+        && !(v == 0.0f && signbit(v));
+}
+
+void serial_write_fields(serial *s, const serial_field *fields, int count, const void *src) {
+    const char *base = src;
+    uint64_t bits = 0;
+    int nbits = 0;
+    for(int i = 0; i < count; i++) {
+        const void *p = base + fields[i].offset;
+        if(fields[i].type == SERIAL_FIELD_FLAG) {
+            bits |= (uint64_t)(*(const int*)p != 0) << nbits++;
+        } else if(fields[i].type == SERIAL_FIELD_FLOAT) {
+            bits |= (uint64_t)serial_float_is_whole(*(const float*)p) << nbits++;
+        }
+    }
+    for(int i = 0; i < nbits; i += 8) {
+        serial_write_int8(s, (int8_t)(bits >> i));
+    }
+
+    int bit = 0;
+    for(int i = 0; i < count; i++) {
+        const void *p = base + fields[i].offset;
+        switch(fields[i].type) {
+            case SERIAL_FIELD_FLAG:
+                bit++;
+                break;
+            case SERIAL_FIELD_UINT:
+                serial_write_varint(s, (uint32_t)*(const int*)p);
+                break;
+            case SERIAL_FIELD_INT:
+                serial_write_svarint(s, *(const int*)p);
+                break;
+            case SERIAL_FIELD_RAW32:
+                serial_write_int32(s, *(const int*)p);
+                break;
+            case SERIAL_FIELD_FLOAT:
+                if(bits & ((uint64_t)1 << bit++)) {
+                    serial_write_svarint(s, (int32_t)*(const float*)p);
+                } else {
+                    serial_write_float(s, *(const float*)p);
+                }
+                break;
+        }
+    }
+}
+
+void serial_read_fields(serial *s, const serial_field *fields, int count, void *dst) {
+    char *base = dst;
+    int nbits = 0;
+    for(int i = 0; i < count; i++) {
+        if(fields[i].type == SERIAL_FIELD_FLAG || fields[i].type == SERIAL_FIELD_FLOAT) {
+            nbits++;
+        }
+    }
+    uint64_t bits = 0;
+    for(int i = 0; i < nbits; i += 8) {
+        bits |= (uint64_t)(uint8_t)serial_read_int8(s) << i;
+    }
+
+    int bit = 0;
+    for(int i = 0; i < count; i++) {
+        void *p = base + fields[i].offset;
+        switch(fields[i].type) {
+            case SERIAL_FIELD_FLAG:
+                *(int*)p = (bits >> bit++) & 1;
+                break;
+            case SERIAL_FIELD_UINT:
+                *(int*)p = (int)serial_read_varint(s);
+                break;
+            case SERIAL_FIELD_INT:
+                *(int*)p = serial_read_svarint(s);
+                break;
+            case SERIAL_FIELD_RAW32:
+                *(int*)p = serial_read_int32(s);
+                break;
+            case SERIAL_FIELD_FLOAT:
+                if(bits & ((uint64_t)1 << bit++)) {
+                    *(float*)p = (float)serial_read_svarint(s);
+                } else {
+                    *(float*)p = serial_read_float(s);
+                }
+                break;
+        }
+    }
 }
@@ -1,10 +1,14 @@
 #include "game/utils/settings.h"
 #include "controller/controller.h"
 #include "utils/config.h"
+#include "utils/io_worker.h"
 #include "utils/log.h"
+#include <SDL2/SDL.h>
 #include <stddef.h> //offsetof
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #define F_INT(struct_, var, def) {#var, TYPE_INT, {.i=def}, offsetof(struct_, var)}
 #define F_BOOL(struct_, var, def) {#var, TYPE_BOOL, {.b=def}, offsetof(struct_, var)}
@@ -15,8 +19,25 @@
 
 #define S_2_F(struct_, field) {struct_, field, NFIELDS(field)}
 
+#define SETTINGS_SNAPSHOTS 3
+#define SETTINGS_MAX_LISTENERS 8
+
+typedef struct settings_listener_entry_t {
+    settings_listener fn;
+    void *userdata;
+} settings_listener_entry;
+
 static settings _settings;
 static const char *settings_path;
+static SDL_mutex *_conf_lock; // The config is written out on the I/O thread
+
+// Published copies, the oldest of which is recycled on every apply
+static settings _snapshots[SETTINGS_SNAPSHOTS];
+static int _snapshot_next;
+static void *_snapshot;
+
+static settings_listener_entry _listeners[SETTINGS_MAX_LISTENERS];
+static int _listener_count;
 
 typedef enum field_type_t {
     TYPE_INT,
@@ -55,6 +76,17 @@ const field f_video[] = {
     F_BOOL(settings_video, crossfade_on,     1),
     F_STRING(settings_video, scaler, "Nearest"),
     F_INT(settings_video,  scale_factor,     1),
+    F_INT(settings_video,  texture_cache_mb, 64),
+    F_INT(settings_video,  texture_copy_mb,  32),
+    F_INT(settings_video,  scale_cache_mb,    0),
+    F_INT(settings_video,  fps_cap,          0),
+    F_BOOL(settings_video, idle_wait,        1),
+    F_BOOL(settings_video, vrr,              0),
+    F_BOOL(settings_video, interpolate,      0),
+    F_INT(settings_video,  frame_skip,       2),
+    F_BOOL(settings_video, frame_delay,      0),
+    F_BOOL(settings_video, flight_recorder,  1),
+    F_INT(settings_video,  flight_recorder_ms, 0),
 };
 
 const field f_sound[] = {
@@ -68,7 +100,11 @@ const field f_sound[] = {
     F_STRING(settings_sound, music_arena3, ""),
     F_STRING(settings_sound, music_arena4, ""),
     F_STRING(settings_sound, music_end,    ""),
-    F_STRING(settings_sound, music_menu,   "")
+    F_STRING(settings_sound, music_menu,   ""),
+    F_INT(settings_sound,  audio_buffers,     4),
+    F_INT(settings_sound,  audio_buffer_size, 16384),
+    F_INT(settings_sound,  sound_voices,      16),
+    F_INT(settings_sound,  audio_period,      512)
 };
 
 const field f_gameplay[] = {
@@ -78,7 +114,24 @@ const field f_gameplay[] = {
     F_INT(settings_gameplay,  power2,      5),
     F_BOOL(settings_gameplay, hazards_on,  1),
     F_INT(settings_gameplay,  difficulty,  1),
-    F_INT(settings_gameplay,  rounds,      1)
+    F_INT(settings_gameplay,  rounds,      1),
+    F_INT(settings_gameplay,  object_pool_size, 256),
+    F_INT(settings_gameplay,  resource_cache_mb, 48),
+    F_BOOL(settings_gameplay, lazy_sprites, 1),
+    F_INT(settings_gameplay,  sprite_predecode, 16),
+    F_INT(settings_gameplay,  sprite_cache_mb, 0),
+    F_BOOL(settings_gameplay, low_memory, 0),
+    F_BOOL(settings_gameplay, sim_thread, 0),
+    F_INT(settings_gameplay,  max_catchup_ticks, 8),
+    F_BOOL(settings_gameplay, fixed_physics, 0),
+    F_INT(settings_gameplay,  run_ahead, 0),
+    F_STRING(settings_gameplay, cores_main, ""),
+    F_STRING(settings_gameplay, cores_sim, ""),
+    F_STRING(settings_gameplay, cores_audio, ""),
+    F_STRING(settings_gameplay, cores_net, ""),
+    F_STRING(settings_gameplay, cores_jobs, ""),
+    F_BOOL(settings_gameplay, thread_priority, 0),
+    F_INT(settings_gameplay,  job_threads, 0)
 };
 
 const field f_tournament[] = {
@@ -125,7 +178,12 @@ const field f_keyboard[] = {
 const field f_net[] = {
     F_STRING(settings_network, net_connect_ip,   "localhost"),
     F_INT(settings_network,    net_connect_port, 2097),
-    F_INT(settings_network,    net_listen_port, 2097)
+    F_INT(settings_network,    net_listen_port, 2097),
+    F_INT(settings_network,    net_input_redundancy, 4),
+    F_INT(settings_network,    net_frame_advantage, 1),
+    F_INT(settings_network,    net_spectate_port, 2098),
+    F_INT(settings_network,    net_spectate_relay_port, 0),
+    F_INT(settings_network,    net_relay_session, 0)
 };
 
 // Map struct to field
@@ -243,6 +301,62 @@ void settings_free_strings(void *st, const field *fields, int nfields) {
     }
 }
 
+// Copies the settings. Strings are duplicated, so the copy doesn't care what
+// the menus do with the originals.
+static void settings_copy(settings *dst, const settings *src) {
+    for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
+        const struct_to_field *s2f = &struct_to_fields[i];
+        settings_free_strings((char*)dst + ((char*)s2f->_struct - (char*)&_settings), s2f->fields, s2f->num_fields);
+    }
+    memcpy(dst, src, sizeof(settings));
+    for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
+        const struct_to_field *s2f = &struct_to_fields[i];
+        void *st = (char*)dst + ((char*)s2f->_struct - (char*)&_settings);
+        for(int k = 0; k < s2f->num_fields; k++) {
+            const field *f = &s2f->fields[k];
+            char **s = fieldstr(st, f->offset);
+            if(f->type == TYPE_STRING && *s != NULL) {
+                *s = strcpy(malloc(strlen(*s) + 1), *s);
+            }
+        }
+    }
+}
+
+void settings_apply() {
+    settings *snap = &_snapshots[_snapshot_next];
+    _snapshot_next = (_snapshot_next + 1) % SETTINGS_SNAPSHOTS;
+    settings_copy(snap, &_settings);
+    SDL_AtomicSetPtr(&_snapshot, snap);
+    for(int i = 0; i < _listener_count; i++) {
+        _listeners[i].fn(snap, _listeners[i].userdata);
+    }
+}
+
+const settings *settings_snapshot() {
+    const settings *snap = SDL_AtomicGetPtr(&_snapshot);
+    return (snap != NULL) ? snap : &_settings;
+}
+
+int settings_add_listener(settings_listener fn, void *userdata) {
+    if(_listener_count >= SETTINGS_MAX_LISTENERS) {
+        PERROR("Too many settings listeners");
+        return 1;
+    }
+    _listeners[_listener_count].fn = fn;
+    _listeners[_listener_count].userdata = userdata;
+    _listener_count++;
+    return 0;
+}
+
+void settings_remove_listener(settings_listener fn, void *userdata) {
+    for(int i = 0; i < _listener_count; i++) {
+        if(_listeners[i].fn == fn && _listeners[i].userdata == userdata) {
+            _listeners[i] = _listeners[--_listener_count];
+            return;
+        }
+    }
+}
+
 int settings_write_defaults(const char *path) {
     int r = 0;
     settings_init(path);
@@ -255,6 +369,7 @@ int settings_write_defaults(const char *path) {
 
 int settings_init(const char *path) {
     settings_path = path;
+    _conf_lock = SDL_CreateMutex();
     memset(&_settings, 0, sizeof(settings));
     for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
         const struct_to_field *s2f = &struct_to_fields[i];
@@ -268,26 +383,131 @@ void settings_load() {
         const struct_to_field *s2f = &struct_to_fields[i];
         settings_load_fields(s2f->_struct, s2f->fields, s2f->num_fields);
     }
+    settings_apply();
 }
 
+static int settings_write_file(const char *path, void *userdata) {
+    SDL_LockMutex(_conf_lock);
+    int ret = conf_write_config(path);
+    SDL_UnlockMutex(_conf_lock);
+    return ret;
+}
+
+// The settings in memory stay authoritative, the file is written behind
 void settings_save() {
+    SDL_LockMutex(_conf_lock);
     for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
         const struct_to_field *s2f = &struct_to_fields[i];
         settings_save_fields(s2f->_struct, s2f->fields, s2f->num_fields);
     }
-    if(conf_write_config(settings_path)) {
-        PERROR("Failed to write config file!\n");
-    }
+    SDL_UnlockMutex(_conf_lock);
+    settings_apply();
+    io_worker_write(settings_path, settings_write_file, NULL, NULL);
 }
 
 void settings_free() {
     for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
         const struct_to_field *s2f = &struct_to_fields[i];
         settings_free_strings(s2f->_struct, s2f->fields, s2f->num_fields);
+        for(int k = 0; k < SETTINGS_SNAPSHOTS; k++) {
+            void *st = (char*)&_snapshots[k] + ((char*)s2f->_struct - (char*)&_settings);
+            settings_free_strings(st, s2f->fields, s2f->num_fields);
+        }
     }
+    SDL_AtomicSetPtr(&_snapshot, NULL);
+    _listener_count = 0;
+    io_worker_flush();
     conf_close();
+    SDL_DestroyMutex(_conf_lock);
+    _conf_lock = NULL;
 }
 
 settings *settings_get() {
     return &_settings;
 }
+
+// Field by its name in the config file, and the struct it lives in
+static const field *settings_find(const char *name, void **st) {
+    for(int i = 0;i < sizeof(struct_to_fields)/sizeof(struct_to_field);i++) {
+        const struct_to_field *s2f = &struct_to_fields[i];
+        for(int k = 0; k < s2f->num_fields; k++) {
+            if(strcmp(s2f->fields[k].name, name) == 0) {
+                *st = s2f->_struct;
+                return &s2f->fields[k];
+            }
+        }
+    }
+    return NULL;
+}
+
+int settings_set(const char *name, const char *value) {
+    void *st;
+    const field *f = settings_find(name, &st);
+    if(f == NULL) {
+        return 1;
+    }
+    char *end;
+    switch(f->type) {
+        case TYPE_INT:
+            {
+                long v = strtol(value, &end, 10);
+                if(*value == 0 || *end != 0) {
+                    return 1;
+                }
+                *fieldint(st, f->offset) = (int)v;
+            }
+            break;
+
+        case TYPE_FLOAT:
+            {
+                double v = strtod(value, &end);
+                if(*value == 0 || *end != 0) {
+                    return 1;
+                }
+                *fieldfloat(st, f->offset) = v;
+            }
+            break;
+
+        case TYPE_BOOL:
+            if(strcmp(value, "1") == 0 || strcasecmp(value, "on") == 0 || strcasecmp(value, "true") == 0) {
+                *fieldbool(st, f->offset) = 1;
+            } else if(strcmp(value, "0") == 0 || strcasecmp(value, "off") == 0 || strcasecmp(value, "false") == 0) {
+                *fieldbool(st, f->offset) = 0;
+            } else {
+                return 1;
+            }
+            break;
+
+        case TYPE_STRING:
+            {
+                char **s = fieldstr(st, f->offset);
+                free(*s);
+                *s = strcpy(malloc(strlen(value) + 1), value);
+            }
+            break;
+    }
+    return 0;
+}
+
+int settings_format(const char *name, char *buf, size_t len) {
+    void *st;
+    const field *f = settings_find(name, &st);
+    if(f == NULL) {
+        return 1;
+    }
+    switch(f->type) {
+        case TYPE_INT:
+        case TYPE_BOOL:
+            snprintf(buf, len, "%d", *fieldint(st, f->offset));
+            break;
+
+        case TYPE_FLOAT:
+            snprintf(buf, len, "%g", *fieldfloat(st, f->offset));
+            break;
+
+        case TYPE_STRING:
+            snprintf(buf, len, "%s", *fieldstr(st, f->offset) ? *fieldstr(st, f->offset) : "");
+            break;
+    }
+    return 0;
+}
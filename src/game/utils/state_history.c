@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "game/utils/state_history.h"
+#include "utils/delta.h"
+#include "utils/log.h"
+
+static state_history_entry* state_history_at(const state_history *h, unsigned int i) {
+    return &h->entries[(h->first + i) % h->max_states];
+}
+
+void state_history_create(state_history *h, unsigned int max_states) {
+    // Room for at least two keyframes, so that dropping one leaves something
+    if(max_states < 2 * STATE_HISTORY_KEYFRAME_INTERVAL) {
+        max_states = 2 * STATE_HISTORY_KEYFRAME_INTERVAL;
+    }
+    h->entries = malloc(sizeof(state_history_entry) * max_states);
+    h->max_states = max_states;
+    h->first = 0;
+    h->count = 0;
+    h->bytes = 0;
+    serial_create(&h->start);
+    serial_create(&h->last);
+    serial_create(&h->scratch);
+}
+
+static void state_history_drop_oldest(state_history *h) {
+    state_history_entry *e = state_history_at(h, 0);
+    h->bytes -= e->len;
+    free(e->data);
+    h->first = (h->first + 1) % h->max_states;
+    h->count--;
+}
+
+static void state_history_drop_newest(state_history *h) {
+    state_history_entry *e = state_history_at(h, h->count - 1);
+    h->bytes -= e->len;
+    free(e->data);
+    h->count--;
+}
+
+void state_history_free(state_history *h) {
+    while(h->count > 0) {
+        state_history_drop_oldest(h);
+    }
+    free(h->entries);
+    h->entries = NULL;
+    serial_free(&h->start);
+    serial_free(&h->last);
+    serial_free(&h->scratch);
+}
+
+// Returns the index of the newest entry at or before tick, or -1
+static int state_history_find(const state_history *h, unsigned int tick) {
+    int lo = 0;
+    int hi = (int)h->count - 1;
+    int found = -1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if(state_history_at(h, mid)->tick <= tick) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Rebuilds the entry at index from its keyframe and the deltas after it
+static int state_history_decode(state_history *h, int index, serial *out) {
+    state_history_entry *e = state_history_at(h, index);
+    int key = index - (int)e->chain;
+    state_history_entry *k = state_history_at(h, key);
+    serial_clear(out);
+    serial_write(out, k->data, k->len);
+    for(int i = key + 1; i <= index; i++) {
+        state_history_entry *d = state_history_at(h, i);
+        long len = delta_decoded_len(d->data, d->len);
+        if(len < 0) {
+            return 1;
+        }
+        serial_reserve(&h->scratch, len);
+        if(delta_decode(out->data, out->len, d->data, d->len, h->scratch.data, len) < 0) {
+            return 1;
+        }
+        serial_clear(out);
+        serial_write(out, h->scratch.data, len);
+    }
+    return 0;
+}
+
+void state_history_add(state_history *h, unsigned int tick, const serial *state) {
+    if(h->count == 0 && h->start.len == 0) {
+        serial_write(&h->start, state->data, state->len);
+    }
+
+    // Going back in time, the newer states are no longer the past
+    if(h->count > 0 && state_history_at(h, h->count - 1)->tick >= tick) {
+        while(h->count > 0 && state_history_at(h, h->count - 1)->tick >= tick) {
+            state_history_drop_newest(h);
+        }
+        serial_clear(&h->last);
+        if(h->count > 0 && state_history_decode(h, h->count - 1, &h->last)) {
+            PERROR("State history is broken, starting over.");
+            while(h->count > 0) {
+                state_history_drop_oldest(h);
+            }
+        }
+    }
+
+    // Make room, keeping the oldest state a keyframe
+    if(h->count == h->max_states) {
+        do {
+            state_history_drop_oldest(h);
+        } while(h->count > 0 && state_history_at(h, 0)->chain != 0);
+    }
+
+    state_history_entry *prev = (h->count > 0) ? state_history_at(h, h->count - 1) : NULL;
+    state_history_entry *e = &h->entries[(h->first + h->count) % h->max_states];
+    e->tick = tick;
+    e->chain = (prev != NULL && prev->chain + 1 < STATE_HISTORY_KEYFRAME_INTERVAL) ? prev->chain + 1 : 0;
+    if(e->chain == 0) {
+        e->len = state->len;
+        e->data = malloc(state->len > 0 ? state->len : 1);
+        memcpy(e->data, state->data, state->len);
+    } else {
+        serial_reserve(&h->scratch, delta_max_size(state->len));
+        e->len = delta_encode(h->last.data, h->last.len, state->data, state->len, h->scratch.data);
+        e->data = malloc(e->len);
+        memcpy(e->data, h->scratch.data, e->len);
+    }
+    h->bytes += e->len;
+    h->count++;
+
+    serial_clear(&h->last);
+    serial_write(&h->last, state->data, state->len);
+}
+
+int state_history_get(state_history *h, unsigned int tick, serial *out) {
+    if(h->count == 0) {
+        return 1;
+    }
+    int index = state_history_find(h, tick);
+    return state_history_decode(h, (index < 0) ? 0 : index, out);
+}
+
+unsigned int state_history_size(const state_history *h) {
+    return h->count;
+}
+
+const serial* state_history_start(const state_history *h) {
+    return (h->start.len > 0) ? &h->start : NULL;
+}
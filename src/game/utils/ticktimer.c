@@ -1,39 +1,249 @@
 #include <stdlib.h>
+#include <string.h>
 #include "game/utils/ticktimer.h"
 #include "utils/vector.h"
+#include "utils/log.h"
+
+#define TICKTIMER_BLOCK_BITS TICKTIMER_WHEEL0_BITS
+#define TICKTIMER_SUPER_BITS (TICKTIMER_WHEEL0_BITS + TICKTIMER_WHEEL1_BITS)
+#define TICKTIMER_MAX_CALLBACKS 32
+#define TICKTIMER_MAX_UNITS 0xFFFF
 
 typedef struct ticktimer_unit_t {
-    ticktimer_cb callback;
-    int ticks;
+    ticktimer_cb callback; // NULL once cancelled
     void *userdata;
+    uint32_t fire_tick;
+    uint16_t generation; // Bumped whenever the unit is freed, to expire handles
+    uint8_t pending;
+    int next;
 } ticktimer_unit;
 
+static ticktimer_cb callbacks[TICKTIMER_MAX_CALLBACKS];
+static int callback_count = 0;
+
+static void ticktimer_reset(ticktimer *tt) {
+    tt->free_head = -1;
+    tt->now = 0;
+    tt->context = NULL;
+    for(int i = 0; i < TICKTIMER_WHEEL0_SIZE; i++) {
+        tt->wheel0[i].head = tt->wheel0[i].tail = -1;
+    }
+    for(int i = 0; i < TICKTIMER_WHEEL1_SIZE; i++) {
+        tt->wheel1[i].head = tt->wheel1[i].tail = -1;
+    }
+    tt->far.head = tt->far.tail = -1;
+}
+
 void ticktimer_init(ticktimer *tt) {
     vector_create(&tt->units, sizeof(ticktimer_unit));
+    ticktimer_reset(tt);
+}
+
+void ticktimer_init_with_allocator(ticktimer *tt, allocator alloc) {
+    vector_create_with_allocator(&tt->units, sizeof(ticktimer_unit), alloc);
+    ticktimer_reset(tt);
 }
 
 void ticktimer_close(ticktimer *tt) {
     vector_free(&tt->units);
 }
 
-void ticktimer_add(ticktimer *tt, int ticks, ticktimer_cb cb, void *userdata) {
-    ticktimer_unit unit;
-    unit.callback = cb;
-    unit.ticks = ticks;
-    unit.userdata = userdata;
-    vector_append(&tt->units, &unit);
+static ticktimer_unit* ticktimer_unit_at(ticktimer *tt, int idx) {
+    return vector_get(&tt->units, idx);
+}
+
+static void ticktimer_slot_append(ticktimer *tt, ticktimer_slot *slot, int idx) {
+    ticktimer_unit_at(tt, idx)->next = -1;
+    if(slot->tail < 0) {
+        slot->head = idx;
+    } else {
+        ticktimer_unit_at(tt, slot->tail)->next = idx;
+    }
+    slot->tail = idx;
+}
+
+static int ticktimer_slot_pop(ticktimer *tt, ticktimer_slot *slot) {
+    int idx = slot->head;
+    if(idx >= 0) {
+        slot->head = ticktimer_unit_at(tt, idx)->next;
+        if(slot->head < 0) {
+            slot->tail = -1;
+        }
+    }
+    return idx;
+}
+
+// Timers of the current block go straight to the first level
+static void ticktimer_place(ticktimer *tt, int idx) {
+    uint32_t fire = ticktimer_unit_at(tt, idx)->fire_tick;
+    if((fire >> TICKTIMER_BLOCK_BITS) == (tt->now >> TICKTIMER_BLOCK_BITS)) {
+        ticktimer_slot_append(tt, &tt->wheel0[fire & (TICKTIMER_WHEEL0_SIZE - 1)], idx);
+    } else if((fire >> TICKTIMER_SUPER_BITS) == (tt->now >> TICKTIMER_SUPER_BITS)) {
+        ticktimer_slot_append(tt, &tt->wheel1[(fire >> TICKTIMER_BLOCK_BITS) & (TICKTIMER_WHEEL1_SIZE - 1)], idx);
+    } else {
+        ticktimer_slot_append(tt, &tt->far, idx);
+    }
+}
+
+static void ticktimer_free_unit(ticktimer *tt, int idx) {
+    ticktimer_unit *unit = ticktimer_unit_at(tt, idx);
+    unit->pending = 0;
+    unit->callback = NULL;
+    unit->generation++;
+    unit->next = tt->free_head;
+    tt->free_head = idx;
+}
+
+static ticktimer_handle ticktimer_handle_of(const ticktimer_unit *unit, int idx) {
+    return ((uint32_t)unit->generation << 16) | (uint32_t)(idx + 1);
+}
+
+ticktimer_handle ticktimer_add(ticktimer *tt, int ticks, ticktimer_cb cb, void *userdata) {
+    int idx = tt->free_head;
+    if(idx >= 0) {
+        tt->free_head = ticktimer_unit_at(tt, idx)->next;
+    } else {
+        if(vector_size(&tt->units) >= TICKTIMER_MAX_UNITS) {
+            PERROR("Too many pending tick timers!");
+            return 0;
+        }
+        ticktimer_unit blank;
+        memset(&blank, 0, sizeof(blank));
+        vector_append(&tt->units, &blank);
+        idx = vector_size(&tt->units) - 1;
+    }
+    ticktimer_unit *unit = ticktimer_unit_at(tt, idx);
+    unit->callback = cb;
+    unit->userdata = userdata;
+    unit->fire_tick = tt->now + (ticks > 0 ? ticks : 0);
+    unit->pending = 1;
+    ticktimer_place(tt, idx);
+    return ticktimer_handle_of(unit, idx);
+}
+
+// Cancelled timers stay in their slot until their tick comes
+void ticktimer_cancel(ticktimer *tt, ticktimer_handle handle) {
+    int idx = (int)(handle & 0xFFFF) - 1;
+    if(idx < 0 || idx >= (int)vector_size(&tt->units)) {
+        return;
+    }
+    ticktimer_unit *unit = ticktimer_unit_at(tt, idx);
+    if(unit->pending && ticktimer_handle_of(unit, idx) == handle) {
+        unit->callback = NULL;
+    }
+}
+
+// Moves the timers of the block that now begins into the first level
+static void ticktimer_cascade(ticktimer *tt) {
+    if((tt->now & ((1 << TICKTIMER_BLOCK_BITS) - 1)) != 0) {
+        return;
+    }
+    int idx;
+    if((tt->now & ((1 << TICKTIMER_SUPER_BITS) - 1)) == 0) {
+        ticktimer_slot far = tt->far;
+        tt->far.head = tt->far.tail = -1;
+        while((idx = ticktimer_slot_pop(tt, &far)) >= 0) {
+            ticktimer_place(tt, idx);
+        }
+    }
+    ticktimer_slot *slot = &tt->wheel1[(tt->now >> TICKTIMER_BLOCK_BITS) & (TICKTIMER_WHEEL1_SIZE - 1)];
+    ticktimer_slot block = *slot;
+    slot->head = slot->tail = -1;
+    while((idx = ticktimer_slot_pop(tt, &block)) >= 0) {
+        ticktimer_place(tt, idx);
+    }
 }
 
 void ticktimer_run(ticktimer *tt) {
-    iterator it;
-    vector_iter_begin(&tt->units, &it);
-    ticktimer_unit *unit;
-    while((unit = iter_next(&it)) != NULL) {
-        if(unit->ticks <= 0) {
-            unit->callback(unit->userdata);
-            vector_delete(&tt->units, &it);
-        } else {
-            unit->ticks--;
+    // Callbacks may add timers for this very tick; those fire now as well
+    ticktimer_slot *slot = &tt->wheel0[tt->now & (TICKTIMER_WHEEL0_SIZE - 1)];
+    int idx;
+    while((idx = ticktimer_slot_pop(tt, slot)) >= 0) {
+        ticktimer_unit *unit = ticktimer_unit_at(tt, idx);
+        ticktimer_cb cb = unit->callback;
+        void *userdata = unit->userdata;
+        ticktimer_free_unit(tt, idx);
+        if(cb != NULL) {
+            cb(userdata);
+        }
+    }
+    tt->now++;
+    ticktimer_cascade(tt);
+}
+
+void ticktimer_register_cb(ticktimer_cb cb) {
+    for(int i = 0; i < callback_count; i++) {
+        if(callbacks[i] == cb) {
+            return;
+        }
+    }
+    if(callback_count >= TICKTIMER_MAX_CALLBACKS) {
+        PERROR("Too many tick timer callbacks registered!");
+        return;
+    }
+    callbacks[callback_count++] = cb;
+}
+
+void ticktimer_set_context(ticktimer *tt, void *context) {
+    tt->context = context;
+}
+
+static int ticktimer_cb_id(ticktimer_cb cb) {
+    for(int i = 0; i < callback_count; i++) {
+        if(callbacks[i] == cb) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void ticktimer_write_slot(ticktimer *tt, const ticktimer_slot *slot, serial *out, uint32_t *count) {
+    for(int idx = slot->head; idx >= 0; idx = ticktimer_unit_at(tt, idx)->next) {
+        ticktimer_unit *unit = ticktimer_unit_at(tt, idx);
+        if(unit->callback == NULL) {
+            continue;
+        }
+        int id = ticktimer_cb_id(unit->callback);
+        if(id < 0 || unit->userdata != tt->context) {
+            DEBUG("Tick timer can't be serialized, leaving it out.");
+            continue;
+        }
+        serial_write_varint(out, unit->fire_tick - tt->now);
+        serial_write_varint(out, id);
+        (*count)++;
+    }
+}
+
+// Written in the order they fire, so reading them back keeps the order
+void ticktimer_serialize(ticktimer *tt, serial *ser) {
+    serial units;
+    serial_create(&units);
+    uint32_t count = 0;
+    for(int i = 0; i < TICKTIMER_WHEEL0_SIZE; i++) {
+        ticktimer_write_slot(tt, &tt->wheel0[(tt->now + i) & (TICKTIMER_WHEEL0_SIZE - 1)], &units, &count);
+    }
+    for(int i = 0; i < TICKTIMER_WHEEL1_SIZE; i++) {
+        ticktimer_write_slot(tt, &tt->wheel1[i], &units, &count);
+    }
+    ticktimer_write_slot(tt, &tt->far, &units, &count);
+    serial_write_varint(ser, count);
+    serial_write(ser, units.data, units.len);
+    serial_free(&units);
+}
+
+void ticktimer_unserialize(ticktimer *tt, serial *ser) {
+    // Whatever was pending is replaced
+    for(unsigned int i = 0; i < vector_size(&tt->units); i++) {
+        ticktimer_unit_at(tt, i)->callback = NULL;
+    }
+    uint32_t count = serial_read_varint(ser);
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t ticks = serial_read_varint(ser);
+        uint32_t id = serial_read_varint(ser);
+        if(id >= (uint32_t)callback_count) {
+            PERROR("Serialized tick timer has an unknown callback %u.", id);
+            continue;
         }
+        ticktimer_add(tt, ticks, callbacks[id], tt->context);
     }
 }
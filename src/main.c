@@ -9,27 +9,75 @@
 #endif
 #include <enet/enet.h>
 #include "engine.h"
+#include "replay_batch.h"
+#include "tournament.h"
+#include "relay.h"
 #include "utils/log.h"
 #include "utils/random.h"
 #include "utils/msgbox.h"
+#include "utils/jobs.h"
+#include "utils/load_timer.h"
+#include "utils/io_worker.h"
+#include "utils/metrics.h"
+#include "utils/cpu.h"
+#include "utils/thread_sched.h"
+#include "game/utils/hash_log.h"
+#include "game/utils/rec_library.h"
 #include "game/game_state.h"
 #include "game/utils/settings.h"
 #include "resources/pathmanager.h"
 #include "resources/ids.h"
 #include "resources/sgmanager.h"
+#include "resources/bundle.h"
+#include "video/surface.h"
 #include "plugins/plugins.h"
-#include "controller/gamecontrollerdb.h"
+#include "controller/joystick.h"
+#include "controller/net_service.h"
+#include "controller/net_capture.h"
 
 int main(int argc, char *argv[]) {
     // Set up initial state for misc things
     char *ip = NULL;
     unsigned short connect_port = 0;
     unsigned short listen_port = 0;
+#ifdef STANDALONE_SERVER
+    const char *batch_dir = NULL;
+    int batch_jobs = 1;
+    int batch_mode = REPLAY_BATCH_PLAY;
+    const char *batch_reference = NULL;
+    int tournament = 0;
+    int tournament_jobs = 1;
+    int tournament_sizes[3] = {0, 0, 0};
+    int relay_port = 0;
+    int relay_sessions = RELAY_DEFAULT_SESSIONS;
+#endif
     engine_init_flags init_flags;
     init_flags.net_mode = NET_MODE_NONE;
     init_flags.record = 0;
+    init_flags.fast_sim = 0;
+    init_flags.benchmark = 0;
+    init_flags.null_video = 0;
+    init_flags.ai_match = 0;
+    init_flags.alloc_check = 0;
+    init_flags.hash_mode = HASH_LOG_WRITE;
+    init_flags.dump_tick = 0;
+    init_flags.check_failed = 0;
+    memset(init_flags.hash_file, 0, 255);
     memset(init_flags.rec_file, 0, 255);
+    memset(init_flags.match_result, 0, 255);
+    memset(init_flags.encode_cmd, 0, 255);
+    memset(init_flags.exec_file, 0, 255);
+    memset(init_flags.load_bench, 0, 255);
     int ret = 0;
+    int pack = 0;
+    char pack_path[512];
+    const char *cpu_features = NULL;
+    const char *netem = NULL;
+    const char *net_capture = NULL;
+    const char *metrics = NULL;
+    const char *net_replay = NULL;
+    const char *recs_dir = NULL;
+    int recs_filters = 0;
 
     // Path manager
     if(pm_init() != 0) {
@@ -51,6 +99,57 @@ int main(int argc, char *argv[]) {
             printf("-c [ip] [port]  Connect to server\n");
             printf("-l [port]       Start server\n");
             printf("play [FILE.REC] Play recording file, defaults to LAST.REC\n");
+            printf("pack [FILE]     Decode all sprites into a bundle for faster loading,\n");
+            printf("                defaults to %s in the resource directory\n", BUNDLE_FILE);
+            printf("recs DIR [har=HAR] [pilot=PILOT]\n");
+            printf("                List the recordings in DIR, by HAR and pilot number or\n");
+            printf("                name. Only new recordings are read, the rest come from\n");
+            printf("                the %s index kept in DIR\n", REC_LIBRARY_FILE);
+            printf("netreplay FILE [ip] [port]\n");
+            printf("                Connect to a listening game and send it the packets received\n");
+            printf("                in a network capture, with their original timing\n");
+            printf("--alloc-check         Report heap allocations in ticks and frames during fights\n");
+            printf("--hash-out FILE       With play, write the state hash of every tick to FILE\n");
+            printf("--hash-check FILE     With play, compare every tick to FILE and stop at the first\n");
+            printf("                      difference, leaving the state in FILE.<tick>.new.state\n");
+            printf("--state-dump N FILE   With play, write the serialized state of tick N to FILE\n");
+            printf("--cpu-features LIST   Only use these of the supported CPU features, eg.\n");
+            printf("                      \"sse2,ssse3\" or \"none\". Known: sse2, ssse3, avx2, neon\n");
+            printf("--netem SPEC          Emulate a bad network for the packets sent, eg.\n");
+            printf("                      \"latency=80,jitter=10,loss=2,dup=1,reorder=1\". A\n");
+            printf("                      channel=N in the list limits the rest to that channel\n");
+            printf("--net-capture FILE    Write every netplay packet sent and received to FILE\n");
+            printf("--exec FILE           Run the console commands in FILE once the game is up.\n");
+            printf("                      \"wait N\" lines wait N ticks, \"bench start\" and\n");
+            printf("                      \"bench stop [FILE]\" time the frames in between\n");
+            printf("--load-benchmark FILE Time startup and loading every arena and HAR, twice,\n");
+            printf("                      and write the times to FILE as JSON\n");
+#ifndef STANDALONE_SERVER
+            printf("--benchmark FILE.REC  Render every tick of a recording and report frame times\n");
+            printf("--encode COMMAND      With --benchmark, pipe the frames as YUV4MPEG2 into\n");
+            printf("                      COMMAND, eg. \"ffmpeg -i - out.mkv\"\n");
+            printf("--null-video          Run without a window, building frames but not drawing\n");
+            printf("                      them. With --benchmark, times the game without the GPU\n");
+#endif
+#ifdef STANDALONE_SERVER
+            printf("--fast          Run the simulation as fast as possible\n");
+            printf("--metrics HOST:PORT\n");
+            printf("                Send tick times, sessions, network and memory numbers to a\n");
+            printf("                statsd collector every %d seconds\n", METRICS_INTERVAL_MS / 1000);
+            printf("batch [DIR] [N] Replay all REC files in DIR with N processes\n");
+            printf("hashes record DIR [N]\n");
+            printf("                Write the per tick state hashes of all REC files in DIR\n");
+            printf("hashes check DIR [N] [REFERENCE]\n");
+            printf("                Replay all REC files in DIR and compare them to their hashes.\n");
+            printf("                On a desync, the REFERENCE binary writes its state too.\n");
+            printf("relay [PORT] [SESSIONS]\n");
+            printf("                Forward netplay between players that meet here with the\n");
+            printf("                same net_relay_session, up to SESSIONS matches at once\n");
+            printf("tournament [N] [HARS] [PILOTS] [DIFFICULTIES]\n");
+            printf("                Play AI matches between all combinations with N processes.\n");
+            printf("                The first HARS HARs, PILOTS pilots and DIFFICULTIES\n");
+            printf("                difficulties are used, all of them by default.\n");
+#endif
             goto exit_0;
         } else if(strcmp(argv[1], "-c") == 0) {
             if(argc >= 3) {
@@ -76,7 +175,147 @@ int main(int argc, char *argv[]) {
                 printf("playing recording LAST.REC\n");
                 snprintf(init_flags.rec_file, 254, "LAST.REC");
             }
+        } else if(strcmp(argv[1], "recs") == 0 && argc >= 3) {
+            recs_dir = argv[2];
+            recs_filters = argc - 3;
+        } else if(strcmp(argv[1], "netreplay") == 0 && argc >= 3) {
+            net_replay = argv[2];
+            if(argc >= 4) {
+                ip = strcpy(malloc(strlen(argv[3])+1), argv[3]);
+            }
+            if(argc >= 5) {
+                connect_port = atoi(argv[4]);
+            }
+        } else if(strcmp(argv[1], "pack") == 0) {
+            pack = 1;
+            if(argc > 2) {
+                snprintf(pack_path, sizeof(pack_path), "%s", argv[2]);
+            } else {
+                snprintf(pack_path, sizeof(pack_path), "%s%s", pm_get_local_path(RESOURCE_PATH), BUNDLE_FILE);
+            }
+#ifdef STANDALONE_SERVER
+        } else if(strcmp(argv[1], "batch") == 0) {
+            batch_dir = (argc > 2) ? argv[2] : ".";
+            if(argc > 3) {
+                batch_jobs = atoi(argv[3]);
+            }
+        } else if(strcmp(argv[1], "hashes") == 0 && argc > 3) {
+            batch_mode = (strcmp(argv[2], "check") == 0) ? REPLAY_BATCH_CHECK : REPLAY_BATCH_RECORD;
+            batch_dir = argv[3];
+            if(argc > 4) {
+                batch_jobs = atoi(argv[4]);
+            }
+            if(argc > 5) {
+                batch_reference = argv[5];
+            }
+        } else if(strcmp(argv[1], "relay") == 0) {
+            relay_port = (argc > 2) ? atoi(argv[2]) : 2097;
+            if(argc > 3) {
+                relay_sessions = atoi(argv[3]);
+            }
+        } else if(strcmp(argv[1], "tournament") == 0) {
+            tournament = 1;
+            tournament_jobs = (argc > 2) ? atoi(argv[2]) : SDL_GetCPUCount();
+            for(int i = 0; i < 3 && argc > 3 + i; i++) {
+                tournament_sizes[i] = atoi(argv[3 + i]);
+            }
+        } else if(strcmp(argv[1], "match") == 0 && argc >= 10) {
+            // Started by tournament: match H1 P1 D1 H2 P2 D2 SEED RESULT
+            init_flags.ai_match = 1;
+            for(int i = 0; i < 2; i++) {
+                init_flags.match_har[i] = atoi(argv[2 + i * 3]);
+                init_flags.match_pilot[i] = atoi(argv[3 + i * 3]);
+                init_flags.match_difficulty[i] = atoi(argv[4 + i * 3]);
+            }
+            init_flags.match_seed = strtoul(argv[8], NULL, 10);
+            strncpy(init_flags.match_result, argv[9], 254);
+#endif
+        }
+    }
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--cpu-features") == 0 && i + 1 < argc) {
+            cpu_features = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--netem") == 0 && i + 1 < argc) {
+            netem = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--net-capture") == 0 && i + 1 < argc) {
+            net_capture = argv[i + 1];
+        }
+        if((strcmp(argv[i], "--exec") == 0 || strcmp(argv[i], "-exec") == 0) && i + 1 < argc) {
+            strncpy(init_flags.exec_file, argv[i + 1], 254);
+        }
+        if(strcmp(argv[i], "--alloc-check") == 0) {
+            init_flags.alloc_check = 1;
+        }
+        if(strcmp(argv[i], "--load-benchmark") == 0 && i + 1 < argc) {
+            strncpy(init_flags.load_bench, argv[i + 1], 254);
+        }
+        if(strcmp(argv[i], "--hash-out") == 0 && i + 1 < argc) {
+            init_flags.hash_mode = HASH_LOG_WRITE;
+            strncpy(init_flags.hash_file, argv[i + 1], 254);
+        }
+        if(strcmp(argv[i], "--hash-check") == 0 && i + 1 < argc) {
+            init_flags.hash_mode = HASH_LOG_CHECK;
+            strncpy(init_flags.hash_file, argv[i + 1], 254);
+        }
+        if(strcmp(argv[i], "--state-dump") == 0 && i + 2 < argc) {
+            init_flags.hash_mode = HASH_LOG_DUMP;
+            init_flags.dump_tick = strtoul(argv[i + 1], NULL, 10);
+            strncpy(init_flags.hash_file, argv[i + 2], 254);
+        }
+    }
+
+#ifndef STANDALONE_SERVER
+    for(int i = 1; i < argc - 1; i++) {
+        if(strcmp(argv[i], "--benchmark") == 0) {
+            init_flags.benchmark = 1;
+            init_flags.record = 0;
+            strncpy(init_flags.rec_file, argv[i + 1], 254);
+        }
+        if(strcmp(argv[i], "--encode") == 0) {
+            strncpy(init_flags.encode_cmd, argv[i + 1], 254);
+        }
+    }
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--null-video") == 0) {
+            init_flags.null_video = 1;
+        }
+    }
+#endif
+
+    // Listing recordings needs nothing else
+    if(recs_dir != NULL) {
+        ret = rec_library_list(recs_dir, recs_filters, argv + 3);
+        goto exit_0;
+    }
+
+#ifdef STANDALONE_SERVER
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--fast") == 0) {
+            init_flags.fast_sim = 1;
         }
+        if(strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics = argv[i + 1];
+        }
+    }
+
+    // Batch mode only hands out work to child processes
+    if(batch_dir != NULL) {
+        ret = replay_batch_hashes(argv[0], batch_dir, batch_jobs, batch_mode, batch_reference) ? 1 : 0;
+        goto exit_0;
+    }
+    if(tournament) {
+        ret = tournament_run(argv[0], tournament_jobs,
+                             tournament_sizes[0], tournament_sizes[1], tournament_sizes[2]) ? 1 : 0;
+        goto exit_0;
+    }
+#endif
+
+    // Time to the first frame is counted from here
+    if(strlen(init_flags.load_bench) > 0) {
+        load_timer_enable();
     }
 
     // Init log
@@ -100,8 +339,24 @@ int main(int argc, char *argv[]) {
     // Dump pathmanager log
     pm_log();
 
-    // Random seed
-    rand_seed(time(NULL));
+    // Pick the vector code paths
+    cpu_init(cpu_features);
+    surface_select_kernels();
+
+    // Network condition emulation
+    if(netem != NULL) {
+        if(net_emu_parse(netem)) {
+            PERROR("Invalid --netem conditions '%s'", netem);
+        } else {
+            INFO("Emulating network conditions: %s", netem);
+        }
+    }
+    if(net_capture != NULL) {
+        net_capture_start(net_capture);
+    }
+
+    // Random seed. Tournament matches are seeded by the tournament.
+    rand_seed(init_flags.ai_match ? init_flags.match_seed : time(NULL));
 
     // Init config
     if(settings_init(pm_get_local_path(CONFIG_PATH))) {
@@ -116,7 +371,9 @@ int main(int argc, char *argv[]) {
     sg_init();
 
     // Find plugins and make sure they are valid
+    uint64_t plugins_start = load_timer_start();
     plugins_init();
+    load_timer_add(LOAD_TIME_PLUGINS, plugins_start);
 
     // Network game override stuff
     if(ip) {
@@ -146,48 +403,32 @@ int main(int argc, char *argv[]) {
     INFO("Found SDL v%d.%d.%d", sdl_linked.major, sdl_linked.minor, sdl_linked.patch);
     INFO("Running on platform: %s", SDL_GetPlatform());
 
+    // Thread pinning and priorities, before any threads are made
+    const settings_gameplay *gameplay = &settings_get()->gameplay;
+    const char *cores[THREAD_ROLE_COUNT];
+    cores[THREAD_ROLE_MAIN] = gameplay->cores_main;
+    cores[THREAD_ROLE_SIM] = gameplay->cores_sim;
+    cores[THREAD_ROLE_AUDIO] = gameplay->cores_audio;
+    cores[THREAD_ROLE_NET] = gameplay->cores_net;
+    cores[THREAD_ROLE_JOBS] = gameplay->cores_jobs;
+    thread_sched_init(cores, gameplay->thread_priority);
+    thread_sched_apply(THREAD_ROLE_MAIN);
+
+    // Background work is shared by one thread per spare core
+    jobs_init(SDL_GetCPUCount() - 1);
+    io_worker_init();
+
 #ifndef STANDALONE_SERVER
     if(SDL_InitSubSystem(SDL_INIT_JOYSTICK|SDL_INIT_GAMECONTROLLER|SDL_INIT_HAPTIC)) {
         err_msgbox("SDL2 Initialization failed: %s", SDL_GetError());
         goto exit_2;
     }
 
-    // Attempt to find gamecontrollerdb.txt, either from resources or from
-    // built-in header
-    SDL_RWops *rw = SDL_RWFromConstMem(gamecontrollerdb, strlen(gamecontrollerdb));
-    SDL_GameControllerAddMappingsFromRW(rw, 1);
-    char *gamecontrollerdbpath = malloc(128);
-    snprintf(gamecontrollerdbpath, 128, "%s/gamecontrollerdb.txt", pm_get_local_path(RESOURCE_PATH));
-    int mappings_loaded = SDL_GameControllerAddMappingsFromFile(gamecontrollerdbpath);
-    if (mappings_loaded > 0) {
-        DEBUG("loaded %d mappings from %s", mappings_loaded, gamecontrollerdbpath);
-    }
-    free(gamecontrollerdbpath);
-
-    // Load up joysticks
-    INFO("Found %d joysticks attached", SDL_NumJoysticks());
-    SDL_Joystick *joy;
-    char guidstr[33];
-    for (int i = 0; i < SDL_NumJoysticks(); i++) {
-        joy = SDL_JoystickOpen(i);
-        if (joy) {
-            SDL_JoystickGUID guid = SDL_JoystickGetGUID(joy);
-            SDL_JoystickGetGUIDString(guid, guidstr, 33);
-            INFO("Opened Joystick %d", i);
-            INFO(" * Name:              %s", SDL_JoystickNameForIndex(i));
-            INFO(" * Number of Axes:    %d", SDL_JoystickNumAxes(joy));
-            INFO(" * Number of Buttons: %d", SDL_JoystickNumButtons(joy));
-            INFO(" * Number of Balls:   %d", SDL_JoystickNumBalls(joy));
-            INFO(" * Number of Hats:    %d", SDL_JoystickNumHats(joy));
-            INFO(" * GUID          :    %s", guidstr);
-        } else {
-            INFO("Joystick %d is unsupported", i);
-        }
-
-        if (SDL_JoystickGetAttached(joy)) {
-            SDL_JoystickClose(joy);
-        }
-    }
+    // Mappings from gamecontrollerdb.txt in the resources override the
+    // built-in ones. Neither is read until a device needs a mapping.
+    char gamecontrollerdbpath[256];
+    snprintf(gamecontrollerdbpath, sizeof(gamecontrollerdbpath), "%s/gamecontrollerdb.txt", pm_get_local_path(RESOURCE_PATH));
+    joystick_init(gamecontrollerdbpath);
 
     // Init libDumb
 #ifdef USE_DUMB
@@ -196,26 +437,60 @@ int main(int argc, char *argv[]) {
 
 #endif // STANDALONE_SERVER
 
+    // Packing only needs the game files
+    if(pack) {
+        ret = bundle_pack(pack_path) ? 1 : 0;
+        goto exit_3;
+    }
+
     // Init enet
     if(enet_initialize() != 0) {
         err_msgbox("Failed to initialize enet");
         goto exit_3;
     }
+    if(metrics != NULL) {
+        metrics_open(metrics);
+    }
+
+    // Replaying a capture only needs the network
+    if(net_replay != NULL) {
+        settings_network *net = &settings_get()->net;
+        ret = net_capture_replay(net_replay, net->net_connect_ip, net->net_connect_port) ? 1 : 0;
+        goto exit_4;
+    }
+
+#ifdef STANDALONE_SERVER
+    if(relay_port > 0) {
+        ret = relay_run(relay_port, relay_sessions) ? 1 : 0;
+        goto exit_4;
+    }
+#endif
 
     // Initialize engine
-    if(engine_init()) {
+    if(engine_init(&init_flags)) {
         err_msgbox("Failed to initialize game engine.");
         goto exit_4;
     }
 
     // Run
     engine_run(&init_flags);
+    if(init_flags.check_failed) {
+        ret = 1;
+    }
 
     // Close everything
     engine_close();
 exit_4:
+    // Let the network threads finish saying goodbye to their peers
+    net_service_wait_all(3000);
+    metrics_close();
     enet_deinitialize();
 exit_3:
+    io_worker_close();
+    jobs_close();
+#ifndef STANDALONE_SERVER
+    joystick_close();
+#endif
     SDL_Quit();
 exit_2:
 #ifdef USE_DUMB
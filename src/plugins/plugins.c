@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include "plugins/plugins.h"
 #include "resources/pathmanager.h"
 #include "utils/scandir.h"
@@ -9,20 +10,144 @@
 #include "utils/log.h"
 
 #define PLUGIN_MAX_COUNT 128
+#define PLUGIN_CACHE_VERSION 1
+
+// A plugin file the manifest cache knows about. Files that turned out not
+// to be plugins are remembered too, with an empty type, so that they
+// aren't opened again on every start.
+typedef struct plugin_file_t {
+    char file[PLUGIN_PATH_LEN];
+    long long mtime;
+    long long size;
+    base_plugin info;
+} plugin_file;
+
 static base_plugin _plugins[PLUGIN_MAX_COUNT];
 static int _plugins_count;
 
+static void plugin_copy_info(char *dst, const char* (*fn)()) {
+    dst[0] = 0;
+    if(fn != NULL) {
+        snprintf(dst, PLUGIN_INFO_LEN, "%s", fn());
+    }
+}
+
+// Opens the plugin file and reads its information. Leaves the handle open.
+static int plugin_probe(base_plugin *p, const char *plugin_file) {
+    p->handle = SDL_LoadObject(p->path);
+    if(p->handle == NULL) {
+        PERROR("Plugin file %s could not be opened: %s", plugin_file, SDL_GetError());
+        return 1;
+    }
+    const char* (*get_name)() = SDL_LoadFunction(p->handle, "plugin_get_name");
+    const char* (*get_author)() = SDL_LoadFunction(p->handle, "plugin_get_author");
+    const char* (*get_license)() = SDL_LoadFunction(p->handle, "plugin_get_license");
+    const char* (*get_type)() = SDL_LoadFunction(p->handle, "plugin_get_type");
+    const char* (*get_version)() = SDL_LoadFunction(p->handle, "plugin_get_version");
+
+    // Make sure we have all functions
+    const char *missing = NULL;
+    if(get_name == NULL) {
+        missing = "get_name";
+    } else if(get_author == NULL) {
+        missing = "get_author";
+    } else if(get_license == NULL) {
+        missing = "get_license";
+    } else if(get_type == NULL) {
+        missing = "get_type";
+    }
+    if(missing != NULL) {
+        PERROR("Plugin %s handle not found: %s", missing, SDL_GetError());
+        SDL_UnloadObject(p->handle);
+        p->handle = NULL;
+        return 1;
+    }
+    if(get_version == NULL) {
+        DEBUG("Plugin get_version handle not found; your plugin is old.");
+    }
+    plugin_copy_info(p->name, get_name);
+    plugin_copy_info(p->author, get_author);
+    plugin_copy_info(p->license, get_license);
+    plugin_copy_info(p->type, get_type);
+    plugin_copy_info(p->version, get_version);
+    return 0;
+}
+
+// Splits off the next tab separated field of a cache line
+static const char* plugin_cache_field(char **line) {
+    char *start = *line;
+    char *end = strpbrk(start, "\t\n");
+    if(end != NULL) {
+        *line = end + (*end == '\t' ? 1 : 0);
+        *end = 0;
+    } else {
+        *line = start + strlen(start);
+    }
+    return start;
+}
+
+static void plugin_cache_load(list *cache) {
+    FILE *fp = fopen(pm_get_local_path(PLUGIN_CACHE_PATH), "r");
+    if(fp == NULL) {
+        return;
+    }
+    char line[1024];
+    if(fgets(line, sizeof(line), fp) == NULL || atoi(line) != PLUGIN_CACHE_VERSION) {
+        fclose(fp);
+        return;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        char *p = line;
+        plugin_file f;
+        memset(&f, 0, sizeof(f));
+        snprintf(f.file, sizeof(f.file), "%s", plugin_cache_field(&p));
+        f.mtime = atoll(plugin_cache_field(&p));
+        f.size = atoll(plugin_cache_field(&p));
+        snprintf(f.info.type, PLUGIN_INFO_LEN, "%s", plugin_cache_field(&p));
+        snprintf(f.info.name, PLUGIN_INFO_LEN, "%s", plugin_cache_field(&p));
+        snprintf(f.info.version, PLUGIN_INFO_LEN, "%s", plugin_cache_field(&p));
+        snprintf(f.info.author, PLUGIN_INFO_LEN, "%s", plugin_cache_field(&p));
+        snprintf(f.info.license, PLUGIN_INFO_LEN, "%s", plugin_cache_field(&p));
+        list_append(cache, &f, sizeof(plugin_file));
+    }
+    fclose(fp);
+}
+
+static void plugin_cache_save(list *files) {
+    const char *path = pm_get_local_path(PLUGIN_CACHE_PATH);
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) {
+        DEBUG("Could not write plugin cache %s.", path);
+        return;
+    }
+    fprintf(fp, "%d\n", PLUGIN_CACHE_VERSION);
+    iterator it;
+    plugin_file *f;
+    list_iter_begin(files, &it);
+    while((f = iter_next(&it)) != NULL) {
+        fprintf(fp, "%s\t%lld\t%lld\t%s\t%s\t%s\t%s\t%s\n",
+                f->file, f->mtime, f->size, f->info.type, f->info.name,
+                f->info.version, f->info.author, f->info.license);
+    }
+    fclose(fp);
+}
+
+static const plugin_file* plugin_cache_find(list *cache, const char *file, long long mtime, long long size) {
+    iterator it;
+    plugin_file *f;
+    list_iter_begin(cache, &it);
+    while((f = iter_next(&it)) != NULL) {
+        if(strcmp(f->file, file) == 0 && f->mtime == mtime && f->size == size) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
 void plugins_init() {
     // Zero out plugin list
     _plugins_count = 0;
-    for(int i = 0; i < PLUGIN_MAX_COUNT; i++) {
-        _plugins[i].handle = NULL;
-        _plugins[i].get_name = NULL;
-        _plugins[i].get_author = NULL;
-        _plugins[i].get_license = NULL;
-        _plugins[i].get_type = NULL;
-        _plugins[i].get_version = NULL;
-    }
+    memset(_plugins, 0, sizeof(_plugins));
 
     // Search for plugins
     INFO("Looking for plugins ...");
@@ -35,95 +160,104 @@ void plugins_init() {
         return;
     }
 
+    // What was found last time, keyed by file name, size and modification time
+    list cache;
+    list files;
+    list_create(&cache);
+    list_create(&files);
+    plugin_cache_load(&cache);
+    int probed = 0;
+
     // Walk through all the plugins, search for valid files
-    if(list_size(&scanned) > 0) {
-        iterator it;
-        list_iter_begin(&scanned, &it);
-        char *plugin_file;
-        char *plugin_path;
-        void *handle;
-        while((plugin_file = iter_next(&it)) != NULL) {
-            // Skip for .. and . :)
-            if(strlen(plugin_file) <= 2) {
-                continue;
-            }
+    iterator it;
+    list_iter_begin(&scanned, &it);
+    char *plugin_file_name;
+    while((plugin_file_name = iter_next(&it)) != NULL && _plugins_count < PLUGIN_MAX_COUNT) {
+        // Skip for .. and . :)
+        if(strlen(plugin_file_name) <= 2) {
+            continue;
+        }
 
-            // Open the plugin file
-            int psize = strlen(pm_get_local_path(PLUGIN_PATH)) + strlen(plugin_file) + 1;
-            plugin_path = malloc(psize);
-            sprintf(plugin_path, "%s%s", pm_get_local_path(PLUGIN_PATH), plugin_file);
-            handle = SDL_LoadObject(plugin_path);
-            free(plugin_path);
-
-            // Check for errors in plugin open
-            if(handle == NULL) {
-                PERROR("Plugin file %s could not be opened: %s", plugin_file, SDL_GetError());
-                continue;
-            }
+        base_plugin *p = &_plugins[_plugins_count];
+        snprintf(p->path, sizeof(p->path), "%s%s", pm_get_local_path(PLUGIN_PATH), plugin_file_name);
+        struct stat st;
+        if(stat(p->path, &st) != 0) {
+            continue;
+        }
 
-            // Build plugin
-            _plugins[_plugins_count].handle = handle;
-            _plugins[_plugins_count].get_name = SDL_LoadFunction(handle, "plugin_get_name");
-            _plugins[_plugins_count].get_author = SDL_LoadFunction(handle, "plugin_get_author");
-            _plugins[_plugins_count].get_license = SDL_LoadFunction(handle, "plugin_get_license");
-            _plugins[_plugins_count].get_type = SDL_LoadFunction(handle, "plugin_get_type");
-            _plugins[_plugins_count].get_version = SDL_LoadFunction(handle, "plugin_get_version");
-
-            // Make sure we have all functions
-            if(_plugins[_plugins_count].get_name == NULL) {
-                PERROR("Plugin get_name handle not found: %s", SDL_GetError());
-                continue;
-            }
-            if(_plugins[_plugins_count].get_author == NULL) {
-                PERROR("Plugin get_author handle not found: %s", SDL_GetError());
-                continue;
-            }
-            if(_plugins[_plugins_count].get_license == NULL) {
-                PERROR("Plugin get_license handle not found: %s", SDL_GetError());
-                continue;
-            }
-            if(_plugins[_plugins_count].get_type == NULL) {
-                PERROR("Plugin get_type handle not found: %s", SDL_GetError());
-                continue;
-            }
-            if(_plugins[_plugins_count].get_version == NULL) {
-                DEBUG("Plugin get_version handle not found; your plugin is old.");
+        plugin_file f;
+        memset(&f, 0, sizeof(f));
+        snprintf(f.file, sizeof(f.file), "%s", plugin_file_name);
+        f.mtime = st.st_mtime;
+        f.size = st.st_size;
+
+        // Only files that are new or have changed need to be opened
+        const plugin_file *cached = plugin_cache_find(&cache, f.file, f.mtime, f.size);
+        if(cached != NULL) {
+            memcpy(p->name, cached->info.name, PLUGIN_INFO_LEN);
+            memcpy(p->author, cached->info.author, PLUGIN_INFO_LEN);
+            memcpy(p->license, cached->info.license, PLUGIN_INFO_LEN);
+            memcpy(p->type, cached->info.type, PLUGIN_INFO_LEN);
+            memcpy(p->version, cached->info.version, PLUGIN_INFO_LEN);
+        } else {
+            probed++;
+            if(plugin_probe(p, plugin_file_name)) {
+                p->type[0] = 0;
             }
+        }
+        f.info = *p;
+        list_append(&files, &f, sizeof(plugin_file));
+        if(p->type[0] == 0) {
+            continue;
+        }
 #ifdef DEBUGMODE
-            // Print some debug information
-            base_plugin *tmp = &_plugins[_plugins_count];
-            DEBUG(" * File: %s", plugin_file);
-            DEBUG("   - Name: %s", tmp->get_name());
-            DEBUG("   - Author: %s", tmp->get_author());
-            DEBUG("   - License: %s", tmp->get_license());
-            DEBUG("   - Type: %s", tmp->get_type());
-            if(tmp->get_version) {
-                DEBUG("   - Version: %s", tmp->get_version());
-            }
-#endif
-            _plugins_count++;
+        // Print some debug information
+        DEBUG(" * File: %s%s", plugin_file_name, p->handle ? "" : " (cached)");
+        DEBUG("   - Name: %s", p->name);
+        DEBUG("   - Author: %s", p->author);
+        DEBUG("   - License: %s", p->license);
+        DEBUG("   - Type: %s", p->type);
+        if(p->version[0]) {
+            DEBUG("   - Version: %s", p->version);
         }
+#endif
+        _plugins_count++;
+    }
+
+    // Rewrite the cache if anything was added, changed or removed
+    if(probed > 0 || list_size(&files) != list_size(&cache)) {
+        plugin_cache_save(&files);
     }
 
-    // Free up the temporary list
+    // Free up the temporary lists
+    list_free(&files);
+    list_free(&cache);
     list_free(&scanned);
 
     // Print some information
-    INFO("%d plugins found.", _plugins_count);
+    INFO("%d plugins found, %d opened.", _plugins_count, probed);
 }
 
 int plugins_get_scaler(scaler_plugin *scaler, const char* name) {
     // Search for a scaler with given name
-    for(int i = 0; i < PLUGIN_MAX_COUNT; i++) {
-        if(_plugins[i].handle != NULL
-           && strcmp(_plugins[i].get_name(), name) == 0
-           && strcmp(_plugins[i].get_type(), "scaler") == 0)
-        {
-            scaler->base = &_plugins[i];
-            scaler->is_factor_available = SDL_LoadFunction(scaler->base->handle, "scaler_is_factor_available");
-            scaler->get_factors_list = SDL_LoadFunction(scaler->base->handle, "scaler_get_factors_list");
-            scaler->get_color_format = SDL_LoadFunction(scaler->base->handle, "scaler_get_color_format");
-            scaler->scale = SDL_LoadFunction(scaler->base->handle, "scaler_handle");
+    for(int i = 0; i < _plugins_count; i++) {
+        base_plugin *p = &_plugins[i];
+        if(strcmp(p->name, name) == 0 && strcmp(p->type, "scaler") == 0) {
+            // Open the plugin now if the information came from the cache
+            if(p->handle == NULL) {
+                p->handle = SDL_LoadObject(p->path);
+                if(p->handle == NULL) {
+                    PERROR("Plugin file %s could not be opened: %s", p->path, SDL_GetError());
+                    return 1;
+                }
+            }
+            scaler->base = p;
+            scaler->is_factor_available = SDL_LoadFunction(p->handle, "scaler_is_factor_available");
+            scaler->get_factors_list = SDL_LoadFunction(p->handle, "scaler_get_factors_list");
+            scaler->get_color_format = SDL_LoadFunction(p->handle, "scaler_get_color_format");
+            scaler->scale = SDL_LoadFunction(p->handle, "scaler_handle");
+            scaler->scale_rows = SDL_LoadFunction(p->handle, "scaler_handle_rows");
+            scaler->scale_index = SDL_LoadFunction(p->handle, "scaler_handle_index");
             return 0;
         }
     }
@@ -133,10 +267,8 @@ int plugins_get_scaler(scaler_plugin *scaler, const char* name) {
 int plugins_get_list_by_type(list *tlist, const char* type) {
     // Search for a scaler with given type
     int count = 0;
-    for(int i = 0; i < PLUGIN_MAX_COUNT; i++) {
-        if(_plugins[i].handle != NULL
-           && strcmp(_plugins[i].get_type(), type) == 0)
-        {
+    for(int i = 0; i < _plugins_count; i++) {
+        if(strcmp(_plugins[i].type, type) == 0) {
             void *ptr = &_plugins[i];
             list_append(tlist,&ptr,sizeof(base_plugin*));
             count++;
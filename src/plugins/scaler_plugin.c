@@ -7,6 +7,8 @@ void scaler_init(scaler_plugin *scaler) {
     scaler->get_factors_list = NULL;
     scaler->get_color_format = NULL;
     scaler->scale = NULL;
+    scaler->scale_rows = NULL;
+    scaler->scale_index = NULL;
 }
 
 int scaler_is_factor_available(scaler_plugin *scaler, int factor) {
@@ -35,4 +37,45 @@ int scaler_scale(scaler_plugin *scaler, const char* in, char* out, int w, int h,
         return scaler->scale(in, out, w, h, factor);
     }
     return 1;
-}
\ No newline at end of file
+}
+
+int scaler_has_scale_rows(scaler_plugin *scaler) {
+    return (scaler->scale_rows != NULL);
+}
+
+// Scales input rows [y0, y1) of the image. Output rows are y0*factor to y1*factor.
+// The whole input image is passed, so that the scaler can look at neighbouring rows.
+int scaler_scale_rows(scaler_plugin *scaler,
+                      const char* in,
+                      char* out,
+                      int w, int h,
+                      int factor,
+                      int y0, int y1) {
+    if(scaler->scale_rows != NULL) {
+        return scaler->scale_rows(in, out, w, h, factor, y0, y1);
+    }
+    return 1;
+}
+
+int scaler_has_scale_index(scaler_plugin *scaler) {
+    return (scaler->scale_index != NULL);
+}
+
+// Scales rows [y0, y1) of a paletted image and its stencil, one byte per pixel.
+// Palette conversion is then done once on the scaled result. Scalers that only
+// pick among neighbouring pixels, such as nearest or Scale2x, can work this way.
+int scaler_scale_index(scaler_plugin *scaler,
+                       const char* in,
+                       const char* in_stencil,
+                       char* out,
+                       char* out_stencil,
+                       int w, int h,
+                       int factor,
+                       int y0, int y1) {
+    if(scaler->scale_index == NULL) {
+        return 1;
+    }
+    scaler->scale_index(in, out, w, h, factor, y0, y1);
+    scaler->scale_index(in_stencil, out_stencil, w, h, factor, y0, y1);
+    return 0;
+}
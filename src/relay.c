@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <SDL2/SDL.h>
+#include <enet/enet.h>
+#include "relay.h"
+#include "controller/net_controller.h"
+#include "game/game_state_type.h"
+#include "utils/hashmap.h"
+#include "utils/iterator.h"
+#include "utils/log.h"
+#include "utils/metrics.h"
+
+// enet can't address more peers than this on one host
+#define RELAY_MAX_PEERS 4095
+
+// A player left waiting this long is sent away
+#define RELAY_WAIT_MS 120000
+
+// How often the session and traffic counts are logged
+#define RELAY_STATS_MS 10000
+
+typedef struct relay_session_t {
+    uint32_t code;
+    ENetPeer *peers[2]; // The first one to arrive is the server
+    Uint32 created;
+} relay_session;
+
+typedef struct relay_t {
+    ENetHost *host;
+    hashmap sessions; // relay_session by code
+    unsigned int active; // Sessions with both players in
+    unsigned int packets;
+    size_t bytes;
+} relay;
+
+static volatile sig_atomic_t relay_running;
+
+static void relay_interrupt(int s) {
+    relay_running = 0;
+}
+
+static void relay_send_paired(ENetPeer *peer, int role) {
+    uint8_t data[2] = {RELAY_PACKET_PAIRED, role};
+    ENetPacket *packet = enet_packet_create(data, sizeof(data), ENET_PACKET_FLAG_RELIABLE);
+    if(enet_peer_send(peer, 0, packet) < 0) {
+        enet_packet_destroy(packet);
+    }
+}
+
+static void relay_connect(relay *r, ENetPeer *peer, uint32_t code) {
+    relay_session *session;
+    unsigned int len;
+    peer->data = NULL;
+    if(code == 0) {
+        DEBUG("Relay: connection without a session code");
+        enet_peer_disconnect(peer, 0);
+        return;
+    }
+    if(hashmap_get(&r->sessions, &code, sizeof(code), (void**)&session, &len) == 0) {
+        if(session->peers[1] != NULL) {
+            DEBUG("Relay: session %u is full", code);
+            enet_peer_disconnect(peer, 0);
+            return;
+        }
+        session->peers[1] = peer;
+        peer->data = session;
+        relay_send_paired(session->peers[0], ROLE_SERVER);
+        relay_send_paired(session->peers[1], ROLE_CLIENT);
+        r->active++;
+        DEBUG("Relay: session %u started", code);
+        return;
+    }
+    relay_session new_session;
+    new_session.code = code;
+    new_session.peers[0] = peer;
+    new_session.peers[1] = NULL;
+    new_session.created = SDL_GetTicks();
+    peer->data = hashmap_put(&r->sessions, &code, sizeof(code), &new_session, sizeof(relay_session));
+}
+
+// When one player leaves, the other one is done too
+static void relay_disconnect(relay *r, ENetPeer *peer) {
+    relay_session *session = peer->data;
+    if(session == NULL) {
+        return;
+    }
+    peer->data = NULL;
+    for(int i = 0; i < 2; i++) {
+        if(session->peers[i] != NULL && session->peers[i] != peer) {
+            session->peers[i]->data = NULL;
+            enet_peer_disconnect_later(session->peers[i], 0);
+        }
+    }
+    if(session->peers[1] != NULL) {
+        r->active--;
+    }
+    DEBUG("Relay: session %u ended", session->code);
+    uint32_t code = session->code;
+    hashmap_del(&r->sessions, &code, sizeof(code));
+}
+
+// The received packet goes out again as is, enet only counts another reference
+static void relay_forward(relay *r, ENetEvent *event) {
+    relay_session *session = event->peer->data;
+    if(session == NULL || session->peers[1] == NULL) {
+        enet_packet_destroy(event->packet);
+        return;
+    }
+    ENetPeer *to = (session->peers[0] == event->peer) ? session->peers[1] : session->peers[0];
+    r->packets++;
+    r->bytes += event->packet->dataLength;
+    if(enet_peer_send(to, event->channelID, event->packet) < 0) {
+        enet_packet_destroy(event->packet);
+    }
+}
+
+// Round trip times and loss are taken over all connected players
+static void relay_report_metrics(relay *r, unsigned int elapsed_ms) {
+    static unsigned int last_packets = 0;
+    static size_t last_bytes = 0;
+    float secs = (elapsed_ms > 0) ? elapsed_ms / 1000.0f : 1.0f;
+    unsigned int peers = 0;
+    unsigned int rtt_sum = 0, rtt_max = 0;
+    float loss_max = 0.0f;
+    for(size_t i = 0; i < r->host->peerCount; i++) {
+        ENetPeer *peer = &r->host->peers[i];
+        if(peer->state != ENET_PEER_STATE_CONNECTED) {
+            continue;
+        }
+        float loss = (float)peer->packetLoss / ENET_PEER_PACKET_LOSS_SCALE;
+        rtt_sum += peer->roundTripTime;
+        rtt_max = (peer->roundTripTime > rtt_max) ? peer->roundTripTime : rtt_max;
+        loss_max = (loss > loss_max) ? loss : loss_max;
+        peers++;
+    }
+    metrics_gauge("relay.sessions", r->active);
+    metrics_gauge("relay.waiting", hashmap_reserved(&r->sessions) - r->active);
+    metrics_gauge("relay.peers", peers);
+    metrics_gauge("relay.packets_per_s", (r->packets - last_packets) / secs);
+    metrics_gauge("relay.bytes_per_s", (r->bytes - last_bytes) / secs);
+    metrics_timing("relay.rtt.avg", peers ? (float)rtt_sum / peers : 0.0f);
+    metrics_timing("relay.rtt.max", rtt_max);
+    metrics_gauge("relay.loss.max", loss_max);
+    metrics_flush();
+    last_packets = r->packets;
+    last_bytes = r->bytes;
+}
+
+static void relay_expire(relay *r, Uint32 now) {
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&r->sessions, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        relay_session *session = pair->val;
+        if(session->peers[1] == NULL && SDL_TICKS_PASSED(now, session->created + RELAY_WAIT_MS)) {
+            DEBUG("Relay: nobody joined session %u", session->code);
+            session->peers[0]->data = NULL;
+            enet_peer_disconnect(session->peers[0], 0);
+            hashmap_delete(&r->sessions, &it);
+        }
+    }
+}
+
+int relay_run(int port, int max_sessions) {
+    relay r;
+    ENetAddress address;
+    ENetEvent event;
+    memset(&r, 0, sizeof(relay));
+
+    int peers = max_sessions * 2;
+    if(peers <= 0 || peers > RELAY_MAX_PEERS) {
+        peers = RELAY_MAX_PEERS;
+    }
+    address.host = ENET_HOST_ANY;
+    address.port = port;
+    r.host = enet_host_create(&address, peers, NET_CHANNEL_COUNT, 0, 0);
+    if(r.host == NULL) {
+        PERROR("Could not start the relay on port %d.", port);
+        return 1;
+    }
+    enet_socket_set_option(r.host->socket, ENET_SOCKOPT_REUSEADDR, 1);
+    hashmap_create(&r.sessions, 8);
+    INFO("Relaying up to %d sessions on port %d.", peers / 2, port);
+
+    relay_running = 1;
+    signal(SIGINT, relay_interrupt);
+    signal(SIGTERM, relay_interrupt);
+    Uint32 last_stats = SDL_GetTicks();
+    while(relay_running) {
+        // Wait for the first event, then take whatever else is there
+        int timeout = 10;
+        while(enet_host_service(r.host, &event, timeout) > 0) {
+            timeout = 0;
+            switch(event.type) {
+                case ENET_EVENT_TYPE_CONNECT:
+                    relay_connect(&r, event.peer, event.data);
+                    break;
+                case ENET_EVENT_TYPE_RECEIVE:
+                    relay_forward(&r, &event);
+                    break;
+                case ENET_EVENT_TYPE_DISCONNECT:
+                    relay_disconnect(&r, event.peer);
+                    break;
+                default:
+                    break;
+            }
+        }
+        // Forwarded packets go out right away, not on the next service call
+        enet_host_flush(r.host);
+
+        Uint32 now = SDL_GetTicks();
+        if(SDL_TICKS_PASSED(now, last_stats + RELAY_STATS_MS)) {
+            relay_expire(&r, now);
+            INFO("Relay: %u sessions, %u waiting, %u packets (%u kB) forwarded",
+                 r.active, hashmap_reserved(&r.sessions) - r.active, r.packets, (unsigned int)(r.bytes / 1024));
+            if(metrics_is_active()) {
+                relay_report_metrics(&r, now - last_stats);
+            }
+            last_stats = now;
+        }
+    }
+
+    INFO("Relay stopping.");
+    for(size_t i = 0; i < r.host->peerCount; i++) {
+        if(r.host->peers[i].state != ENET_PEER_STATE_DISCONNECTED) {
+            enet_peer_disconnect_now(&r.host->peers[i], 0);
+        }
+    }
+    hashmap_free(&r.sessions);
+    enet_host_destroy(r.host);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#include "replay_batch.h"
+#include "utils/scandir.h"
+#include "utils/list.h"
+#include "utils/log.h"
+
+static int is_rec_file(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".rec") == 0;
+}
+
+#ifdef _WIN32
+
+int replay_batch_run(const char *exe, const char *dir, int jobs) {
+    PERROR("Batch replay is not supported on this platform.");
+    return 1;
+}
+
+int replay_batch_hashes(const char *exe, const char *dir, int jobs, int mode, const char *reference) {
+    PERROR("Batch replay is not supported on this platform.");
+    return 1;
+}
+
+#else
+
+// Waits for one child, returns 1 if it failed
+static int replay_batch_wait() {
+    int status;
+    if(wait(&status) < 0) {
+        return 1;
+    }
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+// Runs "exe play <rec> --fast" with the hash flags for the mode
+static void replay_batch_exec(const char *exe, const char *rec, int mode) {
+    char hashes[540];
+    snprintf(hashes, sizeof(hashes), "%s.hashes", rec);
+    if(mode == REPLAY_BATCH_RECORD) {
+        execlp(exe, exe, "play", rec, "--fast", "--hash-out", hashes, (char*)NULL);
+    } else if(mode == REPLAY_BATCH_CHECK) {
+        execlp(exe, exe, "play", rec, "--fast", "--hash-check", hashes, (char*)NULL);
+    } else {
+        execlp(exe, exe, "play", rec, "--fast", (char*)NULL);
+    }
+}
+
+// Has the reference build write its state of the tick the check stopped at
+static void replay_batch_dump_reference(const char *reference, const char *rec) {
+    char path[540];
+    char tick[16];
+    snprintf(path, sizeof(path), "%s.hashes.diverged", rec);
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) {
+        return;
+    }
+    int ok = fgets(tick, sizeof(tick), fp) != NULL;
+    fclose(fp);
+    remove(path);
+    if(!ok) {
+        return;
+    }
+    tick[strcspn(tick, "\r\n")] = 0;
+    snprintf(path, sizeof(path), "%s.hashes.%s.old.state", rec, tick);
+    pid_t pid = fork();
+    if(pid == 0) {
+        execlp(reference, reference, "play", rec, "--fast", "--state-dump", tick, path, (char*)NULL);
+        _exit(127);
+    }
+    if(pid > 0) {
+        replay_batch_wait();
+    }
+    INFO("%s: desync at tick %s, compare %s.hashes.%s.new.state and .old.state", rec, tick, rec, tick);
+}
+
+int replay_batch_hashes(const char *exe, const char *dir, int jobs, int mode, const char *reference) {
+    list files;
+    list_create(&files);
+    if(scan_directory(&files, dir)) {
+        PERROR("Could not open directory %s.", dir);
+        list_free(&files);
+        return 1;
+    }
+    if(jobs < 1) {
+        jobs = 1;
+    }
+
+    int running = 0;
+    int failed = 0;
+    char path[512];
+    iterator it;
+    char *name;
+    list_iter_begin(&files, &it);
+    while((name = iter_next(&it)) != NULL) {
+        if(!is_rec_file(name)) {
+            continue;
+        }
+        if(running >= jobs) {
+            failed += replay_batch_wait();
+            running--;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        pid_t pid = fork();
+        if(pid < 0) {
+            PERROR("Could not start replay of %s.", path);
+            failed++;
+            continue;
+        }
+        if(pid == 0) {
+            replay_batch_exec(exe, path, mode);
+            _exit(127);
+        }
+        running++;
+    }
+    while(running > 0) {
+        failed += replay_batch_wait();
+        running--;
+    }
+
+    // Get the other side of every desync from the reference build
+    if(mode == REPLAY_BATCH_CHECK && reference != NULL && failed > 0) {
+        list_iter_begin(&files, &it);
+        while((name = iter_next(&it)) != NULL) {
+            if(is_rec_file(name)) {
+                snprintf(path, sizeof(path), "%s/%s", dir, name);
+                replay_batch_dump_reference(reference, path);
+            }
+        }
+    }
+
+    list_free(&files);
+    return failed;
+}
+
+int replay_batch_run(const char *exe, const char *dir, int jobs) {
+    return replay_batch_hashes(exe, dir, jobs, REPLAY_BATCH_PLAY, NULL);
+}
+
+#endif // _WIN32
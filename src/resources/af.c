@@ -2,6 +2,54 @@
 #include <shadowdive/shadowdive.h>
 #include "resources/af.h"
 
+static int af_is_plain_input(const char *str) {
+    for(; *str != '\0'; str++) {
+        if(!((*str >= '1' && *str <= '9') || *str == 'K' || *str == 'P')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int af_is_basic_move(const char *str) {
+    static const char *basic[] = {"K", "K1", "K2", "K3", "K4", "K6", "P", "P1", "P2", "P3", "P4", "P6"};
+    for(unsigned int i = 0; i < sizeof(basic) / sizeof(basic[0]); i++) {
+        if(!strcmp(basic[i], str)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void af_build_ai_moves(af *a) {
+    af_ai_moves *m = &a->ai_moves;
+    move_mask_clear(&m->attacks);
+    move_mask_clear(&m->specials);
+    move_mask_clear(&m->close_range);
+    for(int i = 0; i < 70; i++) {
+        af_move *move = af_get_move(a, i);
+        if(move == NULL) {
+            continue;
+        }
+        const char *move_str = str_c(&move->move_string);
+        if(move_str[0] != '\0' && af_is_plain_input(move_str) &&
+           (move->damage > 0 || move->category == CAT_PROJECTILE || move->category == CAT_SCRAP || move->category == CAT_DESTRUCTION)) {
+            move_mask_set(&m->attacks, i);
+        }
+        if(!af_is_basic_move(move_str)) {
+            move_mask_set(&m->specials, i);
+        }
+        switch(move->category) {
+            case CAT_CLOSE:
+            case CAT_LOW:
+            case CAT_MEDIUM:
+            case CAT_HIGH:
+                move_mask_set(&m->close_range, i);
+                break;
+        }
+    }
+}
+
 void af_create(af *a, void *src) {
     sd_af_file *sdaf = (sd_af_file*)src;
 
@@ -24,26 +72,43 @@ void af_create(af *a, void *src) {
     a->sound_translation_table[27] = 0;
 
     // Moves
+    move_trie_create(&a->move_trie);
     for(int i = 0; i < 70; i++) {
         if(sdaf->moves[i] != NULL) {
             af_move_create(&a->moves[i], (void*)sdaf->moves[i], i);
+            move_trie_add(&a->move_trie, str_c(&a->moves[i].move_string), i);
         } else {
             a->moves[i].id = -1;
         }
     }
+    move_trie_build(&a->move_trie);
+    af_build_ai_moves(a);
 }
 
 af_move* af_get_move(af *a, int id) {
-    if(a->moves[id].id == -1) {
+    if(id < 0 || id >= AF_MOVE_COUNT || a->moves[id].id == -1) {
         return NULL;
     }
     return &a->moves[id];
 }
 
 void af_free(af *a) {
-    for(int i = 0; i < 70; i++) {
+    for(int i = 0; i < AF_MOVE_COUNT; i++) {
+        if(a->moves[i].id != -1) {
+            af_move_free(&a->moves[i]);
+        }
+    }
+    move_trie_free(&a->move_trie);
+}
+
+int af_free_step(af *a) {
+    for(int i = 0; i < AF_MOVE_COUNT; i++) {
         if(a->moves[i].id != -1) {
             af_move_free(&a->moves[i]);
+            a->moves[i].id = -1;
+            return 1;
         }
     }
+    move_trie_free(&a->move_trie);
+    return 0;
 }
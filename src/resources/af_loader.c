@@ -1,10 +1,30 @@
 #include "resources/af_loader.h"
 #include "resources/pathmanager.h"
+#include "utils/load_timer.h"
 #include <shadowdive/shadowdive.h>
 
+static void har_fix_sprite_coords(animation *ani, int fix_x, int fix_y) {
+    iterator it;
+    sprite *s;
+    // Fix sprite positions
+    vector_iter_begin(&ani->sprites, &it);
+    while((s = iter_next(&it)) != NULL) {
+        s->pos.x += fix_x;
+        s->pos.y += fix_y;
+    }
+    // Fix collisions coordinates
+    collision_coord *c;
+    vector_iter_begin(&ani->collision_coords, &it);
+    while((c = iter_next(&it)) != NULL) {
+        c->pos.x += fix_x;
+        c->pos.y += fix_y;
+    }
+}
+
 int load_af_file(af *a, int id) {
     // Get directory + filename
     const char *filename = pm_get_resource_path(id);
+    uint64_t start = load_timer_start();
 
     // Load up AF file from libSD
     sd_af_file tmp;
@@ -19,5 +39,23 @@ int load_af_file(af *a, int id) {
     // Convert
     af_create(a, &tmp);
     sd_af_free(&tmp);
+
+    // Then decode the sprites of all moves at once
+    sprite_batch batch;
+    sprite_batch_begin(&batch);
+    for(int i = 0; i < AF_MOVE_COUNT; i++) {
+        af_move *move = af_get_move(a, i);
+        if(move != NULL) {
+            animation_decode_sprites(&move->ani, &batch);
+        }
+    }
+    sprite_batch_finish(&batch);
+
+    // Fix some coordinates on jump sprites
+    af_move *jump = af_get_move(a, ANIM_JUMPING);
+    if(jump != NULL) {
+        har_fix_sprite_coords(&jump->ani, 0, -50);
+    }
+    load_timer_add(LOAD_TIME_AF, start);
     return 0;
 }
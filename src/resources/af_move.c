@@ -15,6 +15,16 @@ void af_move_create(af_move *move, void *src, int id) {
     move->scrap_amount = sdmv->scrap_amount;
     move->pos_constraints = sdmv->unknown_2;
     animation_create(&move->ani, sdmv->animation, id);
+
+    move->reach = -1;
+    iterator it;
+    collision_coord *c;
+    vector_iter_begin(&move->ani.collision_coords, &it);
+    while((c = iter_next(&it)) != NULL) {
+        if(c->pos.x > move->reach) {
+            move->reach = c->pos.x;
+        }
+    }
 }
 
 void af_move_free(af_move *move) {
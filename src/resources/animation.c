@@ -1,6 +1,70 @@
 #include "resources/animation.h"
 #include <shadowdive/shadowdive.h>
 #include <stdlib.h>
+#include "utils/log.h"
+
+VECTOR_DEFINE(sprite_vec, sprite)
+VECTOR_DEFINE(coord_vec, collision_coord)
+
+// Decodes the animation string once and builds the per-frame tag tables
+// and the frame timeline.
+// The decoded script is kept, so objects that play the animation only need
+// to point at it. Needs the collision coords indexed, for finding the first
+// frame that can hit.
+static void animation_compile_tags(animation *ani) {
+    sd_script *script = &ani->script;
+    int err_pos;
+    tag_table_create(&ani->tags);
+    frame_timeline_create(&ani->timeline);
+    ani->hit_tick = -1;
+    sd_script_create(script);
+    ani->script_ok = (sd_script_decode(script, str_c(&ani->animation_string), &err_pos) == SD_SUCCESS);
+    if(ani->script_ok) {
+        tag_table_compile(&ani->tags, script);
+        frame_timeline_compile(&ani->timeline, script);
+        for(int i = 0; i < script->frame_count; i++) {
+            int count;
+            animation_get_frame_coords(ani, script->frames[i].sprite, &count);
+            if(count > 0) {
+                ani->hit_tick = frame_timeline_frame_start(&ani->timeline, i);
+                break;
+            }
+        }
+    } else {
+        DEBUG("Unable to compile tags for animation %d, error at position %d", ani->id, err_pos);
+    }
+}
+
+// Groups the collision coords by frame, so that hit checks only look at the
+// coords of the current frame. The sort is stable, because the hit point is
+// the average of the first few coords that hit.
+static void animation_index_coords(animation *ani) {
+    int count = vector_size(&ani->collision_coords);
+    collision_coord *coords = coord_vec_at(&ani->collision_coords, 0);
+    for(int i = 1; i < count; i++) {
+        collision_coord tmp = coords[i];
+        int k = i - 1;
+        for(; k >= 0 && coords[k].frame_index > tmp.frame_index; k--) {
+            coords[k + 1] = coords[k];
+        }
+        coords[k + 1] = tmp;
+    }
+
+    ani->frame_coord_count = 0;
+    for(int i = 0; i < count; i++) {
+        if(coords[i].frame_index >= ani->frame_coord_count) {
+            ani->frame_coord_count = coords[i].frame_index + 1;
+        }
+    }
+    ani->frame_coords = malloc(sizeof(int) * (ani->frame_coord_count + 1));
+    int n = 0;
+    for(int f = 0; f <= ani->frame_coord_count; f++) {
+        while(n < count && coords[n].frame_index < f) {
+            n++;
+        }
+        ani->frame_coords[f] = n;
+    }
+}
 
 void animation_create(animation *ani, void *src, int id) {
     sd_animation *sdani = (sd_animation*)src;
@@ -11,13 +75,15 @@ void animation_create(animation *ani, void *src, int id) {
     str_create_from_cstr(&ani->animation_string, sdani->anim_string);
 
     // Copy collision coordinates
-    vector_create(&ani->collision_coords, sizeof(collision_coord));
+    coord_vec_create(&ani->collision_coords);
     collision_coord tmp_coord;
     for(int i = 0; i < sdani->coord_count; i++) {
         tmp_coord.pos = vec2i_create(sdani->coord_table[i].x, sdani->coord_table[i].y);
         tmp_coord.frame_index = sdani->coord_table[i].frame_id;
-        vector_append(&ani->collision_coords, &tmp_coord);
+        coord_vec_append(&ani->collision_coords, &tmp_coord);
     }
+    animation_index_coords(ani);
+    animation_compile_tags(ani);
 
     ani->extra_string_count = sdani->extra_string_count;
     // Copy extra strings
@@ -30,12 +96,18 @@ void animation_create(animation *ani, void *src, int id) {
         // inside it, which vector_append does not copy
     }
 
-    // Handle sprites
-    vector_create(&ani->sprites, sizeof(sprite));
+    // Handle sprites. They are decoded later, see animation_decode_sprites
+    sprite_vec_create(&ani->sprites);
     sprite tmp_sprite;
     for(int i = 0; i < sdani->sprite_count; i++) {
-        sprite_create(&tmp_sprite, (void*)sdani->sprites[i], i);
-        vector_append(&ani->sprites, &tmp_sprite);
+        sprite_create_deferred(&tmp_sprite, (void*)sdani->sprites[i], i);
+        sprite_vec_append(&ani->sprites, &tmp_sprite);
+    }
+}
+
+void animation_decode_sprites(animation *ani, sprite_batch *batch) {
+    for(unsigned int i = 0; i < vector_size(&ani->sprites); i++) {
+        sprite_batch_add(batch, sprite_vec_at(&ani->sprites, i));
     }
 }
 
@@ -44,30 +116,58 @@ animation* create_animation_from_single(sprite *sp, vec2i pos) {
     a->start_pos = pos;
     a->id = -1;
     str_create_from_cstr(&a->animation_string, "A9999999999");
-    vector_create(&a->collision_coords, sizeof(collision_coord));
+    coord_vec_create(&a->collision_coords);
+    animation_index_coords(a);
+    animation_compile_tags(a);
     vector_create(&a->extra_strings, sizeof(str));
-    vector_create(&a->sprites, sizeof(sprite));
-    vector_append(&a->sprites, sp);
+    sprite_vec_create(&a->sprites);
+    sprite_vec_append(&a->sprites, sp);
     free(sp);
     return a;
 }
 
 sprite* animation_get_sprite(animation *ani, int sprite_id) {
-    return (sprite*)vector_get(&ani->sprites, sprite_id);
+    return sprite_vec_get(&ani->sprites, sprite_id);
 }
 
 int animation_get_sprite_count(animation *ani) {
     return vector_size(&ani->sprites);
 }
 
+collision_coord* animation_get_frame_coords(animation *ani, int frame_index, int *count) {
+    if(frame_index < 0 || frame_index >= ani->frame_coord_count) {
+        *count = 0;
+        return NULL;
+    }
+    int start = ani->frame_coords[frame_index];
+    *count = ani->frame_coords[frame_index + 1] - start;
+    return (*count > 0) ? coord_vec_at(&ani->collision_coords, start) : NULL;
+}
+
+// Decodes up to budget deferred sprites, returns what is left of the budget
+int animation_predecode(animation *ani, int budget) {
+    for(unsigned int i = 0; budget > 0 && i < vector_size(&ani->sprites); i++) {
+        sprite *s = sprite_vec_at(&ani->sprites, i);
+        if(!sprite_is_decoded(s)) {
+            sprite_use_surface(s);
+            budget--;
+        }
+    }
+    return budget;
+}
+
 void animation_free(animation *ani) {
     iterator it;
 
     // Free animation string
     str_free(&ani->animation_string);
+    sd_script_free(&ani->script);
+    tag_table_free(&ani->tags);
+    frame_timeline_free(&ani->timeline);
 
     // Free collision coordinates
     vector_free(&ani->collision_coords);
+    free(ani->frame_coords);
 
     // Free extra strings
     vector_iter_begin(&ani->extra_strings, &it);
@@ -78,10 +178,8 @@ void animation_free(animation *ani) {
     vector_free(&ani->extra_strings);
 
     // Free animations
-    vector_iter_begin(&ani->sprites, &it);
-    sprite *tmp_sprite = NULL;
-    while((tmp_sprite = iter_next(&it)) != NULL) {
-        sprite_free(tmp_sprite);
+    for(unsigned int i = 0; i < vector_size(&ani->sprites); i++) {
+        sprite_free(sprite_vec_at(&ani->sprites, i));
     }
     vector_free(&ani->sprites);
 }
@@ -17,6 +17,10 @@ void bk_create(bk *b, void *src) {
         sdbk->background->h,
         sdbk->background->data);
 
+    // Backgrounds are solid, so blitters can copy them row by row
+    surface_build_rle(&b->background);
+    surface_build_pal_mask(&b->background);
+
     // Copy sound translation table
     memcpy(b->sound_translation_table, sdbk->soundtable, 30);
 
@@ -29,21 +33,29 @@ void bk_create(bk *b, void *src) {
     // Copy info structs
     hashmap_create(&b->infos, 7);
     bk_info tmp_bk_info;
-    for(int i = 0; i < 50; i++) {
+    for(int i = 0; i < BK_INFO_COUNT; i++) {
         if(sdbk->anims[i] != NULL) {
             bk_info_create(&tmp_bk_info, (void*)sdbk->anims[i], i);
             hashmap_iput(&b->infos, i, &tmp_bk_info, sizeof(bk_info));
         }
     }
+
+    // Hashmap values stay where they are, so they can be indexed directly
+    for(int i = 0; i < BK_INFO_COUNT; i++) {
+        bk_info *val;
+        unsigned int tmp;
+        if(hashmap_iget(&b->infos, i, (void**)&val, &tmp) == 1) {
+            val = NULL;
+        }
+        b->info_index[i] = val;
+    }
 }
 
 bk_info* bk_get_info(bk *b, int id) {
-    bk_info *val;
-    unsigned int tmp;
-    if(hashmap_iget(&b->infos, id, (void**)&val, &tmp) == 1) {
+    if(id < 0 || id >= BK_INFO_COUNT) {
         return NULL;
     }
-    return val;
+    return b->info_index[id];
 }
 
 palette* bk_get_palette(bk *b, int id) {
@@ -67,3 +79,16 @@ void bk_free(bk *b) {
     }
     hashmap_free(&b->infos);
 }
+
+int bk_free_step(bk *b) {
+    iterator it;
+    hashmap_iter_begin(&b->infos, &it);
+    hashmap_pair *pair = iter_next(&it);
+    if(pair == NULL) {
+        bk_free(b);
+        return 0;
+    }
+    bk_info_free((bk_info*)pair->val);
+    hashmap_delete(&b->infos, &it);
+    return 1;
+}
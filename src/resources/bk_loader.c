@@ -1,10 +1,12 @@
 #include "resources/bk_loader.h"
 #include "resources/pathmanager.h"
+#include "utils/load_timer.h"
 #include <shadowdive/shadowdive.h>
 
 int load_bk_file(bk *b, int id) {
     // Get directory + filename
     const char *filename = pm_get_resource_path(id);
+    uint64_t start = load_timer_start();
 
     // Load up BK file from libSD
     sd_bk_file tmp;
@@ -19,5 +21,17 @@ int load_bk_file(bk *b, int id) {
     // Convert
     bk_create(b, &tmp);
     sd_bk_free(&tmp);
+
+    // Then decode the sprites of all animations at once
+    sprite_batch batch;
+    sprite_batch_begin(&batch);
+    for(int i = 0; i < BK_INFO_COUNT; i++) {
+        bk_info *info = bk_get_info(b, i);
+        if(info != NULL) {
+            animation_decode_sprites(&info->ani, &batch);
+        }
+    }
+    sprite_batch_finish(&batch);
+    load_timer_add(LOAD_TIME_BK, start);
     return 0;
 }
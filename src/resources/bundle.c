@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "resources/bundle.h"
+#include "resources/bk_loader.h"
+#include "resources/af_loader.h"
+#include "resources/sprite.h"
+#include "resources/ids.h"
+#include "utils/vector.h"
+#include "utils/log.h"
+#include "utils/mapfile.h"
+
+#define BUNDLE_MAGIC 0x42464D4F // "OMFB"
+#define BUNDLE_VERSION 2
+
+// Sprite data starts on a cache line, like surface buffers do
+#define BUNDLE_ALIGN 64
+
+/*
+ * The file is a header, a table of entries sorted by key, and the sprite
+ * data. Everything is addressed by offsets from the start of the file, so
+ * it can be used straight from the mapping. Sprites are kept the way
+ * sprite_decode leaves them, with their runs, hit mask and palette mask, so
+ * surfaces can point into the file instead of holding copies. The mapping
+ * is read-only and backed by the file, so every process running from the
+ * same resource directory shares the same pages.
+ */
+typedef struct bundle_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} bundle_header;
+
+typedef struct bundle_entry_t {
+    uint64_t key;
+    uint32_t encoded_len; // Guards against hash collisions a little more
+    uint16_t w;
+    uint16_t h;
+    uint32_t offset; // See bundle_layout
+    uint32_t run_count;
+    uint32_t pixel_bytes; // Only the pixels of the runs if rle_pixels is set
+    uint8_t opaque;
+    uint8_t rle_pixels;
+    uint16_t reserved;
+} bundle_entry;
+
+// Where the parts of a sprite are, from the entry offset
+typedef struct bundle_layout_t {
+    uint32_t runs;
+    uint32_t rows;
+    uint32_t offsets; // Row starts in the packed pixels, if rle_pixels is set
+    uint32_t hitmask;
+    uint32_t pal_used;
+    uint32_t size;
+} bundle_layout;
+
+typedef struct bundle_collected_t {
+    bundle_entry entry;
+    char *data;
+} bundle_collected;
+
+static mapfile _file;
+static const bundle_entry *_entries = NULL;
+static surface_rle *_rles = NULL; // Per entry, pointing into the file; runs is NULL if the entry is broken
+static uint32_t _count = 0;
+
+static int _collecting = 0;
+static vector _collected;
+static SDL_SpinLock _collected_lock; // Sprites are decoded on job threads
+
+// FNV-1a over the encoded sprite
+static uint64_t bundle_key(const sd_sprite *sdsprite) {
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned int i = 0; i < sdsprite->len; i++) {
+        h = (h ^ (uint8_t)sdsprite->data[i]) * 1099511628211ull;
+    }
+    h = (h ^ sdsprite->width) * 1099511628211ull;
+    h = (h ^ sdsprite->height) * 1099511628211ull;
+    return h;
+}
+
+static uint32_t bundle_align4(uint32_t n) {
+    return (n + 3) & ~3u;
+}
+
+static void bundle_layout_of(const bundle_entry *e, bundle_layout *l) {
+    uint32_t rows = (e->h + 1) * sizeof(unsigned int);
+    l->runs = bundle_align4(e->pixel_bytes);
+    l->rows = l->runs + e->run_count * 2 * sizeof(uint16_t);
+    l->offsets = l->rows + rows;
+    l->hitmask = l->offsets + (e->rle_pixels ? rows : 0);
+    l->pal_used = l->hitmask + ((uint32_t)e->w * e->h / 32 + 1) * sizeof(uint32_t);
+    l->size = l->pal_used + sizeof(palette_mask);
+}
+
+int bundle_open(const char *path) {
+    bundle_close();
+    if(mapfile_open(&_file, path)) {
+        DEBUG("No sprite bundle at %s.", path);
+        return 1;
+    }
+    const bundle_header *header = (const bundle_header*)_file.data;
+    if(_file.size < sizeof(bundle_header)
+            || header->magic != BUNDLE_MAGIC || header->version != BUNDLE_VERSION
+            || header->count > (_file.size - sizeof(bundle_header)) / sizeof(bundle_entry)) {
+        PERROR("Sprite bundle %s is not valid, decoding sprites from the game files.", path);
+        bundle_close();
+        return 1;
+    }
+    _entries = (const bundle_entry*)(_file.data + sizeof(bundle_header));
+    _count = header->count;
+
+    // Only the run tables need pointers of this process, and they are made
+    // up front so that decode jobs never write here
+    _rles = calloc(_count > 0 ? _count : 1, sizeof(surface_rle));
+    bundle_layout l;
+    for(uint32_t i = 0; i < _count; i++) {
+        const bundle_entry *e = &_entries[i];
+        bundle_layout_of(e, &l);
+        if(e->offset % 4 != 0 || e->offset + (size_t)l.size > _file.size) {
+            continue;
+        }
+        const char *base = _file.data + e->offset;
+        _rles[i].runs = (uint16_t*)(base + l.runs);
+        _rles[i].rows = (unsigned int*)(base + l.rows);
+        _rles[i].offsets = e->rle_pixels ? (unsigned int*)(base + l.offsets) : NULL;
+    }
+    INFO("Mapped %u decoded sprites from %s.", _count, path);
+    return 0;
+}
+
+// Sprites found in the bundle point into it, so this must come after they are all freed
+void bundle_close() {
+    mapfile_close(&_file);
+    free(_rles);
+    _rles = NULL;
+    _entries = NULL;
+    _count = 0;
+}
+
+int bundle_find_sprite(const sd_sprite *sdsprite, surface *sur) {
+    if(_count == 0) {
+        return 1;
+    }
+    uint64_t key = bundle_key(sdsprite);
+    int lo = 0;
+    int hi = (int)_count - 1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const bundle_entry *e = &_entries[mid];
+        if(e->key < key) {
+            lo = mid + 1;
+        } else if(e->key > key) {
+            hi = mid - 1;
+        } else {
+            if(e->encoded_len != sdsprite->len || _rles[mid].runs == NULL) {
+                return 1;
+            }
+            bundle_layout l;
+            bundle_layout_of(e, &l);
+            char *base = (char*)_file.data + e->offset;
+            surface s;
+            memset(&s, 0, sizeof(s));
+            s.w = e->w;
+            s.h = e->h;
+            s.type = SURFACE_TYPE_PALETTE;
+            s.data = base;
+            s.rle = &_rles[mid];
+            s.hitmask = (uint32_t*)(base + l.hitmask);
+            s.pal_used = (palette_mask*)(base + l.pal_used);
+            s.opaque = e->opaque;
+            s.rle_pixels = e->rle_pixels;
+            surface_create_borrowed(sur, &s);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bundle_collect_sprite(const sd_sprite *sdsprite, const surface *sur) {
+    if(!_collecting) {
+        return;
+    }
+    // Only what sprite_decode fully packed can be used as is
+    if(sur->type != SURFACE_TYPE_PALETTE || sur->stencil != NULL || sur->rle == NULL
+            || sur->hitmask == NULL || sur->pal_used == NULL) {
+        DEBUG("Sprite of %dx%d is not packed, leaving it out of the bundle.", sur->w, sur->h);
+        return;
+    }
+    const surface_rle *rle = sur->rle;
+    bundle_collected c;
+    memset(&c, 0, sizeof(c));
+    c.entry.key = bundle_key(sdsprite);
+    c.entry.encoded_len = sdsprite->len;
+    c.entry.w = sur->w;
+    c.entry.h = sur->h;
+    c.entry.run_count = rle->rows[sur->h];
+    c.entry.pixel_bytes = sur->rle_pixels ? rle->offsets[sur->h] : (uint32_t)sur->w * sur->h;
+    c.entry.opaque = sur->opaque;
+    c.entry.rle_pixels = sur->rle_pixels;
+
+    bundle_layout l;
+    bundle_layout_of(&c.entry, &l);
+    size_t rows = (sur->h + 1) * sizeof(unsigned int);
+    c.data = calloc(1, l.size);
+    memcpy(c.data, sur->data, c.entry.pixel_bytes);
+    memcpy(c.data + l.runs, rle->runs, c.entry.run_count * 2 * sizeof(uint16_t));
+    memcpy(c.data + l.rows, rle->rows, rows);
+    if(sur->rle_pixels) {
+        memcpy(c.data + l.offsets, rle->offsets, rows);
+    }
+    memcpy(c.data + l.hitmask, sur->hitmask, l.pal_used - l.hitmask);
+    memcpy(c.data + l.pal_used, sur->pal_used, sizeof(palette_mask));
+    SDL_AtomicLock(&_collected_lock);
+    vector_append(&_collected, &c);
+    SDL_AtomicUnlock(&_collected_lock);
+}
+
+static int bundle_collected_cmp(const void *a, const void *b) {
+    const bundle_collected *ca = a;
+    const bundle_collected *cb = b;
+    return (ca->entry.key > cb->entry.key) - (ca->entry.key < cb->entry.key);
+}
+
+static int bundle_write(const char *path) {
+    // Sprites shared between animations and files are stored once
+    vector_sort(&_collected, bundle_collected_cmp);
+    vector unique;
+    vector_create(&unique, sizeof(bundle_collected));
+    iterator it;
+    bundle_collected *c;
+    uint64_t last_key = 0;
+    vector_iter_begin(&_collected, &it);
+    while((c = iter_next(&it)) != NULL) {
+        if(vector_size(&unique) == 0 || c->entry.key != last_key) {
+            vector_append(&unique, c);
+            last_key = c->entry.key;
+        }
+    }
+
+    bundle_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BUNDLE_MAGIC;
+    header.version = BUNDLE_VERSION;
+    header.count = vector_size(&unique);
+    uint32_t offset = sizeof(bundle_header) + header.count * sizeof(bundle_entry);
+    bundle_layout l;
+    vector_iter_begin(&unique, &it);
+    while((c = iter_next(&it)) != NULL) {
+        offset = (offset + BUNDLE_ALIGN - 1) & ~(uint32_t)(BUNDLE_ALIGN - 1);
+        c->entry.offset = offset;
+        bundle_layout_of(&c->entry, &l);
+        offset += l.size;
+    }
+
+    int err = 1;
+    FILE *fp = fopen(path, "wb");
+    if(fp != NULL) {
+        err = fwrite(&header, sizeof(header), 1, fp) != 1;
+        vector_iter_begin(&unique, &it);
+        while(!err && (c = iter_next(&it)) != NULL) {
+            err |= fwrite(&c->entry, sizeof(bundle_entry), 1, fp) != 1;
+        }
+        static const char padding[BUNDLE_ALIGN];
+        uint32_t pos = sizeof(bundle_header) + header.count * sizeof(bundle_entry);
+        vector_iter_begin(&unique, &it);
+        while(!err && (c = iter_next(&it)) != NULL) {
+            bundle_layout_of(&c->entry, &l);
+            size_t pad = c->entry.offset - pos;
+            err |= fwrite(padding, 1, pad, fp) != pad;
+            err |= fwrite(c->data, 1, l.size, fp) != l.size;
+            pos = c->entry.offset + l.size;
+        }
+        fclose(fp);
+    }
+    if(err) {
+        PERROR("Could not write sprite bundle %s.", path);
+    } else {
+        INFO("Wrote %u sprites (%u bytes) to %s.", header.count, offset, path);
+    }
+    vector_free(&unique);
+    return err;
+}
+
+int bundle_pack(const char *path) {
+    // The bundle must not serve the sprites it is being built from
+    bundle_close();
+    sprite_set_lazy(0);
+    vector_create(&_collected, sizeof(bundle_collected));
+    _collecting = 1;
+
+    int failed = 0;
+    for(int i = 0; i < NUMBER_OF_RESOURCES; i++) {
+        if(is_scene(i)) {
+            bk b;
+            if(load_bk_file(&b, i)) {
+                PERROR("Could not load %s.", get_resource_name(i));
+                failed = 1;
+                continue;
+            }
+            bk_free(&b);
+        } else if(is_har(i)) {
+            af a;
+            if(load_af_file(&a, i)) {
+                PERROR("Could not load %s.", get_resource_name(i));
+                failed = 1;
+                continue;
+            }
+            af_free(&a);
+        }
+    }
+    _collecting = 0;
+    if(!failed) {
+        failed = bundle_write(path);
+    }
+
+    iterator it;
+    bundle_collected *c;
+    vector_iter_begin(&_collected, &it);
+    while((c = iter_next(&it)) != NULL) {
+        free(c->data);
+    }
+    vector_free(&_collected);
+    return failed;
+}
@@ -25,6 +25,34 @@ void font_free(font *font) {
         free(*sur);
     }
     vector_free(&font->surfaces);
+    if(font->atlas != NULL) {
+        surface_free(font->atlas);
+        free(font->atlas);
+        font->atlas = NULL;
+    }
+}
+
+// Finds the top left corner of glyph code in the font atlas
+void font_get_atlas_pos(const font *font, int code, int *x, int *y) {
+    *x = (code % FONT_ATLAS_COLS) * (font->w + FONT_ATLAS_PADDING);
+    *y = (code / FONT_ATLAS_COLS) * (font->h + FONT_ATLAS_PADDING);
+}
+
+// Packs all glyphs into one surface, so that text only needs one texture
+static void font_build_atlas(font *font) {
+    int count = vector_size(&font->surfaces);
+    int rows = (count + FONT_ATLAS_COLS - 1) / FONT_ATLAS_COLS;
+    int x, y;
+    font->atlas = malloc(sizeof(surface));
+    surface_create(font->atlas, SURFACE_TYPE_ALPHA,
+                   FONT_ATLAS_COLS * (font->w + FONT_ATLAS_PADDING),
+                   rows * (font->h + FONT_ATLAS_PADDING));
+    surface_clear(font->atlas);
+    for(int i = 0; i < count; i++) {
+        surface **sur = vector_get(&font->surfaces, i);
+        font_get_atlas_pos(font, i, &x, &y);
+        surface_rgba_blit(font->atlas, *sur, x, y);
+    }
 }
 
 int font_load(font *font, const char* filename, unsigned int size) {
@@ -50,12 +78,16 @@ int font_load(font *font, const char* filename, unsigned int size) {
         return 2;
     }
 
-    // Load into textures
+    // Load into textures. Glyphs are white, so only the alpha is kept;
+    // the color is given when drawing.
     sd_rgba_image_create(&img, pixsize, pixsize);
     for(int i = 0; i < 224; i++) {
         sur = malloc(sizeof(surface));
         sd_font_decode(&sdfont, &img, i, 0xFF, 0xFF, 0xFF);
-        surface_create_from_data(sur, SURFACE_TYPE_RGBA, img.w, img.h, img.data);
+        surface_create(sur, SURFACE_TYPE_ALPHA, img.w, img.h);
+        for(int k = 0; k < img.w * img.h; k++) {
+            sur->data[k] = img.data[k * 4 + 3];
+        }
         vector_append(&font->surfaces, &sur);
     }
 
@@ -63,6 +95,7 @@ int font_load(font *font, const char* filename, unsigned int size) {
     font->w = pixsize;
     font->h = pixsize;
     font->size = size;
+    font_build_atlas(font);
 
     // Free resources
     sd_rgba_image_free(&img);
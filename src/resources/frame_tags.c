@@ -0,0 +1,156 @@
+#include "resources/frame_tags.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *tag_names[TAG_COUNT] = {
+    [TAG_AR] = "ar",
+    [TAG_AS] = "as",
+    [TAG_AT] = "at",
+    [TAG_AW] = "aw",
+    [TAG_B1] = "b1",
+    [TAG_B2] = "b2",
+    [TAG_BB] = "bb",
+    [TAG_BC] = "bc",
+    [TAG_BD] = "bd",
+    [TAG_BE] = "be",
+    [TAG_BF] = "bf",
+    [TAG_BH] = "bh",
+    [TAG_BJ] = "bj",
+    [TAG_BL] = "bl",
+    [TAG_BM] = "bm",
+    [TAG_BPB] = "bpb",
+    [TAG_BPD] = "bpd",
+    [TAG_BPF] = "bpf",
+    [TAG_BPN] = "bpn",
+    [TAG_BPP] = "bpp",
+    [TAG_BPS] = "bps",
+    [TAG_BR] = "br",
+    [TAG_BS] = "bs",
+    [TAG_BT] = "bt",
+    [TAG_BU] = "bu",
+    [TAG_BW] = "bw",
+    [TAG_BX] = "bx",
+    [TAG_BZ] = "bz",
+    [TAG_D] = "d",
+    [TAG_E] = "e",
+    [TAG_F] = "f",
+    [TAG_H] = "h",
+    [TAG_I] = "i",
+    [TAG_JF] = "jf",
+    [TAG_JF2] = "jf2",
+    [TAG_JH] = "jh",
+    [TAG_JL] = "jl",
+    [TAG_JM] = "jm",
+    [TAG_JN] = "jn",
+    [TAG_K] = "k",
+    [TAG_L] = "l",
+    [TAG_M] = "m",
+    [TAG_MD] = "md",
+    [TAG_MG] = "mg",
+    [TAG_MM] = "mm",
+    [TAG_MRX] = "mrx",
+    [TAG_MRY] = "mry",
+    [TAG_MX] = "mx",
+    [TAG_MY] = "my",
+    [TAG_OX] = "ox",
+    [TAG_OY] = "oy",
+    [TAG_PA] = "pa",
+    [TAG_PD] = "pd",
+    [TAG_PE] = "pe",
+    [TAG_PP] = "pp",
+    [TAG_PTR] = "ptr",
+    [TAG_Q] = "q",
+    [TAG_R] = "r",
+    [TAG_S] = "s",
+    [TAG_SB] = "sb",
+    [TAG_SF] = "sf",
+    [TAG_SMF] = "smf",
+    [TAG_SMO] = "smo",
+    [TAG_UA] = "ua",
+    [TAG_UB] = "ub",
+    [TAG_UE] = "ue",
+    [TAG_V] = "v",
+    [TAG_X_EQ] = "x=",
+    [TAG_X_PLUS] = "x+",
+    [TAG_X_MINUS] = "x-",
+    [TAG_Y] = "y",
+    [TAG_Y_EQ] = "y=",
+    [TAG_Y_PLUS] = "y+",
+    [TAG_Y_MINUS] = "y-",
+    [TAG_ZH] = "zh",
+    [TAG_ZJ] = "zj",
+    [TAG_ZL] = "zl",
+    [TAG_ZM] = "zm",
+    [TAG_ZP] = "zp",
+    [TAG_ZZ] = "zz",
+};
+
+// Returns the tag id for a tag name, or -1 if the engine doesn't know the tag
+int tag_lookup(const char *name) {
+    for(int i = 0; i < TAG_COUNT; i++) {
+        if(strcmp(tag_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void tag_table_create(tag_table *table) {
+    table->frame_count = 0;
+    table->frames = NULL;
+}
+
+void tag_table_compile(tag_table *table, const sd_script *script) {
+    tag_table_free(table);
+    if(script->frame_count <= 0) {
+        return;
+    }
+    table->frame_count = script->frame_count;
+    table->frames = calloc(script->frame_count, sizeof(frame_tags));
+    for(int i = 0; i < script->frame_count; i++) {
+        const sd_script_frame *frame = &script->frames[i];
+        frame_tags *tags = &table->frames[i];
+        for(int k = 0; k < frame->tag_count; k++) {
+            int id = tag_lookup(frame->tags[k].key);
+            if(id < 0) {
+                continue;
+            }
+            // First occurrence wins, same as sd_script_get
+            if(!frame_tags_isset(tags, id)) {
+                tags->mask[id / 32] |= 1u << (id % 32);
+                tags->params[id] = frame->tags[k].value;
+            }
+        }
+    }
+}
+
+void tag_table_free(tag_table *table) {
+    free(table->frames);
+    table->frames = NULL;
+    table->frame_count = 0;
+}
+
+const frame_tags* tag_table_get(const tag_table *table, int frame_index) {
+    if(frame_index < 0 || frame_index >= table->frame_count) {
+        return NULL;
+    }
+    return &table->frames[frame_index];
+}
+
+// Returns the index of the first frame after frame_index that has the tag, or -1
+int tag_table_next_frame_with_tag(const tag_table *table, int tag, int frame_index) {
+    for(int i = frame_index + 1; i < table->frame_count; i++) {
+        if(frame_tags_isset(&table->frames[i], tag)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int frame_tags_isset(const frame_tags *tags, int tag) {
+    return (tags->mask[tag / 32] >> (tag % 32)) & 1;
+}
+
+int frame_tags_get(const frame_tags *tags, int tag) {
+    return tags->params[tag];
+}
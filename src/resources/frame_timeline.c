@@ -0,0 +1,75 @@
+#include "resources/frame_timeline.h"
+#include <stdlib.h>
+
+void frame_timeline_create(frame_timeline *timeline) {
+    timeline->frame_count = 0;
+    timeline->starts = NULL;
+    timeline->direct = NULL;
+}
+
+void frame_timeline_compile(frame_timeline *timeline, const sd_script *script) {
+    frame_timeline_free(timeline);
+    if(script->frame_count <= 0) {
+        return;
+    }
+    timeline->frame_count = script->frame_count;
+    timeline->starts = malloc((script->frame_count + 1) * sizeof(int));
+    int ticks = 0;
+    for(int i = 0; i < script->frame_count; i++) {
+        timeline->starts[i] = ticks;
+        ticks += script->frames[i].tick_len;
+    }
+    timeline->starts[script->frame_count] = ticks;
+
+    // Frames of zero length are never found at any tick, same as when
+    // walking the script
+    if(ticks > 0 && ticks <= FRAME_TIMELINE_DIRECT_TICKS && script->frame_count <= INT16_MAX) {
+        timeline->direct = malloc(ticks * sizeof(int16_t));
+        int frame = 0;
+        for(int t = 0; t < ticks; t++) {
+            while(t >= timeline->starts[frame + 1]) {
+                frame++;
+            }
+            timeline->direct[t] = frame;
+        }
+    }
+}
+
+void frame_timeline_free(frame_timeline *timeline) {
+    free(timeline->starts);
+    free(timeline->direct);
+    frame_timeline_create(timeline);
+}
+
+int frame_timeline_frame_at(const frame_timeline *timeline, int tick) {
+    if(tick < 0 || tick >= frame_timeline_total_ticks(timeline)) {
+        return -1;
+    }
+    if(timeline->direct != NULL) {
+        return timeline->direct[tick];
+    }
+
+    // Last frame that starts at or before tick
+    int lo = 0;
+    int hi = timeline->frame_count - 1;
+    while(lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if(timeline->starts[mid] <= tick) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+int frame_timeline_frame_start(const frame_timeline *timeline, int frame_index) {
+    if(frame_index < 0 || frame_index >= timeline->frame_count) {
+        return -1;
+    }
+    return timeline->starts[frame_index];
+}
+
+int frame_timeline_total_ticks(const frame_timeline *timeline) {
+    return (timeline->frame_count > 0) ? timeline->starts[timeline->frame_count] : 0;
+}
@@ -0,0 +1,169 @@
+#include "resources/move_trie.h"
+#include <stdlib.h>
+#include <string.h>
+
+void move_mask_clear(move_mask *mask) {
+    memset(mask->bits, 0, sizeof(mask->bits));
+}
+
+void move_mask_set(move_mask *mask, int id) {
+    mask->bits[id / 32] |= 1u << (id % 32);
+}
+
+int move_mask_isset(const move_mask *mask, int id) {
+    return (mask->bits[id / 32] >> (id % 32)) & 1;
+}
+
+void move_mask_and(move_mask *dst, const move_mask *src) {
+    for(int i = 0; i < MOVE_MASK_WORDS; i++) {
+        dst->bits[i] &= src->bits[i];
+    }
+}
+
+void move_mask_andnot(move_mask *dst, const move_mask *src) {
+    for(int i = 0; i < MOVE_MASK_WORDS; i++) {
+        dst->bits[i] &= ~src->bits[i];
+    }
+}
+
+// Returns the first set id that is >= from, or -1 if there is none
+int move_mask_next(const move_mask *mask, int from) {
+    while(from < MOVE_MASK_BITS) {
+        uint32_t word = mask->bits[from / 32] >> (from % 32);
+        if(word == 0) {
+            from = (from / 32 + 1) * 32;
+            continue;
+        }
+        while(!(word & 1)) {
+            word >>= 1;
+            from++;
+        }
+        return from;
+    }
+    return -1;
+}
+
+// Index of the input in the node tables, or -1 if no move string can hold it
+static int move_trie_key(char input) {
+    if(input >= '1' && input <= '9') {
+        return input - '1';
+    }
+    if(input == 'K') {
+        return 9;
+    }
+    if(input == 'P') {
+        return 10;
+    }
+    return -1;
+}
+
+static move_trie_node* move_trie_node_at(const move_trie *trie, int node) {
+    return (move_trie_node*)trie->nodes.data + node;
+}
+
+static int move_trie_new_node(move_trie *trie) {
+    move_trie_node node;
+    for(int k = 0; k < MOVE_TRIE_KEYS; k++) {
+        node.next[k] = -1;
+    }
+    node.fail = MOVE_TRIE_START;
+    move_mask_clear(&node.own);
+    move_mask_clear(&node.moves);
+    vector_append(&trie->nodes, &node);
+    return vector_size(&trie->nodes) - 1;
+}
+
+void move_trie_create(move_trie *trie) {
+    vector_create(&trie->nodes, sizeof(move_trie_node));
+    move_trie_new_node(trie); // Start
+}
+
+void move_trie_add(move_trie *trie, const char *str, int move_id) {
+    int len = strlen(str);
+    if(len > MOVE_TRIE_MAX_INPUTS) {
+        return;
+    }
+    for(int i = 0; i < len; i++) {
+        if(move_trie_key(str[i]) < 0) {
+            return;
+        }
+    }
+
+    // Oldest input first
+    int cur = MOVE_TRIE_START;
+    for(int i = len - 1; i >= 0; i--) {
+        int key = move_trie_key(str[i]);
+        int next = move_trie_node_at(trie, cur)->next[key];
+        if(next < 0) {
+            // Note that appending may move the node array around
+            next = move_trie_new_node(trie);
+            move_trie_node_at(trie, cur)->next[key] = next;
+        }
+        cur = next;
+    }
+    move_mask_set(&move_trie_node_at(trie, cur)->own, move_id);
+}
+
+// Links every node to its longest shorter tail, breadth first so that the
+// tails are done before the nodes that lead to them, and fills in the
+// missing steps with those of the tail
+void move_trie_build(move_trie *trie) {
+    int count = vector_size(&trie->nodes);
+    int *queue = malloc(sizeof(int) * count);
+    int head = 0, tail = 0;
+
+    move_trie_node *start = move_trie_node_at(trie, MOVE_TRIE_START);
+    start->moves = start->own;
+    for(int k = 0; k < MOVE_TRIE_KEYS; k++) {
+        if(start->next[k] < 0) {
+            start->next[k] = MOVE_TRIE_START;
+        } else {
+            move_trie_node_at(trie, start->next[k])->fail = MOVE_TRIE_START;
+            queue[tail++] = start->next[k];
+        }
+    }
+    while(head < tail) {
+        move_trie_node *node = move_trie_node_at(trie, queue[head++]);
+        const move_trie_node *fail = move_trie_node_at(trie, node->fail);
+        for(int i = 0; i < MOVE_MASK_WORDS; i++) {
+            node->moves.bits[i] = node->own.bits[i] | fail->moves.bits[i];
+        }
+        for(int k = 0; k < MOVE_TRIE_KEYS; k++) {
+            if(node->next[k] < 0) {
+                node->next[k] = fail->next[k];
+            } else {
+                move_trie_node_at(trie, node->next[k])->fail = fail->next[k];
+                queue[tail++] = node->next[k];
+            }
+        }
+    }
+    free(queue);
+}
+
+int move_trie_step(const move_trie *trie, int node, char input) {
+    int key = move_trie_key(input);
+    if(key < 0) {
+        return MOVE_TRIE_START;
+    }
+    return move_trie_node_at(trie, node)->next[key];
+}
+
+const move_mask* move_trie_moves(const move_trie *trie, int node) {
+    return &move_trie_node_at(trie, node)->moves;
+}
+
+int move_trie_walk(const move_trie *trie, const char *inputs) {
+    int node = MOVE_TRIE_START;
+    for(int i = strlen(inputs) - 1; i >= 0; i--) {
+        node = move_trie_step(trie, node, inputs[i]);
+    }
+    return node;
+}
+
+void move_trie_match(const move_trie *trie, const char *inputs, move_mask *out) {
+    *out = *move_trie_moves(trie, move_trie_walk(trie, inputs));
+}
+
+void move_trie_free(move_trie *trie) {
+    vector_free(&trie->nodes);
+}
@@ -4,6 +4,7 @@
 #include "resources/ids.h"
 #include "resources/pathmanager.h"
 #include "utils/log.h"
+#include "video/screen_palette.h"
 
 sd_altpal_file *altpals = NULL;
 
@@ -39,7 +40,7 @@ void altpals_close() {
 }
 
 void palette_set_player_color(palette *palette, int player, int srccolor, int dstcolor) {
-    int dst = dstcolor * 16 + player * 48;
+    int dst = dstcolor * 16 + palette_bank_offset(player);
     int src = srccolor * 16;
     char iz[3];
     memcpy(iz, palette->data, 3);
@@ -18,6 +18,8 @@ static const char* logfile_name = "openomf.log";
 static const char* configfile_name = "openomf.conf";
 static const char* scorefile_name = "SCORES.DAT";
 static const char* savegamedir_name = "save/";
+static const char* plugincache_name = "plugins.cache";
+static const char* scalecache_name = "scaled.cache";
 static char errormessage[128];
 
 // Lists
@@ -66,6 +68,8 @@ int pm_init() {
     local_path_build(CONFIG_PATH, local_base_dir, configfile_name);
     local_path_build(SCORE_PATH, local_base_dir, scorefile_name);
     local_path_build(SAVE_PATH, local_base_dir, savegamedir_name);
+    local_path_build(PLUGIN_CACHE_PATH, local_base_dir, plugincache_name);
+    local_path_build(SCALE_CACHE_PATH, local_base_dir, scalecache_name);
 
     // Set default base dirs for resources and plugins
     int m_ok = 0;
@@ -231,6 +235,8 @@ const char* pm_get_local_path_type_name(unsigned int path_id) {
         case LOG_PATH: return "LOG_PATH";
         case SCORE_PATH: return "SCORE_PATH";
         case SAVE_PATH: return "SAVE_PATH";
+        case PLUGIN_CACHE_PATH: return "PLUGIN_CACHE_PATH";
+        case SCALE_CACHE_PATH: return "SCALE_CACHE_PATH";
     }
     return "UNKNOWN";
 }
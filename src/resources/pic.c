@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <shadowdive/shadowdive.h>
+#include "resources/pic.h"
+#include "resources/pathmanager.h"
+#include "utils/log.h"
+
+int load_pic_file(pic *p, int resource_id) {
+    const char *filename = pm_get_resource_path(resource_id);
+    if(filename == NULL) {
+        PERROR("Could not find requested PIC file handle.");
+        return 1;
+    }
+
+    sd_pic_file pics;
+    sd_pic_create(&pics);
+    int ret = sd_pic_load(&pics, filename);
+    if(ret != SD_SUCCESS) {
+        PERROR("Could not load PIC file %s: %s", filename, sd_get_error(ret));
+        sd_pic_free(&pics);
+        return 1;
+    }
+
+    // All at once, so that picking a photo never has to decode anything
+    p->photo_count = pics.photo_count;
+    p->photos = malloc(sizeof(sprite) * (pics.photo_count > 0 ? pics.photo_count : 1));
+    for(int i = 0; i < pics.photo_count; i++) {
+        const sd_pic_photo *photo = sd_pic_get(&pics, i);
+        sprite_create(&p->photos[i], photo->sprite, i);
+        sprite_get_surface(&p->photos[i]);
+    }
+    sd_pic_free(&pics);
+    return 0;
+}
+
+void pic_free(pic *p) {
+    for(int i = 0; i < p->photo_count; i++) {
+        sprite_free(&p->photos[i]);
+    }
+    free(p->photos);
+    p->photos = NULL;
+    p->photo_count = 0;
+}
+
+sprite* pic_get_photo(pic *p, int photo_id) {
+    if(photo_id < 0 || photo_id >= p->photo_count) {
+        return NULL;
+    }
+    return &p->photos[photo_id];
+}
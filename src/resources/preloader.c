@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "resources/preloader.h"
+#include "resources/bk_loader.h"
+#include "resources/af_loader.h"
+#include "resources/ids.h"
+#include "utils/log.h"
+#include "utils/thread_sched.h"
+
+// One scene BK and two HARs, plus a spare for overlapping requests
+#define PRELOAD_SLOTS 4
+
+enum {
+    PRELOAD_EMPTY = 0,
+    PRELOAD_QUEUED,
+    PRELOAD_LOADING,
+    PRELOAD_READY,
+    PRELOAD_FAILED,
+};
+
+enum {
+    PRELOAD_BK = 0,
+    PRELOAD_AF,
+    PRELOAD_PIC,
+};
+
+// Slot state moves EMPTY -> QUEUED on the main thread, QUEUED -> LOADING on
+// whichever thread claims it first, and LOADING -> READY/FAILED on the
+// thread that loaded it. Only the main thread empties slots.
+typedef struct preload_slot_t {
+    SDL_atomic_t state;
+    int type;
+    int resource_id;
+    union {
+        bk b;
+        af a;
+        pic p;
+    } data;
+} preload_slot;
+
+static preload_slot _slots[PRELOAD_SLOTS];
+static SDL_Thread *_thread = NULL;
+static SDL_sem *_wake = NULL;
+static SDL_atomic_t _quit;
+
+static int preload_slot_load(preload_slot *slot) {
+    if(slot->type == PRELOAD_BK) {
+        return load_bk_file(&slot->data.b, slot->resource_id);
+    }
+    if(slot->type == PRELOAD_PIC) {
+        return load_pic_file(&slot->data.p, slot->resource_id);
+    }
+    return load_af_file(&slot->data.a, slot->resource_id);
+}
+
+static void preload_slot_clear(preload_slot *slot) {
+    if(SDL_AtomicGet(&slot->state) == PRELOAD_READY) {
+        if(slot->type == PRELOAD_BK) {
+            bk_free(&slot->data.b);
+        } else if(slot->type == PRELOAD_PIC) {
+            pic_free(&slot->data.p);
+        } else {
+            af_free(&slot->data.a);
+        }
+    }
+    SDL_AtomicSet(&slot->state, PRELOAD_EMPTY);
+}
+
+static int preloader_thread_run(void *data) {
+    thread_sched_apply(THREAD_ROLE_JOBS);
+    while(!SDL_AtomicGet(&_quit)) {
+        SDL_SemWait(_wake);
+        for(int i = 0; i < PRELOAD_SLOTS; i++) {
+            preload_slot *slot = &_slots[i];
+            if(!SDL_AtomicCAS(&slot->state, PRELOAD_QUEUED, PRELOAD_LOADING)) {
+                continue;
+            }
+            int failed = preload_slot_load(slot);
+            SDL_AtomicSet(&slot->state, failed ? PRELOAD_FAILED : PRELOAD_READY);
+            DEBUG("Preloader: %s %s.",
+                failed ? "Failed to load" : "Loaded",
+                get_resource_name(slot->resource_id));
+        }
+    }
+    return 0;
+}
+
+int preloader_init() {
+    for(int i = 0; i < PRELOAD_SLOTS; i++) {
+        SDL_AtomicSet(&_slots[i].state, PRELOAD_EMPTY);
+    }
+    SDL_AtomicSet(&_quit, 0);
+    _wake = SDL_CreateSemaphore(0);
+    _thread = SDL_CreateThread(preloader_thread_run, "preloader", NULL);
+    if(_thread == NULL) {
+        // Not fatal; everything is just loaded synchronously instead
+        PERROR("Preloader: Unable to start loader thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(_wake);
+        _wake = NULL;
+    }
+    return 0;
+}
+
+void preloader_close() {
+    if(_thread != NULL) {
+        SDL_AtomicSet(&_quit, 1);
+        SDL_SemPost(_wake);
+        SDL_WaitThread(_thread, NULL);
+        SDL_DestroySemaphore(_wake);
+        _thread = NULL;
+        _wake = NULL;
+    }
+    for(int i = 0; i < PRELOAD_SLOTS; i++) {
+        preload_slot_clear(&_slots[i]);
+    }
+}
+
+static preload_slot* preloader_find(int type, int resource_id) {
+    for(int i = 0; i < PRELOAD_SLOTS; i++) {
+        preload_slot *slot = &_slots[i];
+        if(SDL_AtomicGet(&slot->state) != PRELOAD_EMPTY
+           && slot->type == type
+           && slot->resource_id == resource_id) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void preloader_request(int type, int resource_id) {
+    if(_thread == NULL || preloader_find(type, resource_id) != NULL) {
+        return;
+    }
+
+    // Take an empty slot, or recycle one that finished but was never taken
+    preload_slot *slot = NULL;
+    for(int i = 0; i < PRELOAD_SLOTS && slot == NULL; i++) {
+        if(SDL_AtomicGet(&_slots[i].state) == PRELOAD_EMPTY) {
+            slot = &_slots[i];
+        }
+    }
+    for(int i = 0; i < PRELOAD_SLOTS && slot == NULL; i++) {
+        int state = SDL_AtomicGet(&_slots[i].state);
+        if(state == PRELOAD_READY || state == PRELOAD_FAILED) {
+            slot = &_slots[i];
+            preload_slot_clear(slot);
+        }
+    }
+    if(slot == NULL) {
+        return;
+    }
+
+    slot->type = type;
+    slot->resource_id = resource_id;
+    SDL_AtomicSet(&slot->state, PRELOAD_QUEUED);
+    SDL_SemPost(_wake);
+}
+
+void preloader_request_bk(int resource_id) {
+    preloader_request(PRELOAD_BK, resource_id);
+}
+
+void preloader_request_af(int resource_id) {
+    preloader_request(PRELOAD_AF, resource_id);
+}
+
+void preloader_request_pic(int resource_id) {
+    preloader_request(PRELOAD_PIC, resource_id);
+}
+
+// Returns the slot once it has finished loading, or NULL if there is nothing
+// to hand over
+static preload_slot* preloader_wait(int type, int resource_id) {
+    preload_slot *slot = preloader_find(type, resource_id);
+    if(slot == NULL) {
+        return NULL;
+    }
+
+    // Not started yet; cheaper for the caller to just load it
+    if(SDL_AtomicCAS(&slot->state, PRELOAD_QUEUED, PRELOAD_EMPTY)) {
+        return NULL;
+    }
+    while(SDL_AtomicGet(&slot->state) == PRELOAD_LOADING) {
+        SDL_Delay(1);
+    }
+    if(SDL_AtomicGet(&slot->state) != PRELOAD_READY) {
+        SDL_AtomicSet(&slot->state, PRELOAD_EMPTY);
+        return NULL;
+    }
+    return slot;
+}
+
+int preloader_take_bk(bk *b, int resource_id) {
+    preload_slot *slot = preloader_wait(PRELOAD_BK, resource_id);
+    if(slot == NULL) {
+        return 1;
+    }
+    *b = slot->data.b;
+    SDL_AtomicSet(&slot->state, PRELOAD_EMPTY);
+    return 0;
+}
+
+int preloader_take_af(af *a, int resource_id) {
+    preload_slot *slot = preloader_wait(PRELOAD_AF, resource_id);
+    if(slot == NULL) {
+        return 1;
+    }
+    *a = slot->data.a;
+    SDL_AtomicSet(&slot->state, PRELOAD_EMPTY);
+    return 0;
+}
+
+int preloader_take_pic(pic *p, int resource_id) {
+    preload_slot *slot = preloader_wait(PRELOAD_PIC, resource_id);
+    if(slot == NULL) {
+        return 1;
+    }
+    *p = slot->data.p;
+    SDL_AtomicSet(&slot->state, PRELOAD_EMPTY);
+    return 0;
+}
+
+void preloader_flush() {
+    for(int i = 0; i < PRELOAD_SLOTS; i++) {
+        preload_slot *slot = &_slots[i];
+        if(SDL_AtomicCAS(&slot->state, PRELOAD_QUEUED, PRELOAD_EMPTY)) {
+            continue;
+        }
+        int state = SDL_AtomicGet(&slot->state);
+        if(state == PRELOAD_READY || state == PRELOAD_FAILED) {
+            preload_slot_clear(slot);
+        }
+    }
+}
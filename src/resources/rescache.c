@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "resources/rescache.h"
+#include "resources/bk_loader.h"
+#include "resources/af_loader.h"
+#include "resources/pic.h"
+#include "resources/preloader.h"
+#include "resources/ids.h"
+#include "utils/log.h"
+#include "utils/memtrack.h"
+#include "utils/teardown.h"
+
+enum {
+    RESCACHE_BK = 0,
+    RESCACHE_AF,
+    RESCACHE_PIC,
+};
+
+typedef struct rescache_entry_t {
+    int type;
+    int refs;
+    unsigned int bytes;
+    unsigned int last_use;
+    union {
+        bk b;
+        af a;
+        pic p;
+    } data;
+} rescache_entry;
+
+// Resource ids are small, so entries are simply indexed by them
+static rescache_entry *_entries[NUMBER_OF_RESOURCES];
+static unsigned int _bytes_used = 0;
+static unsigned int _byte_budget = 48 * 1024 * 1024;
+static unsigned int _clock = 0;
+static unsigned int _hits = 0;
+static unsigned int _misses = 0;
+// Game states on different threads share the cache
+static SDL_mutex *_lock = NULL;
+
+static unsigned int surface_bytes(const surface *sur) {
+    return sur->w * sur->h * ((sur->type == SURFACE_TYPE_PALETTE) ? 2 : 4);
+}
+
+// Counts sprites as decoded even if they aren't yet, since they will be
+static unsigned int animation_bytes(animation *ani) {
+    unsigned int bytes = 0;
+    iterator it;
+    sprite *s;
+    vector_iter_begin(&ani->sprites, &it);
+    while((s = iter_next(&it)) != NULL) {
+        vec2i size = sprite_get_size(s);
+        bytes += size.x * size.y * 2;
+    }
+    return bytes;
+}
+
+static unsigned int rescache_entry_bytes(rescache_entry *e) {
+    unsigned int bytes = sizeof(rescache_entry);
+    if(e->type == RESCACHE_BK) {
+        bytes += surface_bytes(&e->data.b.background);
+        iterator it;
+        hashmap_pair *pair;
+        hashmap_iter_begin(&e->data.b.infos, &it);
+        while((pair = iter_next(&it)) != NULL) {
+            bytes += animation_bytes(&((bk_info*)pair->val)->ani);
+        }
+    } else if(e->type == RESCACHE_PIC) {
+        for(int i = 0; i < e->data.p.photo_count; i++) {
+            vec2i size = sprite_get_size(&e->data.p.photos[i]);
+            bytes += size.x * size.y * 2;
+        }
+    } else {
+        for(int i = 0; i < 70; i++) {
+            af_move *move = af_get_move(&e->data.a, i);
+            if(move != NULL) {
+                bytes += animation_bytes(&move->ani);
+            }
+        }
+    }
+    return bytes;
+}
+
+// Evicted files are freed an animation at a time from the main loop, since
+// freeing a whole BK file at once can take longer than a frame
+static int rescache_teardown(void *data) {
+    rescache_entry *e = data;
+    int more = 0;
+    if(e->type == RESCACHE_BK) {
+        more = bk_free_step(&e->data.b);
+    } else if(e->type == RESCACHE_PIC) {
+        pic_free(&e->data.p);
+    } else {
+        more = af_free_step(&e->data.a);
+    }
+    if(!more) {
+        mem_free(e);
+    }
+    return more;
+}
+
+static void rescache_evict(int resource_id) {
+    rescache_entry *e = _entries[resource_id];
+    DEBUG("Resource cache: Evicting %s (%u bytes).", get_resource_name(resource_id), e->bytes);
+    _bytes_used -= e->bytes;
+    _entries[resource_id] = NULL;
+    teardown_push(rescache_teardown, e);
+}
+
+// Evicts unreferenced entries, oldest first, until within budget
+static void rescache_trim() {
+    while(_bytes_used > _byte_budget) {
+        int oldest = -1;
+        for(int i = 0; i < NUMBER_OF_RESOURCES; i++) {
+            rescache_entry *e = _entries[i];
+            if(e != NULL && e->refs == 0
+               && (oldest < 0 || e->last_use < _entries[oldest]->last_use)) {
+                oldest = i;
+            }
+        }
+        if(oldest < 0) {
+            return;
+        }
+        rescache_evict(oldest);
+    }
+}
+
+static rescache_entry* rescache_get_locked(int type, int resource_id) {
+    if(resource_id < 0 || resource_id >= NUMBER_OF_RESOURCES) {
+        return NULL;
+    }
+
+    rescache_entry *e = _entries[resource_id];
+    if(e != NULL) {
+        _hits++;
+        e->refs++;
+        e->last_use = ++_clock;
+        return e;
+    }
+
+    // Not cached; take it from the preloader if it has it, or load it now
+    _misses++;
+    e = mem_malloc(MEM_TAG_RESOURCES, sizeof(rescache_entry));
+    e->type = type;
+    int failed;
+    if(type == RESCACHE_BK) {
+        failed = preloader_take_bk(&e->data.b, resource_id)
+                 && load_bk_file(&e->data.b, resource_id);
+    } else if(type == RESCACHE_PIC) {
+        failed = preloader_take_pic(&e->data.p, resource_id)
+                 && load_pic_file(&e->data.p, resource_id);
+    } else {
+        failed = preloader_take_af(&e->data.a, resource_id)
+                 && load_af_file(&e->data.a, resource_id);
+    }
+    if(failed) {
+        mem_free(e);
+        return NULL;
+    }
+    e->refs = 1;
+    e->last_use = ++_clock;
+    e->bytes = rescache_entry_bytes(e);
+    _entries[resource_id] = e;
+    _bytes_used += e->bytes;
+    rescache_trim();
+    return e;
+}
+
+static rescache_entry* rescache_get(int type, int resource_id) {
+    SDL_LockMutex(_lock);
+    rescache_entry *e = rescache_get_locked(type, resource_id);
+    SDL_UnlockMutex(_lock);
+    return e;
+}
+
+bk* rescache_get_bk(int resource_id) {
+    rescache_entry *e = rescache_get(RESCACHE_BK, resource_id);
+    return (e != NULL) ? &e->data.b : NULL;
+}
+
+af* rescache_get_af(int resource_id) {
+    rescache_entry *e = rescache_get(RESCACHE_AF, resource_id);
+    return (e != NULL) ? &e->data.a : NULL;
+}
+
+pic* rescache_get_pic(int resource_id) {
+    rescache_entry *e = rescache_get(RESCACHE_PIC, resource_id);
+    return (e != NULL) ? &e->data.p : NULL;
+}
+
+// Starts loading a file in the background, unless it is already cached
+void rescache_preload_bk(int resource_id) {
+    SDL_LockMutex(_lock);
+    if(resource_id >= 0 && resource_id < NUMBER_OF_RESOURCES && _entries[resource_id] == NULL) {
+        preloader_request_bk(resource_id);
+    }
+    SDL_UnlockMutex(_lock);
+}
+
+void rescache_preload_af(int resource_id) {
+    SDL_LockMutex(_lock);
+    if(resource_id >= 0 && resource_id < NUMBER_OF_RESOURCES && _entries[resource_id] == NULL) {
+        preloader_request_af(resource_id);
+    }
+    SDL_UnlockMutex(_lock);
+}
+
+void rescache_preload_pic(int resource_id) {
+    SDL_LockMutex(_lock);
+    if(resource_id >= 0 && resource_id < NUMBER_OF_RESOURCES && _entries[resource_id] == NULL) {
+        preloader_request_pic(resource_id);
+    }
+    SDL_UnlockMutex(_lock);
+}
+
+void rescache_release(const void *res) {
+    if(res == NULL) {
+        return;
+    }
+    SDL_LockMutex(_lock);
+    for(int i = 0; i < NUMBER_OF_RESOURCES; i++) {
+        rescache_entry *e = _entries[i];
+        if(e != NULL && (const void*)&e->data == res) {
+            e->refs--;
+            rescache_trim();
+            SDL_UnlockMutex(_lock);
+            return;
+        }
+    }
+    SDL_UnlockMutex(_lock);
+    PERROR("Resource cache: Released a resource that isn't cached!");
+}
+
+void rescache_set_budget(unsigned int bytes) {
+    SDL_LockMutex(_lock);
+    _byte_budget = bytes;
+    DEBUG("Resource cache budget set to %u bytes.", bytes);
+    rescache_trim();
+    SDL_UnlockMutex(_lock);
+}
+
+void rescache_init() {
+    for(int i = 0; i < NUMBER_OF_RESOURCES; i++) {
+        _entries[i] = NULL;
+    }
+    _bytes_used = 0;
+    _clock = 0;
+    _hits = 0;
+    _misses = 0;
+    _lock = SDL_CreateMutex();
+}
+
+void rescache_close() {
+    DEBUG("Resource cache: %u hits, %u misses, %u bytes in use.", _hits, _misses, _bytes_used);
+    for(int i = 0; i < NUMBER_OF_RESOURCES; i++) {
+        if(_entries[i] != NULL) {
+            if(_entries[i]->refs > 0) {
+                PERROR("Resource cache: %s still has %d references.",
+                    get_resource_name(i), _entries[i]->refs);
+            }
+            rescache_evict(i);
+        }
+    }
+    // Finished here, since sprites may point into the bundle
+    teardown_flush();
+    SDL_DestroyMutex(_lock);
+    _lock = NULL;
+}
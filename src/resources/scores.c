@@ -1,9 +1,23 @@
+#include <stdlib.h>
 #include <string.h>
+#include <SDL2/SDL.h>
 #include <shadowdive/shadowdive.h>
+#include "utils/io_worker.h"
 #include "utils/log.h"
 #include "resources/pathmanager.h"
 #include "resources/scores.h"
 
+enum {
+    SCORES_UNREAD = 0,
+    SCORES_LOADING,
+    SCORES_READY,
+    SCORES_MISSING,
+};
+
+// The scores as last read or written. While loading, only the I/O thread touches them.
+static scoreboard _scores;
+static SDL_atomic_t _state;
+
 void scores_clear(scoreboard *sb) {
     for(int i = 0; i < 4; i++) {
         for(int m = 0; m < 20; m++) {
@@ -15,7 +29,7 @@ void scores_clear(scoreboard *sb) {
     }
 }
 
-int scores_read(scoreboard *sb) {
+static int scores_read_file(scoreboard *sb) {
     sd_score score_file;
     if(sd_score_create(&score_file) != SD_SUCCESS) {
         goto error_0;
@@ -46,7 +60,32 @@ error_0:
     return 1;
 }
 
-int scores_write(scoreboard *sb) {
+static void scores_load(void *userdata) {
+    int failed = scores_read_file(&_scores);
+    SDL_AtomicSet(&_state, failed ? SCORES_MISSING : SCORES_READY);
+}
+
+// Reads the scores on the I/O thread, so that they are there by the time the scoreboard opens
+void scores_prefetch() {
+    if(SDL_AtomicCAS(&_state, SCORES_UNREAD, SCORES_LOADING)) {
+        io_worker_run(scores_load, NULL);
+    }
+}
+
+int scores_read(scoreboard *sb) {
+    scores_prefetch();
+    if(SDL_AtomicGet(&_state) == SCORES_LOADING) {
+        io_worker_flush();
+    }
+    if(SDL_AtomicGet(&_state) != SCORES_READY) {
+        return 1;
+    }
+    memcpy(sb, &_scores, sizeof(scoreboard));
+    return 0;
+}
+
+static int scores_write_file(const char *path, void *userdata) {
+    scoreboard *sb = userdata;
     sd_score score_file;
     if(sd_score_create(&score_file) != SD_SUCCESS) {
         return 1;
@@ -63,9 +102,23 @@ int scores_write(scoreboard *sb) {
     }
 
     // Save
-    sd_score_save(&score_file, pm_get_local_path(SCORE_PATH));
+    int ret = sd_score_save(&score_file, path);
 
     // All done
     sd_score_free(&score_file);
+    return (ret != SD_SUCCESS);
+}
+
+// Takes effect in memory right away, the file is written behind
+int scores_write(scoreboard *sb) {
+    if(SDL_AtomicGet(&_state) == SCORES_LOADING) {
+        io_worker_flush();
+    }
+    memcpy(&_scores, sb, sizeof(scoreboard));
+    SDL_AtomicSet(&_state, SCORES_READY);
+
+    scoreboard *copy = malloc(sizeof(scoreboard));
+    memcpy(copy, sb, sizeof(scoreboard));
+    io_worker_write(pm_get_local_path(SCORE_PATH), scores_write_file, copy, free);
     return 0;
 }
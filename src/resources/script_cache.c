@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include "resources/script_cache.h"
+#include "utils/hashmap.h"
+#include "utils/log.h"
+
+// String -> script_cache_entry*; the entries are allocated on their own so
+// that they stay put while the map grows
+static hashmap _scripts;
+static int _created = 0;
+
+const script_cache_entry* script_cache_get(const char *str) {
+    if(!_created) {
+        hashmap_create(&_scripts, 7);
+        _created = 1;
+    }
+    void *val;
+    unsigned int len;
+    if(hashmap_sget(&_scripts, str, &val, &len) == 0) {
+        return *(script_cache_entry**)val;
+    }
+    if(hashmap_reserved(&_scripts) >= SCRIPT_CACHE_MAX_ENTRIES) {
+        return NULL;
+    }
+
+    script_cache_entry *entry = malloc(sizeof(script_cache_entry));
+    sd_script_create(&entry->script);
+    int err_pos;
+    if(sd_script_decode(&entry->script, str, &err_pos) != SD_SUCCESS) {
+        sd_script_free(&entry->script);
+        free(entry);
+        return NULL;
+    }
+    tag_table_create(&entry->tags);
+    tag_table_compile(&entry->tags, &entry->script);
+    frame_timeline_create(&entry->timeline);
+    frame_timeline_compile(&entry->timeline, &entry->script);
+    hashmap_sput(&_scripts, str, &entry, sizeof(script_cache_entry*));
+    return entry;
+}
+
+unsigned int script_cache_size() {
+    return _created ? hashmap_reserved(&_scripts) : 0;
+}
+
+void script_cache_clear() {
+    if(!_created) {
+        return;
+    }
+    DEBUG("Script cache: %u custom strings.", hashmap_reserved(&_scripts));
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&_scripts, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        script_cache_entry *entry = *(script_cache_entry**)pair->val;
+        sd_script_free(&entry->script);
+        tag_table_free(&entry->tags);
+        frame_timeline_free(&entry->timeline);
+        free(entry);
+    }
+    hashmap_free(&_scripts);
+    _created = 0;
+}
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <string.h>
+#include <SDL2/SDL.h>
 #include <shadowdive/shadowdive.h>
 
 #include "resources/sgmanager.h"
 #include "resources/pathmanager.h"
+#include "utils/io_worker.h"
 #include "utils/scandir.h"
 #include "utils/list.h"
 #include "utils/log.h"
@@ -50,7 +52,19 @@ error_0:
     return 1;
 }
 
-int sg_load(sd_pilot *pilot, const char* pilotname) {
+enum {
+    SG_UNREAD = 0,
+    SG_LOADING,
+    SG_READY,
+    SG_MISSING,
+};
+
+// The pilot read ahead by sg_prefetch. While loading, only the I/O thread touches it.
+static char _pilot_name[64];
+static sd_pilot _pilot;
+static SDL_atomic_t _pilot_state;
+
+static int sg_load_file(sd_pilot *pilot, const char* pilotname) {
     char tmp[1024];
 
     // Form the savegame filename
@@ -71,6 +85,36 @@ int sg_load(sd_pilot *pilot, const char* pilotname) {
     return 0;
 }
 
+static void sg_load_ahead(void *userdata) {
+    int failed = sg_load_file(&_pilot, _pilot_name);
+    SDL_AtomicSet(&_pilot_state, failed ? SG_MISSING : SG_READY);
+}
+
+// Reads the pilot's savegame on the I/O thread, ahead of the scene that needs it
+void sg_prefetch(const char *pilotname) {
+    if(pilotname == NULL || pilotname[0] == '\0' || strlen(pilotname) >= sizeof(_pilot_name)) {
+        return;
+    }
+    int state = SDL_AtomicGet(&_pilot_state);
+    if(state == SG_LOADING || (state != SG_UNREAD && strcmp(_pilot_name, pilotname) == 0)) {
+        return;
+    }
+    strcpy(_pilot_name, pilotname);
+    SDL_AtomicSet(&_pilot_state, SG_LOADING);
+    io_worker_run(sg_load_ahead, NULL);
+}
+
+int sg_load(sd_pilot *pilot, const char* pilotname) {
+    if(SDL_AtomicGet(&_pilot_state) == SG_LOADING) {
+        io_worker_flush();
+    }
+    if(SDL_AtomicGet(&_pilot_state) == SG_READY && strcmp(_pilot_name, pilotname) == 0) {
+        memcpy(pilot, &_pilot, sizeof(sd_pilot));
+        return 0;
+    }
+    return sg_load_file(pilot, pilotname);
+}
+
 int sd_save(const sd_pilot *pilot, const char* pilotname) {
     // Report error for now
     return 1;
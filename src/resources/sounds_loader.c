@@ -1,12 +1,186 @@
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <SDL2/SDL.h>
 #include <shadowdive/shadowdive.h>
 #include "resources/sounds_loader.h"
 #include "resources/ids.h"
 #include "resources/pathmanager.h"
+#include "utils/mapfile.h"
+#include "utils/memtrack.h"
 #include "utils/log.h"
 
+#define SOUNDS_MAX_SAMPLES 1024
+#define SOUNDS_LANCZOS_TAPS 3
+#define SOUNDS_PI 3.14159265358979323846
+
+typedef struct mapped_sound_t {
+    const char *data;
+    int len;
+} mapped_sound;
+
+typedef struct converted_sound_t {
+    int16_t *data;
+    int len; // In bytes
+    int failed; // Nothing to convert
+} converted_sound;
+
+// Pitches the HAR and menu sounds are played at most of the time. Every
+// sample gets its own buffer for these, the first one converted up front.
+static const float pitch_variants[] = {1.0f, 1.8f, 2.0f};
+#define PITCH_VARIANT_COUNT (int)(sizeof(pitch_variants) / sizeof(float))
+
 sd_sound_file *sound_data = NULL;
 
+// When the sounds file could be mapped, samples point straight into it
+static mapfile sound_map;
+static mapped_sound *mapped_sounds = NULL;
+static int mapped_count = 0;
+
+// Converted samples, sample_count per pitch variant. Shared with the game
+// and simulation threads, so the lock guards them.
+static converted_sound *converted = NULL;
+static int sample_count = 0;
+static int output_rate = SOUNDS_DEFAULT_RATE;
+static SDL_mutex *convert_lock = NULL;
+
+static uint32_t read_le32(const char *p) {
+    const uint8_t *u = (const uint8_t*)p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static uint16_t read_le16(const char *p) {
+    const uint8_t *u = (const uint8_t*)p;
+    return u[0] | (u[1] << 8);
+}
+
+// Builds a sample table pointing into the mapped file. Every sample is
+// checked against what libShadowDive parsed, so if the layout isn't what
+// we expect, the parsed copy is simply kept instead.
+static int sounds_loader_index_map() {
+    if(sound_map.size < 4) {
+        return 1;
+    }
+    uint32_t header_size = read_le32(sound_map.data);
+    if(header_size == 0 || header_size > sound_map.size) {
+        return 1;
+    }
+    int count = header_size / 4;
+    mapped_sound *table = calloc(count, sizeof(mapped_sound));
+    for(int i = 0; i < count; i++) {
+        uint32_t offset = read_le32(sound_map.data + i * 4);
+        if(offset + 2 > sound_map.size) {
+            goto error_0;
+        }
+        uint16_t len = read_le16(sound_map.data + offset);
+        if(offset + 2 + len > sound_map.size) {
+            goto error_0;
+        }
+        table[i].data = sound_map.data + offset + 2;
+        table[i].len = len;
+
+        const sd_sound *sample = sd_sounds_get(sound_data, i);
+        int parsed_len = (sample != NULL) ? sample->len : 0;
+        if(parsed_len != len || (len > 0 && memcmp(sample->data, table[i].data, len) != 0)) {
+            goto error_0;
+        }
+    }
+    const sd_sound *extra = sd_sounds_get(sound_data, count);
+    if(extra != NULL && extra->len > 0) {
+        goto error_0;
+    }
+
+    mapped_sounds = table;
+    mapped_count = count;
+    return 0;
+
+error_0:
+    free(table);
+    return 1;
+}
+
+static double lanczos(double x) {
+    if(x == 0.0) {
+        return 1.0;
+    }
+    if(x <= -SOUNDS_LANCZOS_TAPS || x >= SOUNDS_LANCZOS_TAPS) {
+        return 0.0;
+    }
+    double px = SOUNDS_PI * x;
+    return SOUNDS_LANCZOS_TAPS * sin(px) * sin(px / SOUNDS_LANCZOS_TAPS) / (px * px);
+}
+
+// Resamples the unsigned 8 bit sample with a Lanczos filter. Step is the
+// number of source frames per output frame; when it is above one, the
+// filter is widened so that nothing above the new Nyquist rate folds back.
+static int16_t* sounds_resample(const uint8_t *src, int src_len, double step, int *out_len) {
+    int len = (int)ceil(src_len / step);
+    int16_t *out = mem_malloc(MEM_TAG_AUDIO, sizeof(int16_t) * (len > 0 ? len : 1));
+    double scale = (step > 1.0) ? 1.0 / step : 1.0;
+    double radius = SOUNDS_LANCZOS_TAPS / scale;
+    for(int i = 0; i < len; i++) {
+        double center = i * step;
+        int first = (int)floor(center - radius) + 1;
+        int last = (int)floor(center + radius);
+        double sum = 0.0, weights = 0.0;
+        for(int k = first; k <= last; k++) {
+            double w = lanczos((k - center) * scale);
+            int s = (k < 0 || k >= src_len) ? 0 : (int)src[k] - 128;
+            sum += s * w;
+            weights += w;
+        }
+        double v = (weights != 0.0) ? sum / weights * 256.0 : 0.0;
+        if(v > 32767.0) v = 32767.0;
+        if(v < -32768.0) v = -32768.0;
+        out[i] = (int16_t)lrint(v);
+    }
+    *out_len = len * sizeof(int16_t);
+    return out;
+}
+
+// Called with the lock held
+static converted_sound* sounds_convert(int id, int variant) {
+    converted_sound *c = &converted[variant * sample_count + id];
+    if(c->data == NULL && !c->failed) {
+        char *buf;
+        int len;
+        if(sounds_loader_get(id, &buf, &len) != 0 || len <= 0) {
+            c->failed = 1;
+            return c;
+        }
+        double step = (double)SOUNDS_SOURCE_RATE * pitch_variants[variant] / output_rate;
+        c->data = sounds_resample((const uint8_t*)buf, len, step, &c->len);
+    }
+    return c;
+}
+
+static void sounds_free_converted() {
+    for(int i = 0; i < sample_count * PITCH_VARIANT_COUNT; i++) {
+        mem_free(converted[i].data);
+        converted[i].data = NULL;
+        converted[i].len = 0;
+        converted[i].failed = 0;
+    }
+}
+
+static void sounds_convert_all() {
+    for(int i = 0; i < sample_count; i++) {
+        sounds_convert(i, 0);
+    }
+}
+
+static int sounds_count_samples() {
+    if(mapped_sounds != NULL) {
+        return mapped_count;
+    }
+    int count = 0;
+    while(count < SOUNDS_MAX_SAMPLES && sd_sounds_get(sound_data, count) != NULL) {
+        count++;
+    }
+    return count;
+}
+
 int sounds_loader_init() {
     // Get filename
     const char *filename = pm_get_resource_path(DAT_SOUNDS);
@@ -20,7 +194,29 @@ int sounds_loader_init() {
         PERROR("Unable to load sounds file '%s'!", filename);
         goto error_1;
     }
-    INFO("Loaded sounds file '%s'.", filename);
+
+    // Switch over to the mapped file, and drop the parsed copy
+    if(mapfile_open(&sound_map, filename) == 0) {
+        if(sound_map.mapped && sounds_loader_index_map() == 0) {
+            sd_sounds_free(sound_data);
+            free(sound_data);
+            sound_data = NULL;
+            DEBUG("Sounds file is memory mapped, %d samples.", mapped_count);
+        } else {
+            mapfile_close(&sound_map);
+        }
+    }
+
+    // Converting the samples up front keeps the resampling out of the mixer
+    Uint32 start = SDL_GetTicks();
+    convert_lock = SDL_CreateMutex();
+    sample_count = sounds_count_samples();
+    converted = calloc(sample_count * PITCH_VARIANT_COUNT + 1, sizeof(converted_sound));
+#ifndef STANDALONE_SERVER
+    sounds_convert_all();
+#endif
+    INFO("Loaded sounds file '%s', %d samples converted to %d Hz in %u ms.",
+         filename, sample_count, output_rate, SDL_GetTicks() - start);
     return 0;
 
 error_1:
@@ -32,6 +228,16 @@ error_0:
 }
 
 int sounds_loader_get(int id, char **buffer, int *len) {
+    if(mapped_sounds != NULL) {
+        if(id < 0 || id >= mapped_count || mapped_sounds[id].len == 0) {
+            PERROR("Requested sound %d does not exist!", id);
+            return 1;
+        }
+        *buffer = (char*)mapped_sounds[id].data;
+        *len = mapped_sounds[id].len;
+        return 0;
+    }
+
     // Make sure the data is ok and sound exists
     if(sound_data == NULL) return 1;
 
@@ -49,7 +255,61 @@ int sounds_loader_get(int id, char **buffer, int *len) {
     return 0; // Success
 }
 
+int sounds_loader_get_buffer(int id, float pitch, sound_buffer *buf) {
+    if(id < 0 || id >= sample_count) {
+        PERROR("Requested sound %d does not exist!", id);
+        return 1;
+    }
+    int variant = 0;
+    for(int i = 1; i < PITCH_VARIANT_COUNT; i++) {
+        if(fabsf(pitch - pitch_variants[i]) < 0.001f) {
+            variant = i;
+        }
+    }
+    SDL_LockMutex(convert_lock);
+    converted_sound *c = sounds_convert(id, variant);
+    buf->key = variant * sample_count + id;
+    buf->data = (const char*)c->data;
+    buf->len = c->len;
+    buf->frequency = output_rate;
+    buf->bytes = 2;
+    buf->pitch = pitch / pitch_variants[variant];
+    SDL_UnlockMutex(convert_lock);
+    return (c->data == NULL) ? 1 : 0;
+}
+
+void sounds_loader_set_rate(int rate) {
+    if(convert_lock == NULL || rate <= 0) {
+        return;
+    }
+    SDL_LockMutex(convert_lock);
+    if(rate != output_rate) {
+        Uint32 start = SDL_GetTicks();
+        output_rate = rate;
+        sounds_free_converted();
+        sounds_convert_all();
+        INFO("Converted %d samples to %d Hz in %u ms.", sample_count, output_rate, SDL_GetTicks() - start);
+    }
+    SDL_UnlockMutex(convert_lock);
+}
+
 void sounds_loader_close() {
+    if(converted != NULL) {
+        sounds_free_converted();
+        free(converted);
+        converted = NULL;
+        sample_count = 0;
+    }
+    if(convert_lock != NULL) {
+        SDL_DestroyMutex(convert_lock);
+        convert_lock = NULL;
+    }
+    if(mapped_sounds != NULL) {
+        free(mapped_sounds);
+        mapped_sounds = NULL;
+        mapped_count = 0;
+        mapfile_close(&sound_map);
+    }
     if(sound_data != NULL) {
         sd_sounds_free(sound_data);
         free(sound_data);
@@ -2,37 +2,268 @@
 #include <stdlib.h>
 #include <string.h>
 #include "resources/sprite.h"
+#include "resources/bundle.h"
+#include "video/tcache.h"
+#include "utils/load_timer.h"
+
+// Minimum number of ticks a sprite has to go unused before its pixels may
+// be dropped. Anything drawn or hit tested recently is likely needed again.
+#define SPRITE_MIN_IDLE_TICKS 100
+
+struct sprite_lru_t {
+    surface *sur; // Owned by the sprite
+    unsigned int bytes;
+    unsigned int last_use;
+    int listed; // Decoded, and so in the list
+    sprite_lru *prev; // Towards most recently used
+    sprite_lru *next; // Towards least recently used
+};
+
+static int _lazy = 0;
+static size_t _budget = 0;
+static size_t _bytes_used = 0;
+static unsigned int _ticks = 0;
+static SDL_atomic_t _decodes; // Batches decode on worker threads
+static unsigned int _evictions = 0;
+static sprite_lru *_lru_head = NULL;
+static sprite_lru *_lru_tail = NULL;
+
+void sprite_set_lazy(int lazy) {
+    _lazy = lazy;
+}
+
+void sprite_set_budget(size_t bytes) {
+    _budget = bytes;
+}
+
+static void sprite_lru_unlink(sprite_lru *e) {
+    if(!e->listed) {
+        return;
+    }
+    if(e->prev != NULL) {
+        e->prev->next = e->next;
+    } else {
+        _lru_head = e->next;
+    }
+    if(e->next != NULL) {
+        e->next->prev = e->prev;
+    } else {
+        _lru_tail = e->prev;
+    }
+    e->prev = NULL;
+    e->next = NULL;
+    e->listed = 0;
+    _bytes_used -= e->bytes;
+}
+
+static void sprite_lru_push(sprite_lru *e) {
+    e->prev = NULL;
+    e->next = _lru_head;
+    if(_lru_head != NULL) {
+        _lru_head->prev = e;
+    } else {
+        _lru_tail = e;
+    }
+    _lru_head = e;
+    e->listed = 1;
+    _bytes_used += e->bytes;
+}
+
+// The surface struct stays with the sprite, only the buffers go
+static void sprite_evict(sprite_lru *e) {
+    sprite_lru_unlink(e);
+    // Copies share the pixels and so the textures, leave those be
+    if(e->sur->refs == NULL) {
+        tcache_forget(e->sur);
+    }
+    surface_free(e->sur);
+    _evictions++;
+}
+
+void sprite_tick() {
+    _ticks++;
+    if(_budget == 0) {
+        return;
+    }
+    while(_bytes_used > _budget && _lru_tail != NULL) {
+        if(_ticks - _lru_tail->last_use < SPRITE_MIN_IDLE_TICKS) {
+            break;
+        }
+        sprite_evict(_lru_tail);
+    }
+}
+
+void sprite_get_stats(sprite_stats *stats) {
+    stats->bytes_used = _bytes_used;
+    stats->budget = _budget;
+    stats->decodes = SDL_AtomicGet(&_decodes);
+    stats->evictions = _evictions;
+}
 
 void sprite_create_custom(sprite *sp, vec2i pos, surface *data) {
     sp->id = -1;
     sp->pos = pos;
     sp->data = data;
+    sp->raw = NULL;
+    sp->lru = NULL;
+}
+
+static void sprite_decode(surface *sur, const sd_sprite *sdsprite) {
+    SDL_AtomicIncRef(&_decodes);
+    uint64_t start = load_timer_start();
+    // The bundle keeps sprites the way they end up below, ready to use
+    if(bundle_find_sprite(sdsprite, sur) == 0) {
+        load_timer_add(LOAD_TIME_SPRITES, start);
+        return;
+    }
+    sd_vga_image raw;
+    sd_sprite_vga_decode(&raw, sdsprite);
+    surface_create_from_data(sur, SURFACE_TYPE_PALETTE, raw.w, raw.h, raw.data);
+    memcpy(sur->stencil, raw.stencil, raw.w * raw.h);
+    sd_vga_image_free(&raw);
+
+    // Sprite data doesn't change, so stencil runs, hit mask and palette usage can be
+    // precomputed, and only the visible pixels need to be kept
+    surface_build_rle(sur);
+    surface_build_hitmask(sur);
+    surface_build_pal_mask(sur);
+    surface_pack_stencil(sur);
+    surface_pack_pixels(sur);
+    bundle_collect_sprite(sdsprite, sur);
+    load_timer_add(LOAD_TIME_SPRITES, start);
+}
+
+void sprite_create_deferred(sprite *sp, void *src, int id) {
+    sd_sprite *sdsprite = (sd_sprite*)src;
+    sp->id = id;
+    sp->pos = vec2i_create(sdsprite->pos_x, sdsprite->pos_y);
+    sp->lru = NULL;
+    sp->data = NULL;
+    sp->raw = malloc(sizeof(sd_sprite));
+    sd_sprite_copy(sp->raw, sdsprite);
 }
 
 void sprite_create(sprite *sp, void *src, int id) {
+    if(_lazy) {
+        sprite_create_deferred(sp, src, id);
+        return;
+    }
     sd_sprite *sdsprite = (sd_sprite*)src;
     sp->id = id;
     sp->pos = vec2i_create(sdsprite->pos_x, sdsprite->pos_y);
+    sp->lru = NULL;
     sp->data = malloc(sizeof(surface));
+    sprite_decode(sp->data, sdsprite);
+    sp->raw = NULL;
+}
 
-    // Load data
-    sd_vga_image raw;
-    sd_sprite_vga_decode(&raw, sdsprite);
-    surface_create_from_data(sp->data, SURFACE_TYPE_PALETTE, raw.w, raw.h, raw.data);
-    memcpy(sp->data->stencil, raw.stencil, raw.w * raw.h);
-    sd_vga_image_free(&raw);
+// Only touches the sprite itself, so any number of these can run at once
+static void sprite_batch_decode(void *userdata) {
+    sprite *sp = userdata;
+    sp->data = malloc(sizeof(surface));
+    sprite_decode(sp->data, sp->raw);
+    sd_sprite_free(sp->raw);
+    free(sp->raw);
+    sp->raw = NULL;
+}
+
+void sprite_batch_begin(sprite_batch *batch) {
+    job_counter_init(&batch->done);
+}
+
+// When lazy, the sprite stays as it is and is decoded on first use
+void sprite_batch_add(sprite_batch *batch, sprite *sp) {
+    if(_lazy || sp->raw == NULL || sp->data != NULL) {
+        return;
+    }
+    jobs_run("sprite decode", sprite_batch_decode, sp, &batch->done, 0);
+}
+
+void sprite_batch_finish(sprite_batch *batch) {
+    jobs_wait(&batch->done);
 }
 
 void sprite_free(sprite *sp) {
-    surface_free(sp->data);
-    free(sp->data);
-    sp->data = NULL;
+    if(sp->lru != NULL) {
+        sprite_lru_unlink(sp->lru);
+        free(sp->lru);
+        sp->lru = NULL;
+    }
+    if(sp->data != NULL) {
+        surface_free(sp->data);
+        free(sp->data);
+        sp->data = NULL;
+    }
+    if(sp->raw != NULL) {
+        sd_sprite_free(sp->raw);
+        free(sp->raw);
+        sp->raw = NULL;
+    }
+}
+
+static void sprite_ensure_decoded(sprite *sp) {
+    if(sprite_is_decoded(sp) || sp->raw == NULL) {
+        return;
+    }
+    if(sp->data == NULL) {
+        sp->data = malloc(sizeof(surface));
+    }
+    sprite_decode(sp->data, sp->raw);
+}
+
+surface* sprite_get_surface(sprite *sp) {
+    sprite_ensure_decoded(sp);
+    // Never dropped from now on, so the compressed data can go
+    if(sp->lru != NULL) {
+        sprite_lru_unlink(sp->lru);
+        free(sp->lru);
+        sp->lru = NULL;
+    }
+    if(sp->raw != NULL) {
+        sd_sprite_free(sp->raw);
+        free(sp->raw);
+        sp->raw = NULL;
+    }
+    return sp->data;
+}
+
+surface* sprite_use_surface(sprite *sp) {
+    if(_budget == 0 && sp->lru == NULL) {
+        return sprite_get_surface(sp);
+    }
+    if(sp->raw == NULL) {
+        return sp->data;
+    }
+    sprite_ensure_decoded(sp);
+    // Dropping pixels out of the bundle would free nothing
+    if(sp->data->borrowed) {
+        return sprite_get_surface(sp);
+    }
+    if(sp->lru == NULL) {
+        sp->lru = calloc(1, sizeof(sprite_lru));
+        sp->lru->sur = sp->data;
+        sp->lru->bytes = sp->data->w * sp->data->h * 2;
+    }
+    sp->lru->last_use = _ticks;
+    if(_lru_head != sp->lru) {
+        sprite_lru_unlink(sp->lru);
+        sprite_lru_push(sp->lru);
+    }
+    return sp->data;
+}
+
+int sprite_is_decoded(const sprite *sp) {
+    return sp->data != NULL && sp->data->data != NULL;
 }
 
 vec2i sprite_get_size(sprite *sp) {
     if(sp->data != NULL) {
         return vec2i_create(sp->data->w, sp->data->h);
     }
+    if(sp->raw != NULL) {
+        const sd_sprite *sdsprite = sp->raw;
+        return vec2i_create(sdsprite->width, sdsprite->height);
+    }
     return vec2i_create(0,0);
 }
 
@@ -42,9 +273,12 @@ sprite* sprite_copy(sprite *src) {
     sprite *new = malloc(sizeof(sprite));
     new->pos = src->pos;
     new->id = src->id;
+    new->raw = NULL;
+    new->lru = NULL;
 
-    // Copy surface
+    // Pixels are shared until either copy gets written to. The copy keeps
+    // them even if the original drops its own.
     new->data = malloc(sizeof(surface));
-    surface_copy(new->data, src->data);
+    surface_share(new->data, sprite_use_surface(src));
     return new;
 }
@@ -0,0 +1,139 @@
+#include <SDL2/SDL.h>
+#include "sim_thread.h"
+#include "game/common_defines.h"
+#include "game/game_state_type.h"
+#include "game/utils/settings.h"
+#include "controller/keyboard.h"
+#include "resources/ids.h"
+#include "utils/log.h"
+#include "utils/profiler.h"
+#include "utils/thread_sched.h"
+
+/*
+* The thread only runs while an arena is up and no scene change is pending.
+* Scene loads create and free textures, which must happen on the main thread,
+* so the simulation thread stops itself when a scene change is requested and
+* the main loop takes over ticking until the next arena starts.
+*/
+
+typedef struct sim_thread_t {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_atomic_t running; // Cleared by the main thread to stop the thread
+    SDL_atomic_t ticking; // Cleared by the thread when it stops on its own
+    game_state *gs;
+} sim_thread;
+
+static sim_thread sim = {NULL, NULL};
+
+int sim_thread_can_run(game_state *gs) {
+    return gs->run
+        && gs->this_id == gs->next_id
+        && is_arena(scene_to_resource(gs->this_id));
+}
+
+static int sim_thread_run(void *data) {
+    thread_sched_apply(THREAD_ROLE_SIM);
+    game_state *gs = sim.gs;
+    unsigned int last = SDL_GetTicks();
+    int dynamic_wait = 0;
+    int static_wait = 0;
+    int max_ticks = settings_get()->gameplay.max_catchup_ticks;
+    while(SDL_AtomicGet(&sim.running)) {
+        SDL_LockMutex(sim.lock);
+        if(!sim_thread_can_run(gs)) {
+            SDL_UnlockMutex(sim.lock);
+            break;
+        }
+
+        unsigned int now = SDL_GetTicks();
+        dynamic_wait += now - last;
+        static_wait += now - last;
+        last = now;
+
+        game_state_tick_controllers(gs);
+        if(max_ticks > 0 && static_wait > 10 * max_ticks) {
+            static_wait = 10 * max_ticks;
+        }
+        while(static_wait > 10) {
+            game_state_static_tick(gs);
+            static_wait -= 10;
+        }
+        profiler_count(PROF_CNT_DROPPED_TICKS, game_state_limit_backlog(gs, &dynamic_wait, max_ticks));
+        int ticks = 0;
+        while(dynamic_wait > game_state_ms_per_dyntick(gs) && sim_thread_can_run(gs)
+              && (max_ticks <= 0 || ticks < max_ticks)) {
+            controller_set_tick_time(now - (dynamic_wait - game_state_ms_per_dyntick(gs)));
+            game_state_dynamic_tick(gs);
+            dynamic_wait -= game_state_ms_per_dyntick(gs);
+            ticks++;
+        }
+        profiler_count(PROF_CNT_DYNAMIC_TICKS, ticks);
+
+        // Sleep until the next tick is due
+        int wait = game_state_ms_per_dyntick(gs) - dynamic_wait;
+        if(10 - static_wait < wait) {
+            wait = 10 - static_wait;
+        }
+        SDL_UnlockMutex(sim.lock);
+        SDL_Delay(wait > 0 ? wait + 1 : 1);
+    }
+    SDL_AtomicSet(&sim.ticking, 0);
+    return 0;
+}
+
+int sim_thread_start(game_state *gs) {
+    if(sim.thread != NULL) {
+        return 0;
+    }
+    sim.lock = SDL_CreateMutex();
+    if(sim.lock == NULL) {
+        PERROR("Unable to create simulation lock: %s", SDL_GetError());
+        return 1;
+    }
+    sim.gs = gs;
+    SDL_AtomicSet(&sim.running, 1);
+    SDL_AtomicSet(&sim.ticking, 1);
+    sim.thread = SDL_CreateThread(sim_thread_run, "simulation", NULL);
+    if(sim.thread == NULL) {
+        PERROR("Unable to create simulation thread: %s", SDL_GetError());
+        SDL_DestroyMutex(sim.lock);
+        sim.lock = NULL;
+        return 1;
+    }
+    DEBUG("Simulation thread started.");
+    return 0;
+}
+
+void sim_thread_stop() {
+    if(sim.thread == NULL) {
+        return;
+    }
+    SDL_AtomicSet(&sim.running, 0);
+    SDL_WaitThread(sim.thread, NULL);
+    SDL_DestroyMutex(sim.lock);
+    sim.thread = NULL;
+    sim.lock = NULL;
+    sim.gs = NULL;
+    DEBUG("Simulation thread stopped.");
+}
+
+int sim_thread_is_started() {
+    return sim.thread != NULL;
+}
+
+int sim_thread_is_ticking() {
+    return sim.thread != NULL && SDL_AtomicGet(&sim.ticking);
+}
+
+void sim_thread_lock() {
+    if(sim.thread != NULL) {
+        SDL_LockMutex(sim.lock);
+    }
+}
+
+void sim_thread_unlock() {
+    if(sim.thread != NULL) {
+        SDL_UnlockMutex(sim.lock);
+    }
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#endif
+#include "tournament.h"
+#include "game/common_defines.h"
+#include "utils/log.h"
+
+int tournament_write_result(const char *path, int winner, unsigned int ticks) {
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        PERROR("Could not write match result to %s.", path);
+        return 1;
+    }
+    fprintf(f, "%d %u\n", winner, ticks);
+    fclose(f);
+    return 0;
+}
+
+#ifdef _WIN32
+
+int tournament_run(const char *exe, int jobs, int hars, int pilots, int difficulties) {
+    PERROR("Tournaments are not supported on this platform.");
+    return 1;
+}
+
+#else
+
+typedef struct entrant_t {
+    int har;
+    int pilot;
+    int difficulty;
+} entrant;
+
+typedef struct match_job_t {
+    pid_t pid;
+    int a;
+    int b; // Entrant indices, a plays as player 1
+    char path[64];
+} match_job;
+
+typedef struct tournament_t {
+    int count;
+    entrant *entrants;
+    int *wins; // wins[a * count + b] is the number of times a beat b
+    int *games;
+    unsigned long long total_ticks;
+    int matches;
+    int draws;
+    int failed;
+} tournament;
+
+static void tournament_read_result(tournament *t, match_job *job, int status) {
+    int winner;
+    unsigned int ticks;
+    FILE *f = fopen(job->path, "r");
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || f == NULL || fscanf(f, "%d %u", &winner, &ticks) != 2) {
+        PERROR("Match between entrants %d and %d failed.", job->a, job->b);
+        t->failed++;
+    } else {
+        t->matches++;
+        t->total_ticks += ticks;
+        t->games[job->a * t->count + job->b]++;
+        t->games[job->b * t->count + job->a]++;
+        if(winner == 0) {
+            t->wins[job->a * t->count + job->b]++;
+        } else if(winner == 1) {
+            t->wins[job->b * t->count + job->a]++;
+        } else {
+            t->draws++;
+        }
+    }
+    if(f != NULL) {
+        fclose(f);
+    }
+    unlink(job->path);
+    job->pid = 0;
+}
+
+// Waits for any of the running matches and returns its slot
+static match_job* tournament_wait(tournament *t, match_job *jobs, int job_count) {
+    int status;
+    pid_t pid = wait(&status);
+    for(int i = 0; pid > 0 && i < job_count; i++) {
+        if(jobs[i].pid == pid) {
+            tournament_read_result(t, &jobs[i], status);
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static int tournament_start(const char *exe, tournament *t, match_job *job, int slot, int a, int b, int seed) {
+    const entrant *p1 = &t->entrants[a];
+    const entrant *p2 = &t->entrants[b];
+    char args[7][16];
+    snprintf(args[0], 16, "%d", p1->har);
+    snprintf(args[1], 16, "%d", p1->pilot);
+    snprintf(args[2], 16, "%d", p1->difficulty);
+    snprintf(args[3], 16, "%d", p2->har);
+    snprintf(args[4], 16, "%d", p2->pilot);
+    snprintf(args[5], 16, "%d", p2->difficulty);
+    snprintf(args[6], 16, "%d", seed);
+    snprintf(job->path, sizeof(job->path), "/tmp/openomf_match_%d_%d", (int)getpid(), slot);
+    job->a = a;
+    job->b = b;
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        PERROR("Could not start match between entrants %d and %d.", a, b);
+        t->failed++;
+        return 1;
+    }
+    if(pid == 0) {
+        // The match logs a lot, keep it off the results
+        int null_fd = open("/dev/null", O_WRONLY);
+        if(null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execlp(exe, exe, "match",
+               args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+               job->path, "--fast", (char*)NULL);
+        _exit(127);
+    }
+    job->pid = pid;
+    return 0;
+}
+
+static void tournament_print(tournament *t) {
+    printf("Matches: %d, draws: %d, failed: %d\n", t->matches, t->draws, t->failed);
+    if(t->matches > 0) {
+        printf("Average ticks per match: %.1f\n", (double)t->total_ticks / t->matches);
+    }
+
+    // Win rate of the row entrant against the column entrant
+    printf("\nentrant");
+    for(int b = 0; b < t->count; b++) {
+        printf(",%d", b);
+    }
+    printf(",total\n");
+    for(int a = 0; a < t->count; a++) {
+        const entrant *e = &t->entrants[a];
+        printf("%d %s/%s/%s", a, har_get_name(e->har), pilot_get_name(e->pilot), ai_difficulty_get_name(e->difficulty));
+        int wins = 0;
+        int games = 0;
+        for(int b = 0; b < t->count; b++) {
+            int n = t->games[a * t->count + b];
+            if(n > 0) {
+                printf(",%.2f", (float)t->wins[a * t->count + b] / n);
+            } else {
+                printf(",");
+            }
+            wins += t->wins[a * t->count + b];
+            games += n;
+        }
+        printf(",%.2f\n", games > 0 ? (float)wins / games : 0.0f);
+    }
+}
+
+int tournament_run(const char *exe, int jobs, int hars, int pilots, int difficulties) {
+    hars = (hars < 1 || hars > NUMBER_OF_HAR_TYPES) ? NUMBER_OF_HAR_TYPES : hars;
+    // Kreissack is not selectable
+    pilots = (pilots < 1 || pilots > PILOT_KREISSACK) ? PILOT_KREISSACK : pilots;
+    difficulties = (difficulties < 1 || difficulties > NUMBER_OF_AI_DIFFICULTY_TYPES) ? NUMBER_OF_AI_DIFFICULTY_TYPES : difficulties;
+    if(jobs < 1) {
+        jobs = 1;
+    }
+
+    tournament t;
+    memset(&t, 0, sizeof(tournament));
+    t.count = hars * pilots * difficulties;
+    t.entrants = malloc(sizeof(entrant) * t.count);
+    t.wins = calloc(t.count * t.count, sizeof(int));
+    t.games = calloc(t.count * t.count, sizeof(int));
+    int n = 0;
+    for(int h = 0; h < hars; h++) {
+        for(int p = 0; p < pilots; p++) {
+            for(int d = 0; d < difficulties; d++) {
+                t.entrants[n].har = h;
+                t.entrants[n].pilot = p;
+                t.entrants[n].difficulty = d;
+                n++;
+            }
+        }
+    }
+
+    match_job *slots = calloc(jobs, sizeof(match_job));
+    int running = 0;
+    int seed = 0;
+    for(int a = 0; a < t.count; a++) {
+        for(int b = a + 1; b < t.count; b++) {
+            match_job *job = NULL;
+            for(int i = 0; job == NULL && i < jobs; i++) {
+                if(slots[i].pid == 0) {
+                    job = &slots[i];
+                }
+            }
+            while(job == NULL && running > 0) {
+                job = tournament_wait(&t, slots, jobs);
+                running--;
+            }
+            if(job == NULL) {
+                PERROR("Lost track of the running matches.");
+                t.failed++;
+                continue;
+            }
+            // Take turns on which side each entrant starts on
+            int swap = (a + b) % 2;
+            if(tournament_start(exe, &t, job, job - slots, swap ? b : a, swap ? a : b, seed++) == 0) {
+                running++;
+            }
+        }
+    }
+    while(running > 0) {
+        tournament_wait(&t, slots, jobs);
+        running--;
+    }
+
+    tournament_print(&t);
+
+    free(slots);
+    free(t.entrants);
+    free(t.wins);
+    free(t.games);
+    return t.failed;
+}
+
+#endif // _WIN32
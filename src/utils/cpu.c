@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "utils/cpu.h"
+#include "utils/log.h"
+
+typedef struct cpu_feature_name_t {
+    int feature;
+    const char *name;
+} cpu_feature_name;
+
+static const cpu_feature_name feature_names[] = {
+    {CPU_SSE2, "sse2"},
+    {CPU_SSSE3, "ssse3"},
+    {CPU_AVX2, "avx2"},
+    {CPU_NEON, "neon"},
+};
+#define FEATURE_NAME_COUNT (sizeof(feature_names) / sizeof(cpu_feature_name))
+
+static int cpu_features = 0;
+
+static int cpu_detect() {
+    int features = 0;
+    if(SDL_HasSSE2()) {
+        features |= CPU_SSE2;
+    }
+    if(SDL_HasSSSE3()) {
+        features |= CPU_SSSE3;
+    }
+    if(SDL_HasAVX2()) {
+        features |= CPU_AVX2;
+    }
+    if(SDL_HasNEON()) {
+        features |= CPU_NEON;
+    }
+    return features;
+}
+
+void cpu_init(const char *override) {
+    char buf[64];
+    int detected = cpu_detect();
+    cpu_features_to_str(detected, buf, sizeof(buf));
+    INFO("CPU features: %s", buf);
+
+    cpu_features = detected;
+    if(override != NULL) {
+        int wanted = cpu_parse_features(override);
+        if(wanted < 0) {
+            PERROR("Unknown CPU feature list '%s', using detected features.", override);
+            return;
+        }
+        if(wanted & ~detected) {
+            cpu_features_to_str(wanted & ~detected, buf, sizeof(buf));
+            PERROR("CPU does not support %s, ignoring.", buf);
+        }
+        cpu_features = wanted & detected;
+        cpu_features_to_str(cpu_features, buf, sizeof(buf));
+        INFO("CPU features limited to: %s", buf);
+    }
+}
+
+int cpu_has(int features) {
+    return (cpu_features & features) == features;
+}
+
+int cpu_get_features() {
+    return cpu_features;
+}
+
+// Meant for tests, which need to run every kernel variant
+void cpu_set_features(int features) {
+    cpu_features = features;
+}
+
+int cpu_parse_features(const char *str) {
+    int features = 0;
+    while(*str) {
+        size_t len = strcspn(str, ",");
+        if(len == 4 && strncmp(str, "none", 4) == 0) {
+            // Nothing to add
+        } else if(len > 0) {
+            unsigned int i;
+            for(i = 0; i < FEATURE_NAME_COUNT; i++) {
+                if(strlen(feature_names[i].name) == len && strncmp(str, feature_names[i].name, len) == 0) {
+                    features |= feature_names[i].feature;
+                    break;
+                }
+            }
+            if(i == FEATURE_NAME_COUNT) {
+                return -1;
+            }
+        }
+        str += len;
+        if(*str == ',') {
+            str++;
+        }
+    }
+    return features;
+}
+
+void cpu_features_to_str(int features, char *buf, size_t len) {
+    size_t pos = 0;
+    buf[0] = 0;
+    for(unsigned int i = 0; i < FEATURE_NAME_COUNT; i++) {
+        if(features & feature_names[i].feature) {
+            int n = snprintf(buf + pos, len - pos, "%s%s", pos ? "," : "", feature_names[i].name);
+            if(n < 0 || (size_t)n >= len - pos) {
+                return;
+            }
+            pos += n;
+        }
+    }
+    if(pos == 0) {
+        snprintf(buf, len, "none");
+    }
+}
+
+int cpu_parse_cores(const char *str, uint64_t *cores) {
+    uint64_t mask = 0;
+    while(*str) {
+        char *end;
+        long first = strtol(str, &end, 10);
+        long last = first;
+        if(end == str || first < 0 || first >= CPU_MAX_CORES) {
+            return -1;
+        }
+        if(*end == '-') {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if(end == str || last < first || last >= CPU_MAX_CORES) {
+                return -1;
+            }
+        }
+        for(long i = first; i <= last; i++) {
+            mask |= (uint64_t)1 << i;
+        }
+        str = end;
+        if(*str == ',') {
+            str++;
+        } else if(*str != 0) {
+            return -1;
+        }
+    }
+    *cores = mask;
+    return 0;
+}
+
+void cpu_cores_to_str(uint64_t cores, char *buf, size_t len) {
+    size_t pos = 0;
+    buf[0] = 0;
+    for(int i = 0; i < CPU_MAX_CORES; i++) {
+        if(!((cores >> i) & 1)) {
+            continue;
+        }
+        int last = i;
+        while(last + 1 < CPU_MAX_CORES && ((cores >> (last + 1)) & 1)) {
+            last++;
+        }
+        int n = (last > i)
+            ? snprintf(buf + pos, len - pos, "%s%d-%d", pos ? "," : "", i, last)
+            : snprintf(buf + pos, len - pos, "%s%d", pos ? "," : "", i);
+        if(n < 0 || (size_t)n >= len - pos) {
+            return;
+        }
+        pos += n;
+        i = last;
+    }
+    if(pos == 0) {
+        snprintf(buf, len, "none");
+    }
+}
@@ -0,0 +1,110 @@
+#include "utils/delta.h"
+#include <stdint.h>
+#include <string.h>
+
+#define VARINT_MAX 5
+
+static uint32_t read_word(const char *buf, size_t len, size_t word) {
+    uint32_t v = 0;
+    for(size_t i = word * 4; i < word * 4 + 4; i++) {
+        v <<= 8;
+        if(i < len) {
+            v |= (uint8_t)buf[i];
+        }
+    }
+    return v;
+}
+
+static void write_word(char *buf, size_t len, size_t word, uint32_t v) {
+    for(int i = 3; i >= 0; i--) {
+        if(word * 4 + i < len) {
+            buf[word * 4 + i] = v & 0xFF;
+        }
+        v >>= 8;
+    }
+}
+
+static size_t write_varint(char *out, uint32_t v) {
+    size_t n = 0;
+    while(v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+// Returns the number of bytes read, or 0 if the varint is truncated or too long
+static size_t read_varint(const char *in, size_t len, uint32_t *v) {
+    *v = 0;
+    for(size_t n = 0; n < len && n < VARINT_MAX; n++) {
+        *v |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if(!(in[n] & 0x80)) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Worst case size of a delta for a buffer of len bytes
+size_t delta_max_size(size_t len) {
+    size_t words = (len + 3) / 4;
+    return VARINT_MAX + (words + 7) / 8 + words * VARINT_MAX;
+}
+
+// Writes the delta from base to data into out, which must hold at least
+// delta_max_size(len) bytes. Returns the size of the delta.
+size_t delta_encode(const char *base, size_t base_len, const char *data, size_t len, char *out) {
+    size_t words = (len + 3) / 4;
+    size_t pos = write_varint(out, len);
+    char *mask = out + pos;
+    pos += (words + 7) / 8;
+    memset(mask, 0, (words + 7) / 8);
+    for(size_t i = 0; i < words; i++) {
+        uint32_t diff = read_word(data, len, i) ^ read_word(base, base_len, i);
+        if(diff) {
+            mask[i / 8] |= 1 << (i % 8);
+            pos += write_varint(out + pos, diff);
+        }
+    }
+    return pos;
+}
+
+// Returns the length of the buffer the delta decodes to, or -1 if it is malformed
+long delta_decoded_len(const char *delta, size_t delta_len) {
+    uint32_t len;
+    if(read_varint(delta, delta_len, &len) == 0) {
+        return -1;
+    }
+    return len;
+}
+
+// Applies a delta to base, writing the result to out. Returns the decoded
+// length, or -1 if the delta is malformed or does not fit in out.
+long delta_decode(const char *base, size_t base_len, const char *delta, size_t delta_len, char *out, size_t out_size) {
+    uint32_t len;
+    size_t pos = read_varint(delta, delta_len, &len);
+    if(pos == 0 || len > out_size) {
+        return -1;
+    }
+    size_t words = (len + 3) / 4;
+    const char *mask = delta + pos;
+    pos += (words + 7) / 8;
+    if(pos > delta_len) {
+        return -1;
+    }
+    for(size_t i = 0; i < words; i++) {
+        uint32_t v = read_word(base, base_len, i);
+        if(mask[i / 8] & (1 << (i % 8))) {
+            uint32_t diff;
+            size_t n = read_varint(delta + pos, delta_len - pos, &diff);
+            if(n == 0) {
+                return -1;
+            }
+            pos += n;
+            v ^= diff;
+        }
+        write_word(out, len, i, v);
+    }
+    return len;
+}
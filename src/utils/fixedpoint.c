@@ -0,0 +1,127 @@
+#include <math.h>
+#include "utils/fixedpoint.h"
+
+fixed fixed_from_int(int v) {
+    return v * FIXED_ONE;
+}
+
+fixed fixed_from_float(float v) {
+    return (fixed)floorf(v * FIXED_ONE + 0.5f);
+}
+
+// Rounds towards negative infinity, like floorf
+int fixed_to_int(fixed v) {
+    return v >> FIXED_SHIFT;
+}
+
+float fixed_to_float(fixed v) {
+    return (float)v / FIXED_ONE;
+}
+
+fixed fixed_mul(fixed a, fixed b) {
+    return (fixed)(((int64_t)a * b) >> FIXED_SHIFT);
+}
+
+// Multiplied up rather than shifted, since a left shift of a negative value
+// is undefined. The quotient rounds towards zero.
+fixed fixed_div(fixed a, fixed b) {
+    if(b == 0) {
+        return 0;
+    }
+    return (fixed)((int64_t)a * FIXED_ONE / b);
+}
+
+// Taylor series up to x^7 over -pi/2..pi/2, which is off by less than 2e-4
+fixed fixed_sin(fixed a) {
+    a %= 2 * FIXED_PI;
+    if(a > FIXED_PI) {
+        a -= 2 * FIXED_PI;
+    } else if(a < -FIXED_PI) {
+        a += 2 * FIXED_PI;
+    }
+    if(a > FIXED_PI / 2) {
+        a = FIXED_PI - a;
+    } else if(a < -FIXED_PI / 2) {
+        a = -FIXED_PI - a;
+    }
+    fixed x2 = fixed_mul(a, a);
+    fixed term = a;
+    fixed r = a;
+    term = fixed_mul(term, x2) / 6;
+    r -= term;
+    term = fixed_mul(term, x2) / 20;
+    r += term;
+    term = fixed_mul(term, x2) / 42;
+    r -= term;
+    return r;
+}
+
+fixed fixed_cos(fixed a) {
+    return fixed_sin(a % (2 * FIXED_PI) + FIXED_PI / 2);
+}
+
+// Quarter of a sine wave, FIXED_TURN / 4 + 1 entries. The values are
+// written out, so every build has the very same ones.
+static const fixed sin_table[FIXED_TURN / 4 + 1] = {
+    0, 402, 804, 1206, 1608, 2010, 2412, 2814,
+    3216, 3617, 4019, 4420, 4821, 5222, 5623, 6023,
+    6424, 6824, 7224, 7623, 8022, 8421, 8820, 9218,
+    9616, 10014, 10411, 10808, 11204, 11600, 11996, 12391,
+    12785, 13180, 13573, 13966, 14359, 14751, 15143, 15534,
+    15924, 16314, 16703, 17091, 17479, 17867, 18253, 18639,
+    19024, 19409, 19792, 20175, 20557, 20939, 21320, 21699,
+    22078, 22457, 22834, 23210, 23586, 23961, 24335, 24708,
+    25080, 25451, 25821, 26190, 26558, 26925, 27291, 27656,
+    28020, 28383, 28745, 29106, 29466, 29824, 30182, 30538,
+    30893, 31248, 31600, 31952, 32303, 32652, 33000, 33347,
+    33692, 34037, 34380, 34721, 35062, 35401, 35738, 36075,
+    36410, 36744, 37076, 37407, 37736, 38064, 38391, 38716,
+    39040, 39362, 39683, 40002, 40320, 40636, 40951, 41264,
+    41576, 41886, 42194, 42501, 42806, 43110, 43412, 43713,
+    44011, 44308, 44604, 44898, 45190, 45480, 45769, 46056,
+    46341, 46624, 46906, 47186, 47464, 47741, 48015, 48288,
+    48559, 48828, 49095, 49361, 49624, 49886, 50146, 50404,
+    50660, 50914, 51166, 51417, 51665, 51911, 52156, 52398,
+    52639, 52878, 53114, 53349, 53581, 53812, 54040, 54267,
+    54491, 54714, 54934, 55152, 55368, 55582, 55794, 56004,
+    56212, 56418, 56621, 56823, 57022, 57219, 57414, 57607,
+    57798, 57986, 58172, 58356, 58538, 58718, 58896, 59071,
+    59244, 59415, 59583, 59750, 59914, 60075, 60235, 60392,
+    60547, 60700, 60851, 60999, 61145, 61288, 61429, 61568,
+    61705, 61839, 61971, 62101, 62228, 62353, 62476, 62596,
+    62714, 62830, 62943, 63054, 63162, 63268, 63372, 63473,
+    63572, 63668, 63763, 63854, 63944, 64031, 64115, 64197,
+    64277, 64354, 64429, 64501, 64571, 64639, 64704, 64766,
+    64827, 64884, 64940, 64993, 65043, 65091, 65137, 65180,
+    65220, 65259, 65294, 65328, 65358, 65387, 65413, 65436,
+    65457, 65476, 65492, 65505, 65516, 65525, 65531, 65535,
+    65536,
+};
+
+// Rounds to the nearest angle step
+int fixed_to_angle(fixed radians) {
+    int64_t a = (int64_t)radians * FIXED_TURN;
+    int64_t turn = 2 * FIXED_PI;
+    return (int)((a >= 0 ? a + turn / 2 : a - turn / 2) / turn);
+}
+
+fixed fixed_sin_lut(int angle) {
+    const int quarter = FIXED_TURN / 4;
+    int a = angle & (FIXED_TURN - 1);
+    int i = a % quarter;
+    switch(a / quarter) {
+        case 0: return sin_table[i];
+        case 1: return sin_table[quarter - i];
+        case 2: return -sin_table[i];
+        default: return -sin_table[quarter - i];
+    }
+}
+
+fixed fixed_cos_lut(int angle) {
+    return fixed_sin_lut(angle + FIXED_TURN / 4);
+}
+
+float fixed_snap(float v) {
+    const float steps = 1 << FIXED_SNAP_BITS;
+    return floorf(v * steps + 0.5f) / steps;
+}
@@ -2,24 +2,132 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 #define FNV_32_PRIME ((uint32_t)0x01000193)
 #define FNV1_32_INIT ((uint32_t)2166136261)
-#define TINY_MASK(x) (((uint32_t)1<<(x))-1)
-#define BUCKETS_SIZE(x) (pow(2,(x)))
 
-// The rest
+// Robin Hood hashing with linear probing. Probes never wrap around; instead
+// there are a few overflow slots past the end of the table, and running out
+// of those grows the table. This keeps iteration and deletion simple.
+#define HASHMAP_CAPACITY(x) (1u << (x))
+#define HASHMAP_OVERFLOW(x) ((x) + 2)
 
-uint32_t fnv_32a_buf(const void *buf, unsigned int len, unsigned int x) {
-    unsigned char *bp = (unsigned char *)buf;
-    unsigned char *be = bp + len;
+static uint32_t fnv_32a_buf(const void *buf, unsigned int len) {
+    const unsigned char *bp = buf;
+    const unsigned char *be = bp + len;
     uint32_t hval = FNV1_32_INIT;
     while(bp < be) {
         hval ^= (uint32_t)*bp++;
         hval *= FNV_32_PRIME;
     }
-    return (((hval >> x) ^ hval) & TINY_MASK(x));
+    return hval;
+}
+
+static uint32_t hashmap_mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Integer keys are the common case, mix them without a byte loop. Struct
+// keys made of whole words (pointers, ints) are mixed a word at a time.
+static uint32_t hashmap_hash(const void *key, unsigned int keylen) {
+    if(keylen == sizeof(uint32_t)) {
+        uint32_t x;
+        memcpy(&x, key, sizeof(uint32_t));
+        return hashmap_mix(x);
+    }
+    if(keylen > sizeof(uint32_t) && (keylen & 3) == 0) {
+        const char *p = key;
+        uint32_t h = FNV1_32_INIT;
+        for(unsigned int i = 0; i < keylen; i += 4) {
+            uint32_t x;
+            memcpy(&x, p + i, sizeof(uint32_t));
+            h = hashmap_mix(h ^ x);
+        }
+        return h;
+    }
+    return fnv_32a_buf(key, keylen);
+}
+
+static void hashmap_alloc_slots(hashmap *hm, unsigned int n_size) {
+    hm->buckets_x = n_size;
+    hm->slots = HASHMAP_CAPACITY(n_size) + HASHMAP_OVERFLOW(n_size);
+    size_t b_size = hm->slots * sizeof(hashmap_node);
+    hm->buckets = hm->alloc.cmalloc(b_size);
+    memset(hm->buckets, 0, b_size);
+}
+
+static void hashmap_insert_node(hashmap *hm, hashmap_node node);
+
+static void hashmap_grow(hashmap *hm) {
+    hashmap_node *old = hm->buckets;
+    unsigned int old_slots = hm->slots;
+    hashmap_alloc_slots(hm, hm->buckets_x + 1);
+    for(unsigned int i = 0; i < old_slots; i++) {
+        if(old[i].dist != 0) {
+            hashmap_insert_node(hm, old[i]);
+        }
+    }
+    hm->alloc.cfree(old);
+}
+
+static void hashmap_insert_node(hashmap *hm, hashmap_node node) {
+    unsigned int index = node.hash & (HASHMAP_CAPACITY(hm->buckets_x) - 1);
+    node.dist = 1;
+    while(1) {
+        if(index >= hm->slots) {
+            // Out of overflow slots; grow and place whatever we carry now
+            hashmap_grow(hm);
+            hashmap_insert_node(hm, node);
+            return;
+        }
+        hashmap_node *slot = &hm->buckets[index];
+        if(slot->dist == 0) {
+            *slot = node;
+            return;
+        }
+        // Take the slot from entries that are closer to their home
+        if(slot->dist < node.dist) {
+            hashmap_node tmp = *slot;
+            *slot = node;
+            node = tmp;
+        }
+        index++;
+        node.dist++;
+    }
+}
+
+static hashmap_node* hashmap_find(const hashmap *hm, const void *key, unsigned int keylen, uint32_t hash) {
+    unsigned int index = hash & (HASHMAP_CAPACITY(hm->buckets_x) - 1);
+    for(unsigned int dist = 1; index < hm->slots; index++, dist++) {
+        hashmap_node *slot = &hm->buckets[index];
+        if(slot->dist < dist) {
+            // Empty, or an entry that is closer to home than ours would be
+            return NULL;
+        }
+        if(slot->hash == hash
+           && slot->pair.keylen == keylen
+           && memcmp(slot->pair.key, key, keylen) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+// Frees the entry in the slot, and shifts the following entries back
+static void hashmap_remove_at(hashmap *hm, unsigned int index) {
+    hm->alloc.cfree(hm->buckets[index].pair.val);
+    while(index + 1 < hm->slots && hm->buckets[index + 1].dist > 1) {
+        hm->buckets[index] = hm->buckets[index + 1];
+        hm->buckets[index].dist--;
+        index++;
+    }
+    memset(&hm->buckets[index], 0, sizeof(hashmap_node));
+    hm->reserved--;
 }
 
 /** \brief Creates a new hashmap with an allocator
@@ -28,16 +136,13 @@ uint32_t fnv_32a_buf(const void *buf, unsigned int len, unsigned int x) {
   * allows the user to define the memory allocation functions.
   *
   * \param hm Allocated memory pointer
-  * \param n_size Size of the hashmap. Final size will be pow(w, n_size)
+  * \param n_size Initial size of the hashmap. Initial size will be pow(2, n_size)
   * \param alloc Allocation functions
   */
 void hashmap_create_with_allocator(hashmap *hm, int n_size, allocator alloc) {
     hm->alloc = alloc;
-    hm->buckets_x = n_size;
-    size_t b_size = hashmap_size(hm) * sizeof(hashmap_node*);
-    hm->buckets = hm->alloc.cmalloc(b_size);
-    memset(hm->buckets, 0, b_size);
     hm->reserved = 0;
+    hashmap_alloc_slots(hm, n_size);
 }
 
 
@@ -45,12 +150,11 @@ void hashmap_create_with_allocator(hashmap *hm, int n_size, allocator alloc) {
   *
   * Creates a new hashmap. Note that the size parameter doesn't mean bucket count,
   * but the bucket count is actually calculated pow(2, n_size). So for example value
-  * 8 means 256 buckets, and 9 would be 512 buckets.
-  *
-  * \todo Make a better create function
+  * 8 means 256 buckets, and 9 would be 512 buckets. The hashmap grows by itself
+  * when it gets full, so this is only a starting size.
   *
   * \param hm Allocated memory pointer
-  * \param n_size Size of the hashmap. Final size will be pow(w, n_size)
+  * \param n_size Initial size of the hashmap. Initial size will be pow(2, n_size)
   */
 void hashmap_create(hashmap *hm, int n_size) {
     allocator alloc;
@@ -68,20 +172,13 @@ void hashmap_create(hashmap *hm, int n_size) {
   * \param hm Hashmap to clear
   */
 void hashmap_clear(hashmap *hm) {
-    hashmap_node *node = NULL;
-    hashmap_node *tmp = NULL;
-    for(unsigned int i = 0; i < hashmap_size(hm); i++) {
-        node = hm->buckets[i];
-        while(node != NULL) {
-            tmp = node;
-            node = node->next;
-            hm->alloc.cfree(tmp->pair.key);
-            hm->alloc.cfree(tmp->pair.val);
-            hm->alloc.cfree(tmp);
-            hm->reserved--;
+    for(unsigned int i = 0; i < hm->slots; i++) {
+        if(hm->buckets[i].dist != 0) {
+            hm->alloc.cfree(hm->buckets[i].pair.val);
         }
-        hm->buckets[i] = NULL;
     }
+    memset(hm->buckets, 0, hm->slots * sizeof(hashmap_node));
+    hm->reserved = 0;
 }
 
 /** \brief Free hashmap
@@ -96,6 +193,7 @@ void hashmap_free(hashmap *hm) {
     hm->alloc.cfree(hm->buckets);
     hm->buckets = NULL;
     hm->buckets_x = 0;
+    hm->slots = 0;
     hm->reserved = 0;
 }
 
@@ -107,15 +205,13 @@ void hashmap_free(hashmap *hm) {
   * \return Amount of hashmap buckets
   */
 unsigned int hashmap_size(const hashmap *hm) {
-    return BUCKETS_SIZE(hm->buckets_x);
+    return HASHMAP_CAPACITY(hm->buckets_x);
 }
 
 /** \brief Gets hashmap reserved buckets
   *
-  * Returns the amount of items in the hashmap. Note that the item count
-  * can be larger than the bucket count, if the hashmap is full enough.
-  * If there are a lot more items than buckets, you should really consider
-  * growing your hashmap bucket count ...
+  * Returns the amount of items in the hashmap. The hashmap grows when
+  * this goes over 3/4 of the bucket count.
   *
   * \param hm Hashmap
   * \return Amount of items in the hashmap
@@ -126,8 +222,8 @@ unsigned int hashmap_reserved(const hashmap *hm) {
 
 /** \brief Puts an item to the hashmap
   *
-  * Puts a new item to the hashmap. Note that the
-  * contents of the value memory block will be copied. However,
+  * Puts a new item to the hashmap, replacing any item with the same key.
+  * Note that the contents of the value memory block will be copied. However,
   * any memory _pointed to_ by it will NOT be copied. So be careful!
   *
   * \param hm Hashmap
@@ -140,25 +236,41 @@ unsigned int hashmap_reserved(const hashmap *hm) {
 void* hashmap_put(hashmap *hm,
                   const void *key, unsigned int keylen,
                   const void *val, unsigned int vallen) {
-    unsigned int index = fnv_32a_buf(key, keylen, hm->buckets_x);
-
-    // Create new node, copy data
-    hashmap_node *node = hm->alloc.cmalloc(sizeof(hashmap_node));
-    node->pair.keylen = keylen;
-    node->pair.vallen = vallen;
-    node->pair.key = hm->alloc.cmalloc(keylen);
-    node->pair.val = hm->alloc.cmalloc(vallen);
-    memcpy(node->pair.key, key, keylen);
-    memcpy(node->pair.val, val, vallen);
-
-    // Set new node as first
-    node->next = hm->buckets[index];
-    hm->buckets[index] = node;
+    uint32_t hash = hashmap_hash(key, keylen);
+
+    // Key and value share one block; value first so it stays aligned
+    char *block = hm->alloc.cmalloc(vallen + keylen);
+    memcpy(block, val, vallen);
+    memcpy(block + vallen, key, keylen);
+
+    // Replace an existing item in place
+    hashmap_node *slot = hashmap_find(hm, key, keylen, hash);
+    if(slot != NULL) {
+        hm->alloc.cfree(slot->pair.val);
+        slot->pair.val = block;
+        slot->pair.key = block + vallen;
+        slot->pair.vallen = vallen;
+        return block;
+    }
+
+    // Grow when the load factor goes over 3/4
+    if((hm->reserved + 1) * 4 > hashmap_size(hm) * 3) {
+        hashmap_grow(hm);
+    }
+
+    hashmap_node node;
+    node.pair.keylen = keylen;
+    node.pair.vallen = vallen;
+    node.pair.val = block;
+    node.pair.key = block + vallen;
+    node.hash = hash;
+    node.dist = 1;
+    hashmap_insert_node(hm, node);
     hm->reserved++;
 
     // Return a pointer to the newly allocated value
     // for convenience
-    return node->pair.val;
+    return block;
 }
 
 
@@ -174,42 +286,12 @@ void* hashmap_put(hashmap *hm,
   * \return Returns 0 on success, 1 on error (not found).
   */
 int hashmap_del(hashmap *hm, const void *key, unsigned int keylen) {
-    unsigned int index = fnv_32a_buf(key, keylen, hm->buckets_x);
-
-    // Get node
-    hashmap_node *node = hm->buckets[index];
-    hashmap_node *prev = NULL;
-    if(node == NULL) return 1;
-
-    // Find the node we want to delete
-    int found = 0;
-    while(node) {
-        if(node->pair.keylen == keylen) {
-            if(memcmp(node->pair.key, key, keylen) == 0) {
-                found = 1;
-                break;
-            }
-        }
-        prev = node;
-        node = node->next;
-    }
-
-    // If node was found, handle delete
-    if(found) {
-        if(prev != NULL) {
-            // If node is not first in chain, set correct links
-            prev->next = node->next;
-        } else {
-            // If node is first in chain, set possible next entry as first
-            hm->buckets[index] = node->next;
-        }
-        hm->alloc.cfree(node->pair.key);
-        hm->alloc.cfree(node->pair.val);
-        hm->alloc.cfree(node);
-        hm->reserved--;
-        return 0;
+    hashmap_node *slot = hashmap_find(hm, key, keylen, hashmap_hash(key, keylen));
+    if(slot == NULL) {
+        return 1;
     }
-    return 1;
+    hashmap_remove_at(hm, slot - hm->buckets);
+    return 0;
 }
 
 /** \brief Gets an item from the hashmap
@@ -224,29 +306,15 @@ int hashmap_del(hashmap *hm, const void *key, unsigned int keylen) {
   * \return Returns 0 on success, 1 on error (not found).
   */
 int hashmap_get(hashmap *hm, const void *key, unsigned int keylen, void **val, unsigned int *vallen) {
-    unsigned int index = fnv_32a_buf(key, keylen, hm->buckets_x);
-
-    // Set defaults for error cases
-    *val = NULL;
-    *vallen = 0;
-
-    // Get node
-    hashmap_node *node = hm->buckets[index];
-    if(node == NULL) return 1;
-
-    // Find the node we want
-    while(node) {
-        if(node->pair.keylen == keylen) {
-            if(memcmp(node->pair.key, key, keylen) == 0) {
-                *val = node->pair.val;
-                *vallen = node->pair.vallen;
-                return 0;
-            }
-        }
-        node = node->next;
+    hashmap_node *slot = hashmap_find(hm, key, keylen, hashmap_hash(key, keylen));
+    if(slot == NULL) {
+        *val = NULL;
+        *vallen = 0;
+        return 1;
     }
-
-    return 1;
+    *val = slot->pair.val;
+    *vallen = slot->pair.vallen;
+    return 0;
 }
 
 void hashmap_sput(hashmap *hm, const char *key, void *value, unsigned int value_len) {
@@ -285,88 +353,30 @@ void hashmap_idel(hashmap *hm, unsigned int key) {
   */
 int hashmap_delete(hashmap *hm, iterator *iter) {
     int index = iter->inow - 1;
-
-    // Find correct node
-    hashmap_node *node = hm->buckets[index];
-    hashmap_node *prev = NULL;
-    hashmap_node *seek = iter->vnow;
-    if(node == NULL || seek == NULL) return 1;
-
-    // Find the node we want to delete
-    int found = 0;
-    while(node) {
-        if(node == seek) {
-            found = 1;
-            break;
-        }
-        prev = node;
-        node = node->next;
-    }
-
-    // If node was found, handle delete
-    if(found) {
-        // If node is not first in chain, set correct links
-        // Otherwise set possible next entry as first
-        if(prev != NULL) {
-            prev->next = node->next;
-            iter->vnow = prev;
-        } else {
-            hm->buckets[index] = node->next;
-            iter->vnow = NULL;
-            iter->inow--;
-        }
-
-        // Alld one, free up memory.
-        hm->alloc.cfree(node->pair.key);
-        hm->alloc.cfree(node->pair.val);
-        hm->alloc.cfree(node);
-        hm->reserved--;
-        return 0;
+    if(index < 0 || iter->vnow != &hm->buckets[index] || hm->buckets[index].dist == 0) {
+        return 1;
     }
-    return 1;
-}
 
-static void _hashmap_seek_next(hashmap *hm, iterator *iter) {
-    if(iter->inow >= hashmap_size(hm)) {
-        iter->vnow = NULL;
-        iter->ended = 1;
-        return;
-    }
-    do {
-        iter->vnow = hm->buckets[iter->inow++];
-    } while(iter->vnow == NULL && iter->inow < hashmap_size(hm));
+    // Deleting shifts the following entries back by one, so the
+    // iterator needs to look at this slot again.
+    hashmap_remove_at(hm, index);
+    iter->inow = index;
+    iter->vnow = NULL;
+    return 0;
 }
 
 void* hashmap_iter_next(iterator *iter) {
-    hashmap_node *tmp = NULL;
     hashmap *hm = (hashmap*)iter->data;
-
-    // Find next non-empty bucket
-    if(iter->vnow == NULL) {
-        _hashmap_seek_next(hm, iter);
-        if(iter->vnow == NULL) {
-            return NULL;
+    while(iter->inow < (int)hm->slots) {
+        hashmap_node *node = &hm->buckets[iter->inow++];
+        if(node->dist != 0) {
+            iter->vnow = node;
+            return &node->pair;
         }
-        tmp = (hashmap_node*)iter->vnow;
-        return &tmp->pair;
-    }
-
-    // We already are in a non-empty bucket. See if it has any
-    // other non-empty buckets in list. If it does, return it.
-    tmp = (hashmap_node*)iter->vnow;
-    if(tmp->next != NULL) {
-        iter->vnow = tmp->next;
-        return &tmp->next->pair;
     }
-
-    // We are in the end of the list for this bucket.
-    // Find next non-empty bucket.
-    _hashmap_seek_next(hm, iter);
-    if(iter->vnow == NULL) {
-        return NULL;
-    }
-    tmp = (hashmap_node*)iter->vnow;
-    return &tmp->pair;
+    iter->vnow = NULL;
+    iter->ended = 1;
+    return NULL;
 }
 
 void hashmap_iter_begin(const hashmap *hm, iterator *iter) {
@@ -0,0 +1,181 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/io_worker.h"
+#include "utils/log.h"
+#include "utils/thread_sched.h"
+
+typedef struct io_task_t io_task;
+
+struct io_task_t {
+    char *path; // Set for writes
+    io_write_fn write;
+    io_task_fn run;
+    io_task_fn free_fn;
+    void *userdata;
+    io_task *next;
+};
+
+static SDL_Thread *_thread = NULL;
+static SDL_mutex *_lock = NULL;
+static SDL_cond *_changed = NULL; // Tasks queued or done, or time to quit
+static io_task *_head = NULL;
+static io_task *_tail = NULL;
+static int _busy = 0;
+static int _quit = 0;
+
+static void io_task_write(io_task *t) {
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", t->path);
+    if(t->write(tmp, t->userdata)) {
+        PERROR("Could not write %s.", t->path);
+        remove(tmp);
+        return;
+    }
+    if(rename(tmp, t->path) != 0) {
+        // Windows won't rename over an existing file
+        remove(t->path);
+        if(rename(tmp, t->path) != 0) {
+            PERROR("Could not replace %s.", t->path);
+            remove(tmp);
+        }
+    }
+}
+
+static void io_task_execute(io_task *t) {
+    if(t->path != NULL) {
+        io_task_write(t);
+    } else {
+        t->run(t->userdata);
+    }
+    if(t->free_fn != NULL) {
+        t->free_fn(t->userdata);
+    }
+    free(t->path);
+    free(t);
+}
+
+static int io_worker_run_thread(void *data) {
+    thread_sched_apply(THREAD_ROLE_JOBS);
+    SDL_LockMutex(_lock);
+    while(1) {
+        if(_head == NULL) {
+            if(_quit) {
+                break;
+            }
+            SDL_CondWait(_changed, _lock);
+            continue;
+        }
+        io_task *t = _head;
+        _head = t->next;
+        if(_head == NULL) {
+            _tail = NULL;
+        }
+        _busy = 1;
+        SDL_UnlockMutex(_lock);
+
+        io_task_execute(t);
+
+        SDL_LockMutex(_lock);
+        _busy = 0;
+        SDL_CondBroadcast(_changed);
+    }
+    SDL_UnlockMutex(_lock);
+    return 0;
+}
+
+int io_worker_init() {
+    _quit = 0;
+    _lock = SDL_CreateMutex();
+    _changed = SDL_CreateCond();
+    _thread = SDL_CreateThread(io_worker_run_thread, "io worker", NULL);
+    if(_thread == NULL) {
+        // Not fatal; files are just saved and loaded synchronously instead
+        PERROR("Unable to create I/O thread: %s", SDL_GetError());
+        SDL_DestroyCond(_changed);
+        SDL_DestroyMutex(_lock);
+        _changed = NULL;
+        _lock = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void io_worker_close() {
+    if(_thread == NULL) {
+        return;
+    }
+    SDL_LockMutex(_lock);
+    _quit = 1;
+    SDL_CondBroadcast(_changed);
+    SDL_UnlockMutex(_lock);
+    SDL_WaitThread(_thread, NULL);
+    SDL_DestroyCond(_changed);
+    SDL_DestroyMutex(_lock);
+    _thread = NULL;
+    _changed = NULL;
+    _lock = NULL;
+}
+
+static void io_worker_queue(io_task *t) {
+    if(_thread == NULL) {
+        io_task_execute(t);
+        return;
+    }
+    SDL_LockMutex(_lock);
+    if(t->path != NULL) {
+        // Only the newest contents of a file matter
+        for(io_task *q = _head; q != NULL; q = q->next) {
+            if(q->path != NULL && strcmp(q->path, t->path) == 0) {
+                if(q->free_fn != NULL) {
+                    q->free_fn(q->userdata);
+                }
+                q->write = t->write;
+                q->free_fn = t->free_fn;
+                q->userdata = t->userdata;
+                SDL_UnlockMutex(_lock);
+                free(t->path);
+                free(t);
+                return;
+            }
+        }
+    }
+    if(_tail != NULL) {
+        _tail->next = t;
+    } else {
+        _head = t;
+    }
+    _tail = t;
+    SDL_CondBroadcast(_changed);
+    SDL_UnlockMutex(_lock);
+}
+
+void io_worker_write(const char *path, io_write_fn fn, void *userdata, io_task_fn free_fn) {
+    io_task *t = malloc(sizeof(io_task));
+    memset(t, 0, sizeof(io_task));
+    t->path = strdup(path);
+    t->write = fn;
+    t->free_fn = free_fn;
+    t->userdata = userdata;
+    io_worker_queue(t);
+}
+
+void io_worker_run(io_task_fn fn, void *userdata) {
+    io_task *t = malloc(sizeof(io_task));
+    memset(t, 0, sizeof(io_task));
+    t->run = fn;
+    t->userdata = userdata;
+    io_worker_queue(t);
+}
+
+void io_worker_flush() {
+    if(_thread == NULL) {
+        return;
+    }
+    SDL_LockMutex(_lock);
+    while(_head != NULL || _busy) {
+        SDL_CondWait(_changed, _lock);
+    }
+    SDL_UnlockMutex(_lock);
+}
@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utils/jobs.h"
+#include "utils/log.h"
+#include "utils/thread_sched.h"
+#include "utils/trace.h"
+
+/*
+* Every worker has a deque of its own. A worker puts the jobs it submits at the
+* back of its deque and takes them from the back again, so related work stays on
+* one core. Jobs from other threads are handed to the workers in turn. A worker
+* with nothing left steals from the front of the other deques.
+*
+* The semaphore counts jobs that are in some deque and not yet claimed. Every
+* thread claims one count before it goes looking for a job, so there is always
+* a job to be found.
+*
+* Jobs for the main thread go to a lock-free queue with many producers and one
+* consumer, which the main thread empties in jobs_run_main.
+*
+* Workers past the active count park after their current job, on a semaphore
+* of their own. Their deques are still stolen from, so nothing queued there is
+* left behind.
+*/
+
+#define JOBS_MAX_THREADS 16
+#define JOBS_DEQUE_SIZE 64
+
+struct job_t {
+    const char *name;
+    job_fn fn;
+    void *userdata;
+    job_counter *counter;
+    int flags;
+    void *next; // Main queue link, or waiting list link. Atomic in the main queue.
+};
+
+typedef struct job_deque_t {
+    SDL_SpinLock lock;
+    job **items;
+    unsigned int cap;
+    unsigned int head; // Front, where thieves take from
+    unsigned int count;
+} job_deque;
+
+typedef struct job_worker_t {
+    SDL_Thread *thread;
+    int index;
+    job_deque deque;
+    SDL_sem *park;
+} job_worker;
+
+// Intrusive queue for many producers and one consumer. The stub node keeps it
+// from ever being empty, so producers only need to swap the head.
+typedef struct job_mpsc_t {
+    void *head; // Last pushed job
+    job *tail; // Only touched by the consumer
+    job stub;
+} job_mpsc;
+
+typedef struct job_system_t {
+    job_worker workers[JOBS_MAX_THREADS];
+    int worker_count;
+    SDL_atomic_t active; // Workers past this many park
+    SDL_atomic_t running;
+    SDL_atomic_t next_worker; // Gets the next job from outside the pool
+    SDL_sem *available;
+    SDL_TLSID tls; // Worker index + 1 on worker threads
+    SDL_threadID main_thread;
+    job_mpsc main_queue;
+    job_profile_hook hook;
+    void *hook_userdata;
+} job_system;
+
+static job_system *js = NULL;
+
+static void job_mpsc_init(job_mpsc *q) {
+    memset(&q->stub, 0, sizeof(job));
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+static void job_mpsc_push(job_mpsc *q, job *j) {
+    SDL_AtomicSetPtr(&j->next, NULL);
+    job *prev = SDL_AtomicSetPtr(&q->head, j);
+    SDL_AtomicSetPtr(&prev->next, j);
+}
+
+static job* job_mpsc_pop(job_mpsc *q) {
+    job *tail = q->tail;
+    job *next = SDL_AtomicGetPtr(&tail->next);
+    if(tail == &q->stub) {
+        if(next == NULL) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = SDL_AtomicGetPtr(&tail->next);
+    }
+    if(next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    // The tail is the last job. If a producer is halfway through a push, its job
+    // shows up on the next call. Otherwise the stub goes behind the tail.
+    if(tail != SDL_AtomicGetPtr(&q->head)) {
+        return NULL;
+    }
+    job_mpsc_push(q, &q->stub);
+    next = SDL_AtomicGetPtr(&tail->next);
+    if(next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void job_deque_create(job_deque *d) {
+    d->lock = 0;
+    d->items = malloc(sizeof(job*) * JOBS_DEQUE_SIZE);
+    d->cap = JOBS_DEQUE_SIZE;
+    d->head = 0;
+    d->count = 0;
+}
+
+static void job_deque_push(job_deque *d, job *j) {
+    SDL_AtomicLock(&d->lock);
+    if(d->count == d->cap) {
+        job **items = malloc(sizeof(job*) * d->cap * 2);
+        for(unsigned int i = 0; i < d->count; i++) {
+            items[i] = d->items[(d->head + i) % d->cap];
+        }
+        free(d->items);
+        d->items = items;
+        d->cap *= 2;
+        d->head = 0;
+    }
+    d->items[(d->head + d->count) % d->cap] = j;
+    d->count++;
+    SDL_AtomicUnlock(&d->lock);
+}
+
+static job* job_deque_pop(job_deque *d, int back) {
+    job *j = NULL;
+    SDL_AtomicLock(&d->lock);
+    if(d->count > 0) {
+        if(back) {
+            j = d->items[(d->head + d->count - 1) % d->cap];
+        } else {
+            j = d->items[d->head];
+            d->head = (d->head + 1) % d->cap;
+        }
+        d->count--;
+    }
+    SDL_AtomicUnlock(&d->lock);
+    return j;
+}
+
+static int jobs_worker_index() {
+    if(js == NULL) {
+        return -1;
+    }
+    return (int)(intptr_t)SDL_TLSGet(js->tls) - 1;
+}
+
+static int jobs_is_main_thread() {
+    return js == NULL || SDL_ThreadID() == js->main_thread;
+}
+
+// Finds a job for a thread that has already claimed one from the semaphore
+static job* jobs_take(int self) {
+    while(1) {
+        if(self >= 0) {
+            job *j = job_deque_pop(&js->workers[self].deque, 1);
+            if(j != NULL) {
+                return j;
+            }
+        }
+        for(int i = 1; i <= js->worker_count; i++) {
+            int victim = (self + i + js->worker_count) % js->worker_count;
+            job *j = job_deque_pop(&js->workers[victim].deque, 0);
+            if(j != NULL) {
+                return j;
+            }
+        }
+    }
+}
+
+static void jobs_submit(job *j);
+
+static void job_counter_release(job_counter *counter) {
+    SDL_AtomicLock(&counter->lock);
+    job *waiting = NULL;
+    if(SDL_AtomicAdd(&counter->count, -1) == 1) {
+        waiting = counter->waiting;
+        counter->waiting = NULL;
+    }
+    SDL_AtomicUnlock(&counter->lock);
+    while(waiting != NULL) {
+        job *next = waiting->next;
+        jobs_submit(waiting);
+        waiting = next;
+    }
+}
+
+static void jobs_execute(job *j) {
+    job_profile_hook hook = (js != NULL) ? js->hook : NULL;
+    uint64_t start = (hook != NULL) ? SDL_GetPerformanceCounter() : 0;
+    trace_begin("jobs", j->name);
+    j->fn(j->userdata);
+    trace_end("jobs", j->name);
+    if(hook != NULL) {
+        hook(j->name, SDL_GetPerformanceCounter() - start, js->hook_userdata);
+    }
+    job_counter *counter = j->counter;
+    free(j);
+    if(counter != NULL) {
+        job_counter_release(counter);
+    }
+}
+
+static void jobs_submit(job *j) {
+    if(j->flags & JOB_MAIN_THREAD) {
+        if(js == NULL) {
+            jobs_execute(j);
+        } else {
+            job_mpsc_push(&js->main_queue, j);
+        }
+        return;
+    }
+    if(js == NULL || js->worker_count == 0) {
+        jobs_execute(j);
+        return;
+    }
+    int target = jobs_worker_index();
+    if(target < 0) {
+        target = (SDL_AtomicAdd(&js->next_worker, 1) & 0x7FFFFFFF) % js->worker_count;
+    }
+    job_deque_push(&js->workers[target].deque, j);
+    SDL_SemPost(js->available);
+}
+
+static int jobs_worker_run(void *data) {
+    job_worker *worker = data;
+    thread_sched_apply(THREAD_ROLE_JOBS);
+    SDL_TLSSet(js->tls, (void*)(intptr_t)(worker->index + 1), NULL);
+    while(1) {
+        SDL_SemWait(js->available);
+        if(!SDL_AtomicGet(&js->running)) {
+            break;
+        }
+        jobs_execute(jobs_take(worker->index));
+        while(worker->index >= SDL_AtomicGet(&js->active) && SDL_AtomicGet(&js->running)) {
+            SDL_SemWait(worker->park);
+        }
+    }
+    return 0;
+}
+
+// The calling thread becomes the main thread, and helps out while it waits
+int jobs_init(int threads) {
+    if(js != NULL) {
+        return 0;
+    }
+    js = malloc(sizeof(job_system));
+    memset(js, 0, sizeof(job_system));
+    SDL_AtomicSet(&js->running, 1);
+    js->available = SDL_CreateSemaphore(0);
+    js->tls = SDL_TLSCreate();
+    js->main_thread = SDL_ThreadID();
+    job_mpsc_init(&js->main_queue);
+
+    if(threads > JOBS_MAX_THREADS) {
+        threads = JOBS_MAX_THREADS;
+    }
+    for(int i = 0; i < threads; i++) {
+        job_deque_create(&js->workers[i].deque);
+        js->workers[i].park = SDL_CreateSemaphore(0);
+    }
+    for(int i = 0; i < threads; i++) {
+        js->workers[i].index = i;
+        js->workers[i].thread = SDL_CreateThread(jobs_worker_run, "jobs", &js->workers[i]);
+        if(js->workers[i].thread == NULL) {
+            PERROR("Unable to create job thread: %s", SDL_GetError());
+            break;
+        }
+        js->worker_count++;
+    }
+    for(int i = js->worker_count; i < threads; i++) {
+        free(js->workers[i].deque.items);
+        SDL_DestroySemaphore(js->workers[i].park);
+    }
+    SDL_AtomicSet(&js->active, js->worker_count);
+    DEBUG("Job system started with %d worker threads.", js->worker_count);
+    return 0;
+}
+
+// Jobs that haven't started by now are dropped, so wait for them first
+void jobs_close() {
+    if(js == NULL) {
+        return;
+    }
+    jobs_run_main();
+    SDL_AtomicSet(&js->running, 0);
+    for(int i = 0; i < js->worker_count; i++) {
+        SDL_SemPost(js->available);
+        SDL_SemPost(js->workers[i].park);
+    }
+    for(int i = 0; i < js->worker_count; i++) {
+        SDL_WaitThread(js->workers[i].thread, NULL);
+        SDL_DestroySemaphore(js->workers[i].park);
+        job *j;
+        while((j = job_deque_pop(&js->workers[i].deque, 0)) != NULL) {
+            free(j);
+        }
+        free(js->workers[i].deque.items);
+    }
+    SDL_DestroySemaphore(js->available);
+    free(js);
+    js = NULL;
+}
+
+int jobs_thread_count() {
+    return (js != NULL) ? js->worker_count : 0;
+}
+
+// A parked worker still takes the one job it may have claimed already, so
+// lowering the count takes effect within a job's time
+void jobs_set_active(int threads) {
+    if(js == NULL) {
+        return;
+    }
+    if(threads <= 0 || threads > js->worker_count) {
+        threads = js->worker_count;
+    }
+    int was = SDL_AtomicSet(&js->active, threads);
+    for(int i = was; i < threads; i++) {
+        SDL_SemPost(js->workers[i].park);
+    }
+}
+
+int jobs_active_count() {
+    return (js != NULL) ? SDL_AtomicGet(&js->active) : 0;
+}
+
+void jobs_set_profile_hook(job_profile_hook hook, void *userdata) {
+    if(js != NULL) {
+        js->hook = hook;
+        js->hook_userdata = userdata;
+    }
+}
+
+void job_counter_init(job_counter *counter) {
+    SDL_AtomicSet(&counter->count, 0);
+    counter->lock = 0;
+    counter->waiting = NULL;
+}
+
+int job_counter_done(job_counter *counter) {
+    return SDL_AtomicGet(&counter->count) == 0;
+}
+
+void jobs_run(const char *name, job_fn fn, void *userdata, job_counter *counter, int flags) {
+    jobs_run_after(NULL, name, fn, userdata, counter, flags);
+}
+
+void jobs_run_after(job_counter *after,
+                    const char *name,
+                    job_fn fn,
+                    void *userdata,
+                    job_counter *counter,
+                    int flags) {
+    job *j = malloc(sizeof(job));
+    j->name = name;
+    j->fn = fn;
+    j->userdata = userdata;
+    j->counter = counter;
+    j->flags = flags;
+    j->next = NULL;
+    if(counter != NULL) {
+        SDL_AtomicAdd(&counter->count, 1);
+    }
+    if(after != NULL) {
+        SDL_AtomicLock(&after->lock);
+        if(SDL_AtomicGet(&after->count) > 0) {
+            j->next = after->waiting;
+            after->waiting = j;
+            SDL_AtomicUnlock(&after->lock);
+            return;
+        }
+        SDL_AtomicUnlock(&after->lock);
+    }
+    jobs_submit(j);
+}
+
+void jobs_wait(job_counter *counter) {
+    int main = jobs_is_main_thread();
+    while(SDL_AtomicGet(&counter->count) > 0) {
+        if(main && jobs_run_main() > 0) {
+            continue;
+        }
+        if(js != NULL && SDL_AtomicGet(&js->running) && SDL_SemTryWait(js->available) == 0) {
+            jobs_execute(jobs_take(jobs_worker_index()));
+            continue;
+        }
+        SDL_Delay(0);
+    }
+
+    // The thread that finished the last job may still hold the lock
+    SDL_AtomicLock(&counter->lock);
+    SDL_AtomicUnlock(&counter->lock);
+}
+
+int jobs_run_main() {
+    if(js == NULL) {
+        return 0;
+    }
+    int count = 0;
+    job *j;
+    while((j = job_mpsc_pop(&js->main_queue)) != NULL) {
+        jobs_execute(j);
+        count++;
+    }
+    return count;
+}
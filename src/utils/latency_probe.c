@@ -0,0 +1,160 @@
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "utils/latency_probe.h"
+
+enum {
+    STAGE_IDLE = 0,
+    STAGE_CMD,
+    STAGE_ACT,
+    STAGE_RENDER,
+    STAGE_PRESENT
+};
+
+static const char *span_names[LATENCY_SPANS] = {
+    "event-cmd",
+    "cmd-act",
+    "act-render",
+    "render-present",
+    "total",
+};
+
+static SDL_SpinLock lock;
+static int enabled = 0;
+static int marker = 0;
+static int stage = STAGE_IDLE; // Next stage to be stamped
+static uint64_t stamps[STAGE_PRESENT + 1]; // Performance counter, by stage; STAGE_IDLE is the event
+static latency_stats stats;
+
+static void latency_probe_add(int span, uint64_t counts) {
+    uint64_t ms = counts * 1000 / SDL_GetPerformanceFrequency();
+    stats.hist[span][ms < LATENCY_BUCKETS ? ms : LATENCY_BUCKETS - 1]++;
+}
+
+// Stamps the stage if it is the one due. Lock held.
+static int latency_probe_stamp(int at) {
+    if(stage != at) {
+        return 0;
+    }
+    uint64_t now = SDL_GetPerformanceCounter();
+    if(now - stamps[STAGE_IDLE] > SDL_GetPerformanceFrequency() * LATENCY_TIMEOUT_MS / 1000) {
+        stage = STAGE_IDLE;
+        stats.dropped++;
+        return 0;
+    }
+    stamps[at] = now;
+    stage = (at == STAGE_PRESENT) ? STAGE_IDLE : at + 1;
+    return 1;
+}
+
+void latency_probe_enable(int enable, int with_marker) {
+    SDL_AtomicLock(&lock);
+    enabled = enable;
+    marker = enable && with_marker;
+    stage = STAGE_IDLE;
+    SDL_AtomicUnlock(&lock);
+}
+
+int latency_probe_is_enabled() {
+    return enabled;
+}
+
+int latency_probe_marker_due() {
+    return marker && stage == STAGE_PRESENT;
+}
+
+void latency_probe_input(uint32_t timestamp) {
+    if(!enabled) {
+        return;
+    }
+    SDL_AtomicLock(&lock);
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    int busy = stage != STAGE_IDLE && now - stamps[STAGE_IDLE] <= freq * LATENCY_TIMEOUT_MS / 1000;
+    if(!busy) {
+        if(stage != STAGE_IDLE) {
+            stats.dropped++;
+        }
+        // The event happened this long before the performance counter was read
+        uint32_t ago = SDL_GetTicks() - timestamp;
+        if(ago > LATENCY_TIMEOUT_MS) {
+            ago = 0;
+        }
+        stamps[STAGE_IDLE] = now - ago * freq / 1000;
+        stage = STAGE_CMD;
+    }
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_cmd() {
+    if(!enabled) {
+        return;
+    }
+    SDL_AtomicLock(&lock);
+    latency_probe_stamp(STAGE_CMD);
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_act() {
+    if(!enabled) {
+        return;
+    }
+    SDL_AtomicLock(&lock);
+    latency_probe_stamp(STAGE_ACT);
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_rendered() {
+    if(!enabled) {
+        return;
+    }
+    SDL_AtomicLock(&lock);
+    latency_probe_stamp(STAGE_RENDER);
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_presented() {
+    if(!enabled) {
+        return;
+    }
+    SDL_AtomicLock(&lock);
+    if(latency_probe_stamp(STAGE_PRESENT)) {
+        for(int i = 0; i < LATENCY_SPAN_TOTAL; i++) {
+            latency_probe_add(i, stamps[i + 1] - stamps[i]);
+        }
+        latency_probe_add(LATENCY_SPAN_TOTAL, stamps[STAGE_PRESENT] - stamps[STAGE_IDLE]);
+        stats.samples++;
+    }
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_get(latency_stats *out) {
+    SDL_AtomicLock(&lock);
+    *out = stats;
+    SDL_AtomicUnlock(&lock);
+}
+
+void latency_probe_reset() {
+    SDL_AtomicLock(&lock);
+    memset(&stats, 0, sizeof(stats));
+    stage = STAGE_IDLE;
+    SDL_AtomicUnlock(&lock);
+}
+
+const char* latency_probe_span_name(int span) {
+    return span_names[span];
+}
+
+int latency_probe_percentile(const latency_stats *s, int span, float p) {
+    if(s->samples == 0) {
+        return 0;
+    }
+    unsigned int want = (unsigned int)(p / 100.0f * (s->samples - 1) + 0.5f) + 1;
+    unsigned int seen = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += s->hist[span][i];
+        if(seen >= want) {
+            return i;
+        }
+    }
+    return LATENCY_BUCKETS - 1;
+}
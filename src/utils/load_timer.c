@@ -0,0 +1,76 @@
+#include <limits.h>
+#include <SDL2/SDL.h>
+#include "utils/load_timer.h"
+
+static const char *phase_names[LOAD_TIME_COUNT] = {
+    "plugins",
+    "video_init",
+    "audio_init",
+    "game_files",
+    "engine_init",
+    "scene",
+    "bk",
+    "af",
+    "sprites",
+    "tcache_warm",
+    "frame",
+};
+
+// Microseconds, so they fit the atomics
+static SDL_atomic_t counts[LOAD_TIME_COUNT];
+static SDL_atomic_t total_us[LOAD_TIME_COUNT];
+static SDL_atomic_t max_us[LOAD_TIME_COUNT];
+static int enabled = 0;
+static uint64_t enabled_at = 0;
+
+void load_timer_enable() {
+    enabled = 1;
+    enabled_at = SDL_GetPerformanceCounter();
+}
+
+int load_timer_is_enabled() {
+    return enabled;
+}
+
+float load_timer_elapsed_ms() {
+    if(!enabled) {
+        return 0.0f;
+    }
+    return (SDL_GetPerformanceCounter() - enabled_at) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+uint64_t load_timer_start() {
+    return enabled ? SDL_GetPerformanceCounter() : 0;
+}
+
+void load_timer_add(int phase, uint64_t start) {
+    if(start == 0) {
+        return;
+    }
+    uint64_t us = (SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency();
+    int v = (us > INT_MAX) ? INT_MAX : (int)us;
+    SDL_AtomicAdd(&counts[phase], 1);
+    SDL_AtomicAdd(&total_us[phase], v);
+    int old;
+    do {
+        old = SDL_AtomicGet(&max_us[phase]);
+    } while(v > old && !SDL_AtomicCAS(&max_us[phase], old, v));
+}
+
+void load_timer_get(int phase, load_time *t) {
+    t->count = SDL_AtomicGet(&counts[phase]);
+    t->total_ms = SDL_AtomicGet(&total_us[phase]) / 1000.0f;
+    t->max_ms = SDL_AtomicGet(&max_us[phase]) / 1000.0f;
+}
+
+void load_timer_reset() {
+    for(int i = 0; i < LOAD_TIME_COUNT; i++) {
+        SDL_AtomicSet(&counts[i], 0);
+        SDL_AtomicSet(&total_us[i], 0);
+        SDL_AtomicSet(&max_us[i], 0);
+    }
+}
+
+const char* load_timer_name(int phase) {
+    return phase_names[phase];
+}
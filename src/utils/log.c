@@ -1,9 +1,133 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <SDL2/SDL.h>
 #include "utils/log.h"
 
-FILE *handle = 0;
+/*
+* Lines are formatted on the calling thread and handed to a flusher thread
+* through a bounded multi-producer queue, so that logging from the game loop
+* never waits for file I/O. Every slot carries a sequence number that tells
+* whether it is free for writers or ready for the flusher (see Dmitry Vyukov's
+* bounded MPMC queue). The flusher is woken early once the queue is half full.
+* If it is full anyway, the line is dropped and counted; errors instead wait
+* for room, since they are the lines that matter when something goes wrong.
+* Without the flusher thread (before log_init, or if it could not be started)
+* lines are written directly.
+*/
+
+#define LOG_LINE_SIZE 256
+#define LOG_QUEUE_LINES 1024
+// How often the flusher wakes up on its own
+#define LOG_FLUSH_PERIOD_MS 50
+
+typedef struct log_line_t {
+    SDL_atomic_t seq;
+    int len;
+    char text[LOG_LINE_SIZE];
+} log_line;
+
+static FILE *handle = NULL;
+static log_line *queue = NULL;
+static SDL_atomic_t head;
+static SDL_atomic_t tail; // Only written by the flusher
+static SDL_atomic_t dropped;
+static SDL_atomic_t running;
+static SDL_sem *wake = NULL;
+static SDL_Thread *flusher = NULL;
+
 unsigned int _log_tick = 0;
+int _log_level = LOG_DEBUG;
+
+static int log_format(char *buf, size_t size, char mode, const char *fn, const char *fmt, va_list args) {
+    int len;
+    if(fn != NULL) {
+        len = snprintf(buf, size, "[%7u][%c] %s(): ", _log_tick, mode, fn);
+    } else {
+        len = snprintf(buf, size, "[%7u][%c] ", _log_tick, mode);
+    }
+    if(len < size) {
+        int n = vsnprintf(buf + len, size - len, fmt, args);
+        len = (n < 0) ? len : len + n;
+    }
+
+    // Long lines are cut, but always end with a newline
+    if(len > size - 2) {
+        len = size - 2;
+    }
+    buf[len++] = '\n';
+    buf[len] = 0;
+    return len;
+}
+
+static int log_push(const char *text, int len) {
+    int pos = SDL_AtomicGet(&head);
+    if(pos - SDL_AtomicGet(&tail) == LOG_QUEUE_LINES / 2) {
+        SDL_SemPost(wake);
+    }
+    while(1) {
+        log_line *line = &queue[(unsigned)pos % LOG_QUEUE_LINES];
+        int diff = (int)((unsigned)SDL_AtomicGet(&line->seq) - (unsigned)pos);
+        if(diff == 0) {
+            if(SDL_AtomicCAS(&head, pos, pos + 1)) {
+                memcpy(line->text, text, len);
+                line->len = len;
+                SDL_AtomicSet(&line->seq, pos + 1);
+                return 0;
+            }
+            pos = SDL_AtomicGet(&head);
+        } else if(diff < 0) {
+            return 1; // Full
+        } else {
+            pos = SDL_AtomicGet(&head);
+        }
+    }
+}
+
+static void log_drain() {
+    int pos = SDL_AtomicGet(&tail);
+    while(1) {
+        log_line *line = &queue[(unsigned)pos % LOG_QUEUE_LINES];
+        if(SDL_AtomicGet(&line->seq) != pos + 1) {
+            break;
+        }
+        fwrite(line->text, 1, line->len, handle);
+        SDL_AtomicSet(&line->seq, pos + LOG_QUEUE_LINES);
+        SDL_AtomicSet(&tail, ++pos);
+    }
+    int lost = SDL_AtomicSet(&dropped, 0);
+    if(lost > 0) {
+        fprintf(handle, "[%7u][E] %d log lines dropped\n", _log_tick, lost);
+    }
+    fflush(handle);
+}
+
+static int log_flusher_run(void *data) {
+    while(SDL_AtomicGet(&running)) {
+        SDL_SemWaitTimeout(wake, LOG_FLUSH_PERIOD_MS);
+        log_drain();
+    }
+    return 0;
+}
+
+static void log_start_flusher() {
+    queue = malloc(sizeof(log_line) * LOG_QUEUE_LINES);
+    for(int i = 0; i < LOG_QUEUE_LINES; i++) {
+        SDL_AtomicSet(&queue[i].seq, i);
+    }
+    SDL_AtomicSet(&head, 0);
+    SDL_AtomicSet(&dropped, 0);
+    SDL_AtomicSet(&running, 1);
+    SDL_AtomicSet(&tail, 0);
+    wake = SDL_CreateSemaphore(0);
+    flusher = SDL_CreateThread(log_flusher_run, "log", NULL);
+    if(flusher == NULL) {
+        SDL_DestroySemaphore(wake);
+        wake = NULL;
+        free(queue);
+        queue = NULL;
+    }
+}
 
 int log_init(const char *filename) {
     if(handle) return 1;
@@ -16,24 +140,58 @@ int log_init(const char *filename) {
             return 1;
         }
     }
+    log_start_flusher();
     return 0;
 }
 
 void log_close() {
+    if(flusher != NULL) {
+        SDL_AtomicSet(&running, 0);
+        SDL_SemPost(wake);
+        SDL_WaitThread(flusher, NULL);
+        flusher = NULL;
+        log_drain();
+        SDL_DestroySemaphore(wake);
+        wake = NULL;
+        free(queue);
+        queue = NULL;
+    }
     if(handle != stdout && handle != 0) {
         fclose(handle);
     }
+    handle = NULL;
+}
+
+void log_set_level(int level) {
+    _log_level = level;
+}
+
+int log_get_level() {
+    return _log_level;
 }
 
 void log_print(char mode, const char *fn, const char *fmt, ...) {
-    if(fn != NULL) {
-        fprintf(handle, "[%7u][%c] %s(): ", _log_tick, mode, fn);
-    } else {
-        fprintf(handle, "[%7u][%c] ", _log_tick, mode);
-    }
+    char buf[LOG_LINE_SIZE];
     va_list args;
     va_start(args, fmt);
-    vfprintf(handle, fmt, args);
+    int len = log_format(buf, sizeof(buf), mode, fn, fmt, args);
     va_end(args);
-    fprintf(handle, "\n");
+
+    if(flusher == NULL) {
+        fwrite(buf, 1, len, handle != NULL ? handle : stderr);
+        return;
+    }
+    if(mode != 'E') {
+        if(log_push(buf, len)) {
+            SDL_AtomicIncRef(&dropped);
+        }
+        return;
+    }
+
+    // Errors are often followed by a crash or an exit, so get them out now
+    while(log_push(buf, len)) {
+        SDL_SemPost(wake);
+        SDL_Delay(1);
+    }
+    SDL_SemPost(wake);
 }
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils/mapfile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static int mapfile_read(mapfile *mf, const char *filename) {
+    FILE *handle = fopen(filename, "rb");
+    if(handle == NULL) {
+        return 1;
+    }
+    fseek(handle, 0L, SEEK_END);
+    long size = ftell(handle);
+    rewind(handle);
+    if(size < 0) {
+        fclose(handle);
+        return 1;
+    }
+    char *data = malloc(size > 0 ? size : 1);
+    if(fread(data, 1, size, handle) != (size_t)size) {
+        free(data);
+        fclose(handle);
+        return 1;
+    }
+    fclose(handle);
+    mf->data = data;
+    mf->size = size;
+    mf->mapped = 0;
+    return 0;
+}
+
+int mapfile_open(mapfile *mf, const char *filename) {
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return 1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+            close(fd);
+            mf->data = data;
+            mf->size = st.st_size;
+            mf->mapped = 1;
+            return 0;
+        }
+    }
+    close(fd);
+#endif
+    return mapfile_read(mf, filename);
+}
+
+void mapfile_close(mapfile *mf) {
+    if(mf->data == NULL) {
+        return;
+    }
+#ifndef _WIN32
+    if(mf->mapped) {
+        munmap((void*)mf->data, mf->size);
+    } else {
+        free((void*)mf->data);
+    }
+#else
+    free((void*)mf->data);
+#endif
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utils/memarena.h"
+
+#define MEMARENA_ALIGN 16
+#define MEMARENA_ALIGN_UP(x) (((x) + MEMARENA_ALIGN - 1) & ~(size_t)(MEMARENA_ALIGN - 1))
+
+#define SCENE_ARENA_BLOCK (64 * 1024)
+#define FRAME_ARENA_BLOCK (16 * 1024)
+
+struct memarena_block_t {
+    memarena_block *next;
+    size_t size;
+    size_t pos;
+    // Data follows, aligned to MEMARENA_ALIGN
+};
+
+// Every allocation is prefixed with its size, so that realloc knows how much to copy
+typedef struct memarena_header_t {
+    size_t size;
+} memarena_header;
+
+#define BLOCK_HEADER MEMARENA_ALIGN_UP(sizeof(memarena_block))
+#define ALLOC_HEADER MEMARENA_ALIGN_UP(sizeof(memarena_header))
+
+static memarena_block* memarena_new_block(size_t size) {
+    memarena_block *block = malloc(BLOCK_HEADER + size);
+    block->next = NULL;
+    block->size = size;
+    block->pos = 0;
+    return block;
+}
+
+void memarena_create(memarena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size;
+    arena->used = 0;
+}
+
+void* memarena_alloc(memarena *arena, size_t size) {
+    size_t need = ALLOC_HEADER + MEMARENA_ALIGN_UP(size);
+    memarena_block *block = arena->head;
+    if(block == NULL || block->pos + need > block->size) {
+        // Oversized requests get a block of their own
+        size_t bsize = (need > arena->block_size) ? need : arena->block_size;
+        block = memarena_new_block(bsize);
+        block->next = arena->head;
+        arena->head = block;
+    }
+    char *p = (char*)block + BLOCK_HEADER + block->pos;
+    block->pos += need;
+    arena->used += need;
+    ((memarena_header*)p)->size = size;
+    return p + ALLOC_HEADER;
+}
+
+void* memarena_realloc(memarena *arena, void *ptr, size_t size) {
+    if(ptr == NULL) {
+        return memarena_alloc(arena, size);
+    }
+    memarena_header *hdr = (memarena_header*)((char*)ptr - ALLOC_HEADER);
+    if(size <= hdr->size) {
+        return ptr;
+    }
+
+    // Grow in place if this was the last allocation of the current block
+    memarena_block *block = arena->head;
+    char *end = (char*)block + BLOCK_HEADER + block->pos;
+    size_t old_need = MEMARENA_ALIGN_UP(hdr->size);
+    size_t new_need = MEMARENA_ALIGN_UP(size);
+    if((char*)ptr + old_need == end && block->pos - old_need + new_need <= block->size) {
+        block->pos += new_need - old_need;
+        arena->used += new_need - old_need;
+        hdr->size = size;
+        return ptr;
+    }
+
+    void *p = memarena_alloc(arena, size);
+    memcpy(p, ptr, hdr->size);
+    return p;
+}
+
+// Keeps the newest block around for reuse, frees the rest
+void memarena_reset(memarena *arena) {
+    memarena_block *block = arena->head;
+    if(block == NULL) {
+        return;
+    }
+    memarena_block *next = block->next;
+    while(next != NULL) {
+        memarena_block *tmp = next->next;
+        free(next);
+        next = tmp;
+    }
+    block->next = NULL;
+    block->pos = 0;
+    arena->used = 0;
+}
+
+void memarena_free(memarena *arena) {
+    memarena_block *block = arena->head;
+    while(block != NULL) {
+        memarena_block *tmp = block->next;
+        free(block);
+        block = tmp;
+    }
+    arena->head = NULL;
+    arena->used = 0;
+}
+
+size_t memarena_used(const memarena *arena) {
+    return arena->used;
+}
+
+static memarena _scene_arena = {NULL, SCENE_ARENA_BLOCK, 0};
+static memarena _frame_arena = {NULL, FRAME_ARENA_BLOCK, 0};
+
+static void* scene_malloc(size_t size) { return memarena_alloc(&_scene_arena, size); }
+static void* scene_realloc(void *ptr, size_t size) { return memarena_realloc(&_scene_arena, ptr, size); }
+static void* frame_malloc(size_t size) { return memarena_alloc(&_frame_arena, size); }
+static void* frame_realloc(void *ptr, size_t size) { return memarena_realloc(&_frame_arena, ptr, size); }
+static void arena_nop_free(void *ptr) {}
+
+allocator memarena_scene_allocator() {
+    allocator alloc;
+    alloc.cmalloc = scene_malloc;
+    alloc.crealloc = scene_realloc;
+    alloc.cfree = arena_nop_free;
+    return alloc;
+}
+
+allocator memarena_frame_allocator() {
+    allocator alloc;
+    alloc.cmalloc = frame_malloc;
+    alloc.crealloc = frame_realloc;
+    alloc.cfree = arena_nop_free;
+    return alloc;
+}
+
+void memarena_scene_reset() {
+    memarena_reset(&_scene_arena);
+}
+
+void memarena_frame_reset() {
+    memarena_reset(&_frame_arena);
+}
+
+void memarena_close() {
+    memarena_free(&_scene_arena);
+    memarena_free(&_frame_arena);
+}
@@ -0,0 +1,90 @@
+#include "utils/mempool.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+// Blocks are aligned to this, and must be able to hold the free list pointer
+#define MEMPOOL_ALIGN 16
+
+void mempool_create(mempool *pool, unsigned int block_size, unsigned int capacity) {
+    allocator alloc;
+    alloc.cmalloc = malloc;
+    alloc.crealloc = realloc;
+    alloc.cfree = free;
+    mempool_create_with_allocator(pool, block_size, capacity, alloc);
+}
+
+void mempool_create_with_allocator(mempool *pool, unsigned int block_size, unsigned int capacity, allocator alloc) {
+    pool->alloc = alloc;
+    if(block_size < sizeof(void*)) {
+        block_size = sizeof(void*);
+    }
+    pool->block_size = (block_size + MEMPOOL_ALIGN - 1) & ~(MEMPOOL_ALIGN - 1);
+    pool->capacity = capacity;
+    pool->used = 0;
+    pool->peak = 0;
+    pool->overflows = 0;
+    pool->free_list = NULL;
+    pool->data = NULL;
+    if(capacity == 0) {
+        return;
+    }
+    pool->data = pool->alloc.cmalloc(pool->block_size * capacity);
+
+    // Chain all blocks to the free list, first block first
+    for(int i = capacity - 1; i >= 0; i--) {
+        void *block = pool->data + i * pool->block_size;
+        *(void**)block = pool->free_list;
+        pool->free_list = block;
+    }
+}
+
+void mempool_free(mempool *pool) {
+    if(pool->data != NULL) {
+        pool->alloc.cfree(pool->data);
+    }
+    pool->data = NULL;
+    pool->free_list = NULL;
+    pool->capacity = 0;
+    pool->used = 0;
+}
+
+int mempool_owns(const mempool *pool, const void *ptr) {
+    uintptr_t p = (uintptr_t)ptr;
+    uintptr_t start = (uintptr_t)pool->data;
+    return (pool->data != NULL && p >= start && p < start + pool->block_size * pool->capacity);
+}
+
+void* mempool_alloc(mempool *pool) {
+    if(pool->free_list == NULL) {
+        pool->overflows++;
+        return pool->alloc.cmalloc(pool->block_size);
+    }
+    void *block = pool->free_list;
+    pool->free_list = *(void**)block;
+    pool->used++;
+    if(pool->used > pool->peak) {
+        pool->peak = pool->used;
+    }
+    return block;
+}
+
+void mempool_release(mempool *pool, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    if(!mempool_owns(pool, ptr)) {
+        pool->alloc.cfree(ptr);
+        return;
+    }
+    *(void**)ptr = pool->free_list;
+    pool->free_list = ptr;
+    pool->used--;
+}
+
+unsigned int mempool_used(const mempool *pool) {
+    return pool->used;
+}
+
+unsigned int mempool_capacity(const mempool *pool) {
+    return pool->capacity;
+}
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "utils/memtrack.h"
+#include "utils/log.h"
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+// Header in front of every block. Kept at 16 bytes so the blocks stay as
+// aligned as malloc makes them.
+typedef union mem_header_t {
+    struct {
+        size_t size;
+        int tag;
+    };
+    char pad[16];
+} mem_header;
+
+typedef struct mem_counters_t {
+    SDL_atomic_t live;
+    SDL_atomic_t peak;
+    SDL_atomic_t allocs;
+    SDL_atomic_t count;
+} mem_counters;
+
+static mem_counters counters[MEM_TAG_COUNT];
+static mem_counters total;
+
+// Guard state. The TLS slot holds the name of the open guard on the thread.
+static SDL_atomic_t guards_open;
+static SDL_atomic_t guard_hits;
+static SDL_SpinLock guard_lock;
+static SDL_TLSID guard_tls = 0;
+static mem_guard_hook guard_hook = NULL;
+static void *guard_userdata = NULL;
+
+static const char *tag_names[] = {
+    "misc",
+    "video",
+    "tcache",
+    "resources",
+    "audio",
+    "objects",
+    "gui",
+    "net",
+};
+
+static void mem_raise_peak(SDL_atomic_t *peak, int live) {
+    int old = SDL_AtomicGet(peak);
+    while(live > old && !SDL_AtomicCAS(peak, old, live)) {
+        old = SDL_AtomicGet(peak);
+    }
+}
+
+static void mem_count(mem_counters *c, int bytes, int blocks) {
+    int live = SDL_AtomicAdd(&c->live, bytes) + bytes;
+    SDL_AtomicAdd(&c->count, blocks);
+    if(bytes > 0) {
+        mem_raise_peak(&c->peak, live);
+    }
+}
+
+static void mem_account(int tag, int bytes, int blocks) {
+    mem_count(&counters[tag], bytes, blocks);
+    mem_count(&total, bytes, blocks);
+}
+
+static void mem_guard_default_hook(const char *where, size_t size, void *userdata) {
+    PERROR("Allocation of %u bytes in %s", (unsigned int)size, where);
+#if defined(__GLIBC__)
+    void *frames[16];
+    int count = backtrace(frames, 16);
+    backtrace_symbols_fd(frames, count, 2);
+#endif
+}
+
+// Called for every allocation. Cheap while no guard is open anywhere.
+static void mem_guard_note(size_t size) {
+    if(SDL_AtomicGet(&guards_open) == 0) {
+        return;
+    }
+    const char *where = SDL_TLSGet(guard_tls);
+    if(where == NULL) {
+        return;
+    }
+    SDL_AtomicAdd(&guard_hits, 1);
+
+    // The hook may allocate too, so the guard is closed while it runs
+    SDL_TLSSet(guard_tls, NULL, NULL);
+    mem_guard_hook hook = (guard_hook != NULL) ? guard_hook : mem_guard_default_hook;
+    hook(where, size, guard_userdata);
+    SDL_TLSSet(guard_tls, where, NULL);
+}
+
+#ifdef ALLOC_GUARD
+// Linked in place of the C library functions with -Wl,--wrap, see CMakeLists.txt
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    mem_guard_note(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    mem_guard_note(num * size);
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size) {
+    mem_guard_note(size);
+    return __real_realloc(ptr, size);
+}
+
+#define MEM_GUARD_NOTE(size)
+#else
+#define MEM_GUARD_NOTE(size) mem_guard_note(size)
+#endif
+
+static void* mem_attach(mem_header *h, mem_tag tag, size_t size) {
+    if(h == NULL) {
+        return NULL;
+    }
+    h->size = size;
+    h->tag = tag;
+    mem_account(tag, (int)size, 1);
+    SDL_AtomicAdd(&counters[tag].allocs, 1);
+    SDL_AtomicAdd(&total.allocs, 1);
+    return h + 1;
+}
+
+void* mem_malloc(mem_tag tag, size_t size) {
+    MEM_GUARD_NOTE(size);
+    return mem_attach(malloc(sizeof(mem_header) + size), tag, size);
+}
+
+void* mem_calloc(mem_tag tag, size_t num, size_t size) {
+    MEM_GUARD_NOTE(num * size);
+    return mem_attach(calloc(1, sizeof(mem_header) + num * size), tag, num * size);
+}
+
+// Keeps the tag the block was allocated with
+void* mem_realloc(mem_tag tag, void *ptr, size_t size) {
+    if(ptr == NULL) {
+        return mem_malloc(tag, size);
+    }
+    MEM_GUARD_NOTE(size);
+    mem_header *h = (mem_header*)ptr - 1;
+    size_t old = h->size;
+    int old_tag = h->tag;
+    h = realloc(h, sizeof(mem_header) + size);
+    if(h == NULL) {
+        return NULL;
+    }
+    h->size = size;
+    mem_account(old_tag, (int)size - (int)old, 0);
+    return h + 1;
+}
+
+void mem_free(void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    mem_header *h = (mem_header*)ptr - 1;
+    mem_account(h->tag, -(int)h->size, -1);
+    free(h);
+}
+
+// The allocator interface has no room for context, so every tag gets its own functions
+#define MEM_TAG_FUNCS(name, tag) \
+    static void* name##_malloc(size_t size) { return mem_malloc(tag, size); } \
+    static void* name##_realloc(void *ptr, size_t size) { return mem_realloc(tag, ptr, size); }
+
+MEM_TAG_FUNCS(misc, MEM_TAG_MISC)
+MEM_TAG_FUNCS(video, MEM_TAG_VIDEO)
+MEM_TAG_FUNCS(tcache, MEM_TAG_TCACHE)
+MEM_TAG_FUNCS(resources, MEM_TAG_RESOURCES)
+MEM_TAG_FUNCS(audio, MEM_TAG_AUDIO)
+MEM_TAG_FUNCS(objects, MEM_TAG_OBJECTS)
+MEM_TAG_FUNCS(gui, MEM_TAG_GUI)
+MEM_TAG_FUNCS(net, MEM_TAG_NET)
+
+static const allocator tag_allocators[] = {
+    {misc_malloc, mem_free, misc_realloc},
+    {video_malloc, mem_free, video_realloc},
+    {tcache_malloc, mem_free, tcache_realloc},
+    {resources_malloc, mem_free, resources_realloc},
+    {audio_malloc, mem_free, audio_realloc},
+    {objects_malloc, mem_free, objects_realloc},
+    {gui_malloc, mem_free, gui_realloc},
+    {net_malloc, mem_free, net_realloc},
+};
+
+allocator mem_allocator(mem_tag tag) {
+    return tag_allocators[tag];
+}
+
+const char* mem_tag_name(mem_tag tag) {
+    return tag_names[tag];
+}
+
+static void mem_read(const mem_counters *c, mem_stats *stats) {
+    stats->live = SDL_AtomicGet((SDL_atomic_t*)&c->live);
+    stats->peak = SDL_AtomicGet((SDL_atomic_t*)&c->peak);
+    stats->allocs = SDL_AtomicGet((SDL_atomic_t*)&c->allocs);
+    stats->count = SDL_AtomicGet((SDL_atomic_t*)&c->count);
+}
+
+void mem_get_stats(mem_tag tag, mem_stats *stats) {
+    mem_read(&counters[tag], stats);
+}
+
+void mem_get_total(mem_stats *stats) {
+    mem_read(&total, stats);
+}
+
+// Peaks start over from the current live bytes
+void mem_reset_peaks() {
+    for(int i = 0; i < MEM_TAG_COUNT; i++) {
+        SDL_AtomicSet(&counters[i].peak, SDL_AtomicGet(&counters[i].live));
+    }
+    SDL_AtomicSet(&total.peak, SDL_AtomicGet(&total.live));
+}
+
+void mem_guard_begin(const char *where) {
+    if(guard_tls == 0) {
+        SDL_AtomicLock(&guard_lock);
+        if(guard_tls == 0) {
+            guard_tls = SDL_TLSCreate();
+        }
+        SDL_AtomicUnlock(&guard_lock);
+    }
+    SDL_TLSSet(guard_tls, where, NULL);
+    SDL_AtomicAdd(&guards_open, 1);
+}
+
+void mem_guard_end() {
+    SDL_TLSSet(guard_tls, NULL, NULL);
+    SDL_AtomicAdd(&guards_open, -1);
+}
+
+// Allocations seen inside guards since the last reset
+unsigned int mem_guard_count() {
+    return SDL_AtomicGet(&guard_hits);
+}
+
+void mem_guard_reset() {
+    SDL_AtomicSet(&guard_hits, 0);
+}
+
+void mem_guard_set_hook(mem_guard_hook hook, void *userdata) {
+    guard_hook = hook;
+    guard_userdata = userdata;
+}
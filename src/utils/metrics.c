@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <enet/enet.h>
+#include "utils/metrics.h"
+#include "utils/log.h"
+
+#define METRICS_DEFAULT_PORT 8125
+#define METRICS_PREFIX "openomf."
+
+static ENetSocket _socket = ENET_SOCKET_NULL;
+static ENetAddress _address;
+static char _packet[METRICS_PACKET_SIZE];
+static size_t _len = 0;
+
+int metrics_open(const char *target) {
+    char host[256];
+    int port = METRICS_DEFAULT_PORT;
+    strncpy(host, target, sizeof(host) - 1);
+    host[sizeof(host) - 1] = 0;
+    char *colon = strrchr(host, ':');
+    if(colon != NULL) {
+        *colon = 0;
+        port = atoi(colon + 1);
+    }
+    if(host[0] == 0 || port <= 0 || port > 65535 || enet_address_set_host(&_address, host) != 0) {
+        PERROR("Invalid metrics target '%s'", target);
+        return 1;
+    }
+    _address.port = port;
+    _socket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if(_socket == ENET_SOCKET_NULL) {
+        PERROR("Could not create a socket for metrics");
+        return 1;
+    }
+    _len = 0;
+    INFO("Sending metrics to %s:%d", host, port);
+    return 0;
+}
+
+void metrics_close() {
+    if(_socket == ENET_SOCKET_NULL) {
+        return;
+    }
+    metrics_flush();
+    enet_socket_destroy(_socket);
+    _socket = ENET_SOCKET_NULL;
+}
+
+int metrics_is_active() {
+    return _socket != ENET_SOCKET_NULL;
+}
+
+void metrics_flush() {
+    if(_socket == ENET_SOCKET_NULL || _len == 0) {
+        return;
+    }
+    ENetBuffer buffer;
+    buffer.data = _packet;
+    buffer.dataLength = _len;
+    // Nobody listening is fine, the numbers are just lost
+    enet_socket_send(_socket, &_address, &buffer, 1);
+    _len = 0;
+}
+
+static void metrics_add(const char *name, double value, const char *type) {
+    if(_socket == ENET_SOCKET_NULL) {
+        return;
+    }
+    char line[256];
+    int n = snprintf(line, sizeof(line), METRICS_PREFIX "%s:%g|%s\n", name, value, type);
+    if(n <= 0 || n >= (int)sizeof(line)) {
+        return;
+    }
+    if(_len + n > sizeof(_packet)) {
+        metrics_flush();
+    }
+    memcpy(_packet + _len, line, n);
+    _len += n;
+}
+
+void metrics_gauge(const char *name, double value) {
+    metrics_add(name, value, "g");
+}
+
+void metrics_timing(const char *name, double ms) {
+    metrics_add(name, ms, "ms");
+}
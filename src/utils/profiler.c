@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "utils/profiler.h"
+#include "utils/trace.h"
+#include "utils/vector.h"
+
+static const char *phase_names[PROF_COUNT] = {
+    "frame",
+    "events",
+    "static tick",
+    "dynamic tick",
+    "audio",
+    "render",
+    "console",
+    "present",
+    "present gap",
+    "run-ahead",
+    "frame delay",
+};
+
+static const char *counter_names[PROF_CNT_COUNT] = {
+    "dynamic ticks",
+    "dropped ticks",
+    "skipped frames",
+    "tcache hits",
+    "tcache misses",
+    "tcache warmed",
+    "rollbacks",
+    "rollback ticks",
+    "object spawns",
+    "object frees",
+    "run-ahead ticks",
+};
+
+static SDL_atomic_t counters[PROF_CNT_COUNT];
+static uint64_t start[PROF_COUNT];
+static uint64_t current[PROF_COUNT]; // Accumulated during the ongoing frame
+static float history[PROF_COUNT][PROFILER_HISTORY]; // Milliseconds
+static int head = 0; // Next history slot to write
+static int frames = 0;
+
+typedef struct capture_frame_t {
+    float ms[PROF_COUNT];
+} capture_frame;
+
+static vector capture;
+static int capturing = 0;
+
+// Phases may be entered several times per frame; the times are summed
+void profiler_begin(int phase) {
+    trace_begin("frame", phase_names[phase]);
+    start[phase] = SDL_GetPerformanceCounter();
+}
+
+void profiler_end(int phase) {
+    current[phase] += SDL_GetPerformanceCounter() - start[phase];
+    trace_end("frame", phase_names[phase]);
+}
+
+void profiler_record(int phase, uint64_t counts) {
+    current[phase] += counts;
+}
+
+void profiler_frame_end() {
+    float ms_per_count = 1000.0f / SDL_GetPerformanceFrequency();
+    capture_frame frame;
+    for(int i = 0; i < PROF_COUNT; i++) {
+        frame.ms[i] = current[i] * ms_per_count;
+        history[i][head] = frame.ms[i];
+        current[i] = 0;
+    }
+    if(capturing) {
+        vector_append(&capture, &frame);
+    }
+    head = (head + 1) % PROFILER_HISTORY;
+    if(frames < PROFILER_HISTORY) {
+        frames++;
+    }
+}
+
+void profiler_count(int counter, int n) {
+    SDL_AtomicAdd(&counters[counter], n);
+}
+
+unsigned int profiler_get_count(int counter) {
+    return (unsigned int)SDL_AtomicGet(&counters[counter]);
+}
+
+const char* profiler_counter_name(int counter) {
+    return counter_names[counter];
+}
+
+const char* profiler_phase_name(int phase) {
+    return phase_names[phase];
+}
+
+// Counters keep counting; only the frame times start over
+void profiler_reset_history() {
+    frames = 0;
+}
+
+int profiler_frame_count() {
+    return frames;
+}
+
+float profiler_get_ms(int phase, int frames_ago) {
+    if(frames_ago < 0 || frames_ago >= frames) {
+        return 0.0f;
+    }
+    int slot = (head - 1 - frames_ago + PROFILER_HISTORY) % PROFILER_HISTORY;
+    return history[phase][slot];
+}
+
+static int compare_float(const void *a, const void *b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// p is in the range 0..100, over the frames in the history
+float profiler_percentile(int phase, float p) {
+    if(frames == 0) {
+        return 0.0f;
+    }
+    float sorted[PROFILER_HISTORY];
+    for(int i = 0; i < frames; i++) {
+        sorted[i] = profiler_get_ms(phase, i);
+    }
+    qsort(sorted, frames, sizeof(float), compare_float);
+    int idx = (int)(p / 100.0f * (frames - 1) + 0.5f);
+    if(idx < 0) {
+        idx = 0;
+    } else if(idx >= frames) {
+        idx = frames - 1;
+    }
+    return sorted[idx];
+}
+
+void profiler_capture_start() {
+    if(capturing) {
+        vector_clear(&capture);
+        return;
+    }
+    vector_create(&capture, sizeof(capture_frame));
+    capturing = 1;
+}
+
+void profiler_capture_report(FILE *out) {
+    if(!capturing) {
+        return;
+    }
+    unsigned int count = vector_size(&capture);
+    fprintf(out, "frames=%u\n", count);
+    if(count > 0) {
+        float *sorted = malloc(count * sizeof(float));
+        for(int p = 0; p < PROF_COUNT; p++) {
+            double sum = 0.0;
+            for(unsigned int i = 0; i < count; i++) {
+                sorted[i] = ((capture_frame*)vector_get(&capture, i))->ms[p];
+                sum += sorted[i];
+            }
+            qsort(sorted, count, sizeof(float), compare_float);
+            fprintf(out, "%s: avg=%.3f p99=%.3f max=%.3f\n",
+                    phase_names[p],
+                    sum / count,
+                    sorted[(unsigned int)(0.99f * (count - 1) + 0.5f)],
+                    sorted[count - 1]);
+        }
+        free(sorted);
+    }
+    for(int c = 0; c < PROF_CNT_COUNT; c++) {
+        fprintf(out, "%s: %u\n", counter_names[c], profiler_get_count(c));
+    }
+    fflush(out);
+    vector_free(&capture);
+    capturing = 0;
+}
@@ -26,6 +26,18 @@ float random_float(struct random_t *r) {
     return (float)random_intmax(r) / UINT_MAX;
 }
 
+// SplitMix64 finalizer over the key and counter
+uint32_t random_hash(uint32_t key, uint32_t counter) {
+    uint64_t z = (((uint64_t)key << 32) | counter) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+uint32_t random_hash_int(uint32_t key, uint32_t counter, uint32_t upperbound) {
+    return random_hash(key, counter) % upperbound;
+}
+
 void rand_seed(uint32_t seed) { random_seed(&rand_state, seed); }
 uint32_t rand_get_seed(void) { return random_get_seed(&rand_state); }
 uint32_t rand_int(uint32_t upperbound) { return random_int(&rand_state, upperbound); }
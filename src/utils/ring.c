@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utils/ring.h"
+
+void ring_create(ring *r, unsigned int item_size, unsigned int capacity) {
+    unsigned int size = 1;
+    while(size < capacity) {
+        size *= 2;
+    }
+    r->data = malloc(item_size * size);
+    r->item_size = item_size;
+    r->mask = size - 1;
+    SDL_AtomicSet(&r->head, 0);
+    SDL_AtomicSet(&r->tail, 0);
+}
+
+void ring_free(ring *r) {
+    free(r->data);
+    r->data = NULL;
+}
+
+// Returns 1 if the ring is full
+int ring_push(ring *r, const void *item) {
+    unsigned int head = SDL_AtomicGet(&r->head);
+    if(head - (unsigned int)SDL_AtomicGet(&r->tail) > r->mask) {
+        return 1;
+    }
+    memcpy(r->data + (head & r->mask) * r->item_size, item, r->item_size);
+    // The atomic store orders the copy before the consumer can see the item
+    SDL_AtomicSet(&r->head, head + 1);
+    return 0;
+}
+
+// Returns 1 if the ring is empty
+int ring_pop(ring *r, void *item) {
+    unsigned int tail = SDL_AtomicGet(&r->tail);
+    if(tail == (unsigned int)SDL_AtomicGet(&r->head)) {
+        return 1;
+    }
+    memcpy(item, r->data + (tail & r->mask) * r->item_size, r->item_size);
+    SDL_AtomicSet(&r->tail, tail + 1);
+    return 0;
+}
+
+unsigned int ring_size(ring *r) {
+    return (unsigned int)SDL_AtomicGet(&r->head) - (unsigned int)SDL_AtomicGet(&r->tail);
+}
+
+unsigned int ring_capacity(const ring *r) {
+    return r->mask + 1;
+}
@@ -4,26 +4,40 @@
 #include <string.h>
 #include <ctype.h>
 
+// Smallest allocation; most strings are short move and animation strings
+#define STR_MIN_CAPACITY 16
+
 void str_create(str *string) {
     string->len = 0;
+    string->capacity = 0;
     string->data = NULL;
 }
 
+// Makes room for a string of len characters. Grows geometrically, so that
+// repeated appends only reallocate now and then.
+void str_reserve(str *string, size_t len) {
+    if(string->data != NULL && len < string->capacity) {
+        return;
+    }
+    size_t capacity = (string->capacity > STR_MIN_CAPACITY) ? string->capacity : STR_MIN_CAPACITY;
+    while(capacity <= len) {
+        capacity *= 2;
+    }
+    string->data = realloc(string->data, capacity);
+    string->capacity = capacity;
+}
+
 void str_create_from_cstr(str *string, const char *cstr) {
+    str_create(string);
     if(cstr) {
-        string->len = strlen(cstr);
-        string->data = malloc(string->len + 1);
-        memcpy(string->data, cstr, string->len);
-        string->data[string->len] = 0;
-    } else {
-        string->len = 0;
-        string->data = NULL;
+        str_create_from_data(string, cstr, strlen(cstr));
     }
 }
 
 void str_create_from_data(str *string, const char *data, size_t len) {
+    str_create(string);
+    str_reserve(string, len);
     string->len = len;
-    string->data = malloc(len + 1);
     memcpy(string->data, data, len);
     string->data[string->len] = 0;
 }
@@ -34,6 +48,7 @@ void str_free(str *string) {
     }
     string->data = NULL;
     string->len = 0;
+    string->capacity = 0;
 }
 
 size_t str_size(const str *string) {
@@ -50,48 +65,51 @@ void str_remove_at(str *string, size_t pos) {
 void str_substr(str *dst, const str *src, size_t start, size_t end) {
     if(src->data) {
         size_t len = end - start;
-        dst->data = realloc(dst->data, len + 1);
+        str_reserve(dst, len);
         dst->len = len;
-        memcpy(dst->data, src->data + start, len);
+        memmove(dst->data, src->data + start, len);
         dst->data[len] = 0;
     } else {
-        dst->data = NULL;
-        dst->len = 0;
+        str_free(dst);
     }
 }
 
 void str_copy(str *dst, const str *src) {
+    if(src == dst) {
+        return;
+    }
     if(src->data) {
-        dst->data = realloc(dst->data, src->len + 1);
+        str_reserve(dst, src->len);
         dst->len = src->len;
         memcpy(dst->data, src->data, dst->len);
         dst->data[dst->len] = 0;
     } else {
-        dst->data = NULL;
-        dst->len = 0;
+        str_free(dst);
     }
 }
 
 void str_append(str *dst, const str *src) {
-    dst->data = realloc(dst->data, dst->len + src->len + 1);
-    memcpy(dst->data + dst->len, src->data, src->len);
-    dst->len += src->len;
+    size_t srclen = src->len;
+    str_reserve(dst, dst->len + srclen);
+    memmove(dst->data + dst->len, src->data, srclen);
+    dst->len += srclen;
     dst->data[dst->len] = 0;
 }
 
 void str_append_c(str *dst, const char *src) {
     size_t srclen = strlen(src);
-    dst->data = realloc(dst->data, dst->len + srclen + 1);
+    str_reserve(dst, dst->len + srclen);
     memcpy(dst->data + dst->len, src, srclen);
     dst->len += srclen;
     dst->data[dst->len] = 0;
 }
 
 void str_prepend(str *dst, const str *src) {
-    dst->data = realloc(dst->data, dst->len + src->len + 1);
-    memmove(dst->data + src->len, dst->data, dst->len);
-    memcpy(dst->data, src->data, src->len);
-    dst->len += src->len;
+    size_t srclen = src->len;
+    str_reserve(dst, dst->len + srclen);
+    memmove(dst->data + srclen, dst->data, dst->len);
+    memmove(dst->data, src->data, srclen);
+    dst->len += srclen;
     dst->data[dst->len] = 0;
 }
 
@@ -126,13 +144,7 @@ int str_last_of(const str *string, char find, size_t *pos) {
 }
 
 int str_equal(const str *string, const str *string_b) {
-    if(string->len != string_b->len) {
-        return 0;
-    }
-    if(strcmp(string->data, string_b->data) != 0) {
-        return 0;
-    }
-    return 1;
+    return str_view_equal(str_view_of(string), str_view_of(string_b));
 }
 
 int str_cmp(const str *cmp_a, const str *cmp_b) {
@@ -179,3 +191,39 @@ const char* str_c(const str *string) {
     // a pointer to that data
     return string->data;
 }
+
+str_view str_view_of(const str *string) {
+    str_view view;
+    view.len = string->len;
+    view.data = string->data;
+    return view;
+}
+
+str_view str_view_from_cstr(const char *cstr) {
+    str_view view;
+    view.len = (cstr != NULL) ? strlen(cstr) : 0;
+    view.data = cstr;
+    return view;
+}
+
+// Characters start..end of the view, clamped to its length
+str_view str_view_sub(str_view view, size_t start, size_t end) {
+    if(end > view.len) {
+        end = view.len;
+    }
+    if(start > end) {
+        start = end;
+    }
+    str_view sub;
+    sub.len = end - start;
+    sub.data = (view.data != NULL) ? view.data + start : NULL;
+    return sub;
+}
+
+int str_view_equal(str_view a, str_view b) {
+    return a.len == b.len && (a.len == 0 || memcmp(a.data, b.data, a.len) == 0);
+}
+
+int str_view_starts_with(str_view view, str_view prefix) {
+    return prefix.len <= view.len && (prefix.len == 0 || memcmp(view.data, prefix.data, prefix.len) == 0);
+}
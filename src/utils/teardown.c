@@ -0,0 +1,103 @@
+#include <SDL2/SDL.h>
+#include "utils/teardown.h"
+#include "utils/trace.h"
+#include "utils/vector.h"
+
+typedef struct teardown_item_t {
+    teardown_fn fn;
+    void *data;
+} teardown_item;
+
+static SDL_SpinLock lock;
+static int ready = 0;
+static vector queue; // teardown_item, oldest first
+static unsigned int next = 0; // First item of the queue that isn't done
+
+void teardown_init() {
+    if(ready) {
+        return;
+    }
+    vector_create(&queue, sizeof(teardown_item));
+    next = 0;
+    ready = 1;
+}
+
+void teardown_close() {
+    if(!ready) {
+        return;
+    }
+    teardown_flush();
+    SDL_AtomicLock(&lock);
+    ready = 0;
+    vector_free(&queue);
+    SDL_AtomicUnlock(&lock);
+}
+
+void teardown_push(teardown_fn fn, void *data) {
+    SDL_AtomicLock(&lock);
+    if(ready) {
+        teardown_item item = {fn, data};
+        vector_append(&queue, &item);
+        SDL_AtomicUnlock(&lock);
+        return;
+    }
+    SDL_AtomicUnlock(&lock);
+    while(fn(data)) {}
+}
+
+// Oldest item, without taking it off the queue. Lock held.
+static teardown_item* teardown_front() {
+    if(next < vector_size(&queue)) {
+        return vector_get(&queue, next);
+    }
+    // All done; start the queue over
+    vector_clear(&queue);
+    next = 0;
+    return NULL;
+}
+
+int teardown_run(unsigned int budget_us) {
+    if(!ready) {
+        return 0;
+    }
+    uint64_t until = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() * budget_us / 1000000;
+    int ran = 0;
+    int left;
+    while(1) {
+        SDL_AtomicLock(&lock);
+        teardown_item *front = teardown_front();
+        left = (int)(vector_size(&queue) - next);
+        if(front == NULL || (ran && SDL_GetPerformanceCounter() >= until)) {
+            SDL_AtomicUnlock(&lock);
+            break;
+        }
+        // The vector may grow while the step runs, so the item is copied out
+        teardown_item item = *front;
+        SDL_AtomicUnlock(&lock);
+
+        if(!ran) {
+            trace_begin("teardown", "run");
+            ran = 1;
+        }
+        if(!item.fn(item.data)) {
+            SDL_AtomicLock(&lock);
+            next++;
+            SDL_AtomicUnlock(&lock);
+        }
+    }
+    if(ran) {
+        trace_end("teardown", "run");
+    }
+    return left;
+}
+
+void teardown_flush() {
+    while(teardown_run(1000000) > 0) {}
+}
+
+int teardown_pending() {
+    SDL_AtomicLock(&lock);
+    int left = ready ? (int)(vector_size(&queue) - next) : 0;
+    SDL_AtomicUnlock(&lock);
+    return left;
+}
@@ -0,0 +1,173 @@
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // For the pthread affinity calls
+#endif
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "utils/thread_sched.h"
+#include "utils/cpu.h"
+#include "utils/log.h"
+
+static const char *role_names[THREAD_ROLE_COUNT] = {
+    "main",
+    "simulation",
+    "audio",
+    "network",
+    "job",
+};
+
+static uint64_t role_cores[THREAD_ROLE_COUNT]; // 0 to leave as is
+static int raise_priority_on = 0;
+static int configured = 0;
+static SDL_atomic_t reported[THREAD_ROLE_COUNT];
+
+void thread_sched_init(const char *cores[THREAD_ROLE_COUNT], int raise_priority) {
+    int count = SDL_GetCPUCount();
+    uint64_t all = (count >= CPU_MAX_CORES) ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1);
+    int pinned = 0;
+    for(int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        role_cores[i] = 0;
+        SDL_AtomicSet(&reported[i], 0);
+        if(cores[i] == NULL || cores[i][0] == 0) {
+            continue;
+        }
+        uint64_t mask;
+        if(cpu_parse_cores(cores[i], &mask)) {
+            PERROR("Invalid core list '%s' for the %s thread, not pinning it.", cores[i], role_names[i]);
+        } else if((mask & all) == 0) {
+            PERROR("None of the cores '%s' for the %s thread exist, not pinning it.", cores[i], role_names[i]);
+        } else {
+            role_cores[i] = mask & all;
+            pinned = 1;
+        }
+    }
+    if(pinned) {
+        // New threads start on the cores of the thread that made them, so
+        // the roles that aren't pinned are let onto every core explicitly
+        for(int i = 0; i < THREAD_ROLE_COUNT; i++) {
+            if(role_cores[i] == 0) {
+                role_cores[i] = all;
+            }
+        }
+        // Keep the job workers off the simulation thread's cores if there are others
+        if(cores[THREAD_ROLE_JOBS] == NULL || cores[THREAD_ROLE_JOBS][0] == 0) {
+            uint64_t rest = all & ~role_cores[THREAD_ROLE_SIM];
+            if(rest != 0) {
+                role_cores[THREAD_ROLE_JOBS] = rest;
+            }
+        }
+    }
+    raise_priority_on = raise_priority;
+    configured = pinned || raise_priority;
+}
+
+static int thread_sched_set_cores(uint64_t cores) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int i = 0; i < CPU_MAX_CORES; i++) {
+        if((cores >> i) & 1) {
+            CPU_SET(i, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)cores) == 0;
+#else
+    (void)cores;
+    return -1;
+#endif
+}
+
+// The cores the thread may run on as the OS sees it, 0 if it won't say
+static uint64_t thread_sched_get_cores() {
+#if defined(__linux__)
+    cpu_set_t set;
+    uint64_t cores = 0;
+    if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return 0;
+    }
+    for(int i = 0; i < CPU_MAX_CORES; i++) {
+        if(CPU_ISSET(i, &set)) {
+            cores |= (uint64_t)1 << i;
+        }
+    }
+    return cores;
+#elif defined(_WIN32)
+    // Only readable by setting it, so set it back right away
+    DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), 1);
+    if(old != 0) {
+        SetThreadAffinityMask(GetCurrentThread(), old);
+    }
+    return old;
+#else
+    return 0;
+#endif
+}
+
+// Returns what the thread ended up with, for the log
+static const char* thread_sched_raise(int role) {
+    if(role == THREAD_ROLE_AUDIO) {
+#if defined(_WIN32)
+        // MMCSS gives audio threads their time slots even under load
+        typedef HANDLE (WINAPI *mmcss_fn)(LPCSTR, LPDWORD);
+        HMODULE avrt = LoadLibraryA("avrt.dll");
+        mmcss_fn set_task = avrt ? (mmcss_fn)GetProcAddress(avrt, "AvSetMmThreadCharacteristicsA") : NULL;
+        DWORD task_index = 0;
+        if(set_task != NULL && set_task("Pro Audio", &task_index) != NULL) {
+            return "mmcss pro audio";
+        }
+#elif defined(__linux__)
+        // Needs CAP_SYS_NICE or an rtprio limit; most desktops allow neither
+        struct sched_param param;
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) {
+            return "real-time";
+        }
+#endif
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+        if(SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL) == 0) {
+            return "time critical";
+        }
+#endif
+    }
+    if(SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) == 0) {
+        return "high";
+    }
+    return "normal (not allowed to raise)";
+}
+
+void thread_sched_apply(int role) {
+    if(!configured || role < 0 || role >= THREAD_ROLE_COUNT) {
+        return;
+    }
+    int failed = 0;
+    if(role_cores[role] != 0) {
+        failed = thread_sched_set_cores(role_cores[role]);
+    }
+    const char *priority = "normal";
+    if(raise_priority_on && (role == THREAD_ROLE_AUDIO || role == THREAD_ROLE_NET)) {
+        priority = thread_sched_raise(role);
+    }
+
+    // Threads of a role are all the same, so one report each is enough
+    if(SDL_AtomicCAS(&reported[role], 0, 1)) {
+        char buf[64];
+        uint64_t cores = thread_sched_get_cores();
+        if(cores != 0) {
+            cpu_cores_to_str(cores, buf, sizeof(buf));
+        } else {
+            snprintf(buf, sizeof(buf), "unknown");
+        }
+        if(failed) {
+            PERROR("Could not pin the %s thread, it runs on cores %s.", role_names[role], buf);
+        }
+        INFO("The %s thread runs on cores %s, priority %s.", role_names[role], buf, priority);
+    }
+}
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "utils/trace.h"
+#include "utils/io_worker.h"
+#include "utils/log.h"
+
+#define TRACE_BUFFER_EVENTS 4096
+#define TRACE_MAX_THREADS 16
+// How often the writer thread drains the buffers
+#define TRACE_WRITER_PERIOD_MS 10
+
+typedef struct trace_event_t {
+    const char *cat;
+    const char *name;
+    char phase;
+    int value;
+    uint64_t counter;
+} trace_event;
+
+typedef struct trace_buffer_t {
+    trace_event events[TRACE_BUFFER_EVENTS];
+    SDL_atomic_t head; // Next slot to write, owned by the emitting thread
+    SDL_atomic_t tail; // Next slot to read, owned by the writer thread
+    unsigned long tid;
+} trace_buffer;
+
+static trace_buffer *buffers[TRACE_MAX_THREADS];
+static SDL_atomic_t buffer_count;
+static SDL_atomic_t active;
+static SDL_atomic_t flight; // Keep recording over the oldest events, see trace_flight_set
+static SDL_atomic_t running;
+static SDL_atomic_t dropped;
+static SDL_TLSID tls = 0;
+static SDL_Thread *writer = NULL;
+static FILE *out = NULL;
+static int first_event = 1;
+static uint64_t start_counter = 0;
+static double us_per_count = 0.0;
+
+// Events copied out of the thread buffers by trace_flight_dump
+typedef struct trace_flight_event_t {
+    trace_event ev;
+    unsigned long tid;
+} trace_flight_event;
+
+typedef struct trace_flight_dump_t {
+    char filename[512];
+    trace_flight_event *events;
+    unsigned int count;
+} trace_flight_dump_job;
+
+static trace_buffer* trace_get_buffer() {
+    trace_buffer *buf = SDL_TLSGet(tls);
+    if(buf != NULL) {
+        return buf;
+    }
+
+    // First event from this thread. Buffers are kept until trace_close.
+    int slot = SDL_AtomicAdd(&buffer_count, 1);
+    if(slot >= TRACE_MAX_THREADS) {
+        SDL_AtomicAdd(&buffer_count, -1);
+        return NULL;
+    }
+    buf = calloc(1, sizeof(trace_buffer));
+    buf->tid = SDL_ThreadID();
+    SDL_TLSSet(tls, buf, NULL);
+    SDL_AtomicSetPtr((void**)&buffers[slot], buf);
+    return buf;
+}
+
+static void trace_push(const char *cat, const char *name, char phase, int value) {
+    int tracing = SDL_AtomicGet(&active);
+    if(!tracing && !SDL_AtomicGet(&flight)) {
+        return;
+    }
+    trace_buffer *buf = trace_get_buffer();
+    if(buf == NULL) {
+        SDL_AtomicIncRef(&dropped);
+        return;
+    }
+    // Only a running trace has a writer to wait for; the flight recorder
+    // just goes round over the oldest events
+    int head = SDL_AtomicGet(&buf->head);
+    if(tracing && head - SDL_AtomicGet(&buf->tail) >= TRACE_BUFFER_EVENTS) {
+        SDL_AtomicIncRef(&dropped);
+        return;
+    }
+    trace_event *ev = &buf->events[head % TRACE_BUFFER_EVENTS];
+    ev->cat = cat;
+    ev->name = name;
+    ev->phase = phase;
+    ev->value = value;
+    ev->counter = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&buf->head, head + 1);
+}
+
+static void trace_write_event(FILE *fp, const trace_event *ev, unsigned long tid, uint64_t base, int *first) {
+    double ts = (ev->counter - base) * us_per_count;
+    fprintf(fp, "%s\n{\"cat\":\"%s\",\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.1f,\"pid\":1,\"tid\":%lu",
+            *first ? "" : ",", ev->cat, ev->name, ev->phase, ts, tid);
+    if(ev->phase == 'i') {
+        fprintf(fp, ",\"s\":\"t\",\"args\":{\"value\":%d}", ev->value);
+    }
+    fputc('}', fp);
+    *first = 0;
+}
+
+static void trace_drain() {
+    int count = SDL_AtomicGet(&buffer_count);
+    if(count > TRACE_MAX_THREADS) {
+        count = TRACE_MAX_THREADS;
+    }
+    for(int i = 0; i < count; i++) {
+        trace_buffer *buf = SDL_AtomicGetPtr((void**)&buffers[i]);
+        if(buf == NULL) {
+            continue; // Slot claimed, but not published yet
+        }
+        int tail = SDL_AtomicGet(&buf->tail);
+        int head = SDL_AtomicGet(&buf->head);
+        for(; tail != head; tail++) {
+            trace_write_event(out, &buf->events[tail % TRACE_BUFFER_EVENTS], buf->tid, start_counter, &first_event);
+        }
+        SDL_AtomicSet(&buf->tail, tail);
+    }
+}
+
+static int trace_writer_run(void *data) {
+    while(SDL_AtomicGet(&running)) {
+        trace_drain();
+        SDL_Delay(TRACE_WRITER_PERIOD_MS);
+    }
+    return 0;
+}
+
+int trace_start(const char *filename) {
+    if(out != NULL) {
+        PERROR("Trace is already running.");
+        return 1;
+    }
+    if(tls == 0) {
+        tls = SDL_TLSCreate();
+    }
+    out = fopen(filename, "w");
+    if(out == NULL) {
+        PERROR("Unable to open trace file %s.", filename);
+        return 1;
+    }
+    fputs("{\"traceEvents\":[", out);
+    first_event = 1;
+    start_counter = SDL_GetPerformanceCounter();
+    us_per_count = 1000000.0 / SDL_GetPerformanceFrequency();
+    SDL_AtomicSet(&dropped, 0);
+
+    // Anything still queued from an earlier trace belongs to that one
+    int count = SDL_AtomicGet(&buffer_count);
+    for(int i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        if(buffers[i] != NULL) {
+            SDL_AtomicSet(&buffers[i]->tail, SDL_AtomicGet(&buffers[i]->head));
+        }
+    }
+
+    SDL_AtomicSet(&running, 1);
+    writer = SDL_CreateThread(trace_writer_run, "trace", NULL);
+    if(writer == NULL) {
+        PERROR("Unable to create trace thread: %s", SDL_GetError());
+        fclose(out);
+        out = NULL;
+        return 1;
+    }
+    SDL_AtomicSet(&active, 1);
+    DEBUG("Tracing to %s.", filename);
+    return 0;
+}
+
+void trace_stop() {
+    if(out == NULL) {
+        return;
+    }
+    SDL_AtomicSet(&active, 0);
+    SDL_AtomicSet(&running, 0);
+    SDL_WaitThread(writer, NULL);
+    writer = NULL;
+    trace_drain();
+    fputs("\n]}\n", out);
+    fclose(out);
+    out = NULL;
+    DEBUG("Trace stopped, %u events dropped.", trace_dropped());
+}
+
+int trace_is_active() {
+    return SDL_AtomicGet(&active);
+}
+
+// Only safe once the threads that emitted events are gone
+void trace_close() {
+    trace_stop();
+    for(int i = 0; i < TRACE_MAX_THREADS; i++) {
+        free(buffers[i]);
+        buffers[i] = NULL;
+    }
+    SDL_AtomicSet(&buffer_count, 0);
+}
+
+void trace_begin(const char *cat, const char *name) {
+    trace_push(cat, name, 'B', 0);
+}
+
+void trace_end(const char *cat, const char *name) {
+    trace_push(cat, name, 'E', 0);
+}
+
+void trace_instant(const char *cat, const char *name, int value) {
+    trace_push(cat, name, 'i', value);
+}
+
+unsigned int trace_dropped() {
+    return SDL_AtomicGet(&dropped);
+}
+
+void trace_flight_set(int on) {
+    if(on && tls == 0) {
+        tls = SDL_TLSCreate();
+    }
+    if(on && us_per_count == 0.0) {
+        us_per_count = 1000000.0 / SDL_GetPerformanceFrequency();
+    }
+    SDL_AtomicSet(&flight, on);
+}
+
+int trace_flight_is_on() {
+    return SDL_AtomicGet(&flight);
+}
+
+static void trace_flight_write(void *userdata) {
+    trace_flight_dump_job *job = userdata;
+    FILE *fp = fopen(job->filename, "w");
+    if(fp == NULL) {
+        PERROR("Unable to open trace file %s.", job->filename);
+        goto exit_0;
+    }
+    // Times start from the oldest event kept
+    uint64_t base = UINT64_MAX;
+    for(unsigned int i = 0; i < job->count; i++) {
+        if(job->events[i].ev.counter < base) {
+            base = job->events[i].ev.counter;
+        }
+    }
+    int first = 1;
+    fputs("{\"traceEvents\":[", fp);
+    for(unsigned int i = 0; i < job->count; i++) {
+        trace_write_event(fp, &job->events[i].ev, job->events[i].tid, base, &first);
+    }
+    fputs("\n]}\n", fp);
+    fclose(fp);
+    INFO("Wrote %u traced events to %s.", job->count, job->filename);
+
+exit_0:
+    free(job->events);
+    free(job);
+}
+
+int trace_flight_dump(const char *filename) {
+    if(!SDL_AtomicGet(&flight)) {
+        return 1;
+    }
+    trace_flight_dump_job *job = malloc(sizeof(trace_flight_dump_job));
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    job->events = malloc(sizeof(trace_flight_event) * TRACE_BUFFER_EVENTS * TRACE_MAX_THREADS);
+    job->count = 0;
+
+    int count = SDL_AtomicGet(&buffer_count);
+    if(count > TRACE_MAX_THREADS) {
+        count = TRACE_MAX_THREADS;
+    }
+    for(int i = 0; i < count; i++) {
+        trace_buffer *buf = SDL_AtomicGetPtr((void**)&buffers[i]);
+        if(buf == NULL) {
+            continue;
+        }
+        // The thread keeps writing meanwhile. Whatever it may have written
+        // over during the copy is left out afterwards.
+        int head = SDL_AtomicGet(&buf->head);
+        int from = (head > TRACE_BUFFER_EVENTS) ? head - TRACE_BUFFER_EVENTS : 0;
+        unsigned int start = job->count;
+        for(int e = from; e < head; e++) {
+            job->events[job->count].ev = buf->events[e % TRACE_BUFFER_EVENTS];
+            job->events[job->count].tid = buf->tid;
+            job->count++;
+        }
+        int overwritten = SDL_AtomicGet(&buf->head) - TRACE_BUFFER_EVENTS + 1;
+        if(overwritten > from) {
+            unsigned int skip = overwritten - from;
+            if(skip > job->count - start) {
+                skip = job->count - start;
+            }
+            memmove(&job->events[start], &job->events[start + skip],
+                    (job->count - start - skip) * sizeof(trace_flight_event));
+            job->count -= skip;
+        }
+    }
+    io_worker_run(trace_flight_write, job);
+    return 0;
+}
@@ -119,6 +119,26 @@ int vector_delete(vector *vec, iterator *iter) {
     return 0;
 }
 
+// Removes every entry for which rf returns nonzero, keeping the order of the rest.
+// This is a single pass, so prefer it over vector_delete when many entries may go.
+// rf may append to the vector; the new entries are visited in the same pass.
+unsigned int vector_remove_if(vector *vec, vector_remove_func rf, void *userdata) {
+    unsigned int w = 0;
+    for(unsigned int r = 0; r < vec->blocks; r++) {
+        if(rf(vec->data + r * vec->block_size, userdata)) {
+            continue;
+        }
+        // rf may have grown the vector, so only use the data pointer after calling it
+        if(w != r) {
+            memcpy(vec->data + w * vec->block_size, vec->data + r * vec->block_size, vec->block_size);
+        }
+        w++;
+    }
+    unsigned int removed = vec->blocks - w;
+    vec->blocks = w;
+    return removed;
+}
+
 void vector_sort(vector *vec, vector_compare_func cf) {
     qsort(vec->data, vec->blocks, vec->block_size, cf);
 }
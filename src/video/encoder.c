@@ -0,0 +1,388 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // popen
+#endif
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+#include "video/encoder.h"
+#include "video/video.h"
+#include "audio/audio.h"
+#include "utils/ring.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define ENCODER_PIPE_MODE "wb"
+#else
+#define ENCODER_PIPE_MODE "w"
+#endif
+
+/*
+* The render thread only reads the frame back into one of a few reusable
+* buffers. Shifting and fading it the way the window shows it, converting
+* it and writing it into the pipe are left to a worker thread. If every
+* buffer is still waiting to be written the frame is dropped rather than
+* stalling the game, unless the capture was started to wait; the next
+* frame is then written for as long as the dropped one would have been.
+*
+* Audio comes from the mixer in small blocks through a ring, which the
+* worker empties into the WAV file whenever it wakes up.
+*/
+
+#define ENCODER_QUEUE_SIZE 8
+#define ENCODER_WAKEUP_MS 20
+#define ENCODER_AUDIO_BLOCK 512 // Stereo frames per block
+#define ENCODER_AUDIO_BLOCKS 256
+#define WAV_HEADER_SIZE 44
+
+typedef struct encoder_job_t {
+    char *pixels;
+    video_frame_info info;
+    int repeat; // Output frames this one stands for, 0 to quit
+} encoder_job;
+
+typedef struct encoder_audio_block_t {
+    int frames;
+    int16_t samples[ENCODER_AUDIO_BLOCK * 2];
+} encoder_audio_block;
+
+typedef struct encoder_t {
+    SDL_Thread *thread;
+    SDL_sem *free_slots;
+    SDL_sem *queued;
+    encoder_job jobs[ENCODER_QUEUE_SIZE];
+    int head;
+    int tail;
+
+    int w;
+    int h;
+    int fps;
+    int rgba;
+    int wait;
+    unsigned int start_ms;
+    unsigned int frames; // Output frames queued so far
+    unsigned int dropped;
+
+    // Only touched by the worker
+    FILE *pipe;
+    char *out; // The frame as the window shows it
+    uint8_t *yuv;
+    FILE *wav;
+    unsigned int wav_bytes;
+    SDL_atomic_t failed;
+} encoder;
+
+static encoder *enc = NULL;
+
+// Outlives the encoders, as the mixer may still be pushing a block when one stops
+static ring audio_ring;
+static int audio_ring_created = 0;
+static SDL_atomic_t audio_frequency;
+
+static void encoder_audio_tap(const int16_t *samples, int frames, int frequency) {
+    SDL_AtomicSet(&audio_frequency, frequency);
+    encoder_audio_block block;
+    while(frames > 0) {
+        block.frames = frames < ENCODER_AUDIO_BLOCK ? frames : ENCODER_AUDIO_BLOCK;
+        memcpy(block.samples, samples, block.frames * 2 * sizeof(int16_t));
+        // A full ring means the worker is stuck; the rest of the period is lost
+        if(ring_push(&audio_ring, &block)) {
+            return;
+        }
+        samples += block.frames * 2;
+        frames -= block.frames;
+    }
+}
+
+static void wav_put16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void wav_put32(uint8_t *p, uint32_t v) {
+    wav_put16(p, v & 0xFFFF);
+    wav_put16(p + 2, v >> 16);
+}
+
+static void wav_write_header(FILE *fp, int frequency, unsigned int bytes) {
+    uint8_t h[WAV_HEADER_SIZE];
+    memcpy(h, "RIFF", 4);
+    wav_put32(h + 4, 36 + bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    wav_put32(h + 16, 16);
+    wav_put16(h + 20, 1); // PCM
+    wav_put16(h + 22, 2);
+    wav_put32(h + 24, frequency);
+    wav_put32(h + 28, frequency * 4);
+    wav_put16(h + 32, 4);
+    wav_put16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    wav_put32(h + 40, bytes);
+    fwrite(h, 1, WAV_HEADER_SIZE, fp);
+}
+
+static void encoder_write_audio() {
+    encoder_audio_block block;
+    while(ring_pop(&audio_ring, &block) == 0) {
+        if(enc->wav == NULL) {
+            continue;
+        }
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        for(int i = 0; i < block.frames * 2; i++) {
+            block.samples[i] = SDL_SwapLE16(block.samples[i]);
+        }
+#endif
+        enc->wav_bytes += fwrite(block.samples, 1, block.frames * 2 * sizeof(int16_t), enc->wav);
+    }
+}
+
+// Does what video_render_submit does to the frame on the way to the window
+static void encoder_compose(const encoder_job *job) {
+    int w = enc->w;
+    int h = enc->h;
+    int f = job->info.fade * 255.0f;
+    memset(enc->out, 0, w * h * 4);
+    for(int y = 0; y < h; y++) {
+        int sy = y - job->info.move_y;
+        if(sy < 0 || sy >= h) {
+            continue;
+        }
+        for(int x = 0; x < w; x++) {
+            int sx = x - job->info.move_x;
+            if(sx < 0 || sx >= w) {
+                continue;
+            }
+            const uint8_t *s = (const uint8_t*)job->pixels + (sy * w + sx) * 4;
+            uint8_t *d = (uint8_t*)enc->out + (y * w + x) * 4;
+            d[0] = s[0] * f / 255;
+            d[1] = s[1] * f / 255;
+            d[2] = s[2] * f / 255;
+            d[3] = 0xFF;
+        }
+    }
+}
+
+// YUV 4:4:4 planes, BT.601 limited range
+static void encoder_to_yuv() {
+    int size = enc->w * enc->h;
+    uint8_t *yp = enc->yuv;
+    uint8_t *up = enc->yuv + size;
+    uint8_t *vp = enc->yuv + size * 2;
+    const uint8_t *s = (const uint8_t*)enc->out;
+    for(int i = 0; i < size; i++, s += 4) {
+        int r = s[0], g = s[1], b = s[2];
+        yp[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        up[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        vp[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+static void encoder_write_frame(const encoder_job *job) {
+    if(SDL_AtomicGet(&enc->failed)) {
+        return;
+    }
+    trace_begin("video", "encode frame");
+    encoder_compose(job);
+    const char *data = enc->out;
+    size_t size = (size_t)enc->w * enc->h * 4;
+    if(!enc->rgba) {
+        encoder_to_yuv();
+        data = (const char*)enc->yuv;
+        size = (size_t)enc->w * enc->h * 3;
+    }
+    for(int i = 0; i < job->repeat; i++) {
+        if((!enc->rgba && fputs("FRAME\n", enc->pipe) < 0) || fwrite(data, 1, size, enc->pipe) != size) {
+            PERROR("Writing to the encoder failed, it may have quit.");
+            SDL_AtomicSet(&enc->failed, 1);
+            break;
+        }
+    }
+    trace_end("video", "encode frame");
+}
+
+static int encoder_worker(void *data) {
+    while(1) {
+        int got = SDL_SemWaitTimeout(enc->queued, ENCODER_WAKEUP_MS) == 0;
+        encoder_write_audio();
+        if(!got) {
+            continue;
+        }
+        encoder_job *job = &enc->jobs[enc->tail];
+        enc->tail = (enc->tail + 1) % ENCODER_QUEUE_SIZE;
+        if(job->repeat == 0) {
+            break;
+        }
+        encoder_write_frame(job);
+        SDL_SemPost(enc->free_slots);
+    }
+    encoder_write_audio();
+    return 0;
+}
+
+static void encoder_free() {
+    if(enc->pipe != NULL) {
+        pclose(enc->pipe);
+    }
+    if(enc->wav != NULL) {
+        fseek(enc->wav, 0, SEEK_SET);
+        wav_write_header(enc->wav, SDL_AtomicGet(&audio_frequency), enc->wav_bytes);
+        fclose(enc->wav);
+    }
+    if(enc->free_slots != NULL) {
+        SDL_DestroySemaphore(enc->free_slots);
+    }
+    if(enc->queued != NULL) {
+        SDL_DestroySemaphore(enc->queued);
+    }
+    for(int i = 0; i < ENCODER_QUEUE_SIZE; i++) {
+        free(enc->jobs[i].pixels);
+    }
+    free(enc->out);
+    free(enc->yuv);
+    free(enc);
+    enc = NULL;
+}
+
+int encoder_start(const encoder_options *opts) {
+    if(enc != NULL) {
+        PERROR("An encoder is already running.");
+        return 1;
+    }
+    video_frame_info info;
+    video_get_frame_info(&info);
+    if(opts->fps <= 0 || opts->command == NULL || opts->command[0] == 0) {
+        return 1;
+    }
+
+    enc = calloc(1, sizeof(encoder));
+    enc->w = info.w;
+    enc->h = info.h;
+    enc->fps = opts->fps;
+    enc->rgba = opts->rgba;
+    enc->wait = opts->wait;
+    for(int i = 0; i < ENCODER_QUEUE_SIZE; i++) {
+        enc->jobs[i].pixels = malloc(enc->w * enc->h * 4);
+    }
+    enc->out = malloc(enc->w * enc->h * 4);
+    enc->yuv = malloc(enc->w * enc->h * 3);
+
+#ifndef _WIN32
+    // If the encoder quits, writes fail instead of the game being killed
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    enc->pipe = popen(opts->command, ENCODER_PIPE_MODE);
+    if(enc->pipe == NULL) {
+        PERROR("Could not start the encoder '%s'.", opts->command);
+        encoder_free();
+        return 1;
+    }
+    if(!enc->rgba) {
+        fprintf(enc->pipe, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", enc->w, enc->h, enc->fps);
+    }
+
+    if(opts->audio_path != NULL) {
+        enc->wav = fopen(opts->audio_path, "wb");
+        if(enc->wav == NULL) {
+            PERROR("Could not open %s for the audio, recording video only.", opts->audio_path);
+        } else {
+            wav_write_header(enc->wav, 0, 0);
+        }
+    }
+    if(!audio_ring_created) {
+        ring_create(&audio_ring, sizeof(encoder_audio_block), ENCODER_AUDIO_BLOCKS);
+        audio_ring_created = 1;
+    }
+    encoder_audio_block block;
+    while(ring_pop(&audio_ring, &block) == 0);
+
+    enc->free_slots = SDL_CreateSemaphore(ENCODER_QUEUE_SIZE);
+    enc->queued = SDL_CreateSemaphore(0);
+    enc->thread = SDL_CreateThread(encoder_worker, "encoder", NULL);
+    if(enc->thread == NULL) {
+        PERROR("Unable to create encoder thread: %s", SDL_GetError());
+        encoder_free();
+        return 1;
+    }
+    if(enc->wav != NULL) {
+        audio_set_tap(encoder_audio_tap);
+    }
+    INFO("Encoding %dx%d at %d fps into '%s'.", enc->w, enc->h, enc->fps, opts->command);
+    return 0;
+}
+
+void encoder_stop() {
+    if(enc == NULL) {
+        return;
+    }
+    audio_set_tap(NULL);
+
+    // Queue the quit signal behind the frames that are still waiting
+    SDL_SemWait(enc->free_slots);
+    enc->jobs[enc->head].repeat = 0;
+    enc->head = (enc->head + 1) % ENCODER_QUEUE_SIZE;
+    SDL_SemPost(enc->queued);
+    SDL_WaitThread(enc->thread, NULL);
+
+    INFO("Encoder stopped, %u frames written, %u dropped.", enc->frames, enc->dropped);
+    encoder_free();
+}
+
+int encoder_active() {
+    return enc != NULL;
+}
+
+void encoder_capture(unsigned int clock_ms) {
+    if(enc == NULL) {
+        return;
+    }
+    if(SDL_AtomicGet(&enc->failed)) {
+        encoder_stop();
+        return;
+    }
+    if(enc->frames == 0) {
+        enc->start_ms = clock_ms;
+    }
+
+    // Frames come at whatever rate the game runs; the output's rate is fixed
+    unsigned int due = (uint64_t)(clock_ms - enc->start_ms) * enc->fps / 1000 + 1;
+    if(due <= enc->frames) {
+        return;
+    }
+    video_frame_info info;
+    video_get_frame_info(&info);
+    if(info.w != enc->w || info.h != enc->h) {
+        enc->dropped++;
+        return;
+    }
+    if(enc->wait) {
+        SDL_SemWait(enc->free_slots);
+    } else if(SDL_SemTryWait(enc->free_slots) != 0) {
+        enc->dropped++;
+        return;
+    }
+    encoder_job *job = &enc->jobs[enc->head];
+    if(video_read_frame(job->pixels)) {
+        SDL_SemPost(enc->free_slots);
+        return;
+    }
+    job->info = info;
+    job->repeat = due - enc->frames;
+    enc->frames = due;
+    enc->head = (enc->head + 1) % ENCODER_QUEUE_SIZE;
+    SDL_SemPost(enc->queued);
+}
+
+unsigned int encoder_frame_count() {
+    return enc != NULL ? enc->frames : 0;
+}
+
+unsigned int encoder_dropped_count() {
+    return enc != NULL ? enc->dropped : 0;
+}
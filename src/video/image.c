@@ -126,20 +126,25 @@ int image_write_tga(image *img, const char *filename) {
     header.descriptor = 0;
     fwrite(&header, sizeof(tga_header), 1, fp);
 
-    // Write data
-    char *d = 0;
-    for(int y = img->h-1; y >= 0; y--) {
+    // Write data, bottom row first, a row at a time as BGR
+    char *row = malloc(img->w * 3);
+    int ret = 0;
+    for(int y = img->h-1; y >= 0 && ret == 0; y--) {
+        const char *d = img->data + y * img->w * 4;
         for(int x = 0; x < img->w; x++) {
-            d = img->data + (y * img->w + x) * 4;
-            fwrite(d+2, 1, 1, fp);
-            fwrite(d+1, 1, 1, fp);
-            fwrite(d+0, 1, 1, fp);
+            row[x * 3 + 0] = d[x * 4 + 2];
+            row[x * 3 + 1] = d[x * 4 + 1];
+            row[x * 3 + 2] = d[x * 4 + 0];
+        }
+        if(fwrite(row, 3, img->w, fp) != (size_t)img->w) {
+            ret = 1;
         }
     }
+    free(row);
 
     // Free file
     fclose(fp);
-    return 0; // Success
+    return ret;
 }
 
 int image_supports_png() {
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "video/scale_cache.h"
+#include "utils/hashmap.h"
+#include "utils/io_worker.h"
+#include "utils/log.h"
+#include "utils/mapfile.h"
+#include "utils/memtrack.h"
+#include "utils/vector.h"
+
+#define SCALE_CACHE_MAGIC 0x53464D4F // "OMFS"
+#define SCALE_CACHE_VERSION 1
+
+/*
+ * The file is a header, a table of entries sorted by key, and the scaled
+ * pixels, all addressed by offsets from the start of the file like the
+ * sprite bundle.
+ */
+typedef struct scale_cache_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} scale_cache_header;
+
+typedef struct scale_cache_entry_t {
+    uint64_t key;
+    uint32_t size;
+    uint32_t offset;
+} scale_cache_entry;
+
+// Entries made during this run, written out on close
+typedef struct scale_cache_new_t {
+    uint32_t size;
+    char *data;
+} scale_cache_new;
+
+typedef struct scale_cache_out_t {
+    scale_cache_entry entry;
+    const char *data;
+} scale_cache_out;
+
+// The whole new file
+typedef struct scale_cache_buf_t {
+    char *data;
+    size_t size;
+} scale_cache_buf;
+
+HASHMAP_DEFINE(scale_cache_map, uint64_t, scale_cache_new)
+
+static int _open = 0;
+static char _path[512];
+static mapfile _file;
+static const scale_cache_entry *_entries = NULL;
+static uint32_t _count = 0;
+static hashmap _added;
+static unsigned int _bytes = 0; // Of the file, as it would be written now
+static unsigned int _max_bytes = 0;
+static unsigned int _hits = 0;
+static SDL_SpinLock _lock; // Textures are built on job threads, see tcache_resolve
+
+// FNV-1a, same as the sprite bundle
+uint64_t scale_cache_key_add(uint64_t key, const char *data, size_t len) {
+    for(size_t i = 0; i < len; i++) {
+        key = (key ^ (uint8_t)data[i]) * 1099511628211ull;
+    }
+    return key;
+}
+
+uint64_t scale_cache_key(const char *scaler_name, int factor, int w, int h) {
+    uint64_t key = 14695981039346656037ull;
+    key = scale_cache_key_add(key, scaler_name, strlen(scaler_name) + 1);
+    key = (key ^ factor) * 1099511628211ull;
+    key = (key ^ w) * 1099511628211ull;
+    key = (key ^ h) * 1099511628211ull;
+    return key;
+}
+
+int scale_cache_open(const char *path, unsigned int max_bytes) {
+    scale_cache_close();
+    strncpy(_path, path, sizeof(_path) - 1);
+    _path[sizeof(_path) - 1] = 0;
+    _max_bytes = max_bytes;
+    _bytes = sizeof(scale_cache_header);
+    _hits = 0;
+    hashmap_create_with_allocator(&_added, 6, mem_allocator(MEM_TAG_TCACHE));
+    _open = 1;
+
+    if(mapfile_open(&_file, path)) {
+        DEBUG("No scale cache at %s yet.", path);
+        return 0;
+    }
+    const scale_cache_header *header = (const scale_cache_header*)_file.data;
+    if(_file.size < sizeof(scale_cache_header)
+            || header->magic != SCALE_CACHE_MAGIC || header->version != SCALE_CACHE_VERSION
+            || header->count > (_file.size - sizeof(scale_cache_header)) / sizeof(scale_cache_entry)) {
+        PERROR("Scale cache %s is not valid, starting a new one.", path);
+        mapfile_close(&_file);
+        return 0;
+    }
+    _entries = (const scale_cache_entry*)(_file.data + sizeof(scale_cache_header));
+    _count = header->count;
+    _bytes = _file.size;
+    INFO("Loaded %u scaled sprites from %s.", _count, path);
+    return 0;
+}
+
+int scale_cache_is_open() {
+    return _open;
+}
+
+static int scale_cache_out_cmp(const void *a, const void *b) {
+    const scale_cache_out *oa = a;
+    const scale_cache_out *ob = b;
+    return (oa->entry.key > ob->entry.key) - (oa->entry.key < ob->entry.key);
+}
+
+static int scale_cache_write_file(const char *path, void *userdata) {
+    scale_cache_buf *buf = userdata;
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        return 1;
+    }
+    int err = fwrite(buf->data, 1, buf->size, fp) != buf->size;
+    err |= fclose(fp) != 0;
+    return err;
+}
+
+static void scale_cache_free_buf(void *userdata) {
+    scale_cache_buf *buf = userdata;
+    free(buf->data);
+    free(buf);
+}
+
+// Everything that was there, and what was added, in one new file
+static scale_cache_buf* scale_cache_build() {
+    vector out;
+    vector_create(&out, sizeof(scale_cache_out));
+    scale_cache_out o;
+    for(uint32_t i = 0; i < _count; i++) {
+        o.entry = _entries[i];
+        if(o.entry.offset + (size_t)o.entry.size > _file.size) {
+            continue;
+        }
+        o.data = _file.data + o.entry.offset;
+        vector_append(&out, &o);
+    }
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&_added, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        scale_cache_new *n = pair->val;
+        memcpy(&o.entry.key, pair->key, sizeof(uint64_t));
+        o.entry.size = n->size;
+        o.data = n->data;
+        vector_append(&out, &o);
+    }
+    vector_sort(&out, scale_cache_out_cmp);
+
+    scale_cache_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCALE_CACHE_MAGIC;
+    header.version = SCALE_CACHE_VERSION;
+    header.count = vector_size(&out);
+    uint32_t offset = sizeof(scale_cache_header) + header.count * sizeof(scale_cache_entry);
+    scale_cache_out *e;
+    vector_iter_begin(&out, &it);
+    while((e = iter_next(&it)) != NULL) {
+        e->entry.offset = offset;
+        offset += e->entry.size;
+    }
+
+    scale_cache_buf *buf = malloc(sizeof(scale_cache_buf));
+    buf->data = malloc(offset);
+    buf->size = offset;
+    char *p = buf->data;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    vector_iter_begin(&out, &it);
+    while((e = iter_next(&it)) != NULL) {
+        memcpy(p, &e->entry, sizeof(scale_cache_entry));
+        p += sizeof(scale_cache_entry);
+    }
+    vector_iter_begin(&out, &it);
+    while((e = iter_next(&it)) != NULL) {
+        memcpy(p, e->data, e->entry.size);
+        p += e->entry.size;
+    }
+    vector_free(&out);
+    return buf;
+}
+
+void scale_cache_close() {
+    if(!_open) {
+        return;
+    }
+    unsigned int added = hashmap_reserved(&_added);
+    DEBUG("Scale cache: %u hits, %u new.", _hits, added);
+    if(added > 0) {
+        // The file is copied out first, as it can't be replaced while mapped
+        scale_cache_buf *buf = scale_cache_build();
+        io_worker_write(_path, scale_cache_write_file, buf, scale_cache_free_buf);
+    }
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&_added, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        mem_free(((scale_cache_new*)pair->val)->data);
+    }
+    hashmap_free(&_added);
+    if(_entries != NULL) {
+        mapfile_close(&_file);
+    }
+    _entries = NULL;
+    _count = 0;
+    _open = 0;
+}
+
+const char* scale_cache_find(uint64_t key, uint32_t size) {
+    if(!_open) {
+        return NULL;
+    }
+    int lo = 0;
+    int hi = (int)_count - 1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const scale_cache_entry *e = &_entries[mid];
+        if(e->key < key) {
+            lo = mid + 1;
+        } else if(e->key > key) {
+            hi = mid - 1;
+        } else {
+            if(e->size != size || e->offset + (size_t)size > _file.size) {
+                return NULL;
+            }
+            SDL_AtomicLock(&_lock);
+            _hits++;
+            SDL_AtomicUnlock(&_lock);
+            return _file.data + e->offset;
+        }
+    }
+    const char *found = NULL;
+    SDL_AtomicLock(&_lock);
+    scale_cache_new *n = scale_cache_map_get(&_added, &key);
+    if(n != NULL && n->size == size) {
+        _hits++;
+        found = n->data;
+    }
+    SDL_AtomicUnlock(&_lock);
+    return found;
+}
+
+void scale_cache_add(uint64_t key, const char *data, uint32_t size) {
+    if(!_open) {
+        return;
+    }
+    // Copied outside the lock, and dropped if it turns out not to be needed
+    scale_cache_new n;
+    n.size = size;
+    n.data = mem_malloc(MEM_TAG_TCACHE, size);
+    memcpy(n.data, data, size);
+    SDL_AtomicLock(&_lock);
+    int keep = _bytes + sizeof(scale_cache_entry) + size <= _max_bytes && scale_cache_map_get(&_added, &key) == NULL;
+    if(keep) {
+        scale_cache_map_put(&_added, &key, &n);
+        _bytes += sizeof(scale_cache_entry) + size;
+    }
+    SDL_AtomicUnlock(&_lock);
+    if(!keep) {
+        mem_free(n.data);
+    }
+}
@@ -0,0 +1,80 @@
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include "video/scaler_pool.h"
+#include "utils/jobs.h"
+#include "utils/trace.h"
+
+/*
+* Runs scalers that support row band scaling on the job system.
+* The image is split into horizontal bands, one per job thread plus one for the
+* calling thread. The calling thread handles the first band itself and then
+* waits for the rest to finish.
+*/
+
+#define SCALER_POOL_MAX_BANDS 9
+
+// Images smaller than this are not worth splitting
+#define SCALER_POOL_MIN_PIXELS (64 * 64)
+
+typedef struct scaler_band_t {
+    scaler_plugin *scaler;
+    const char *in;
+    char *out;
+    int w;
+    int h;
+    int factor;
+    int y0;
+    int y1;
+} scaler_band;
+
+static void scaler_pool_run_band(void *userdata) {
+    scaler_band *band = userdata;
+    if(band->y0 < band->y1) {
+        trace_begin("video", "scale band");
+        scaler_scale_rows(band->scaler, band->in, band->out, band->w, band->h, band->factor, band->y0, band->y1);
+        trace_end("video", "scale band");
+    }
+}
+
+int scaler_pool_scale(scaler_plugin *scaler,
+                      const char* in,
+                      char* out,
+                      int w, int h,
+                      int factor) {
+
+    // Fall back to plain single threaded scaling if splitting isn't possible or worth it
+    if(jobs_thread_count() == 0
+        || !scaler_has_scale_rows(scaler)
+        || w * h < SCALER_POOL_MIN_PIXELS
+        || h < 2) {
+        return scaler_scale(scaler, in, out, w, h, factor);
+    }
+
+    int bands = jobs_thread_count() + 1;
+    if(bands > SCALER_POOL_MAX_BANDS) {
+        bands = SCALER_POOL_MAX_BANDS;
+    }
+    if(bands > h) {
+        bands = h;
+    }
+    scaler_band band[SCALER_POOL_MAX_BANDS];
+    for(int i = 0; i < bands; i++) {
+        band[i].scaler = scaler;
+        band[i].in = in;
+        band[i].out = out;
+        band[i].w = w;
+        band[i].h = h;
+        band[i].factor = factor;
+        band[i].y0 = h * i / bands;
+        band[i].y1 = h * (i + 1) / bands;
+    }
+
+    job_counter done;
+    job_counter_init(&done);
+    for(int i = 1; i < bands; i++) {
+        jobs_run("scale band", scaler_pool_run_band, &band[i], &done, 0);
+    }
+    scaler_pool_run_band(&band[0]);
+    jobs_wait(&done);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <string.h>
+#include "video/screen_palette.h"
+
+void palette_mask_clear(palette_mask *mask) {
+    memset(mask->bits, 0, sizeof(mask->bits));
+}
+
+void palette_mask_fill(palette_mask *mask) {
+    memset(mask->bits, 0xFF, sizeof(mask->bits));
+}
+
+void palette_mask_set(palette_mask *mask, uint8_t index) {
+    mask->bits[index >> 5] |= (1u << (index & 31));
+}
+
+int palette_mask_get(const palette_mask *mask, uint8_t index) {
+    return (mask->bits[index >> 5] >> (index & 31)) & 1;
+}
+
+// Tells if any index in start..start+count-1 is set
+int palette_mask_any(const palette_mask *mask, int start, int count) {
+    for(int i = start; i < start + count; i++) {
+        if(mask->bits[i >> 5] == 0) {
+            i |= 31;
+            continue;
+        }
+        if(palette_mask_get(mask, i)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define BLEND_ONE (255 * 256)
+
+static inline int max_channel(const uint8_t *x) {
+    int m = x[0] > x[1] ? x[0] : x[1];
+    return m > x[2] ? m : x[2];
+}
+
+// These only use integers. Results are floored like the float versions they
+// replaced, so the two only differ where float rounding fell just short of
+// a whole number.
+void screen_palette_blend(screen_palette *pal, int start, int count, int ref, int weight) {
+    const int c[3] = {pal->data[ref][0], pal->data[ref][1], pal->data[ref][2]};
+    for(int i = start; i < start + count; i++) {
+        uint8_t *x = pal->data[i];
+        for(int j = 0; j < 3; j++) {
+            int t = x[j] * BLEND_ONE + (c[j] - x[j]) * weight;
+            t = t < 0 ? 0 : t / BLEND_ONE;
+            x[j] = t > 255 ? 255 : t;
+        }
+    }
+}
+
+void screen_palette_tint(screen_palette *pal, int start, int count, int ref, int weight) {
+    const int c[3] = {pal->data[ref][0], pal->data[ref][1], pal->data[ref][2]};
+    const int64_t one = (int64_t)BLEND_ONE * 255;
+    for(int i = start; i < start + count; i++) {
+        uint8_t *x = pal->data[i];
+        int64_t w = (int64_t)weight * max_channel(x);
+        for(int j = 0; j < 3; j++) {
+            int64_t t = x[j] * one + (c[j] - x[j]) * w;
+            t = t < 0 ? 0 : t / one;
+            x[j] = t > 255 ? 255 : t;
+        }
+    }
+}
+
+// Bumps the palette version, and stamps every index that differs from old_data
+// (or all of them, if force is set) with the new version.
+void screen_palette_mark(screen_palette *pal, const uint8_t old_data[256][3], int force) {
+    pal->version++;
+    for(int i = 0; i < 256; i++) {
+        if(force || memcmp(pal->data[i], old_data[i], 3) != 0) {
+            pal->changed[i] = pal->version;
+            pal->word_changed[i >> 5] = pal->version;
+        }
+    }
+}
+
+// Returns the lookup table of a player. Only the entries whose colors changed
+// since the table was last used get rebuilt, so player colors set up once for
+// a match cost nothing afterwards.
+const palette_lut* screen_palette_get_lut(screen_palette *pal, uint8_t pal_offset) {
+    if(pal_offset % PLAYER_PALETTE_SIZE != 0 || pal_offset / PLAYER_PALETTE_SIZE >= PLAYER_PALETTE_COUNT) {
+        return NULL;
+    }
+    int player = pal_offset / PLAYER_PALETTE_SIZE;
+    palette_lut *lut = &pal->player_luts[player];
+    int built = pal->player_lut_built[player];
+    unsigned int since = pal->player_lut_version[player];
+    if(built && since == pal->version) {
+        return lut;
+    }
+    for(int i = 0; i < 256; i++) {
+        int idx = palette_bank_index(i, pal_offset);
+        if(built && pal->changed[idx] <= since) {
+            continue;
+        }
+        lut->data[i][0] = pal->data[idx][0];
+        lut->data[i][1] = pal->data[idx][1];
+        lut->data[i][2] = pal->data[idx][2];
+        lut->data[i][3] = 0xFF;
+    }
+    pal->player_lut_built[player] = 1;
+    pal->player_lut_version[player] = pal->version;
+    return lut;
+}
+
+// Tells if any of the palette indexes in mask have changed after the given version
+int screen_palette_changed_since(const screen_palette *pal, const palette_mask *mask, unsigned int version) {
+    for(int w = 0; w < PALETTE_MASK_WORDS; w++) {
+        uint32_t bits = mask->bits[w];
+        if(bits == 0 || pal->word_changed[w] <= version) {
+            continue;
+        }
+        for(int b = 0; b < 32; b++) {
+            if((bits >> b) & 1 && pal->changed[w * 32 + b] > version) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
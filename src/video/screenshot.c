@@ -0,0 +1,178 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include "video/screenshot.h"
+#include "video/image.h"
+#include "video/video.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+/*
+* SDL_Renderer has no asynchronous readback, so the pixels are read on the
+* render thread right after the frame is submitted, before present() can
+* block on vsync. Encoding is what takes most of the time, and that is done
+* by a single worker thread from a bounded queue. When the queue is full the
+* render thread waits for a free slot rather than dropping the frame, so that
+* a captured sequence never has holes in it.
+*/
+
+#define SCREENSHOT_QUEUE_SIZE 8
+
+typedef struct screenshot_job_t {
+    image img;
+    char filename[64];
+} screenshot_job;
+
+typedef struct screenshot_writer_t {
+    SDL_Thread *thread;
+    SDL_sem *free_slots;
+    SDL_sem *queued;
+    screenshot_job jobs[SCREENSHOT_QUEUE_SIZE];
+    int head;
+    int tail;
+} screenshot_writer;
+
+static screenshot_writer *writer = NULL;
+static int single_requested = 0;
+static int seq_every = 0;
+static unsigned int seq_frame = 0;
+static unsigned int seq_count = 0;
+static unsigned int seq_id = 0;
+
+static int screenshot_write(screenshot_job *job) {
+    trace_begin("video", "screenshot write");
+    int ret;
+    if(image_supports_png()) {
+        ret = image_write_png(&job->img, job->filename);
+    } else {
+        ret = image_write_tga(&job->img, job->filename);
+    }
+    trace_end("video", "screenshot write");
+    if(ret) {
+        PERROR("Screenshot write operation failed (%s)", job->filename);
+    }
+    return ret;
+}
+
+static int screenshot_worker(void *data) {
+    while(1) {
+        SDL_SemWait(writer->queued);
+        screenshot_job *job = &writer->jobs[writer->tail];
+        writer->tail = (writer->tail + 1) % SCREENSHOT_QUEUE_SIZE;
+
+        // A job without pixels is the signal to quit
+        if(job->img.data == NULL) {
+            break;
+        }
+        screenshot_write(job);
+        image_free(&job->img);
+        SDL_SemPost(writer->free_slots);
+    }
+    return 0;
+}
+
+static int screenshot_writer_start() {
+    if(writer != NULL) {
+        return 0;
+    }
+    writer = malloc(sizeof(screenshot_writer));
+    writer->head = 0;
+    writer->tail = 0;
+    writer->free_slots = SDL_CreateSemaphore(SCREENSHOT_QUEUE_SIZE);
+    writer->queued = SDL_CreateSemaphore(0);
+    writer->thread = SDL_CreateThread(screenshot_worker, "screenshot", NULL);
+    if(writer->thread == NULL) {
+        PERROR("Unable to create screenshot thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(writer->free_slots);
+        SDL_DestroySemaphore(writer->queued);
+        free(writer);
+        writer = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+// Takes ownership of the image. Writes synchronously if there is no worker.
+static void screenshot_push(image *img, const char *filename) {
+    if(screenshot_writer_start()) {
+        screenshot_job job;
+        job.img = *img;
+        snprintf(job.filename, sizeof(job.filename), "%s", filename);
+        screenshot_write(&job);
+        image_free(&job.img);
+        return;
+    }
+    SDL_SemWait(writer->free_slots);
+    screenshot_job *job = &writer->jobs[writer->head];
+    job->img = *img;
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    writer->head = (writer->head + 1) % SCREENSHOT_QUEUE_SIZE;
+    SDL_SemPost(writer->queued);
+}
+
+void screenshot_request() {
+    single_requested = 1;
+}
+
+void screenshot_sequence_start(int every) {
+    seq_every = every > 0 ? every : 1;
+    seq_frame = 0;
+    seq_count = 0;
+    seq_id = SDL_GetTicks();
+}
+
+void screenshot_sequence_stop() {
+    seq_every = 0;
+}
+
+int screenshot_sequence_active() {
+    return seq_every > 0;
+}
+
+unsigned int screenshot_sequence_count() {
+    return seq_count;
+}
+
+void screenshot_capture() {
+    int seq_due = 0;
+    if(seq_every > 0) {
+        seq_due = (seq_frame++ % seq_every) == 0;
+    }
+    if(!single_requested && !seq_due) {
+        return;
+    }
+
+    image img;
+    char filename[64];
+    const char *ext = image_supports_png() ? "png" : "tga";
+    if(single_requested) {
+        video_screenshot(&img);
+        snprintf(filename, sizeof(filename), "screenshot_%u.%s", SDL_GetTicks(), ext);
+        screenshot_push(&img, filename);
+        single_requested = 0;
+    }
+    if(seq_due) {
+        video_screenshot(&img);
+        snprintf(filename, sizeof(filename), "capture_%u_%05u.%s", seq_id, seq_count, ext);
+        screenshot_push(&img, filename);
+        seq_count++;
+    }
+}
+
+void screenshot_close() {
+    seq_every = 0;
+    single_requested = 0;
+    if(writer == NULL) {
+        return;
+    }
+
+    // Queue the quit signal behind whatever is still waiting to be written
+    SDL_SemWait(writer->free_slots);
+    writer->jobs[writer->head].img.data = NULL;
+    writer->head = (writer->head + 1) % SCREENSHOT_QUEUE_SIZE;
+    SDL_SemPost(writer->queued);
+    SDL_WaitThread(writer->thread, NULL);
+    SDL_DestroySemaphore(writer->free_slots);
+    SDL_DestroySemaphore(writer->queued);
+    free(writer);
+    writer = NULL;
+}
@@ -1,20 +1,70 @@
 #include <stdlib.h>
 #include <string.h>
 #include <utils/log.h>
+#include "utils/cpu.h"
+#include "utils/memtrack.h"
+#include "utils/miscmath.h"
 #include "video/surface.h"
 
-void surface_create(surface *sur, int type, int w, int h) {
-    if(type == SURFACE_TYPE_RGBA) {
-        sur->data = malloc(w*h*4);
-        sur->stencil = NULL;
-    } else {
-        sur->data = malloc(w*h);
-        sur->stencil = malloc(w*h);
+// Number of surfaces freed so far. Lets holders of surface pointers
+// find out whether any of them may have gone away.
+static SDL_atomic_t surface_frees;
+
+unsigned int surface_get_free_count() {
+    return SDL_AtomicGet(&surface_frees);
+}
+
+// Surface buffers start on a cache line, which is also enough for any vector load
+#define SURFACE_ALIGN 64
+
+static size_t surface_align(size_t n) {
+    return (n + SURFACE_ALIGN - 1) & ~(size_t)(SURFACE_ALIGN - 1);
+}
+
+// The pointer mem_malloc gave us is kept just in front of the block for freeing
+static char* surface_alloc_block(size_t size) {
+    char *raw = mem_malloc(MEM_TAG_VIDEO, size + SURFACE_ALIGN + sizeof(void*));
+    uintptr_t p = ((uintptr_t)raw + sizeof(void*) + SURFACE_ALIGN - 1) & ~(uintptr_t)(SURFACE_ALIGN - 1);
+    ((void**)p)[-1] = raw;
+    return (char*)p;
+}
+
+int surface_pixel_bytes(int type) {
+    return (type == SURFACE_TYPE_RGBA) ? 4 : 1;
+}
+
+// Allocates the pixels and, if asked, the stencil right after them in one block
+static void surface_alloc(surface *sur, int with_stencil) {
+    size_t size = (size_t)sur->w * sur->h;
+    size_t data_size = surface_align(size * surface_pixel_bytes(sur->type));
+    size_t total = data_size + (with_stencil ? surface_align(size) : 0);
+    sur->data = surface_alloc_block(total);
+    sur->stencil = with_stencil ? sur->data + data_size : NULL;
+}
+
+static void surface_release(surface *sur) {
+    if(sur->data != NULL) {
+        mem_free(((void**)sur->data)[-1]);
     }
+    sur->data = NULL;
+    sur->stencil = NULL;
+}
+
+void surface_create(surface *sur, int type, int w, int h) {
     sur->w = w;
     sur->h = h;
     sur->type = type;
-    sur->force_refresh = 0;
+    surface_alloc(sur, type == SURFACE_TYPE_PALETTE);
+    sur->rle = NULL;
+    sur->hitmask = NULL;
+    sur->pal_used = NULL;
+    sur->refs = NULL;
+    sur->borrowed = 0;
+    sur->opaque = 0;
+    sur->rle_pixels = 0;
+    // Cache entries may outlive their surfaces, so make sure a new surface
+    // at an old address never picks up a stale texture.
+    sur->force_refresh = 1;
 }
 
 void surface_force_refresh(surface *sur) {
@@ -23,7 +73,7 @@ void surface_force_refresh(surface *sur) {
 
 void surface_create_from_data(surface *sur, int type, int w, int h, const char *src) {
     surface_create(sur, type, w, h);
-    int size = w * h * ((type == SURFACE_TYPE_PALETTE) ? 1 : 4);
+    int size = w * h * surface_pixel_bytes(type);
     memcpy(sur->data, src, size);
     if(type == SURFACE_TYPE_PALETTE) {
         memset(sur->stencil, 1, w * h);
@@ -44,11 +94,319 @@ int surface_to_image(surface *sur, image *img) {
     return 0;
 }
 
-void surface_free(surface *sur) {
-    free(sur->data);
-    free(sur->stencil);
-    sur->stencil = NULL;
+// Releases the stencil runs. Must be called whenever the stencil changes.
+static void surface_drop_rle(surface *sur) {
+    if(sur->rle != NULL) {
+        free(sur->rle->runs);
+        free(sur->rle->rows);
+        free(sur->rle->offsets);
+        free(sur->rle);
+        sur->rle = NULL;
+    }
+    sur->opaque = 0;
+}
+
+static void surface_drop_hitmask(surface *sur) {
+    free(sur->hitmask);
+    sur->hitmask = NULL;
+}
+
+static void surface_drop_pal_mask(surface *sur) {
+    free(sur->pal_used);
+    sur->pal_used = NULL;
+}
+
+// Expands count stencil bytes of whichever form the surface has, from pixel start on
+void surface_read_stencil(const surface *sur, char *dst, int start, int count) {
+    if(sur->stencil != NULL) {
+        memcpy(dst, sur->stencil + start, count);
+        return;
+    }
+    for(int i = 0; i < count; i++) {
+        int p = start + i;
+        dst[i] = (sur->hitmask[p / 32] >> (p % 32)) & 1;
+    }
+}
+
+// The hit mask is dropped on every write, so it is current whenever it exists
+int surface_stencil_at(const surface *sur, int i) {
+    if(sur->hitmask != NULL) {
+        return (sur->hitmask[i / 32] >> (i % 32)) & 1;
+    }
+    return sur->stencil[i] == 1;
+}
+
+static int surface_stencil_packed(const surface *sur) {
+    return sur->type == SURFACE_TYPE_PALETTE && sur->stencil == NULL && sur->hitmask != NULL;
+}
+
+// Lets go of the buffers without freeing them, another owner still has them
+static void surface_forget(surface *sur) {
     sur->data = NULL;
+    sur->stencil = NULL;
+    sur->rle = NULL;
+    sur->hitmask = NULL;
+    sur->pal_used = NULL;
+    sur->refs = NULL;
+    sur->borrowed = 0;
+    sur->opaque = 0;
+    sur->rle_pixels = 0;
+}
+
+void surface_free(surface *sur) {
+    if(sur->borrowed) {
+        surface_forget(sur);
+        SDL_AtomicIncRef(&surface_frees);
+        return;
+    }
+    if(sur->refs != NULL) {
+        if(SDL_AtomicAdd(sur->refs, -1) > 1) {
+            surface_forget(sur);
+            SDL_AtomicIncRef(&surface_frees);
+            return;
+        }
+        free(sur->refs);
+        sur->refs = NULL;
+    }
+    surface_drop_rle(sur);
+    surface_drop_hitmask(sur);
+    surface_drop_pal_mask(sur);
+    surface_release(sur);
+    sur->rle_pixels = 0;
+    SDL_AtomicIncRef(&surface_frees);
+}
+
+// Makes dst another owner of the buffers of src. Neither may be written to
+// without surface_make_writable(), which gives the writer buffers of its own.
+void surface_share(surface *dst, surface *src) {
+    // Nobody frees borrowed buffers, so there is nothing to count
+    if(src->borrowed) {
+        *dst = *src;
+        return;
+    }
+    if(src->refs == NULL) {
+        src->refs = malloc(sizeof(SDL_atomic_t));
+        SDL_AtomicSet(src->refs, 1);
+    }
+    SDL_AtomicAdd(src->refs, 1);
+    *dst = *src;
+}
+
+void surface_create_borrowed(surface *sur, const surface *src) {
+    *sur = *src;
+    sur->refs = NULL;
+    sur->borrowed = 1;
+    sur->force_refresh = 1;
+}
+
+// Copy on write; every function that changes a surface calls this first.
+// A packed stencil is expanded back to bytes, since writers need those.
+void surface_make_writable(surface *sur) {
+    if(sur->refs == NULL && !sur->borrowed) {
+        if(surface_stencil_packed(sur)) {
+            surface old = *sur;
+            surface_alloc(sur, 1);
+            surface_read_pixels(&old, sur->data, 0, sur->w * sur->h);
+            surface_read_stencil(&old, sur->stencil, 0, sur->w * sur->h);
+            surface_release(&old);
+            if(sur->rle_pixels) {
+                free(sur->rle->offsets);
+                sur->rle->offsets = NULL;
+                sur->rle_pixels = 0;
+            }
+        }
+        return;
+    }
+    if(sur->refs != NULL && SDL_AtomicGet(sur->refs) == 1) {
+        free(sur->refs);
+        sur->refs = NULL;
+        surface_make_writable(sur);
+        return;
+    }
+    surface src = *sur;
+    surface_forget(sur);
+    int size = src.w * src.h * surface_pixel_bytes(src.type);
+    surface_alloc(sur, src.type == SURFACE_TYPE_PALETTE);
+    if(src.type == SURFACE_TYPE_PALETTE) {
+        surface_read_pixels(&src, sur->data, 0, src.w * src.h);
+        surface_read_stencil(&src, sur->stencil, 0, src.w * src.h);
+    } else {
+        memcpy(sur->data, src.data, size);
+    }
+    // Anything derived from the pixels is about to go stale anyway
+    sur->force_refresh = 1;
+    surface_free(&src);
+}
+
+// Records which palette indexes the visible pixels use, so that palette changes
+// elsewhere don't invalidate the surface. Any write into the surface drops this.
+void surface_build_pal_mask(surface *sur) {
+    surface_make_writable(sur);
+    surface_drop_pal_mask(sur);
+    if(sur->type != SURFACE_TYPE_PALETTE) {
+        return;
+    }
+    sur->pal_used = malloc(sizeof(palette_mask));
+    palette_mask_clear(sur->pal_used);
+    int size = sur->w * sur->h;
+    for(int i = 0; i < size; i++) {
+        if(sur->stencil[i] == 1) {
+            palette_mask_set(sur->pal_used, (uint8_t)sur->data[i]);
+        }
+    }
+}
+
+// Precomputes the opaque pixel runs of the stencil, so that blitters can
+// skip over transparent areas. Only useful for surfaces that don't change.
+int surface_build_rle(surface *sur) {
+    if(sur->type != SURFACE_TYPE_PALETTE || sur->w > UINT16_MAX) {
+        return 1;
+    }
+    surface_make_writable(sur);
+    surface_drop_rle(sur);
+
+    // Count runs first, so we only need to allocate once
+    unsigned int count = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *st = sur->stencil + y * sur->w;
+        for(int x = 0; x < sur->w; x++) {
+            if(st[x] == 1 && (x == 0 || st[x-1] != 1)) {
+                count++;
+            }
+        }
+    }
+
+    surface_rle *rle = malloc(sizeof(surface_rle));
+    rle->runs = malloc(sizeof(uint16_t) * 2 * (count > 0 ? count : 1));
+    rle->rows = malloc(sizeof(unsigned int) * (sur->h + 1));
+    rle->offsets = NULL;
+    unsigned int n = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *st = sur->stencil + y * sur->w;
+        rle->rows[y] = n;
+        int x = 0;
+        while(x < sur->w) {
+            if(st[x] != 1) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while(x < sur->w && st[x] == 1) {
+                x++;
+            }
+            rle->runs[n * 2 + 0] = start;
+            rle->runs[n * 2 + 1] = x - start;
+            n++;
+        }
+    }
+    rle->rows[sur->h] = n;
+    sur->rle = rle;
+
+    // One full width run per row means every pixel is drawn
+    sur->opaque = (n == (unsigned int)sur->h);
+    for(unsigned int i = 0; sur->opaque && i < n; i++) {
+        sur->opaque = (rle->runs[i * 2 + 1] == sur->w);
+    }
+    return 0;
+}
+
+// Packs the stencil into one bit per pixel for collision checks. There is an
+// extra zero bit past the end, because mirrored lookups can index one past it.
+void surface_build_hitmask(surface *sur) {
+    surface_make_writable(sur);
+    surface_drop_hitmask(sur);
+    if(sur->stencil == NULL) {
+        return;
+    }
+    int size = sur->w * sur->h;
+    sur->hitmask = calloc(size / 32 + 1, sizeof(uint32_t));
+    for(int i = 0; i < size; i++) {
+        if(sur->stencil[i] > 0) {
+            sur->hitmask[i / 32] |= 1u << (i % 32);
+        }
+    }
+}
+
+// Sprites never change, so their stencil can live in the runs and the hit mask
+// alone. That is about a third of what the bytes take. Shared surfaces keep
+// theirs, since the other owners have the same pointer. The pixels move to a
+// block of their own, as the stencil can't be cut off the end of the old one.
+void surface_pack_stencil(surface *sur) {
+    if(sur->type != SURFACE_TYPE_PALETTE || sur->refs != NULL || sur->borrowed
+            || sur->rle == NULL || sur->hitmask == NULL) {
+        return;
+    }
+    surface old = *sur;
+    surface_alloc(sur, 0);
+    memcpy(sur->data, old.data, sur->w * sur->h);
+    surface_release(&old);
+}
+
+// Transparent pixels must all be 0, so that readers see the same pixels as
+// before. Solid surfaces have nothing to drop and are left as they are.
+void surface_pack_pixels(surface *sur) {
+    if(!surface_stencil_packed(sur) || sur->refs != NULL || sur->borrowed || sur->rle_pixels || sur->opaque) {
+        return;
+    }
+    const surface_rle *rle = sur->rle;
+    unsigned int total = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *row = sur->data + y * sur->w;
+        int x = 0;
+        for(unsigned int i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+            for(; x < rle->runs[i * 2]; x++) {
+                if(row[x] != 0) return;
+            }
+            x += rle->runs[i * 2 + 1];
+            total += rle->runs[i * 2 + 1];
+        }
+        for(; x < sur->w; x++) {
+            if(row[x] != 0) return;
+        }
+    }
+
+    unsigned int *offsets = malloc(sizeof(unsigned int) * (sur->h + 1));
+    char *px = surface_alloc_block(total > 0 ? total : 1);
+    unsigned int n = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *row = sur->data + y * sur->w;
+        offsets[y] = n;
+        for(unsigned int i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+            memcpy(px + n, row + rle->runs[i * 2], rle->runs[i * 2 + 1]);
+            n += rle->runs[i * 2 + 1];
+        }
+    }
+    offsets[sur->h] = n;
+    surface old = *sur;
+    surface_release(&old);
+    sur->data = px;
+    sur->rle->offsets = offsets;
+    sur->rle_pixels = 1;
+}
+
+// Expands count pixels of a paletted surface, from pixel start on
+void surface_read_pixels(const surface *sur, char *dst, int start, int count) {
+    if(!sur->rle_pixels) {
+        memcpy(dst, sur->data + start, count);
+        return;
+    }
+    const surface_rle *rle = sur->rle;
+    int end = start + count;
+    memset(dst, 0, count);
+    for(int y = start / sur->w; y < sur->h && y * sur->w < end; y++) {
+        int row = y * sur->w;
+        const char *px = sur->data + rle->offsets[y];
+        for(unsigned int i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+            int rs = row + rle->runs[i * 2];
+            int re = rs + rle->runs[i * 2 + 1];
+            int a = max2(rs, start);
+            int b = min2(re, end);
+            if(a < b) {
+                memcpy(dst + (a - start), px + (a - rs), b - a);
+            }
+            px += rle->runs[i * 2 + 1];
+        }
+    }
 }
 
 int surface_get_type(surface *sur) {
@@ -56,19 +414,18 @@ int surface_get_type(surface *sur) {
 }
 
 void surface_clear(surface *sur) {
-    if(sur->type == SURFACE_TYPE_RGBA) {
-        memset(sur->data, 0, sur->w*sur->h*4);
-    } else {
-        memset(sur->data, 0, sur->w*sur->h);
-    }
+    surface_make_writable(sur);
+    surface_drop_pal_mask(sur);
+    memset(sur->data, 0, sur->w * sur->h * surface_pixel_bytes(sur->type));
 }
 
 // Fills the whole surface with color
 void surface_fill(surface *sur, color c) {
     // Only for RGBA for now
-    if(sur->type == SURFACE_TYPE_PALETTE) {
+    if(sur->type != SURFACE_TYPE_RGBA) {
         return;
     }
+    surface_make_writable(sur);
 
     // Fill
     for(int i = 0; i < sur->w * sur->h; i++) {
@@ -83,10 +440,17 @@ void surface_copy_ex(surface *dst, surface *src) {
     if(src->type != dst->type) {
         return;
     }
-    int size = src->w * src->h * ((src->type == SURFACE_TYPE_PALETTE) ? 1 : 4);
-    memcpy(dst->data, src->data, size);
-    if(src->stencil != NULL)
-        memcpy(dst->stencil, src->stencil, src->w * src->h);
+    surface_make_writable(dst);
+    int size = src->w * src->h * surface_pixel_bytes(src->type);
+    if(src->type == SURFACE_TYPE_PALETTE) {
+        surface_read_pixels(src, dst->data, 0, size);
+        surface_read_stencil(src, dst->stencil, 0, src->w * src->h);
+    } else {
+        memcpy(dst->data, src->data, size);
+    }
+    surface_drop_rle(dst);
+    surface_drop_hitmask(dst);
+    surface_drop_pal_mask(dst);
 }
 
 // Copies a surface to a new surface
@@ -94,13 +458,29 @@ void surface_copy_ex(surface *dst, surface *src) {
 void surface_copy(surface *dst, surface *src) {
     surface_create(dst, src->type, src->w, src->h);
 
-    int size = src->w * src->h * ((src->type == SURFACE_TYPE_PALETTE) ? 1 : 4);
-    memcpy(dst->data, src->data, size);
-
-    if(src->stencil != NULL && dst->stencil != NULL) {
-        memcpy(dst->stencil, src->stencil, src->w * src->h);
+    int size = src->w * src->h * surface_pixel_bytes(src->type);
+    if(src->type == SURFACE_TYPE_PALETTE) {
+        surface_read_pixels(src, dst->data, 0, size);
+        surface_read_stencil(src, dst->stencil, 0, src->w * src->h);
     } else {
-        dst->stencil = NULL;
+        memcpy(dst->data, src->data, size);
+    }
+    if(src->pal_used != NULL) {
+        dst->pal_used = malloc(sizeof(palette_mask));
+        *dst->pal_used = *src->pal_used;
+    }
+}
+
+// Copies w pixels of the given size, last pixel first
+static void surface_copy_row_reversed(char *dst, const char *src, int w, int bytes) {
+    if(bytes == 4) {
+        for(int x = 0; x < w; x++) {
+            memcpy(dst + (w - x - 1) * 4, src + x * 4, 4);
+        }
+        return;
+    }
+    for(int x = 0; x < w; x++) {
+        dst[w - x - 1] = src[x];
     }
 }
 
@@ -118,26 +498,112 @@ void surface_sub(surface *dst,
     }
 
     // Copy!
-    int bytes = (src->type == SURFACE_TYPE_RGBA) ? 4 : 1;
-    int src_offset,dst_offset;
+    surface_make_writable(dst);
+    surface_drop_rle(dst);
+    surface_drop_hitmask(dst);
+    surface_drop_pal_mask(dst);
+    int bytes = surface_pixel_bytes(src->type);
+    int stencil = (src->type == SURFACE_TYPE_PALETTE);
+    int mirror = (method == SUB_METHOD_MIRROR);
+
+    // Packed pixels and stencils are expanded a row at a time
+    char *row = (src->rle_pixels || (stencil && src->stencil == NULL)) ? malloc(w) : NULL;
     for(int y = 0; y < h; y++) {
-        for(int x = 0; x < w; x++) {
-            src_offset = (src_x + x + (src_y + y) * src->w) * bytes;
-            switch(method) {
-                case SUB_METHOD_MIRROR:
-                    dst_offset = (dst_x + (w - x - 1) + (dst_y + y) * dst->w) * bytes;
-                    break;
-                default:
-                    dst_offset = (dst_x + x + (dst_y + y) * dst->w) * bytes;
-                    break;
+        int src_start = src_x + (src_y + y) * src->w;
+        int dst_start = dst_x + (dst_y + y) * dst->w;
+        const char *src_row = src->data + src_start * bytes;
+        if(src->rle_pixels) {
+            surface_read_pixels(src, row, src_start, w);
+            src_row = row;
+        }
+        if(mirror) {
+            surface_copy_row_reversed(dst->data + dst_start * bytes, src_row, w, bytes);
+        } else {
+            memcpy(dst->data + dst_start * bytes, src_row, w * bytes);
+        }
+        if(stencil) {
+            const char *src_stencil = row;
+            if(src->stencil != NULL) {
+                src_stencil = src->stencil + src_start;
+            } else {
+                surface_read_stencil(src, row, src_start, w);
             }
-            for(int m = 0; m < bytes; m++) {
-                dst->data[dst_offset + m] = src->data[src_offset + m];
+            if(mirror) {
+                surface_copy_row_reversed(dst->stencil + dst_start, src_stencil, w, 1);
+            } else {
+                memcpy(dst->stencil + dst_start, src_stencil, w);
             }
-            if(bytes == 1) {
-                dst->stencil[dst_offset] = src->stencil[src_offset];
+        }
+    }
+    free(row);
+}
+
+// Clips a src_w*src_h area drawn at dst_x,dst_y against the destination surface.
+// Resulting ranges are in source coordinates before flipping. Returns 0 if nothing is visible.
+static int surface_clip(const surface *dst,
+                        int src_w, int src_h,
+                        int dst_x, int dst_y,
+                        int *x0, int *x1, int *y0, int *y1) {
+    *x0 = (dst_x < 0) ? -dst_x : 0;
+    *y0 = (dst_y < 0) ? -dst_y : 0;
+    *x1 = (dst_x + src_w > dst->w) ? dst->w - dst_x : src_w;
+    *y1 = (dst_y + src_h > dst->h) ? dst->h - dst_y : src_h;
+    return (*x0 < *x1 && *y0 < *y1);
+}
+
+// Remap rows of the palette used by additive blending, source color 1 uses row 4
+#define ADDITIVE_REMAP_FIRST 3
+#define ADDITIVE_REMAP_ROWS ((int)(sizeof(((palette*)0)->remaps) / sizeof(((palette*)0)->remaps[0])))
+
+// Blends one row in spans of the same source color, so that every span is
+// remapped from a single row of the table. Effect sprites are mostly long
+// runs of a few colors and of transparency. step is -1 for flipped rows.
+static void additive_row(char *dst_data, const char *dst_stencil,
+                         const char *src_row, int step,
+                         const palette *remap_pal, int count) {
+    int x = 0;
+    while(x < count) {
+        uint8_t c = (uint8_t)src_row[x * step];
+        int end = x + 1;
+        while(end < count && (uint8_t)src_row[end * step] == c) {
+            end++;
+        }
+        uint8_t row = c + ADDITIVE_REMAP_FIRST;
+        if(c != 0 && row < ADDITIVE_REMAP_ROWS) {
+            const unsigned char *remap = remap_pal->remaps[row];
+            for(int i = x; i < end; i++) {
+                if(dst_stencil[i] == 1) {
+                    dst_data[i] = remap[(uint8_t)dst_data[i]];
+                }
             }
         }
+        x = end;
+    }
+}
+
+// Blends the visible parts of the runs of one row of packed pixels, where
+// the pixels of each run follow those of the previous one
+static void additive_row_rle(char *dst_data, const char *dst_stencil,
+                             const char *px, const uint16_t *runs, unsigned int run_count,
+                             const palette *remap_pal, int src_w, int x0, int x1, int flip) {
+    int vs = flip ? src_w - x1 : x0;
+    int ve = flip ? src_w - x0 : x1;
+    for(unsigned int i = 0; i < run_count; i++) {
+        int start = runs[i * 2];
+        const char *run = px;
+        px += runs[i * 2 + 1];
+        int rs = max2(start, vs);
+        int re = min2(start + runs[i * 2 + 1], ve);
+        if(rs >= re) {
+            continue;
+        }
+        if(flip) {
+            int d = src_w - re - x0;
+            additive_row(dst_data + d, dst_stencil + d, run + (re - 1 - start), -1, remap_pal, re - rs);
+        } else {
+            int d = rs - x0;
+            additive_row(dst_data + d, dst_stencil + d, run + (rs - start), 1, remap_pal, re - rs);
+        }
     }
 }
 
@@ -152,60 +618,152 @@ void surface_additive_blit(surface *dst,
         return;
     }
 
-    int src_offset,dst_offset;
-    uint8_t src_index, dst_index;
-    for(int y = 0; y < src->h; y++) {
-        for(int x = 0; x < src->w; x++) {
-            // If pixel offscreen, skip
-            if(dst_x + x >= dst->w
-                || dst_y + y >= dst->h
-                || dst_x + x < 0
-                || dst_y + y < 0) continue;
-
-            // Calculate pixel offsets
-            src_offset = ((flip & SDL_FLIP_HORIZONTAL) ? src->w - x : x) +
-                         ((flip & SDL_FLIP_VERTICAL) ? src->h - y : y) * src->w;
-            dst_offset = dst_x + x + (dst_y + y) * dst->w;
-
-            // Do blit, if pixel is visible on stencil
-            if(dst->stencil[dst_offset] == 1) {
-                if(src->data[src_offset] == 0)
-                    continue;
-
-                src_index = src->data[src_offset]+3;
-                dst_index = dst->data[dst_offset];
-                dst->data[dst_offset] = remap_pal->remaps[src_index][dst_index];
-            }
+    int x0, x1, y0, y1;
+    if(!surface_clip(dst, src->w, src->h, dst_x, dst_y, &x0, &x1, &y0, &y1)) {
+        return;
+    }
+
+    surface_make_writable(dst);
+    surface_drop_pal_mask(dst);
+
+    // Additive blending keys on the source color index, not the source stencil,
+    // so the stencil runs can only be used if everything outside them is 0.
+    int count = x1 - x0;
+    for(int y = y0; y < y1; y++) {
+        int sy = (flip & SDL_FLIP_VERTICAL) ? src->h - 1 - y : y;
+        int dst_offset = dst_x + x0 + (dst_y + y) * dst->w;
+        const char *src_row = src->data + sy * src->w;
+        if(src->rle_pixels) {
+            unsigned int first = src->rle->rows[sy];
+            additive_row_rle(dst->data + dst_offset, dst->stencil + dst_offset,
+                             src->data + src->rle->offsets[sy],
+                             src->rle->runs + first * 2, src->rle->rows[sy + 1] - first,
+                             remap_pal, src->w, x0, x1, (flip & SDL_FLIP_HORIZONTAL) ? 1 : 0);
+        } else if(flip & SDL_FLIP_HORIZONTAL) {
+            additive_row(dst->data + dst_offset, dst->stencil + dst_offset,
+                         src_row + src->w - 1 - x0, -1, remap_pal, count);
+        } else {
+            additive_row(dst->data + dst_offset, dst->stencil + dst_offset,
+                         src_row + x0, 1, remap_pal, count);
         }
     }
 }
 
 void surface_rgba_blit(surface *dst, const surface *src, int dst_x, int dst_y) {
-    // Both surfaces must be rgba
-    if(dst->type != SURFACE_TYPE_RGBA || src->type != SURFACE_TYPE_RGBA) {
+    // Both surfaces must be rgba, or both alpha
+    if(dst->type != src->type || src->type == SURFACE_TYPE_PALETTE) {
         return;
     }
 
-    int dst_pos;
-    int src_pos;
-    for(int y = 0; y < src->h; y++) {
-        for(int x = 0; x < src->w; x++) {
-            // If pixel offscreen, skip
-            if(dst_x + x >= dst->w
-                || dst_y + y >= dst->h
-                || dst_x + x < 0
-                || dst_y + y < 0) continue;
+    int x0, x1, y0, y1;
+    if(!surface_clip(dst, src->w, src->h, dst_x, dst_y, &x0, &x1, &y0, &y1)) {
+        return;
+    }
+    int bytes = surface_pixel_bytes(src->type);
+    for(int y = y0; y < y1; y++) {
+        memcpy(dst->data + ((dst_y + y) * dst->w + dst_x + x0) * bytes,
+               src->data + (y * src->w + x0) * bytes,
+               (x1 - x0) * bytes);
+    }
+}
+
+int surface_alpha_tint_blit(surface *dst, const surface *src,
+                            int dst_x, int dst_y,
+                            int src_x, int src_y, int w, int h,
+                            uint8_t opacity, color c, int additive,
+                            int *y0, int *y1) {
+    if(dst->type != SURFACE_TYPE_RGBA || src->type != SURFACE_TYPE_ALPHA) {
+        return 0;
+    }
+    if(src_x < 0 || src_y < 0 || src_x + w > src->w || src_y + h > src->h) {
+        return 0;
+    }
 
-            dst_pos = (dst_y + y) * dst->w + (dst_x + x);
-            src_pos = y * src->w + x;
-            dst_pos *= 4;
-            src_pos *= 4;
-            dst->data[dst_pos+0] = src->data[src_pos+0];
-            dst->data[dst_pos+1] = src->data[src_pos+1];
-            dst->data[dst_pos+2] = src->data[src_pos+2];
-            dst->data[dst_pos+3] = src->data[src_pos+3];
+    int cx0, cx1, cy0, cy1;
+    if(!surface_clip(dst, w, h, dst_x, dst_y, &cx0, &cx1, &cy0, &cy1)) {
+        return 0;
+    }
+    const uint8_t rgb[3] = {c.r, c.g, c.b};
+    for(int y = cy0; y < cy1; y++) {
+        const uint8_t *s = (const uint8_t*)src->data + (src_y + y) * src->w + src_x + cx0;
+        uint8_t *d = (uint8_t*)dst->data + ((dst_y + y) * dst->w + dst_x + cx0) * 4;
+        for(int x = cx0; x < cx1; x++, s++, d += 4) {
+            int a = *s * opacity / 255;
+            if(a == 0) {
+                continue;
+            }
+            if(additive) {
+                for(int k = 0; k < 3; k++) {
+                    d[k] = min2(d[k] + rgb[k] * a / 255, 255);
+                }
+            } else {
+                for(int k = 0; k < 3; k++) {
+                    d[k] = (rgb[k] * a + d[k] * (255 - a)) / 255;
+                }
+                d[3] = a + d[3] * (255 - a) / 255;
+            }
         }
-    }}
+    }
+    *y0 = dst_y + cy0;
+    *y1 = dst_y + cy1;
+    return 1;
+}
+
+static void alpha_row(char *dst_data, char *dst_stencil,
+                      const char *src_row, const char *src_stencil,
+                      int count) {
+    for(int x = 0; x < count; x++) {
+        if(src_stencil[x] == 1) {
+            dst_data[x] = src_row[x];
+            dst_stencil[x] = 1;
+        }
+    }
+}
+
+static void alpha_row_flipped(char *dst_data, char *dst_stencil,
+                              const char *src_row, const char *src_stencil,
+                              int count) {
+    for(int x = 0; x < count; x++) {
+        if(src_stencil[-x] == 1) {
+            dst_data[x] = src_row[-x];
+            dst_stencil[x] = 1;
+        }
+    }
+}
+
+// Blits the opaque runs of one source row. Runs are clipped to the visible range.
+// With packed pixels src holds only the pixels of the runs, one after another.
+static void alpha_row_rle(char *dst_data, char *dst_stencil,
+                          const char *src, int packed, const uint16_t *runs, unsigned int run_count,
+                          int src_w, int x0, int x1, int flip) {
+    // Visible source columns
+    int vs = flip ? src_w - x1 : x0;
+    int ve = flip ? src_w - x0 : x1;
+    for(unsigned int i = 0; i < run_count; i++) {
+        int start = runs[i * 2];
+        int rs = start;
+        int re = rs + runs[i * 2 + 1];
+        const char *run = packed ? src : src + start;
+        if(packed) {
+            src += runs[i * 2 + 1];
+        }
+        if(re <= vs) continue;
+        if(rs >= ve) break;
+        if(rs < vs) rs = vs;
+        if(re > ve) re = ve;
+        if(flip) {
+            // Source column sx lands on destination column src_w - 1 - sx
+            char *d = dst_data + (src_w - re - x0);
+            for(int sx = re - 1; sx >= rs; sx--) {
+                *d++ = run[sx - start];
+            }
+            memset(dst_stencil + (src_w - re - x0), 1, re - rs);
+        } else {
+            memcpy(dst_data + (rs - x0), run + (rs - start), re - rs);
+            memset(dst_stencil + (rs - x0), 1, re - rs);
+        }
+    }
+}
 
 void surface_alpha_blit(surface *dst,
                         surface *src,
@@ -217,25 +775,40 @@ void surface_alpha_blit(surface *dst,
         return;
     }
 
-    int src_offset,dst_offset;
-    for(int y = 0; y < src->h; y++) {
-        for(int x = 0; x < src->w; x++) {
-            // If pixel offscreen, skip
-            if(dst_x + x >= dst->w
-                || dst_y + y >= dst->h
-                || dst_x + x < 0
-                || dst_y + y < 0) continue;
-
-            // Calculate offsets
-            src_offset = ((flip & SDL_FLIP_HORIZONTAL) ? src->w - 1 - x : x) +
-                         ((flip & SDL_FLIP_VERTICAL) ? src->h - 1 - y : y) * src->w;
-            dst_offset = dst_x + x + (dst_y + y) * dst->w;
-
-            // If pixel is visible on stencil, do blit
-            if(src->stencil[src_offset] == 1) {
-                dst->data[dst_offset] = src->data[src_offset];
-                dst->stencil[dst_offset] = 1;
-            }
+    int x0, x1, y0, y1;
+    if(!surface_clip(dst, src->w, src->h, dst_x, dst_y, &x0, &x1, &y0, &y1)) {
+        return;
+    }
+    surface_make_writable(dst);
+    surface_drop_rle(dst);
+    surface_drop_hitmask(dst);
+    surface_drop_pal_mask(dst);
+
+    int count = x1 - x0;
+    int hflip = (flip & SDL_FLIP_HORIZONTAL) ? 1 : 0;
+    for(int y = y0; y < y1; y++) {
+        int sy = (flip & SDL_FLIP_VERTICAL) ? src->h - 1 - y : y;
+        int dst_offset = dst_x + x0 + (dst_y + y) * dst->w;
+        int src_offset = sy * src->w;
+        if(src->opaque && !hflip) {
+            // Backgrounds are solid, so their rows can be copied as is
+            memcpy(dst->data + dst_offset, src->data + src_offset + x0, count);
+            memset(dst->stencil + dst_offset, 1, count);
+        } else if(src->rle != NULL) {
+            unsigned int first = src->rle->rows[sy];
+            const char *src_px = src->rle_pixels ? src->data + src->rle->offsets[sy] : src->data + src_offset;
+            alpha_row_rle(dst->data + dst_offset, dst->stencil + dst_offset,
+                          src_px, src->rle_pixels,
+                          src->rle->runs + first * 2, src->rle->rows[sy + 1] - first,
+                          src->w, x0, x1, hflip);
+        } else if(hflip) {
+            src_offset += src->w - 1 - x0;
+            alpha_row_flipped(dst->data + dst_offset, dst->stencil + dst_offset,
+                              src->data + src_offset, src->stencil + src_offset, count);
+        } else {
+            src_offset += x0;
+            alpha_row(dst->data + dst_offset, dst->stencil + dst_offset,
+                      src->data + src_offset, src->stencil + src_offset, count);
         }
     }
 }
@@ -246,16 +819,241 @@ void surface_convert_to_rgba(surface *sur, screen_palette *pal, int pal_offset)
     if(sur->type == SURFACE_TYPE_RGBA) {
         return;
     }
+    surface_make_writable(sur);
 
-    char *pixels = malloc(sur->w * sur->h * 4);
-    surface_to_rgba(sur, pixels, pal, NULL, pal_offset);
+    surface old = *sur;
+    sur->type = SURFACE_TYPE_RGBA;
+    surface_alloc(sur, 0);
+    surface_to_rgba(&old, sur->data, pal, NULL, pal_offset);
 
     // Free old data
-    free(sur->data);
-    free(sur->stencil);
-    sur->data = pixels;
-    sur->stencil = NULL;
-    sur->type = SURFACE_TYPE_RGBA;
+    surface_drop_rle(sur);
+    surface_drop_hitmask(sur);
+    surface_drop_pal_mask(sur);
+    surface_release(&old);
+    sur->force_refresh = 1;
+}
+
+// Builds a lookup table for converting palette indexes to RGBA
+void surface_build_lut(palette_lut *lut,
+                       const screen_palette *pal,
+                       const char *remap_table,
+                       uint8_t pal_offset) {
+    uint8_t idx;
+    for(int i = 0; i < 256; i++) {
+        if(remap_table != NULL) {
+            idx = (uint8_t)remap_table[i];
+        } else {
+            idx = (uint8_t)i;
+        }
+        idx = palette_bank_index(idx, pal_offset);
+        lut->data[i][0] = pal->data[idx][0];
+        lut->data[i][1] = pal->data[idx][1];
+        lut->data[i][2] = pal->data[idx][2];
+        lut->data[i][3] = 0xFF;
+    }
+}
+
+// The vector kernels below assume that the pixel words in palette_lut
+// are laid out as R,G,B,A bytes in memory, ie. little endian. The x86 kernels
+// are built for their own instruction sets, and picked at runtime by
+// surface_select_kernels.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SURFACE_LUT_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SURFACE_LUT_NEON
+#endif
+#endif
+
+typedef int (*lut_convert_fn)(const uint8_t *src,
+                              const uint8_t *stencil,
+                              char *dst,
+                              const palette_lut *lut,
+                              int size);
+
+// Scalar conversion. Also handles whatever is left over from the vector kernels.
+static void lut_convert_scalar(const uint8_t *src,
+                               const uint8_t *stencil,
+                               char *dst,
+                               const palette_lut *lut,
+                               int start,
+                               int size) {
+    for(int i = start; i < size; i++) {
+        memcpy(dst + i * 4, lut->data[src[i]], 4);
+        if(stencil[i] != 1) {
+            dst[i * 4 + 3] = 0;
+        }
+    }
+}
+
+#if defined(SURFACE_LUT_X86)
+// 8 pixels at a time. Stencil bytes are widened to 32bit alpha masks.
+__attribute__((target("avx2")))
+static int lut_convert_avx2(const uint8_t *src,
+                            const uint8_t *stencil,
+                            char *dst,
+                            const palette_lut *lut,
+                            int size) {
+    const uint32_t *t = lut->packed;
+    const __m128i one = _mm_set1_epi8(1);
+    const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+    int i = 0;
+    for(; i + 8 <= size; i += 8) {
+        const uint8_t *s = src + i;
+        __m128i st = _mm_cmpeq_epi8(_mm_loadl_epi64((const __m128i*)(stencil + i)), one);
+        __m256i mask = _mm256_or_si256(_mm256_cvtepi8_epi32(st), rgb);
+        __m256i px = _mm256_setr_epi32(t[s[0]], t[s[1]], t[s[2]], t[s[3]],
+                                       t[s[4]], t[s[5]], t[s[6]], t[s[7]]);
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_and_si256(px, mask));
+    }
+    return i;
+}
+
+// 16 pixels at a time. Stencil bytes are widened to 32bit alpha masks.
+__attribute__((target("sse2")))
+static int lut_convert_sse2(const uint8_t *src,
+                            const uint8_t *stencil,
+                            char *dst,
+                            const palette_lut *lut,
+                            int size) {
+    const uint32_t *t = lut->packed;
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    __m128i mask[4];
+    int i = 0;
+    for(; i + 16 <= size; i += 16) {
+        __m128i st = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(stencil + i)), one);
+        __m128i lo = _mm_unpacklo_epi8(st, st);
+        __m128i hi = _mm_unpackhi_epi8(st, st);
+        mask[0] = _mm_unpacklo_epi16(lo, lo);
+        mask[1] = _mm_unpackhi_epi16(lo, lo);
+        mask[2] = _mm_unpacklo_epi16(hi, hi);
+        mask[3] = _mm_unpackhi_epi16(hi, hi);
+        for(int k = 0; k < 4; k++) {
+            const uint8_t *s = src + i + k * 4;
+            __m128i px = _mm_setr_epi32(t[s[0]], t[s[1]], t[s[2]], t[s[3]]);
+            px = _mm_and_si128(px, _mm_or_si128(mask[k], rgb));
+            _mm_storeu_si128((__m128i*)(dst + (i + k * 4) * 4), px);
+        }
+    }
+    return i;
+}
+#elif defined(SURFACE_LUT_NEON)
+// 8 pixels at a time. Stencil bytes are widened to 32bit alpha masks.
+static int lut_convert_neon(const uint8_t *src,
+                            const uint8_t *stencil,
+                            char *dst,
+                            const palette_lut *lut,
+                            int size) {
+    const uint32_t *t = lut->packed;
+    const uint32x4_t rgb = vdupq_n_u32(0x00FFFFFF);
+    uint32_t px[8];
+    int i = 0;
+    for(; i + 8 <= size; i += 8) {
+        const uint8_t *s = src + i;
+        for(int k = 0; k < 8; k++) {
+            px[k] = t[s[k]];
+        }
+        int16x8_t st = vmovl_s8(vreinterpret_s8_u8(vceq_u8(vld1_u8(stencil + i), vdup_n_u8(1))));
+        uint32x4_t m_lo = vorrq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(st))), rgb);
+        uint32x4_t m_hi = vorrq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(st))), rgb);
+        vst1q_u8((uint8_t*)dst + i * 4, vreinterpretq_u8_u32(vandq_u32(vld1q_u32(px), m_lo)));
+        vst1q_u8((uint8_t*)dst + i * 4 + 16, vreinterpretq_u8_u32(vandq_u32(vld1q_u32(px + 4), m_hi)));
+    }
+    return i;
+}
+#endif
+
+// NULL until a vector kernel is selected, everything goes through the scalar loop then
+static lut_convert_fn lut_convert_vector = NULL;
+
+// Picks the fastest kernels the CPU features allow. Call again after changing them.
+void surface_select_kernels() {
+    const char *name = "scalar";
+    lut_convert_vector = NULL;
+#if defined(SURFACE_LUT_X86)
+    if(cpu_has(CPU_AVX2)) {
+        lut_convert_vector = lut_convert_avx2;
+        name = "avx2";
+    } else if(cpu_has(CPU_SSE2)) {
+        lut_convert_vector = lut_convert_sse2;
+        name = "sse2";
+    }
+#elif defined(SURFACE_LUT_NEON)
+    if(cpu_has(CPU_NEON)) {
+        lut_convert_vector = lut_convert_neon;
+        name = "neon";
+    }
+#endif
+    INFO("Surface palette conversion: %s", name);
+}
+
+static void lut_convert(const uint8_t *src,
+                        const uint8_t *stencil,
+                        char *dst,
+                        const palette_lut *lut,
+                        int size) {
+    int done = 0;
+    if(lut_convert_vector != NULL) {
+        done = lut_convert_vector(src, stencil, dst, lut, size);
+    }
+    lut_convert_scalar(src, stencil, dst, lut, done, size);
+}
+
+// Converts a paletted surface to RGBA using a prebuilt lookup table
+void surface_to_rgba_lut(surface *sur, char *dst, const palette_lut *lut) {
+    surface_to_rgba_lut_rows(sur, dst, lut, 0, sur->h);
+}
+
+// Packed pixels are converted run by run. Everything else is color 0 made
+// transparent, same as what the stencil gives for the full surface.
+static void lut_convert_rle_rows(const surface *sur, char *dst, const palette_lut *lut, int y0, int y1) {
+    const surface_rle *rle = sur->rle;
+    uint32_t clear;
+    memcpy(&clear, lut->data[0], 4);
+    ((uint8_t*)&clear)[3] = 0;
+    for(int y = y0; y < y1; y++) {
+        char *row = dst + (size_t)(y - y0) * sur->w * 4;
+        for(int x = 0; x < sur->w; x++) {
+            memcpy(row + x * 4, &clear, 4);
+        }
+        const uint8_t *px = (const uint8_t*)sur->data + rle->offsets[y];
+        for(unsigned int i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+            char *d = row + rle->runs[i * 2] * 4;
+            int len = rle->runs[i * 2 + 1];
+            for(int k = 0; k < len; k++) {
+                memcpy(d + k * 4, &lut->packed[px[k]], 4);
+            }
+            px += len;
+        }
+    }
+}
+
+// Converts rows [y0, y1) only. dst is laid out for the whole surface.
+void surface_to_rgba_lut_rows(surface *sur, char *dst, const palette_lut *lut, int y0, int y1) {
+    if(sur->rle_pixels) {
+        lut_convert_rle_rows(sur, dst + (size_t)y0 * sur->w * 4, lut, y0, y1);
+        return;
+    }
+    int start = y0 * sur->w;
+    const uint8_t *src = (const uint8_t*)sur->data + start;
+    dst += start * 4;
+    int size = (y1 - y0) * sur->w;
+    if(sur->stencil != NULL) {
+        lut_convert(src, (const uint8_t*)sur->stencil + start, dst, lut, size);
+        return;
+    }
+
+    // Packed stencils are expanded a chunk at a time for the kernels
+    char stencil[1024];
+    for(int i = 0; i < size; i += sizeof(stencil)) {
+        int count = min2(size - i, sizeof(stencil));
+        surface_read_stencil(sur, stencil, start + i, count);
+        lut_convert(src + i, (const uint8_t*)stencil, dst + i * 4, lut, count);
+    }
 }
 
 // Creates a new RGBA surface
@@ -267,28 +1065,26 @@ void surface_to_rgba(surface *sur,
 
     if(sur->type == SURFACE_TYPE_RGBA) {
         memcpy(dst, sur->data, sur->w * sur->h * 4);
-    } else {
-        int n = 0;
-        uint8_t idx = 0;
+        return;
+    }
+    if(sur->type == SURFACE_TYPE_ALPHA) {
+        // Clear pixels stay black, so that scalers see the same as before
         for(int i = 0; i < sur->w * sur->h; i++) {
-            n = i * 4;
-            if(remap_table != NULL) {
-                idx = (uint8_t)remap_table[(uint8_t)sur->data[i]];
-            } else {
-                idx = (uint8_t)sur->data[i];
-            }
-            // TODO: This is kind of a hack. Since the pal_offset
-            // is only ever used for player 2 har, we can safely
-            // make some assumptions. therefore, only apply offset,
-            // if the color we are handling is between 0 and 48 (har colors).
-            if(idx < 48) {
-                idx += pal_offset;
-            }
-            *(dst + n + 0) = pal->data[idx][0];
-            *(dst + n + 1) = pal->data[idx][1];
-            *(dst + n + 2) = pal->data[idx][2];
-            *(dst + n + 3) = (sur->stencil[i] == 1) ? 0xFF : 0;
+            char v = (sur->data[i] != 0) ? 0xFF : 0;
+            dst[i * 4 + 0] = v;
+            dst[i * 4 + 1] = v;
+            dst[i * 4 + 2] = v;
+            dst[i * 4 + 3] = sur->data[i];
         }
+        return;
+    }
+    const palette_lut *player_lut = (remap_table == NULL) ? screen_palette_get_lut(pal, pal_offset) : NULL;
+    if(player_lut != NULL) {
+        surface_to_rgba_lut(sur, dst, player_lut);
+    } else {
+        palette_lut lut;
+        surface_build_lut(&lut, pal, remap_table, pal_offset);
+        surface_to_rgba_lut(sur, dst, &lut);
     }
 }
 
@@ -1,182 +1,1076 @@
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include "video/tcache.h"
+#include "video/scaler_pool.h"
+#include "video/scale_cache.h"
 #include "utils/hashmap.h"
+#include "utils/jobs.h"
 #include "utils/log.h"
+#include "utils/memtrack.h"
+#include "utils/profiler.h"
+#include "utils/trace.h"
+#include "utils/vector.h"
 
-#define CACHE_LIFETIME 300
+// Default texture memory budget, and the minimum number of ticks an entry
+// has to stay unused before it may be evicted.
+#define CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define CACHE_MIN_IDLE_TICKS 10
+
+// Default memory budget for the converted pixels kept for tcache_reinit
+#define CACHE_DEFAULT_COPY_BUDGET (32 * 1024 * 1024)
+
+// Atlas page settings. Surfaces that don't fit on a page get a texture of their own.
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_MAX_PAGES 8
+#define ATLAS_MAX_SHELVES 64
+#define ATLAS_PADDING 1
+
+// Number of palette lookup tables kept around. Usually only a couple
+// of palette offset / remap combinations are in use at the same time.
+#define LUT_CACHE_SIZE 4
+
+// Staging memory for the textures built at once by tcache_resolve. Bursts that
+// need more are built in several rounds.
+#define CACHE_STAGING_MAX (16 * 1024 * 1024)
+
+// Textures of a scene that was left, destroyed per tick. See tcache_retire.
+#define CACHE_RETIRE_PER_TICK 16
 
 typedef struct tcache_entry_key_t {
-    surface *c_surface;
+    char *c_data; // Shared sprite copies share their buffers, and so their texture
     char *c_remap_table;
     uint16_t w,h;
     uint8_t c_pal_offset;
 } tcache_entry_key;
 
-typedef struct tcache_entry_value_t {
+typedef struct tcache_shelf_t {
+    int y;
+    int h;
+    int x;
+} tcache_shelf;
+
+typedef struct tcache_page_t {
     SDL_Texture *tex;
-    unsigned int age;
+    tcache_shelf shelves[ATLAS_MAX_SHELVES];
+    int shelf_count;
+    int next_y;
+    unsigned int entries;
+} tcache_page;
+
+typedef struct tcache_entry_value_t tcache_entry_value;
+
+struct tcache_entry_value_t {
+    SDL_Texture *tex;
+    SDL_Rect rect;
+    int page; // Page index, or -1 if the entry owns its texture
+    unsigned int bytes;
+    unsigned int last_use;
+    unsigned int pal_version;
+    palette_mask pal_used; // Palette indexes the texture depends on
+    char *copy; // Converted and scaled pixels, for uploading again after a renderer reset
+    uint8_t pinned; // Never evicted, see tcache_get_static
+    uint8_t streaming; // Owns a streaming texture, see tcache_make_streaming
+    uint8_t pending; // Texture not built yet, see tcache_resolve
+    unsigned int frame; // Last frame the entry was used in
+    tcache_entry_key key;
+    tcache_entry_value *prev; // Towards most recently used
+    tcache_entry_value *next; // Towards least recently used
+};
+
+typedef struct tcache_lut_t {
+    int valid;
     unsigned int pal_version;
-} tcache_entry_value;
+    char *remap_table;
+    uint8_t pal_offset;
+    palette_lut lut;
+} tcache_lut;
+
+// Conversion and scaling of a surface into the pixels of its texture.
+// Everything it needs from the cache and the palette lookup tables is copied
+// in when it is set up, so that it can run on any thread.
+typedef struct tcache_build_t {
+    tcache_entry_value *val; // NULL if the entry was dropped before the build ran
+    surface *sur;
+    screen_palette *pal;
+    char *remap_table;
+    uint8_t pal_offset;
+    uint8_t scale_factor;
+    scaler_plugin *scaler;
+    int tex_w;
+    int tex_h;
+    uint64_t scale_key; // tcache_scale_key, or 0 without the disk cache
+    palette_lut lut;
+    unsigned int bytes; // Of buf
+    char *buf; // The texture pixels end up at the start
+} tcache_build;
 
 typedef struct tcache_t {
     hashmap entries;
+    vector pending; // tcache_build, in the order the misses happened
+    vector retired; // SDL_Texture*, still to be destroyed
+    int deferring; // Set between tcache_begin_frame and tcache_end_frame
+    unsigned int frame;
+    tcache_lut luts[LUT_CACHE_SIZE];
+    int next_lut;
+    tcache_entry_value *lru_head;
+    tcache_entry_value *lru_tail;
+    unsigned int bytes_used;
+    unsigned int byte_budget;
+    unsigned int copy_bytes;
+    unsigned int copy_budget;
+    unsigned int ticks;
+    tcache_page pages[ATLAS_MAX_PAGES];
+    int page_size;
+    char *scratch;
+    unsigned int scratch_size;
     unsigned int hits;
     unsigned int misses;
-    unsigned int old_frees;
+    unsigned int warmed;
+    unsigned int evictions;
+    unsigned int page_resets;
+    unsigned int reuploads;
+    unsigned int streaming;
+    int warming; // Set while tcache_warm runs, so its work isn't counted as misses
     uint8_t scale_factor;
     scaler_plugin *scaler;
+    base_plugin *scaler_base; // The plugin the scaler had when textures were made
     SDL_Renderer *renderer;
+    tcache_flush_hook flush_hook;
+    void *flush_userdata;
 } tcache;
 
 static tcache *cache = NULL;
 
+HASHMAP_DEFINE(tcache_map, tcache_entry_key, tcache_entry_value)
+
 // Helper method for getting cache entry
 tcache_entry_value* tcache_add_entry(tcache_entry_key *key, tcache_entry_value *val) {
-    return hashmap_put(&cache->entries,
-                      (void*)key, sizeof(tcache_entry_key),
-                      (void*)val, sizeof(tcache_entry_value));
+    return tcache_map_put(&cache->entries, key, val);
 }
 
 // Helper method for setting cache entry
 tcache_entry_value* tcache_get_entry(tcache_entry_key *key) {
-    tcache_entry_value *val = NULL;
-    unsigned int tmp_size;
-    hashmap_get(&cache->entries,
-                (void*)key, sizeof(tcache_entry_key),
-                (void**)&val, &tmp_size);
-    return val;
+    return tcache_map_get(&cache->entries, key);
+}
+
+static void tcache_lru_unlink(tcache_entry_value *val) {
+    if(val->prev != NULL) {
+        val->prev->next = val->next;
+    } else {
+        cache->lru_head = val->next;
+    }
+    if(val->next != NULL) {
+        val->next->prev = val->prev;
+    } else {
+        cache->lru_tail = val->prev;
+    }
+    val->prev = NULL;
+    val->next = NULL;
+}
+
+static void tcache_lru_push(tcache_entry_value *val) {
+    val->prev = NULL;
+    val->next = cache->lru_head;
+    if(cache->lru_head != NULL) {
+        cache->lru_head->prev = val;
+    } else {
+        cache->lru_tail = val;
+    }
+    cache->lru_head = val;
+}
+
+// Marks the entry as the most recently used one
+static void tcache_touch(tcache_entry_value *val) {
+    val->last_use = cache->ticks;
+    val->frame = cache->frame;
+    if(!val->pinned && cache->lru_head != val) {
+        tcache_lru_unlink(val);
+        tcache_lru_push(val);
+    }
+}
+
+static void tcache_page_reset(tcache_page *page) {
+    page->shelf_count = 0;
+    page->next_y = 0;
+    page->entries = 0;
+}
+
+static void tcache_pages_free() {
+    for(int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if(cache->pages[i].tex != NULL) {
+            SDL_DestroyTexture(cache->pages[i].tex);
+            cache->pages[i].tex = NULL;
+        }
+        tcache_page_reset(&cache->pages[i]);
+    }
+}
+
+// Find out how large atlas pages this renderer can handle
+static void tcache_set_page_size() {
+    SDL_RendererInfo rinfo;
+    cache->page_size = ATLAS_PAGE_SIZE;
+    if(SDL_GetRendererInfo(cache->renderer, &rinfo) == 0) {
+        if(rinfo.max_texture_width > 0 && rinfo.max_texture_width < cache->page_size) {
+            cache->page_size = rinfo.max_texture_width;
+        }
+        if(rinfo.max_texture_height > 0 && rinfo.max_texture_height < cache->page_size) {
+            cache->page_size = rinfo.max_texture_height;
+        }
+    }
+}
+
+// Finds a place for a w*h rectangle from the given page using a simple shelf packer.
+// Returns 0 on success, 1 if the rectangle doesn't fit.
+static int tcache_page_pack(tcache_page *page, int page_size, int w, int h, SDL_Rect *out) {
+    int pw = w + ATLAS_PADDING;
+    int ph = h + ATLAS_PADDING;
+
+    // Try to find the shelf that wastes the least height
+    tcache_shelf *best = NULL;
+    for(int i = 0; i < page->shelf_count; i++) {
+        tcache_shelf *s = &page->shelves[i];
+        if(s->h >= ph && s->x + pw <= page_size) {
+            if(best == NULL || s->h < best->h) {
+                best = s;
+            }
+        }
+    }
+
+    // No fitting shelf, so open up a new one (if there is room)
+    if(best == NULL) {
+        if(page->shelf_count >= ATLAS_MAX_SHELVES || page->next_y + ph > page_size || pw > page_size) {
+            return 1;
+        }
+        best = &page->shelves[page->shelf_count++];
+        best->y = page->next_y;
+        best->h = ph;
+        best->x = 0;
+        page->next_y += ph;
+    }
+
+    out->x = best->x;
+    out->y = best->y;
+    out->w = w;
+    out->h = h;
+    best->x += pw;
+    page->entries++;
+    return 0;
+}
+
+// Reserves space for the entry from the atlas. If the surface is too large for
+// the atlas or the atlas is full, a separate texture is created for the entry.
+// Textures are static, written with SDL_UpdateTexture only, unless the entry
+// is known to change often; streaming ones always get a texture of their own.
+static void tcache_alloc_entry(tcache_entry_value *val, int w, int h, int own, int streaming) {
+    val->streaming = streaming;
+    for(int i = 0; !own && !streaming && i < ATLAS_MAX_PAGES; i++) {
+        tcache_page *page = &cache->pages[i];
+        if(page->tex == NULL) {
+            page->tex = SDL_CreateTexture(cache->renderer,
+                                          SDL_PIXELFORMAT_ABGR8888,
+                                          SDL_TEXTUREACCESS_STATIC,
+                                          cache->page_size,
+                                          cache->page_size);
+            if(page->tex == NULL) {
+                PERROR("Unable to create texture atlas page: %s", SDL_GetError());
+                break;
+            }
+            SDL_SetTextureBlendMode(page->tex, SDL_BLENDMODE_BLEND);
+            tcache_page_reset(page);
+            DEBUG("Texture atlas page %d created (%dx%d).", i, cache->page_size, cache->page_size);
+        }
+        if(tcache_page_pack(page, cache->page_size, w, h, &val->rect) == 0) {
+            val->tex = page->tex;
+            val->page = i;
+            return;
+        }
+    }
+
+    val->page = -1;
+    val->rect.x = 0;
+    val->rect.y = 0;
+    val->rect.w = w;
+    val->rect.h = h;
+    val->tex = SDL_CreateTexture(cache->renderer,
+                                 SDL_PIXELFORMAT_ABGR8888,
+                                 streaming ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC,
+                                 w, h);
+    SDL_SetTextureBlendMode(val->tex, SDL_BLENDMODE_BLEND);
+}
+
+// Releases the space reserved by the entry. Atlas pages are recycled
+// once all entries on them have been released.
+static void tcache_free_entry(tcache_entry_value *val) {
+    if(val->page < 0) {
+        SDL_DestroyTexture(val->tex);
+        return;
+    }
+    tcache_page *page = &cache->pages[val->page];
+    if(page->entries > 0 && --page->entries == 0) {
+        tcache_page_reset(page);
+        cache->page_resets++;
+    }
+}
+
+static void tcache_free_copy(tcache_entry_value *val) {
+    if(val->copy != NULL) {
+        mem_free(val->copy);
+        val->copy = NULL;
+        cache->copy_bytes -= val->bytes;
+    }
+}
+
+// Keeps the pixels just uploaded to the entry, if the copy budget allows
+static void tcache_keep_copy(tcache_entry_value *val, const char *pixels) {
+    if(val->copy == NULL) {
+        if(cache->copy_bytes + val->bytes > cache->copy_budget) {
+            return;
+        }
+        val->copy = mem_malloc(MEM_TAG_TCACHE, val->bytes);
+        cache->copy_bytes += val->bytes;
+    }
+    memcpy(val->copy, pixels, val->bytes);
+}
+
+// An entry that has to be built again, because its surface or the palette
+// colors it uses changed, is likely to keep changing, eg. during palette
+// fades. Static textures are slow to rewrite on some drivers, so the entry
+// moves to a streaming texture of its own. If that can't be had, the old
+// texture stays.
+static void tcache_make_streaming(tcache_entry_value *val) {
+    SDL_Texture *tex = SDL_CreateTexture(cache->renderer,
+                                         SDL_PIXELFORMAT_ABGR8888,
+                                         SDL_TEXTUREACCESS_STREAMING,
+                                         val->rect.w, val->rect.h);
+    if(tex == NULL) {
+        return;
+    }
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    tcache_free_entry(val);
+    val->tex = tex;
+    val->page = -1;
+    val->rect.x = 0;
+    val->rect.y = 0;
+    val->streaming = 1;
+    cache->streaming++;
+}
+
+// Drops the entry from the cache and releases its texture memory
+static void tcache_evict(tcache_entry_value *val) {
+    tcache_entry_key key;
+    memcpy(&key, &val->key, sizeof(tcache_entry_key));
+    if(val->pending) {
+        iterator it;
+        tcache_build *b;
+        vector_iter_begin(&cache->pending, &it);
+        while((b = iter_next(&it)) != NULL) {
+            if(b->val == val) {
+                b->val = NULL;
+            }
+        }
+    }
+    tcache_lru_unlink(val);
+    tcache_free_entry(val);
+    tcache_free_copy(val);
+    cache->bytes_used -= val->bytes;
+    cache->evictions++;
+    tcache_map_del(&cache->entries, &key);
+}
+
+// Returns a lookup table for the given palette state. Tables are rebuilt
+// only when the palette version changes.
+static const palette_lut* tcache_get_lut(screen_palette *pal, char *remap_table, uint8_t pal_offset) {
+    // Plain player colors are kept by the palette itself
+    if(remap_table == NULL) {
+        const palette_lut *lut = screen_palette_get_lut(pal, pal_offset);
+        if(lut != NULL) {
+            return lut;
+        }
+    }
+    for(int i = 0; i < LUT_CACHE_SIZE; i++) {
+        tcache_lut *l = &cache->luts[i];
+        if(l->valid
+            && l->pal_version == pal->version
+            && l->remap_table == remap_table
+            && l->pal_offset == pal_offset) {
+            return &l->lut;
+        }
+    }
+    tcache_lut *l = &cache->luts[cache->next_lut];
+    cache->next_lut = (cache->next_lut + 1) % LUT_CACHE_SIZE;
+    surface_build_lut(&l->lut, pal, remap_table, pal_offset);
+    l->valid = 1;
+    l->pal_version = pal->version;
+    l->remap_table = remap_table;
+    l->pal_offset = pal_offset;
+    return &l->lut;
+}
+
+// Finds out which palette indexes the converted surface depends on, after remapping
+static void tcache_pal_used(surface *sur, char *remap_table, uint8_t pal_offset, palette_mask *out) {
+    if(sur->type != SURFACE_TYPE_PALETTE) {
+        palette_mask_clear(out);
+        return;
+    }
+    if(sur->pal_used == NULL) {
+        palette_mask_fill(out);
+        return;
+    }
+    palette_mask_clear(out);
+    for(int i = 0; i < 256; i++) {
+        if(!palette_mask_get(sur->pal_used, i)) {
+            continue;
+        }
+        uint8_t idx = (remap_table != NULL) ? (uint8_t)remap_table[i] : (uint8_t)i;
+        palette_mask_set(out, palette_bank_index(idx, pal_offset));
+    }
+}
+
+// Disk cache key of a w*h surface scaled with the current scaler, before the pixels
+static uint64_t tcache_scale_key(int w, int h) {
+    const char *name = (cache->scaler != NULL && cache->scaler->base != NULL) ? cache->scaler->base->name : "";
+    return scale_cache_key(name, cache->scale_factor, w, h);
+}
+
+// Returns a scratch buffer of at least size bytes
+static char* tcache_scratch(unsigned int size) {
+    if(cache->scratch_size < size) {
+        mem_free(cache->scratch);
+        cache->scratch = mem_malloc(MEM_TAG_TCACHE, size);
+        cache->scratch_size = size;
+    }
+    return cache->scratch;
+}
+
+static int tcache_scales_index(const surface *sur) {
+    return cache->scale_factor > 1 && sur->type == SURFACE_TYPE_PALETTE && scaler_has_scale_index(cache->scaler);
+}
+
+// Takes what building the texture of the entry needs, see tcache_build
+static void tcache_build_setup(tcache_build *b,
+                               tcache_entry_value *val,
+                               surface *sur,
+                               screen_palette *pal,
+                               char *remap_table,
+                               uint8_t pal_offset) {
+    b->val = val;
+    b->sur = sur;
+    b->pal = pal;
+    b->remap_table = remap_table;
+    b->pal_offset = pal_offset;
+    b->scale_factor = cache->scale_factor;
+    b->scaler = cache->scaler;
+    b->tex_w = sur->w * cache->scale_factor;
+    b->tex_h = sur->h * cache->scale_factor;
+    b->scale_key = scale_cache_is_open() ? tcache_scale_key(sur->w, sur->h) : 0;
+    if(sur->type == SURFACE_TYPE_PALETTE) {
+        memcpy(&b->lut, tcache_get_lut(pal, remap_table, pal_offset), sizeof(palette_lut));
+    }
+    // Both the unscaled and the scaled image are carved from the same block
+    unsigned int tex_px = b->tex_w * b->tex_h;
+    unsigned int px = sur->w * sur->h;
+    if(tcache_scales_index(sur)) {
+        b->bytes = tex_px * 6 + px * 2;
+    } else if(cache->scale_factor > 1) {
+        b->bytes = tex_px * 4 + px * 4;
+    } else {
+        b->bytes = tex_px * 4;
+    }
+    // Keeps the blocks carved from the staging memory aligned
+    b->bytes = (b->bytes + 15) & ~15u;
+    b->buf = NULL;
+}
+
+// Converts the surface to RGBA. Alpha surfaces become white, and are tinted when drawn.
+static void tcache_build_convert(const tcache_build *b, surface *sur, char *dst) {
+    if(sur->type != SURFACE_TYPE_PALETTE) {
+        surface_to_rgba(sur, dst, b->pal, b->remap_table, b->pal_offset);
+    } else {
+        surface_to_rgba_lut(sur, dst, &b->lut);
+    }
+}
+
+// Fills b->buf with the texture pixels. May run on any thread.
+static void tcache_build_run(void *userdata) {
+    tcache_build *b = userdata;
+    surface *sur = b->sur;
+    int tex_w = b->tex_w;
+    int tex_h = b->tex_h;
+    char *pixels = b->buf;
+    if(b->scale_factor > 1 && sur->type == SURFACE_TYPE_PALETTE && scaler_has_scale_index(b->scaler)) {
+        // Scale the palette indexes and convert the result, behind the RGBA part of the block
+        const char *stencil = sur->stencil;
+        if(stencil == NULL) {
+            surface_read_stencil(sur, pixels + tex_w * tex_h * 6, 0, sur->w * sur->h);
+            stencil = pixels + tex_w * tex_h * 6;
+        }
+        const char *indexes = sur->data;
+        if(sur->rle_pixels) {
+            char *expanded = pixels + tex_w * tex_h * 6 + sur->w * sur->h;
+            surface_read_pixels(sur, expanded, 0, sur->w * sur->h);
+            indexes = expanded;
+        }
+        surface scaled;
+        memset(&scaled, 0, sizeof(surface));
+        scaled.w = tex_w;
+        scaled.h = tex_h;
+        scaled.type = SURFACE_TYPE_PALETTE;
+        scaled.data = pixels + tex_w * tex_h * 4;
+        scaled.stencil = scaled.data + tex_w * tex_h;
+        // The scaled indexes don't depend on the palette, so one disk cache entry serves all of them
+        uint64_t disk_key = 0;
+        const char *stored = NULL;
+        if(b->scale_key != 0) {
+            disk_key = scale_cache_key_add(b->scale_key, indexes, sur->w * sur->h);
+            disk_key = scale_cache_key_add(disk_key, stencil, sur->w * sur->h);
+            stored = scale_cache_find(disk_key, tex_w * tex_h * 2);
+        }
+        if(stored != NULL) {
+            memcpy(scaled.data, stored, tex_w * tex_h * 2);
+        } else {
+            trace_begin("video", "scale");
+            scaler_scale_index(b->scaler, indexes, stencil, scaled.data, scaled.stencil,
+                               sur->w, sur->h, b->scale_factor, 0, sur->h);
+            trace_end("video", "scale");
+            if(b->scale_key != 0) {
+                scale_cache_add(disk_key, scaled.data, tex_w * tex_h * 2);
+            }
+        }
+        tcache_build_convert(b, &scaled, pixels);
+    } else if(b->scale_factor > 1) {
+        char *raw = pixels + tex_w * tex_h * 4;
+        tcache_build_convert(b, sur, raw);
+        uint64_t disk_key = 0;
+        const char *stored = NULL;
+        if(b->scale_key != 0) {
+            disk_key = scale_cache_key_add(b->scale_key, raw, sur->w * sur->h * 4);
+            stored = scale_cache_find(disk_key, tex_w * tex_h * 4);
+        }
+        if(stored != NULL) {
+            memcpy(pixels, stored, tex_w * tex_h * 4);
+        } else {
+            trace_begin("video", "scale");
+            scaler_pool_scale(b->scaler, raw, pixels, sur->w, sur->h, b->scale_factor);
+            trace_end("video", "scale");
+            if(b->scale_key != 0) {
+                scale_cache_add(disk_key, pixels, tex_w * tex_h * 4);
+            }
+        }
+    } else {
+        tcache_build_convert(b, sur, pixels);
+    }
+}
+
+// Puts the built pixels in the entry's texture. Main thread only.
+static void tcache_build_upload(tcache_build *b) {
+    tcache_entry_value *val = b->val;
+    if(SDL_UpdateTexture(val->tex, &val->rect, b->buf, b->tex_w * 4) != 0) {
+        PERROR("Failed to update texture (ptr: %p) for writing: %s", val->tex, SDL_GetError());
+    }
+    if(cache->copy_budget > 0) {
+        tcache_keep_copy(val, b->buf);
+    }
+    val->pending = 0;
 }
 
 void tcache_init(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler) {
     cache = malloc(sizeof(tcache));
-    hashmap_create(&cache->entries, 6);
+    hashmap_create_with_allocator(&cache->entries, 6, mem_allocator(MEM_TAG_TCACHE));
+    vector_create(&cache->pending, sizeof(tcache_build));
+    vector_create(&cache->retired, sizeof(SDL_Texture*));
+    cache->deferring = 0;
+    cache->frame = 0;
     cache->renderer = renderer;
     cache->scaler = scaler;
+    cache->scaler_base = (scaler != NULL) ? scaler->base : NULL;
     cache->scale_factor = scale_factor;
+    cache->scratch = NULL;
+    cache->scratch_size = 0;
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->bytes_used = 0;
+    cache->byte_budget = CACHE_DEFAULT_BUDGET;
+    cache->copy_bytes = 0;
+    cache->copy_budget = CACHE_DEFAULT_COPY_BUDGET;
+    cache->ticks = 0;
     cache->hits = 0;
-    cache->old_frees = 0;
+    cache->evictions = 0;
     cache->misses = 0;
+    cache->warmed = 0;
+    cache->warming = 0;
+    cache->page_resets = 0;
+    cache->reuploads = 0;
+    cache->next_lut = 0;
+    cache->flush_hook = NULL;
+    cache->flush_userdata = NULL;
+    for(int i = 0; i < LUT_CACHE_SIZE; i++) {
+        cache->luts[i].valid = 0;
+    }
+    for(int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        cache->pages[i].tex = NULL;
+        tcache_page_reset(&cache->pages[i]);
+    }
+    tcache_set_page_size();
     DEBUG("Texture cache initialized.");
 }
 
+// Destroys up to max retired textures, from the end so that nothing moves
+static void tcache_destroy_retired(unsigned int max) {
+    iterator it;
+    SDL_Texture **tex;
+    vector_iter_end(&cache->retired, &it);
+    while(max-- > 0 && (tex = iter_prev(&it)) != NULL) {
+        SDL_DestroyTexture(*tex);
+        vector_delete(&cache->retired, &it);
+    }
+}
+
+// Releases all textures before the renderer goes away. Entries that have a
+// copy of their pixels stay in the cache, so that tcache_reinit can upload
+// them to the new renderer without converting and scaling them again.
+void tcache_release() {
+    if(cache == NULL) {
+        return;
+    }
+    tcache_destroy_retired(UINT_MAX);
+    vector_clear(&cache->pending);
+    iterator it;
+    hashmap_iter_begin(&cache->entries, &it);
+    hashmap_pair *pair;
+    while((pair = iter_next(&it)) != NULL) {
+        tcache_entry_value *entry = pair->val;
+        if(entry->page < 0 && entry->tex != NULL) {
+            SDL_DestroyTexture(entry->tex);
+        }
+        entry->tex = NULL;
+        // Textures that were never built have nothing worth keeping
+        if(entry->pending) {
+            tcache_free_copy(entry);
+            entry->pending = 0;
+        }
+        if(entry->copy == NULL) {
+            if(!entry->pinned) {
+                tcache_lru_unlink(entry);
+            }
+            cache->bytes_used -= entry->bytes;
+            hashmap_delete(&cache->entries, &it);
+        }
+    }
+    tcache_pages_free();
+}
+
 void tcache_reinit(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler) {
+    // The copies are only good for the scaling they were made with
+    int same_scaling = (cache->scale_factor == scale_factor && cache->scaler == scaler
+                        && (scaler == NULL || cache->scaler_base == scaler->base));
+    tcache_release();
     cache->renderer = renderer;
     cache->scaler = scaler;
+    cache->scaler_base = (scaler != NULL) ? scaler->base : NULL;
     cache->scale_factor = scale_factor;
-    tcache_clear();
+    tcache_set_page_size();
+    if(!same_scaling) {
+        tcache_clear();
+        return;
+    }
+
+    // Put everything back in one go. Entries go back in the order they are
+    // found in, so the atlas pages may end up packed a little differently.
+    trace_begin("video", "tcache reupload");
+    iterator it;
+    hashmap_iter_begin(&cache->entries, &it);
+    hashmap_pair *pair;
+    while((pair = iter_next(&it)) != NULL) {
+        tcache_entry_value *entry = pair->val;
+        int w = entry->rect.w;
+        int h = entry->rect.h;
+        tcache_alloc_entry(entry, w, h, entry->pinned, entry->streaming);
+        if(entry->tex == NULL || SDL_UpdateTexture(entry->tex, &entry->rect, entry->copy, w * 4) != 0) {
+            PERROR("Unable to upload texture again: %s", SDL_GetError());
+            if(entry->tex != NULL) {
+                tcache_free_entry(entry);
+            }
+            if(!entry->pinned) {
+                tcache_lru_unlink(entry);
+            }
+            tcache_free_copy(entry);
+            cache->bytes_used -= entry->bytes;
+            hashmap_delete(&cache->entries, &it);
+            continue;
+        }
+        cache->reuploads++;
+    }
+    trace_end("video", "tcache reupload");
+    DEBUG("Texture cache uploaded %d textures again.", hashmap_reserved(&cache->entries));
 }
 
 void tcache_clear() {
+    // Nothing to clear when running without a renderer
+    if(cache == NULL) {
+        return;
+    }
+    tcache_destroy_retired(UINT_MAX);
     iterator it;
     hashmap_iter_begin(&cache->entries, &it);
     hashmap_pair *pair;
     while((pair = iter_next(&it)) != NULL) {
         tcache_entry_value *entry = pair->val;
-        SDL_DestroyTexture(entry->tex);
+        if(entry->page < 0 && entry->tex != NULL) {
+            SDL_DestroyTexture(entry->tex);
+        }
+        if(entry->copy != NULL) {
+            mem_free(entry->copy);
+        }
     }
     hashmap_clear(&cache->entries);
+    vector_clear(&cache->pending);
+    cache->copy_bytes = 0;
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->bytes_used = 0;
+
+    // Atlas pages are owned by the renderer, so they must be released here too;
+    // tcache_clear is always called before the renderer is destroyed.
+    tcache_pages_free();
 }
 
-void tcache_tick() {
+// For scene changes. Empties the cache like tcache_clear, but the atlas pages
+// are kept for the next scene to pack its sprites into, and textures of their
+// own are destroyed a few per tick instead of all at once.
+void tcache_retire() {
+    if(cache == NULL) {
+        return;
+    }
     iterator it;
     hashmap_iter_begin(&cache->entries, &it);
     hashmap_pair *pair;
     while((pair = iter_next(&it)) != NULL) {
         tcache_entry_value *entry = pair->val;
-        entry->age++;
-        if(entry->age > CACHE_LIFETIME) {
-            SDL_DestroyTexture(entry->tex);
-            hashmap_delete(&cache->entries, &it);
-            cache->old_frees++;
+        if(entry->page < 0 && entry->tex != NULL) {
+            vector_append(&cache->retired, &entry->tex);
+        }
+        if(entry->copy != NULL) {
+            mem_free(entry->copy);
         }
     }
+    hashmap_clear(&cache->entries);
+    vector_clear(&cache->pending);
+    cache->copy_bytes = 0;
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->bytes_used = 0;
+    for(int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        tcache_page_reset(&cache->pages[i]);
+    }
+}
+
+void tcache_set_flush_hook(tcache_flush_hook hook, void *userdata) {
+    cache->flush_hook = hook;
+    cache->flush_userdata = userdata;
+}
+
+void tcache_set_budget(unsigned int bytes) {
+    cache->byte_budget = bytes;
+    DEBUG("Texture cache budget set to %u bytes.", bytes);
+}
+
+void tcache_set_copy_budget(unsigned int bytes) {
+    cache->copy_budget = bytes;
+
+    // Copies already over the new budget are dropped, oldest use first
+    tcache_entry_value *val = cache->lru_tail;
+    while(cache->copy_bytes > cache->copy_budget && val != NULL) {
+        tcache_free_copy(val);
+        val = val->prev;
+    }
+    if(cache->copy_bytes > cache->copy_budget) {
+        iterator it;
+        hashmap_iter_begin(&cache->entries, &it);
+        hashmap_pair *pair;
+        while(cache->copy_bytes > cache->copy_budget && (pair = iter_next(&it)) != NULL) {
+            tcache_free_copy(pair->val);
+        }
+    }
+    DEBUG("Texture copy budget set to %u bytes.", bytes);
+}
+
+void tcache_tick() {
+    cache->ticks++;
+    tcache_destroy_retired(CACHE_RETIRE_PER_TICK);
+
+    // Evict least recently used entries until we are within budget again.
+    // Entries that have been used very recently are left alone, since
+    // they are most likely going to be needed again on the next frame.
+    while(cache->bytes_used > cache->byte_budget && cache->lru_tail != NULL) {
+        if(cache->ticks - cache->lru_tail->last_use < CACHE_MIN_IDLE_TICKS) {
+            break;
+        }
+        tcache_evict(cache->lru_tail);
+    }
+}
+
+void tcache_begin_frame() {
+    if(cache == NULL) {
+        return;
+    }
+    cache->frame++;
+    cache->deferring = 1;
+}
+
+void tcache_resolve() {
+    if(cache == NULL || vector_size(&cache->pending) == 0) {
+        return;
+    }
+    trace_begin("video", "tcache resolve");
+    unsigned int count = vector_size(&cache->pending);
+    unsigned int start = 0;
+    while(start < count) {
+        // Take as many builds as fit in the staging memory, but at least one
+        unsigned int end = start;
+        unsigned int bytes = 0;
+        while(end < count) {
+            tcache_build *b = vector_get(&cache->pending, end);
+            if(end > start && bytes + b->bytes > CACHE_STAGING_MAX) {
+                break;
+            }
+            bytes += b->bytes;
+            end++;
+        }
+
+        // Build on the job system, then upload in order on this thread
+        char *staging = tcache_scratch(bytes);
+        job_counter done;
+        job_counter_init(&done);
+        for(unsigned int i = start; i < end; i++) {
+            tcache_build *b = vector_get(&cache->pending, i);
+            b->buf = staging;
+            staging += b->bytes;
+            if(b->val != NULL) {
+                jobs_run("tcache build", tcache_build_run, b, &done, 0);
+            }
+        }
+        jobs_wait(&done);
+        for(unsigned int i = start; i < end; i++) {
+            tcache_build *b = vector_get(&cache->pending, i);
+            if(b->val != NULL) {
+                tcache_build_upload(b);
+            }
+        }
+        start = end;
+    }
+    vector_clear(&cache->pending);
+    trace_end("video", "tcache resolve");
+}
+
+void tcache_end_frame() {
+    if(cache == NULL) {
+        return;
+    }
+    tcache_resolve();
+    cache->deferring = 0;
+}
+
+// Drops the textures made from the surface's pixels, eg. before they are freed
+void tcache_forget(surface *sur) {
+    if(cache == NULL || sur->data == NULL) {
+        return;
+    }
+    tcache_entry_value *val = cache->lru_head;
+    while(val != NULL) {
+        tcache_entry_value *next = val->next;
+        if(val->key.c_data == sur->data && !val->pinned) {
+            tcache_evict(val);
+        }
+        val = next;
+    }
+}
+
+void tcache_get_stats(tcache_stats *stats) {
+    memset(stats, 0, sizeof(tcache_stats));
+    if(cache == NULL) {
+        return;
+    }
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->warmed = cache->warmed;
+    stats->evictions = cache->evictions;
+    stats->bytes_used = cache->bytes_used;
+    stats->budget = cache->byte_budget;
+    stats->copy_bytes = cache->copy_bytes;
+    stats->reuploads = cache->reuploads;
+    stats->streaming = cache->streaming;
+    stats->entries = hashmap_reserved(&cache->entries);
 }
 
 void tcache_close() {
     DEBUG("Texture cache:");
-    DEBUG(" * Misses:    %d", cache->misses);
-    DEBUG(" * Hits:      %d", cache->hits);
-    DEBUG(" * Old frees: %d", cache->old_frees);
+    DEBUG(" * Misses:      %d", cache->misses);
+    DEBUG(" * Hits:        %d", cache->hits);
+    DEBUG(" * Warmed:      %d", cache->warmed);
+    DEBUG(" * Evictions:   %d", cache->evictions);
+    DEBUG(" * Page resets: %d", cache->page_resets);
+    DEBUG(" * Reuploads:   %d", cache->reuploads);
+    DEBUG(" * Streaming:   %d", cache->streaming);
     tcache_clear();
     hashmap_free(&cache->entries);
+    vector_free(&cache->pending);
+    vector_free(&cache->retired);
+    mem_free(cache->scratch);
     free(cache);
 }
 
-SDL_Texture* tcache_get(surface *sur,
-                        screen_palette *pal,
-                        char *remap_table,
-                        uint8_t pal_offset) {
+static SDL_Texture* tcache_lookup(surface *sur,
+                                  screen_palette *pal,
+                                  char *remap_table,
+                                  uint8_t pal_offset,
+                                  SDL_Rect *src_rect,
+                                  int pinned) {
 
     if(sur == NULL || sur->w == 0 || sur->h == 0 || sur->data == NULL) {
         if(sur != NULL) {
             DEBUG("Invalid surface requested from tcache: w,h = %d,%d data = %p", sur->w, sur->h, sur->data);
         } else {
-            DEBUG("Invalid surface requested from tcache: w,h = %d,%d surface = %p", sur->w, sur->h, sur);
+            DEBUG("Invalid surface requested from tcache: surface = %p", sur);
         }
         return NULL;
     }
 
+    // Sprites without any HAR colors look the same in every player's bank,
+    // so all players share one texture of them
+    if(remap_table == NULL && sur->pal_used != NULL && pal_offset != 0
+       && !palette_mask_any(sur->pal_used, 0, PLAYER_PALETTE_SIZE)) {
+        pal_offset = 0;
+    }
+
     // Form a key
     tcache_entry_key key;
     memset(&key, 0, sizeof(tcache_entry_key));
-    key.c_pal_offset = (sur->type == SURFACE_TYPE_RGBA) ? 0 : pal_offset;
-    key.c_remap_table = (sur->type == SURFACE_TYPE_RGBA) ? 0 : remap_table;
-    key.c_surface = sur;
+    key.c_pal_offset = (sur->type != SURFACE_TYPE_PALETTE) ? 0 : pal_offset;
+    key.c_remap_table = (sur->type != SURFACE_TYPE_PALETTE) ? 0 : remap_table;
+    key.c_data = sur->data;
     key.w = sur->w;
     key.h = sur->h;
 
     // Attempt to find appropriate surface
     // If surface is cacheable and hasn't changed, just return here.
+    // Palette changes only matter if they touch the indexes the texture was built from.
     tcache_entry_value *val = tcache_get_entry(&key);
-    if(val != NULL && (val->pal_version == pal->version || sur->type == SURFACE_TYPE_RGBA) && !sur->force_refresh) {
-        val->age = 0;
-        cache->hits++;
+    if(val != NULL && !sur->force_refresh && (sur->type != SURFACE_TYPE_PALETTE
+                                              || val->pal_version == pal->version
+                                              || !screen_palette_changed_since(pal, &val->pal_used, val->pal_version))) {
+        val->pal_version = pal->version;
+        tcache_touch(val);
+        if(!cache->warming) {
+            cache->hits++;
+            profiler_count(PROF_CNT_TCACHE_HITS, 1);
+        }
+        *src_rect = val->rect;
         return val->tex;
     }
 
-    // Reset refresh flag here
+    // Reset refresh flag here. New surfaces come with it set too, so it says
+    // nothing about how often one changes; only a rebuild below does.
     sur->force_refresh = 0;
+    trace_begin("video", "tcache miss");
 
     // If there was no fitting surface tex in the cache at all,
-    // then we need to create one
+    // then we need to reserve some space for one
+    int tex_w = sur->w * cache->scale_factor;
+    int tex_h = sur->h * cache->scale_factor;
+    int rebuild = (val != NULL);
     if(val == NULL) {
         tcache_entry_value new_entry;
-        new_entry.age = 0;
+        tcache_alloc_entry(&new_entry, tex_w, tex_h, pinned, 0);
+        if(new_entry.tex == NULL) {
+            PERROR("Unable to create texture for surface: %s", SDL_GetError());
+            trace_end("video", "tcache miss");
+            return NULL;
+        }
+        new_entry.bytes = tex_w * tex_h * 4;
+        new_entry.last_use = cache->ticks;
         new_entry.pal_version = pal->version;
-        new_entry.tex = SDL_CreateTexture(cache->renderer,
-                                          SDL_PIXELFORMAT_ABGR8888,
-                                          SDL_TEXTUREACCESS_STREAMING,
-                                          sur->w * cache->scale_factor,
-                                          sur->h * cache->scale_factor);
-        SDL_SetTextureBlendMode(new_entry.tex, SDL_BLENDMODE_BLEND);
+        new_entry.pinned = pinned;
+        new_entry.copy = NULL;
+        new_entry.pending = 0;
+        new_entry.frame = 0;
+        memcpy(&new_entry.key, &key, sizeof(tcache_entry_key));
         val = tcache_add_entry(&key, &new_entry);
+        if(!pinned) {
+            tcache_lru_push(val);
+        }
+        cache->bytes_used += val->bytes;
     }
 
-    // We have a texture either from the cache, or we just created one.
-    // Either one, it needs to be updated. Let's do it now.
-    // Also, scale surface if necessary
-    if(cache->scale_factor > 1) {
-        char *raw = malloc(sur->w * sur->h * 4);
-        surface scaled;
-        surface_create(&scaled,
-                       SURFACE_TYPE_RGBA,
-                       sur->w * cache->scale_factor,
-                       sur->h * cache->scale_factor);
-
-        surface_to_rgba(sur, raw, pal, remap_table, pal_offset);
-        scaler_scale(cache->scaler, raw, scaled.data, sur->w, sur->h, cache->scale_factor);
-        surface_to_texture(&scaled, val->tex, pal, remap_table, pal_offset);
-        surface_free(&scaled);
-        free(raw);
+    // We have a texture area either from the cache, or we just reserved one.
+    // Either one, it needs to be updated. During a frame that is left for
+    // tcache_resolve, which builds all of the frame's textures at once.
+    tcache_build build;
+    tcache_build_setup(&build, val, sur, pal, remap_table, pal_offset);
+    if(cache->deferring) {
+        // Commands queued earlier in the frame may still use the old contents
+        if(rebuild && val->frame == cache->frame && cache->flush_hook != NULL) {
+            cache->flush_hook(cache->flush_userdata);
+        }
+        if(rebuild && !val->streaming) {
+            tcache_make_streaming(val);
+        }
+        val->pending = 1;
+        vector_append(&cache->pending, &build);
     } else {
-        surface_to_texture(sur, val->tex, pal, remap_table, pal_offset);
+        build.buf = tcache_scratch(build.bytes);
+        tcache_build_run(&build);
+
+        // Anything queued for drawing must get out before we touch the texture
+        if(cache->flush_hook != NULL) {
+            cache->flush_hook(cache->flush_userdata);
+        }
+        if(rebuild && !val->streaming) {
+            tcache_make_streaming(val);
+        }
+        tcache_build_upload(&build);
     }
 
-    // Set correct age and palette version
-    val->age = 0;
+    // Set correct use time and palette version
+    tcache_touch(val);
     val->pal_version = pal->version;
+    tcache_pal_used(sur, remap_table, pal_offset, &val->pal_used);
 
     // Do some statistics stuff
-    cache->misses++;
+    if(cache->warming) {
+        cache->warmed++;
+        profiler_count(PROF_CNT_TCACHE_WARMED, 1);
+    } else {
+        cache->misses++;
+        profiler_count(PROF_CNT_TCACHE_MISSES, 1);
+    }
+    trace_end("video", "tcache miss");
+    *src_rect = val->rect;
     return val->tex;
 }
+
+SDL_Texture* tcache_get(surface *sur,
+                        screen_palette *pal,
+                        char *remap_table,
+                        uint8_t pal_offset,
+                        SDL_Rect *src_rect) {
+    return tcache_lookup(sur, pal, remap_table, pal_offset, src_rect, 0);
+}
+
+// For surfaces that are drawn on every frame, like scene backgrounds. The
+// texture is not put on an atlas page and is never evicted; it is only
+// rebuilt if the palette colors it uses or the surface itself change.
+SDL_Texture* tcache_get_static(surface *sur, screen_palette *pal, SDL_Rect *src_rect) {
+    return tcache_lookup(sur, pal, NULL, 0, src_rect, 1);
+}
+
+// Builds the texture tcache_get would return, ahead of its first use.
+// Returns 1 if a texture had to be built, 0 if it was cached already.
+int tcache_warm(surface *sur, screen_palette *pal, char *remap_table, uint8_t pal_offset) {
+    SDL_Rect src_rect;
+    unsigned int warmed = cache->warmed;
+    cache->warming = 1;
+    tcache_lookup(sur, pal, remap_table, pal_offset, &src_rect, 0);
+    cache->warming = 0;
+    return cache->warmed != warmed;
+}
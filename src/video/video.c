@@ -1,24 +1,123 @@
 #include <SDL2/SDL.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h> // strcasecmp
 
 #include "video/video.h"
 #include "video/image.h"
 #include "video/tcache.h"
+#include "video/screenshot.h"
 #include "utils/log.h"
+#include "utils/profiler.h"
+#include "utils/trace.h"
 #include "utils/list.h"
+#include "utils/vector.h"
 #include "resources/palette.h"
 #include "video/video_state.h"
 #include "video/video_hw.h"
 #include "video/video_soft.h"
+#include "video/video_null.h"
 #include "plugins/plugins.h"
 
 static video_state state;
+static Uint64 last_present = 0; // Performance counter at the last present
+
+// Area captures wait here until the frame they want has been presented.
+// Requests may come from the simulation thread, so the list is locked.
+#define MAX_AREA_CAPTURES 4
+
+typedef struct {
+    surface *sur;
+    int *ok;
+    SDL_Rect rect;
+} video_area_request;
+
+static video_area_request area_requests[MAX_AREA_CAPTURES];
+static int area_request_count = 0;
+static SDL_mutex *area_lock = NULL;
+static char *area_buf = NULL; // Reused readback buffer
+static int area_buf_size = 0;
+
+// Draw lists that sprite draws are currently being recorded into
+#define MAX_RECORDERS 8
+
+typedef struct {
+    surface *sur;
+    SDL_Rect src;
+    SDL_Rect dst;
+    SDL_BlendMode blend_mode;
+    int pal_offset;
+    SDL_RendererFlip flip_mode;
+    uint8_t opacity;
+    uint8_t has_src;
+    color tint;
+} video_draw_cmd;
+
+static video_draw_list *recorders[MAX_RECORDERS];
+static int recorder_count = 0;
+
+// Shadows are only ever cast near the floor, so the buffer covers the
+// bottom of the screen only. Each pixel counts the shadows on top of it.
+#define SHADOW_TOP 100
+#define SHADOW_H (NATIVE_H - SHADOW_TOP)
+#define SHADOW_OPACITY 50
+#define SHADOW_MAX_LAYERS 8
+
+static uint8_t *shadow_cover = NULL;
+static surface shadow_sur;
+static uint8_t shadow_alpha[SHADOW_MAX_LAYERS + 1];
+static int shadow_x0, shadow_y0, shadow_x1, shadow_y1; // Touched area, x1 and y1 exclusive
+
+static const char *frame_scaler_names[VIDEO_FRAME_SCALER_COUNT] = {"NEAREST", "LINEAR", "CRT"};
+
+const char* video_frame_scaler_name(int frame_scaler) {
+    if(frame_scaler < 0 || frame_scaler >= VIDEO_FRAME_SCALER_COUNT) {
+        return NULL;
+    }
+    return frame_scaler_names[frame_scaler];
+}
+
+// Returns the frame scaler with the given name, or -1
+int video_find_frame_scaler(const char *name) {
+    for(int i = 0; i < VIDEO_FRAME_SCALER_COUNT; i++) {
+        if(strcasecmp(name, frame_scaler_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Bright and dark half rows, stretched over the whole screen
+static void video_create_scanlines() {
+    state.scanlines = SDL_CreateTexture(state.renderer,
+                                        SDL_PIXELFORMAT_ABGR8888,
+                                        SDL_TEXTUREACCESS_STATIC,
+                                        1, NATIVE_H * 2);
+    if(state.scanlines == NULL) {
+        PERROR("Unable to create scanline texture: %s", SDL_GetError());
+        return;
+    }
+    uint32_t rows[NATIVE_H * 2];
+    for(int i = 0; i < NATIVE_H * 2; i++) {
+        uint8_t v = (i % 2) ? 0xA0 : 0xFF;
+        rows[i] = 0xFF000000 | (v << 16) | (v << 8) | v;
+    }
+    SDL_UpdateTexture(state.scanlines, NULL, rows, 4);
+    SDL_SetTextureBlendMode(state.scanlines, SDL_BLENDMODE_MOD);
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    SDL_SetTextureScaleMode(state.scanlines, SDL_ScaleModeNearest);
+#endif
+}
 
 void reset_targets() {
     if(state.target != NULL) {
         SDL_DestroyTexture(state.target);
     }
+    if(state.scanlines != NULL) {
+        SDL_DestroyTexture(state.scanlines);
+        state.scanlines = NULL;
+    }
     state.target = SDL_CreateTexture(state.renderer,
                                      SDL_PIXELFORMAT_ABGR8888,
                                      SDL_TEXTUREACCESS_TARGET,
@@ -31,10 +130,20 @@ void reset_targets() {
     memset(pixels, 0, size);
     SDL_UpdateTexture(state.target, NULL, pixels, NATIVE_W * state.scale_factor * 4);
     free(pixels);
+
+    // The frame is stretched to the window size when it is presented
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    SDL_SetTextureScaleMode(state.target, (state.frame_scaler > VIDEO_FRAME_SCALER_NEAREST)
+                                              ? SDL_ScaleModeLinear : SDL_ScaleModeNearest);
+#endif
+    if(state.frame_scaler == VIDEO_FRAME_SCALER_CRT) {
+        video_create_scanlines();
+    }
 }
 
 int video_load_scaler(const char* name, int scale_factor) {
     scaler_init(&state.scaler);
+    state.frame_scaler = video_find_frame_scaler(name);
     if(scale_factor <= 1) {
         return 0;
     }
@@ -47,6 +156,49 @@ int video_load_scaler(const char* name, int scale_factor) {
     return 0;
 }
 
+// Frame scalers draw everything at native size; plugins need the scaled size
+static void video_set_scaler(const char *name, int scale_factor) {
+    if(video_load_scaler(name, scale_factor) || state.frame_scaler >= 0) {
+        if(state.frame_scaler < 0) {
+            DEBUG("Scaler \"%s\" plugin not found; using Nearest neighbour scaling.", name);
+        } else {
+            DEBUG("Using %s frame scaling.", frame_scaler_names[state.frame_scaler]);
+        }
+        scaler_init(&state.scaler);
+        state.scale_factor = 1;
+    } else {
+        DEBUG("Scaler \"%s\" loaded w/ factor %d", name, scale_factor);
+        state.scale_factor = scale_factor;
+    }
+}
+
+static void video_alloc_palettes() {
+    state.cur_palette = malloc(sizeof(screen_palette));
+    state.ver_palette = malloc(sizeof(screen_palette));
+    state.base_palette = malloc(sizeof(palette));
+    memset(state.cur_palette, 0, sizeof(screen_palette));
+    memset(state.ver_palette, 0, sizeof(screen_palette));
+    state.cur_palette->version = 1;
+}
+
+// Sets up palette state only, without a window or a renderer. Scenes may
+// still call the rendering functions; they do nothing.
+int video_init_headless() {
+    memset(&state, 0, sizeof(video_state));
+    state.w = NATIVE_W;
+    state.h = NATIVE_H;
+    state.fade = 1.0f;
+    state.scale_factor = 1;
+    scaler_init(&state.scaler);
+    video_alloc_palettes();
+
+    state.cur_renderer = VIDEO_RENDERER_NULL;
+    video_null_init(&state);
+
+    INFO("Video Init OK (headless)");
+    return 0;
+}
+
 int video_init(int window_w,
                int window_h,
                int fullscreen,
@@ -59,24 +211,16 @@ int video_init(int window_w,
     state.vsync = vsync;
     state.fade = 1.0f;
     state.target = NULL;
+    state.scanlines = NULL;
     state.target_move_x = 0;
     state.target_move_y = 0;
 
     // Load scaler (if any)
     strcpy(state.scaler_name, scaler_name);
-    if(video_load_scaler(scaler_name, scale_factor)) {
-        DEBUG("Scaler \"%s\" plugin not found; using Nearest neighbour scaling.", scaler_name);
-        state.scale_factor = 1;
-    } else {
-        DEBUG("Scaler \"%s\" loaded w/ factor %d", scaler_name, scale_factor);
-        state.scale_factor = scale_factor;
-    }
+    video_set_scaler(scaler_name, scale_factor);
 
     // Clear palettes
-    state.cur_palette = malloc(sizeof(screen_palette));
-    state.base_palette = malloc(sizeof(palette));
-    memset(state.cur_palette, 0, sizeof(screen_palette));
-    state.cur_palette->version = 1;
+    video_alloc_palettes();
 
     // Form title string
     char title[32];
@@ -132,6 +276,7 @@ int video_init(int window_w,
 
     // Set rendertargets
     reset_targets();
+    area_lock = SDL_CreateMutex();
 
     // Init texture cache
     tcache_init(state.renderer, state.scale_factor, &state.scaler);
@@ -155,8 +300,9 @@ int video_init(int window_w,
 }
 
 void video_reinit_renderer() {
-    // Clear old texture cache entries
-    tcache_clear();
+    // Release renderer textures; tcache_reinit puts back what it can
+    tcache_release();
+    state.cb.render_reinit(&state);
 
     // Kill old renderer
     SDL_DestroyRenderer(state.renderer);
@@ -176,6 +322,8 @@ void video_reinit_renderer() {
     reset_targets();
 }
 
+// Changes what it can on the renderer that is there. Only a vsync change that
+// SDL can't make on a live renderer needs a new one.
 int video_reinit(int window_w,
                  int window_h,
                  int fullscreen,
@@ -183,18 +331,9 @@ int video_reinit(int window_w,
                  const char* scaler_name,
                  int scale_factor) {
 
-    // Tells if something has changed in video settings
+    // Tells if the window has changed
     int changed = 0;
 
-    // Check scaler
-    if(strcmp(scaler_name, state.scaler_name) != 0) {
-        strcpy(state.scaler_name, scaler_name);
-        changed = 1;
-    }
-    if(scale_factor != state.scale_factor) {
-        changed = 1;
-    }
-
     // Set window size if necessary
     if(window_w != state.w || window_h != state.h || fullscreen != state.fs) {
         SDL_SetWindowSize(state.window, window_w, window_h);
@@ -221,8 +360,13 @@ int video_reinit(int window_w,
     }
 
     // Check for vsync changes
+    int rebuild = 0;
     if(vsync != state.vsync) {
-        changed = 1;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        rebuild = SDL_RenderSetVSync(state.renderer, vsync) != 0;
+#else
+        rebuild = 1;
+#endif
     }
 
     // Set video state
@@ -231,17 +375,27 @@ int video_reinit(int window_w,
     state.w = window_w;
     state.h = window_h;
 
-    // Load scaler
-    if(video_load_scaler(scaler_name, scale_factor)) {
-        DEBUG("Scaler %s plugin not found; using Nearest neighbour scaling.");
-        state.scale_factor = 1;
-    } else {
-        DEBUG("Scaler %s loaded w/ factor %d", scaler_name, scale_factor);
-        state.scale_factor = scale_factor;
+    // Load scaler. Textures only need building again if the scaling changed.
+    int rescale = 0;
+    if(strcmp(scaler_name, state.scaler_name) != 0 || scale_factor != state.scale_factor) {
+        strcpy(state.scaler_name, scaler_name);
+        int old_factor = state.scale_factor;
+        base_plugin *old_base = state.scaler.base;
+        video_set_scaler(scaler_name, scale_factor);
+        rescale = state.scale_factor != old_factor || state.scaler.base != old_base;
+        if(!rebuild) {
+            if(rescale) {
+                SDL_RenderSetLogicalSize(state.renderer,
+                                         NATIVE_W * state.scale_factor,
+                                         NATIVE_H * state.scale_factor);
+                tcache_reinit(state.renderer, state.scale_factor, &state.scaler);
+            }
+            // The frame scaler is a setting of the target texture
+            reset_targets();
+        }
     }
 
-    // If any settings changed, reinit the screen
-    if(changed) {
+    if(rebuild) {
         video_reinit_renderer();
     }
 
@@ -254,6 +408,19 @@ void video_move_target(int x, int y) {
     state.target_move_y = y * state.scale_factor;
 }
 
+// Refresh rate of the display the window is on, 0 if it isn't known
+int video_get_refresh_rate() {
+    SDL_DisplayMode mode;
+    if(state.window == NULL) {
+        return 0;
+    }
+    int display = SDL_GetWindowDisplayIndex(state.window);
+    if(display < 0 || SDL_GetCurrentDisplayMode(display, &mode) != 0) {
+        return 0;
+    }
+    return mode.refresh_rate;
+}
+
 void video_get_state(int *w, int *h, int *fs, int *vsync) {
     if(w != NULL) {
         *w = state.w;
@@ -270,7 +437,7 @@ void video_get_state(int *w, int *h, int *fs, int *vsync) {
 }
 
 void video_select_renderer(int renderer) {
-    if(renderer == state.cur_renderer) {
+    if(renderer == state.cur_renderer || state.renderer == NULL) {
         return;
     }
     state.cb.render_close(&state);
@@ -282,6 +449,9 @@ void video_select_renderer(int renderer) {
         case VIDEO_RENDERER_HW:
             video_hw_init(&state);
             break;
+        case VIDEO_RENDERER_NULL:
+            video_null_init(&state);
+            break;
     }
 }
 
@@ -291,46 +461,144 @@ void video_set_fade(float fade) {
 
 void video_screenshot(image *img) {
     image_create(img, state.w, state.h);
+    if(state.renderer == NULL) {
+        return;
+    }
     int ret = SDL_RenderReadPixels(state.renderer, NULL, SDL_PIXELFORMAT_ABGR8888, img->data, img->w * 4);
     if(ret != 0) {
         PERROR("Unable to read pixels from rendertarget: %s", SDL_GetError());
     }
 }
 
-int video_area_capture(surface *sur, int x, int y, int w, int h) {
-    float scale_x = (float)state.w / NATIVE_W;
-    float scale_y = (float)state.h / NATIVE_H;
-
-    // Correct position (take scaling into account)
-    SDL_Rect r;
-    r.x = x * scale_x;
-    r.y = y * scale_y;
-    r.w = w * scale_x;
-    r.h = h * scale_y;
-
-    // Create a new surface
-    surface_create(sur, SURFACE_TYPE_RGBA, r.w, r.h);
+void video_get_frame_info(video_frame_info *info) {
+    info->w = NATIVE_W * state.scale_factor;
+    info->h = NATIVE_H * state.scale_factor;
+    info->fade = state.fade;
+    info->move_x = state.target_move_x * state.scale_factor;
+    info->move_y = state.target_move_y * state.scale_factor;
+}
 
-    // Read pixels
-    int ret = SDL_RenderReadPixels(state.renderer, &r, SDL_PIXELFORMAT_ABGR8888, sur->data, sur->w * 4);
+// Both renderers finish the frame in the target texture, so it is read
+// from there. The window's back buffer is left as the render target.
+int video_read_frame(char *dst) {
+    if(state.renderer == NULL || state.target == NULL) {
+        return 1;
+    }
+    SDL_SetRenderTarget(state.renderer, state.target);
+    int ret = SDL_RenderReadPixels(state.renderer, NULL, SDL_PIXELFORMAT_ABGR8888, dst,
+                                   NATIVE_W * state.scale_factor * 4);
+    SDL_SetRenderTarget(state.renderer, NULL);
     if(ret != 0) {
-        surface_free(sur);
-        PERROR("Unable to read pixels from renderer: %s", SDL_GetError());
+        PERROR("Unable to read pixels from render target: %s", SDL_GetError());
         return 1;
     }
+    return 0;
+}
 
+int video_area_capture(surface *sur, int *ok, int x, int y, int w, int h) {
+    if(area_lock == NULL) {
+        return 1;
+    }
+    SDL_LockMutex(area_lock);
+    int i = 0;
+    while(i < area_request_count && area_requests[i].sur != sur) {
+        i++;
+    }
+    if(i == MAX_AREA_CAPTURES) {
+        SDL_UnlockMutex(area_lock);
+        return 1;
+    }
+    if(i == area_request_count) {
+        area_request_count++;
+    }
+    area_requests[i].sur = sur;
+    area_requests[i].ok = ok;
+    area_requests[i].rect.x = x;
+    area_requests[i].rect.y = y;
+    area_requests[i].rect.w = w;
+    area_requests[i].rect.h = h;
+    SDL_UnlockMutex(area_lock);
     return 0;
 }
 
+void video_area_capture_cancel(surface *sur) {
+    if(area_lock == NULL) {
+        return;
+    }
+    SDL_LockMutex(area_lock);
+    for(int i = 0; i < area_request_count; i++) {
+        if(area_requests[i].sur == sur) {
+            area_requests[i] = area_requests[--area_request_count];
+            break;
+        }
+    }
+    SDL_UnlockMutex(area_lock);
+}
+
+// Reads the pending areas from the presented frame, which is still intact
+// in the render target. The result is point sampled back to native size.
+static void video_run_area_captures() {
+    SDL_LockMutex(area_lock);
+    if(area_request_count == 0) {
+        SDL_UnlockMutex(area_lock);
+        return;
+    }
+    trace_begin("video", "area capture");
+    int sf = state.scale_factor;
+    SDL_SetRenderTarget(state.renderer, state.target);
+    for(int i = 0; i < area_request_count; i++) {
+        video_area_request *req = &area_requests[i];
+        SDL_Rect r;
+        r.x = req->rect.x * sf;
+        r.y = req->rect.y * sf;
+        r.w = req->rect.w * sf;
+        r.h = req->rect.h * sf;
+        if(r.w * r.h * 4 > area_buf_size) {
+            area_buf_size = r.w * r.h * 4;
+            area_buf = realloc(area_buf, area_buf_size);
+        }
+        if(SDL_RenderReadPixels(state.renderer, &r, SDL_PIXELFORMAT_ABGR8888, area_buf, r.w * 4) != 0) {
+            PERROR("Unable to read pixels from renderer: %s", SDL_GetError());
+            continue;
+        }
+        surface_create(req->sur, SURFACE_TYPE_RGBA, req->rect.w, req->rect.h);
+        for(int y = 0; y < req->rect.h; y++) {
+            for(int x = 0; x < req->rect.w; x++) {
+                memcpy(req->sur->data + (y * req->rect.w + x) * 4,
+                       area_buf + ((y * sf) * r.w + x * sf) * 4,
+                       4);
+            }
+        }
+        *req->ok = 1;
+    }
+    area_request_count = 0;
+    SDL_SetRenderTarget(state.renderer, NULL);
+    trace_end("video", "area capture");
+    SDL_UnlockMutex(area_lock);
+}
+
+// Bumps the palette version and remembers the palette contents,
+// so that we can later tell if the palette has really changed.
+static void video_bump_pal_version(int force) {
+    screen_palette_mark(state.cur_palette, state.ver_palette->data, force);
+    memcpy(state.ver_palette->data, state.cur_palette->data, 768);
+}
+
 void video_force_pal_refresh() {
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
-    state.cur_palette->version++;
+    video_bump_pal_version(1);
+}
+
+void video_sync_pal_version() {
+    if(memcmp(state.cur_palette->data, state.ver_palette->data, 768) != 0) {
+        video_bump_pal_version(0);
+    }
 }
 
 void video_set_base_palette(const palette *src) {
     memcpy(state.base_palette, src, sizeof(palette));
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
-    state.cur_palette->version++;
+    video_bump_pal_version(1);
 }
 
 palette *video_get_base_palette() {
@@ -341,7 +609,7 @@ void video_copy_pal_range(const palette *src, int src_start, int dst_start, int
     memcpy(state.cur_palette->data + dst_start * 3,
            src->data + src_start * 3,
            amount * 3);
-    state.cur_palette->version++;
+    video_bump_pal_version(0);
 }
 
 screen_palette* video_get_pal_ref() {
@@ -351,14 +619,98 @@ screen_palette* video_get_pal_ref() {
 void video_render_prepare() {
     // Reset palette
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
+    if(state.renderer == NULL) {
+        return;
+    }
     SDL_SetRenderTarget(state.renderer, state.target);
     state.cb.render_prepare(&state);
 }
 
+// All sprite draws go through here, so that they can be recorded
+static void video_fsot(surface *sur, const SDL_Rect *src, SDL_Rect *dst, SDL_BlendMode blend_mode,
+                       int pal_offset, SDL_RendererFlip flip_mode, uint8_t opacity, color tint) {
+    if(recorder_count > 0) {
+        video_draw_cmd cmd;
+        memset(&cmd, 0, sizeof(video_draw_cmd));
+        cmd.sur = sur;
+        if(src != NULL) {
+            cmd.src = *src;
+            cmd.has_src = 1;
+        }
+        cmd.dst = *dst; // Renderers may scale dst in place
+        cmd.blend_mode = blend_mode;
+        cmd.pal_offset = pal_offset;
+        cmd.flip_mode = flip_mode;
+        cmd.opacity = opacity;
+        cmd.tint = tint;
+        for(int i = 0; i < recorder_count; i++) {
+            vector_append(&recorders[i]->cmds, &cmd);
+        }
+    }
+    state.cb.render_fsot(&state, sur, src, dst, blend_mode, pal_offset, flip_mode, opacity, tint);
+}
+
+void video_draw_list_create(video_draw_list *list) {
+    vector_create(&list->cmds, sizeof(video_draw_cmd));
+    list->surface_frees = 0;
+    list->valid = 0;
+}
+
+void video_draw_list_free(video_draw_list *list) {
+    vector_free(&list->cmds);
+    list->valid = 0;
+}
+
+// Starts recording sprite draws into list. Draws are still rendered as usual.
+void video_record_begin(video_draw_list *list) {
+    if(recorder_count >= MAX_RECORDERS) {
+        PERROR("Too many nested draw list recordings!");
+        list->valid = 0;
+        return;
+    }
+    vector_clear(&list->cmds);
+    list->surface_frees = surface_get_free_count();
+    list->valid = 0;
+    recorders[recorder_count++] = list;
+}
+
+void video_record_end(video_draw_list *list) {
+    if(recorder_count > 0 && recorders[recorder_count - 1] == list) {
+        recorder_count--;
+        // Surfaces freed meanwhile may have been drawn before they went away
+        list->valid = (list->surface_frees == surface_get_free_count());
+    }
+}
+
+// Draws everything in the list again. Returns 1 without drawing anything if
+// the list is empty or some surface may have been freed since it was recorded.
+int video_draw_list_replay(const video_draw_list *list) {
+    if(!list->valid || list->surface_frees != surface_get_free_count()) {
+        return 1;
+    }
+    iterator it;
+    video_draw_cmd *cmd;
+    vector_iter_begin(&list->cmds, &it);
+    while((cmd = iter_next(&it)) != NULL) {
+        SDL_Rect dst = cmd->dst;
+        video_fsot(cmd->sur, cmd->has_src ? &cmd->src : NULL, &dst, cmd->blend_mode,
+                   cmd->pal_offset, cmd->flip_mode, cmd->opacity, cmd->tint);
+    }
+    return 0;
+}
+
 void video_render_background(surface *sur) {
     state.cb.render_background(&state, sur);
 }
 
+// Sprites that are likely to be drawn in the next few frames. Renderers that
+// don't cache anything per sprite just ignore these.
+void video_prewarm_sprite(surface *sur, int pal_offset) {
+    if(state.cb.render_prewarm != NULL) {
+        state.cb.render_prewarm(&state, sur, pal_offset);
+    }
+}
+
 void video_render_sprite_tint(
         surface *sur,
         int sx,
@@ -374,9 +726,9 @@ void video_render_sprite_tint(
     dst.y = sy;
 
     // Render
-    state.cb.render_fsot(
-        &state,
+    video_fsot(
         sur,
+        NULL,
         &dst,
         SDL_BLENDMODE_BLEND,
         pal_offset,
@@ -455,9 +807,9 @@ void video_render_sprite_size(
     dst.y = sy;
 
     // Render
-    state.cb.render_fsot(
-        &state,
+    video_fsot(
         sur,
+        NULL,
         &dst,
         SDL_BLENDMODE_BLEND, // blendmode
         0, // Pal offset
@@ -495,18 +847,149 @@ void video_render_sprite_flip_scale_opacity_tint(
         blend_mode = SDL_BLENDMODE_ADD;
 
     // Render
-    state.cb.render_fsot(&state, sur, &dst, blend_mode, pal_offset, flip, opacity, tint);
+    video_fsot(sur, NULL, &dst, blend_mode, pal_offset, flip, opacity, tint);
+}
+
+void video_render_sprite_part_opacity_tint(
+        surface *sur,
+        int sx,
+        int sy,
+        int src_x,
+        int src_y,
+        int w,
+        int h,
+        unsigned int rendering_mode,
+        uint8_t opacity,
+        color tint) {
+
+    SDL_Rect src;
+    src.x = src_x;
+    src.y = src_y;
+    src.w = w;
+    src.h = h;
+
+    SDL_Rect dst;
+    dst.x = sx;
+    dst.y = sy;
+    dst.w = w;
+    dst.h = h;
+
+    SDL_BlendMode blend_mode = SDL_BLENDMODE_BLEND;
+    if(rendering_mode == BLEND_ADDITIVE)
+        blend_mode = SDL_BLENDMODE_ADD;
+
+    video_fsot(sur, &src, &dst, blend_mode, 0, 0, opacity, tint);
+}
+
+void video_shadow_begin() {
+    if(state.renderer == NULL) {
+        return;
+    }
+    if(shadow_cover == NULL) {
+        shadow_cover = calloc(NATIVE_W * SHADOW_H, 1);
+        surface_create(&shadow_sur, SURFACE_TYPE_RGBA, NATIVE_W, SHADOW_H);
+        memset(shadow_sur.data, 0, NATIVE_W * SHADOW_H * 4);
+
+        // Same result as drawing the layers one by one at SHADOW_OPACITY
+        float left = 1.0f;
+        for(int i = 0; i <= SHADOW_MAX_LAYERS; i++) {
+            shadow_alpha[i] = 255.0f * (1.0f - left) + 0.5f;
+            left *= 1.0f - SHADOW_OPACITY / 255.0f;
+        }
+    }
+    shadow_x0 = NATIVE_W;
+    shadow_y0 = SHADOW_H;
+    shadow_x1 = 0;
+    shadow_y1 = 0;
+}
+
+static void video_shadow_mark(int x, int y) {
+    if(x < 0 || x >= NATIVE_W || y < 0 || y >= SHADOW_H) {
+        return;
+    }
+    uint8_t *c = &shadow_cover[y * NATIVE_W + x];
+    if(*c < SHADOW_MAX_LAYERS) {
+        (*c)++;
+    }
+    if(x < shadow_x0) shadow_x0 = x;
+    if(y < shadow_y0) shadow_y0 = y;
+    if(x >= shadow_x1) shadow_x1 = x + 1;
+    if(y >= shadow_y1) shadow_y1 = y + 1;
+}
+
+// Adds the silhouette of the surface to the shadow buffer, squashed to
+// y_percent of its height like video_render_sprite_flip_scale would. Every
+// pixel is also spread one step down and right, which gives the shadow its
+// soft edge without a second draw.
+void video_render_shadow(surface *sur, int sx, int sy, unsigned int flip_mode, float y_percent) {
+    if(shadow_cover == NULL) {
+        return;
+    }
+    int dst_h = sur->h * y_percent;
+    int dst_y = sy + (sur->h - dst_h) / 2 - SHADOW_TOP;
+    for(int r = 0; r < dst_h; r++) {
+        int src_y = (r * 2 + 1) * sur->h / (dst_h * 2);
+        if(flip_mode & FLIP_VERTICAL) {
+            src_y = sur->h - 1 - src_y;
+        }
+        for(int c = 0; c < sur->w; c++) {
+            int src_x = (flip_mode & FLIP_HORIZONTAL) ? sur->w - 1 - c : c;
+            int i = src_y * sur->w + src_x;
+            int opaque = (sur->type == SURFACE_TYPE_RGBA) ? sur->data[i * 4 + 3] != 0 : surface_stencil_at(sur, i);
+            if(opaque) {
+                video_shadow_mark(sx + c, dst_y + r);
+                video_shadow_mark(sx + c + 1, dst_y + r + 1);
+            }
+        }
+    }
+}
+
+// Turns the counts into black pixels and draws the touched part once
+void video_shadow_end() {
+    if(shadow_cover == NULL || shadow_x1 <= shadow_x0) {
+        return;
+    }
+    int w = shadow_x1 - shadow_x0;
+    for(int y = shadow_y0; y < shadow_y1; y++) {
+        uint8_t *c = &shadow_cover[y * NATIVE_W + shadow_x0];
+        char *px = &shadow_sur.data[(y * NATIVE_W + shadow_x0) * 4];
+        for(int x = 0; x < w; x++) {
+            px[x * 4 + 3] = shadow_alpha[c[x]];
+            c[x] = 0;
+        }
+    }
+    surface_force_refresh(&shadow_sur);
+    video_render_sprite_part_opacity_tint(
+        &shadow_sur,
+        shadow_x0, shadow_y0 + SHADOW_TOP,
+        shadow_x0, shadow_y0,
+        w, shadow_y1 - shadow_y0,
+        BLEND_ALPHA,
+        255,
+        color_create(0xFF, 0xFF, 0xFF, 0xFF));
+    shadow_x1 = 0;
 }
 
 // Called on every game tick
 void video_tick() {
-    tcache_tick();
+    if(state.renderer != NULL) {
+        tcache_tick();
+    }
 }
 
 // Called after frame has been rendered
 void video_render_finish() {
+    video_render_submit();
+    video_render_present();
+}
+
+// Hands the frame to SDL. Everything that reads game or video state is done here.
+void video_render_submit() {
     // Tell software/hardware renderer to finish up whatever it was doing
     state.cb.render_finish(&state);
+    if(state.renderer == NULL) {
+        return;
+    }
 
     // Set our rendertarget to screen buffer.
     SDL_SetRenderTarget(state.renderer, NULL);
@@ -526,13 +1009,29 @@ void video_render_finish() {
     dst.w = NATIVE_W * state.scale_factor;
     dst.h = NATIVE_H * state.scale_factor;
     SDL_RenderCopy(state.renderer, state.target, NULL, &dst);
+    if(state.scanlines != NULL) {
+        SDL_RenderCopy(state.renderer, state.scanlines, NULL, &dst);
+    }
 
     // Reset color modulation to normal
     SDL_SetTextureColorMod(state.target, 0xFF, 0xFF, 0xFF);
+}
+
+// Shows the submitted frame. This is where vsync waits happen.
+void video_render_present() {
+    if(state.renderer == NULL) {
+        return;
+    }
 
     // Flip buffers. If vsync is off, we should sleep here
     // so hat our main loop doesn't eat up all cpu :)
     SDL_RenderPresent(state.renderer);
+    Uint64 now = SDL_GetPerformanceCounter();
+    if(last_present != 0) {
+        profiler_record(PROF_PRESENT_GAP, now - last_present);
+    }
+    last_present = now;
+    video_run_area_captures();
     if(!state.vsync) {
         SDL_Delay(1);
     }
@@ -540,11 +1039,31 @@ void video_render_finish() {
 
 void video_close() {
     state.cb.render_close(&state);
+    if(shadow_cover != NULL) {
+        free(shadow_cover);
+        shadow_cover = NULL;
+        surface_free(&shadow_sur);
+    }
+    free(state.cur_palette);
+    free(state.ver_palette);
+    free(state.base_palette);
+    if(state.renderer == NULL) {
+        INFO("Video deinit.");
+        return;
+    }
+    SDL_DestroyMutex(area_lock);
+    area_lock = NULL;
+    area_request_count = 0;
+    free(area_buf);
+    area_buf = NULL;
+    area_buf_size = 0;
     SDL_DestroyTexture(state.target);
+    if(state.scanlines != NULL) {
+        SDL_DestroyTexture(state.scanlines);
+    }
     SDL_DestroyRenderer(state.renderer);
     SDL_DestroyWindow(state.window);
-    free(state.cur_palette);
-    free(state.base_palette);
     tcache_close();
+    screenshot_close();
     INFO("Video deinit.");
 }
@@ -1,21 +1,248 @@
+#include <stdlib.h>
+#include "video/video.h"
 #include "video/video_hw.h"
 #include "video/tcache.h"
+#include "utils/vector.h"
+#include "utils/load_timer.h"
 #include "utils/log.h"
+#include "utils/trace.h"
 
-void hw_render_close(video_state *state) {
+/*
+* Hardware renderer. Draw calls are not submitted right away, but gathered
+* into a command queue that is flushed at the end of the frame (or before a
+* texture that may be in use gets updated). Commands are kept in submission
+* order, so layer ordering is preserved. Consecutive commands that use the same
+* texture and blend mode are submitted as one batch. Textures missing from the
+* cache are built in parallel right before the commands are submitted.
+*/
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define HW_USE_GEOMETRY
+#endif
+
+// Sprites queued for warming up per frame, and the time that may be spent on them
+#define HW_PREWARM_MAX 64
+#define HW_PREWARM_BUDGET_US 1000
+
+typedef struct hw_command_t {
+    SDL_Texture *tex;
+    SDL_Rect src;
+    SDL_Rect dst;
+    SDL_BlendMode blend_mode;
+    SDL_RendererFlip flip_mode;
+    uint8_t opacity;
+    color color_mod;
+} hw_command;
+
+typedef struct hw_renderer_t {
+    vector commands;
+    vector vertices;
+    vector indices;
+    SDL_Renderer *renderer;
+
+    // Sprites to build textures for at the end of the frame. Surface pointers
+    // are only good until the next tick, so the queue never outlives the frame.
+    surface *prewarm[HW_PREWARM_MAX];
+    uint8_t prewarm_pal_offset[HW_PREWARM_MAX];
+    int prewarm_count;
+} hw_renderer;
+
+#ifdef HW_USE_GEOMETRY
+// Submits commands [start, end) that all share the same texture and blend mode
+static void hw_submit_batch(hw_renderer *hr, unsigned int start, unsigned int end) {
+    hw_command *first = vector_get(&hr->commands, start);
+    int tex_w, tex_h;
+    if(SDL_QueryTexture(first->tex, NULL, NULL, &tex_w, &tex_h) != 0) {
+        return;
+    }
+
+    // Color and alpha modulation is done with vertex colors
+    vector_clear(&hr->vertices);
+    vector_clear(&hr->indices);
+    for(unsigned int i = start; i < end; i++) {
+        hw_command *cmd = vector_get(&hr->commands, i);
+        float u0 = (float)cmd->src.x / tex_w;
+        float v0 = (float)cmd->src.y / tex_h;
+        float u1 = (float)(cmd->src.x + cmd->src.w) / tex_w;
+        float v1 = (float)(cmd->src.y + cmd->src.h) / tex_h;
+        float tmp;
+        if(cmd->flip_mode & SDL_FLIP_HORIZONTAL) {
+            tmp = u0; u0 = u1; u1 = tmp;
+        }
+        if(cmd->flip_mode & SDL_FLIP_VERTICAL) {
+            tmp = v0; v0 = v1; v1 = tmp;
+        }
+        float x0 = cmd->dst.x;
+        float y0 = cmd->dst.y;
+        float x1 = cmd->dst.x + cmd->dst.w;
+        float y1 = cmd->dst.y + cmd->dst.h;
+
+        SDL_Vertex vert;
+        vert.color.r = cmd->color_mod.r;
+        vert.color.g = cmd->color_mod.g;
+        vert.color.b = cmd->color_mod.b;
+        vert.color.a = cmd->opacity;
+        int base = vector_size(&hr->vertices);
+        vert.position.x = x0; vert.position.y = y0; vert.tex_coord.x = u0; vert.tex_coord.y = v0;
+        vector_append(&hr->vertices, &vert);
+        vert.position.x = x1; vert.position.y = y0; vert.tex_coord.x = u1; vert.tex_coord.y = v0;
+        vector_append(&hr->vertices, &vert);
+        vert.position.x = x1; vert.position.y = y1; vert.tex_coord.x = u1; vert.tex_coord.y = v1;
+        vector_append(&hr->vertices, &vert);
+        vert.position.x = x0; vert.position.y = y1; vert.tex_coord.x = u0; vert.tex_coord.y = v1;
+        vector_append(&hr->vertices, &vert);
+
+        int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+        for(int k = 0; k < 6; k++) {
+            vector_append(&hr->indices, &quad[k]);
+        }
+    }
 
+    SDL_SetTextureColorMod(first->tex, 0xFF, 0xFF, 0xFF);
+    SDL_SetTextureAlphaMod(first->tex, 0xFF);
+    SDL_SetTextureBlendMode(first->tex, first->blend_mode);
+    SDL_RenderGeometry(hr->renderer,
+                       first->tex,
+                       (SDL_Vertex*)hr->vertices.data,
+                       vector_size(&hr->vertices),
+                       (int*)hr->indices.data,
+                       vector_size(&hr->indices));
 }
+#else
+// Submits commands [start, end) that all share the same texture and blend mode
+static void hw_submit_batch(hw_renderer *hr, unsigned int start, unsigned int end) {
+    hw_command *prev = NULL;
+    for(unsigned int i = start; i < end; i++) {
+        hw_command *cmd = vector_get(&hr->commands, i);
 
-void hw_render_reinit(video_state *state) {
+        // Only touch texture state when it actually changes
+        if(prev == NULL || prev->opacity != cmd->opacity) {
+            SDL_SetTextureAlphaMod(cmd->tex, cmd->opacity);
+        }
+        if(prev == NULL
+            || prev->color_mod.r != cmd->color_mod.r
+            || prev->color_mod.g != cmd->color_mod.g
+            || prev->color_mod.b != cmd->color_mod.b) {
+            SDL_SetTextureColorMod(cmd->tex, cmd->color_mod.r, cmd->color_mod.g, cmd->color_mod.b);
+        }
+        if(prev == NULL) {
+            SDL_SetTextureBlendMode(cmd->tex, cmd->blend_mode);
+        }
+        SDL_RenderCopyEx(hr->renderer, cmd->tex, &cmd->src, &cmd->dst, 0, NULL, cmd->flip_mode);
+        prev = cmd;
+    }
+}
+#endif
 
+// Submits all queued commands
+static void hw_flush(void *userdata) {
+    hw_renderer *hr = userdata;
+    // The textures they use must be built first
+    tcache_resolve();
+    unsigned int count = vector_size(&hr->commands);
+    unsigned int start = 0;
+    while(start < count) {
+        hw_command *first = vector_get(&hr->commands, start);
+        unsigned int end = start + 1;
+        while(end < count) {
+            hw_command *cmd = vector_get(&hr->commands, end);
+            if(cmd->tex != first->tex || cmd->blend_mode != first->blend_mode) {
+                break;
+            }
+            end++;
+        }
+        hw_submit_batch(hr, start, end);
+        start = end;
+    }
+    vector_clear(&hr->commands);
+}
+
+static void hw_queue(hw_renderer *hr,
+                     SDL_Texture *tex,
+                     SDL_Rect *src,
+                     SDL_Rect *dst,
+                     SDL_BlendMode blend_mode,
+                     SDL_RendererFlip flip_mode,
+                     uint8_t opacity,
+                     color color_mod) {
+    hw_command cmd;
+    cmd.tex = tex;
+    cmd.src = *src;
+    cmd.dst = *dst;
+    cmd.blend_mode = blend_mode;
+    cmd.flip_mode = flip_mode;
+    cmd.opacity = opacity;
+    cmd.color_mod = color_mod;
+    vector_append(&hr->commands, &cmd);
+}
+
+void hw_render_close(video_state *state) {
+    hw_renderer *hr = state->userdata;
+    hw_flush(hr);
+    tcache_set_flush_hook(NULL, NULL);
+    vector_free(&hr->commands);
+    vector_free(&hr->vertices);
+    vector_free(&hr->indices);
+    free(hr);
+}
+
+void hw_render_reinit(video_state *state) {
+    // Queued textures are about to die with the renderer
+    hw_renderer *hr = state->userdata;
+    vector_clear(&hr->commands);
+    hr->prewarm_count = 0;
 }
 
 void hw_render_prepare(video_state *state) {
+    hw_renderer *hr = state->userdata;
+    hr->renderer = state->renderer;
+    vector_clear(&hr->commands);
+    hr->prewarm_count = 0;
+    tcache_begin_frame();
+}
 
+// Builds textures for the queued sprites until the time budget runs out
+static void hw_run_prewarm(video_state *state) {
+    hw_renderer *hr = state->userdata;
+    if(hr->prewarm_count == 0) {
+        return;
+    }
+    trace_begin("video", "prewarm");
+    uint64_t warm_start = load_timer_start();
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint64_t budget = SDL_GetPerformanceFrequency() * HW_PREWARM_BUDGET_US / 1000000;
+    for(int i = 0; i < hr->prewarm_count; i++) {
+        if(SDL_GetPerformanceCounter() - start > budget) {
+            break;
+        }
+        tcache_warm(hr->prewarm[i], state->cur_palette, NULL, hr->prewarm_pal_offset[i]);
+    }
+    hr->prewarm_count = 0;
+    load_timer_add(LOAD_TIME_TCACHE_WARM, warm_start);
+    trace_end("video", "prewarm");
 }
 
 void hw_render_finish(video_state *state) {
+    hw_renderer *hr = state->userdata;
+    hr->renderer = state->renderer;
+    hw_flush(hr);
+    tcache_end_frame();
+    hw_run_prewarm(state);
+}
 
+void hw_render_prewarm(video_state *state, surface *sur, int pal_offset) {
+    hw_renderer *hr = state->userdata;
+    if(hr->prewarm_count >= HW_PREWARM_MAX) {
+        return;
+    }
+    for(int i = 0; i < hr->prewarm_count; i++) {
+        if(hr->prewarm[i] == sur && hr->prewarm_pal_offset[i] == pal_offset) {
+            return;
+        }
+    }
+    hr->prewarm[hr->prewarm_count] = sur;
+    hr->prewarm_pal_offset[hr->prewarm_count] = pal_offset;
+    hr->prewarm_count++;
 }
 
 void hw_scale_rect(video_state *state, SDL_Rect *rct) {
@@ -29,18 +256,24 @@ void hw_render_background(
                     video_state *state,
                     surface *sur) {
 
-    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, 0);
+    SDL_Rect src;
+    SDL_Texture *tex = tcache_get_static(sur, state->cur_palette, &src);
     if(tex == NULL)
         return;
-    SDL_SetTextureColorMod(tex, 0xFF, 0xFF, 0xFF);
-    SDL_SetTextureAlphaMod(tex, 0xFF);
-    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
-    SDL_RenderCopy(state->renderer, tex, NULL, NULL);
+    SDL_Rect dst;
+    dst.x = 0;
+    dst.y = 0;
+    dst.w = NATIVE_W * state->scale_factor;
+    dst.h = NATIVE_H * state->scale_factor;
+    hw_queue(state->userdata, tex, &src, &dst,
+             SDL_BLENDMODE_NONE, SDL_FLIP_NONE,
+             0xFF, color_create(0xFF, 0xFF, 0xFF, 0xFF));
 }
 
 void hw_render_sprite_fsot(
                     video_state *state,
                     surface *sur,
+                    const SDL_Rect *part,
                     SDL_Rect *dst,
                     SDL_BlendMode blend_mode,
                     int pal_offset,
@@ -49,22 +282,38 @@ void hw_render_sprite_fsot(
                     color color_mod) {
 
     hw_scale_rect(state, dst);
-    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, pal_offset);
+    SDL_Rect src;
+    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, pal_offset, &src);
     if(tex == NULL)
         return;
-    SDL_SetTextureAlphaMod(tex, opacity);
-    SDL_SetTextureColorMod(tex, color_mod.r, color_mod.g, color_mod.b);
-    SDL_SetTextureBlendMode(tex, blend_mode);
-    SDL_RenderCopyEx(state->renderer, tex, NULL, dst, 0, NULL, flip_mode);
+    if(part != NULL) {
+        src.x += part->x;
+        src.y += part->y;
+        src.w = part->w;
+        src.h = part->h;
+    }
+    hw_queue(state->userdata, tex, &src, dst, blend_mode, flip_mode, opacity, color_mod);
 }
 
 
 void video_hw_init(video_state *state) {
+    hw_renderer *hr = malloc(sizeof(hw_renderer));
+    vector_create(&hr->commands, sizeof(hw_command));
+    vector_create(&hr->vertices, sizeof(SDL_Vertex));
+    vector_create(&hr->indices, sizeof(int));
+    hr->renderer = state->renderer;
+    hr->prewarm_count = 0;
+    state->userdata = hr;
+
+    // Texture cache must flush our queue before it touches any texture data
+    tcache_set_flush_hook(hw_flush, hr);
+
     state->cb.render_close = hw_render_close;
     state->cb.render_reinit = hw_render_reinit;
     state->cb.render_prepare = hw_render_prepare;
     state->cb.render_finish = hw_render_finish;
     state->cb.render_fsot = hw_render_sprite_fsot;
     state->cb.render_background = hw_render_background;
+    state->cb.render_prewarm = hw_render_prewarm;
     DEBUG("Switched to hardware renderer.");
 }
@@ -0,0 +1,26 @@
+#include "video/video_null.h"
+
+/*
+* A renderer that draws nothing. Scenes still build their frames and hand
+* every sprite over, so running with this renderer measures the game logic
+* and the draw submission without the cost of conversions, uploads and the GPU.
+* Also used when there is no window at all.
+*/
+
+static void video_null_close(video_state *state) {}
+static void video_null_reinit(video_state *state) {}
+static void video_null_prepare(video_state *state) {}
+static void video_null_finish(video_state *state) {}
+static void video_null_background(video_state *state, surface *sur) {}
+static void video_null_fsot(video_state *state, surface *sur, const SDL_Rect *src, SDL_Rect *dst, SDL_BlendMode blend_mode,
+                            int pal_offset, SDL_RendererFlip flip_mode, uint8_t opacity, color tint) {}
+
+void video_null_init(video_state *state) {
+    state->cb.render_close = video_null_close;
+    state->cb.render_reinit = video_null_reinit;
+    state->cb.render_prepare = video_null_prepare;
+    state->cb.render_finish = video_null_finish;
+    state->cb.render_background = video_null_background;
+    state->cb.render_fsot = video_null_fsot;
+    state->cb.render_prewarm = NULL;
+}
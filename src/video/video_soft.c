@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <string.h>
 #include "video/video_soft.h"
+#include "video/scaler_pool.h"
 #include "utils/log.h"
 
 /*
@@ -15,11 +17,49 @@
 * TODO: Rewrite and rethink
 */
 
+// Only the rows that changed since the last frame are converted, scaled and
+// uploaded. Past this share of changed rows the whole frame is redone instead.
+#define SOFT_DIRTY_MAX_PERCENT 60
+
+// Rows around a changed one that a scaler may also write differently
+#define SOFT_SCALE_MARGIN 2
+
+// Number of SDL_Surface wrappers kept around for RGBA sprites, such as gauges
+#define SOFT_WRAPPERS 64
+
+// An SDL_Surface over the pixels of an RGBA surface. Only the pixel pointer and
+// size go into it, so it stays right for whatever surface has those pixels now.
+typedef struct {
+    const char *pixels;
+    int w, h;
+    SDL_Surface *s;
+} soft_wrapper;
+
 typedef struct soft_renderer_t {
     char *tmp_normal;
     char *tmp_scaling;
     surface lower;
     SDL_Surface *higher;
+
+    // Streaming textures for the layers. These are recreated
+    // only when the renderer or the scale factor changes.
+    SDL_Texture *lower_tex;
+    SDL_Texture *higher_tex;
+    int tex_scale_factor;
+
+    // Lower layer pixels and stencil as last uploaded, and the palette they used
+    char *prev_lower;
+    unsigned int prev_pal_version;
+    int full_upload; // Set when the textures have no valid contents
+
+    // Rows drawn into the higher layer this frame and the last one
+    int higher_y0, higher_y1;
+    int prev_higher_y0, prev_higher_y1;
+
+    soft_wrapper wrappers[SOFT_WRAPPERS];
+
+    // Lower layer scaled in palette indexes, if the scaler can work on those
+    surface scaled;
 } soft_renderer;
 
 SDL_Surface* surface_from_pixels(char *pixels, int w, int h) {
@@ -33,53 +73,266 @@ SDL_Surface* surface_from_pixels(char *pixels, int w, int h) {
                                     0xFF000000);
 }
 
+static SDL_Texture* soft_create_texture(SDL_Renderer *renderer, int w, int h) {
+    SDL_Texture *tex = SDL_CreateTexture(renderer,
+                                         SDL_PIXELFORMAT_ABGR8888,
+                                         SDL_TEXTUREACCESS_STREAMING,
+                                         w, h);
+    if(tex == NULL) {
+        PERROR("Unable to create software renderer texture: %s", SDL_GetError());
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    return tex;
+}
+
+static void soft_free_textures(soft_renderer *sr) {
+    if(sr->lower_tex != NULL) {
+        SDL_DestroyTexture(sr->lower_tex);
+        sr->lower_tex = NULL;
+    }
+    if(sr->higher_tex != NULL) {
+        SDL_DestroyTexture(sr->higher_tex);
+        sr->higher_tex = NULL;
+    }
+}
+
+// Makes sure the textures and the scaling buffer exist and match the current scale factor
+static int soft_check_textures(video_state *state) {
+    soft_renderer *sr = state->userdata;
+    if(sr->lower_tex != NULL
+        && sr->higher_tex != NULL
+        && sr->tex_scale_factor == state->scale_factor) {
+        return 0;
+    }
+    soft_free_textures(sr);
+
+    free(sr->tmp_scaling);
+    sr->tmp_scaling = NULL;
+    if(sr->scaled.data != NULL) {
+        surface_free(&sr->scaled);
+    }
+    if(state->scale_factor > 1) {
+        sr->tmp_scaling = malloc(320 * 200 * 4 * state->scale_factor * state->scale_factor);
+        if(scaler_has_scale_index(&state->scaler)) {
+            surface_create(&sr->scaled, SURFACE_TYPE_PALETTE, 320 * state->scale_factor, 200 * state->scale_factor);
+        }
+    }
+
+    sr->lower_tex = soft_create_texture(state->renderer,
+                                        320 * state->scale_factor,
+                                        200 * state->scale_factor);
+    sr->higher_tex = soft_create_texture(state->renderer, 320, 200);
+    sr->tex_scale_factor = state->scale_factor;
+    sr->full_upload = 1;
+    if(sr->lower_tex == NULL || sr->higher_tex == NULL) {
+        soft_free_textures(sr);
+        return 1;
+    }
+    return 0;
+}
+
+// Finds or makes the SDL_Surface for an RGBA surface. Surface pixels are cache
+// line aligned, so the address bits above that spread the entries well.
+static SDL_Surface* soft_get_wrapper(soft_renderer *sr, surface *sur) {
+    soft_wrapper *w = &sr->wrappers[((uintptr_t)sur->data >> 6) % SOFT_WRAPPERS];
+    if(w->s != NULL && w->pixels == sur->data && w->w == sur->w && w->h == sur->h) {
+        return w->s;
+    }
+    if(w->s != NULL) {
+        SDL_FreeSurface(w->s);
+    }
+    w->s = surface_from_pixels(sur->data, sur->w, sur->h);
+    w->pixels = sur->data;
+    w->w = sur->w;
+    w->h = sur->h;
+    if(w->s != NULL) {
+        SDL_SetSurfaceBlendMode(w->s, SDL_BLENDMODE_BLEND);
+    }
+    return w->s;
+}
 
 void soft_render_close(video_state *state) {
     soft_renderer *sr = state->userdata;
+    soft_free_textures(sr);
+    for(int i = 0; i < SOFT_WRAPPERS; i++) {
+        if(sr->wrappers[i].s != NULL) {
+            SDL_FreeSurface(sr->wrappers[i].s);
+        }
+    }
     SDL_FreeSurface(sr->higher);
     surface_free(&sr->lower);
+    if(sr->scaled.data != NULL) {
+        surface_free(&sr->scaled);
+    }
+    free(sr->prev_lower);
     free(sr->tmp_normal);
     free(sr->tmp_scaling);
     free(sr);
 }
 
+// Called while the current renderer is still alive. Textures are
+// recreated on the next frame.
 void soft_render_reinit(video_state *state) {
-
+    soft_free_textures(state->userdata);
 }
 
 void soft_render_prepare(video_state *state) {
+    // Only the rows drawn last frame have anything to clear
     soft_renderer *sr = state->userdata;
-    SDL_FillRect(sr->higher, NULL, SDL_MapRGBA(sr->higher->format, 0, 0, 0, 0));
+    if(sr->higher_y0 < sr->higher_y1) {
+        SDL_Rect r = {0, sr->higher_y0, 320, sr->higher_y1 - sr->higher_y0};
+        SDL_FillRect(sr->higher, &r, SDL_MapRGBA(sr->higher->format, 0, 0, 0, 0));
+    }
+    sr->prev_higher_y0 = sr->higher_y0;
+    sr->prev_higher_y1 = sr->higher_y1;
+    sr->higher_y0 = 200;
+    sr->higher_y1 = 0;
 }
 
-void soft_render_finish(video_state *state) {
+// Marks the rows of the lower layer that differ from the last upload
+static int soft_find_dirty_rows(soft_renderer *sr, screen_palette *pal, uint8_t *dirty) {
+    int all = sr->full_upload || sr->prev_pal_version != pal->version;
+    int count = 0;
+    for(int y = 0; y < 200; y++) {
+        int o = y * 320;
+        dirty[y] = all
+            || memcmp(sr->lower.data + o, sr->prev_lower + o, 320) != 0
+            || memcmp(sr->lower.stencil + o, sr->prev_lower + 320 * 200 + o, 320) != 0;
+        count += dirty[y];
+    }
+    return count;
+}
+
+static void soft_upload_rows(video_state *state, int y0, int y1) {
     soft_renderer *sr = state->userdata;
-    SDL_Texture *tex;
-    SDL_Surface *low_s;
+    int sf = state->scale_factor;
+    char *src = (sf > 1) ? sr->tmp_scaling : sr->tmp_normal;
+    SDL_Rect r = {0, y0 * sf, 320 * sf, (y1 - y0) * sf};
+    SDL_UpdateTexture(sr->lower_tex, &r, src + y0 * sf * 320 * sf * 4, 320 * sf * 4);
+}
 
-    // Blit lower
-    surface_to_rgba(&sr->lower, sr->tmp_normal, state->cur_palette, NULL, 0);
+// Scaled rows also depend on their neighbours, so those go up as well
+static void soft_find_upload_rows(const uint8_t *dirty, uint8_t *upload, int margin) {
+    for(int i = 0; i < 200; i++) {
+        upload[i] = 0;
+        for(int k = i - margin; k <= i + margin && !upload[i]; k++) {
+            upload[i] = (k >= 0 && k < 200 && dirty[k]);
+        }
+    }
+}
 
-    // Scale if necessary
-    if(state->scale_factor > 1) {
-        int nw = 320 * state->scale_factor;
-        int nh = 200 * state->scale_factor;
-        scaler_scale(&state->scaler, sr->tmp_normal, sr->tmp_scaling, 320, 200, state->scale_factor);
-        low_s = surface_from_pixels(sr->tmp_scaling, nw, nh);
+// Scales the changed rows as palette indexes, and converts only the scaled result.
+// That moves a quarter of the bytes through the scaler that RGBA would.
+static void soft_update_lower_index(video_state *state, const uint8_t *dirty, const palette_lut *lut) {
+    soft_renderer *sr = state->userdata;
+    int sf = state->scale_factor;
+    uint8_t upload[200];
+    soft_find_upload_rows(dirty, upload, SOFT_SCALE_MARGIN);
+    int y = 0;
+    while(y < 200) {
+        if(!upload[y]) {
+            y++;
+            continue;
+        }
+        int y0 = y;
+        while(y < 200 && upload[y]) {
+            y++;
+        }
+        scaler_scale_index(&state->scaler, sr->lower.data, sr->lower.stencil,
+                           sr->scaled.data, sr->scaled.stencil, 320, 200, sf, y0, y);
+        surface_to_rgba_lut_rows(&sr->scaled, sr->tmp_scaling, lut, y0 * sf, y * sf);
+        soft_upload_rows(state, y0, y);
+    }
+}
+
+static void soft_update_lower(video_state *state) {
+    soft_renderer *sr = state->userdata;
+    int sf = state->scale_factor;
+    uint8_t dirty[200];
+    int count = soft_find_dirty_rows(sr, state->cur_palette, dirty);
+    if(count == 0) {
+        return;
+    }
+    const palette_lut *lut = screen_palette_get_lut(state->cur_palette, 0);
+    int partial = count * 100 <= 200 * SOFT_DIRTY_MAX_PERCENT
+        && lut != NULL
+        && (sf == 1 || scaler_has_scale_rows(&state->scaler));
+
+    if(lut != NULL && sr->scaled.data != NULL) {
+        soft_update_lower_index(state, dirty, lut);
+    } else if(!partial) {
+        surface_to_rgba(&sr->lower, sr->tmp_normal, state->cur_palette, NULL, 0);
+        if(sf > 1) {
+            scaler_pool_scale(&state->scaler, sr->tmp_normal, sr->tmp_scaling, 320, 200, sf);
+        }
+        soft_upload_rows(state, 0, 200);
     } else {
-        low_s = surface_from_pixels(sr->tmp_normal, 320, 200);
+        // Convert the changed rows first, since the scaler looks past them
+        int y = 0;
+        while(y < 200) {
+            if(!dirty[y]) {
+                y++;
+                continue;
+            }
+            int y0 = y;
+            while(y < 200 && dirty[y]) {
+                y++;
+            }
+            surface_to_rgba_lut_rows(&sr->lower, sr->tmp_normal, lut, y0, y);
+        }
+
+        uint8_t upload[200];
+        soft_find_upload_rows(dirty, upload, (sf > 1) ? SOFT_SCALE_MARGIN : 0);
+        y = 0;
+        while(y < 200) {
+            if(!upload[y]) {
+                y++;
+                continue;
+            }
+            int y0 = y;
+            while(y < 200 && upload[y]) {
+                y++;
+            }
+            if(sf > 1) {
+                scaler_scale_rows(&state->scaler, sr->tmp_normal, sr->tmp_scaling, 320, 200, sf, y0, y);
+            }
+            soft_upload_rows(state, y0, y);
+        }
     }
 
-    // Make a texture
-    tex = SDL_CreateTextureFromSurface(state->renderer, low_s);
-    SDL_RenderCopy(state->renderer, tex, NULL, NULL);
-    SDL_DestroyTexture(tex);
-    SDL_FreeSurface(low_s);
+    memcpy(sr->prev_lower, sr->lower.data, 320 * 200);
+    memcpy(sr->prev_lower + 320 * 200, sr->lower.stencil, 320 * 200);
+    sr->prev_pal_version = state->cur_palette->version;
+}
+
+void soft_render_finish(video_state *state) {
+    soft_renderer *sr = state->userdata;
+    if(soft_check_textures(state)) {
+        return;
+    }
 
-    // Blit upper
-    tex = SDL_CreateTextureFromSurface(state->renderer, sr->higher);
-    SDL_RenderCopy(state->renderer, tex, NULL, NULL);
-    SDL_DestroyTexture(tex);
+    // Blit lower
+    soft_update_lower(state);
+    SDL_RenderCopy(state->renderer, sr->lower_tex, NULL, NULL);
+
+    // Blit upper. Rows cleared since the last frame must go up as well.
+    int y0 = sr->higher_y0 < sr->prev_higher_y0 ? sr->higher_y0 : sr->prev_higher_y0;
+    int y1 = sr->higher_y1 > sr->prev_higher_y1 ? sr->higher_y1 : sr->prev_higher_y1;
+    if(sr->full_upload) {
+        y0 = 0;
+        y1 = 200;
+    }
+    if(y0 < y1) {
+        SDL_Rect r = {0, y0, 320, y1 - y0};
+        SDL_LockSurface(sr->higher);
+        SDL_UpdateTexture(sr->higher_tex, &r,
+                          (char*)sr->higher->pixels + y0 * sr->higher->pitch,
+                          sr->higher->pitch);
+        SDL_UnlockSurface(sr->higher);
+    }
+    SDL_RenderCopy(state->renderer, sr->higher_tex, NULL, NULL);
+    sr->full_upload = 0;
 }
 
 void soft_render_background(
@@ -93,6 +346,7 @@ void soft_render_background(
 void soft_render_sprite_fsot(
                     video_state *state,
                     surface *sur,
+                    const SDL_Rect *part,
                     SDL_Rect *dst,
                     SDL_BlendMode blend_mode,
                     int pal_offset,
@@ -103,6 +357,8 @@ void soft_render_sprite_fsot(
     // No scaling,
     // No opacity for paletted surfaces
     // No color modulation for paletted surfaces
+    // No partial blits for paletted surfaces
+    // No flipping for alpha surfaces
 
     soft_renderer *sr = state->userdata;
     if(sur->type == SURFACE_TYPE_PALETTE) {
@@ -111,13 +367,39 @@ void soft_render_sprite_fsot(
         } else {
             surface_alpha_blit(&sr->lower, sur, dst->x, dst->y, flip_mode);
         }
+    } else if(sur->type == SURFACE_TYPE_ALPHA) {
+        // Tinted while blending, straight into the layer
+        surface higher;
+        memset(&higher, 0, sizeof(surface));
+        higher.type = SURFACE_TYPE_RGBA;
+        higher.w = 320;
+        higher.h = 200;
+        int y0, y1;
+        SDL_LockSurface(sr->higher);
+        higher.data = sr->higher->pixels;
+        int drawn = surface_alpha_tint_blit(
+            &higher, sur, dst->x, dst->y,
+            (part != NULL) ? part->x : 0, (part != NULL) ? part->y : 0,
+            (part != NULL) ? part->w : sur->w, (part != NULL) ? part->h : sur->h,
+            opacity, color_mod, blend_mode == SDL_BLENDMODE_ADD, &y0, &y1);
+        SDL_UnlockSurface(sr->higher);
+        if(drawn) {
+            if(y0 < sr->higher_y0) sr->higher_y0 = y0;
+            if(y1 > sr->higher_y1) sr->higher_y1 = y1;
+        }
     } else {
-        surface_to_rgba(sur, sr->tmp_normal, state->cur_palette, NULL, 0);
-        SDL_Surface *s = surface_from_pixels(sr->tmp_normal, sur->w, sur->h);
+        // RGBA data can be blitted as is
+        SDL_Surface *s = soft_get_wrapper(sr, sur);
+        if(s == NULL) {
+            return;
+        }
         SDL_SetSurfaceAlphaMod(s, opacity);
         SDL_SetSurfaceColorMod(s, color_mod.r, color_mod.g, color_mod.b);
-        SDL_SetSurfaceBlendMode(s, SDL_BLENDMODE_BLEND);
-        SDL_BlitSurface(s, NULL, sr->higher, dst);
+        if(SDL_BlitSurface(s, (SDL_Rect*)part, sr->higher, dst) == 0 && dst->w > 0 && dst->h > 0) {
+            // dst is clipped to what was drawn
+            if(dst->y < sr->higher_y0) sr->higher_y0 = dst->y;
+            if(dst->y + dst->h > sr->higher_y1) sr->higher_y1 = dst->y + dst->h;
+        }
     }
 }
 
@@ -137,12 +419,22 @@ void video_soft_init(video_state *state) {
     // Preallocate memory for more efficient drawing
     sr->tmp_normal = malloc(320 * 200 * 4);
     sr->tmp_scaling = NULL;
-    if(state->scale_factor > 1) {
-        sr->tmp_scaling = malloc(320 * 200 * 4 * state->scale_factor * state->scale_factor);
-    }
+    sr->prev_lower = malloc(320 * 200 * 2);
+    sr->prev_pal_version = 0;
+    sr->full_upload = 1;
+    sr->higher_y0 = 0;
+    sr->higher_y1 = 200;
+    sr->prev_higher_y0 = 0;
+    sr->prev_higher_y1 = 200;
+    sr->lower_tex = NULL;
+    sr->higher_tex = NULL;
+    sr->tex_scale_factor = 0;
+    memset(sr->wrappers, 0, sizeof(sr->wrappers));
+    memset(&sr->scaled, 0, sizeof(surface));
 
     // Set as userdata
     state->userdata = sr;
+    soft_check_textures(state);
 
     // Bind functions
     state->cb.render_close = soft_render_close;
@@ -151,5 +443,6 @@ void video_soft_init(video_state *state) {
     state->cb.render_finish = soft_render_finish;
     state->cb.render_fsot = soft_render_sprite_fsot;
     state->cb.render_background = soft_render_background;
+    state->cb.render_prewarm = NULL;
     DEBUG("Switched to software renderer.");
 }
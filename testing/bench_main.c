@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "video/surface.h"
+#include "video/screen_palette.h"
+#include "plugins/plugins.h"
+#include "resources/pathmanager.h"
+#include "resources/move_trie.h"
+#include "game/game_state.h"
+#include "game/game_state_type.h"
+#include "game/game_player.h"
+#include "game/protos/object.h"
+#include "game/utils/serial.h"
+#include "controller/net_controller.h"
+#include "controller/net_service.h"
+#include "utils/hashmap.h"
+#include "utils/vector.h"
+#include "utils/random.h"
+#include "utils/log.h"
+
+/*
+* Microbenchmarks for the core kernels. Every benchmark runs a fixed amount
+* of work on fixed, seeded input, so numbers are comparable between builds.
+*
+* Usage: openomf_bench [filter]
+* Only benchmarks whose name contains the filter string are run. Results go
+* to stdout as CSV, one benchmark per line. Times are nanoseconds per op.
+*
+* The net benchmarks are soaks rather than timings: both peers run in this
+* process, over loopback and the network condition emulation. There an op is
+* an input tick, and the times are how long its first copy took to arrive.
+*/
+
+#define BENCH_RUNS 7
+#define BENCH_SEED 0x1234abcd
+
+typedef void (*bench_func)(void *ctx, int ops);
+
+static const char *bench_filter = NULL;
+static struct random_t bench_rand;
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+// Runs the benchmark once to warm up, then BENCH_RUNS times for real
+static void bench_run(const char *name, bench_func f, void *ctx, int ops) {
+    if(bench_filter != NULL && strstr(name, bench_filter) == NULL) {
+        return;
+    }
+    double ns_per_count = 1000000000.0 / SDL_GetPerformanceFrequency();
+    double runs[BENCH_RUNS];
+    f(ctx, ops);
+    for(int i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        f(ctx, ops);
+        runs[i] = (SDL_GetPerformanceCounter() - start) * ns_per_count / ops;
+    }
+    qsort(runs, BENCH_RUNS, sizeof(double), compare_double);
+    printf("%s,%d,%.2f,%.2f\n", name, ops, runs[0], runs[BENCH_RUNS / 2]);
+    fflush(stdout);
+}
+
+// Surfaces ----------------------------------------------------------------
+
+typedef struct surface_ctx_t {
+    surface pal_dst;
+    surface pal_src;
+    surface glow_src;
+    surface pal_packed;
+    surface glow_packed;
+    surface rgba_dst;
+    surface rgba_src;
+    screen_palette pal;
+    palette remap_pal;
+    palette_lut lut;
+    char *rgba;
+} surface_ctx;
+
+// Sprite-like paletted surface: a fully opaque block with transparent borders
+static void bench_fill_sprite(surface *sur) {
+    for(int y = 0; y < sur->h; y++) {
+        for(int x = 0; x < sur->w; x++) {
+            int i = x + y * sur->w;
+            int border = x < sur->w / 8 || x >= sur->w - sur->w / 8;
+            sur->data[i] = random_int(&bench_rand, 256);
+            sur->stencil[i] = border ? 0 : 1;
+        }
+    }
+    surface_build_rle(sur);
+}
+
+// Additive sources only use the first few palette indexes, one per remap table
+static void bench_fill_glow(surface *sur) {
+    bench_fill_sprite(sur);
+    for(int i = 0; i < sur->w * sur->h; i++) {
+        sur->data[i] = random_int(&bench_rand, 16);
+    }
+}
+
+// Same pixels with only the runs kept, the way sprites are held
+static void bench_pack(surface *dst, surface *src) {
+    surface_copy(dst, src);
+    for(int i = 0; i < dst->w * dst->h; i++) {
+        if(dst->stencil[i] != 1) {
+            dst->data[i] = 0;
+        }
+    }
+    surface_build_rle(dst);
+    surface_build_hitmask(dst);
+    surface_pack_stencil(dst);
+    surface_pack_pixels(dst);
+}
+
+static void bench_fill_rgba(surface *sur) {
+    for(int i = 0; i < sur->w * sur->h * 4; i++) {
+        sur->data[i] = random_int(&bench_rand, 256);
+    }
+}
+
+static void surface_ctx_create(surface_ctx *ctx) {
+    surface_create(&ctx->pal_dst, SURFACE_TYPE_PALETTE, 320, 200);
+    surface_create(&ctx->pal_src, SURFACE_TYPE_PALETTE, 160, 120);
+    surface_create(&ctx->glow_src, SURFACE_TYPE_PALETTE, 160, 120);
+    surface_create(&ctx->rgba_dst, SURFACE_TYPE_RGBA, 320, 200);
+    surface_create(&ctx->rgba_src, SURFACE_TYPE_RGBA, 160, 120);
+    bench_fill_sprite(&ctx->pal_dst);
+    bench_fill_sprite(&ctx->pal_src);
+    bench_fill_glow(&ctx->glow_src);
+    bench_pack(&ctx->pal_packed, &ctx->pal_src);
+    bench_pack(&ctx->glow_packed, &ctx->glow_src);
+    bench_fill_rgba(&ctx->rgba_dst);
+    bench_fill_rgba(&ctx->rgba_src);
+    memset(&ctx->pal, 0, sizeof(screen_palette));
+    for(int i = 0; i < 256; i++) {
+        ctx->pal.data[i][0] = i;
+        ctx->pal.data[i][1] = 255 - i;
+        ctx->pal.data[i][2] = i / 2;
+    }
+    for(int k = 0; k < 19; k++) {
+        for(int i = 0; i < 256; i++) {
+            ctx->remap_pal.remaps[k][i] = random_int(&bench_rand, 256);
+        }
+    }
+    surface_build_lut(&ctx->lut, &ctx->pal, NULL, 0);
+    ctx->rgba = malloc(320 * 200 * 4);
+}
+
+static void surface_ctx_free(surface_ctx *ctx) {
+    surface_free(&ctx->pal_dst);
+    surface_free(&ctx->pal_src);
+    surface_free(&ctx->glow_src);
+    surface_free(&ctx->pal_packed);
+    surface_free(&ctx->glow_packed);
+    surface_free(&ctx->rgba_dst);
+    surface_free(&ctx->rgba_src);
+    free(ctx->rgba);
+}
+
+static void bench_surface_to_rgba(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_to_rgba(&ctx->pal_dst, ctx->rgba, &ctx->pal, NULL, 0);
+    }
+}
+
+static void bench_surface_to_rgba_lut(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_to_rgba_lut(&ctx->pal_dst, ctx->rgba, &ctx->lut);
+    }
+}
+
+static void bench_surface_sub(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_sub(&ctx->pal_dst, &ctx->pal_src, 80, 40, 0, 0, 160, 120, SUB_METHOD_NONE);
+    }
+}
+
+static void bench_surface_sub_mirror(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_sub(&ctx->pal_dst, &ctx->pal_src, 80, 40, 0, 0, 160, 120, SUB_METHOD_MIRROR);
+    }
+}
+
+static void bench_surface_alpha_blit(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_alpha_blit(&ctx->pal_dst, &ctx->pal_src, 80, 40, SDL_FLIP_NONE);
+    }
+}
+
+static void bench_surface_alpha_blit_flip(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_alpha_blit(&ctx->pal_dst, &ctx->pal_src, 80, 40, SDL_FLIP_HORIZONTAL);
+    }
+}
+
+static void bench_surface_additive_blit(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_additive_blit(&ctx->pal_dst, &ctx->glow_src, 80, 40, &ctx->remap_pal, SDL_FLIP_NONE);
+    }
+}
+
+static void bench_surface_to_rgba_packed(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_to_rgba_lut(&ctx->pal_packed, ctx->rgba, &ctx->lut);
+    }
+}
+
+static void bench_surface_alpha_blit_packed(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_alpha_blit(&ctx->pal_dst, &ctx->pal_packed, 80, 40, SDL_FLIP_NONE);
+    }
+}
+
+static void bench_surface_alpha_blit_packed_flip(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_alpha_blit(&ctx->pal_dst, &ctx->pal_packed, 80, 40, SDL_FLIP_HORIZONTAL);
+    }
+}
+
+static void bench_surface_additive_blit_packed(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_additive_blit(&ctx->pal_dst, &ctx->glow_packed, 80, 40, &ctx->remap_pal, SDL_FLIP_NONE);
+    }
+}
+
+static void bench_surface_rgba_blit(void *userdata, int ops) {
+    surface_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        surface_rgba_blit(&ctx->rgba_dst, &ctx->rgba_src, 80, 40);
+    }
+}
+
+static void bench_surfaces() {
+    surface_ctx ctx;
+    surface_ctx_create(&ctx);
+    bench_run("surface.to_rgba", bench_surface_to_rgba, &ctx, 200);
+    bench_run("surface.to_rgba_lut", bench_surface_to_rgba_lut, &ctx, 200);
+    bench_run("surface.sub", bench_surface_sub, &ctx, 1000);
+    bench_run("surface.sub_mirror", bench_surface_sub_mirror, &ctx, 1000);
+    bench_run("surface.alpha_blit", bench_surface_alpha_blit, &ctx, 1000);
+    bench_run("surface.alpha_blit_flip", bench_surface_alpha_blit_flip, &ctx, 1000);
+    bench_run("surface.additive_blit", bench_surface_additive_blit, &ctx, 1000);
+    bench_run("surface.to_rgba_packed", bench_surface_to_rgba_packed, &ctx, 200);
+    bench_run("surface.alpha_blit_packed", bench_surface_alpha_blit_packed, &ctx, 1000);
+    bench_run("surface.alpha_blit_packed_flip", bench_surface_alpha_blit_packed_flip, &ctx, 1000);
+    bench_run("surface.additive_blit_packed", bench_surface_additive_blit_packed, &ctx, 1000);
+    bench_run("surface.rgba_blit", bench_surface_rgba_blit, &ctx, 1000);
+    surface_ctx_free(&ctx);
+}
+
+// Scalers -----------------------------------------------------------------
+
+typedef struct scaler_ctx_t {
+    scaler_plugin scaler;
+    char *in;
+    char *out;
+    int factor;
+} scaler_ctx;
+
+static void bench_scaler_scale(void *userdata, int ops) {
+    scaler_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        scaler_scale(&ctx->scaler, ctx->in, ctx->out, 320, 200, ctx->factor);
+    }
+}
+
+// Scalers are plugins, so these only run if some are installed
+static void bench_scalers() {
+    if(pm_init() != 0) {
+        fprintf(stderr, "Skipping scalers: %s\n", pm_get_errormsg());
+        return;
+    }
+    plugins_init();
+
+    list scalers;
+    list_create(&scalers);
+    plugins_get_list_by_type(&scalers, "scaler");
+    if(list_size(&scalers) == 0) {
+        fprintf(stderr, "Skipping scalers: no scaler plugins found\n");
+    }
+
+    scaler_ctx ctx;
+    ctx.in = malloc(320 * 200 * 4);
+    ctx.out = malloc(320 * 200 * 4 * 4 * 4);
+    for(int i = 0; i < 320 * 200 * 4; i++) {
+        ctx.in[i] = random_int(&bench_rand, 256);
+    }
+
+    iterator it;
+    list_iter_begin(&scalers, &it);
+    base_plugin **plugin;
+    while((plugin = iter_next(&it)) != NULL) {
+        const char *scaler_name = (*plugin)->name;
+        scaler_init(&ctx.scaler);
+        if(plugins_get_scaler(&ctx.scaler, scaler_name)) {
+            continue;
+        }
+        for(ctx.factor = 2; ctx.factor <= 4; ctx.factor++) {
+            if(!scaler_is_factor_available(&ctx.scaler, ctx.factor)) {
+                continue;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "scaler.%s.x%d", scaler_name, ctx.factor);
+            bench_run(name, bench_scaler_scale, &ctx, 20);
+        }
+    }
+
+    free(ctx.in);
+    free(ctx.out);
+    list_free(&scalers);
+    plugins_close();
+    pm_free();
+}
+
+// Containers --------------------------------------------------------------
+
+#define BENCH_KEYS 512
+#define BENCH_VECTOR_ITEMS 256
+
+// Same layout as the texture cache keys
+typedef struct bench_key_t {
+    void *surface;
+    char *remap_table;
+    uint16_t w, h;
+    uint8_t pal_offset;
+} bench_key;
+
+typedef struct hashmap_ctx_t {
+    hashmap map;
+    bench_key keys[BENCH_KEYS];
+    char value[64];
+} hashmap_ctx;
+
+static void bench_hashmap_put(void *userdata, int ops) {
+    hashmap_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        if(i % BENCH_KEYS == 0) {
+            hashmap_clear(&ctx->map);
+        }
+        hashmap_put(&ctx->map, &ctx->keys[i % BENCH_KEYS], sizeof(bench_key), ctx->value, sizeof(ctx->value));
+    }
+}
+
+static void bench_hashmap_get(void *userdata, int ops) {
+    hashmap_ctx *ctx = userdata;
+    void *val;
+    unsigned int len;
+    for(int i = 0; i < ops; i++) {
+        hashmap_get(&ctx->map, &ctx->keys[i % BENCH_KEYS], sizeof(bench_key), &val, &len);
+    }
+}
+
+// Fills the vector up to object list size and empties it again, front first
+static void bench_vector_append_delete(void *userdata, int ops) {
+    vector *vec = userdata;
+    char item[32] = {0};
+    for(int done = 0; done < ops; done += BENCH_VECTOR_ITEMS) {
+        for(int i = 0; i < BENCH_VECTOR_ITEMS; i++) {
+            vector_append(vec, item);
+        }
+        iterator it;
+        vector_iter_begin(vec, &it);
+        while(iter_next(&it) != NULL) {
+            vector_delete(vec, &it);
+        }
+    }
+}
+
+static void bench_containers() {
+    hashmap_ctx ctx;
+    // The texture cache starts out with the same size
+    hashmap_create(&ctx.map, 6);
+    memset(ctx.keys, 0, sizeof(ctx.keys));
+    for(int i = 0; i < BENCH_KEYS; i++) {
+        ctx.keys[i].surface = (void*)(uintptr_t)(0x10000 + i * 64);
+        ctx.keys[i].w = 16 + random_int(&bench_rand, 240);
+        ctx.keys[i].h = 16 + random_int(&bench_rand, 180);
+        ctx.keys[i].pal_offset = random_int(&bench_rand, 2) * 48;
+    }
+    memset(ctx.value, 0, sizeof(ctx.value));
+    bench_run("hashmap.put", bench_hashmap_put, &ctx, BENCH_KEYS * 100);
+    bench_run("hashmap.get", bench_hashmap_get, &ctx, BENCH_KEYS * 100);
+    hashmap_free(&ctx.map);
+
+    vector vec;
+    vector_create(&vec, 32);
+    bench_run("vector.append_delete", bench_vector_append_delete, &vec, BENCH_VECTOR_ITEMS * 400);
+    vector_free(&vec);
+}
+
+// Serialization -----------------------------------------------------------
+
+static void bench_serial_write_int8(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_clear(ser);
+    for(int i = 0; i < ops; i++) {
+        serial_write_int8(ser, i);
+    }
+}
+
+static void bench_serial_write_int16(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_clear(ser);
+    for(int i = 0; i < ops; i++) {
+        serial_write_int16(ser, i);
+    }
+}
+
+static void bench_serial_write_int32(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_clear(ser);
+    for(int i = 0; i < ops; i++) {
+        serial_write_int32(ser, i);
+    }
+}
+
+static void bench_serial_write_float(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_clear(ser);
+    for(int i = 0; i < ops; i++) {
+        serial_write_float(ser, i * 0.5f);
+    }
+}
+
+// Reads back what bench_serial_write_int32 wrote
+static void bench_serial_read_int32(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_read_reset(ser);
+    uint32_t sum = 0;
+    for(int i = 0; i < ops; i++) {
+        sum += serial_read_int32(ser);
+    }
+    if(sum == 1) {
+        printf("unreachable\n");
+    }
+}
+
+static void bench_serial_get_int32(void *userdata, int ops) {
+    serial *ser = userdata;
+    serial_read_reset(ser);
+    const char *p = serial_read_block(ser, ops * 4);
+    uint32_t sum = 0;
+    for(int i = 0; p != NULL && i < ops; i++) {
+        sum += serial_get_int32(&p);
+    }
+    if(sum == 1) {
+        printf("unreachable\n");
+    }
+}
+
+typedef struct state_ctx_t {
+    game_state gs;
+    object hars[2];
+    animation ani;
+    serial ser;
+} state_ctx;
+
+static void bench_game_state_serialize(void *userdata, int ops) {
+    state_ctx *ctx = userdata;
+    for(int i = 0; i < ops; i++) {
+        serial_clear(&ctx->ser);
+        game_state_serialize(&ctx->gs, &ctx->ser);
+    }
+}
+
+// Only the parts of a game state that serialization reads are set up; HARs
+// are plain objects, since real ones need the game data files.
+static void state_ctx_create(state_ctx *ctx) {
+    memset(ctx, 0, sizeof(state_ctx));
+    vector_create(&ctx->gs.objects, sizeof(void*));
+    ctx->ani.id = 1;
+    for(int i = 0; i < 2; i++) {
+        ctx->gs.players[i] = malloc(sizeof(game_player));
+        game_player_create(ctx->gs.players[i]);
+        object_create(&ctx->hars[i], &ctx->gs, vec2i_create(60 + i * 200, 190), vec2f_create(0, 0));
+        ctx->hars[i].cur_animation = &ctx->ani;
+        ctx->gs.players[i]->har = &ctx->hars[i];
+    }
+    serial_create_size(&ctx->ser, GAME_STATE_SERIAL_SIZE_HINT);
+}
+
+static void state_ctx_free(state_ctx *ctx) {
+    for(int i = 0; i < 2; i++) {
+        ctx->gs.players[i]->har = NULL;
+        object_free(&ctx->hars[i]);
+        game_player_free(ctx->gs.players[i]);
+        free(ctx->gs.players[i]);
+    }
+    vector_free(&ctx->gs.objects);
+    serial_free(&ctx->ser);
+}
+
+static void bench_serialization() {
+    serial ser;
+    serial_create(&ser);
+    bench_run("serial.write_int8", bench_serial_write_int8, &ser, 100000);
+    bench_run("serial.write_int16", bench_serial_write_int16, &ser, 100000);
+    bench_run("serial.write_int32", bench_serial_write_int32, &ser, 100000);
+    bench_run("serial.write_float", bench_serial_write_float, &ser, 100000);
+    bench_serial_write_int32(&ser, 100000);
+    bench_run("serial.read_int32", bench_serial_read_int32, &ser, 100000);
+    bench_run("serial.get_int32", bench_serial_get_int32, &ser, 100000);
+    serial_free(&ser);
+
+    state_ctx ctx;
+    state_ctx_create(&ctx);
+    bench_run("game_state.serialize", bench_game_state_serialize, &ctx, 10000);
+    state_ctx_free(&ctx);
+}
+
+// Move matching -----------------------------------------------------------
+
+#define BENCH_MOVES 70
+#define BENCH_INPUTS 64
+
+typedef struct move_ctx_t {
+    move_trie trie;
+    move_mask filter;
+    char inputs[BENCH_INPUTS][11];
+} move_ctx;
+
+// Same lookup as match_move, without the HAR state checks
+static void bench_match_move(void *userdata, int ops) {
+    move_ctx *ctx = userdata;
+    int found = 0;
+    for(int i = 0; i < ops; i++) {
+        move_mask candidates;
+        move_trie_match(&ctx->trie, ctx->inputs[i % BENCH_INPUTS], &candidates);
+        move_mask_and(&candidates, &ctx->filter);
+        for(int m = move_mask_next(&candidates, 0); m >= 0; m = move_mask_next(&candidates, m + 1)) {
+            found++;
+        }
+    }
+    if(found < 0) {
+        printf("unreachable\n");
+    }
+}
+
+// As har_act does it: one input at a time, moves read off the node
+static void bench_step_move(void *userdata, int ops) {
+    move_ctx *ctx = userdata;
+    int found = 0;
+    int node = MOVE_TRIE_START;
+    for(int i = 0; i < ops; i++) {
+        node = move_trie_step(&ctx->trie, node, ctx->inputs[i % BENCH_INPUTS][0]);
+        move_mask candidates = *move_trie_moves(&ctx->trie, node);
+        move_mask_and(&candidates, &ctx->filter);
+        for(int m = move_mask_next(&candidates, 0); m >= 0; m = move_mask_next(&candidates, m + 1)) {
+            found++;
+        }
+    }
+    if(found < 0) {
+        printf("unreachable\n");
+    }
+}
+
+static void bench_moves() {
+    // Move strings look like the AF ones: an attack key and a few directions
+    const char *keys = "KP";
+    const char *dirs = "123456789";
+    move_ctx ctx;
+    move_trie_create(&ctx.trie);
+    move_mask_clear(&ctx.filter);
+    for(int i = 0; i < BENCH_MOVES; i++) {
+        char str[6];
+        int len = 1 + random_int(&bench_rand, 4);
+        str[0] = keys[random_int(&bench_rand, 2)];
+        for(int k = 1; k < len; k++) {
+            str[k] = dirs[random_int(&bench_rand, 9)];
+        }
+        str[len] = '\0';
+        move_trie_add(&ctx.trie, str, i);
+        if(random_int(&bench_rand, 4) != 0) {
+            move_mask_set(&ctx.filter, i);
+        }
+    }
+    move_trie_build(&ctx.trie);
+    for(int i = 0; i < BENCH_INPUTS; i++) {
+        ctx.inputs[i][0] = (i % 3 == 0) ? keys[random_int(&bench_rand, 2)] : '5';
+        for(int k = 1; k < 10; k++) {
+            ctx.inputs[i][k] = dirs[random_int(&bench_rand, 9)];
+        }
+        ctx.inputs[i][10] = '\0';
+    }
+    bench_run("har.match_move", bench_match_move, &ctx, 100000);
+    bench_run("har.step_move", bench_step_move, &ctx, 100000);
+    move_trie_free(&ctx.trie);
+}
+
+// Netplay loopback -------------------------------------------------------
+
+#define BENCH_NET_PORT 23457
+#define BENCH_NET_TICKS 500
+#define BENCH_NET_TICK_MS 2
+#define BENCH_NET_LINGER_MS 1000
+
+typedef struct net_profile_t {
+    const char *name;
+    const char *conditions;
+} net_profile;
+
+static const net_profile bench_net_profiles[] = {
+    {"clean", "off"},
+    {"lan", "latency=2,jitter=1"},
+    {"wan", "latency=40,jitter=10,loss=3,dup=1,reorder=2"},
+    {"bad", "latency=100,jitter=40,loss=15,dup=2,reorder=5"},
+};
+
+// Brings up a client and server host and connects them, before the services
+// take the hosts over
+static int bench_net_connect(ENetHost **server, ENetHost **client, ENetPeer **server_peer, ENetPeer **client_peer) {
+    ENetAddress address;
+    ENetEvent event;
+    enet_address_set_host(&address, "127.0.0.1");
+    address.port = BENCH_NET_PORT;
+    *server = enet_host_create(&address, 1, NET_CHANNEL_COUNT, 0, 0);
+    *client = enet_host_create(NULL, 1, NET_CHANNEL_COUNT, 0, 0);
+    if(*server == NULL || *client == NULL) {
+        return 1;
+    }
+    *client_peer = enet_host_connect(*client, &address, NET_CHANNEL_COUNT, 0);
+    *server_peer = NULL;
+    int client_connected = 0;
+    Uint32 deadline = SDL_GetTicks() + 2000;
+    while((*server_peer == NULL || !client_connected) && !SDL_TICKS_PASSED(SDL_GetTicks(), deadline)) {
+        if(enet_host_service(*server, &event, 1) > 0 && event.type == ENET_EVENT_TYPE_CONNECT) {
+            *server_peer = event.peer;
+        }
+        if(enet_host_service(*client, &event, 1) > 0 && event.type == ENET_EVENT_TYPE_CONNECT) {
+            client_connected = 1;
+        }
+    }
+    return (*server_peer == NULL || !client_connected);
+}
+
+static void bench_net_receive(net_service *ns, uint64_t *sent, uint64_t *arrived) {
+    ENetEvent event;
+    while(net_service_poll(ns, &event) == 0) {
+        if(event.type != ENET_EVENT_TYPE_RECEIVE) {
+            continue;
+        }
+        uint64_t now = SDL_GetPerformanceCounter();
+        const uint32_t *ticks = (const uint32_t*)event.packet->data;
+        size_t count = event.packet->dataLength / sizeof(uint32_t);
+        for(size_t i = 0; i < count; i++) {
+            if(ticks[i] < BENCH_NET_TICKS && arrived[ticks[i]] == 0) {
+                arrived[ticks[i]] = now - sent[ticks[i]];
+            }
+        }
+        enet_packet_destroy(event.packet);
+    }
+}
+
+// The client sends an input packet per tick, repeating the last ticks the way
+// the net controller does, and the server notes when each tick first arrives
+static void bench_net_run(const net_profile *profile, int redundancy) {
+    char name[64];
+    snprintf(name, sizeof(name), "net.%s.redundancy%d", profile->name, redundancy);
+    if(bench_filter != NULL && strstr(name, bench_filter) == NULL) {
+        return;
+    }
+
+    ENetHost *server_host, *client_host;
+    ENetPeer *server_peer, *client_peer;
+    if(bench_net_connect(&server_host, &client_host, &server_peer, &client_peer)) {
+        fprintf(stderr, "Skipping %s: loopback connection failed\n", name);
+        if(server_host != NULL) {
+            enet_host_destroy(server_host);
+        }
+        if(client_host != NULL) {
+            enet_host_destroy(client_host);
+        }
+        return;
+    }
+    net_service *server = net_service_create(server_host);
+    net_service *client = net_service_create(client_host);
+    net_emu_parse(profile->conditions);
+
+    uint64_t *sent = calloc(BENCH_NET_TICKS, sizeof(uint64_t));
+    uint64_t *arrived = calloc(BENCH_NET_TICKS, sizeof(uint64_t));
+    uint32_t ticks[16];
+    for(uint32_t tick = 0; tick < BENCH_NET_TICKS; tick++) {
+        sent[tick] = SDL_GetPerformanceCounter();
+        int count = 0;
+        for(int i = 0; i < redundancy && i <= (int)tick; i++) {
+            ticks[count++] = tick - i;
+        }
+        ENetPacket *packet = enet_packet_create(ticks, count * sizeof(uint32_t), ENET_PACKET_FLAG_UNSEQUENCED);
+        net_service_send(client, client_peer, NET_CHANNEL_INPUT, packet);
+        net_service_flush(client);
+        bench_net_receive(server, sent, arrived);
+        SDL_Delay(BENCH_NET_TICK_MS);
+    }
+    Uint32 deadline = SDL_GetTicks() + BENCH_NET_LINGER_MS;
+    while(!SDL_TICKS_PASSED(SDL_GetTicks(), deadline)) {
+        bench_net_receive(server, sent, arrived);
+        SDL_Delay(1);
+    }
+
+    double ns_per_count = 1000000000.0 / SDL_GetPerformanceFrequency();
+    double *times = malloc(sizeof(double) * BENCH_NET_TICKS);
+    int received = 0;
+    for(int i = 0; i < BENCH_NET_TICKS; i++) {
+        if(arrived[i] != 0) {
+            times[received++] = arrived[i] * ns_per_count;
+        }
+    }
+    if(received > 0) {
+        qsort(times, received, sizeof(double), compare_double);
+        printf("%s,%d,%.2f,%.2f\n", name, BENCH_NET_TICKS, times[0], times[received / 2]);
+        fflush(stdout);
+    }
+    if(received < BENCH_NET_TICKS) {
+        fprintf(stderr, "%s: %d of %d ticks never arrived\n", name, BENCH_NET_TICKS - received, BENCH_NET_TICKS);
+    }
+
+    net_emu_parse("off");
+    net_service_close(client);
+    net_service_close(server);
+    net_service_wait_all(3000);
+    free(times);
+    free(sent);
+    free(arrived);
+}
+
+static void bench_net() {
+    if(enet_initialize() != 0) {
+        fprintf(stderr, "Skipping net: enet_initialize failed\n");
+        return;
+    }
+    net_emu_seed(BENCH_SEED);
+    for(unsigned int i = 0; i < sizeof(bench_net_profiles) / sizeof(net_profile); i++) {
+        bench_net_run(&bench_net_profiles[i], 1);
+        bench_net_run(&bench_net_profiles[i], 8);
+    }
+    enet_deinitialize();
+}
+
+int main(int argc, char **argv) {
+    if(argc > 1) {
+        bench_filter = argv[1];
+    }
+    if(log_init("openomf_bench.log")) {
+        fprintf(stderr, "Unable to open openomf_bench.log\n");
+        return 1;
+    }
+    if(SDL_Init(SDL_INIT_TIMER)) {
+        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    random_seed(&bench_rand, BENCH_SEED);
+    rand_seed(BENCH_SEED);
+
+    printf("name,ops,min_ns,median_ns\n");
+    bench_surfaces();
+    bench_scalers();
+    bench_containers();
+    bench_serialization();
+    bench_moves();
+    bench_net();
+
+    SDL_Quit();
+    log_close();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/cpu.h>
+#include <video/surface.h>
+
+#define TEST_CPU_W 37
+#define TEST_CPU_H 5
+
+void test_cpu_parse_features(void) {
+    CU_ASSERT(cpu_parse_features("") == 0);
+    CU_ASSERT(cpu_parse_features("none") == 0);
+    CU_ASSERT(cpu_parse_features("sse2") == CPU_SSE2);
+    CU_ASSERT(cpu_parse_features("sse2,avx2") == (CPU_SSE2|CPU_AVX2));
+    CU_ASSERT(cpu_parse_features("neon,ssse3,") == (CPU_NEON|CPU_SSSE3));
+    CU_ASSERT(cpu_parse_features("sse") == -1);
+    CU_ASSERT(cpu_parse_features("avx2,mmx") == -1);
+}
+
+void test_cpu_features_to_str(void) {
+    char buf[64];
+    cpu_features_to_str(0, buf, sizeof(buf));
+    CU_ASSERT(strcmp(buf, "none") == 0);
+    cpu_features_to_str(CPU_SSE2|CPU_AVX2, buf, sizeof(buf));
+    CU_ASSERT(strcmp(buf, "sse2,avx2") == 0);
+    CU_ASSERT(cpu_parse_features(buf) == (CPU_SSE2|CPU_AVX2));
+}
+
+void test_cpu_parse_cores(void) {
+    uint64_t cores = 1;
+    CU_ASSERT(cpu_parse_cores("", &cores) == 0 && cores == 0);
+    CU_ASSERT(cpu_parse_cores("3", &cores) == 0 && cores == 0x8);
+    CU_ASSERT(cpu_parse_cores("0,2-3", &cores) == 0 && cores == 0xD);
+    CU_ASSERT(cpu_parse_cores("63", &cores) == 0 && cores == (uint64_t)1 << 63);
+    CU_ASSERT(cpu_parse_cores("64", &cores) == -1);
+    CU_ASSERT(cpu_parse_cores("3-1", &cores) == -1);
+    CU_ASSERT(cpu_parse_cores("1;2", &cores) == -1);
+    CU_ASSERT(cpu_parse_cores("a", &cores) == -1);
+
+    char buf[64];
+    cpu_cores_to_str(0, buf, sizeof(buf));
+    CU_ASSERT(strcmp(buf, "none") == 0);
+    cpu_cores_to_str(0xED, buf, sizeof(buf));
+    CU_ASSERT(strcmp(buf, "0,2-3,5-7") == 0);
+    CU_ASSERT(cpu_parse_cores(buf, &cores) == 0 && cores == 0xED);
+}
+
+void test_cpu_override(void) {
+    cpu_init(NULL);
+    int detected = cpu_get_features();
+    cpu_init("none");
+    CU_ASSERT(cpu_get_features() == 0);
+    cpu_init("sse2,avx2,neon");
+    CU_ASSERT((cpu_get_features() & ~detected) == 0);
+    cpu_set_features(detected);
+}
+
+// Every kernel the CPU can run must match the scalar conversion
+void test_cpu_surface_kernels(void) {
+    static const int sets[] = {0, CPU_SSE2, CPU_SSE2|CPU_AVX2, CPU_NEON};
+    int detected = cpu_get_features();
+    palette_lut lut;
+    for(int i = 0; i < 256; i++) {
+        lut.packed[i] = 0xFF000000u | (i * 0x010307u);
+    }
+    surface sur;
+    surface_create(&sur, SURFACE_TYPE_PALETTE, TEST_CPU_W, TEST_CPU_H);
+    for(int i = 0; i < TEST_CPU_W * TEST_CPU_H; i++) {
+        sur.data[i] = (char)(i * 7);
+        sur.stencil[i] = (i % 3) ? 1 : 0;
+    }
+
+    char expect[TEST_CPU_W * TEST_CPU_H * 4];
+    char got[TEST_CPU_W * TEST_CPU_H * 4];
+    cpu_set_features(0);
+    surface_select_kernels();
+    surface_to_rgba_lut(&sur, expect, &lut);
+    for(unsigned int k = 1; k < sizeof(sets) / sizeof(sets[0]); k++) {
+        if((sets[k] & detected) != sets[k]) {
+            continue;
+        }
+        cpu_set_features(sets[k]);
+        surface_select_kernels();
+        memset(got, 0, sizeof(got));
+        surface_to_rgba_lut(&sur, got, &lut);
+        CU_ASSERT(memcmp(expect, got, sizeof(got)) == 0);
+    }
+
+    cpu_set_features(detected);
+    surface_select_kernels();
+    surface_free(&sur);
+}
+
+void cpu_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for cpu feature parsing", test_cpu_parse_features) == NULL) { return; }
+    if(CU_add_test(suite, "Test for cpu feature names", test_cpu_features_to_str) == NULL) { return; }
+    if(CU_add_test(suite, "Test for cpu core lists", test_cpu_parse_cores) == NULL) { return; }
+    if(CU_add_test(suite, "Test for cpu feature override", test_cpu_override) == NULL) { return; }
+    if(CU_add_test(suite, "Test for surface kernels", test_cpu_surface_kernels) == NULL) { return; }
+}
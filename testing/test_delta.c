@@ -0,0 +1,69 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/delta.h>
+#include <string.h>
+
+#define TEST_BUF_SIZE 103
+
+char test_base[TEST_BUF_SIZE];
+char test_data[TEST_BUF_SIZE + 16];
+char test_delta[1024];
+char test_out[TEST_BUF_SIZE + 16];
+
+static long roundtrip(size_t base_len, size_t len) {
+    size_t dlen = delta_encode(test_base, base_len, test_data, len, test_delta);
+    CU_ASSERT(dlen <= delta_max_size(len));
+    CU_ASSERT(delta_decoded_len(test_delta, dlen) == (long)len);
+    memset(test_out, 0xAA, sizeof(test_out));
+    long ret = delta_decode(test_base, base_len, test_delta, dlen, test_out, sizeof(test_out));
+    CU_ASSERT(ret == (long)len);
+    CU_ASSERT(memcmp(test_out, test_data, len) == 0);
+    return dlen;
+}
+
+void test_delta_unchanged(void) {
+    for(int i = 0; i < TEST_BUF_SIZE; i++) {
+        test_base[i] = i * 7;
+    }
+    memcpy(test_data, test_base, TEST_BUF_SIZE);
+
+    // Only the length and the mask should be needed
+    long dlen = roundtrip(TEST_BUF_SIZE, TEST_BUF_SIZE);
+    CU_ASSERT(dlen == 1 + (TEST_BUF_SIZE / 4 + 1 + 7) / 8);
+}
+
+void test_delta_changed(void) {
+    test_data[3] ^= 1;
+    test_data[50] = 0x7F;
+    test_data[TEST_BUF_SIZE-1] = 0;
+    long dlen = roundtrip(TEST_BUF_SIZE, TEST_BUF_SIZE);
+    CU_ASSERT(dlen < TEST_BUF_SIZE / 2);
+}
+
+void test_delta_resize(void) {
+    // Grow beyond the base, then shrink below it
+    memset(test_data + TEST_BUF_SIZE, 0x55, 16);
+    roundtrip(TEST_BUF_SIZE, TEST_BUF_SIZE + 16);
+    roundtrip(TEST_BUF_SIZE, 10);
+    roundtrip(TEST_BUF_SIZE, 0);
+}
+
+void test_delta_no_base(void) {
+    roundtrip(0, TEST_BUF_SIZE + 16);
+}
+
+void test_delta_malformed(void) {
+    size_t dlen = delta_encode(test_base, TEST_BUF_SIZE, test_data, TEST_BUF_SIZE, test_delta);
+    CU_ASSERT(delta_decode(test_base, TEST_BUF_SIZE, test_delta, dlen - 1, test_out, sizeof(test_out)) == -1);
+    CU_ASSERT(delta_decode(test_base, TEST_BUF_SIZE, test_delta, dlen, test_out, 10) == -1);
+    CU_ASSERT(delta_decoded_len(test_delta, 0) == -1);
+}
+
+void delta_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for delta of unchanged data", test_delta_unchanged) == NULL) { return; }
+    if(CU_add_test(suite, "Test for delta of changed data", test_delta_changed) == NULL) { return; }
+    if(CU_add_test(suite, "Test for delta with resize", test_delta_resize) == NULL) { return; }
+    if(CU_add_test(suite, "Test for delta without base", test_delta_no_base) == NULL) { return; }
+    if(CU_add_test(suite, "Test for malformed delta", test_delta_malformed) == NULL) { return; }
+}
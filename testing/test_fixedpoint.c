@@ -0,0 +1,69 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <math.h>
+#include <utils/fixedpoint.h>
+
+void test_fixed_convert(void) {
+    CU_ASSERT(fixed_from_int(3) == 3 * FIXED_ONE);
+    CU_ASSERT(fixed_to_int(fixed_from_int(-7)) == -7);
+    CU_ASSERT(fixed_to_int(fixed_from_float(-0.5f)) == -1);
+    CU_ASSERT(fixed_from_float(1.5f) == FIXED_ONE + FIXED_ONE / 2);
+    CU_ASSERT(fixed_to_float(fixed_from_float(-2.25f)) == -2.25f);
+}
+
+void test_fixed_mul_div(void) {
+    fixed a = fixed_from_float(1.5f);
+    fixed b = fixed_from_float(-4.0f);
+    CU_ASSERT(fixed_mul(a, b) == fixed_from_int(-6));
+    CU_ASSERT(fixed_div(fixed_from_int(-6), b) == a);
+    CU_ASSERT(fixed_div(a, 0) == 0);
+    // Negative dividends, with and without a negative divisor
+    CU_ASSERT(fixed_div(fixed_from_int(-6), fixed_from_int(4)) == -a);
+    CU_ASSERT(fixed_div(fixed_from_float(-0.75f), fixed_from_float(0.5f)) == -a);
+    CU_ASSERT(fixed_div(fixed_from_int(-1), fixed_from_int(-3)) == FIXED_ONE / 3);
+    // Needs more than 32 bits in between
+    CU_ASSERT(fixed_mul(fixed_from_int(150), fixed_from_int(200)) == fixed_from_int(30000));
+}
+
+void test_fixed_trig(void) {
+    for(int i = -64; i <= 64; i++) {
+        float a = i * 0.1f;
+        float s = fixed_to_float(fixed_sin(fixed_from_float(a)));
+        float c = fixed_to_float(fixed_cos(fixed_from_float(a)));
+        CU_ASSERT(fabsf(s - sinf(a)) < 0.001f);
+        CU_ASSERT(fabsf(c - cosf(a)) < 0.001f);
+    }
+}
+
+void test_fixed_trig_lut(void) {
+    for(int i = -2 * FIXED_TURN; i <= 2 * FIXED_TURN; i += 7) {
+        float a = i * 2.0f * 3.14159265f / FIXED_TURN;
+        CU_ASSERT(fabsf(fixed_to_float(fixed_sin_lut(i)) - sinf(a)) < 0.0001f);
+        CU_ASSERT(fabsf(fixed_to_float(fixed_cos_lut(i)) - cosf(a)) < 0.0001f);
+    }
+    CU_ASSERT(fixed_sin_lut(FIXED_TURN / 4) == FIXED_ONE);
+    CU_ASSERT(fixed_cos_lut(FIXED_TURN / 2) == -FIXED_ONE);
+    CU_ASSERT(fixed_to_angle(FIXED_PI) == FIXED_TURN / 2);
+    CU_ASSERT(fixed_to_angle(-FIXED_PI / 2) == -FIXED_TURN / 4);
+    CU_ASSERT(fixed_to_angle(fixed_from_int(1)) == 163);
+}
+
+void test_fixed_snap(void) {
+    const float step = 1.0f / (1 << FIXED_SNAP_BITS);
+    CU_ASSERT(fixed_snap(0.3f * step) == 0.0f);
+    CU_ASSERT(fixed_snap(-0.7f * step) == -step);
+    CU_ASSERT(fixed_snap(319.0f + 2.6f * step) == 319.0f + 3.0f * step);
+    // Sums of positions and velocities on the grid stay on it
+    float pos = fixed_snap(300.123f);
+    float vel = fixed_snap(-7.891f);
+    CU_ASSERT(fixed_snap(pos + vel) == pos + vel);
+}
+
+void fixedpoint_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for fixed point conversions", test_fixed_convert) == NULL) { return; }
+    if(CU_add_test(suite, "Test for fixed point mul and div", test_fixed_mul_div) == NULL) { return; }
+    if(CU_add_test(suite, "Test for fixed point sin and cos", test_fixed_trig) == NULL) { return; }
+    if(CU_add_test(suite, "Test for fixed point sin and cos tables", test_fixed_trig_lut) == NULL) { return; }
+    if(CU_add_test(suite, "Test for float snapping", test_fixed_snap) == NULL) { return; }
+}
@@ -0,0 +1,79 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <resources/frame_timeline.h>
+#include <utils/random.h>
+#include <stdlib.h>
+
+// The frame at a tick, the slow way: adding up frame lengths
+static int test_frame_at(const sd_script *script, int tick) {
+    if(tick < 0) {
+        return -1;
+    }
+    int next = 0;
+    for(int i = 0; i < script->frame_count; i++) {
+        next += script->frames[i].tick_len;
+        if(tick < next) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void test_timeline_lookups(int frames, int max_len, unsigned int seed) {
+    struct random_t rnd;
+    random_seed(&rnd, seed);
+    sd_script script;
+    script.frame_count = frames;
+    script.frames = calloc(frames, sizeof(sd_script_frame));
+    int total = 0;
+    for(int i = 0; i < frames; i++) {
+        // Zero length frames too, those are never played
+        script.frames[i].tick_len = random_int(&rnd, max_len + 1);
+        total += script.frames[i].tick_len;
+    }
+
+    frame_timeline timeline;
+    frame_timeline_create(&timeline);
+    frame_timeline_compile(&timeline, &script);
+    CU_ASSERT(frame_timeline_total_ticks(&timeline) == total);
+    int ok = 1;
+    for(int t = -2; t < total + 2; t++) {
+        ok = ok && frame_timeline_frame_at(&timeline, t) == test_frame_at(&script, t);
+    }
+    int start = 0;
+    for(int i = 0; i < frames; i++) {
+        ok = ok && frame_timeline_frame_start(&timeline, i) == start;
+        start += script.frames[i].tick_len;
+    }
+    CU_ASSERT(ok);
+    CU_ASSERT(frame_timeline_frame_start(&timeline, frames) == -1);
+    frame_timeline_free(&timeline);
+    free(script.frames);
+}
+
+void test_frame_timeline_short(void) {
+    test_timeline_lookups(20, 8, 1);
+}
+
+void test_frame_timeline_long(void) {
+    test_timeline_lookups(300, 40, 2);
+}
+
+void test_frame_timeline_empty(void) {
+    sd_script script;
+    script.frame_count = 0;
+    script.frames = NULL;
+    frame_timeline timeline;
+    frame_timeline_create(&timeline);
+    frame_timeline_compile(&timeline, &script);
+    CU_ASSERT(frame_timeline_total_ticks(&timeline) == 0);
+    CU_ASSERT(frame_timeline_frame_at(&timeline, 0) == -1);
+    frame_timeline_free(&timeline);
+}
+
+void frame_timeline_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for frame lookups in short animations", test_frame_timeline_short) == NULL) { return; }
+    if(CU_add_test(suite, "Test for frame lookups in long animations", test_frame_timeline_long) == NULL) { return; }
+    if(CU_add_test(suite, "Test for animations without frames", test_frame_timeline_empty) == NULL) { return; }
+}
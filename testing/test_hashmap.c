@@ -112,6 +112,42 @@ void test_hashmap_clear(void) {
     CU_ASSERT(hashmap_reserved(&test_map) == 0);
 }
 
+void test_hashmap_grow(void) {
+    hashmap map;
+    hashmap_create(&map, 2);
+    for(unsigned int i = 0; i < TEST_VAL_COUNT; i++) {
+        hashmap_iput(&map, i, &i, sizeof(int));
+    }
+    CU_ASSERT(hashmap_reserved(&map) == TEST_VAL_COUNT);
+    CU_ASSERT(hashmap_size(&map) >= TEST_VAL_COUNT);
+
+    unsigned int *val;
+    unsigned int vlen;
+    int found = 0;
+    for(unsigned int i = 0; i < TEST_VAL_COUNT; i++) {
+        if(hashmap_iget(&map, i, (void**)&val, &vlen) == 0 && *val == i) {
+            found++;
+        }
+    }
+    CU_ASSERT(found == TEST_VAL_COUNT);
+    hashmap_free(&map);
+}
+
+void test_hashmap_replace(void) {
+    hashmap map;
+    hashmap_create(&map, 4);
+    unsigned int a = 1, b = 2;
+    hashmap_sput(&map, "key", &a, sizeof(int));
+    hashmap_sput(&map, "key", &b, sizeof(int));
+    CU_ASSERT(hashmap_reserved(&map) == 1);
+
+    unsigned int *val;
+    unsigned int vlen;
+    CU_ASSERT(hashmap_sget(&map, "key", (void**)&val, &vlen) == 0);
+    CU_ASSERT(*val == b);
+    hashmap_free(&map);
+}
+
 void hashmap_test_suite(CU_pSuite suite) {
     // Add tests
     if(CU_add_test(suite, "Test for hashmap create", test_hashmap_create) == NULL) { return; }
@@ -122,4 +158,6 @@ void hashmap_test_suite(CU_pSuite suite) {
     if(CU_add_test(suite, "Test for hashmap iterator delete operation", test_hashmap_iter_del) == NULL) { return; }
     if(CU_add_test(suite, "Test for hashmap clear operation", test_hashmap_clear) == NULL) { return; }
     if(CU_add_test(suite, "Test for hashmap free operation", test_hashmap_free) == NULL) { return; }
+    if(CU_add_test(suite, "Test for hashmap growing", test_hashmap_grow) == NULL) { return; }
+    if(CU_add_test(suite, "Test for hashmap replacing values", test_hashmap_replace) == NULL) { return; }
 }
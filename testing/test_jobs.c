@@ -0,0 +1,139 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/jobs.h>
+
+#define TEST_JOBS_MANY 10000
+
+static SDL_atomic_t test_jobs_sum;
+static SDL_atomic_t test_jobs_order;
+static int test_jobs_first_done;
+static int test_jobs_second_saw;
+static SDL_threadID test_jobs_main_id;
+static SDL_threadID test_jobs_ran_on;
+
+static void test_jobs_add(void *userdata) {
+    SDL_AtomicAdd(&test_jobs_sum, (int)(intptr_t)userdata);
+}
+
+static void test_jobs_first(void *userdata) {
+    SDL_Delay(10);
+    test_jobs_first_done = SDL_AtomicAdd(&test_jobs_order, 1) + 1;
+}
+
+static void test_jobs_second(void *userdata) {
+    test_jobs_second_saw = test_jobs_first_done;
+    SDL_AtomicAdd(&test_jobs_order, 1);
+}
+
+static void test_jobs_record_thread(void *userdata) {
+    test_jobs_ran_on = SDL_ThreadID();
+}
+
+static void test_jobs_nested(void *userdata) {
+    job_counter inner;
+    job_counter_init(&inner);
+    for(int i = 0; i < 8; i++) {
+        jobs_run("test add", test_jobs_add, (void*)(intptr_t)1, &inner, 0);
+    }
+    jobs_wait(&inner);
+}
+
+void test_jobs_init(void) {
+    CU_ASSERT(jobs_init(4) == 0);
+    CU_ASSERT(jobs_thread_count() == 4);
+    test_jobs_main_id = SDL_ThreadID();
+}
+
+void test_jobs_counter(void) {
+    job_counter done;
+    job_counter_init(&done);
+    CU_ASSERT(job_counter_done(&done));
+    SDL_AtomicSet(&test_jobs_sum, 0);
+    for(int i = 1; i <= 100; i++) {
+        jobs_run("test add", test_jobs_add, (void*)(intptr_t)i, &done, 0);
+    }
+    jobs_wait(&done);
+    CU_ASSERT(job_counter_done(&done));
+    CU_ASSERT(SDL_AtomicGet(&test_jobs_sum) == 5050);
+}
+
+void test_jobs_after(void) {
+    job_counter first, second;
+    job_counter_init(&first);
+    job_counter_init(&second);
+    SDL_AtomicSet(&test_jobs_order, 0);
+    test_jobs_first_done = 0;
+    test_jobs_second_saw = 0;
+    jobs_run("test first", test_jobs_first, NULL, &first, 0);
+    jobs_run_after(&first, "test second", test_jobs_second, NULL, &second, 0);
+    jobs_wait(&second);
+    CU_ASSERT(test_jobs_second_saw == 1);
+    CU_ASSERT(SDL_AtomicGet(&test_jobs_order) == 2);
+}
+
+void test_jobs_main_thread(void) {
+    job_counter done;
+    job_counter_init(&done);
+    test_jobs_ran_on = 0;
+    jobs_run("test main", test_jobs_record_thread, NULL, &done, JOB_MAIN_THREAD);
+    jobs_wait(&done);
+    CU_ASSERT(test_jobs_ran_on == test_jobs_main_id);
+    CU_ASSERT(jobs_run_main() == 0);
+}
+
+void test_jobs_many(void) {
+    job_counter done;
+    job_counter_init(&done);
+    SDL_AtomicSet(&test_jobs_sum, 0);
+    for(int i = 0; i < TEST_JOBS_MANY; i++) {
+        jobs_run("test add", test_jobs_add, (void*)(intptr_t)1, &done, 0);
+    }
+    for(int i = 0; i < 16; i++) {
+        jobs_run("test nested", test_jobs_nested, NULL, &done, 0);
+    }
+    jobs_wait(&done);
+    CU_ASSERT(SDL_AtomicGet(&test_jobs_sum) == TEST_JOBS_MANY + 16 * 8);
+}
+
+void test_jobs_active(void) {
+    jobs_set_active(1);
+    CU_ASSERT(jobs_active_count() == 1);
+
+    // Jobs handed to parked workers get stolen by the one still running
+    job_counter done;
+    job_counter_init(&done);
+    SDL_AtomicSet(&test_jobs_sum, 0);
+    for(int i = 0; i < 1000; i++) {
+        jobs_run("test add", test_jobs_add, (void*)(intptr_t)1, &done, 0);
+    }
+    jobs_wait(&done);
+    CU_ASSERT(SDL_AtomicGet(&test_jobs_sum) == 1000);
+
+    jobs_set_active(0);
+    CU_ASSERT(jobs_active_count() == 4);
+    jobs_set_active(1);
+}
+
+void test_jobs_close(void) {
+    jobs_close();
+    CU_ASSERT(jobs_thread_count() == 0);
+
+    // Without a pool, jobs run right away
+    job_counter done;
+    job_counter_init(&done);
+    SDL_AtomicSet(&test_jobs_sum, 0);
+    jobs_run("test add", test_jobs_add, (void*)(intptr_t)3, &done, 0);
+    CU_ASSERT(job_counter_done(&done));
+    CU_ASSERT(SDL_AtomicGet(&test_jobs_sum) == 3);
+}
+
+void jobs_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for jobs init", test_jobs_init) == NULL) { return; }
+    if(CU_add_test(suite, "Test for jobs counter", test_jobs_counter) == NULL) { return; }
+    if(CU_add_test(suite, "Test for jobs dependencies", test_jobs_after) == NULL) { return; }
+    if(CU_add_test(suite, "Test for jobs on main thread", test_jobs_main_thread) == NULL) { return; }
+    if(CU_add_test(suite, "Test for many jobs", test_jobs_many) == NULL) { return; }
+    if(CU_add_test(suite, "Test for jobs with workers parked", test_jobs_active) == NULL) { return; }
+    if(CU_add_test(suite, "Test for jobs close", test_jobs_close) == NULL) { return; }
+}
@@ -0,0 +1,64 @@
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <SDL2/SDL.h>
+#include <utils/latency_probe.h>
+
+void test_latency_probe_stages(void) {
+    latency_stats stats;
+    latency_probe_reset();
+    latency_probe_enable(1, 1);
+
+    // Stages out of order don't count
+    latency_probe_presented();
+    latency_probe_input(SDL_GetTicks());
+    latency_probe_act();
+    latency_probe_rendered();
+    CU_ASSERT(!latency_probe_marker_due());
+    latency_probe_cmd();
+    latency_probe_act();
+    latency_probe_rendered();
+    CU_ASSERT(latency_probe_marker_due());
+    latency_probe_presented();
+    CU_ASSERT(!latency_probe_marker_due());
+
+    latency_probe_get(&stats);
+    CU_ASSERT(stats.samples == 1);
+    unsigned int total = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        total += stats.hist[LATENCY_SPAN_TOTAL][i];
+    }
+    CU_ASSERT(total == 1);
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 50.0f) < LATENCY_TIMEOUT_MS);
+
+    // Nothing is followed while off
+    latency_probe_enable(0, 0);
+    latency_probe_input(SDL_GetTicks());
+    latency_probe_cmd();
+    latency_probe_act();
+    latency_probe_rendered();
+    latency_probe_presented();
+    latency_probe_get(&stats);
+    CU_ASSERT(stats.samples == 1);
+    latency_probe_reset();
+}
+
+void test_latency_probe_percentile(void) {
+    latency_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 50.0f) == 0);
+    stats.samples = 100;
+    stats.hist[LATENCY_SPAN_TOTAL][10] = 50;
+    stats.hist[LATENCY_SPAN_TOTAL][20] = 49;
+    stats.hist[LATENCY_SPAN_TOTAL][LATENCY_BUCKETS - 1] = 1;
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 0.0f) == 10);
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 50.0f) == 20);
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 98.0f) == 20);
+    CU_ASSERT(latency_probe_percentile(&stats, LATENCY_SPAN_TOTAL, 100.0f) == LATENCY_BUCKETS - 1);
+}
+
+void latency_probe_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for following a press", test_latency_probe_stages) == NULL) { return; }
+    if(CU_add_test(suite, "Test for latency percentiles", test_latency_probe_percentile) == NULL) { return; }
+}
@@ -0,0 +1,78 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/log.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_LOG_FILE "test_log.txt"
+
+static int count_lines(const char *needle) {
+    FILE *f = fopen(TEST_LOG_FILE, "r");
+    if(f == NULL) {
+        return -1;
+    }
+    char line[512];
+    int count = 0;
+    while(fgets(line, sizeof(line), f)) {
+        if(strstr(line, needle) != NULL) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+void test_log_order(void) {
+    CU_ASSERT(log_init(TEST_LOG_FILE) == 0);
+    for(int i = 0; i < 100; i++) {
+        log_print('I', NULL, "line %d", i);
+    }
+    log_close();
+
+    FILE *f = fopen(TEST_LOG_FILE, "r");
+    CU_ASSERT_FATAL(f != NULL);
+    char line[512];
+    int expect = 0;
+    while(fgets(line, sizeof(line), f)) {
+        int n;
+        CU_ASSERT(sscanf(line, "[%*u][I] line %d", &n) == 1);
+        CU_ASSERT(n == expect);
+        expect++;
+    }
+    fclose(f);
+    CU_ASSERT(expect == 100);
+    remove(TEST_LOG_FILE);
+}
+
+void test_log_level(void) {
+    int old = log_get_level();
+    CU_ASSERT(log_init(TEST_LOG_FILE) == 0);
+    log_set_level(LOG_ERROR);
+    INFO("filtered");
+    PERROR("kept");
+    log_set_level(old);
+    log_close();
+    CU_ASSERT(count_lines("filtered") == 0);
+    CU_ASSERT(count_lines("kept") == 1);
+    remove(TEST_LOG_FILE);
+}
+
+void test_log_long_line(void) {
+    char big[1000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = 0;
+    CU_ASSERT(log_init(TEST_LOG_FILE) == 0);
+    log_print('I', NULL, "%s", big);
+    log_print('I', NULL, "after");
+    log_close();
+    CU_ASSERT(count_lines("xxxx") == 1);
+    CU_ASSERT(count_lines("after") == 1);
+    remove(TEST_LOG_FILE);
+}
+
+void log_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for log line order", test_log_order) == NULL) { return; }
+    if(CU_add_test(suite, "Test for log level filtering", test_log_level) == NULL) { return; }
+    if(CU_add_test(suite, "Test for log long lines", test_log_long_line) == NULL) { return; }
+}
@@ -6,7 +6,30 @@ void hashmap_test_suite(CU_pSuite suite);
 void vector_test_suite(CU_pSuite suite);
 void list_test_suite(CU_pSuite suite);
 void array_test_suite(CU_pSuite suite);
+void mempool_test_suite(CU_pSuite suite);
+void memarena_test_suite(CU_pSuite suite);
+void delta_test_suite(CU_pSuite suite);
 void text_render_test_suite(CU_pSuite suite);
+void log_test_suite(CU_pSuite suite);
+void ring_test_suite(CU_pSuite suite);
+void jobs_test_suite(CU_pSuite suite);
+void cpu_test_suite(CU_pSuite suite);
+void memtrack_test_suite(CU_pSuite suite);
+void net_capture_test_suite(CU_pSuite suite);
+void fixedpoint_test_suite(CU_pSuite suite);
+void surface_test_suite(CU_pSuite suite);
+void random_test_suite(CU_pSuite suite);
+void state_history_test_suite(CU_pSuite suite);
+void move_trie_test_suite(CU_pSuite suite);
+void serial_test_suite(CU_pSuite suite);
+void frame_timeline_test_suite(CU_pSuite suite);
+void scale_cache_test_suite(CU_pSuite suite);
+void script_cache_test_suite(CU_pSuite suite);
+void rec_library_test_suite(CU_pSuite suite);
+void latency_probe_test_suite(CU_pSuite suite);
+void sound_queue_test_suite(CU_pSuite suite);
+void teardown_test_suite(CU_pSuite suite);
+void tcache_test_suite(CU_pSuite suite);
 
 int main(int argc, char **argv) {
     if(CU_initialize_registry() != CUE_SUCCESS) {
@@ -34,10 +57,102 @@ int main(int argc, char **argv) {
     if(array_suite == NULL) goto end;
     array_test_suite(array_suite);
 
+    CU_pSuite mempool_suite = CU_add_suite("Mempool", NULL, NULL);
+    if(mempool_suite == NULL) goto end;
+    mempool_test_suite(mempool_suite);
+
+    CU_pSuite memarena_suite = CU_add_suite("Memarena", NULL, NULL);
+    if(memarena_suite == NULL) goto end;
+    memarena_test_suite(memarena_suite);
+
+    CU_pSuite delta_suite = CU_add_suite("Delta", NULL, NULL);
+    if(delta_suite == NULL) goto end;
+    delta_test_suite(delta_suite);
+
     CU_pSuite text_render_suite = CU_add_suite("Text Renderer", NULL, NULL);
     if(text_render_suite == NULL) goto end;
     text_render_test_suite(text_render_suite);
 
+    CU_pSuite log_suite = CU_add_suite("Log", NULL, NULL);
+    if(log_suite == NULL) goto end;
+    log_test_suite(log_suite);
+
+    CU_pSuite ring_suite = CU_add_suite("Ring", NULL, NULL);
+    if(ring_suite == NULL) goto end;
+    ring_test_suite(ring_suite);
+
+    CU_pSuite jobs_suite = CU_add_suite("Jobs", NULL, NULL);
+    if(jobs_suite == NULL) goto end;
+    jobs_test_suite(jobs_suite);
+
+    CU_pSuite cpu_suite = CU_add_suite("CPU", NULL, NULL);
+    if(cpu_suite == NULL) goto end;
+    cpu_test_suite(cpu_suite);
+
+    CU_pSuite memtrack_suite = CU_add_suite("Memtrack", NULL, NULL);
+    if(memtrack_suite == NULL) goto end;
+    memtrack_test_suite(memtrack_suite);
+
+    CU_pSuite net_capture_suite = CU_add_suite("Net capture", NULL, NULL);
+    if(net_capture_suite == NULL) goto end;
+    net_capture_test_suite(net_capture_suite);
+
+    CU_pSuite fixedpoint_suite = CU_add_suite("Fixed point", NULL, NULL);
+    if(fixedpoint_suite == NULL) goto end;
+    fixedpoint_test_suite(fixedpoint_suite);
+
+    CU_pSuite surface_suite = CU_add_suite("Surface", NULL, NULL);
+    if(surface_suite == NULL) goto end;
+    surface_test_suite(surface_suite);
+
+    CU_pSuite random_suite = CU_add_suite("Random", NULL, NULL);
+    if(random_suite == NULL) goto end;
+    random_test_suite(random_suite);
+
+    CU_pSuite state_history_suite = CU_add_suite("State history", NULL, NULL);
+    if(state_history_suite == NULL) goto end;
+    state_history_test_suite(state_history_suite);
+
+    CU_pSuite move_trie_suite = CU_add_suite("Move trie", NULL, NULL);
+    if(move_trie_suite == NULL) goto end;
+    move_trie_test_suite(move_trie_suite);
+
+    CU_pSuite serial_suite = CU_add_suite("Serial", NULL, NULL);
+    if(serial_suite == NULL) goto end;
+    serial_test_suite(serial_suite);
+
+    CU_pSuite frame_timeline_suite = CU_add_suite("Frame timeline", NULL, NULL);
+    if(frame_timeline_suite == NULL) goto end;
+    frame_timeline_test_suite(frame_timeline_suite);
+
+    CU_pSuite scale_cache_suite = CU_add_suite("Scale cache", NULL, NULL);
+    if(scale_cache_suite == NULL) goto end;
+    scale_cache_test_suite(scale_cache_suite);
+
+    CU_pSuite script_cache_suite = CU_add_suite("Script cache", NULL, NULL);
+    if(script_cache_suite == NULL) goto end;
+    script_cache_test_suite(script_cache_suite);
+
+    CU_pSuite rec_library_suite = CU_add_suite("Recording library", NULL, NULL);
+    if(rec_library_suite == NULL) goto end;
+    rec_library_test_suite(rec_library_suite);
+
+    CU_pSuite latency_probe_suite = CU_add_suite("Latency probe", NULL, NULL);
+    if(latency_probe_suite == NULL) goto end;
+    latency_probe_test_suite(latency_probe_suite);
+
+    CU_pSuite sound_queue_suite = CU_add_suite("Sound queue", NULL, NULL);
+    if(sound_queue_suite == NULL) goto end;
+    sound_queue_test_suite(sound_queue_suite);
+
+    CU_pSuite teardown_suite = CU_add_suite("Teardown", NULL, NULL);
+    if(teardown_suite == NULL) goto end;
+    teardown_test_suite(teardown_suite);
+
+    CU_pSuite tcache_suite = CU_add_suite("Texture cache", NULL, NULL);
+    if(tcache_suite == NULL) goto end;
+    tcache_test_suite(tcache_suite);
+
     // Run tests
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
@@ -0,0 +1,75 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/memarena.h>
+#include <utils/vector.h>
+#include <stdint.h>
+#include <string.h>
+
+void test_memarena_alloc(void) {
+    memarena arena;
+    memarena_create(&arena, 256);
+    char *a = memarena_alloc(&arena, 3);
+    char *b = memarena_alloc(&arena, 100);
+    CU_ASSERT(a != NULL);
+    CU_ASSERT(b != NULL);
+    CU_ASSERT(((uintptr_t)a & 15) == 0);
+    CU_ASSERT(((uintptr_t)b & 15) == 0);
+    memset(a, 1, 3);
+    memset(b, 2, 100);
+    CU_ASSERT(a[2] == 1);
+
+    // Larger than a block
+    char *c = memarena_alloc(&arena, 1000);
+    CU_ASSERT(c != NULL);
+    memset(c, 3, 1000);
+    CU_ASSERT(b[99] == 2);
+    memarena_free(&arena);
+}
+
+void test_memarena_realloc(void) {
+    memarena arena;
+    memarena_create(&arena, 256);
+    int *p = memarena_realloc(&arena, NULL, sizeof(int) * 4);
+    for(int i = 0; i < 4; i++) {
+        p[i] = i;
+    }
+    p = memarena_realloc(&arena, p, sizeof(int) * 200);
+    for(int i = 0; i < 4; i++) {
+        CU_ASSERT(p[i] == i);
+    }
+    memarena_free(&arena);
+}
+
+void test_memarena_reset(void) {
+    memarena arena;
+    memarena_create(&arena, 256);
+    for(int i = 0; i < 20; i++) {
+        memarena_alloc(&arena, 60);
+    }
+    CU_ASSERT(memarena_used(&arena) > 0);
+    memarena_reset(&arena);
+    CU_ASSERT(memarena_used(&arena) == 0);
+    CU_ASSERT(memarena_alloc(&arena, 16) != NULL);
+    memarena_free(&arena);
+}
+
+void test_memarena_vector(void) {
+    vector vec;
+    vector_create_with_allocator(&vec, sizeof(int), memarena_frame_allocator());
+    for(int i = 0; i < 500; i++) {
+        vector_append(&vec, &i);
+    }
+    CU_ASSERT(vector_size(&vec) == 500);
+    CU_ASSERT(*((int*)vector_get(&vec, 499)) == 499);
+    vector_free(&vec);
+    memarena_frame_reset();
+    memarena_close();
+}
+
+void memarena_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for memarena alloc", test_memarena_alloc) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memarena realloc", test_memarena_realloc) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memarena reset", test_memarena_reset) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memarena vector", test_memarena_vector) == NULL) { return; }
+}
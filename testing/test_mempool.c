@@ -0,0 +1,70 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/mempool.h>
+#include <string.h>
+
+#define TEST_POOL_SIZE 16
+#define TEST_BLOCK_SIZE 24
+
+mempool test_pool;
+void *test_blocks[TEST_POOL_SIZE + 1];
+
+void test_mempool_create(void) {
+    mempool_create(&test_pool, TEST_BLOCK_SIZE, TEST_POOL_SIZE);
+    CU_ASSERT_PTR_NOT_NULL(test_pool.data);
+    CU_ASSERT(test_pool.block_size >= TEST_BLOCK_SIZE);
+    CU_ASSERT(mempool_capacity(&test_pool) == TEST_POOL_SIZE);
+    CU_ASSERT(mempool_used(&test_pool) == 0);
+}
+
+void test_mempool_alloc(void) {
+    for(int i = 0; i < TEST_POOL_SIZE; i++) {
+        test_blocks[i] = mempool_alloc(&test_pool);
+        CU_ASSERT_PTR_NOT_NULL(test_blocks[i]);
+        CU_ASSERT(mempool_owns(&test_pool, test_blocks[i]));
+        memset(test_blocks[i], i, TEST_BLOCK_SIZE);
+        CU_ASSERT(mempool_used(&test_pool) == i+1);
+    }
+
+    // Make sure the blocks don't overlap
+    for(int i = 0; i < TEST_POOL_SIZE; i++) {
+        CU_ASSERT(((char*)test_blocks[i])[TEST_BLOCK_SIZE-1] == i);
+    }
+}
+
+void test_mempool_overflow(void) {
+    // Pool is full; this should come from the heap
+    test_blocks[TEST_POOL_SIZE] = mempool_alloc(&test_pool);
+    CU_ASSERT_PTR_NOT_NULL(test_blocks[TEST_POOL_SIZE]);
+    CU_ASSERT(!mempool_owns(&test_pool, test_blocks[TEST_POOL_SIZE]));
+    CU_ASSERT(test_pool.overflows == 1);
+    CU_ASSERT(mempool_used(&test_pool) == TEST_POOL_SIZE);
+}
+
+void test_mempool_release(void) {
+    for(int i = 0; i <= TEST_POOL_SIZE; i++) {
+        mempool_release(&test_pool, test_blocks[i]);
+    }
+    CU_ASSERT(mempool_used(&test_pool) == 0);
+    CU_ASSERT(test_pool.peak == TEST_POOL_SIZE);
+
+    // Released blocks should get reused
+    void *block = mempool_alloc(&test_pool);
+    CU_ASSERT(mempool_owns(&test_pool, block));
+    mempool_release(&test_pool, block);
+}
+
+void test_mempool_free(void) {
+    mempool_free(&test_pool);
+    CU_ASSERT_PTR_NULL(test_pool.data);
+    CU_ASSERT(mempool_capacity(&test_pool) == 0);
+}
+
+void mempool_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for mempool create", test_mempool_create) == NULL) { return; }
+    if(CU_add_test(suite, "Test for mempool alloc", test_mempool_alloc) == NULL) { return; }
+    if(CU_add_test(suite, "Test for mempool overflow", test_mempool_overflow) == NULL) { return; }
+    if(CU_add_test(suite, "Test for mempool release", test_mempool_release) == NULL) { return; }
+    if(CU_add_test(suite, "Test for mempool free operation", test_mempool_free) == NULL) { return; }
+}
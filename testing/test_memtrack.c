@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/memtrack.h>
+#include <utils/vector.h>
+#include <utils/ring.h>
+
+static unsigned int test_hook_calls;
+static size_t test_hook_size;
+static const char *test_hook_where;
+
+static void test_memtrack_hook(const char *where, size_t size, void *userdata) {
+    test_hook_calls++;
+    test_hook_size = size;
+    test_hook_where = where;
+}
+
+void test_memtrack_alloc(void) {
+    mem_stats before, after;
+    mem_get_stats(MEM_TAG_MISC, &before);
+    char *a = mem_malloc(MEM_TAG_MISC, 100);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+    CU_ASSERT(((uintptr_t)a & 15) == 0);
+    mem_get_stats(MEM_TAG_MISC, &after);
+    CU_ASSERT(after.live == before.live + 100);
+    CU_ASSERT(after.count == before.count + 1);
+    CU_ASSERT(after.allocs == before.allocs + 1);
+    CU_ASSERT(after.peak >= after.live);
+
+    a = mem_realloc(MEM_TAG_MISC, a, 300);
+    mem_get_stats(MEM_TAG_MISC, &after);
+    CU_ASSERT(after.live == before.live + 300);
+    CU_ASSERT(after.count == before.count + 1);
+
+    mem_free(a);
+    mem_get_stats(MEM_TAG_MISC, &after);
+    CU_ASSERT(after.live == before.live);
+    CU_ASSERT(after.count == before.count);
+    CU_ASSERT(after.peak >= before.live + 300);
+}
+
+void test_memtrack_allocator(void) {
+    mem_stats before, after;
+    mem_get_stats(MEM_TAG_GUI, &before);
+    vector vec;
+    vector_create_with_allocator(&vec, sizeof(int), mem_allocator(MEM_TAG_GUI));
+    for(int i = 0; i < 100; i++) {
+        vector_append(&vec, &i);
+    }
+    mem_get_stats(MEM_TAG_GUI, &after);
+    CU_ASSERT(after.live >= before.live + 100 * sizeof(int));
+    vector_free(&vec);
+    mem_get_stats(MEM_TAG_GUI, &after);
+    CU_ASSERT(after.live == before.live);
+}
+
+void test_memtrack_reset_peaks(void) {
+    mem_stats stats;
+    mem_free(mem_malloc(MEM_TAG_NET, 1000));
+    mem_reset_peaks();
+    mem_get_stats(MEM_TAG_NET, &stats);
+    CU_ASSERT(stats.peak == stats.live);
+    mem_get_total(&stats);
+    CU_ASSERT(stats.peak == stats.live);
+}
+
+void test_memtrack_guard(void) {
+    mem_guard_set_hook(test_memtrack_hook, NULL);
+    mem_guard_reset();
+    test_hook_calls = 0;
+
+    // Outside of a guard nothing is counted
+    mem_free(mem_malloc(MEM_TAG_MISC, 10));
+    CU_ASSERT(mem_guard_count() == 0);
+
+    mem_guard_begin("test");
+    void *p = mem_malloc(MEM_TAG_MISC, 42);
+    mem_guard_end();
+    mem_free(p);
+    CU_ASSERT(mem_guard_count() == 1);
+    CU_ASSERT(test_hook_calls == 1);
+    CU_ASSERT(test_hook_size == 42);
+    CU_ASSERT(test_hook_where != NULL && strcmp(test_hook_where, "test") == 0);
+
+    mem_guard_reset();
+    CU_ASSERT(mem_guard_count() == 0);
+    mem_guard_set_hook(NULL, NULL);
+}
+
+// Hot paths are expected to stay clear of the heap once set up
+void test_memtrack_guard_ring(void) {
+    ring r;
+    int v = 0;
+    ring_create(&r, sizeof(int), 16);
+    mem_guard_set_hook(test_memtrack_hook, NULL);
+    mem_guard_reset();
+    mem_guard_begin("ring");
+    for(int i = 0; i < 1000; i++) {
+        ring_push(&r, &i);
+        ring_pop(&r, &v);
+    }
+    mem_guard_end();
+    CU_ASSERT(mem_guard_count() == 0);
+    mem_guard_set_hook(NULL, NULL);
+    ring_free(&r);
+}
+
+void memtrack_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for memtrack alloc and free", test_memtrack_alloc) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memtrack allocator", test_memtrack_allocator) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memtrack peak reset", test_memtrack_reset_peaks) == NULL) { return; }
+    if(CU_add_test(suite, "Test for memtrack allocation guard", test_memtrack_guard) == NULL) { return; }
+    if(CU_add_test(suite, "Test for no allocations in ring", test_memtrack_guard_ring) == NULL) { return; }
+}
@@ -0,0 +1,90 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <resources/move_trie.h>
+#include <utils/random.h>
+#include <string.h>
+
+#define TEST_MOVES 70
+#define TEST_INPUTS 2000
+
+static const char *test_keys = "123456789KP";
+
+static void test_make_moves(move_trie *trie, char strs[][MOVE_TRIE_MAX_INPUTS + 1], struct random_t *rnd) {
+    move_trie_create(trie);
+    for(int i = 0; i < TEST_MOVES; i++) {
+        // Attack key last, like the AF move strings, and a few short ones
+        int len = random_int(rnd, 5);
+        for(int k = 0; k < len; k++) {
+            strs[i][k] = test_keys[random_int(rnd, (k == 0) ? 11 : 4)];
+        }
+        strs[i][len] = '\0';
+        move_trie_add(trie, strs[i], i);
+    }
+    move_trie_build(trie);
+}
+
+// The moves whose string the buffer starts with, the slow way
+static void test_prefix_moves(char strs[][MOVE_TRIE_MAX_INPUTS + 1], const char *buf, move_mask *out) {
+    move_mask_clear(out);
+    for(int i = 0; i < TEST_MOVES; i++) {
+        if(strncmp(strs[i], buf, strlen(strs[i])) == 0) {
+            move_mask_set(out, i);
+        }
+    }
+}
+
+// Stepping one input at a time finds what matching the whole buffer finds
+void test_move_trie_step(void) {
+    struct random_t rnd;
+    random_seed(&rnd, 1234);
+    char strs[TEST_MOVES][MOVE_TRIE_MAX_INPUTS + 1];
+    move_trie trie;
+    test_make_moves(&trie, strs, &rnd);
+
+    char buf[MOVE_TRIE_MAX_INPUTS + 1];
+    memset(buf, 0, sizeof(buf));
+    int node = MOVE_TRIE_START;
+    int ok = 1;
+    for(int i = 0; i < TEST_INPUTS; i++) {
+        char c = test_keys[random_int(&rnd, 6)];
+        memmove(buf + 1, buf, MOVE_TRIE_MAX_INPUTS - 1);
+        buf[0] = c;
+        node = move_trie_step(&trie, node, c);
+
+        move_mask ref, all;
+        test_prefix_moves(strs, buf, &ref);
+        move_trie_match(&trie, buf, &all);
+        ok = ok && memcmp(&ref, move_trie_moves(&trie, node), sizeof(move_mask)) == 0;
+        ok = ok && memcmp(&ref, &all, sizeof(move_mask)) == 0;
+        ok = ok && move_trie_walk(&trie, buf) == node;
+    }
+    CU_ASSERT(ok);
+    move_trie_free(&trie);
+}
+
+void test_move_trie_limits(void) {
+    move_trie trie;
+    move_trie_create(&trie);
+    move_trie_add(&trie, "", 0);
+    move_trie_add(&trie, "K2", 1);
+    move_trie_add(&trie, "K2X", 2); // Not an input
+    move_trie_add(&trie, "P12345678912", 3); // Longer than the inputs kept
+    move_trie_build(&trie);
+
+    int node = MOVE_TRIE_START;
+    CU_ASSERT(move_mask_isset(move_trie_moves(&trie, node), 0));
+    node = move_trie_step(&trie, node, '2');
+    node = move_trie_step(&trie, node, 'K');
+    CU_ASSERT(move_mask_isset(move_trie_moves(&trie, node), 0));
+    CU_ASSERT(move_mask_isset(move_trie_moves(&trie, node), 1));
+    CU_ASSERT(move_mask_next(move_trie_moves(&trie, node), 2) == -1);
+    node = move_trie_step(&trie, node, 'K');
+    CU_ASSERT(!move_mask_isset(move_trie_moves(&trie, node), 1));
+    move_trie_free(&trie);
+}
+
+void move_trie_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for stepping through move inputs", test_move_trie_step) == NULL) { return; }
+    if(CU_add_test(suite, "Test for move strings that can't be matched", test_move_trie_limits) == NULL) { return; }
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <controller/net_capture.h>
+
+#define TEST_CAPTURE_FILE "test_net_capture.bin"
+
+typedef struct capture_check_t {
+    int count;
+    int ok;
+    uint64_t last_us;
+} capture_check;
+
+static int test_capture_cb(const net_capture_record *rec, void *userdata) {
+    capture_check *check = userdata;
+    char expect[16];
+    snprintf(expect, sizeof(expect), "packet %d", check->count);
+    int ok = rec->len == strlen(expect) + 1 && memcmp(rec->data, expect, rec->len) == 0;
+    ok = ok && rec->dir == ((check->count % 2) ? NET_CAPTURE_IN : NET_CAPTURE_OUT);
+    ok = ok && rec->channel == check->count % 3;
+    ok = ok && rec->tick == check->count * 10 - 1;
+    ok = ok && rec->flags == ((check->count % 2) ? ENET_PACKET_FLAG_RELIABLE : ENET_PACKET_FLAG_UNSEQUENCED);
+    ok = ok && rec->time_us >= check->last_us;
+    check->ok = check->ok && ok;
+    check->last_us = rec->time_us;
+    check->count++;
+    return 0;
+}
+
+void test_net_capture_round_trip(void) {
+    CU_ASSERT(net_capture_start(TEST_CAPTURE_FILE) == 0);
+    CU_ASSERT(net_capture_is_active());
+    for(int i = 0; i < 5; i++) {
+        char data[16];
+        snprintf(data, sizeof(data), "packet %d", i);
+        int flags = (i % 2) ? ENET_PACKET_FLAG_RELIABLE : ENET_PACKET_FLAG_UNSEQUENCED;
+        ENetPacket *packet = enet_packet_create(data, strlen(data) + 1, flags);
+        net_capture_packet((i % 2) ? NET_CAPTURE_IN : NET_CAPTURE_OUT, i % 3, packet, i * 10 - 1);
+        enet_packet_destroy(packet);
+    }
+    net_capture_stop();
+    CU_ASSERT(!net_capture_is_active());
+
+    capture_check check = {0, 1, 0};
+    CU_ASSERT(net_capture_read(TEST_CAPTURE_FILE, test_capture_cb, &check) == 5);
+    CU_ASSERT(check.count == 5);
+    CU_ASSERT(check.ok);
+    remove(TEST_CAPTURE_FILE);
+}
+
+void test_net_capture_not_a_capture(void) {
+    FILE *fp = fopen(TEST_CAPTURE_FILE, "wb");
+    fputs("not a capture", fp);
+    fclose(fp);
+    capture_check check = {0, 1, 0};
+    CU_ASSERT(net_capture_read(TEST_CAPTURE_FILE, test_capture_cb, &check) == -1);
+    CU_ASSERT(check.count == 0);
+    remove(TEST_CAPTURE_FILE);
+}
+
+void net_capture_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for net capture round trip", test_net_capture_round_trip) == NULL) { return; }
+    if(CU_add_test(suite, "Test for net capture with a wrong file", test_net_capture_not_a_capture) == NULL) { return; }
+}
@@ -0,0 +1,36 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/random.h>
+
+#define TEST_HASH_DRAWS 10000
+
+void test_random_hash_repeatable(void) {
+    uint32_t first[16];
+    for(uint32_t i = 0; i < 16; i++) {
+        first[i] = random_hash(1234, i);
+    }
+    // Drawing backwards gives the same values
+    for(int i = 15; i >= 0; i--) {
+        CU_ASSERT(random_hash(1234, i) == first[i]);
+    }
+    CU_ASSERT(random_hash(1234, 0) != random_hash(1235, 0));
+    CU_ASSERT(random_hash(1234, 0) != random_hash(1234, 1));
+}
+
+void test_random_hash_int_range(void) {
+    int seen[6] = {0};
+    for(uint32_t i = 0; i < TEST_HASH_DRAWS; i++) {
+        uint32_t v = random_hash_int(42, i, 6);
+        CU_ASSERT_FATAL(v < 6);
+        seen[v]++;
+    }
+    for(int i = 0; i < 6; i++) {
+        CU_ASSERT(seen[i] > TEST_HASH_DRAWS / 6 / 2);
+    }
+}
+
+void random_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for counter based random repeatability", test_random_hash_repeatable) == NULL) { return; }
+    if(CU_add_test(suite, "Test for counter based random range", test_random_hash_int_range) == NULL) { return; }
+}
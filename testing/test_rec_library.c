@@ -0,0 +1,81 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <game/utils/rec_library.h>
+#include <game/common_defines.h>
+#include <stdio.h>
+#include <string.h>
+
+static void test_add_entry(rec_library *lib, const char *name, int har_a, int pilot_a, int har_b, int pilot_b) {
+    rec_library_entry e;
+    memset(&e, 0, sizeof(e));
+    strcpy(e.name, name);
+    e.mtime = 1234;
+    e.size = 100;
+    e.ticks = 500;
+    e.pilots[0].har_id = har_a;
+    e.pilots[0].pilot_id = pilot_a;
+    strcpy(e.pilots[0].name, pilot_get_name(pilot_a));
+    e.pilots[1].har_id = har_b;
+    e.pilots[1].pilot_id = pilot_b;
+    strcpy(e.pilots[1].name, pilot_get_name(pilot_b));
+    vector_append(&lib->entries, &e);
+}
+
+// Filters must hold for one side of the match
+void test_rec_library_query(void) {
+    rec_library lib;
+    rec_library_open(&lib, "."); // No index there
+    test_add_entry(&lib, "A.REC", HAR_JAGUAR, PILOT_CRYSTAL, HAR_NOVA, PILOT_STEFFAN);
+    rec_library_entry *e = vector_get(&lib.entries, 0);
+
+    rec_library_query q;
+    rec_library_query_init(&q);
+    CU_ASSERT(rec_library_match(e, &q));
+    CU_ASSERT(rec_library_query_parse(&q, "arena=1") == 1);
+    CU_ASSERT(rec_library_query_parse(&q, "har=nova") == 0);
+    CU_ASSERT(q.har_id == HAR_NOVA);
+    CU_ASSERT(rec_library_match(e, &q));
+    CU_ASSERT(rec_library_query_parse(&q, "pilot=crystal") == 0);
+    CU_ASSERT(!rec_library_match(e, &q));
+    CU_ASSERT(rec_library_query_parse(&q, "pilot=steffan") == 0);
+    CU_ASSERT(rec_library_match(e, &q));
+
+    rec_library_query_init(&q);
+    rec_library_query_parse(&q, "har=0");
+    CU_ASSERT(rec_library_match(e, &q));
+    rec_library_query_parse(&q, "har=not a har");
+    CU_ASSERT(!rec_library_match(e, &q));
+
+    // Names that are not one of the pilots go by the name in the recording
+    strcpy(e->pilots[1].name, "ZED");
+    rec_library_query_init(&q);
+    rec_library_query_parse(&q, "pilot=zed");
+    CU_ASSERT(q.pilot_id == -1);
+    CU_ASSERT(rec_library_match(e, &q));
+    rec_library_free(&lib);
+}
+
+void test_rec_library_save(void) {
+    rec_library lib;
+    rec_library_open(&lib, ".");
+    test_add_entry(&lib, "A.REC", HAR_JAGUAR, PILOT_CRYSTAL, HAR_NOVA, PILOT_STEFFAN);
+    test_add_entry(&lib, "B.REC", HAR_GARGOYLE, PILOT_MILANO, HAR_CHRONOS, PILOT_CHRISTIAN);
+    CU_ASSERT(rec_library_save(&lib) == 0);
+    rec_library_free(&lib);
+
+    rec_library_open(&lib, ".");
+    CU_ASSERT_FATAL(vector_size(&lib.entries) == 2);
+    rec_library_entry *e = vector_get(&lib.entries, 1);
+    CU_ASSERT(strcmp(e->name, "B.REC") == 0);
+    CU_ASSERT(strcmp(e->pilots[1].name, "CHRISTIAN") == 0);
+    CU_ASSERT(e->pilots[0].har_id == HAR_GARGOYLE);
+    CU_ASSERT(e->mtime == 1234 && e->ticks == 500);
+    rec_library_free(&lib);
+    remove("./" REC_LIBRARY_FILE);
+}
+
+void rec_library_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for filtering recordings", test_rec_library_query) == NULL) { return; }
+    if(CU_add_test(suite, "Test for saving the recording index", test_rec_library_save) == NULL) { return; }
+}
@@ -0,0 +1,93 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/ring.h>
+
+#define TEST_RING_SIZE 8
+#define TEST_THREAD_ITEMS 100000
+
+ring test_ring;
+
+void test_ring_create(void) {
+    ring_create(&test_ring, sizeof(int), TEST_RING_SIZE - 1);
+    CU_ASSERT_PTR_NOT_NULL(test_ring.data);
+    CU_ASSERT(ring_capacity(&test_ring) == TEST_RING_SIZE);
+    CU_ASSERT(ring_size(&test_ring) == 0);
+}
+
+void test_ring_push_pop(void) {
+    int v;
+    CU_ASSERT(ring_pop(&test_ring, &v) == 1);
+    for(int i = 0; i < TEST_RING_SIZE; i++) {
+        CU_ASSERT(ring_push(&test_ring, &i) == 0);
+    }
+    v = 100;
+    CU_ASSERT(ring_push(&test_ring, &v) == 1);
+    CU_ASSERT(ring_size(&test_ring) == TEST_RING_SIZE);
+    for(int i = 0; i < TEST_RING_SIZE; i++) {
+        CU_ASSERT(ring_pop(&test_ring, &v) == 0);
+        CU_ASSERT(v == i);
+    }
+    CU_ASSERT(ring_pop(&test_ring, &v) == 1);
+}
+
+void test_ring_wrap(void) {
+    // Keep the ring half full while the positions go around a few times
+    int v;
+    int next = 0;
+    int expect = 0;
+    for(int i = 0; i < TEST_RING_SIZE / 2; i++) {
+        ring_push(&test_ring, &next);
+        next++;
+    }
+    for(int i = 0; i < TEST_RING_SIZE * 4; i++) {
+        CU_ASSERT(ring_push(&test_ring, &next) == 0);
+        next++;
+        CU_ASSERT(ring_pop(&test_ring, &v) == 0);
+        CU_ASSERT(v == expect);
+        expect++;
+    }
+    while(ring_pop(&test_ring, &v) == 0) {
+        CU_ASSERT(v == expect);
+        expect++;
+    }
+    CU_ASSERT(expect == next);
+}
+
+static int test_ring_producer(void *data) {
+    for(int i = 0; i < TEST_THREAD_ITEMS; i++) {
+        while(ring_push(&test_ring, &i)) {
+            SDL_Delay(0);
+        }
+    }
+    return 0;
+}
+
+void test_ring_threads(void) {
+    SDL_Thread *thread = SDL_CreateThread(test_ring_producer, "ring test", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(thread);
+    int v;
+    int expect = 0;
+    int ordered = 1;
+    while(expect < TEST_THREAD_ITEMS) {
+        if(ring_pop(&test_ring, &v) == 0) {
+            ordered = ordered && (v == expect);
+            expect++;
+        }
+    }
+    SDL_WaitThread(thread, NULL);
+    CU_ASSERT(ordered);
+}
+
+void test_ring_free(void) {
+    ring_free(&test_ring);
+    CU_ASSERT_PTR_NULL(test_ring.data);
+}
+
+void ring_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for ring create", test_ring_create) == NULL) { return; }
+    if(CU_add_test(suite, "Test for ring push and pop", test_ring_push_pop) == NULL) { return; }
+    if(CU_add_test(suite, "Test for ring wrap around", test_ring_wrap) == NULL) { return; }
+    if(CU_add_test(suite, "Test for ring across threads", test_ring_threads) == NULL) { return; }
+    if(CU_add_test(suite, "Test for ring free", test_ring_free) == NULL) { return; }
+}
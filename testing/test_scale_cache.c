@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <video/scale_cache.h>
+
+#define TEST_CACHE_FILE "test_scale_cache.bin"
+
+static uint64_t test_key(const char *scaler, int factor, const char *in) {
+    return scale_cache_key_add(scale_cache_key(scaler, factor, 4, 2), in, 8);
+}
+
+void test_scale_cache_round_trip(void) {
+    const char in[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    char out[32];
+    for(int i = 0; i < 32; i++) {
+        out[i] = i * 3;
+    }
+    remove(TEST_CACHE_FILE);
+    CU_ASSERT(scale_cache_open(TEST_CACHE_FILE, 1024 * 1024) == 0);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 32) == NULL);
+    scale_cache_add(test_key("HQx", 2, in), out, 32);
+    scale_cache_add(test_key("HQx", 4, in), out, 16);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 32) != NULL);
+    scale_cache_close();
+
+    CU_ASSERT(scale_cache_open(TEST_CACHE_FILE, 1024 * 1024) == 0);
+    const char *found = scale_cache_find(test_key("HQx", 2, in), 32);
+    CU_ASSERT_PTR_NOT_NULL(found);
+    CU_ASSERT(found != NULL && memcmp(found, out, 32) == 0);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 4, in), 16) != NULL);
+    // Other scalers, and sizes that don't match, miss
+    CU_ASSERT(scale_cache_find(test_key("xBR", 2, in), 32) == NULL);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 16) == NULL);
+
+    // Entries added later go in with the old ones
+    const char in2[8] = {8, 7, 6, 5, 4, 3, 2, 1};
+    scale_cache_add(test_key("xBR", 3, in2), out, 8);
+    scale_cache_close();
+    CU_ASSERT(scale_cache_open(TEST_CACHE_FILE, 1024 * 1024) == 0);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 32) != NULL);
+    CU_ASSERT(scale_cache_find(test_key("xBR", 3, in2), 8) != NULL);
+    scale_cache_close();
+    remove(TEST_CACHE_FILE);
+}
+
+void test_scale_cache_limits(void) {
+    const char in[8] = {0};
+    char out[64] = {0};
+    FILE *fp = fopen(TEST_CACHE_FILE, "wb");
+    fputs("not a cache", fp);
+    fclose(fp);
+    CU_ASSERT(scale_cache_open(TEST_CACHE_FILE, 100) == 0);
+    CU_ASSERT(scale_cache_is_open());
+    scale_cache_add(test_key("HQx", 2, in), out, 32);
+    scale_cache_add(test_key("HQx", 3, in), out, 64); // Over the limit
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 32) != NULL);
+    CU_ASSERT(scale_cache_find(test_key("HQx", 3, in), 64) == NULL);
+    scale_cache_close();
+    CU_ASSERT(!scale_cache_is_open());
+    CU_ASSERT(scale_cache_find(test_key("HQx", 2, in), 32) == NULL);
+    remove(TEST_CACHE_FILE);
+}
+
+void scale_cache_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for storing and finding scaled sprites", test_scale_cache_round_trip) == NULL) { return; }
+    if(CU_add_test(suite, "Test for invalid files and the size limit", test_scale_cache_limits) == NULL) { return; }
+}
@@ -0,0 +1,30 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <resources/script_cache.h>
+
+void test_script_cache_shared(void) {
+    const script_cache_entry *a = script_cache_get("bs100A1-bf0A15");
+    const script_cache_entry *b = script_cache_get("A5");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(b);
+    CU_ASSERT(a != b);
+    CU_ASSERT(script_cache_get("bs100A1-bf0A15") == a);
+    CU_ASSERT(script_cache_size() == 2);
+    CU_ASSERT(a->script.frame_count == 2);
+    CU_ASSERT(frame_timeline_total_ticks(&a->timeline) == 16);
+    CU_ASSERT(frame_timeline_frame_at(&a->timeline, 1) == 1);
+    script_cache_clear();
+    CU_ASSERT(script_cache_size() == 0);
+}
+
+void test_script_cache_invalid(void) {
+    CU_ASSERT_PTR_NULL(script_cache_get("A1-!!!"));
+    CU_ASSERT(script_cache_size() == 0);
+    script_cache_clear();
+}
+
+void script_cache_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for sharing decoded strings", test_script_cache_shared) == NULL) { return; }
+    if(CU_add_test(suite, "Test for strings that don't decode", test_script_cache_invalid) == NULL) { return; }
+}
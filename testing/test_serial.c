@@ -0,0 +1,61 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <game/utils/serial.h>
+
+// Records written with serial_put_* read back the same as with serial_read_*
+void test_serial_block(void) {
+    serial ser;
+    serial_create(&ser);
+    serial_write_int8(&ser, -5);
+    char *p = serial_write_block(&ser, 11);
+    serial_put_int16(&p, -1234);
+    serial_put_int32(&p, 0x12345678);
+    serial_put_float(&p, 1.5f);
+    serial_put_int8(&p, 7);
+    CU_ASSERT(serial_len(&ser) == 12);
+
+    CU_ASSERT(serial_read_int8(&ser) == -5);
+    CU_ASSERT(serial_read_int16(&ser) == -1234);
+    const char *r = serial_read_block(&ser, 9);
+    CU_ASSERT_FATAL(r != NULL);
+    CU_ASSERT(serial_get_int32(&r) == 0x12345678);
+    CU_ASSERT(serial_get_float(&r) == 1.5f);
+    CU_ASSERT(serial_get_int8(&r) == 7);
+    CU_ASSERT(!serial_error(&ser));
+    serial_free(&ser);
+}
+
+void test_serial_truncated(void) {
+    serial ser;
+    serial_create(&ser);
+    serial_write_int32(&ser, -1);
+    serial_write_int8(&ser, 0x40);
+
+    serial view;
+    serial_create_view(&view, ser.data, 3);
+    CU_ASSERT(serial_read_block(&view, 4) == NULL);
+    CU_ASSERT(serial_error(&view));
+    serial_read_reset(&view);
+    CU_ASSERT(!serial_error(&view));
+    CU_ASSERT(serial_read_int32(&view) == 0);
+    CU_ASSERT(serial_error(&view));
+
+    // A varint that is cut off in the middle
+    serial_create_view(&view, ser.data, 2);
+    serial_read_varint(&view);
+    CU_ASSERT(serial_error(&view));
+
+    serial_read_reset(&ser);
+    CU_ASSERT(serial_read_int32(&ser) == -1);
+    CU_ASSERT(serial_read_int8(&ser) == 0x40);
+    CU_ASSERT(!serial_error(&ser));
+    CU_ASSERT(serial_read_int8(&ser) == 0);
+    CU_ASSERT(serial_error(&ser));
+    serial_free(&ser);
+}
+
+void serial_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for fixed size records", test_serial_block) == NULL) { return; }
+    if(CU_add_test(suite, "Test for reading past the end", test_serial_truncated) == NULL) { return; }
+}
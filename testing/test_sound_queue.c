@@ -0,0 +1,68 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <audio/sound_queue.h>
+
+void test_sound_queue_merge(void) {
+    sound_queue q;
+    sound_queue_clear(&q);
+    for(int i = 0; i < 10; i++) {
+        sound_queue_add(&q, 5, 0.2f, 0.5f, 1.0f);
+    }
+    sound_queue_add(&q, 5, 0.2f, -0.5f, 1.0f); // Other side
+    sound_queue_add(&q, 5, 0.2f, 0.5f, 1.5f); // Other pitch
+    sound_queue_add(&q, 6, 0.2f, 0.5f, 1.0f);
+    CU_ASSERT(q.count == 4);
+    CU_ASSERT(q.sounds[0].triggers == 10);
+    CU_ASSERT(q.sounds[0].volume == 1.0f);
+    CU_ASSERT(q.sounds[0].panning > 0.49f && q.sounds[0].panning < 0.51f);
+
+    // Nearby panning merges, weighted by volume
+    sound_queue_clear(&q);
+    sound_queue_add(&q, 1, 0.3f, 0.0f, 1.0f);
+    sound_queue_add(&q, 1, 0.1f, 0.1f, 1.0f);
+    CU_ASSERT(q.count == 1);
+    CU_ASSERT(q.sounds[0].panning > 0.02f && q.sounds[0].panning < 0.03f);
+
+    // Both edges of a bucket merge, however the panning moves in between
+    sound_queue_clear(&q);
+    for(int i = 0; i < 4; i++) {
+        sound_queue_add(&q, 1, 0.1f, 0.0f, 1.0f);
+        sound_queue_add(&q, 1, 0.1f + i * 0.1f, 0.249f, 1.0f);
+    }
+    CU_ASSERT(q.count == 1);
+    CU_ASSERT(q.sounds[0].triggers == 8);
+    sound_queue_add(&q, 1, 0.1f, 0.25f, 1.0f);
+    sound_queue_add(&q, 1, 0.1f, -0.001f, 1.0f);
+    CU_ASSERT(q.count == 3);
+}
+
+void test_sound_queue_limits(void) {
+    sound_queue q;
+    sound_queue_clear(&q);
+    sound_queue_add(&q, 1, 0.1f, -1.0f, 1.0f);
+    sound_queue_add(&q, 1, 0.5f, 0.0f, 1.0f);
+    sound_queue_add(&q, 2, 0.4f, 0.0f, 1.0f);
+    sound_queue_add(&q, 1, 0.3f, 1.0f, 1.0f);
+    CU_ASSERT(sound_queue_finish(&q) == 3);
+    CU_ASSERT(q.sounds[0].id == 1 && q.sounds[0].volume == 0.5f);
+    CU_ASSERT(q.sounds[1].id == 2);
+    CU_ASSERT(q.sounds[2].id == 1 && q.sounds[2].volume == 0.3f);
+
+    // Only the loudest sounds of a tick are kept, in trigger order
+    sound_queue_clear(&q);
+    for(int i = 0; i < SOUND_QUEUE_SIZE + 4; i++) {
+        sound_queue_add(&q, i, (i % 10) / 10.0f, 0.0f, 1.0f);
+    }
+    CU_ASSERT(q.count == SOUND_QUEUE_SIZE);
+    CU_ASSERT(sound_queue_finish(&q) == SOUND_QUEUE_VOICES);
+    for(int i = 0; i < q.count; i++) {
+        CU_ASSERT(q.sounds[i].volume > 0.65f);
+        CU_ASSERT(i == 0 || q.sounds[i].id > q.sounds[i - 1].id);
+    }
+}
+
+void sound_queue_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for merging sounds", test_sound_queue_merge) == NULL) { return; }
+    if(CU_add_test(suite, "Test for sound limits", test_sound_queue_limits) == NULL) { return; }
+}
@@ -0,0 +1,109 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <game/utils/state_history.h>
+#include <string.h>
+
+#define TEST_STATE_SIZE 200
+#define TEST_HISTORY_STATES 100
+
+// A state that changes a little every tick, like a game state does
+static void test_make_state(serial *ser, unsigned int tick) {
+    char data[TEST_STATE_SIZE];
+    for(int i = 0; i < TEST_STATE_SIZE; i++) {
+        data[i] = i;
+    }
+    memcpy(data, &tick, sizeof(tick));
+    data[100 + tick % 50] ^= tick;
+    serial_clear(ser);
+    serial_write(ser, data, TEST_STATE_SIZE);
+}
+
+static int test_state_matches(state_history *h, unsigned int tick, unsigned int expect) {
+    serial out, ref;
+    serial_create(&out);
+    serial_create(&ref);
+    test_make_state(&ref, expect);
+    int ok = state_history_get(h, tick, &out) == 0 && out.len == ref.len && memcmp(out.data, ref.data, ref.len) == 0;
+    serial_free(&out);
+    serial_free(&ref);
+    return ok;
+}
+
+void test_state_history_get(void) {
+    state_history h;
+    serial ser;
+    serial_create(&ser);
+    state_history_create(&h, TEST_HISTORY_STATES);
+    CU_ASSERT(state_history_get(&h, 0, &ser) == 1);
+    for(unsigned int t = 0; t < 80; t++) {
+        test_make_state(&ser, t);
+        state_history_add(&h, t, &ser);
+    }
+    CU_ASSERT(state_history_size(&h) == 80);
+    CU_ASSERT(test_state_matches(&h, 0, 0));
+    CU_ASSERT(test_state_matches(&h, 45, 45));
+    CU_ASSERT(test_state_matches(&h, 79, 79));
+    CU_ASSERT(test_state_matches(&h, 1000, 79));
+
+    // Deltas are much smaller than whole states
+    CU_ASSERT(h.bytes < 80 * TEST_STATE_SIZE / 2);
+    state_history_free(&h);
+    serial_free(&ser);
+}
+
+void test_state_history_full(void) {
+    state_history h;
+    serial ser;
+    serial_create(&ser);
+    state_history_create(&h, TEST_HISTORY_STATES);
+    for(unsigned int t = 0; t < 1000; t++) {
+        test_make_state(&ser, t);
+        state_history_add(&h, t, &ser);
+    }
+    CU_ASSERT(state_history_size(&h) <= TEST_HISTORY_STATES);
+    CU_ASSERT(state_history_size(&h) > TEST_HISTORY_STATES - STATE_HISTORY_KEYFRAME_INTERVAL);
+    CU_ASSERT(test_state_matches(&h, 999, 999));
+    CU_ASSERT(test_state_matches(&h, 950, 950));
+
+    // Too far back gives the oldest one left, the first one is kept for resets
+    unsigned int oldest = 1000 - state_history_size(&h);
+    CU_ASSERT(test_state_matches(&h, 0, oldest));
+    serial ref;
+    serial_create(&ref);
+    test_make_state(&ref, 0);
+    const serial *start = state_history_start(&h);
+    CU_ASSERT(start != NULL && start->len == ref.len && memcmp(start->data, ref.data, ref.len) == 0);
+    serial_free(&ref);
+    state_history_free(&h);
+    serial_free(&ser);
+}
+
+void test_state_history_rewind(void) {
+    state_history h;
+    serial ser;
+    serial_create(&ser);
+    state_history_create(&h, TEST_HISTORY_STATES);
+    for(unsigned int t = 0; t < 50; t++) {
+        test_make_state(&ser, t);
+        state_history_add(&h, t, &ser);
+    }
+
+    // Going back to tick 20 and playing on drops what came after it
+    for(unsigned int t = 20; t < 30; t++) {
+        test_make_state(&ser, t + 1000);
+        state_history_add(&h, t, &ser);
+    }
+    CU_ASSERT(state_history_size(&h) == 30);
+    CU_ASSERT(test_state_matches(&h, 19, 19));
+    CU_ASSERT(test_state_matches(&h, 25, 1025));
+    CU_ASSERT(test_state_matches(&h, 40, 1029));
+    state_history_free(&h);
+    serial_free(&ser);
+}
+
+void state_history_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for state history get", test_state_history_get) == NULL) { return; }
+    if(CU_add_test(suite, "Test for state history when full", test_state_history_full) == NULL) { return; }
+    if(CU_add_test(suite, "Test for state history after a rewind", test_state_history_rewind) == NULL) { return; }
+}
@@ -85,6 +85,35 @@ void test_str_free(void) {
     CU_ASSERT_PTR_NULL(m.data);
 }
 
+void test_str_reserve(void) {
+    str s;
+    str_create(&s);
+    for(int i = 0; i < 100; i++) {
+        str_append_c(&s, "x");
+    }
+    CU_ASSERT(str_size(&s) == 100);
+    CU_ASSERT(s.capacity > 100);
+    CU_ASSERT(s.data[100] == 0);
+    size_t capacity = s.capacity;
+    str_reserve(&s, 50);
+    CU_ASSERT(s.capacity == capacity);
+    str_free(&s);
+    CU_ASSERT(s.capacity == 0);
+}
+
+void test_str_view(void) {
+    str s;
+    str_create_from_cstr(&s, "prefix_rest");
+    str_view v = str_view_of(&s);
+    CU_ASSERT(v.len == 11);
+    CU_ASSERT(str_view_starts_with(v, str_view_from_cstr("prefix")));
+    CU_ASSERT_FALSE(str_view_starts_with(v, str_view_from_cstr("rest")));
+    CU_ASSERT(str_view_equal(str_view_sub(v, 7, 11), str_view_from_cstr("rest")));
+    CU_ASSERT(str_view_sub(v, 7, 100).len == 4);
+    CU_ASSERT(str_view_equal(str_view_from_cstr(NULL), str_view_from_cstr("")));
+    str_free(&s);
+}
+
 void str_test_suite(CU_pSuite suite) {
     // Add tests
     if(CU_add_test(suite, "Test for string create from C string", test_str_cstr) == NULL) { return; }
@@ -100,4 +129,6 @@ void str_test_suite(CU_pSuite suite) {
     if(CU_add_test(suite, "Test for string equals", test_last_of) == NULL) { return; }
 
     if(CU_add_test(suite, "Test for string free operation", test_str_free) == NULL) { return; }
+    if(CU_add_test(suite, "Test for string capacity growth", test_str_reserve) == NULL) { return; }
+    if(CU_add_test(suite, "Test for string views", test_str_view) == NULL) { return; }
 }
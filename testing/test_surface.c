@@ -0,0 +1,265 @@
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <video/surface.h>
+
+#define TEST_W 37
+#define TEST_H 23
+
+// Sprite-like surface: a few runs per row, transparent pixels are 0
+static void test_fill_sprite(surface *sur, int colors) {
+    surface_create(sur, SURFACE_TYPE_PALETTE, TEST_W, TEST_H);
+    for(int y = 0; y < TEST_H; y++) {
+        for(int x = 0; x < TEST_W; x++) {
+            int i = x + y * TEST_W;
+            int solid = ((x + y) % 7 < 4) && x != y;
+            sur->stencil[i] = solid;
+            sur->data[i] = solid ? 1 + (x * 3 + y) % colors : 0;
+        }
+    }
+}
+
+// One copy keeps the byte stencil and full pixels, the other is packed
+static void test_make_pair(surface *full, surface *packed, int colors) {
+    test_fill_sprite(full, colors);
+    surface_copy(packed, full);
+    surface_build_rle(packed);
+    surface_build_hitmask(packed);
+    surface_pack_stencil(packed);
+    surface_pack_pixels(packed);
+}
+
+void test_surface_pack_pixels(void) {
+    surface full, packed;
+    char px[TEST_W * TEST_H];
+    char st[TEST_W * TEST_H];
+    test_make_pair(&full, &packed, 200);
+    CU_ASSERT(packed.rle_pixels);
+    surface_read_pixels(&packed, px, 0, TEST_W * TEST_H);
+    surface_read_stencil(&packed, st, 0, TEST_W * TEST_H);
+    CU_ASSERT(memcmp(px, full.data, TEST_W * TEST_H) == 0);
+    CU_ASSERT(memcmp(st, full.stencil, TEST_W * TEST_H) == 0);
+
+    // Partial reads across row ends
+    surface_read_pixels(&packed, px, TEST_W - 5, TEST_W + 9);
+    CU_ASSERT(memcmp(px, full.data + TEST_W - 5, TEST_W + 9) == 0);
+
+    // Writing brings back the full pixels
+    surface_make_writable(&packed);
+    CU_ASSERT(!packed.rle_pixels);
+    CU_ASSERT(memcmp(packed.data, full.data, TEST_W * TEST_H) == 0);
+    surface_free(&full);
+    surface_free(&packed);
+}
+
+void test_surface_pack_pixels_not_zero(void) {
+    surface sur;
+    test_fill_sprite(&sur, 200);
+    sur.data[1] = 5; // Hidden by the stencil, but not 0
+    sur.stencil[1] = 0;
+    surface_build_rle(&sur);
+    surface_build_hitmask(&sur);
+    surface_pack_stencil(&sur);
+    surface_pack_pixels(&sur);
+    CU_ASSERT(!sur.rle_pixels);
+    surface_free(&sur);
+}
+
+static void test_blit_pair(int additive, SDL_RendererFlip flip, int x, int y) {
+    surface full, packed, dst_a, dst_b;
+    palette remap_pal;
+    for(int k = 0; k < 19; k++) {
+        for(int i = 0; i < 256; i++) {
+            remap_pal.remaps[k][i] = (i * 7 + k) & 0xFF;
+        }
+    }
+    test_make_pair(&full, &packed, additive ? 12 : 200);
+    surface_create(&dst_a, SURFACE_TYPE_PALETTE, 64, 48);
+    surface_create(&dst_b, SURFACE_TYPE_PALETTE, 64, 48);
+    for(int i = 0; i < 64 * 48; i++) {
+        dst_a.data[i] = dst_b.data[i] = i & 0xFF;
+        dst_a.stencil[i] = dst_b.stencil[i] = (i % 3) != 0;
+    }
+    if(additive) {
+        surface_additive_blit(&dst_a, &full, x, y, &remap_pal, flip);
+        surface_additive_blit(&dst_b, &packed, x, y, &remap_pal, flip);
+    } else {
+        surface_alpha_blit(&dst_a, &full, x, y, flip);
+        surface_alpha_blit(&dst_b, &packed, x, y, flip);
+    }
+    CU_ASSERT(memcmp(dst_a.data, dst_b.data, 64 * 48) == 0);
+    CU_ASSERT(memcmp(dst_a.stencil, dst_b.stencil, 64 * 48) == 0);
+    surface_free(&full);
+    surface_free(&packed);
+    surface_free(&dst_a);
+    surface_free(&dst_b);
+}
+
+void test_surface_packed_alpha_blit(void) {
+    test_blit_pair(0, SDL_FLIP_NONE, 5, 3);
+    test_blit_pair(0, SDL_FLIP_HORIZONTAL, 5, 3);
+    test_blit_pair(0, SDL_FLIP_HORIZONTAL | SDL_FLIP_VERTICAL, -7, 30); // Clipped
+}
+
+void test_surface_packed_additive_blit(void) {
+    test_blit_pair(1, SDL_FLIP_NONE, 5, 3);
+    test_blit_pair(1, SDL_FLIP_HORIZONTAL, 40, -4); // Clipped
+}
+
+void test_surface_packed_to_rgba(void) {
+    surface full, packed;
+    screen_palette pal;
+    palette_lut lut;
+    static char rgba_a[TEST_W * TEST_H * 4];
+    static char rgba_b[TEST_W * TEST_H * 4];
+    memset(&pal, 0, sizeof(screen_palette));
+    for(int i = 0; i < 256; i++) {
+        pal.data[i][0] = i;
+        pal.data[i][1] = 255 - i;
+        pal.data[i][2] = i / 2;
+    }
+    surface_build_lut(&lut, &pal, NULL, 0);
+    test_make_pair(&full, &packed, 200);
+    surface_to_rgba_lut(&full, rgba_a, &lut);
+    surface_to_rgba_lut(&packed, rgba_b, &lut);
+    CU_ASSERT(memcmp(rgba_a, rgba_b, sizeof(rgba_a)) == 0);
+    surface_free(&full);
+    surface_free(&packed);
+}
+
+// Copies a 20x15 area from 3,4 to 6,2 and checks it pixel by pixel
+static void test_sub_check(surface *src, const surface *ref, int method) {
+    surface dst;
+    surface_create(&dst, SURFACE_TYPE_PALETTE, TEST_W, TEST_H);
+    surface_sub(&dst, src, 6, 2, 3, 4, 20, 15, method);
+    int ok = 1;
+    for(int y = 0; y < 15; y++) {
+        for(int x = 0; x < 20; x++) {
+            int sx = (method == SUB_METHOD_MIRROR) ? 3 + 19 - x : 3 + x;
+            int s = sx + (4 + y) * TEST_W;
+            int d = 6 + x + (2 + y) * TEST_W;
+            ok = ok && dst.data[d] == ref->data[s] && dst.stencil[d] == ref->stencil[s];
+        }
+    }
+    CU_ASSERT(ok);
+    surface_free(&dst);
+}
+
+void test_surface_sub(void) {
+    surface full, packed;
+    test_make_pair(&full, &packed, 200);
+    test_sub_check(&full, &full, SUB_METHOD_NONE);
+    test_sub_check(&full, &full, SUB_METHOD_MIRROR);
+    test_sub_check(&packed, &full, SUB_METHOD_NONE);
+    test_sub_check(&packed, &full, SUB_METHOD_MIRROR);
+    surface_free(&full);
+    surface_free(&packed);
+}
+
+// The second player's bank replaces the HAR colors only
+void test_surface_palette_bank(void) {
+    screen_palette pal;
+    memset(&pal, 0, sizeof(pal));
+    for(int i = 0; i < 256; i++) {
+        pal.data[i][0] = i;
+    }
+    palette_lut lut;
+    surface_build_lut(&lut, &pal, NULL, palette_bank_offset(1));
+    int ok = 1;
+    for(int i = 0; i < 256; i++) {
+        ok = ok && lut.data[i][0] == ((i < PLAYER_PALETTE_SIZE) ? i + PLAYER_PALETTE_SIZE : i);
+    }
+    CU_ASSERT(ok);
+
+    // The palette's own table for the bank agrees
+    const palette_lut *bank = screen_palette_get_lut(&pal, palette_bank_offset(1));
+    CU_ASSERT(bank != NULL && memcmp(bank->data, lut.data, sizeof(lut.data)) == 0);
+    CU_ASSERT(screen_palette_get_lut(&pal, 7) == NULL);
+
+    palette_mask mask;
+    palette_mask_clear(&mask);
+    palette_mask_set(&mask, 200);
+    CU_ASSERT(!palette_mask_any(&mask, 0, PLAYER_PALETTE_SIZE));
+    palette_mask_set(&mask, 40);
+    CU_ASSERT(palette_mask_any(&mask, 0, PLAYER_PALETTE_SIZE));
+    CU_ASSERT(!palette_mask_any(&mask, 41, 100));
+}
+
+// Alpha surfaces draw in the tint color, and expand to white
+void test_surface_alpha_tint(void) {
+    surface src, dst;
+    surface_create(&src, SURFACE_TYPE_ALPHA, 4, 3);
+    for(int i = 0; i < 12; i++) {
+        src.data[i] = (i % 3 == 0) ? 0 : (char)0xFF;
+    }
+    surface_create(&dst, SURFACE_TYPE_RGBA, 8, 8);
+    surface_fill(&dst, color_create(10, 20, 30, 0));
+
+    // Clipped at the top left corner; the top row and left column are out
+    int y0, y1;
+    color c = color_create(200, 100, 50, 255);
+    CU_ASSERT(surface_alpha_tint_blit(&dst, &src, -1, -1, 0, 0, 4, 3, 255, c, 0, &y0, &y1));
+    CU_ASSERT(y0 == 0 && y1 == 2);
+    const uint8_t *d = (const uint8_t*)dst.data;
+    // src (1,1) is index 5: covered
+    CU_ASSERT(d[0] == 200 && d[1] == 100 && d[2] == 50 && d[3] == 255);
+    // src (2,1) is index 6: clear, so dst is as it was
+    CU_ASSERT(d[4] == 10 && d[5] == 20 && d[6] == 30 && d[7] == 0);
+    // Outside the glyph
+    CU_ASSERT(d[(3 * 8 + 3) * 4 + 3] == 0);
+
+    // Half opacity blends
+    CU_ASSERT(surface_alpha_tint_blit(&dst, &src, 4, 4, 1, 1, 1, 1, 128, c, 0, &y0, &y1));
+    const uint8_t *h = d + (4 * 8 + 4) * 4;
+    CU_ASSERT(h[0] == (200 * 128 + 10 * 127) / 255 && h[3] == 128);
+    CU_ASSERT(!surface_alpha_tint_blit(&dst, &src, 8, 0, 0, 0, 4, 3, 255, c, 0, &y0, &y1));
+
+    char rgba[12 * 4];
+    surface_to_rgba(&src, rgba, NULL, NULL, 0);
+    CU_ASSERT((uint8_t)rgba[4] == 0xFF && (uint8_t)rgba[7] == 0xFF);
+    CU_ASSERT(rgba[0] == 0 && rgba[3] == 0);
+    surface_free(&src);
+    surface_free(&dst);
+}
+
+// Borrowed buffers are read in place and copied on write, never freed
+void test_surface_borrowed(void) {
+    surface full, packed, borrowed, copy;
+    char px[TEST_W * TEST_H];
+    test_make_pair(&full, &packed, 200);
+    surface_create_borrowed(&borrowed, &packed);
+    CU_ASSERT(borrowed.data == packed.data && borrowed.rle == packed.rle);
+    surface_read_pixels(&borrowed, px, 0, TEST_W * TEST_H);
+    CU_ASSERT(memcmp(px, full.data, TEST_W * TEST_H) == 0);
+
+    surface_share(&copy, &borrowed);
+    CU_ASSERT(copy.refs == NULL);
+    surface_free(&copy);
+    CU_ASSERT(copy.data == NULL);
+
+    surface_make_writable(&borrowed);
+    CU_ASSERT(!borrowed.borrowed && borrowed.data != packed.data);
+    CU_ASSERT(borrowed.stencil != NULL);
+    CU_ASSERT(memcmp(borrowed.data, full.data, TEST_W * TEST_H) == 0);
+    CU_ASSERT(memcmp(borrowed.stencil, full.stencil, TEST_W * TEST_H) == 0);
+    surface_free(&borrowed);
+
+    // The owner still has everything
+    surface_read_pixels(&packed, px, 0, TEST_W * TEST_H);
+    CU_ASSERT(memcmp(px, full.data, TEST_W * TEST_H) == 0);
+    surface_free(&full);
+    surface_free(&packed);
+}
+
+void surface_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for packing surface pixels", test_surface_pack_pixels) == NULL) { return; }
+    if(CU_add_test(suite, "Test for packing with visible transparency", test_surface_pack_pixels_not_zero) == NULL) { return; }
+    if(CU_add_test(suite, "Test for alpha blits of packed pixels", test_surface_packed_alpha_blit) == NULL) { return; }
+    if(CU_add_test(suite, "Test for additive blits of packed pixels", test_surface_packed_additive_blit) == NULL) { return; }
+    if(CU_add_test(suite, "Test for converting packed pixels", test_surface_packed_to_rgba) == NULL) { return; }
+    if(CU_add_test(suite, "Test for copying surface areas", test_surface_sub) == NULL) { return; }
+    if(CU_add_test(suite, "Test for player palette banks", test_surface_palette_bank) == NULL) { return; }
+    if(CU_add_test(suite, "Test for tinted alpha surfaces", test_surface_alpha_tint) == NULL) { return; }
+    if(CU_add_test(suite, "Test for borrowed surface buffers", test_surface_borrowed) == NULL) { return; }
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <SDL2/SDL.h>
+#include <video/tcache.h>
+
+#define TEST_W 24
+#define TEST_H 16
+
+static void test_tcache_palette(screen_palette *pal) {
+    memset(pal, 0, sizeof(screen_palette));
+    for(int i = 0; i < 256; i++) {
+        pal->data[i][0] = i;
+        pal->data[i][1] = 255 - i;
+        pal->data[i][2] = i / 2;
+    }
+    pal->version = 1;
+}
+
+// Like a freshly decoded sprite
+static void test_tcache_sprite(surface *sur, char color) {
+    surface_create(sur, SURFACE_TYPE_PALETTE, TEST_W, TEST_H);
+    memset(sur->data, color, TEST_W * TEST_H);
+    memset(sur->stencil, 1, TEST_W * TEST_H);
+}
+
+void test_tcache_new_on_page(void) {
+    surface a, b;
+    SDL_Rect ra, rb;
+    tcache_stats stats;
+    screen_palette pal;
+
+    // A software renderer needs no window, so the cache can be run headless
+    SDL_Surface *target = SDL_CreateRGBSurface(0, 64, 64, 32, 0, 0, 0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(target);
+    SDL_Renderer *renderer = SDL_CreateSoftwareRenderer(target);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(renderer);
+    tcache_init(renderer, 1, NULL);
+    test_tcache_palette(&pal);
+    test_tcache_sprite(&a, 10);
+    test_tcache_sprite(&b, 20);
+    CU_ASSERT(a.force_refresh);
+
+    // New surfaces share an atlas page
+    SDL_Texture *ta = tcache_get(&a, &pal, NULL, 0, &ra);
+    SDL_Texture *tb = tcache_get(&b, &pal, NULL, 0, &rb);
+    CU_ASSERT_PTR_NOT_NULL(ta);
+    CU_ASSERT(ta == tb);
+    CU_ASSERT(ra.x != rb.x || ra.y != rb.y);
+    tcache_get_stats(&stats);
+    CU_ASSERT(stats.streaming == 0);
+
+    // Only a rebuild moves one off the page
+    surface_force_refresh(&a);
+    ta = tcache_get(&a, &pal, NULL, 0, &ra);
+    CU_ASSERT(ta != tb);
+    CU_ASSERT(ra.x == 0 && ra.y == 0);
+    tcache_get_stats(&stats);
+    CU_ASSERT(stats.streaming == 1);
+
+    tcache_forget(&a);
+    tcache_forget(&b);
+    surface_free(&a);
+    surface_free(&b);
+    tcache_close();
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+}
+
+void tcache_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for placing new textures on atlas pages", test_tcache_new_on_page) == NULL) { return; }
+}
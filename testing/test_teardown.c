@@ -0,0 +1,57 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <utils/teardown.h>
+
+// Counts down to zero, a step at a time
+static int test_teardown_step(void *data) {
+    int *steps = data;
+    (*steps)--;
+    return *steps > 0;
+}
+
+void test_teardown_uninit(void) {
+    // Without a queue, frees are done right away
+    int steps = 3;
+    teardown_push(test_teardown_step, &steps);
+    CU_ASSERT(steps == 0);
+    CU_ASSERT(teardown_pending() == 0);
+}
+
+void test_teardown_budget(void) {
+    int a = 3;
+    int b = 2;
+    teardown_init();
+    teardown_push(test_teardown_step, &a);
+    teardown_push(test_teardown_step, &b);
+    CU_ASSERT(teardown_pending() == 2);
+    CU_ASSERT(a == 3);
+
+    // With no time at all, one step is still taken, and the oldest goes first
+    CU_ASSERT(teardown_run(0) == 2);
+    CU_ASSERT(a == 2);
+    CU_ASSERT(b == 2);
+    teardown_run(0);
+    CU_ASSERT(teardown_run(0) == 1);
+    CU_ASSERT(a == 0);
+    CU_ASSERT(b == 2);
+
+    teardown_flush();
+    CU_ASSERT(b == 0);
+    CU_ASSERT(teardown_pending() == 0);
+    CU_ASSERT(teardown_run(0) == 0);
+}
+
+void test_teardown_close(void) {
+    int steps = 5;
+    teardown_push(test_teardown_step, &steps);
+    teardown_close();
+    CU_ASSERT(steps == 0);
+    CU_ASSERT(teardown_pending() == 0);
+}
+
+void teardown_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for teardown without a queue", test_teardown_uninit) == NULL) { return; }
+    if(CU_add_test(suite, "Test for teardown budget", test_teardown_budget) == NULL) { return; }
+    if(CU_add_test(suite, "Test for teardown close", test_teardown_close) == NULL) { return; }
+}
@@ -79,6 +79,24 @@ void test_vector_delete(void) {
     CU_ASSERT_PTR_NULL(iter_next(&it));
 }
 
+static int remove_odd(void *item, void *userdata) {
+    return (*(int*)item) % 2;
+}
+
+void test_vector_remove_if(void) {
+    for(int i = 0; i < TEST_VAL_COUNT; i++) {
+        vector_append(&test_vector, &i);
+    }
+    CU_ASSERT(vector_remove_if(&test_vector, remove_odd, NULL) == TEST_VAL_COUNT/2);
+    CU_ASSERT(vector_size(&test_vector) == TEST_VAL_COUNT/2);
+
+    // Remaining entries keep their order
+    for(int i = 0; i < TEST_VAL_COUNT/2; i++) {
+        CU_ASSERT(*((int*)vector_get(&test_vector, i)) == i*2);
+    }
+    vector_clear(&test_vector);
+}
+
 void vector_test_suite(CU_pSuite suite) {
     // Add tests
     if(CU_add_test(suite, "Test for vector create", test_vector_create) == NULL) { return; }
@@ -87,5 +105,6 @@ void vector_test_suite(CU_pSuite suite) {
     if(CU_add_test(suite, "Test for vector get", test_vector_get) == NULL) { return; }
     if(CU_add_test(suite, "Test for vector iterator", test_vector_iterator) == NULL) { return; }
     if(CU_add_test(suite, "Test for vector delete", test_vector_delete) == NULL) { return; }
+    if(CU_add_test(suite, "Test for vector remove_if", test_vector_remove_if) == NULL) { return; }
     if(CU_add_test(suite, "Test for vector free operation", test_vector_free) == NULL) { return; }
 }